@@ -11,7 +11,8 @@
 
 /** AES mode */
 enum aes_mode {
-	AES_MODE_CTR  /**< AES Counter mode (CTR) */
+	AES_MODE_CTR,  /**< AES Counter mode (CTR)        */
+	AES_MODE_GCM,  /**< AES Galois Counter Mode (GCM) */
 };
 
 struct aes;
@@ -22,3 +23,5 @@ int  aes_alloc(struct aes **stp, enum aes_mode mode,
 void aes_set_iv(struct aes *aes, const uint8_t iv[AES_BLOCK_SIZE]);
 int  aes_encr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len);
 int  aes_decr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len);
+int  aes_get_authtag(struct aes *aes, uint8_t *tag, size_t taglen);
+int  aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen);
@@ -40,6 +40,7 @@ void    *mem_reallocarray(void *ptr, size_t nmemb,
 void    *mem_ref(void *data);
 void    *mem_deref(void *data);
 uint32_t mem_nrefs(const void *data);
+size_t   mem_size(const void *data);
 
 void     mem_debug(void);
 void     mem_threshold_set(ssize_t n);
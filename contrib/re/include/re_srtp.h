@@ -10,6 +10,8 @@ enum srtp_suite {
 	SRTP_AES_CM_128_HMAC_SHA1_80,
 	SRTP_AES_256_CM_HMAC_SHA1_32,
 	SRTP_AES_256_CM_HMAC_SHA1_80,
+	SRTP_AES_128_GCM,
+	SRTP_AES_256_GCM,
 };
 
 enum srtp_flags {
@@ -24,5 +26,10 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb);
 int srtp_decrypt(struct srtp *srtp, struct mbuf *mb);
 int srtcp_encrypt(struct srtp *srtp, struct mbuf *mb);
 int srtcp_decrypt(struct srtp *srtp, struct mbuf *mb);
+int srtp_encrypt_batch(struct srtp *srtp, struct mbuf * const *mbv, size_t n,
+		       int *errv);
+int srtp_decrypt_batch(struct srtp *srtp, struct mbuf * const *mbv, size_t n,
+		       int *errv);
 
 const char *srtp_suite_name(enum srtp_suite suite);
+size_t srtp_suite_key_size(enum srtp_suite suite);
@@ -7,6 +7,7 @@
 
 struct tls;
 struct tls_conn;
+struct tls_session;
 struct tcp_conn;
 struct udp_sock;
 
@@ -55,6 +56,9 @@ int tls_srtp_keyinfo(const struct tls_conn *tc, enum srtp_suite *suite,
 const char *tls_cipher_name(const struct tls_conn *tc);
 int tls_set_ciphers(struct tls *tls, const char *cipherv[], size_t count);
 int tls_set_servername(struct tls_conn *tc, const char *servername);
+int tls_set_session_reuse(struct tls *tls, bool enabled);
+int tls_get_session(struct tls_session **sessp, const struct tls_conn *tc);
+bool tls_session_reused(const struct tls_conn *tc);
 
 
 /* TCP */
@@ -81,6 +85,11 @@ int dtls_connect(struct tls_conn **ptc, struct tls *tls,
 		 struct dtls_sock *sock, const struct sa *peer,
 		 dtls_estab_h *estabh, dtls_recv_h *recvh,
 		 dtls_close_h *closeh, void *arg);
+int dtls_resume(struct tls_conn **ptc, struct tls *tls,
+		struct dtls_sock *sock, const struct sa *peer,
+		const struct tls_session *sess,
+		dtls_estab_h *estabh, dtls_recv_h *recvh,
+		dtls_close_h *closeh, void *arg);
 int dtls_accept(struct tls_conn **ptc, struct tls *tls,
 		struct dtls_sock *sock,
 		dtls_estab_h *estabh, dtls_recv_h *recvh,
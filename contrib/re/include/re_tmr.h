@@ -37,6 +37,32 @@ struct tmr {
 	tmr_start_real((tmr), (delay), (th), (arg), __FILE__, __LINE__)
 
 
+/**
+ * Defines a clock that replaces the system clock for the timers of a
+ * thread
+ *
+ * @param arg Handler argument
+ *
+ * @return Current time in [ms]
+ */
+typedef uint64_t (tmr_clock_h)(void *arg);
+
+/**
+ * Called by the main loop when it is idle with a virtual clock
+ *
+ * @param next Time until the next timer expires in [ms], 0 if none
+ * @param arg  Handler argument
+ */
+typedef void (tmr_idle_h)(uint64_t next, void *arg);
+
+/** Virtual clock of a thread */
+struct tmr_clock {
+	tmr_clock_h *clockh;  /**< Clock handler, NULL for the system clock */
+	tmr_idle_h *idleh;    /**< Idle handler                          */
+	void *arg;            /**< Handler argument                      */
+};
+
+
 void     tmr_poll(struct list *tmrl);
 uint64_t tmr_jiffies(void);
 uint64_t tmr_next_timeout(struct list *tmrl);
@@ -49,6 +75,9 @@ void     tmr_start_real(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg,
 void     tmr_cancel(struct tmr *tmr);
 uint64_t tmr_get_expire(const struct tmr *tmr);
 
+void     tmr_set_clock(tmr_clock_h *clockh, tmr_idle_h *idleh, void *arg);
+bool     tmr_clock_isvirtual(void);
+
 
 /**
  * Check if the timer is running
@@ -16,8 +16,16 @@
 #ifdef EVP_CIPH_CTR_MODE
 
 
+enum {
+	GCM_IV_SIZE = 12,
+};
+
+
 struct aes {
 	EVP_CIPHER_CTX *ctx;
+	enum aes_mode mode;
+	uint8_t iv[AES_BLOCK_SIZE];
+	int enc;    /* GCM: direction of the current message, -1 if none */
 };
 
 
@@ -36,6 +44,33 @@ static void destructor(void *arg)
 }
 
 
+static const EVP_CIPHER *aes_cipher(enum aes_mode mode, size_t key_bits)
+{
+	switch (mode) {
+
+	case AES_MODE_CTR:
+		switch (key_bits) {
+
+		case 128: return EVP_aes_128_ctr();
+		case 192: return EVP_aes_192_ctr();
+		case 256: return EVP_aes_256_ctr();
+		default:  return NULL;
+		}
+
+	case AES_MODE_GCM:
+		switch (key_bits) {
+
+		case 128: return EVP_aes_128_gcm();
+		case 256: return EVP_aes_256_gcm();
+		default:  return NULL;
+		}
+
+	default:
+		return NULL;
+	}
+}
+
+
 int aes_alloc(struct aes **aesp, enum aes_mode mode,
 	      const uint8_t *key, size_t key_bits,
 	      const uint8_t iv[AES_BLOCK_SIZE])
@@ -47,13 +82,16 @@ int aes_alloc(struct aes **aesp, enum aes_mode mode,
 	if (!aesp || !key)
 		return EINVAL;
 
-	if (mode != AES_MODE_CTR)
+	if (mode != AES_MODE_CTR && mode != AES_MODE_GCM)
 		return ENOTSUP;
 
 	st = mem_zalloc(sizeof(*st), destructor);
 	if (!st)
 		return ENOMEM;
 
+	st->mode = mode;
+	st->enc = -1;
+
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
 	st->ctx = EVP_CIPHER_CTX_new();
 	if (!st->ctx) {
@@ -72,17 +110,17 @@ int aes_alloc(struct aes **aesp, enum aes_mode mode,
 	EVP_CIPHER_CTX_init(st->ctx);
 #endif
 
-	switch (key_bits) {
-
-	case 128: cipher = EVP_aes_128_ctr(); break;
-	case 192: cipher = EVP_aes_192_ctr(); break;
-	case 256: cipher = EVP_aes_256_ctr(); break;
-	default:
+	cipher = aes_cipher(mode, key_bits);
+	if (!cipher) {
 		re_fprintf(stderr, "aes: unknown key: %zu bits\n", key_bits);
 		err = EINVAL;
 		goto out;
 	}
 
+	/* the GCM IV is applied per message, see aes_set_iv() */
+	if (mode == AES_MODE_GCM)
+		iv = NULL;
+
 	r = EVP_EncryptInit_ex(st->ctx, cipher, NULL, key, iv);
 	if (!r) {
 		ERR_clear_error();
@@ -99,6 +137,10 @@ int aes_alloc(struct aes **aesp, enum aes_mode mode,
 }
 
 
+/**
+ * Set the IV. In GCM mode this starts a new message, of which only the
+ * first 12 bytes of the IV are used.
+ */
 void aes_set_iv(struct aes *aes, const uint8_t iv[AES_BLOCK_SIZE])
 {
 	int r;
@@ -106,20 +148,57 @@ void aes_set_iv(struct aes *aes, const uint8_t iv[AES_BLOCK_SIZE])
 	if (!aes || !iv)
 		return;
 
+	if (aes->mode == AES_MODE_GCM) {
+		memcpy(aes->iv, iv, GCM_IV_SIZE);
+		aes->enc = -1;
+		return;
+	}
+
 	r = EVP_EncryptInit_ex(aes->ctx, NULL, NULL, NULL, iv);
 	if (!r)
 		ERR_clear_error();
 }
 
 
-int aes_encr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
+/* The direction of a GCM message is known with its first data */
+static int gcm_begin(struct aes *aes, int enc)
+{
+	if (aes->enc == enc)
+		return 0;
+
+	if (aes->enc != -1)
+		return EPROTO;
+
+	if (!EVP_CipherInit_ex(aes->ctx, NULL, NULL, NULL, aes->iv, enc)) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	aes->enc = enc;
+
+	return 0;
+}
+
+
+static int aes_crypt(struct aes *aes, uint8_t *out, const uint8_t *in,
+		     size_t len, int enc)
 {
 	int c_len = (int)len;
+	int err;
 
-	if (!aes || !out || !in)
+	if (!aes || !in)
+		return EINVAL;
+
+	if (aes->mode == AES_MODE_GCM) {
+		err = gcm_begin(aes, enc);
+		if (err)
+			return err;
+	}
+	else if (!out) {
 		return EINVAL;
+	}
 
-	if (!EVP_EncryptUpdate(aes->ctx, out, &c_len, in, (int)len)) {
+	if (!EVP_CipherUpdate(aes->ctx, out, &c_len, in, (int)len)) {
 		ERR_clear_error();
 		return EPROTO;
 	}
@@ -128,6 +207,93 @@ int aes_encr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
 }
 
 
+/**
+ * Encrypt data. In GCM mode, passing out as NULL adds the data as
+ * Additional Authenticated Data (AAD), which must come first.
+ */
+int aes_encr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
+{
+	return aes_crypt(aes, out, in, len, 1);
+}
+
+
+int aes_decr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
+{
+	return aes_crypt(aes, out, in, len, 0);
+}
+
+
+/**
+ * Get the authentication tag of an encrypted GCM message
+ */
+int aes_get_authtag(struct aes *aes, uint8_t *tag, size_t taglen)
+{
+	uint8_t buf[AES_BLOCK_SIZE];
+	int len;
+	int err;
+
+	if (!aes || !tag || !taglen || taglen > AES_BLOCK_SIZE)
+		return EINVAL;
+
+	if (aes->mode != AES_MODE_GCM)
+		return ENOTSUP;
+
+	err = gcm_begin(aes, 1);
+	if (err)
+		return err;
+
+	if (!EVP_EncryptFinal_ex(aes->ctx, buf, &len) ||
+	    !EVP_CIPHER_CTX_ctrl(aes->ctx, EVP_CTRL_GCM_GET_TAG,
+				 (int)taglen, tag)) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	aes->enc = -1;
+
+	return 0;
+}
+
+
+/**
+ * Verify the authentication tag of a decrypted GCM message
+ *
+ * @return 0 if the tag matches, EAUTH if it does not
+ */
+int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
+{
+	uint8_t buf[AES_BLOCK_SIZE];
+	int len, r;
+	int err;
+
+	if (!aes || !tag || !taglen || taglen > AES_BLOCK_SIZE)
+		return EINVAL;
+
+	if (aes->mode != AES_MODE_GCM)
+		return ENOTSUP;
+
+	err = gcm_begin(aes, 0);
+	if (err)
+		return err;
+
+	aes->enc = -1;
+
+	if (!EVP_CIPHER_CTX_ctrl(aes->ctx, EVP_CTRL_GCM_SET_TAG,
+				 (int)taglen, (void *)tag)) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	r = EVP_DecryptFinal_ex(aes->ctx, buf, &len);
+	if (r <= 0) {
+		ERR_clear_error();
+		return EAUTH;
+	}
+
+	return 0;
+}
+
+
 #else /* EVP_CIPH_CTR_MODE */
 
 
@@ -204,15 +370,30 @@ int aes_encr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
 }
 
 
-#endif /* EVP_CIPH_CTR_MODE */
+int aes_decr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
+{
+	return aes_encr(aes, out, in, len);
+}
 
 
-/*
- * Common code:
- */
+int aes_get_authtag(struct aes *aes, uint8_t *tag, size_t taglen)
+{
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+
+	return ENOTSUP;
+}
 
 
-int aes_decr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
+int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
 {
-	return aes_encr(aes, out, in, len);
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+
+	return ENOTSUP;
 }
+
+
+#endif /* EVP_CIPH_CTR_MODE */
@@ -73,6 +73,9 @@
 #endif
 
 
+extern void tmr_clock_idle(struct list *tmrl);
+
+
 /** Main loop values */
 enum {
 	MAX_BLOCKING = 100,    /**< Maximum time spent in handler in [ms] */
@@ -99,6 +102,7 @@ struct re {
 	bool polling;                /**< Is polling flag                   */
 	int sig;                     /**< Last caught signal                */
 	struct list tmrl;            /**< List of timers                    */
+	struct tmr_clock clock;      /**< Virtual clock of the timers       */
 
 #ifdef HAVE_POLL
 	struct pollfd *fds;          /**< Event set for poll()              */
@@ -129,6 +133,7 @@ static struct re global_re = {
 	false,
 	0,
 	LIST_INIT,
+	{NULL, NULL, NULL},
 #ifdef HAVE_POLL
 	NULL,
 #endif
@@ -659,7 +664,10 @@ void fd_close(int fd)
  */
 static int fd_poll(struct re *re)
 {
-	const uint64_t to = tmr_next_timeout(&re->tmrl);
+	/* With a virtual clock, never wait for I/O */
+	const bool virt = tmr_clock_isvirtual();
+	const uint64_t to = virt ? 0 : tmr_next_timeout(&re->tmrl);
+	const bool block = !to && !virt;
 	int i, n;
 #ifdef HAVE_SELECT
 	fd_set rfds, wfds, efds;
@@ -673,7 +681,7 @@ static int fd_poll(struct re *re)
 #ifdef HAVE_POLL
 	case METHOD_POLL:
 		re_unlock(re);
-		n = poll(re->fds, re->nfds, to ? (int)to : -1);
+		n = poll(re->fds, re->nfds, block ? -1 : (int)to);
 		re_lock(re);
 		break;
 #endif
@@ -705,7 +713,7 @@ static int fd_poll(struct re *re)
 #endif
 		tv.tv_usec = (uint32_t) (to % 1000) * 1000;
 		re_unlock(re);
-		n = select(re->nfds, &rfds, &wfds, &efds, to ? &tv : NULL);
+		n = select(re->nfds, &rfds, &wfds, &efds, block ? NULL : &tv);
 		re_lock(re);
 	}
 		break;
@@ -714,7 +722,7 @@ static int fd_poll(struct re *re)
 	case METHOD_EPOLL:
 		re_unlock(re);
 		n = epoll_wait(re->epfd, re->events, re->maxfds,
-			       to ? (int)to : -1);
+			       block ? -1 : (int)to);
 		re_lock(re);
 		break;
 #endif
@@ -728,7 +736,7 @@ static int fd_poll(struct re *re)
 
 		re_unlock(re);
 		n = kevent(re->kqfd, NULL, 0, re->evlist, re->maxfds,
-			   to ? &timeout : NULL);
+			   block ? NULL : &timeout);
 		re_lock(re);
 		}
 		break;
@@ -743,6 +751,9 @@ static int fd_poll(struct re *re)
 	if (n < 0)
 		return errno;
 
+	if (virt && n == 0)
+		tmr_clock_idle(&re->tmrl);
+
 	/* Check for events */
 	for (i=0; (n > 0) && (i < re->nfds); i++) {
 		int fd, flags = 0;
@@ -1216,3 +1227,10 @@ struct list *tmrl_get(void)
 {
 	return &re_get()->tmrl;
 }
+
+
+struct tmr_clock *tmr_clock_get(void);
+struct tmr_clock *tmr_clock_get(void)
+{
+	return &re_get()->clock;
+}
@@ -361,6 +361,33 @@ uint32_t mem_nrefs(const void *data)
 }
 
 
+/**
+ * Get the size of a memory object
+ *
+ * @param data Memory object
+ *
+ * @return Size in bytes, 0 if memory debugging is disabled
+ */
+size_t mem_size(const void *data)
+{
+#if MEM_DEBUG
+	struct mem *m;
+
+	if (!data)
+		return 0;
+
+	m = ((struct mem *)data) - 1;
+
+	MAGIC_CHECK(m);
+
+	return m->size;
+#else
+	(void)data;
+	return 0;
+#endif
+}
+
+
 #if MEM_DEBUG
 static bool debug_handler(struct le *le, void *arg)
 {
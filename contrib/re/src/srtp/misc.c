@@ -86,6 +86,28 @@ void srtp_iv_calc(union vect128 *iv, const union vect128 *k_s,
 }
 
 
+/*
+ * RFC 7714 8.1.  Initialization Vector (IV)
+ *
+ * The 12 byte IV is 2 zero bytes, the SSRC and the 48-bit packet index,
+ * XOR'ed with the salt.
+ */
+void srtp_iv_calc_gcm(union vect128 *iv, const union vect128 *k_s,
+		      uint32_t ssrc, uint64_t ix)
+{
+	if (!iv || !k_s)
+		return;
+
+	iv->u16[0] = k_s->u16[0];
+	iv->u16[1] = k_s->u16[1] ^ htons((ssrc >> 16) & 0xffff);
+	iv->u16[2] = k_s->u16[2] ^ htons(ssrc & 0xffff);
+	iv->u16[3] = k_s->u16[3] ^ htons((ix >> 32) & 0xffff);
+	iv->u16[4] = k_s->u16[4] ^ htons((ix >> 16) & 0xffff);
+	iv->u16[5] = k_s->u16[5] ^ htons(ix & 0xffff);
+	iv->u32[3] = 0;
+}
+
+
 const char *srtp_suite_name(enum srtp_suite suite)
 {
 	switch (suite) {
@@ -94,6 +116,30 @@ const char *srtp_suite_name(enum srtp_suite suite)
 	case SRTP_AES_CM_128_HMAC_SHA1_80:  return "AES_CM_128_HMAC_SHA1_80";
 	case SRTP_AES_256_CM_HMAC_SHA1_32:  return "AES_256_CM_HMAC_SHA1_32";
 	case SRTP_AES_256_CM_HMAC_SHA1_80:  return "AES_256_CM_HMAC_SHA1_80";
+	case SRTP_AES_128_GCM:              return "AEAD_AES_128_GCM";
+	case SRTP_AES_256_GCM:              return "AEAD_AES_256_GCM";
 	default:                            return "?";
 	}
 }
+
+
+/**
+ * Get the size of the master key and salt of an SRTP suite
+ *
+ * @param suite SRTP suite
+ *
+ * @return Size in bytes, 0 if the suite is unknown
+ */
+size_t srtp_suite_key_size(enum srtp_suite suite)
+{
+	switch (suite) {
+
+	case SRTP_AES_CM_128_HMAC_SHA1_32:
+	case SRTP_AES_CM_128_HMAC_SHA1_80:  return 16 + SRTP_SALT_SIZE;
+	case SRTP_AES_256_CM_HMAC_SHA1_32:
+	case SRTP_AES_256_CM_HMAC_SHA1_80:  return 32 + SRTP_SALT_SIZE;
+	case SRTP_AES_128_GCM:              return 16 + GCM_SALT_SIZE;
+	case SRTP_AES_256_GCM:              return 32 + GCM_SALT_SIZE;
+	default:                            return 0;
+	}
+}
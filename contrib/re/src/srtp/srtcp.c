@@ -53,6 +53,48 @@ int srtcp_encrypt(struct srtp *srtp, struct mbuf *mb)
 
 	strm->rtcp_index = (strm->rtcp_index+1) & 0x7fffffff;
 
+	/*
+	 * RFC 7714 9.  The header and the E-flag with the SRTCP index are
+	 * the Associated Data, and the tag comes before the SRTCP index.
+	 */
+	if (rtcp->mode == AES_MODE_GCM) {
+		const uint32_t eix = htonl(1U<<31 | strm->rtcp_index);
+		uint8_t tag[GCM_TAG_SIZE];
+		union vect128 iv;
+		uint8_t *p = mbuf_buf(mb);
+
+		srtp_iv_calc_gcm(&iv, &rtcp->k_s, ssrc, strm->rtcp_index);
+
+		aes_set_iv(rtcp->aes, iv.u8);
+
+		err = aes_encr(rtcp->aes, NULL, &mb->buf[start], 8);
+		if (err)
+			return err;
+
+		err = aes_encr(rtcp->aes, NULL, (const uint8_t *)&eix, 4);
+		if (err)
+			return err;
+
+		err = aes_encr(rtcp->aes, p, p, mbuf_get_left(mb));
+		if (err)
+			return err;
+
+		err = aes_get_authtag(rtcp->aes, tag, rtcp->tag_len);
+		if (err)
+			return err;
+
+		mb->pos = mb->end;
+
+		err  = mbuf_write_mem(mb, tag, rtcp->tag_len);
+		err |= mbuf_write_u32(mb, eix);
+		if (err)
+			return err;
+
+		mb->pos = start;
+
+		return 0;
+	}
+
 	if (rtcp->aes) {
 		union vect128 iv;
 		uint8_t *p = mbuf_buf(mb);
@@ -125,6 +167,50 @@ int srtcp_decrypt(struct srtp *srtp, struct mbuf *mb)
 	if (mbuf_get_left(mb) < (4 + rtcp->tag_len))
 		return EBADMSG;
 
+	if (rtcp->mode == AES_MODE_GCM) {
+		size_t tag_start = mb->end - (4 + rtcp->tag_len);
+		const uint8_t *eix = &mb->buf[mb->end - 4];
+		union vect128 iv;
+		uint8_t *p = mbuf_buf(mb);
+
+		memcpy(&v, eix, 4);
+		v = ntohl(v);
+		ix = v & 0x7fffffff;
+
+		/* unencrypted SRTCP is not supported with GCM */
+		if (!(v >> 31))
+			return EPROTO;
+
+		srtp_iv_calc_gcm(&iv, &rtcp->k_s, ssrc, ix);
+
+		aes_set_iv(rtcp->aes, iv.u8);
+
+		err = aes_decr(rtcp->aes, NULL, &mb->buf[start], 8);
+		if (err)
+			return err;
+
+		err = aes_decr(rtcp->aes, NULL, eix, 4);
+		if (err)
+			return err;
+
+		err = aes_decr(rtcp->aes, p, p, tag_start - pld_start);
+		if (err)
+			return err;
+
+		err = aes_authenticate(rtcp->aes, &mb->buf[tag_start],
+				       rtcp->tag_len);
+		if (err)
+			return err;
+
+		if (!srtp_replay_check(&strm->replay_rtcp, ix))
+			return EALREADY;
+
+		mb->pos = start;
+		mb->end = tag_start;
+
+		return 0;
+	}
+
 	/* Read out E-Bit, SRTCP-index and Authentication Tag */
 	eix_start = mb->end - (4 + rtcp->tag_len);
 	mb->pos = eix_start;
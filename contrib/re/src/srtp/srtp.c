@@ -33,7 +33,7 @@ static inline int seq_diff(uint16_t x, uint16_t y)
 static int comp_init(struct comp *c, unsigned offs,
 		     const uint8_t *key, size_t key_b,
 		     const uint8_t *s, size_t s_b,
-		     size_t tag_len, bool encrypted)
+		     size_t tag_len, bool encrypted, enum aes_mode mode)
 {
 	uint8_t k_e[MAX_KEYLEN], k_a[SHA_DIGEST_LENGTH];
 	int err = 0;
@@ -45,19 +45,27 @@ static int comp_init(struct comp *c, unsigned offs,
 		return EINVAL;
 
 	c->tag_len = tag_len;
+	c->mode = mode;
 
 	err |= srtp_derive(k_e, key_b,       0x00+offs, key, key_b, s, s_b);
-	err |= srtp_derive(k_a, sizeof(k_a), 0x01+offs, key, key_b, s, s_b);
-	err |= srtp_derive(c->k_s.u8, 14,    0x02+offs, key, key_b, s, s_b);
+	err |= srtp_derive(c->k_s.u8, s_b,   0x02+offs, key, key_b, s, s_b);
 	if (err)
 		return err;
 
 	if (encrypted) {
-		err = aes_alloc(&c->aes, AES_MODE_CTR, k_e, key_b*8, NULL);
+		err = aes_alloc(&c->aes, mode, k_e, key_b*8, NULL);
 		if (err)
 			return err;
 	}
 
+	/* GCM is authenticated encryption, there is no separate HMAC */
+	if (mode == AES_MODE_GCM)
+		return 0;
+
+	err = srtp_derive(k_a, sizeof(k_a), 0x01+offs, key, key_b, s, s_b);
+	if (err)
+		return err;
+
 	err = hmac_create(&c->hmac, HMAC_HASH_SHA1, k_a, sizeof(k_a));
 	if (err)
 		return err;
@@ -84,7 +92,8 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 {
 	struct srtp *srtp;
 	const uint8_t *master_salt;
-	size_t cipher_bytes, auth_bytes;
+	size_t cipher_bytes, salt_bytes, auth_bytes;
+	enum aes_mode mode;
 	int err = 0;
 
 	if (!srtpp || !key)
@@ -93,32 +102,58 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	switch (suite) {
 
 	case SRTP_AES_CM_128_HMAC_SHA1_80:
+		mode         = AES_MODE_CTR;
 		cipher_bytes = 16;
+		salt_bytes   = SRTP_SALT_SIZE;
 		auth_bytes   = 10;
 		break;
 
 	case SRTP_AES_CM_128_HMAC_SHA1_32:
+		mode         = AES_MODE_CTR;
 		cipher_bytes = 16;
+		salt_bytes   = SRTP_SALT_SIZE;
 		auth_bytes   =  4;
 		break;
 
 	case SRTP_AES_256_CM_HMAC_SHA1_80:
+		mode         = AES_MODE_CTR;
 		cipher_bytes = 32;
+		salt_bytes   = SRTP_SALT_SIZE;
 		auth_bytes   = 10;
 		break;
 
 	case SRTP_AES_256_CM_HMAC_SHA1_32:
+		mode         = AES_MODE_CTR;
 		cipher_bytes = 32;
+		salt_bytes   = SRTP_SALT_SIZE;
 		auth_bytes   =  4;
 		break;
 
+	case SRTP_AES_128_GCM:
+		mode         = AES_MODE_GCM;
+		cipher_bytes = 16;
+		salt_bytes   = GCM_SALT_SIZE;
+		auth_bytes   = GCM_TAG_SIZE;
+		break;
+
+	case SRTP_AES_256_GCM:
+		mode         = AES_MODE_GCM;
+		cipher_bytes = 32;
+		salt_bytes   = GCM_SALT_SIZE;
+		auth_bytes   = GCM_TAG_SIZE;
+		break;
+
 	default:
 		return ENOTSUP;
 	};
 
-	if ((cipher_bytes + SRTP_SALT_SIZE) != key_bytes)
+	if ((cipher_bytes + salt_bytes) != key_bytes)
 		return EINVAL;
 
+	/* with GCM the cipher also does the authentication */
+	if (mode == AES_MODE_GCM && (flags & SRTP_UNENCRYPTED_SRTCP))
+		return ENOTSUP;
+
 	master_salt = &key[cipher_bytes];
 
 	srtp = mem_zalloc(sizeof(*srtp), destructor);
@@ -126,10 +161,10 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 		return ENOMEM;
 
 	err |= comp_init(&srtp->rtp,  0, key, cipher_bytes,
-			 master_salt, SRTP_SALT_SIZE, auth_bytes, true);
+			 master_salt, salt_bytes, auth_bytes, true, mode);
 	err |= comp_init(&srtp->rtcp, 3, key, cipher_bytes,
-			 master_salt, SRTP_SALT_SIZE, auth_bytes,
-			 !(flags & SRTP_UNENCRYPTED_SRTCP));
+			 master_salt, salt_bytes, auth_bytes,
+			 !(flags & SRTP_UNENCRYPTED_SRTCP), mode);
 	if (err)
 		goto out;
 
@@ -143,7 +178,19 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 }
 
 
-int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
+/* Consecutive packets of a batch usually belong to the same stream */
+static int rtp_stream(struct srtp_stream **strmp, struct srtp *srtp,
+		      const struct rtp_header *hdr)
+{
+	if (*strmp && (*strmp)->ssrc == hdr->ssrc)
+		return 0;
+
+	return stream_get_seq(strmp, srtp, hdr->ssrc, hdr->seq);
+}
+
+
+static int encrypt_packet(struct srtp *srtp, struct srtp_stream **strmp,
+			  struct mbuf *mb)
 {
 	struct srtp_stream *strm;
 	struct rtp_header hdr;
@@ -152,9 +199,6 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 	uint64_t ix;
 	int err;
 
-	if (!srtp || !mb)
-		return EINVAL;
-
 	comp = &srtp->rtp;
 
 	start = mb->pos;
@@ -163,10 +207,12 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 	if (err)
 		return err;
 
-	err = stream_get_seq(&strm, srtp, hdr.ssrc, hdr.seq);
+	err = rtp_stream(strmp, srtp, &hdr);
 	if (err)
 		return err;
 
+	strm = *strmp;
+
 	/* Roll-Over Counter (ROC) */
 	if (seq_diff(strm->s_l, hdr.seq) <= -32768) {
 		strm->roc++;
@@ -175,7 +221,37 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 
 	ix = 65536ULL * strm->roc + hdr.seq;
 
-	if (comp->aes) {
+	if (comp->mode == AES_MODE_GCM) {
+		uint8_t tag[GCM_TAG_SIZE];
+		union vect128 iv;
+		uint8_t *p = mbuf_buf(mb);
+
+		srtp_iv_calc_gcm(&iv, &comp->k_s, strm->ssrc, ix);
+
+		aes_set_iv(comp->aes, iv.u8);
+
+		/* The RTP header is the Associated Data */
+		err = aes_encr(comp->aes, NULL, &mb->buf[start],
+			       mb->pos - start);
+		if (err)
+			return err;
+
+		err = aes_encr(comp->aes, p, p, mbuf_get_left(mb));
+		if (err)
+			return err;
+
+		err = aes_get_authtag(comp->aes, tag, comp->tag_len);
+		if (err)
+			return err;
+
+		mb->pos = mb->end;
+
+		err = mbuf_write_mem(mb, tag, comp->tag_len);
+		if (err)
+			return err;
+	}
+
+	if (comp->mode == AES_MODE_CTR && comp->aes) {
 		union vect128 iv;
 		uint8_t *p = mbuf_buf(mb);
 
@@ -220,7 +296,8 @@ int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 }
 
 
-int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
+static int decrypt_packet(struct srtp *srtp, struct srtp_stream **strmp,
+			  struct mbuf *mb)
 {
 	struct srtp_stream *strm;
 	struct rtp_header hdr;
@@ -230,9 +307,6 @@ int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
 	int diff;
 	int err;
 
-	if (!srtp || !mb)
-		return EINVAL;
-
 	comp = &srtp->rtp;
 
 	start = mb->pos;
@@ -241,10 +315,12 @@ int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
 	if (err)
 		return err;
 
-	err = stream_get_seq(&strm, srtp, hdr.ssrc, hdr.seq);
+	err = rtp_stream(strmp, srtp, &hdr);
 	if (err)
 		return err;
 
+	strm = *strmp;
+
 	diff = seq_diff(strm->s_l, hdr.seq);
 	if (diff > 32768)
 		return ETIMEDOUT;
@@ -257,6 +333,40 @@ int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
 
 	ix = srtp_get_index(strm->roc, strm->s_l, hdr.seq);
 
+	if (comp->mode == AES_MODE_GCM) {
+		union vect128 iv;
+		uint8_t *p = mbuf_buf(mb);
+		size_t tag_start;
+
+		if (mbuf_get_left(mb) < comp->tag_len)
+			return EBADMSG;
+
+		tag_start = mb->end - comp->tag_len;
+
+		srtp_iv_calc_gcm(&iv, &comp->k_s, strm->ssrc, ix);
+
+		aes_set_iv(comp->aes, iv.u8);
+
+		err = aes_decr(comp->aes, NULL, &mb->buf[start],
+			       mb->pos - start);
+		if (err)
+			return err;
+
+		err = aes_decr(comp->aes, p, p, tag_start - mb->pos);
+		if (err)
+			return err;
+
+		err = aes_authenticate(comp->aes, &mb->buf[tag_start],
+				       comp->tag_len);
+		if (err)
+			return err;
+
+		mb->end = tag_start;
+
+		if (!srtp_replay_check(&strm->replay_rtp, ix))
+			return EALREADY;
+	}
+
 	if (comp->hmac) {
 		uint8_t tag_calc[SHA_DIGEST_LENGTH];
 		uint8_t tag_pkt[SHA_DIGEST_LENGTH];
@@ -303,7 +413,7 @@ int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
 			return EALREADY;
 	}
 
-	if (comp->aes) {
+	if (comp->mode == AES_MODE_CTR && comp->aes) {
 
 		union vect128 iv;
 		uint8_t *p = mbuf_buf(mb);
@@ -323,3 +433,96 @@ int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
 
 	return 0;
 }
+
+
+int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
+{
+	struct srtp_stream *strm = NULL;
+
+	if (!srtp || !mb)
+		return EINVAL;
+
+	return encrypt_packet(srtp, &strm, mb);
+}
+
+
+int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
+{
+	struct srtp_stream *strm = NULL;
+
+	if (!srtp || !mb)
+		return EINVAL;
+
+	return decrypt_packet(srtp, &strm, mb);
+}
+
+
+/**
+ * Encrypt a batch of SRTP packets
+ *
+ * Each packet is encrypted as with srtp_encrypt(). A failed packet does
+ * not stop the batch.
+ *
+ * @param srtp SRTP Context
+ * @param mbv  Packets
+ * @param n    Number of packets
+ * @param errv Optional error code of each packet
+ *
+ * @return 0 if all packets were encrypted, otherwise the first error
+ */
+int srtp_encrypt_batch(struct srtp *srtp, struct mbuf * const *mbv, size_t n,
+		       int *errv)
+{
+	struct srtp_stream *strm = NULL;
+	size_t i;
+	int err = 0;
+
+	if (!srtp || !mbv)
+		return EINVAL;
+
+	for (i = 0; i < n; i++) {
+
+		int e = mbv[i] ? encrypt_packet(srtp, &strm, mbv[i]) : EINVAL;
+
+		if (errv)
+			errv[i] = e;
+		if (e && !err)
+			err = e;
+	}
+
+	return err;
+}
+
+
+/**
+ * Decrypt a batch of SRTP packets
+ *
+ * @param srtp SRTP Context
+ * @param mbv  Packets
+ * @param n    Number of packets
+ * @param errv Optional error code of each packet
+ *
+ * @return 0 if all packets were decrypted, otherwise the first error
+ */
+int srtp_decrypt_batch(struct srtp *srtp, struct mbuf * const *mbv, size_t n,
+		       int *errv)
+{
+	struct srtp_stream *strm = NULL;
+	size_t i;
+	int err = 0;
+
+	if (!srtp || !mbv)
+		return EINVAL;
+
+	for (i = 0; i < n; i++) {
+
+		int e = mbv[i] ? decrypt_packet(srtp, &strm, mbv[i]) : EINVAL;
+
+		if (errv)
+			errv[i] = e;
+		if (e && !err)
+			err = e;
+	}
+
+	return err;
+}
@@ -6,7 +6,9 @@
 
 
 enum {
-	SRTP_SALT_SIZE = 14
+	SRTP_SALT_SIZE = 14,
+	GCM_SALT_SIZE  = 12,
+	GCM_TAG_SIZE   = 16,
 };
 
 
@@ -40,6 +42,7 @@ struct srtp_stream {
 struct srtp {
 	struct comp {
 		struct aes *aes;    /**< AES Context                       */
+		enum aes_mode mode; /**< AES encryption mode               */
 		struct hmac *hmac;  /**< HMAC Context                      */
 		union vect128 k_s;  /**< Derived salting key (14 bytes)    */
 		size_t tag_len;     /**< Authentication tag length [bytes] */
@@ -59,6 +62,8 @@ int  srtp_derive(uint8_t *out, size_t out_len, uint8_t label,
 		 const uint8_t *master_salt, size_t salt_bytes);
 void srtp_iv_calc(union vect128 *iv, const union vect128 *k_s,
 		  uint32_t ssrc, uint64_t ix);
+void srtp_iv_calc_gcm(union vect128 *iv, const union vect128 *k_s,
+		      uint32_t ssrc, uint64_t ix);
 uint64_t srtp_get_index(uint32_t roc, uint16_t s_l, uint16_t seq);
 
 
@@ -751,6 +751,20 @@ int tls_srtp_keyinfo(const struct tls_conn *tc, enum srtp_suite *suite,
 		salt_size = 14;
 		break;
 
+#ifdef SRTP_AEAD_AES_128_GCM
+	case SRTP_AEAD_AES_128_GCM:
+		*suite = SRTP_AES_128_GCM;
+		key_size  = 16;
+		salt_size = 12;
+		break;
+
+	case SRTP_AEAD_AES_256_GCM:
+		*suite = SRTP_AES_256_GCM;
+		key_size  = 32;
+		salt_size = 12;
+		break;
+#endif
+
 	default:
 		return ENOSYS;
 	}
@@ -876,6 +890,115 @@ int tls_set_servername(struct tls_conn *tc, const char *servername)
 }
 
 
+static void session_destructor(void *data)
+{
+	struct tls_session *ts = data;
+
+	if (ts->sess)
+		SSL_SESSION_free(ts->sess);
+}
+
+
+/**
+ * Enable or disable session resumption on a TLS context
+ *
+ * The server side keeps sessions in its cache and issues session
+ * tickets, so that a client can resume with tls_get_session() and
+ * dtls_resume() after the connection is gone.
+ *
+ * @param tls     TLS Context
+ * @param enabled True to enable, false to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int tls_set_session_reuse(struct tls *tls, bool enabled)
+{
+	static const uint8_t sid_ctx[] = "libre";
+
+	if (!tls)
+		return EINVAL;
+
+	if (!enabled) {
+		SSL_CTX_set_session_cache_mode(tls->ctx, SSL_SESS_CACHE_OFF);
+		SSL_CTX_set_options(tls->ctx, SSL_OP_NO_TICKET);
+		return 0;
+	}
+
+	/* required when client certificates are verified */
+	if (1 != SSL_CTX_set_session_id_context(tls->ctx, sid_ctx,
+						sizeof(sid_ctx) - 1)) {
+		ERR_clear_error();
+		return EPROTO;
+	}
+
+	SSL_CTX_set_session_cache_mode(tls->ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_clear_options(tls->ctx, SSL_OP_NO_TICKET);
+
+	return 0;
+}
+
+
+/**
+ * Get the session of an established TLS connection, for resumption
+ *
+ * @param sessp Pointer to allocated session
+ * @param tc    TLS Connection
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int tls_get_session(struct tls_session **sessp, const struct tls_conn *tc)
+{
+	struct tls_session *ts;
+	SSL_SESSION *sess;
+
+	if (!sessp || !tc)
+		return EINVAL;
+
+	if (!SSL_is_init_finished(tc->ssl))
+		return ENOTCONN;
+
+	sess = SSL_get1_session(tc->ssl);
+	if (!sess)
+		return ENOENT;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && \
+	!defined(LIBRESSL_VERSION_NUMBER)
+	if (!SSL_SESSION_is_resumable(sess)) {
+		SSL_SESSION_free(sess);
+		return ENOENT;
+	}
+#endif
+
+	ts = mem_zalloc(sizeof(*ts), session_destructor);
+	if (!ts) {
+		SSL_SESSION_free(sess);
+		return ENOMEM;
+	}
+
+	ts->sess = sess;
+
+	*sessp = ts;
+
+	return 0;
+}
+
+
+/**
+ * Check if a TLS connection resumed a previous session
+ *
+ * @param tc TLS Connection
+ *
+ * @return true if resumed, false if a full handshake was done
+ */
+bool tls_session_reused(const struct tls_conn *tc)
+{
+	if (!tc)
+		return false;
+
+	return SSL_session_reused(tc->ssl) == 1;
+}
+
+
 static int print_error(const char *str, size_t len, void *unused)
 {
 	(void)unused;
@@ -36,6 +36,11 @@ struct tls {
 };
 
 
+struct tls_session {
+	SSL_SESSION *sess;
+};
+
+
 #ifdef TLS_BIO_OPAQUE
 BIO_METHOD *tls_method_tcp(void);
 BIO_METHOD *tls_method_udp(void);
@@ -515,6 +515,35 @@ int dtls_connect(struct tls_conn **ptc, struct tls *tls,
 		 struct dtls_sock *sock, const struct sa *peer,
 		 dtls_estab_h *estabh, dtls_recv_h *recvh,
 		 dtls_close_h *closeh, void *arg)
+{
+	return dtls_resume(ptc, tls, sock, peer, NULL,
+			   estabh, recvh, closeh, arg);
+}
+
+
+/**
+ * DTLS Connect, offering to resume a previous session
+ *
+ * The server falls back to a full handshake if it does not know
+ * the session anymore.
+ *
+ * @param ptc    Pointer to allocated DTLS connection
+ * @param tls    TLS Context
+ * @param sock   DTLS Socket
+ * @param peer   Peer address
+ * @param sess   Session from tls_get_session(), or NULL
+ * @param estabh Establish handler
+ * @param recvh  Receive handler
+ * @param closeh Close handler
+ * @param arg    Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dtls_resume(struct tls_conn **ptc, struct tls *tls,
+		struct dtls_sock *sock, const struct sa *peer,
+		const struct tls_session *sess,
+		dtls_estab_h *estabh, dtls_recv_h *recvh,
+		dtls_close_h *closeh, void *arg)
 {
 	struct tls_conn *tc;
 	int err;
@@ -528,6 +557,12 @@ int dtls_connect(struct tls_conn **ptc, struct tls *tls,
 
 	tc->active = true;
 
+	if (sess && 1 != SSL_set_session(tc->ssl, sess->sess)) {
+		ERR_clear_error();
+		err = EPROTO;
+		goto out;
+	}
+
 	err = tls_connect(tc);
 	if (err)
 		goto out;
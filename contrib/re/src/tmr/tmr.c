@@ -39,6 +39,7 @@ enum {
 };
 
 extern struct list *tmrl_get(void);
+extern struct tmr_clock *tmr_clock_get(void);
 
 
 static bool inspos_handler(struct le *le, void *arg)
@@ -124,8 +125,12 @@ void tmr_poll(struct list *tmrl)
  */
 uint64_t tmr_jiffies(void)
 {
+	const struct tmr_clock *vclock = tmr_clock_get();
 	uint64_t jfs;
 
+	if (vclock->clockh)
+		return vclock->clockh(vclock->arg);
+
 #if defined(WIN32)
 	FILETIME ft;
 	ULARGE_INTEGER li;
@@ -334,3 +339,56 @@ uint64_t tmr_get_expire(const struct tmr *tmr)
 
 	return (tmr->jfs > jfs) ? (tmr->jfs - jfs) : 0;
 }
+
+
+/**
+ * Replace the system clock with a virtual clock
+ *
+ * Like the timers, the clock belongs to the calling thread; other
+ * threads keep theirs. It is meant for simulations that run everything
+ * on a single main loop: whenever that loop has nothing to do, it calls
+ * the idle handler instead of waiting, and the handler moves the clock
+ * forward.
+ *
+ * @param clockh Clock handler, NULL to return to the system clock
+ * @param idleh  Idle handler
+ * @param arg    Handler argument
+ */
+void tmr_set_clock(tmr_clock_h *clockh, tmr_idle_h *idleh, void *arg)
+{
+	struct tmr_clock *vclock = tmr_clock_get();
+
+	vclock->clockh = clockh;
+	vclock->idleh  = clockh ? idleh : NULL;
+	vclock->arg    = clockh ? arg : NULL;
+}
+
+
+/**
+ * Check if a virtual clock is set for the calling thread
+ *
+ * @return true if virtual, false if the system clock is used
+ */
+bool tmr_clock_isvirtual(void)
+{
+	return tmr_clock_get()->clockh != NULL;
+}
+
+
+/* Called by the main loop when there is no I/O with a virtual clock */
+void tmr_clock_idle(struct list *tmrl);
+void tmr_clock_idle(struct list *tmrl)
+{
+	const struct tmr_clock *vclock = tmr_clock_get();
+	const struct tmr *tmr = list_ledata(tmrl->head);
+	const uint64_t jfs = tmr_jiffies();
+
+	if (!vclock->idleh)
+		return;
+
+	/* Expired timers are run first */
+	if (tmr && tmr->jfs <= jfs)
+		return;
+
+	vclock->idleh(tmr ? tmr->jfs - jfs : 0, vclock->arg);
+}
@@ -55,6 +55,7 @@ extern "C" {
 
 #include "avs_rest.h"
 #include "avs_flowmgr.h"
+#include "avs_vidconv.h"
 #include "avs_mill.h"
 #include "avs_engine.h"
 #include "avs_netprobe.h"
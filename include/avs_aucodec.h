@@ -30,6 +30,7 @@ struct aucodec_param {
 	uint32_t srate;
 	uint8_t  ch;
 	bool cbr;
+	uint8_t  aulevel_id;  /* RFC 6464 extmap id, 0 if not negotiated */
 };
 
 struct media_ctx;
@@ -28,6 +28,7 @@ typedef void (reset_effect_h)(void *st, int fs_hz);
 typedef void (free_effect_h)(void *st);
 typedef void (effect_process_h)(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
 typedef void (effect_length_h)(void *st, int *length_mod_Q10);
+typedef struct pitch_analysis *(effect_pitch_h)(void *st);
     
 enum audio_effect{
     AUDIO_EFFECT_CHORUS = 0,
@@ -77,12 +78,36 @@ struct aueffect {
     free_effect_h *e_free_h;
     effect_process_h *e_proc_h;
     effect_length_h *e_length_h;
+    effect_pitch_h *e_pitch_h;
+    int fs_hz;
 };
     
 int aueffect_alloc(struct aueffect **auep, enum audio_effect effect_type, int fs_hz);
 int aueffect_reset(struct aueffect *aue, int fs_hz);
 int aueffect_process(struct aueffect *aue, const int16_t *sampin, int16_t *sampout, size_t n_sampin, size_t *n_sampout);
 int aueffect_length_modification(struct aueffect *aue, int *length_modification_q10);
+int aueffect_share_pitch(struct aueffect *aue, struct aueffect *src);
+    
+int pitch_analysis_share(struct pitch_analysis *pa, struct pitch_analysis *src);
+    
+struct aueswitch;
+    
+struct aueswitch_stats {
+    uint32_t switches;
+    uint32_t deferred;
+    uint32_t bypassed;
+};
+    
+typedef void (aueswitch_notify_h)(void *arg);
+
+int aueswitch_alloc(struct aueswitch **swp, int fs_hz);
+void aueswitch_set_notify_handler(struct aueswitch *sw,
+                                  aueswitch_notify_h *notifyh, void *arg);
+int aueswitch_set(struct aueswitch *sw, enum audio_effect effect_type);
+int aueswitch_collect(struct aueswitch *sw);
+void aueswitch_process(struct aueswitch *sw, int16_t samp[], size_t n_samp, int fs_hz);
+enum audio_effect aueswitch_effect(struct aueswitch *sw);
+void aueswitch_get_stats(struct aueswitch *sw, struct aueswitch_stats *stats);
     
 void* create_chorus(int fs_hz, int strength);
 void free_chorus(void *st);
@@ -96,24 +121,29 @@ void* create_pitch_up_shift(int fs_hz, int strength);
 void* create_pitch_down_shift(int fs_hz, int strength);
 void free_pitch_shift(void *st);
 void pitch_shift_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+struct pitch_analysis *pitch_shift_pitch(void *st);
     
 void* create_pace_up_shift(int fs_hz, int strength);
 void* create_pace_down_shift(int fs_hz, int strength);
 void free_pace_shift(void *st);
 void pace_shift_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
 void pace_shift_length_factor(void *st, int *length_mod_Q10);
+struct pitch_analysis *pace_shift_pitch(void *st);
     
 void* create_vocoder(int fs_hz, int strength);
 void free_vocoder(void *st);
 void vocoder_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+struct pitch_analysis *vocoder_pitch(void *st);
 
 void* create_auto_tune(int fs_hz, int strength);
 void free_auto_tune(void *st);
 void auto_tune_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+struct pitch_analysis *auto_tune_pitch(void *st);
 
 void* create_harmonizer(int fs_hz, int strength);
 void free_harmonizer(void *st);
 void harmonizer_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+struct pitch_analysis *harmonizer_pitch(void *st);
 
 void* create_normalizer(int fs_hz, int strength);
 void reset_normalizer(void *st, int fs_hz);
@@ -123,6 +153,7 @@ void normalizer_process(void *st, int16_t in[], int16_t out[], size_t L_in, size
 void* create_pitch_cycler(int fs_hz, int strength);
 void free_pitch_cycler(void *st);
 void pitch_cycler_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+struct pitch_analysis *pitch_cycler_pitch(void *st);
     
 void* create_pass_through(int fs_hz, int strength);
 void free_pass_through(void *st);
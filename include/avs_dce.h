@@ -29,6 +29,7 @@ typedef void (dce_close_chan_h)(int sid,
 				const char *label, const char *protocol,
 				void *arg);
 typedef void (dce_data_h)(int sid, uint8_t *data, size_t len, void *arg);
+typedef void (dce_buffered_low_h)(size_t buffered, void *arg);
 
 int  dce_init(void);
 void dce_close(void);
@@ -57,3 +58,18 @@ int  dce_send(struct dce *dce, struct dce_channel *ch, const char *data, size_t
 void dce_recv_pkt(struct dce *dce, const uint8_t *pkt, size_t len);
 bool dce_snd_dry(struct dce *dce);
 bool dce_is_chan_open(const struct dce_channel *ch);
+
+/* Bulk transfer
+ *
+ * Data is queued and handed to SCTP as the send buffer allows, split
+ * into binary messages of at most 16 KB, which the receiver gets as
+ * separate dce_data_h calls, in order. dce_buffered_amount() tells
+ * how much is still queued. Once it drops to the low watermark after
+ * SCTP pushed back, lowh is called with the channel's arg. Sending
+ * more than 16 MB ahead fails with ENOBUFS.
+ */
+int    dce_send_bulk(struct dce *dce, struct dce_channel *ch,
+		     const uint8_t *data, size_t len);
+size_t dce_buffered_amount(struct dce *dce, const struct dce_channel *ch);
+int    dce_channel_set_buffered_low(struct dce_channel *ch, size_t threshold,
+				    dce_buffered_low_h *lowh);
@@ -133,6 +133,8 @@ int  ecall_restart(struct ecall *ecall);
 struct ecall_marshal;
 
 int  ecall_marshal_alloc(struct ecall_marshal **emp);
+int  ecall_marshal_alloc_shard(struct ecall_marshal **emp,
+			       struct mediashard *shard);
 int  marshal_ecall_start(struct ecall_marshal *em, struct ecall *ecall);
 int  marshal_ecall_answer(struct ecall_marshal *em, struct ecall *ecall);
 int  marshal_ecall_restart(struct ecall_marshal *em, struct ecall *ecall);
@@ -107,6 +107,20 @@ int engine_alloc(struct engine **enginep, const char *request_uri,
 		 engine_ping_h *shuth, void *arg);
 int engine_restart(struct engine *eng);
 
+/* Load cached conversations on a pool of worker threads.
+ *
+ * With *workers* greater than zero, conversations are read from the
+ * store on that many threads during startup and merged into the engine
+ * in batches on the main thread. Listeners with a convsloadedh receive
+ * a single notification once all of them are in. Listeners without
+ * one still get an addconvh for each conversation, but only after
+ * loading has finished.
+ *
+ * Call this right after engine_alloc(), before the engine has logged
+ * in. Zero workers, the default, loads one conversation at a time.
+ */
+int engine_set_startup_workers(struct engine *engine, unsigned workers);
+
 /* Request a full sync.
  *
  * You can only call this function on an active engine. It will then go
@@ -458,6 +472,7 @@ typedef void (engine_otr_add_msg_h)(struct engine_conv *conv,
 				    const char *sender, const char *recipient,
 				    void *arg);
 typedef void (engine_syncdone_h)(void *arg);
+typedef void (engine_convs_loaded_h)(uint32_t count, void *arg);
 
 
 struct engine_lsnr {
@@ -466,6 +481,7 @@ struct engine_lsnr {
 	engine_user_h *userh;
 	engine_conn_ev_h *connh;
 	engine_conv_add_h *addconvh;
+	engine_convs_loaded_h *convsloadedh; /* store loaded at startup */
 	engine_conv_update_h *convupdateh;
 	engine_conv_call_h *callh;
 	engine_call_participant_h *callparth;
@@ -48,6 +48,12 @@ int jzon_int_opt(int *dst, struct json_object *obj, const char *key,
 		 int dflt);
 bool jzon_bool_opt(struct json_object *obj, const char *key, bool dflt);
 
+/* Objects found in a container (jzon_object(), jzon_array(), jzon_apply(),
+ * json_object_object_get_ex(), json_object_array_get_idx()) are borrowed.
+ * They live as long as the decoded document they belong to, and must not
+ * be passed to mem_ref() or mem_deref(). Only the root from jzon_decode()
+ * is a mem object.
+ */
 int jzon_object(struct json_object **dstp, struct json_object *jobj,
 		const char *key);
 int jzon_array(struct json_object **dstp, struct json_object *jobj,
@@ -78,6 +78,35 @@ struct mediaflow_stats {
 
 	unsigned dtls_pkt_sent;
 	unsigned dtls_pkt_recv;
+
+	/* call setup timeline, since mediaflow_alloc() */
+	struct {
+		int32_t gathered;
+		int32_t ice_start;
+		int32_t ice_estab;
+		int32_t dtls_start;
+		int32_t dtls_estab;
+		int32_t rtp_tx;
+		int32_t rtp_rx;
+	} setup;
+};
+
+
+/*
+ * Memory used by a mediaflow, in bytes, by subsystem.
+ *
+ * flow and stats are exact. The others are an approximation: the sizes
+ * of the objects the flow holds, without what those allocate inside.
+ * They are zero in builds without memory debugging.
+ */
+struct mediaflow_mem {
+	size_t flow;     /* struct mediaflow */
+	size_t stats;    /* RTP and codec statistics */
+	size_t sdp;
+	size_t ice;      /* ICE, STUN and TURN */
+	size_t dtls;     /* DTLS and SRTP */
+	size_t codec;    /* audio and video codec state */
+	size_t data;     /* data channel */
 };
 
 
@@ -153,6 +182,13 @@ int mediaflow_gather_turn(struct mediaflow *mf, const struct sa *turn_srv,
 int mediaflow_gather_turn_tcp(struct mediaflow *mf, const struct sa *turn_srv,
 			      const char *username, const char *password,
 			      bool secure);
+
+struct turnpool;
+struct turnpool_server;
+int mediaflow_turnpool_alloc(struct turnpool **poolp, unsigned size, int af);
+int mediaflow_gather_turnpool(struct mediaflow *mf, struct turnpool *pool,
+			      const struct turnpool_server *srvv, size_t srvc);
+
 size_t mediaflow_remote_cand_count(const struct mediaflow *mf);
 int mediaflow_summary(struct re_printf *pf, const struct mediaflow *mf);
 int mediaflow_rtp_summary(struct re_printf *pf, const struct mediaflow *mf);
@@ -178,6 +214,11 @@ struct viddec_state *mediaflow_video_decoder(const struct mediaflow *mf);
 bool mediaflow_has_data(const struct mediaflow *mf);
 
 const struct tls_conn *mediaflow_dtls_connection(const struct mediaflow *mf);
+int  mediaflow_get_dtls_session(const struct mediaflow *mf,
+				struct tls_session **sessp);
+void mediaflow_set_dtls_session(struct mediaflow *mf,
+				struct tls_session *sess);
+bool mediaflow_dtls_resumed(const struct mediaflow *mf);
 
 bool mediaflow_is_started(const struct mediaflow *mf);
 
@@ -209,9 +250,18 @@ int mediaflow_hold_media(struct mediaflow *mf, bool hold);
 
 const struct mediaflow_stats *mediaflow_stats_get(const struct mediaflow *mf);
 
+int    mediaflow_mem_get(const struct mediaflow *mf, struct mediaflow_mem *mem);
+void   mediaflow_mem_add(struct mediaflow_mem *sum,
+			 const struct mediaflow_mem *mem);
+size_t mediaflow_mem_total(const struct mediaflow_mem *mem);
+int    mediaflow_mem_debug(struct re_printf *pf,
+			   const struct mediaflow_mem *mem);
+
 void mediaflow_set_local_eoc(struct mediaflow *mf);
 bool mediaflow_have_eoc(const struct mediaflow *mf);
 void mediaflow_enable_privacy(struct mediaflow *mf, bool enabled);
+void mediaflow_enable_hd_video(struct mediaflow *mf, bool enabled);
+void mediaflow_enable_fast_setup(struct mediaflow *mf, bool enabled);
 
 const char *mediaflow_lcand_name(const struct mediaflow *mf);
 const char *mediaflow_rcand_name(const struct mediaflow *mf);
@@ -221,3 +271,76 @@ struct dce *mediaflow_get_dce(const struct mediaflow *mf);
 
 bool mediaflow_get_audio_cbr(const struct mediaflow *mf);
 
+
+/*
+ * Media shards -- worker threads with their own main loop
+ */
+
+struct mediashard;
+
+typedef void (mediashard_h)(void *arg);
+
+int  mediashard_init(unsigned n);
+int  mediashard_close(void);
+unsigned mediashard_count(void);
+struct mediashard *mediashard_get(unsigned ix);
+struct mediashard *mediashard_pick(void);
+struct mediashard *mediashard_current(void);
+unsigned mediashard_index(const struct mediashard *sh);
+int  mediashard_exec(struct mediashard *sh, mediashard_h *h, void *arg);
+int  mediashard_call(struct mediashard *sh, mediashard_h *h, void *arg);
+unsigned mediashard_flows(const struct mediashard *sh);
+int  mediashard_cpu_time(struct mediashard *sh, uint64_t *usecp);
+int  mediashard_debug(struct re_printf *pf, const struct mediashard *sh);
+
+
+/*
+ * Path cache -- network paths that worked in earlier calls
+ */
+
+enum pathcache_state {
+	PATHCACHE_UNKNOWN = 0,
+	PATHCACHE_OK,
+	PATHCACHE_DEAD,
+};
+
+/* Class of the remote peer, derived from its candidates */
+enum pathcache_peer {
+	PATHCACHE_PEER_NONE = 0,
+	PATHCACHE_PEER_LAN,     /* host candidate in our network */
+	PATHCACHE_PEER_NAT,     /* server reflexive candidate */
+	PATHCACHE_PEER_RELAY,   /* relayed candidates only */
+};
+
+struct pathcache_stats {
+	uint64_t lookups;       /* flows that completed ICE setup */
+	uint64_t hits;          /* ... with a cached pair */
+	uint64_t deferred;      /* TURN allocations held back as dead */
+	uint64_t setup_hit_ms;
+	uint64_t n_setup_hit;
+	uint64_t setup_miss_ms;
+	uint64_t n_setup_miss;
+};
+
+void pathcache_enable(bool enabled);
+bool pathcache_enabled(void);
+void pathcache_flush(void);
+void pathcache_turn_result(const struct sa *laddr, const struct sa *srv,
+			   int proto, bool ok, uint32_t rtt);
+enum pathcache_state pathcache_turn_state(const struct sa *laddr,
+					  const struct sa *srv, int proto,
+					  uint32_t *rttp);
+void pathcache_pair_result(const struct sa *laddr, const struct sa *srv,
+			   enum pathcache_peer peer,
+			   enum ice_cand_type ltype, enum ice_cand_type rtype,
+			   uint32_t rtt);
+int  pathcache_pair_lookup(const struct sa *laddr, const struct sa *srv,
+			   enum pathcache_peer peer,
+			   enum ice_cand_type *ltypep, enum ice_cand_type *rtypep,
+			   uint32_t *rttp);
+void pathcache_setup_result(bool hit, int32_t setup_ms);
+void pathcache_deferred(void);
+void pathcache_stats_get(struct pathcache_stats *stats);
+int32_t pathcache_setup_savings(const struct pathcache_stats *stats);
+const char *pathcache_peer_name(enum pathcache_peer peer);
+int  pathcache_debug(struct re_printf *pf, void *unused);
@@ -24,6 +24,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "avs_ztime.h"
     
 struct max_min_avg{
@@ -75,13 +76,52 @@ struct rtp_stats {
     int dropouts;
     struct ztime start_time;
     struct ztime prev_time;
-    int seq_nr_buf[MAX_PACKETS];
+    uint16_t seq_nr_buf[MAX_PACKETS];
 };
     
 void mediastats_rtp_stats_init(struct rtp_stats* rs, int pt, int dropout_thres_ms);
     
+/* Does nothing if rs is NULL, i.e. the stream has no statistics yet */
 void mediastats_rtp_stats_update(struct rtp_stats* rs, const uint8_t *pkt, size_t len,
 	uint32_t bw_alloc_bps);
+
+
+/*
+ * Loss adaptive control of the Opus encoder settings of one channel.
+ *
+ * Feed it one report per receiver report interval; it returns true
+ * when the settings in cur have changed and should be applied. DTX is
+ * only switched on if dtx_allowed is set. Changing FEC or DTX recreates
+ * the encoder, so they change at most once every few reports.
+ */
+
+struct auctl_report {
+	float loss_pct;    /* packet loss seen by the receiver */
+	float mbl;         /* mean burst length in packets */
+	float expand_pct;  /* share of the playout that was concealed */
+	int rtt_ms;
+};
+
+struct auctl_settings {
+	bool fec;          /* Opus in-band FEC */
+	int loss_pct;      /* packet loss the encoder should expect */
+	bool dtx;
+	int packet_ms;
+};
+
+struct auctl {
+	struct auctl_settings cur;
+	bool dtx_allowed;
+	float loss;        /* smoothed */
+	float mbl;         /* smoothed */
+	float expand;      /* smoothed */
+	int n;
+	int n_hold;        /* reports since FEC or DTX changed */
+};
+
+void mediastats_auctl_init(struct auctl *ac);
+bool mediastats_auctl_update(struct auctl *ac,
+			     const struct auctl_report *rep);
     
 #ifdef __cplusplus
 }
@@ -46,9 +46,13 @@ void msystem_enable_loopback(struct msystem *msys, bool enable);
 void msystem_enable_privacy(struct msystem *msys, bool enable);
 void msystem_enable_cbr(struct msystem *msys, bool enable);
 bool msystem_have_cbr(const struct msystem *msys);
+void msystem_enable_hd_video(struct msystem *msys, bool enable);
+bool msystem_have_hd_video(const struct msystem *msys);
 void msystem_set_ifname(struct msystem *msys, const char *ifname);
 int  msystem_enable_datachannel(struct msystem *msys, bool enable);
 bool msystem_have_datachannel(const struct msystem *msys);
+int  msystem_enable_turnpool(struct msystem *msys, bool enable);
+struct turnpool *msystem_turnpool(const struct msystem *msys);
 struct call_config;
 int  msystem_set_call_config(struct msystem *msys, struct call_config *cfg);
 struct call_config *msystem_get_call_config(const struct msystem *msys);
@@ -17,6 +17,15 @@ GenericMessage *generic_message_decode(size_t len, const uint8_t *data);
 void generic_message_free(GenericMessage *msg);
 
 
+struct protobuf_arena;
+
+int  protobuf_arena_alloc(struct protobuf_arena **arenap, size_t size);
+void protobuf_arena_reset(struct protobuf_arena *arena);
+size_t protobuf_arena_used(const struct protobuf_arena *arena);
+GenericMessage *generic_message_decode_arena(struct protobuf_arena *arena,
+					     size_t len, const uint8_t *data);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,22 +37,48 @@
 #include <stdio.h>
 
 namespace wire_avs {
+
+// Captures RTP and RTCP packets to a pcapng file.
+//
+// DumpPacket() may be called from any thread. It copies the packet into
+// a lock-free ring and returns; a writer thread started by Start() does
+// the file I/O. If the writer falls behind, packets are dropped and
+// counted instead of blocking the caller.
+//
+// Each flow (SSRC, RTP or RTCP) gets its own interface in the capture.
+// Packets are wrapped in IPv4/UDP headers, with one UDP port per flow,
+// so the file can be read by any pcapng capable tool.
 class RtpDump
 {
 public:
     RtpDump();
     ~RtpDump();
 
-    int32_t Start(const char* fileNameUTF8);
+    // snapLen limits how much of each packet is saved, 0 saves it all
+    int32_t Start(const char* fileNameUTF8, size_t snapLen = 0);
     int32_t Stop();
     bool IsActive() const;
     int32_t DumpPacket(const uint8_t* packet,
                                size_t packetLength);
+
+    // Packets dropped since Start() because the ring was full
+    uint32_t Dropped() const;
+
 private:
-    // Return the system time in ms.
-    inline uint32_t GetTimeInMS() const;
-    // Return x in network byte order (big endian).
-    inline uint32_t RtpDumpHtonl(uint32_t x) const;
+    struct Slot;
+
+    static void* WriterThread(void* arg);
+    void WriterLoop();
+    bool WriteNext();
+
+    int WriteSectionHeader();
+    int WriteInterface(uint32_t ssrc, bool isRTCP);
+    int WritePacket(const Slot* slot);
+    int FlowInterface(const Slot* slot, bool isRTCP);
+    int WriteBlock(uint32_t type, const uint8_t* body, size_t len);
+
+    // Return the system time in us.
+    inline uint64_t GetTimeInUS() const;
     // Return x in network byte order (big endian).
     inline uint16_t RtpDumpHtons(uint16_t x) const;
 
@@ -62,9 +88,29 @@ private:
     bool RTCP(const uint8_t* packet) const;
 
 private:
+    // Start() and Stop()
     pthread_mutex_t _mutex;
+    pthread_t _thread;
+    bool _running;
+
+    // shared with the capturing threads, accessed atomically
+    int _active;
+    uint64_t _enqPos;
+    uint32_t _dropped;
+    Slot* _ring;
+    size_t _snapLen;
+
+    // writer thread only
     FILE* _file;
-    uint32_t _startTime;
+    uint64_t _deqPos;
+    bool _writeError;
+    struct Flow {
+        uint32_t ssrc;
+        bool isRTCP;
+    };
+    static const int MAX_FLOWS = 16;
+    Flow _flows[MAX_FLOWS];
+    int _numFlows;
 };
-}  // namespace wwire_avs
+}  // namespace wire_avs
 #endif // RTP_DUMP_H
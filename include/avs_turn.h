@@ -17,6 +17,30 @@
 */
 
 
+/*
+ * TURN over TCP framing
+ */
+
+struct turn_framer;
+
+/* mb is only valid during the call. Returning an error stops the framer */
+typedef int (turn_framer_frame_h)(struct mbuf *mb, void *arg);
+
+struct turn_framer_stats {
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t copied;   /* bytes of frames that spanned segments */
+};
+
+int  turn_framer_alloc(struct turn_framer **tfp,
+		       turn_framer_frame_h *frameh, void *arg);
+void turn_framer_close(struct turn_framer *tf);
+int  turn_framer_recv(struct turn_framer *tf, struct mbuf *mb);
+void turn_framer_reset(struct turn_framer *tf);
+size_t turn_framer_pending(const struct turn_framer *tf);
+const struct turn_framer_stats *turn_framer_stats(const struct turn_framer *tf);
+
+
 /*
  * TURN Connection
  */
@@ -38,9 +62,15 @@ struct turn_conn {
 	struct turnc *turnc;
 	struct tcp_conn *tc;
 	struct sa turn_srv;
+	struct sa relay_addr;
+	struct sa mapped_addr;
 	struct tls_conn *tlsc;
 	struct tls *tls;
-	struct mbuf *mb;
+	struct turn_framer *framer;
+	struct tcp_helper *th_batch;  /* batches small sends for TCP */
+	struct mbuf *txb;
+	struct tmr tmr_tx;
+	struct tmr tmr_estab;       /* delivers estab after a handover */
 	struct udp_helper *uh_app;  /* for outgoing UDP->TCP redirect */
 	struct udp_sock *us_app;    // todo: remove?
 	struct udp_sock *us_turn;
@@ -51,6 +81,7 @@ struct turn_conn {
 	int proto;
 	bool secure;
 	bool turn_allocated;
+	int err;                    /* last error, 0 if none */
 	int layer_stun;
 	int layer_turn;
 	turnconn_estab_h *estabh;
@@ -62,6 +93,7 @@ struct turn_conn {
 	uint64_t ts_turn_req;
 
 	unsigned n_permh;
+	unsigned n_chanh;
 };
 
 
@@ -73,6 +105,9 @@ int turnconn_alloc(struct turn_conn **connp, struct list *connl,
 		   turnconn_estab_h *estabh, turnconn_data_h *datah,
 		   turnconn_error_h *errorh, void *arg
 		   );
+int turnconn_handover(struct turn_conn *conn, struct list *connl,
+		      turnconn_estab_h *estabh, turnconn_data_h *datah,
+		      turnconn_error_h *errorh, void *arg);
 int turnconn_add_permission(struct turn_conn *conn, const struct sa *peer);
 int turnconn_add_channel(struct turn_conn *conn, const struct sa *peer);
 struct turn_conn *turnconn_find_allocated(const struct list *turnconnl,
@@ -83,6 +118,44 @@ bool turnconn_are_all_allocated(const struct list *turnconnl);
 int turnconn_debug(struct re_printf *pf, const struct turn_conn *conn);
 
 
+/*
+ * TURN allocation pool -- allocations made ahead of the next call
+ */
+
+struct turnpool;
+
+struct turnpool_stats {
+	uint32_t taken;      /* allocations handed to a call */
+	uint32_t misses;     /* calls that found the pool empty */
+	uint32_t allocs;     /* allocations started */
+	uint32_t cancelled;  /* allocations that lost a race */
+	uint32_t failed;     /* races where every allocation failed */
+};
+
+/* A TURN server and transport a call is configured for */
+struct turnpool_server {
+	struct sa addr;
+	int proto;
+	bool secure;
+	const char *username;
+	const char *password;
+};
+
+int  turnpool_alloc(struct turnpool **poolp, unsigned size, int af,
+		    int layer_stun, int layer_turn);
+int  turnpool_set_servers(struct turnpool *pool,
+			  const struct turnpool_server *srvv, size_t srvc);
+int  turnpool_take(struct turnpool *pool, int af,
+		   const struct turnpool_server *srvv, size_t srvc,
+		   struct list *connl,
+		   turnconn_estab_h *estabh, turnconn_data_h *datah,
+		   turnconn_error_h *errorh, void *arg);
+void turnpool_flush(struct turnpool *pool);
+unsigned turnpool_ready(const struct turnpool *pool);
+const struct turnpool_stats *turnpool_stats(const struct turnpool *pool);
+int  turnpool_debug(struct re_printf *pf, const struct turnpool *pool);
+
+
 /*
  * STUN uri
  */
@@ -0,0 +1,46 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+ * Video frame conversion
+ *
+ * Converts NV12, NV21, YUY2, ARGB and I420 frames to I420 and scales
+ * them down in the same pass, a row at a time. Uses SSE2 or NEON when
+ * the compiler targets it.
+ */
+
+struct avs_vidframe;
+struct vidconv;
+
+int  vidconv_alloc(struct vidconv **vcp);
+
+/* dst must be an I420 frame with w, h and planes set, no larger than
+ * src. The scaling is bilinear, 2:1 is a box filter.
+ */
+int  vidconv_to_i420(struct vidconv *vc, struct avs_vidframe *dst,
+		     const struct avs_vidframe *src);
+
+/* The largest size not above max_w x max_h (in either orientation)
+ * with the aspect ratio of w x h, rounded down to even.
+ */
+void vidconv_fit(int *dw, int *dh, int w, int h, int max_w, int max_h);
+
+/* For testing and benchmarks */
+void vidconv_enable_simd(bool enable);
+bool vidconv_has_simd(void);
@@ -21,8 +21,13 @@ enum avs_vidframe_type {
 	AVS_VIDFRAME_NV12 = 1,
 	AVS_VIDFRAME_NV21,
 	AVS_VIDFRAME_I420,
+	AVS_VIDFRAME_YUY2,
+	AVS_VIDFRAME_ARGB,
 };
 	
+/* NV12/NV21: u is the interleaved chroma plane, v is unused.
+ * YUY2/ARGB: y is the packed image and ys its stride in bytes.
+ */
 struct avs_vidframe {
 	enum avs_vidframe_type type;
 	uint8_t *y;
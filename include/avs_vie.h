@@ -34,6 +34,82 @@ void vie_set_video_handlers(flowmgr_video_state_change_h *state_change_h,
 	flowmgr_video_size_h *size_h,
 	void *arg);
 
+
+/*
+ * Send resolution/framerate adaptation
+ */
+
+/* One step of the resolution ladder, best first. Bitrates are in
+ * kilobits/second. The step needs min_br to run at max_fps; below that
+ * the framerate is scaled down until min_fps before dropping to the
+ * next step. The encoder is capped at max_br, which must be at least
+ * the min_br of the step above or it can never be reached.
+ */
+struct vie_ladder_step {
+	uint32_t width;
+	uint32_t height;
+	uint32_t max_fps;
+	uint32_t min_fps;
+	uint32_t min_br;
+	uint32_t max_br;
+};
+
+struct vie_oppoint {
+	size_t step;
+	uint32_t width;
+	uint32_t height;
+	uint32_t fps;
+	uint32_t max_br;
+};
+
+struct vie_adapt;
+
+/* Pass NULL for stepv to use the built-in ladder */
+int  vie_adapt_alloc(struct vie_adapt **vap,
+		     const struct vie_ladder_step *stepv, size_t stepc);
+bool vie_adapt_set_bitrate(struct vie_adapt *va, uint32_t bitrate_bps,
+			   uint64_t now);
+bool vie_adapt_set_cpu_overuse(struct vie_adapt *va, bool overuse,
+			       uint64_t now);
+const struct vie_oppoint *vie_adapt_oppoint(const struct vie_adapt *va);
+int  vie_adapt_debug(struct re_printf *pf, const struct vie_adapt *va);
+
+/* Replace the ladder used for new send streams, NULL restores default */
+int  vie_set_resolution_ladder(const struct vie_ladder_step *stepv,
+			       size_t stepc);
+
+/* HD (up to 1280x720) for new send streams, off by default. Without it
+ * the default ladder stops at 640x480 and the send bandwidth at
+ * 800 kbps.
+ */
+void vie_enable_hd(bool enable);
+bool vie_have_hd(void);
+
+
+/*
+ * VP8 temporal layers
+ */
+
+enum {
+	VIE_MAX_TLAYERS = 3,
+};
+
+/* Number of temporal layers we offer to send, 1 disables layering.
+ * The sender uses the lower of ours and the remote's SDP value.
+ */
+int     vie_set_temporal_layers(uint8_t n);
+uint8_t vie_get_temporal_layers(void);
+
+int  vie_vp8_tid(uint8_t *tidp, bool *syncp, const uint8_t *pkt, size_t len);
+
+struct vie_tl_sel;
+
+int  vie_tl_sel_alloc(struct vie_tl_sel **selp);
+bool vie_tl_sel_decode(struct vie_tl_sel *sel, uint8_t tid, bool sync,
+		       bool key, int64_t late_ms, uint64_t now);
+uint8_t vie_tl_sel_max_tid(const struct vie_tl_sel *sel);
+int  vie_tl_sel_debug(struct re_printf *pf, const struct vie_tl_sel *sel);
+
 #ifdef __cplusplus
 }
 #endif
@@ -129,6 +129,34 @@ void voe_deregister_adm(void);
     
 void voe_enable_cbr(bool enabled);
 bool voe_have_cbr();
+
+void voe_enable_shared_encoder(bool enabled);
+bool voe_have_shared_encoder(void);
+
+/* Active speaker selection: only the loudest streams are decoded,
+ * max 0 decodes all of them.
+ */
+void   voe_set_max_decoded_streams(size_t n);
+size_t voe_get_max_decoded_streams(void);
+
+int voe_aulevel_parse(uint8_t *levelp, bool *vadp,
+		      const uint8_t *pkt, size_t len, uint8_t id);
+int voe_aulevel_rewrite(uint8_t *pkt, size_t len, uint8_t id,
+			uint8_t new_id);
+
+struct voe_spksel;
+
+int  voe_spksel_alloc(struct voe_spksel **selp, size_t max_decode);
+void voe_spksel_set_max(struct voe_spksel *sel, size_t max_decode);
+size_t voe_spksel_max(const struct voe_spksel *sel);
+int  voe_spksel_add(struct voe_spksel *sel, int id, bool has_level);
+void voe_spksel_remove(struct voe_spksel *sel, int id);
+void voe_spksel_nolevel(struct voe_spksel *sel, int id, uint64_t now);
+void voe_spksel_level(struct voe_spksel *sel, int id, uint8_t level,
+		      uint64_t now);
+bool voe_spksel_update(struct voe_spksel *sel, uint64_t now);
+bool voe_spksel_decoding(const struct voe_spksel *sel, int id);
+int  voe_spksel_debug(struct re_printf *pf, const struct voe_spksel *sel);
     
 int voe_debug(struct re_printf *pf, void *unused);
 
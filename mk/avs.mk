@@ -63,6 +63,7 @@ AVS_MODULES += turn
 AVS_MODULES += uuid
 AVS_MODULES += version
 AVS_MODULES += vidcodec
+AVS_MODULES += vidconv
 AVS_MODULES += voe
 AVS_MODULES += vie
 AVS_MODULES += wcall
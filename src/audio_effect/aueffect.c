@@ -33,7 +33,10 @@ static void aueffect_destructor(void *arg)
     
     debug("aueffect_destructor: %p \n",aue);
     
-    aue->e_free_h(aue->effect);
+    /* The create handler may have failed */
+    if(aue->effect && aue->e_free_h){
+        aue->e_free_h(aue->effect);
+    }
 }
 
 int aueffect_alloc(struct aueffect **auep,
@@ -90,6 +93,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_pitch_shift;
             aue->e_proc_h = pitch_shift_process;
+            aue->e_pitch_h = pitch_shift_pitch;
             break;
         case AUDIO_EFFECT_PITCH_DOWN_SHIFT_INSANE:
             strength++;
@@ -103,6 +107,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_pitch_shift;
             aue->e_proc_h = pitch_shift_process;
+            aue->e_pitch_h = pitch_shift_pitch;
             break;
         case AUDIO_EFFECT_PACE_DOWN_SHIFT_MAX:
             strength++;
@@ -113,6 +118,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_pace_shift;
             aue->e_proc_h = pace_shift_process;
+            aue->e_pitch_h = pace_shift_pitch;
             aue->e_length_h = pace_shift_length_factor;
             break;
         case AUDIO_EFFECT_PACE_UP_SHIFT_MAX:
@@ -124,6 +130,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_pace_shift;
             aue->e_proc_h = pace_shift_process;
+            aue->e_pitch_h = pace_shift_pitch;
             aue->e_length_h = pace_shift_length_factor;
             break;
         case AUDIO_EFFECT_VOCODER_MED:
@@ -133,6 +140,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_vocoder;
             aue->e_proc_h = vocoder_process;
+            aue->e_pitch_h = vocoder_pitch;
             break;
         case AUDIO_EFFECT_AUTO_TUNE_MAX:
             strength++;
@@ -143,6 +151,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_auto_tune;
             aue->e_proc_h = auto_tune_process;
+            aue->e_pitch_h = auto_tune_pitch;
             break;
         case AUDIO_EFFECT_HARMONIZER_MAX:
             strength++;
@@ -153,6 +162,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_harmonizer;
             aue->e_proc_h = harmonizer_process;
+            aue->e_pitch_h = harmonizer_pitch;
             break;
         case AUDIO_EFFECT_NORMALIZER:
             aue->e_create_h = create_normalizer;
@@ -169,6 +179,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_pitch_cycler;
             aue->e_proc_h = pitch_cycler_process;
+            aue->e_pitch_h = pitch_cycler_pitch;
             break;
         case AUDIO_EFFECT_NONE:
             aue->e_create_h = create_pass_through;
@@ -185,6 +196,7 @@ int aueffect_alloc(struct aueffect **auep,
     if(!aue->effect){
         err = -1;
     }
+    aue->fs_hz = fs_hz;
     
 out:
     if (err) {
@@ -204,7 +216,11 @@ int aueffect_reset(struct aueffect *aue, int fs_hz)
         return -1;
     }
     
-    aue->e_reset_h(aue->effect, fs_hz);
+    /* Effects without a reset handler only run at their initial rate */
+    if(aue->e_reset_h){
+        aue->e_reset_h(aue->effect, fs_hz);
+        aue->fs_hz = fs_hz;
+    }
     
     return 0;
 }
@@ -231,3 +247,26 @@ int aueffect_length_modification(struct aueffect *aue, int *length_modification_
  
     return 0;
 }
+
+/* Lets aue use the pitch analysis of src, for effects that are fed the
+ * same input. Both effects must be pitch based and run at the same rate.
+ */
+int aueffect_share_pitch(struct aueffect *aue, struct aueffect *src)
+{
+    struct pitch_analysis *pa, *pa_src;
+    
+    if(!aue || !src || !aue->effect || !src->effect){
+        return EINVAL;
+    }
+    if(!aue->e_pitch_h || !src->e_pitch_h){
+        return ENOTSUP;
+    }
+    
+    pa = aue->e_pitch_h(aue->effect);
+    pa_src = src->e_pitch_h(src->effect);
+    if(!pa || !pa_src){
+        return ENOTSUP;
+    }
+    
+    return pitch_analysis_share(pa, pa_src);
+}
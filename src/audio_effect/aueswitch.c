@@ -0,0 +1,422 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Live switching of audio effects
+ *
+ * aueswitch_set() is called from a control thread, it allocates the new
+ * effect there and hands it over. aueswitch_process() runs on the audio
+ * thread, it only ever try-locks, picks up the new effect at the start
+ * of a frame and cross-fades from the old one. The old effect is handed
+ * back and freed by aueswitch_collect() on the control thread, so the
+ * audio thread never allocates, frees or waits.
+ *
+ * The notify handler tells the control thread when to collect: after a
+ * switch, and when the audio runs at another rate than the effect was
+ * made for, in which case aueswitch_collect() re-creates it.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <re.h>
+#include "avs_audio_effect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "avs_log.h"
+#ifdef __cplusplus
+}
+#endif
+
+enum {
+    AUESWITCH_XFADE_MS = 5,
+    AUESWITCH_MAX_SAMP = 960,  /* 10 ms at 48 kHz, stereo */
+    AUESWITCH_MAX_RETIRED = 4,
+};
+
+struct aueswitch {
+    /* audio thread only, cur is only changed under the mutex */
+    struct aueffect *cur;
+    struct aueffect *old;
+    bool fading;
+    int fade_pos;
+    int fade_len;
+    uint32_t bypassed;
+    int16_t fade_buf[AUESWITCH_MAX_SAMP];
+
+    /* shared, under mutex */
+    pthread_mutex_t mutex;
+    struct aueffect *pending;
+    bool has_pending;
+    struct aueffect *retired[AUESWITCH_MAX_RETIRED];
+    int n_retired;
+    int fs_hz;
+    bool stale_rate;
+    bool notified;
+    enum audio_effect type;
+    struct aueswitch_stats stats;
+
+    aueswitch_notify_h *notifyh;
+    void *arg;
+};
+
+static void aueswitch_destructor(void *arg)
+{
+    struct aueswitch *sw = (struct aueswitch *)arg;
+
+    mem_deref(sw->cur);
+    mem_deref(sw->old);
+    mem_deref(sw->pending);
+    for(int i = 0; i < sw->n_retired; i++){
+        mem_deref(sw->retired[i]);
+    }
+
+    pthread_mutex_destroy(&sw->mutex);
+}
+
+int aueswitch_alloc(struct aueswitch **swp, int fs_hz)
+{
+    struct aueswitch *sw;
+
+    if(!swp){
+        return EINVAL;
+    }
+
+    sw = (struct aueswitch *)mem_zalloc(sizeof(*sw), aueswitch_destructor);
+    if(!sw){
+        return ENOMEM;
+    }
+
+    pthread_mutex_init(&sw->mutex, NULL);
+    sw->fs_hz = fs_hz;
+    sw->type = AUDIO_EFFECT_NONE;
+
+    *swp = sw;
+
+    return 0;
+}
+
+/* Called from the control thread, the handler from the audio thread */
+void aueswitch_set_notify_handler(struct aueswitch *sw,
+                                  aueswitch_notify_h *notifyh, void *arg)
+{
+    if(!sw){
+        return;
+    }
+
+    pthread_mutex_lock(&sw->mutex);
+    sw->notifyh = notifyh;
+    sw->arg = arg;
+    pthread_mutex_unlock(&sw->mutex);
+}
+
+/* With the mutex held */
+static int take_retired(struct aueswitch *sw,
+                        struct aueffect *retired[AUESWITCH_MAX_RETIRED])
+{
+    int n_retired = sw->n_retired;
+
+    memcpy(retired, sw->retired, n_retired * sizeof(retired[0]));
+    sw->n_retired = 0;
+    sw->notified = false;
+
+    return n_retired;
+}
+
+static void free_retired(struct aueffect *retired[], int n_retired)
+{
+    for(int i = 0; i < n_retired; i++){
+        mem_deref(retired[i]);
+    }
+}
+
+static int alloc_effect(struct aueffect **auep, enum audio_effect effect_type,
+                        int fs_hz)
+{
+    struct aueffect *aue = NULL;
+    int err;
+
+    if(effect_type != AUDIO_EFFECT_NONE){
+        err = aueffect_alloc(&aue, effect_type, fs_hz);
+        if(err){
+            error("aueswitch: could not allocate effect %d \n", effect_type);
+            return ENOMEM;
+        }
+
+        /* The audio path cannot change the frame length */
+        if(aue->e_length_h){
+            mem_deref(aue);
+            return ENOTSUP;
+        }
+    }
+
+    *auep = aue;
+
+    return 0;
+}
+
+/* Called from the control thread */
+int aueswitch_set(struct aueswitch *sw, enum audio_effect effect_type)
+{
+    struct aueffect *retired[AUESWITCH_MAX_RETIRED];
+    struct aueffect *aue = NULL, *stale;
+    int n_retired, fs_hz;
+    int err;
+
+    if(!sw){
+        return EINVAL;
+    }
+
+    pthread_mutex_lock(&sw->mutex);
+    fs_hz = sw->fs_hz;
+    n_retired = take_retired(sw, retired);
+    pthread_mutex_unlock(&sw->mutex);
+
+    free_retired(retired, n_retired);
+
+    err = alloc_effect(&aue, effect_type, fs_hz);
+    if(err){
+        return err;
+    }
+
+    pthread_mutex_lock(&sw->mutex);
+    stale = sw->pending;
+    sw->pending = aue;
+    sw->has_pending = true;
+    sw->type = effect_type;
+    pthread_mutex_unlock(&sw->mutex);
+
+    /* Replaced before the audio thread got to it */
+    mem_deref(stale);
+
+    return 0;
+}
+
+/* With the mutex held. True if the effect that is or will be running
+ * was made for another rate.
+ */
+static bool next_is_stale(const struct aueswitch *sw)
+{
+    const struct aueffect *next = sw->has_pending ? sw->pending : sw->cur;
+
+    return next && next->fs_hz != sw->fs_hz;
+}
+
+/* Called from the control thread when notified. Frees the effects the
+ * audio thread is done with and re-creates the effect if it was made
+ * for another rate than the audio runs at.
+ */
+int aueswitch_collect(struct aueswitch *sw)
+{
+    struct aueffect *retired[AUESWITCH_MAX_RETIRED];
+    struct aueffect *aue = NULL, *stale = NULL;
+    enum audio_effect type;
+    bool stale_rate;
+    int n_retired, fs_hz;
+    int err;
+
+    if(!sw){
+        return EINVAL;
+    }
+
+    pthread_mutex_lock(&sw->mutex);
+    n_retired = take_retired(sw, retired);
+    stale_rate = sw->stale_rate && next_is_stale(sw);
+    sw->stale_rate = false;
+    type = sw->type;
+    fs_hz = sw->fs_hz;
+    pthread_mutex_unlock(&sw->mutex);
+
+    free_retired(retired, n_retired);
+
+    if(!stale_rate){
+        return 0;
+    }
+
+    err = alloc_effect(&aue, type, fs_hz);
+    if(err){
+        return err;
+    }
+
+    pthread_mutex_lock(&sw->mutex);
+    /* Unless aueswitch_set() got in first */
+    if(sw->type == type && sw->fs_hz == fs_hz && next_is_stale(sw)){
+        stale = sw->pending;
+        sw->pending = aue;
+        sw->has_pending = true;
+        aue = NULL;
+    }
+    pthread_mutex_unlock(&sw->mutex);
+
+    mem_deref(stale);
+    mem_deref(aue);
+
+    return 0;
+}
+
+static void retire(struct aueswitch *sw, struct aueffect *aue)
+{
+    if(aue){
+        sw->retired[sw->n_retired++] = aue;
+    }
+}
+
+static void switch_effect(struct aueswitch *sw, int fs_hz)
+{
+    sw->old = sw->cur;
+    sw->cur = sw->pending;
+    sw->pending = NULL;
+    sw->has_pending = false;
+
+    sw->fading = true;
+    sw->fade_pos = 0;
+    sw->fade_len = (AUESWITCH_XFADE_MS * fs_hz) / 1000;
+
+    ++sw->stats.switches;
+}
+
+/* Called from the audio thread, with the mutex held. Returns true if
+ * the control thread should be notified.
+ */
+static bool update(struct aueswitch *sw, int fs_hz)
+{
+    sw->fs_hz = fs_hz;
+    sw->stats.bypassed = sw->bypassed;
+
+    if(sw->old && !sw->fading && sw->n_retired < AUESWITCH_MAX_RETIRED){
+        retire(sw, sw->old);
+        sw->old = NULL;
+    }
+
+    if(next_is_stale(sw)){
+        sw->stale_rate = true;
+    }
+
+    if(sw->has_pending){
+        /* Wait for the control thread to collect the retired effects */
+        if(sw->old || sw->n_retired >= AUESWITCH_MAX_RETIRED){
+            ++sw->stats.deferred;
+        }
+        else{
+            switch_effect(sw, fs_hz);
+        }
+    }
+
+    if(sw->notified || !sw->notifyh){
+        return false;
+    }
+    if(sw->n_retired == 0 && !sw->stale_rate){
+        return false;
+    }
+
+    sw->notified = true;
+
+    return true;
+}
+
+static void process_effect(struct aueswitch *sw, struct aueffect *aue,
+                           int16_t samp[], size_t n_samp, int fs_hz)
+{
+    size_t n_out;
+
+    if(!aue){
+        return;
+    }
+
+    /* Allocated for another rate, pass the audio through */
+    if(aue->fs_hz != fs_hz){
+        ++sw->bypassed;
+        return;
+    }
+
+    aueffect_process(aue, samp, samp, n_samp, &n_out);
+}
+
+/* Called from the audio thread, processes 10 ms in place */
+void aueswitch_process(struct aueswitch *sw, int16_t samp[], size_t n_samp, int fs_hz)
+{
+    if(!sw || !samp){
+        return;
+    }
+
+    if(0 == pthread_mutex_trylock(&sw->mutex)){
+        aueswitch_notify_h *notifyh = NULL;
+        void *arg = NULL;
+
+        if(update(sw, fs_hz)){
+            notifyh = sw->notifyh;
+            arg = sw->arg;
+        }
+        pthread_mutex_unlock(&sw->mutex);
+
+        if(notifyh){
+            notifyh(arg);
+        }
+    }
+
+    if(sw->fading){
+        if(n_samp > AUESWITCH_MAX_SAMP || sw->fade_len <= 0){
+            sw->fading = false;
+        }
+        else{
+            memcpy(sw->fade_buf, samp, n_samp * sizeof(int16_t));
+            process_effect(sw, sw->old, sw->fade_buf, n_samp, fs_hz);
+        }
+    }
+
+    process_effect(sw, sw->cur, samp, n_samp, fs_hz);
+
+    if(sw->fading){
+        for(size_t i = 0; i < n_samp && sw->fade_pos < sw->fade_len; i++){
+            int32_t g = (sw->fade_pos << 15) / sw->fade_len;
+
+            samp[i] = (int16_t)((sw->fade_buf[i] * ((1 << 15) - g)
+                                 + samp[i] * g) >> 15);
+            sw->fade_pos++;
+        }
+        if(sw->fade_pos >= sw->fade_len){
+            sw->fading = false;
+        }
+    }
+}
+
+enum audio_effect aueswitch_effect(struct aueswitch *sw)
+{
+    enum audio_effect type;
+
+    if(!sw){
+        return AUDIO_EFFECT_NONE;
+    }
+
+    pthread_mutex_lock(&sw->mutex);
+    type = sw->type;
+    pthread_mutex_unlock(&sw->mutex);
+
+    return type;
+}
+
+void aueswitch_get_stats(struct aueswitch *sw, struct aueswitch_stats *stats)
+{
+    if(!sw || !stats){
+        return;
+    }
+
+    pthread_mutex_lock(&sw->mutex);
+    *stats = sw->stats;
+    pthread_mutex_unlock(&sw->mutex);
+}
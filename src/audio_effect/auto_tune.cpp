@@ -100,12 +100,18 @@ static int find_nearest_lag_always_up(struct auto_tune_effect *ate, int lag_in)
 void* create_auto_tune(int fs_hz, int strength)
 {
     struct auto_tune_effect* ate = (struct auto_tune_effect*)calloc(sizeof(struct auto_tune_effect),1);
+    if(!ate){
+        return NULL;
+    }
  
     ate->resampler = new webrtc::PushResampler<int16_t>;
 
     ate->fs_khz = fs_hz/1000;
     
-    init_find_pitch_lags(&ate->pest, fs_hz, 2);
+    if(pitch_analysis_init(&ate->pa, fs_hz, 2)){
+        free_auto_tune(ate);
+        return NULL;
+    }
     
     time_scale_init(&ate->tscale, fs_hz, fs_hz);
     
@@ -140,20 +146,27 @@ void free_auto_tune(void *st)
     struct auto_tune_effect *ate = (struct auto_tune_effect*)st;
     
     delete ate->resampler;
-    free_find_pitch_lags(&ate->pest);
+    pitch_analysis_free(&ate->pa);
     
     free(ate);
 }
 
+struct pitch_analysis *auto_tune_pitch(void *st)
+{
+    struct auto_tune_effect *ate = (struct auto_tune_effect*)st;
+    
+    return &ate->pa;
+}
+
 static void find_min_max_pitch(struct auto_tune_effect *ate, int *min_pL, int *max_pL)
 {
     int pitchL;
     int maxL = 0;
     int minL = 1000;
     float inv_comp = 1.0/ate->comp_smth;
-    if(ate->pest.voiced){
+    if(ate->pa.pest->voiced){
         for(int i = 0; i < Z_NB_SUBFR; i++){
-            pitchL = (ate->fs_khz*ate->pest.pitchL[i])/16;
+            pitchL = (ate->fs_khz*ate->pa.pest->pitchL[i])/16;
             pitchL = (int)((float)pitchL * inv_comp);
             if(pitchL > maxL){
                 maxL = pitchL;
@@ -215,11 +228,11 @@ void auto_tune_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_
             biquad(&ate->lp_filt[j], a_lp[j], b_lp[j], in_lp, in_lp, L10);
         }
         
-        find_pitch_lags(&ate->pest, &in[i*L10], L10);
+        pitch_analysis_process(&ate->pa, &in[i*L10], L10);
 
         ate->resampler->Resample( &in[i*L10], L10, &ate->buf[(ATE_BUF_FRAMES-1)*L10_out + L_extra], L10_out);
         
-        pL = ((ate->pest.pitchL[2] + ate->pest.pitchL[3]) >> 1);
+        pL = ((ate->pa.pest->pitchL[2] + ate->pa.pest->pitchL[3]) >> 1);
         ate->pL_buf[ATE_PL_BUF_SZ-1] = pL;
         
         median_pL = median_pitch(ate);
@@ -247,7 +260,7 @@ void auto_tune_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_
         int min_pL, max_pL;
         find_min_max_pitch(ate, &min_pL, &max_pL);
         
-        time_scale_insert(&ate->tscale, tmp_buf, n, max_pL, min_pL, ate->pest.voiced);
+        time_scale_insert(&ate->tscale, tmp_buf, n, max_pL, min_pL, ate->pa.pest->voiced);
         
         time_scale_extract(&ate->tscale, &out[i*L10], L10);
         
@@ -44,7 +44,7 @@
 struct auto_tune_effect {
     int fs_khz;
     webrtc::PushResampler<int16_t> *resampler;
-    struct pitch_estimator pest;
+    struct pitch_analysis pa;
     struct time_scale tscale;
     struct biquad lp_filt[ATE_NUM_BIQUADS];
     float read_idx;
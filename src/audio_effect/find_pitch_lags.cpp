@@ -38,6 +38,7 @@ void init_find_pitch_lags(struct pitch_estimator *pest, int fs_hz, int complexit
     pest->resampler = new webrtc::PushResampler<int16_t>;
     pest->resampler->InitializeIfNeeded(fs_hz, 16000, 1);
     pest->fs_khz = fs_hz/1000;
+    pest->complexity = complexity;
     if(complexity < 0){
         pest->complexity = 0;
     }
@@ -51,6 +52,77 @@ void free_find_pitch_lags(struct pitch_estimator *pest)
     delete pest->resampler;
 }
 
+int pitch_analysis_init(struct pitch_analysis *pa, int fs_hz, int complexity)
+{
+    struct pitch_estimator *pest;
+    
+    pest = (struct pitch_estimator*)calloc(sizeof(struct pitch_estimator),1);
+    if(!pest){
+        return ENOMEM;
+    }
+    
+    init_find_pitch_lags(pest, fs_hz, complexity);
+    pest->refs = 1;
+    
+    pa->pest = pest;
+    pa->frame = 0;
+    
+    return 0;
+}
+
+void pitch_analysis_free(struct pitch_analysis *pa)
+{
+    struct pitch_estimator *pest = pa->pest;
+    
+    pa->pest = NULL;
+    
+    if(!pest || --pest->refs > 0){
+        return;
+    }
+    
+    free_find_pitch_lags(pest);
+    free(pest);
+}
+
+/* Makes pa use the estimator of src. Both effects must be fed the same
+ * input, 10 ms at a time and in lock step.
+ */
+int pitch_analysis_share(struct pitch_analysis *pa, struct pitch_analysis *src)
+{
+    if(!pa || !src || !pa->pest || !src->pest){
+        return EINVAL;
+    }
+    if(pa->pest == src->pest){
+        return 0;
+    }
+    if(pa->pest->fs_khz != src->pest->fs_khz){
+        return EINVAL;
+    }
+    
+    pitch_analysis_free(pa);
+    
+    pa->pest = src->pest;
+    pa->frame = src->frame;
+    pa->pest->refs++;
+    
+    return 0;
+}
+
+void pitch_analysis_process(struct pitch_analysis *pa, int16_t x[], int L)
+{
+    struct pitch_estimator *pest = pa->pest;
+    
+    pa->frame++;
+    
+    /* Another effect has analysed this frame already */
+    if((int32_t)(pa->frame - pest->nframes) <= 0){
+        return;
+    }
+    
+    find_pitch_lags(pest, x, L);
+    pest->nframes = pa->frame;
+}
+
 void find_pitch_lags(struct pitch_estimator *pest, int16_t x[], int L)
 {
 #if !defined(WEBRTC_ARCH_ARM)
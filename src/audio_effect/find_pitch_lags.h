@@ -46,6 +46,17 @@ struct pitch_estimator {
     int fs_khz;
     int complexity;
     bool voiced;
+    int refs;
+    uint32_t nframes;
+};
+
+/* Pitch analysis as seen by one effect. Effects that process the same
+ * input can share one estimator, the 40 ms analysis of each frame is
+ * then done by whichever effect gets to the frame first.
+ */
+struct pitch_analysis {
+    struct pitch_estimator *pest;
+    uint32_t frame;
 };
 
 void init_find_pitch_lags(struct pitch_estimator *pest, int fs_hz, int complexity);
@@ -53,4 +64,8 @@ void free_find_pitch_lags(struct pitch_estimator *pest);
 
 void find_pitch_lags(struct pitch_estimator *pest, int16_t x[], int L);
 
+int pitch_analysis_init(struct pitch_analysis *pa, int fs_hz, int complexity);
+void pitch_analysis_free(struct pitch_analysis *pa);
+void pitch_analysis_process(struct pitch_analysis *pa, int16_t x[], int L);
+
 #endif
\ No newline at end of file
@@ -92,12 +92,18 @@ static void find_nearest_lag(struct harmonizer_effect *he, int lag_in, int lags_
 void* create_harmonizer(int fs_hz, int strength)
 {
     struct harmonizer_effect* he = (struct harmonizer_effect*)calloc(sizeof(struct harmonizer_effect),1);
+    if(!he){
+        return NULL;
+    }
  
     he->resampler = new webrtc::PushResampler<int16_t>;
 
     he->fs_khz = fs_hz/1000;
     
-    init_find_pitch_lags(&he->pest, fs_hz, 2);
+    if(pitch_analysis_init(&he->pa, fs_hz, 2)){
+        free_harmonizer(he);
+        return NULL;
+    }
     
     he->resampler->InitializeIfNeeded(fs_hz, fs_hz * HMZ_UP_FAC, 1);
     
@@ -129,20 +135,27 @@ void free_harmonizer(void *st)
     struct harmonizer_effect *he = (struct harmonizer_effect*)st;
     
     delete he->resampler;
-    free_find_pitch_lags(&he->pest);
+    pitch_analysis_free(&he->pa);
     
     free(he);
 }
 
+struct pitch_analysis *harmonizer_pitch(void *st)
+{
+    struct harmonizer_effect *he = (struct harmonizer_effect*)st;
+    
+    return &he->pa;
+}
+
 static void find_min_max_pitch(struct harmonizer_effect *he, int *min_pL, int *max_pL, int ch)
 {
     int pitchL;
     int maxL = 0;
     int minL = 1000;
     float inv_comp = 1.0/he->hm_ch[ch].comp_smth;
-    if(he->pest.voiced){
+    if(he->pa.pest->voiced){
         for(int i = 0; i < Z_NB_SUBFR; i++){
-            pitchL = (he->fs_khz*he->pest.pitchL[i])/16;
+            pitchL = (he->fs_khz*he->pa.pest->pitchL[i])/16;
             pitchL = (int)((float)pitchL * inv_comp);
             if(pitchL > maxL){
                 maxL = pitchL;
@@ -204,11 +217,11 @@ void harmonizer_process(void *st, int16_t in[], int16_t out[], size_t L_in, size
             biquad(&he->lp_filt[j], a_lp[j], b_lp[j], in_lp, in_lp, L10);
         }
         
-        find_pitch_lags(&he->pest, &in[i*L10], L10);
+        pitch_analysis_process(&he->pa, &in[i*L10], L10);
 
         he->resampler->Resample( &in[i*L10], L10, &he->buf[(HMZ_BUF_FRAMES-1)*L10_out + L_extra], L10_out);
         
-        he->pL_buf[HMZ_PL_BUF_SZ-1] = ((he->pest.pitchL[2] + he->pest.pitchL[3]) >> 1);
+        he->pL_buf[HMZ_PL_BUF_SZ-1] = ((he->pa.pest->pitchL[2] + he->pa.pest->pitchL[3]) >> 1);
         
         median_pL = median_pitch(he);
         
@@ -242,7 +255,7 @@ void harmonizer_process(void *st, int16_t in[], int16_t out[], size_t L_in, size
             int min_pL, max_pL;
             find_min_max_pitch(he, &min_pL, &max_pL, c);
         
-            time_scale_insert(&he->hm_ch[c].tscale, tmp_buf, n, max_pL, min_pL, he->pest.voiced);
+            time_scale_insert(&he->hm_ch[c].tscale, tmp_buf, n, max_pL, min_pL, he->pa.pest->voiced);
         
             time_scale_extract(&he->hm_ch[c].tscale, tmp_buf, L10);
         
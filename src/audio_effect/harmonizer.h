@@ -52,7 +52,7 @@ struct harm_channel {
 struct harmonizer_effect {
     int fs_khz;
     webrtc::PushResampler<int16_t> *resampler;
-    struct pitch_estimator pest;
+    struct pitch_analysis pa;
     struct biquad lp_filt[HMZ_NUM_BIQUADS];
     struct harm_channel hm_ch[HMZ_NUM_CHANNELS];
     float read_idx_ch1;
@@ -4,6 +4,7 @@
 
 AVS_SRCS += \
 	audio_effect/aueffect.c \
+	audio_effect/aueswitch.c \
 	audio_effect/chorus.cpp \
 	audio_effect/reverb.cpp \
 	audio_effect/pitch_shift.cpp \
@@ -36,10 +36,16 @@ extern "C" {
 void* create_pace_up_shift(int fs_hz, int strength)
 {
     struct pace_shift_effect* pse = (struct pace_shift_effect*)calloc(sizeof(struct pace_shift_effect),1);
+    if(!pse){
+        return NULL;
+    }
  
     pse->fs_khz = fs_hz/1000;
     
-    init_find_pitch_lags(&pse->pest, fs_hz, 2);
+    if(pitch_analysis_init(&pse->pa, fs_hz, 2)){
+        free_pace_shift(pse);
+        return NULL;
+    }
 
     if(strength < 0){
         strength = 0;
@@ -58,10 +64,16 @@ void* create_pace_up_shift(int fs_hz, int strength)
 void* create_pace_down_shift(int fs_hz, int strength)
 {
     struct pace_shift_effect* pse = (struct pace_shift_effect*)calloc(sizeof(struct pace_shift_effect),1);
+    if(!pse){
+        return NULL;
+    }
     
     pse->fs_khz = fs_hz/1000;
     
-    init_find_pitch_lags(&pse->pest, fs_hz, 2);
+    if(pitch_analysis_init(&pse->pa, fs_hz, 2)){
+        free_pace_shift(pse);
+        return NULL;
+    }
     
     if(strength < 0){
         strength = 0;
@@ -81,11 +93,18 @@ void free_pace_shift(void *st)
 {
     struct pace_shift_effect *pse = (struct pace_shift_effect*)st;
     
-    delete pse->pest.resampler;
+    pitch_analysis_free(&pse->pa);
     
     free(pse);
 }
 
+struct pitch_analysis *pace_shift_pitch(void *st)
+{
+    struct pace_shift_effect *pse = (struct pace_shift_effect*)st;
+    
+    return &pse->pa;
+}
+
 void pace_shift_length_factor(void *st, int *length_mod_Q10){
     struct pace_shift_effect *pse = (struct pace_shift_effect*)st;
     
@@ -97,9 +116,9 @@ static void find_min_max_pitch(struct pace_shift_effect *pse, int *min_pL, int *
     int pitchL;
     int maxL = 0;
     int minL = 1000;
-    if(pse->pest.voiced){
+    if(pse->pa.pest->voiced){
         for(int i = 0; i < Z_NB_SUBFR; i++){
-            pitchL = (pse->fs_khz*pse->pest.pitchL[i])/16;
+            pitchL = (pse->fs_khz*pse->pa.pest->pitchL[i])/16;
             if(pitchL > maxL){
                 maxL = pitchL;
             }
@@ -125,12 +144,12 @@ void pace_shift_process(void *st, int16_t in[], int16_t out[], size_t L_in, size
     int L10_out = (int)((float)L10*pse->shift);
     
     for( int i = 0; i < N; i++){
-        find_pitch_lags(&pse->pest, &in[i*L10], L10);
+        pitch_analysis_process(&pse->pa, &in[i*L10], L10);
         
         int min_pL, max_pL;
         find_min_max_pitch(pse, &min_pL, &max_pL);
         
-        time_scale_insert(&pse->tscale, &in[i*L10], L10, max_pL, min_pL, pse->pest.voiced);
+        time_scale_insert(&pse->tscale, &in[i*L10], L10, max_pL, min_pL, pse->pa.pest->voiced);
         
         time_scale_extract(&pse->tscale, &out[i*L10_out], L10_out);
         
@@ -31,7 +31,7 @@
 
 struct pace_shift_effect {
     int fs_khz;
-    struct pitch_estimator pest;
+    struct pitch_analysis pa;
     struct time_scale tscale;
     float shift;
     int cnt;
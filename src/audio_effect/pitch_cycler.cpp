@@ -36,10 +36,16 @@ extern "C" {
 void* create_pitch_cycler(int fs_hz, int strength)
 {
     struct pitch_cycler_effect* pce = (struct pitch_cycler_effect*)calloc(sizeof(struct pitch_cycler_effect),1);
+    if(!pce){
+        return NULL;
+    }
  
     pce->fs_khz = fs_hz/1000;
     
-    init_find_pitch_lags(&pce->pest, fs_hz, 2);
+    if(pitch_analysis_init(&pce->pa, fs_hz, 2)){
+        free_pitch_cycler(pce);
+        return NULL;
+    }
     
     time_scale_init(&pce->tscale, fs_hz * PCE_EXTRA_UP, fs_hz * PCE_EXTRA_UP);
  
@@ -71,20 +77,27 @@ void free_pitch_cycler(void *st)
     struct pitch_cycler_effect *pce = (struct pitch_cycler_effect*)st;
     
     delete pce->resampler;
-    free_find_pitch_lags(&pce->pest);
+    pitch_analysis_free(&pce->pa);
     
     free(pce);
 }
 
+struct pitch_analysis *pitch_cycler_pitch(void *st)
+{
+    struct pitch_cycler_effect *pce = (struct pitch_cycler_effect*)st;
+    
+    return &pce->pa;
+}
+
 static void find_min_max_pitch(struct pitch_cycler_effect *pce, int *min_pL, int *max_pL)
 {
     int pitchL;
     int maxL = 0;
     int minL = 1000;
     float inv_comp = 1.0/pce->comp;
-    if(pce->pest.voiced){
+    if(pce->pa.pest->voiced){
         for(int i = 0; i < Z_NB_SUBFR; i++){
-            pitchL = (PCE_EXTRA_UP*pce->fs_khz*pce->pest.pitchL[i])/16;
+            pitchL = (PCE_EXTRA_UP*pce->fs_khz*pce->pa.pest->pitchL[i])/16;
             pitchL = (int)((float)pitchL * inv_comp);
             if(pitchL > maxL){
                 maxL = pitchL;
@@ -120,7 +133,7 @@ void pitch_cycler_process(void *st, int16_t in[], int16_t out[], size_t L_in, si
     int pL, median_pL;
     float comp;
     for( int i = 0; i < N; i++){
-        find_pitch_lags(&pce->pest, &in[i*L10], L10);
+        pitch_analysis_process(&pce->pa, &in[i*L10], L10);
 
         pce->resampler->Resample( &in[i*L10], L10, &pce->buf[(PCE_BUF_FRAMES-1)*L10_out + L_extra], L10_out);
         
@@ -143,7 +156,7 @@ void pitch_cycler_process(void *st, int16_t in[], int16_t out[], size_t L_in, si
         int min_pL, max_pL;
         find_min_max_pitch(pce, &min_pL, &max_pL);
         
-        time_scale_insert(&pce->tscale, tmp_buf, n, max_pL, min_pL, pce->pest.voiced);
+        time_scale_insert(&pce->tscale, tmp_buf, n, max_pL, min_pL, pce->pa.pest->voiced);
         
         time_scale_extract(&pce->tscale, tmp_out, L10 * PCE_EXTRA_UP);
         
@@ -43,7 +43,7 @@ struct pitch_cycler_effect {
     int fs_khz;
     webrtc::PushResampler<int16_t> *resampler;
     webrtc::PushResampler<int16_t> *resampler_out;
-    struct pitch_estimator pest;
+    struct pitch_analysis pa;
     struct time_scale tscale;
     float read_idx;
     int16_t buf[PCE_UP_FAC * PCE_EXTRA_UP * (PCE_BUF_FRAMES * 10 + PCE_EXTRA_BUF_MS) * 48];
@@ -42,12 +42,18 @@ void* create_pitch_up_shift(int fs_hz, int strength)
         {3,5}    // 100 Hz -> 166 Hz
     };
     struct pitch_shift_effect* pse = (struct pitch_shift_effect*)calloc(sizeof(struct pitch_shift_effect),1);
+    if(!pse){
+        return NULL;
+    }
  
     pse->resampler = new webrtc::PushResampler<int16_t>;
 
     pse->fs_khz = fs_hz/1000;
     
-    init_find_pitch_lags(&pse->pest, fs_hz, 2);
+    if(pitch_analysis_init(&pse->pa, fs_hz, 2)){
+        free_pitch_shift(pse);
+        return NULL;
+    }
     
     if(strength < 0){
         strength = 0;
@@ -76,12 +82,18 @@ void* create_pitch_down_shift(int fs_hz, int strength)
     };
     
     struct pitch_shift_effect* pse = (struct pitch_shift_effect*)calloc(sizeof(struct pitch_shift_effect),1);
+    if(!pse){
+        return NULL;
+    }
     
     pse->resampler = new webrtc::PushResampler<int16_t>;
     
     pse->fs_khz = fs_hz/1000;
     
-    init_find_pitch_lags(&pse->pest, fs_hz, 2);
+    if(pitch_analysis_init(&pse->pa, fs_hz, 2)){
+        free_pitch_shift(pse);
+        return NULL;
+    }
     
     if(strength < 0){
         strength = 0;
@@ -105,19 +117,26 @@ void free_pitch_shift(void *st)
     struct pitch_shift_effect *pse = (struct pitch_shift_effect*)st;
     
     delete pse->resampler;
-    free_find_pitch_lags(&pse->pest);
+    pitch_analysis_free(&pse->pa);
     
     free(pse);
 }
 
+struct pitch_analysis *pitch_shift_pitch(void *st)
+{
+    struct pitch_shift_effect *pse = (struct pitch_shift_effect*)st;
+    
+    return &pse->pa;
+}
+
 static void find_min_max_pitch(struct pitch_shift_effect *pse, int *min_pL, int *max_pL)
 {
     int pitchL;
     int maxL = 0;
     int minL = 1000;
-    if(pse->pest.voiced){
+    if(pse->pa.pest->voiced){
         for(int i = 0; i < Z_NB_SUBFR; i++){
-            pitchL = (pse->fs_khz*pse->pest.pitchL[i]*pse->up)/(16*pse->down);
+            pitchL = (pse->fs_khz*pse->pa.pest->pitchL[i]*pse->up)/(16*pse->down);
             if(pitchL > maxL){
                 maxL = pitchL;
             }
@@ -144,14 +163,14 @@ void pitch_shift_process(void *st, int16_t in[], int16_t out[], size_t L_in, siz
     
     int16_t tmp_buf[L10_out];
     for( int i = 0; i < N; i++){
-        find_pitch_lags(&pse->pest, &in[i*L10], L10);
+        pitch_analysis_process(&pse->pa, &in[i*L10], L10);
 
         pse->resampler->Resample( &in[i*L10], L10, tmp_buf, L10_out);
         
         int min_pL, max_pL;
         find_min_max_pitch(pse, &min_pL, &max_pL);
     
-        time_scale_insert(&pse->tscale, tmp_buf, L10_out, max_pL, min_pL, pse->pest.voiced);
+        time_scale_insert(&pse->tscale, tmp_buf, L10_out, max_pL, min_pL, pse->pa.pest->voiced);
         
         time_scale_extract(&pse->tscale, &out[i*L10], L10);
     }
@@ -39,7 +39,7 @@ struct up_down_params{
 struct pitch_shift_effect {
     int fs_khz;
     webrtc::PushResampler<int16_t> *resampler;
-    struct pitch_estimator pest;
+    struct pitch_analysis pa;
     struct time_scale tscale;
     int up;
     int down;
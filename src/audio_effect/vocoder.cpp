@@ -32,6 +32,9 @@ extern "C" {
 void* create_vocoder(int fs_hz, int strength)
 {
     struct vocoder_effect* ve = (struct vocoder_effect*)calloc(sizeof(struct vocoder_effect),1);
+    if(!ve){
+        return NULL;
+    }
     
     ve->resampler_in = new webrtc::PushResampler<int16_t>;
     ve->resampler_in->InitializeIfNeeded(fs_hz, PROC_FS_KHZ*1000, 1);
@@ -58,7 +61,10 @@ void* create_vocoder(int fs_hz, int strength)
     ve->e_min_track = E_MIN;
     ve->e_max_track = E_MIN + 10;
     
-    init_find_pitch_lags(&ve->pest, PROC_FS_KHZ*1000, 2);    
+    if(pitch_analysis_init(&ve->pa, PROC_FS_KHZ*1000, 2)){
+        free_vocoder(ve);
+        return NULL;
+    }
     ve->pitch_period = 84;
     
     ve->strength = strength;
@@ -77,10 +83,23 @@ void free_vocoder(void *st)
     
     delete ve->resampler_in;
     delete ve->resampler_out;
+    pitch_analysis_free(&ve->pa);
     
     free(ve);
 }
 
+struct pitch_analysis *vocoder_pitch(void *st)
+{
+    struct vocoder_effect *ve = (struct vocoder_effect*)st;
+    
+    /* The analysis runs on the resampled signal */
+    if(ve->fs_khz != PROC_FS_KHZ){
+        return NULL;
+    }
+    
+    return &ve->pa;
+}
+
 static float compress(float x)
 {
     float xf = x * 3.0518e-05;
@@ -320,9 +339,9 @@ void vocoder_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t
     for( int i = 0; i < N; i++){
         ve->resampler_in->Resample( &in[i*L10], L10, &ve->buf[L10_out], L10_out);
         
-        find_pitch_lags(&ve->pest, &ve->buf[L10_out], L10_out);
+        pitch_analysis_process(&ve->pa, &ve->buf[L10_out], L10_out);
         
-        pL = ((ve->pest.pitchL[2] + ve->pest.pitchL[3]) >> 1);
+        pL = ((ve->pa.pest->pitchL[2] + ve->pa.pest->pitchL[3]) >> 1);
         ve->pL_buf[E_PL_BUF_SZ-1] = pL;
         
         median_pL = median_pitch(ve);
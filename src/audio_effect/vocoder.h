@@ -72,7 +72,7 @@ struct vocoder_effect {
     webrtc::PushResampler<int16_t> *resampler_in;
     webrtc::PushResampler<int16_t> *resampler_out;
     struct residual_estimator rest;
-    struct pitch_estimator pest;
+    struct pitch_analysis pa;
     int16_t buf[E_BUF_FRAMES * 10 * 48];
     int pL_buf[E_PL_BUF_SZ];
     int cnt;
@@ -39,6 +39,14 @@ namespace webrtc {
 	static void *play_thread(void *arg){
 		return static_cast<fake_audiodevice*>(arg)->playout_thread();
 	}
+
+	static void rec_timeout_handler(void *arg){
+		static_cast<fake_audiodevice*>(arg)->record_timeout();
+	}
+
+	static void play_timeout_handler(void *arg){
+		static_cast<fake_audiodevice*>(arg)->playout_timeout();
+	}
     
 	fake_audiodevice::fake_audiodevice(bool realtime) {
 		audioCallback_ = NULL;
@@ -49,6 +57,9 @@ namespace webrtc {
 		rec_tid_ = 0;
 		play_tid_ = 0;
 		realtime_ = realtime;
+		virtual_clock_ = false;
+		tmr_init(&rec_tmr_);
+		tmr_init(&play_tmr_);
 		delta_omega_ = 0.0f;
 		omega_ = 0.0f;
     }
@@ -90,7 +101,13 @@ namespace webrtc {
     
 	int32_t fake_audiodevice::StartPlayout() {
 		if(!is_playing_){
-			pthread_create(&play_tid_, NULL, play_thread, this);
+			if(virtual_clock_){
+				tmr_start(&play_tmr_, FRAME_LEN_MS,
+					  play_timeout_handler, this);
+			}
+			else{
+				pthread_create(&play_tid_, NULL, play_thread, this);
+			}
 		}
 		is_playing_ = true;
 		return 0;
@@ -103,7 +120,13 @@ namespace webrtc {
 	int32_t fake_audiodevice::StartRecording() {
 		if(!is_recording_){
 			is_recording_ = true;
-			pthread_create(&rec_tid_, NULL, rec_thread, this);
+			if(virtual_clock_){
+				tmr_start(&rec_tmr_, FRAME_LEN_MS,
+					  rec_timeout_handler, this);
+			}
+			else{
+				pthread_create(&rec_tid_, NULL, rec_thread, this);
+			}
 		}
 		return 0;
     }
@@ -113,6 +136,10 @@ namespace webrtc {
 	}
     
 	int32_t fake_audiodevice::StopRecording() {
+		if (virtual_clock_){
+			tmr_cancel(&rec_tmr_);
+			is_recording_ = false;
+		}
 		if (rec_tid_ && is_recording_){
 			void* thread_ret;
 			is_recording_ = false;
@@ -124,6 +151,10 @@ namespace webrtc {
 	}
     
 	int32_t fake_audiodevice::StopPlayout() {
+		if (virtual_clock_){
+			tmr_cancel(&play_tmr_);
+			is_playing_ = false;
+		}
 		if (play_tid_ && is_playing_){
 			void* thread_ret;
 			is_playing_ = false;
@@ -149,11 +180,66 @@ namespace webrtc {
         
 		return 0;
     }
-        
-	void* fake_audiodevice::record_thread(){
+
+	/* Drives the device from re timers instead of its own threads. The
+	 * frames then follow tmr_jiffies(), which may be a virtual clock.
+	 * Must be called before the device is started, on the thread that
+	 * runs the re main loop.
+	 */
+	int32_t fake_audiodevice::EnableVirtualClock() {
+		if(is_recording_ || is_playing_){
+			return -1;
+		}
+		virtual_clock_ = true;
+
+		return 0;
+	}
+
+	void fake_audiodevice::RecordFrame(){
 		int16_t audio_buf[FRAME_LEN] = {0};
 		uint32_t currentMicLevel = 10;
 		uint32_t newMicLevel = 0;
+
+		if(delta_omega_ > 0.0f){
+			float tmp;
+			for( int i = 0; i < FRAME_LEN; i++){
+				tmp = (int16_t)(sinf(omega_) * 8000.0f);
+				omega_ += delta_omega_;
+				audio_buf[i] = (int16_t)tmp;
+			}
+			omega_ = fmod(omega_, 2*3.1415926536);
+		}
+
+		if(audioCallback_){
+			audioCallback_->RecordedDataIsAvailable((void*)audio_buf,
+								FRAME_LEN, 2, 1, FS_KHZ*1000, 0, 0,
+								currentMicLevel, false, newMicLevel);
+		}
+	}
+
+	void fake_audiodevice::PlayoutFrame(){
+		int16_t audio_buf[FRAME_LEN] = {0};
+		size_t nSamplesOut;
+		int64_t elapsed_time_ms, ntp_time_ms;
+
+		if(audioCallback_){
+			audioCallback_->NeedMorePlayData(FRAME_LEN, 2, 1, FS_KHZ*1000,
+							 (void*)audio_buf, nSamplesOut,
+							 &elapsed_time_ms, &ntp_time_ms);
+		}
+	}
+
+	void fake_audiodevice::record_timeout(){
+		tmr_start(&rec_tmr_, FRAME_LEN_MS, rec_timeout_handler, this);
+		RecordFrame();
+	}
+
+	void fake_audiodevice::playout_timeout(){
+		tmr_start(&play_tmr_, FRAME_LEN_MS, play_timeout_handler, this);
+		PlayoutFrame();
+	}
+        
+	void* fake_audiodevice::record_thread(){
 		struct timeval now, next_io_time, delta, sleep_time;
         
 		delta.tv_sec = 0;
@@ -168,21 +254,7 @@ namespace webrtc {
 
 			timeradd(&next_io_time, &delta, &next_io_time);
 
-			if(delta_omega_ > 0.0f){
-				float tmp;
-				for( int i = 0; i < FRAME_LEN; i++){
-					tmp = (int16_t)(sinf(omega_) * 8000.0f);
-					omega_ += delta_omega_;
-					audio_buf[i] = (int16_t)tmp;
-				}
-				omega_ = fmod(omega_, 2*3.1415926536);
-			}
-                
-			if(audioCallback_){
-				int32_t ret = audioCallback_->RecordedDataIsAvailable((void*)audio_buf,
-												FRAME_LEN, 2, 1, FS_KHZ*1000, 0, 0,
-												currentMicLevel, false, newMicLevel);
-			}
+			RecordFrame();
             
 			gettimeofday(&now, NULL);
 			timersub(&next_io_time, &now, &sleep_time);
@@ -202,9 +274,6 @@ namespace webrtc {
 	}
     
 	void* fake_audiodevice::playout_thread(){
-		int16_t audio_buf[FRAME_LEN] = {0};
-		size_t nSamplesOut;
-		int64_t elapsed_time_ms, ntp_time_ms;
 		struct timeval now, next_io_time, delta, sleep_time;
         
 		delta.tv_sec = 0;
@@ -219,11 +288,7 @@ namespace webrtc {
             
 			timeradd(&next_io_time, &delta, &next_io_time);
             
-			if(audioCallback_){
-				int32_t ret = audioCallback_->NeedMorePlayData(FRAME_LEN, 2, 1, FS_KHZ*1000,
-																(void*)audio_buf, nSamplesOut,
-																&elapsed_time_ms, &ntp_time_ms);
-			}
+			PlayoutFrame();
             
 			gettimeofday(&now, NULL);
 			timersub(&next_io_time, &now, &sleep_time);
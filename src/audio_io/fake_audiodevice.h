@@ -19,6 +19,7 @@
 #include "webrtc/modules/audio_device/include/audio_device.h"
 #include <pthread.h>
 #include <string.h>
+#include <re.h>
 
 #define FRAME_LEN_MS 10
 #define FS_KHZ 16
@@ -52,6 +53,7 @@ namespace webrtc {
         int32_t Terminate();
         
         int32_t EnableSine();
+        int32_t EnableVirtualClock();
         
         int32_t ActiveAudioLayer(AudioLayer* audioLayer) const { return -1; }
         ErrorCode LastError() const { return kAdmErrNone; }
@@ -165,7 +167,12 @@ namespace webrtc {
                 
         void* record_thread();
         void* playout_thread();
+        void record_timeout();
+        void playout_timeout();
     private:
+        void RecordFrame();
+        void PlayoutFrame();
+
         AudioTransport* audioCallback_;
         pthread_t rec_tid_ = 0;
         pthread_t play_tid_ = 0;
@@ -174,6 +181,9 @@ namespace webrtc {
         volatile bool rec_is_initialized_;
         volatile bool play_is_initialized_;
         bool realtime_;
+        bool virtual_clock_;
+        struct tmr rec_tmr_;
+        struct tmr play_tmr_;
         float delta_omega_;
         float omega_;
     };
@@ -95,10 +95,39 @@
 #define DATA_CHANNEL_MAX_LABEL_STR_LEN 128
 #define DATA_CHANNEL_MAX_PROTOCOL_STR_LEN 128
 
+/* Bulk sends are split into messages of at most this size */
+#define DCE_BULK_CHUNK (16*1024)
+/* usrsctp calls send_cb once this much send buffer space is free */
+#define DCE_SEND_THRESHOLD (64*1024)
+/* Bulk sends beyond this many buffered bytes fail with ENOBUFS */
+#define DCE_MAX_BUFFERED (16*1024*1024)
+
+
+/* Associations are known to usrsctp by a handle, not by their address.
+ * The handle is the index of a slot in the association table plus the
+ * slot's generation, so a stale handle from a destroyed dce never
+ * matches a newer dce reusing the slot. Each slot has its own lock,
+ * the send and receive callbacks of different associations never
+ * contend with each other. The global lock only protects allocating
+ * and freeing slots.
+ *
+ * The table and all slot locks are set up once in dce_init and never
+ * move, so the callbacks look up a slot without the global lock.
+ */
+#define DCE_MAX_ASSOC 1024
+
+struct dce_slot {
+	struct lock *lock;
+	struct dce *dce;     /* NULL if not (yet) active */
+	uint16_t gen;
+};
 
 static struct {
 	struct lock *lock;
-	struct list dcel;
+	struct dce_slot slotv[DCE_MAX_ASSOC];
+	uint16_t freev[DCE_MAX_ASSOC];
+	size_t freec;
+	size_t slotc;        /* slots ever handed out */
 } g_dce = {
 	.lock = NULL
 };
@@ -138,6 +167,12 @@ struct dce_channel {
 	dce_data_h *datah;
 	int id;
 	void *arg;
+
+	/* bulk data not yet taken by usrsctp */
+	struct mbuf *sendq;
+	size_t buffered_low;
+	dce_buffered_low_h *lowh;
+	bool above_low;
 };
 
 struct dce {
@@ -150,11 +185,19 @@ struct dce {
 	bool snd_dry_event;
 	void *arg;
 
-	struct le le; /* member of global active list */
+	void *handle; /* our address towards usrsctp */
+
+	/* Pumps requested from usrsctp threads run in the owning thread */
+	struct mqueue *mq;
+	bool pump_pending;   /* protected by the slot lock */
 
 	uint32_t magic;
 };
 
+enum {
+	DCE_MQ_PUMP = 1,
+};
+
 #define DCE_MAGIC 0xdcedce
 
 #define DATA_CHANNEL_OPEN_REQUEST  0x03
@@ -211,18 +254,96 @@ struct sctp_header {
 };
 
 
-static bool exist_dce(struct list *dcel, struct dce *dce)
+static inline void *slot_handle(size_t idx, uint16_t gen)
 {
-	bool found = false;
-	struct le *le;
+	return (void *)(uintptr_t)(((uintptr_t)gen << 16) | (idx + 1));
+}
+
 
-	le = dcel->head;
-	while (le && !found) {
-		found = le->data == (void *)dce;
-		le = le->next;
+static int slot_alloc(void **handlep)
+{
+	struct dce_slot *slot;
+	size_t idx;
+	int err = 0;
+
+	lock_write_get(g_dce.lock);
+
+	if (g_dce.freec > 0) {
+		idx = g_dce.freev[--g_dce.freec];
+	}
+	else if (g_dce.slotc < DCE_MAX_ASSOC) {
+		idx = g_dce.slotc++;
+	}
+	else {
+		err = ENOSPC;
+		goto out;
 	}
 
-	return found;
+	slot = &g_dce.slotv[idx];
+	*handlep = slot_handle(idx, slot->gen);
+
+ out:
+	lock_rel(g_dce.lock);
+
+	return err;
+}
+
+
+static void slot_free(void *handle)
+{
+	size_t idx = ((uintptr_t)handle & 0xffff) - 1;
+	struct dce_slot *slot = &g_dce.slotv[idx];
+
+	if (!dce_inited || idx >= DCE_MAX_ASSOC)
+		return;
+
+	lock_write_get(slot->lock);
+	slot->dce = NULL;
+	++slot->gen;
+	lock_rel(slot->lock);
+
+	lock_write_get(g_dce.lock);
+	g_dce.freev[g_dce.freec++] = (uint16_t)idx;
+	lock_rel(g_dce.lock);
+}
+
+
+static void slot_publish(void *handle, struct dce *dce)
+{
+	size_t idx = ((uintptr_t)handle & 0xffff) - 1;
+	struct dce_slot *slot = &g_dce.slotv[idx];
+
+	if (!dce_inited || idx >= DCE_MAX_ASSOC)
+		return;
+
+	lock_write_get(slot->lock);
+	slot->dce = dce;
+	lock_rel(slot->lock);
+}
+
+
+/* Returns the active dce for a handle with its slot locked,
+ * or NULL and nothing locked.
+ */
+static struct dce *slot_acquire(void *handle, struct dce_slot **slotp)
+{
+	uintptr_t h = (uintptr_t)handle;
+	size_t idx = (h & 0xffff) - 1;
+	struct dce_slot *slot;
+
+	if (!h || idx >= DCE_MAX_ASSOC)
+		return NULL;
+
+	slot = &g_dce.slotv[idx];
+	lock_write_get(slot->lock);
+	if (!slot->dce || slot->gen != (uint16_t)(h >> 16)) {
+		lock_rel(slot->lock);
+		return NULL;
+	}
+
+	*slotp = slot;
+
+	return slot->dce;
 }
 
 static int sctp_header_decode(struct sctp_header *hdr, struct mbuf *mb)
@@ -618,23 +739,15 @@ open_channel(struct peer_connection *pc, uint8_t unordered, uint16_t pr_policy,
 	return (channel);
 }
 
+/* Returns 0, or the errno from usrsctp, EAGAIN if the send buffer
+ * is full.
+ */
 static int
-send_user_message(struct peer_connection *pc, struct channel *channel, char *message, size_t length)
+send_channel_data(struct peer_connection *pc, struct channel *channel,
+		  const void *data, size_t length, uint32_t ppid)
 {
 	struct sctp_sendv_spa spa;
 
-	if (channel == NULL) {
-		return (0);
-	}
-	if ((channel->state != DATA_CHANNEL_OPEN) &&
-	    (channel->state != DATA_CHANNEL_CONNECTING)) {
-		/* XXX: What to do in other states */
-		warning("dce: %s Channel %u (%s/%s) is closed \n",
-		      __FUNCTION__, channel->id,
-		      channel->label, channel->protocol);
-		return (0);
-	}
-
 	memset(&spa, 0, sizeof(struct sctp_sendv_spa));
 	spa.sendv_sndinfo.snd_sid = channel->o_stream;
     
@@ -644,7 +757,7 @@ send_user_message(struct peer_connection *pc, struct channel *channel, char *mes
 	} else {
 		spa.sendv_sndinfo.snd_flags = SCTP_EOR;
 	}
-	spa.sendv_sndinfo.snd_ppid = htonl(DATA_CHANNEL_PPID_DOMSTRING);
+	spa.sendv_sndinfo.snd_ppid = htonl(ppid);
 	spa.sendv_flags = SCTP_SEND_SNDINFO_VALID;
 	if ((channel->pr_policy == SCTP_PR_SCTP_TTL) ||
 	    (channel->pr_policy == SCTP_PR_SCTP_RTX)) {
@@ -653,10 +766,35 @@ send_user_message(struct peer_connection *pc, struct channel *channel, char *mes
 		spa.sendv_flags |= SCTP_SEND_PRINFO_VALID;
 	}
 	if (usrsctp_sendv(pc->sock,
-	                  message, length,
+	                  data, length,
 	                  NULL, 0,
 	                  &spa, (socklen_t)sizeof(struct sctp_sendv_spa),
 	                  SCTP_SENDV_SPA, 0) < 0) {
+		int err = errno;
+
+		return err == EWOULDBLOCK ? EAGAIN : err;
+	}
+
+	return 0;
+}
+
+static int
+send_user_message(struct peer_connection *pc, struct channel *channel, char *message, size_t length)
+{
+	if (channel == NULL) {
+		return (0);
+	}
+	if ((channel->state != DATA_CHANNEL_OPEN) &&
+	    (channel->state != DATA_CHANNEL_CONNECTING)) {
+		/* XXX: What to do in other states */
+		warning("dce: %s Channel %u (%s/%s) is closed \n",
+		      __FUNCTION__, channel->id,
+		      channel->label, channel->protocol);
+		return (0);
+	}
+
+	if (send_channel_data(pc, channel, message, length,
+			      DATA_CHANNEL_PPID_DOMSTRING)) {
 		warning("dce: sctp_sendv \n");
 		return (0);
 	} else {
@@ -664,6 +802,138 @@ send_user_message(struct peer_connection *pc, struct channel *channel, char *mes
 	}
 }
 
+/* Hands as much queued bulk data to usrsctp as it takes, in chunks of
+ * DCE_BULK_CHUNK. Returns true if the buffered amount has just dropped
+ * to the channel's low watermark.
+ *
+ * NOTE: call with the peer connection locked
+ */
+static bool
+pump_channel(struct dce *dce, struct dce_channel *ch)
+{
+	struct mbuf *mb = ch->sendq;
+	struct channel *channel;
+	size_t left;
+	int err;
+
+	if (!mb || ch->id < 0 || ch->id >= NUMBER_OF_CHANNELS)
+		return false;
+
+	channel = &dce->pc.channels[ch->id];
+	if ((channel->state != DATA_CHANNEL_OPEN) &&
+	    (channel->state != DATA_CHANNEL_CONNECTING))
+		return false;
+
+	while ((left = mbuf_get_left(mb)) > 0) {
+		size_t n = min(left, (size_t)DCE_BULK_CHUNK);
+
+		err = send_channel_data(&dce->pc, channel, mbuf_buf(mb), n,
+					DATA_CHANNEL_PPID_BINARY);
+		if (err) {
+			if (err != EAGAIN)
+				warning("dce: bulk send failed (%m)\n", err);
+			break;
+		}
+
+		mbuf_advance(mb, n);
+		dce->snd_dry_event = false;
+	}
+
+	if (left == 0) {
+		mbuf_rewind(mb);
+	}
+	else if (mb->pos > mb->size / 2) {
+		memmove(mb->buf, mbuf_buf(mb), left);
+		mb->pos = 0;
+		mb->end = left;
+	}
+
+	if (ch->above_low && left <= ch->buffered_low) {
+		ch->above_low = false;
+		return ch->lowh != NULL;
+	}
+
+	return false;
+}
+
+/* Pumps all channels and calls the low watermark handlers of those
+ * that dropped below it. The handlers are called with nothing locked,
+ * each channel is referenced so it can't go away under us.
+ *
+ * NOTE: call from the thread owning the dce, with nothing locked
+ */
+static void
+pump_channels(struct dce *dce)
+{
+	struct dce_channel *lowv[NUMBER_OF_CHANNELS];
+	size_t bufv[NUMBER_OF_CHANNELS];
+	size_t i, n = 0;
+	struct le *le;
+
+	lock_peer_connection(&dce->pc);
+	for (le = list_head(&dce->channell); le; le = le->next) {
+		struct dce_channel *ch = le->data;
+
+		if (pump_channel(dce, ch) && n < ARRAY_SIZE(lowv)) {
+			bufv[n] = mbuf_get_left(ch->sendq);
+			lowv[n++] = mem_ref(ch);
+		}
+	}
+	unlock_peer_connection(&dce->pc);
+
+	for (i = 0; i < n; i++) {
+		struct dce_channel *ch = lowv[i];
+
+		if (ch->lowh)
+			ch->lowh(bufv[i], ch->arg);
+		mem_deref(ch);
+	}
+}
+
+/* Asks the owning thread to pump the channels. usrsctp calls us with
+ * its own locks held, and dce_send holds the peer connection lock
+ * across usrsctp_sendv, so neither may pump here.
+ *
+ * NOTE: call with the slot locked
+ */
+static void
+schedule_pump(struct dce *dce)
+{
+	int err;
+
+	if (dce->pump_pending || !dce->mq)
+		return;
+
+	err = mqueue_push(dce->mq, DCE_MQ_PUMP, NULL);
+	if (err) {
+		warning("dce: schedule pump failed (%m)\n", err);
+		return;
+	}
+
+	dce->pump_pending = true;
+}
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct dce *dce = arg;
+	struct dce_slot *slot;
+
+	(void)data;
+
+	if (id != DCE_MQ_PUMP)
+		return;
+
+	if (!slot_acquire(dce->handle, &slot))
+		return;
+	dce->pump_pending = false;
+	lock_rel(slot->lock);
+
+	mem_ref(dce);
+	pump_channels(dce);
+	mem_deref(dce);
+}
+
 static void
 reset_outgoing_stream(struct peer_connection *pc, uint16_t o_stream)
 {
@@ -1381,9 +1651,16 @@ handle_notification(struct dce *dce,
 		break;
 	case SCTP_AUTHENTICATION_EVENT:
 		break;
-	case SCTP_SENDER_DRY_EVENT:
+	case SCTP_SENDER_DRY_EVENT: {
+		struct dce_slot *slot;
+
 		dce->snd_dry_event = true;
+		if (slot_acquire(dce->handle, &slot)) {
+			schedule_pump(dce);
+			lock_rel(slot->lock);
+		}
 		break;
+	}
 	case SCTP_NOTIFICATIONS_STOPPED_EVENT:
 		break;
 	case SCTP_SEND_FAILED_EVENT:
@@ -1521,30 +1798,26 @@ static int
 receive_cb(struct socket *sock, union sctp_sockstore addr, void *data,
            size_t datalen, struct sctp_rcvinfo rcv, int flags, void *ulp_info)
 {
-	struct dce *dce = ulp_info;
-	int err = 0;
+	struct dce_slot *slot;
+	struct dce *dce;
 
-	if (!dce) {
+	if (!ulp_info) {
 		warning("dce: receive_cb: dce == NULL\n");
 		return 1;
 	}
 
-	debug("sock=%p dce=%p dce->pc=%p\n", sock, dce, &dce->pc);
-
-	lock_write_get(g_dce.lock);
-	if (!exist_dce(&g_dce.dcel, dce)) {
-		warning("dce: receive_cb: dce(%p) not active\n", dce);
-		err = ENOSYS;
-	}
-	else {
-		assert(DCE_MAGIC == dce->magic);
-		/* Make sure we have a ref to the dce */
-		mem_ref(dce);
+	dce = slot_acquire(ulp_info, &slot);
+	if (!dce) {
+		warning("dce: receive_cb: dce(%p) not active\n", ulp_info);
+		return 1;
 	}
-	lock_rel(g_dce.lock);
 
-	if (err)
-		return 1;
+	assert(DCE_MAGIC == dce->magic);
+	/* Make sure we have a ref to the dce */
+	mem_ref(dce);
+	lock_rel(slot->lock);
+
+	debug("sock=%p dce=%p dce->pc=%p\n", sock, dce, &dce->pc);
 	
 	if (data) {
 		lock_peer_connection(&dce->pc);
@@ -1561,9 +1834,8 @@ receive_cb(struct socket *sock, union sctp_sockstore addr, void *data,
 		free(data);
 	}
 	else {
-		usrsctp_deregister_address(dce);
-		if (dce)
-			dce->sock = NULL;
+		usrsctp_deregister_address(dce->handle);
+		dce->sock = NULL;
 		usrsctp_close(sock);
 	}
 
@@ -1573,6 +1845,31 @@ receive_cb(struct socket *sock, union sctp_sockstore addr, void *data,
 }
 
 
+/* Called by usrsctp when at least DCE_SEND_THRESHOLD bytes of send
+ * buffer are free again.
+ */
+static int
+send_cb(struct socket *sock, uint32_t sb_free)
+{
+	struct dce_slot *slot;
+	struct dce *dce;
+	void *ulp_info = NULL;
+
+	(void)sb_free;
+
+	usrsctp_get_ulpinfo(sock, &ulp_info);
+
+	dce = slot_acquire(ulp_info, &slot);
+	if (!dce)
+		return 0;
+
+	schedule_pump(dce);
+	lock_rel(slot->lock);
+
+	return 0;
+}
+
+
 int dce_status(struct re_printf *pf, struct dce *dce)
 {
 	if (!dce)
@@ -1610,7 +1907,7 @@ int dce_connect(struct dce *dce, bool dtls_role_active)
 	sconn.sconn_len = sizeof(struct sockaddr_conn);
 #endif
 	sconn.sconn_port = htons(port);
-	sconn.sconn_addr = dce;
+	sconn.sconn_addr = dce->handle;
 	
 	sctp_err = usrsctp_connect(dce->sock, (struct sockaddr *)&sconn,
 				   sizeof(sconn));
@@ -1709,7 +2006,7 @@ void dce_recv_pkt(struct dce *dce, const uint8_t *pkt, size_t len)
 		}
 	}
 
-	usrsctp_conninput(dce, pkt, len, 0);
+	usrsctp_conninput(dce->handle, pkt, len, 0);
 }
 
 
@@ -1738,6 +2035,85 @@ bool dce_snd_dry(struct dce *dce)
 	return dce->snd_dry_event;
 }
 
+
+int dce_send_bulk(struct dce *dce, struct dce_channel *ch,
+		  const uint8_t *data, size_t len)
+{
+	struct mbuf *mb;
+	size_t pos;
+	int err = 0;
+
+	if (!dce || !ch || (!data && len))
+		return EINVAL;
+
+	assert(DCE_MAGIC == dce->magic);
+
+	if (ch->id >= NUMBER_OF_CHANNELS || ch->id < 0)
+		return ERANGE;
+
+	lock_peer_connection(&dce->pc);
+
+	if (!ch->sendq) {
+		ch->sendq = mbuf_alloc(DCE_BULK_CHUNK);
+		if (!ch->sendq) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+	mb = ch->sendq;
+
+	if (mbuf_get_left(mb) + len > DCE_MAX_BUFFERED) {
+		err = ENOBUFS;
+		goto out;
+	}
+
+	pos = mb->pos;
+	mb->pos = mb->end;
+	err = mbuf_write_mem(mb, data, len);
+	mb->pos = pos;
+	if (err)
+		goto out;
+
+	pump_channel(dce, ch);
+
+	/* Only arm the low watermark if usrsctp pushed back */
+	if (mbuf_get_left(mb) > ch->buffered_low)
+		ch->above_low = true;
+
+ out:
+	unlock_peer_connection(&dce->pc);
+
+	return err;
+}
+
+
+size_t dce_buffered_amount(struct dce *dce, const struct dce_channel *ch)
+{
+	size_t n;
+
+	if (!dce || !ch)
+		return 0;
+
+	lock_peer_connection(&dce->pc);
+	n = ch->sendq ? mbuf_get_left(ch->sendq) : 0;
+	unlock_peer_connection(&dce->pc);
+
+	return n;
+}
+
+
+int dce_channel_set_buffered_low(struct dce_channel *ch, size_t threshold,
+				 dce_buffered_low_h *lowh)
+{
+	if (!ch)
+		return EINVAL;
+
+	ch->buffered_low = threshold;
+	ch->lowh = lowh;
+
+	return 0;
+}
+
 static
 void
 debug_printf(const char *format, ...)
@@ -1754,9 +2130,12 @@ static void dce_destructor(void *arg)
 {
 	struct dce *dce = arg;
 
-	lock_write_get(g_dce.lock);
-	list_unlink(&dce->le);
-	lock_rel(g_dce.lock);
+	/* From here on the send and receive callbacks ignore us */
+	if (dce->handle)
+		slot_publish(dce->handle, NULL);
+
+	/* No more pumps can be scheduled */
+	dce->mq = mem_deref(dce->mq);
 
 	assert(DCE_MAGIC == dce->magic);
     
@@ -1772,7 +2151,8 @@ static void dce_destructor(void *arg)
 	}
 #endif
 
-	usrsctp_deregister_address(dce);
+	if (dce->handle)
+		usrsctp_deregister_address(dce->handle);
 	if (dce->sock) {
 		struct socket *sock = dce->sock;
 		dce->sock = NULL;
@@ -1782,25 +2162,31 @@ static void dce_destructor(void *arg)
 
 	list_flush(&dce->channell);
 	close_peer_connection(&dce->pc);
+
+	if (dce->handle)
+		slot_free(dce->handle);
 }
 
 
 static int usrsctp_send_handler(void *addr, void *buf, size_t len,
 				uint8_t tos, uint8_t set_df)
 {
-	struct dce *dce = addr;
+	struct dce_slot *slot;
+	struct dce *dce;
 	struct sctp_header hdr;
 	struct mbuf mb;
 	int err;
     
-	if (!dce)
+	if (!addr)
 		return EINVAL;
 
-	lock_write_get(g_dce.lock);
-	if (!exist_dce(&g_dce.dcel, dce)) {
-		debug("dce: send: dce(%p) not active\n", dce);
-		err = ENOSYS;
-		goto out;
+	/* Only this association's slot is locked, so that the sendh
+	 * can't race with the dce being destroyed.
+	 */
+	dce = slot_acquire(addr, &slot);
+	if (!dce) {
+		debug("dce: send: dce(%p) not active\n", addr);
+		return 1;
 	}
 
 	assert(DCE_MAGIC == dce->magic);
@@ -1828,22 +2214,44 @@ static int usrsctp_send_handler(void *addr, void *buf, size_t len,
 	}
 
  out:
-	lock_rel(g_dce.lock);
+	lock_rel(slot->lock);
 
 	return err ? 1 : 0;
 }
 
 
+static void slots_free(void)
+{
+	size_t i;
+
+	for (i = 0; i < DCE_MAX_ASSOC; i++)
+		g_dce.slotv[i].lock = mem_deref(g_dce.slotv[i].lock);
+	g_dce.slotc = 0;
+	g_dce.freec = 0;
+
+	g_dce.lock = mem_deref(g_dce.lock);
+}
+
+
 int dce_init(void)
 {
+	size_t i;
+	int err;
+
 	debug("dce_init: inited=%d\n", dce_inited);
 	
 	if (dce_inited)
 		return 0;
 
 	memset(&g_dce, 0, sizeof(g_dce));
-	lock_alloc(&g_dce.lock);
-	list_init(&g_dce.dcel);
+	err = lock_alloc(&g_dce.lock);
+	for (i = 0; i < DCE_MAX_ASSOC && !err; i++)
+		err = lock_alloc(&g_dce.slotv[i].lock);
+	if (err) {
+		warning("dce: init: lock alloc failed (%m)\n", err);
+		slots_free();
+		return err;
+	}
 
 	usrsctp_init(0, usrsctp_send_handler, debug_printf);
     
@@ -1866,7 +2274,7 @@ void dce_close(void)
 		usleep(500000);
 	}
 
-	mem_deref(g_dce.lock);
+	slots_free();
 	dce_inited = false;	
 }
 
@@ -1917,10 +2325,17 @@ int dce_alloc(struct dce **dcep,
 #endif
 	usrsctp_sysctl_set_sctp_blackhole(2);
 
-	usrsctp_register_address(dce);
+	err = slot_alloc(&dce->handle);
+	if (err) {
+		warning("dce: alloc: no free association slot (%m)\n", err);
+		goto out;
+	}
+
+	usrsctp_register_address(dce->handle);
 
 	dce->sock = usrsctp_socket(AF_CONN, SOCK_STREAM, IPPROTO_SCTP,
-				   receive_cb, NULL, 0, dce);
+				   receive_cb, send_cb, DCE_SEND_THRESHOLD,
+				   dce->handle);
 	
 	if (dce->sock == NULL) {
 		warning("dce: alloc: failed to create socket\n");
@@ -1938,6 +2353,10 @@ int dce_alloc(struct dce **dcep,
 	err = init_peer_connection(&dce->pc);
 	if (err)
 		goto out;
+
+	err = mqueue_alloc(&dce->mq, mqueue_handler, dce);
+	if (err)
+		goto out;
     
 	struct linger linger_opt; // This makes sctp stop immediately after usrsctp_close
 	linger_opt.l_onoff = 1;
@@ -2015,7 +2434,7 @@ int dce_alloc(struct dce **dcep,
 	sconn.sconn_len = sizeof(sconn);
 #endif
 	sconn.sconn_port = htons(port);
-	sconn.sconn_addr = dce;
+	sconn.sconn_addr = dce->handle;
 	info("dce: alloc: binding: %p:%d\n", dce, port);
 	sctp_err = usrsctp_bind(dce->sock,
 				(struct sockaddr *)&sconn, sizeof(sconn));
@@ -2037,9 +2456,7 @@ int dce_alloc(struct dce **dcep,
     
 	dce->magic = DCE_MAGIC;
 
-	lock_write_get(g_dce.lock);
-	list_append(&g_dce.dcel, &dce->le, dce);
-	lock_rel(g_dce.lock);
+	slot_publish(dce->handle, dce);
     
  out:
 	if (err)
@@ -2050,6 +2467,14 @@ int dce_alloc(struct dce **dcep,
 	return err;
 }
 
+static void dce_channel_destructor(void *arg)
+{
+	struct dce_channel *ch = arg;
+
+	mem_deref(ch->sendq);
+}
+
+
 int dce_channel_alloc(struct dce_channel **chp,
 		      struct dce *dce,
 		      const char *label,
@@ -2075,7 +2500,7 @@ int dce_channel_alloc(struct dce_channel **chp,
 		return EALREADY;
 	}
 
-	ch = mem_zalloc(sizeof(*ch), NULL);
+	ch = mem_zalloc(sizeof(*ch), dce_channel_destructor);
 	if (!ch)
 		return ENOMEM;
 	
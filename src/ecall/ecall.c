@@ -52,6 +52,7 @@ static const struct ecall_conf default_conf = {
 
 
 static int alloc_mediaflow(struct ecall *ecall);
+static int restart_mediaflow(struct ecall *ecall, bool offerer);
 static int generate_answer(struct ecall *ecall, struct econn *econn);
 
 
@@ -240,8 +241,7 @@ static void econn_update_req_handler(struct econn *econn,
 		mediaflow_reset_media(ecall->mf);
 	}
 	else {
-		ecall->mf = mem_deref(ecall->mf);
-		err = alloc_mediaflow(ecall);
+		err = restart_mediaflow(ecall, false);
 		if (err)
 			goto error;
 	}
@@ -1052,6 +1052,7 @@ static bool interface_handler(const char *ifname, const struct sa *sa,
 
 static int alloc_mediaflow(struct ecall *ecall)
 {
+	struct turnpool *pool;
 	struct sa laddr;
 	char tag[64] = "";
 	int err;
@@ -1111,6 +1112,9 @@ static int alloc_mediaflow(struct ecall *ecall)
 		mediaflow_enable_privacy(ecall->mf, true);
 	}
 
+	if (msystem_have_hd_video(ecall->msys))
+		mediaflow_enable_hd_video(ecall->mf, true);
+
 	mediaflow_set_gather_handler(ecall->mf, mf_gather_handler);
 
 	err = mediaflow_add_video(ecall->mf, msystem_vidcodecl(ecall->msys));
@@ -1157,6 +1161,32 @@ static int alloc_mediaflow(struct ecall *ecall)
 		/* populate all network interfaces */
 		net_if_apply(interface_handler, ecall);
 
+		/* The pool races the server over UDP and TCP, which
+		 * TURN servers listen on at the same port, for the
+		 * next call too. Either one will do for this call.
+		 */
+		pool = msystem_turnpool(ecall->msys);
+		if (pool) {
+			struct turnpool_server srvv[2];
+			size_t i;
+
+			for (i = 0; i < ARRAY_SIZE(srvv); i++) {
+				srvv[i].addr = ecall->turn.srv;
+				srvv[i].secure = false;
+				srvv[i].username = ecall->turn.user;
+				srvv[i].password = ecall->turn.pass;
+			}
+			srvv[0].proto = IPPROTO_UDP;
+			srvv[1].proto = IPPROTO_TCP;
+
+			(void)turnpool_set_servers(pool, srvv,
+						   ARRAY_SIZE(srvv));
+
+			if (!mediaflow_gather_turnpool(ecall->mf, pool,
+						       srvv, ARRAY_SIZE(srvv)))
+				break;
+		}
+
 		err = mediaflow_gather_turn(ecall->mf, &ecall->turn.srv,
 					    ecall->turn.user,
 					    ecall->turn.pass);
@@ -1179,6 +1209,49 @@ static int alloc_mediaflow(struct ecall *ecall)
 }
 
 
+/*
+ * Replace the mediaflow of a restarted call. The side that was DTLS
+ * client keeps its session and offers to resume it, which saves a
+ * round trip and the certificate signatures before media flows again.
+ * As offerer we keep our DTLS role (RFC 8842), so that the session
+ * stays with the DTLS client.
+ */
+static int restart_mediaflow(struct ecall *ecall, bool offerer)
+{
+	struct tls_session *sess = NULL;
+	enum media_setup setup;
+	int err;
+
+	setup = mediaflow_local_setup(ecall->mf);
+
+	/* only the DTLS client of an established flow has a session */
+	(void)mediaflow_get_dtls_session(ecall->mf, &sess);
+
+	ecall->mf = mem_deref(ecall->mf);
+	err = alloc_mediaflow(ecall);
+	if (err)
+		goto out;
+
+	mediaflow_set_dtls_session(ecall->mf, sess);
+
+	if (offerer && (setup == SETUP_ACTIVE || setup == SETUP_PASSIVE)) {
+
+		err = mediaflow_set_setup(ecall->mf, setup);
+		if (err)
+			goto out;
+	}
+
+	info("ecall(%p): restart: setup=%s, %s DTLS session\n",
+	     ecall, mediaflow_setup_name(setup),
+	     sess ? "with" : "without");
+
+ out:
+	mem_deref(sess);
+
+	return err;
+}
+
+
 static int create_econn(struct ecall *ecall)
 {
 	int err;
@@ -1636,8 +1709,15 @@ int ecall_debug(struct re_printf *pf, const struct ecall *ecall)
 			  ecall->audio_setup_time);
 
 	if (ecall->mf) {
+		struct mediaflow_mem mem;
+
 		err |= re_hprintf(pf, "mediaflow:   %H\n",
 				  mediaflow_debug, ecall->mf);
+
+		mediaflow_mem_get(ecall->mf, &mem);
+		err |= re_hprintf(pf, "memory:      %zu bytes (ecall=%zu)\n",
+				  sizeof(*ecall) + mediaflow_mem_total(&mem),
+				  sizeof(*ecall));
 	}
 	else {
 		err |= re_hprintf(pf, "mediaflow:   None\n");
@@ -1686,9 +1766,11 @@ int ecall_restart(struct ecall *ecall)
 	}
 
 	ecall->update = true;
-	
-	ecall->mf = mem_deref(ecall->mf);
-	err = alloc_mediaflow(ecall);
+
+	/* allocations made on the old network are of no use */
+	turnpool_flush(msystem_turnpool(ecall->msys));
+
+	err = restart_mediaflow(ecall, true);
 	if (err) {
 		warning("ecall: re-start: alloc_mediaflow failed: %m\n", err);
 		goto out;
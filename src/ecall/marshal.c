@@ -22,6 +22,8 @@
 
 struct ecall_marshal {
 	struct mqueue *mq;
+	struct mediashard *shard;  /* where the events are handled */
+	int err;
 };
 
 
@@ -183,11 +185,23 @@ static void mqueue_handler(int id, void *data, void *arg)
 }
 
 
+static void mq_close_handler(void *arg)
+{
+	struct ecall_marshal *em = arg;
+
+	em->mq = mem_deref(em->mq);
+}
+
+
 static void marshal_destructor(void *arg)
 {
 	struct ecall_marshal *em = arg;
 
-	mem_deref(em->mq);
+	/* the queue must be closed on the loop it was opened on */
+	if (em->shard)
+		mediashard_call(em->shard, mq_close_handler, em);
+	else
+		mem_deref(em->mq);
 }
 
 
@@ -217,6 +231,49 @@ int ecall_marshal_alloc(struct ecall_marshal **emp)
 }
 
 
+static void mq_open_handler(void *arg)
+{
+	struct ecall_marshal *em = arg;
+
+	em->err = mqueue_alloc(&em->mq, mqueue_handler, em);
+}
+
+
+/* The events are handled on the given media shard instead of the
+ * calling thread. The ecalls must have been allocated on that shard,
+ * and their handlers are called from it.
+ */
+int ecall_marshal_alloc_shard(struct ecall_marshal **emp,
+			      struct mediashard *shard)
+{
+	struct ecall_marshal *em;
+	int err;
+
+	if (!emp || !shard)
+		return EINVAL;
+
+	em = mem_zalloc(sizeof(*em), marshal_destructor);
+	if (!em)
+		return ENOMEM;
+
+	err = mediashard_call(shard, mq_open_handler, em);
+	if (!err)
+		err = em->err;
+	if (err)
+		goto out;
+
+	em->shard = shard;
+
+ out:
+	if (err)
+		mem_deref(em);
+	else
+		*emp = em;
+
+	return err;
+}
+
+
 static void transp_recv_destructor(void *arg)
 {
 	struct mq_data *md = arg;
@@ -20,6 +20,7 @@
  * Conversation management
  */
 
+#include <pthread.h>
 #include <re.h>
 #include "avs_dict.h"
 #include "avs_jzon.h"
@@ -40,9 +41,80 @@
 #define ENGINE_USER_DEFAULT_SELF_NAME "You"
 
 
+enum {
+	CONV_LOAD_MAX_WORKERS = 16,
+	CONV_LOAD_BATCH       = 64,   /* conversations merged per wakeup  */
+};
+
+enum {
+	CONV_LOAD_MQ_BATCH = 0,
+};
+
+
+struct conv_loader;
+
 struct engine_conv_data {
 	struct dict *convd;
 	struct engine_lsnr user_lsnr;
+	struct conv_loader *loader;
+};
+
+
+/* A conversation as read from the store, before it is merged into the
+ * engine. Contains no references to engine state so that it can be
+ * filled in on a worker thread.
+ */
+struct conv_rec {
+	struct le le;
+	char *id;
+	int err;
+
+	uint8_t type;
+	char *name;
+	struct list mbrl;   /* struct conv_rec_member  */
+	uint8_t flags;
+	char *last_event;
+	char *last_read;
+
+	struct engine_conv *conv;  /* set once merged  */
+};
+
+struct conv_rec_member {
+	struct le le;
+	char *user_id;
+	uint8_t flags;
+	double quality;
+};
+
+
+/* State for loading conversations on a pool of worker threads.
+ *
+ * The workers take records from idl, read them from the store and put
+ * them on readl. Every CONV_LOAD_BATCH records, the main thread is woken
+ * up through the mqueue and merges what has been read so far.
+ */
+struct conv_loader {
+	struct engine *engine;
+	struct engine_module_state *state;
+	struct store *store;
+	struct mqueue *mq;
+	struct lock *lock;
+
+	pthread_t threadv[CONV_LOAD_MAX_WORKERS];
+	unsigned threadc;
+
+	struct list idl;     /* struct conv_rec, to be read (locked)  */
+	struct list readl;   /* struct conv_rec, to be merged (locked) */
+	uint32_t readc;      /* number of records on readl (locked)  */
+	uint32_t nread;      /* records read in total (locked)  */
+	bool stop;           /* (locked)  */
+
+	struct list loadedl; /* struct conv_rec, merged  */
+	uint32_t total;
+	uint32_t merged;
+	bool finished;
+
+	uint64_t ts_start;
 };
 
 
@@ -62,6 +134,35 @@ static void send_add_conv(struct engine_conv *conv)
 }
 
 
+/* Conversations loaded from the store at startup are only announced
+ * individually to listeners that don't take the bulk notification.
+ */
+static void send_add_loaded_conv(struct engine_conv *conv)
+{
+	struct le *le;
+
+	LIST_FOREACH(&conv->engine->lsnrl, le) {
+		struct engine_lsnr *lsnr = le->data;
+
+		if (lsnr->addconvh && !lsnr->convsloadedh)
+			lsnr->addconvh(conv, lsnr->arg);
+	}
+}
+
+
+static void send_convs_loaded(struct engine *engine, uint32_t count)
+{
+	struct le *le;
+
+	LIST_FOREACH(&engine->lsnrl, le) {
+		struct engine_lsnr *lsnr = le->data;
+
+		if (lsnr->convsloadedh)
+			lsnr->convsloadedh(count, lsnr->arg);
+	}
+}
+
+
 void engine_send_conv_update(struct engine_conv *conv,
 			     enum engine_conv_changes changes)
 {
@@ -201,86 +302,155 @@ int engine_save_conv(struct engine_conv *conv)
 /*** load conversation
  */
 
-static int load_member(struct engine_conv_member **mbrp,
-		       struct engine *engine, struct sobject *so)
+static void conv_rec_destructor(void *arg)
 {
-	struct engine_conv_member *mbr;
-	char *user_id;
-	uint8_t v8;
-	int err;
+	struct conv_rec *rec = arg;
+
+	list_unlink(&rec->le);
+	mem_deref(rec->id);
+	mem_deref(rec->name);
+	list_flush(&rec->mbrl);
+	mem_deref(rec->last_event);
+	mem_deref(rec->last_read);
+	mem_deref(rec->conv);
+}
 
-	mbr = mem_zalloc(sizeof(*mbr), NULL);
-	if (!mbr)
-		return ENOMEM;
 
-	err = sobject_read_lenstr(&user_id, so);
-	if (err)
-		goto out;
+static void conv_rec_member_destructor(void *arg)
+{
+	struct conv_rec_member *rm = arg;
 
-	err = engine_lookup_user(&mbr->user, engine, user_id, true);
-	if (err)
-		goto out;
+	list_unlink(&rm->le);
+	mem_deref(rm->user_id);
+}
 
-	err = sobject_read_u8(&v8, so);
-	if (err)
-		goto out;
-	mbr->active = v8 & 0x01;
-	mbr->in_call = v8 & 0x02;
 
-	err = sobject_read_dbl(&mbr->quality, so);
-	if (err)
-		goto out;
+static int conv_rec_alloc(struct conv_rec **recp, const char *id)
+{
+	struct conv_rec *rec;
+	int err;
 
-	*mbrp = mbr;
+	rec = mem_zalloc(sizeof(*rec), conv_rec_destructor);
+	if (!rec)
+		return ENOMEM;
 
- out:
-	if (err)
-		mem_deref(mbr);
-	mem_deref(user_id);
-	return err;
+	err = str_dup(&rec->id, id);
+	if (err) {
+		mem_deref(rec);
+		return err;
+	}
+
+	*recp = rec;
+	return 0;
 }
 
 
-static int load_conv(struct engine_conv *conv)
+/* Reads the conversation rec->id from the store into *rec*.
+ *
+ * This only touches the store and *rec* and is safe to call from a
+ * worker thread.
+ */
+static int read_conv(struct conv_rec *rec, struct store *store)
 {
 	struct sobject *so;
-	char *dst;
-	uint8_t v8;
 	uint32_t cnt, i;
 	int err;
 
-	err = store_user_open(&so, conv->engine->store, "conv", conv->id,
-			      "rb");
+	err = store_user_open(&so, store, "conv", rec->id, "rb");
 	if (err)
 		return err;
 
-	err = sobject_read_u8(&v8, so);
+	err = sobject_read_u8(&rec->type, so);
 	if (err)
 		goto out;
-	conv->type = v8;
 
-	err = sobject_read_lenstr(&dst, so);
+	err = sobject_read_lenstr(&rec->name, so);
 	if (err)
 		goto out;
-	mem_deref(conv->name);
-	conv->name = dst;
 
 	err = sobject_read_u32(&cnt, so);
 	if (err)
 		goto out;
 
 	for (i = 0; i < cnt; ++i) {
-		struct engine_conv_member *mbr = NULL;
+		struct conv_rec_member *rm;
 
-		err = load_member(&mbr, conv->engine, so);
+		rm = mem_zalloc(sizeof(*rm), conv_rec_member_destructor);
+		if (!rm) {
+			err = ENOMEM;
+			goto out;
+		}
+		list_append(&rec->mbrl, &rm->le, rm);
+
+		err = sobject_read_lenstr(&rm->user_id, so);
+		if (err)
+			goto out;
+
+		err = sobject_read_u8(&rm->flags, so);
+		if (err)
+			goto out;
+
+		err = sobject_read_dbl(&rm->quality, so);
 		if (err)
 			goto out;
-		list_append(&conv->memberl, &mbr->le, mbr);
 	}
 
-	err = sobject_read_u8(&v8, so);
+	err = sobject_read_u8(&rec->flags, so);
+	if (err)
+		goto out;
+
+	err = sobject_read_lenstr(&rec->last_event, so);
 	if (err)
 		goto out;
+
+	err = sobject_read_lenstr(&rec->last_read, so);
+	if (err)
+		goto out;
+
+ out:
+	mem_deref(so);
+	return err;
+}
+
+
+/* Moves the content of *rec* into *conv*. Must run on the main thread
+ * since it resolves the members.
+ */
+static int apply_conv_rec(struct engine_conv *conv, struct conv_rec *rec)
+{
+	struct le *le;
+	uint8_t v8;
+	int err;
+
+	conv->type = rec->type;
+
+	mem_deref(conv->name);
+	conv->name = rec->name;
+	rec->name = NULL;
+
+	LIST_FOREACH(&rec->mbrl, le) {
+		struct conv_rec_member *rm = le->data;
+		struct engine_conv_member *mbr;
+
+		mbr = mem_zalloc(sizeof(*mbr), NULL);
+		if (!mbr)
+			return ENOMEM;
+
+		err = engine_lookup_user(&mbr->user, conv->engine,
+					 rm->user_id, true);
+		if (err) {
+			mem_deref(mbr);
+			return err;
+		}
+
+		mbr->active = rm->flags & 0x01;
+		mbr->in_call = rm->flags & 0x02;
+		mbr->quality = rm->quality;
+
+		list_append(&conv->memberl, &mbr->le, mbr);
+	}
+
+	v8 = rec->flags;
 	conv->active = v8 & (1 << 0);
 	conv->archived = v8 & (1 << 1);
 	conv->muted = v8 & (1 << 2);
@@ -288,24 +458,41 @@ static int load_conv(struct engine_conv *conv)
 	conv->user_in_call = v8 & (1 << 5);
 	conv->device_in_call = v8 & (1 << 6);
 
-	err = sobject_read_lenstr(&dst, so);
-	if (err)
-		goto out;
 	mem_deref(conv->last_event);
-	conv->last_event = dst;
+	conv->last_event = rec->last_event;
+	rec->last_event = NULL;
 
-	err = sobject_read_lenstr(&dst, so);
-	if (err)
-		goto out;
 	mem_deref(conv->last_read);
-	conv->last_read = dst;
+	conv->last_read = rec->last_read;
+	rec->last_read = NULL;
 
 	engine_update_conv_unread(conv);
 
 	engine_call_post_conv_load(conv);
 
+	return 0;
+}
+
+
+static int load_conv(struct engine_conv *conv)
+{
+	struct conv_rec *rec;
+	int err;
+
+	err = conv_rec_alloc(&rec, conv->id);
+	if (err)
+		return err;
+
+	err = read_conv(rec, conv->engine->store);
+	if (err)
+		goto out;
+
+	err = apply_conv_rec(conv, rec);
+	if (err)
+		goto out;
+
  out:
-	mem_deref(so);
+	mem_deref(rec);
 	return err;
 }
 
@@ -1323,6 +1510,7 @@ static void engine_conv_data_destructor(void *arg)
 {
 	struct engine_conv_data *data = arg;
 
+	mem_deref(data->loader);
 	mem_deref(data->convd);
 	engine_lsnr_unregister(&data->user_lsnr);
 }
@@ -1374,7 +1562,6 @@ static int conv_dir_handler(const char *id, void *arg)
 {
 	struct engine *engine = arg;
 	struct engine_conv *conv;
-	struct le *le;
 	int err;
 
 	err = conv_alloc(&conv, engine, id);
@@ -1391,17 +1578,294 @@ static int conv_dir_handler(const char *id, void *arg)
 		return 0;
 	}
 
+	send_add_loaded_conv(conv);
+
+	return 0;
+}
+
+
+static void startup_done(struct engine *engine,
+			 struct engine_module_state *state, int err)
+{
+	if (err)
+		engine->need_sync = true;
+	state->state = ENGINE_STATE_ACTIVE;
+	engine_active_handler(engine);
+}
+
+
+/*** parallel startup
+ */
+
+static void conv_loader_stop(struct conv_loader *cl)
+{
+	unsigned i;
+
+	lock_write_get(cl->lock);
+	cl->stop = true;
+	lock_rel(cl->lock);
+
+	for (i = 0; i < cl->threadc; ++i)
+		pthread_join(cl->threadv[i], NULL);
+	cl->threadc = 0;
+}
+
+
+static void conv_loader_destructor(void *arg)
+{
+	struct conv_loader *cl = arg;
+
+	if (cl->lock)
+		conv_loader_stop(cl);
+
+	list_flush(&cl->idl);
+	list_flush(&cl->readl);
+	list_flush(&cl->loadedl);
+	mem_deref(cl->mq);
+	mem_deref(cl->lock);
+	mem_deref(cl->store);
+}
+
+
+static void *conv_load_thread(void *arg)
+{
+	struct conv_loader *cl = arg;
+
+	for (;;) {
+		struct conv_rec *rec;
+		bool flush;
+
+		lock_write_get(cl->lock);
+		rec = cl->stop ? NULL : list_ledata(list_head(&cl->idl));
+		if (rec)
+			list_unlink(&rec->le);
+		lock_rel(cl->lock);
+
+		if (!rec)
+			break;
+
+		rec->err = read_conv(rec, cl->store);
+
+		lock_write_get(cl->lock);
+		list_append(&cl->readl, &rec->le, rec);
+		++cl->readc;
+		++cl->nread;
+		flush = cl->readc >= CONV_LOAD_BATCH
+			|| cl->nread == cl->total;
+		lock_rel(cl->lock);
+
+		if (flush)
+			mqueue_push(cl->mq, CONV_LOAD_MQ_BATCH, NULL);
+	}
+
+	return NULL;
+}
+
+
+static void conv_loader_finish(struct conv_loader *cl)
+{
+	struct engine *engine = cl->engine;
+	struct le *le;
+
+	cl->finished = true;
+	conv_loader_stop(cl);
+
+	info("conv: loaded %u of %u conversations in %llu ms "
+	     "on %u workers.\n",
+	     list_count(&cl->loadedl), cl->total,
+	     (unsigned long long)(tmr_jiffies() - cl->ts_start),
+	     engine->startup_workers);
+
+	/* Listeners that don't handle the bulk notification still get
+	 * their addconvh, just deferred until everything is merged.
+	 */
 	LIST_FOREACH(&engine->lsnrl, le) {
 		struct engine_lsnr *lsnr = le->data;
+		struct le *rle;
 
-		if (lsnr->addconvh)
-			lsnr->addconvh(conv, lsnr->arg);
+		if (lsnr->convsloadedh || !lsnr->addconvh)
+			continue;
+
+		LIST_FOREACH(&cl->loadedl, rle) {
+			struct conv_rec *rec = rle->data;
+
+			/* Removed since it was merged */
+			if (dict_lookup(engine->conv->convd, rec->id)
+			    != rec->conv)
+				continue;
+
+			lsnr->addconvh(rec->conv, lsnr->arg);
+		}
+	}
+	send_convs_loaded(engine, list_count(&cl->loadedl));
+
+	list_flush(&cl->loadedl);
+
+	startup_done(engine, cl->state, 0);
+}
+
+
+static void merge_conv_rec(struct conv_loader *cl, struct conv_rec *rec)
+{
+	struct engine *engine = cl->engine;
+	struct engine_conv *conv;
+	int err;
+
+	++cl->merged;
+
+	if (rec->err) {
+		info("Loading conversation '%s' failed: %m.\n",
+		     rec->id, rec->err);
+		engine->need_sync = true;
+		mem_deref(rec);
+		return;
+	}
+
+	/* Someone else may have created the conversation while we were
+	 * loading. Theirs is more recent, so keep it.
+	 */
+	if (dict_lookup(engine->conv->convd, rec->id)) {
+		mem_deref(rec);
+		return;
 	}
 
+	err = conv_alloc(&conv, engine, rec->id);
+	if (err) {
+		info("Loading conversation '%s' failed in creation: %m.\n",
+		     rec->id, err);
+		engine->need_sync = true;
+		mem_deref(rec);
+		return;
+	}
+
+	err = apply_conv_rec(conv, rec);
+	if (err) {
+		info("Loading conversation '%s' failed: %m.\n",
+		     rec->id, err);
+		engine->need_sync = true;
+		mem_deref(rec);
+		return;
+	}
+
+	/* The conversation may go away before the loader has finished,
+	 * keep it alive until then.
+	 */
+	rec->conv = mem_ref(conv);
+	list_append(&cl->loadedl, &rec->le, rec);
+}
+
+
+static void conv_load_mqueue_handler(int id, void *data, void *arg)
+{
+	struct conv_loader *cl = arg;
+	struct list batch = LIST_INIT;
+	struct le *le;
+
+	(void) id;
+	(void) data;
+
+	if (cl->finished)
+		return;
+
+	lock_write_get(cl->lock);
+	while ((le = list_head(&cl->readl))) {
+		list_unlink(le);
+		list_append(&batch, le, le->data);
+	}
+	cl->readc = 0;
+	lock_rel(cl->lock);
+
+	while ((le = list_head(&batch))) {
+		list_unlink(le);
+		merge_conv_rec(cl, le->data);
+	}
+
+	if (cl->merged == cl->total)
+		conv_loader_finish(cl);
+}
+
+
+static int conv_loader_dir_handler(const char *id, void *arg)
+{
+	struct conv_loader *cl = arg;
+	struct conv_rec *rec;
+	int err;
+
+	err = conv_rec_alloc(&rec, id);
+	if (err)
+		return err;
+
+	list_append(&cl->idl, &rec->le, rec);
+	++cl->total;
+
 	return 0;
 }
 
 
+static int start_parallel_load(struct engine *engine,
+			       struct engine_module_state *state)
+{
+	struct conv_loader *cl;
+	unsigned i, workers;
+	int err;
+
+	cl = mem_zalloc(sizeof(*cl), conv_loader_destructor);
+	if (!cl)
+		return ENOMEM;
+
+	cl->engine = engine;
+	cl->state = state;
+	cl->store = mem_ref(engine->store);
+	cl->ts_start = tmr_jiffies();
+
+	err = lock_alloc(&cl->lock);
+	if (err)
+		goto out;
+
+	err = mqueue_alloc(&cl->mq, conv_load_mqueue_handler, cl);
+	if (err)
+		goto out;
+
+	err = store_user_dir(engine->store, "conv", conv_loader_dir_handler,
+			     cl);
+	if (err)
+		goto out;
+
+	engine->conv->loader = cl;
+
+	if (cl->total == 0) {
+		conv_loader_finish(cl);
+		return 0;
+	}
+
+	workers = min(engine->startup_workers, CONV_LOAD_MAX_WORKERS);
+	workers = min(workers, cl->total);
+
+	for (i = 0; i < workers; ++i) {
+		err = pthread_create(&cl->threadv[i], NULL,
+				     conv_load_thread, cl);
+		if (err) {
+			warning("conv: starting load worker failed: %m\n",
+				err);
+			break;
+		}
+		++cl->threadc;
+	}
+
+	if (cl->threadc == 0)
+		err = EAGAIN;
+	else
+		err = 0;
+
+ out:
+	if (err) {
+		engine->conv->loader = NULL;
+		mem_deref(cl);
+	}
+	return err;
+}
+
+
 static void startup_handler(struct engine *engine,
 			    struct engine_module_state *state)
 {
@@ -1412,16 +1876,24 @@ static void startup_handler(struct engine *engine,
 		goto out;
 	}
 
+	if (engine->startup_workers > 0) {
+		err = start_parallel_load(engine, state);
+		if (!err)
+			return;
+
+		warning("conv: parallel startup failed (%m), "
+			"loading sequentially.\n", err);
+	}
+
 	err = store_user_dir(engine->store, "conv", conv_dir_handler,
 			     engine);
 	if (err)
 		goto out;
 
+	send_convs_loaded(engine, dict_count(engine->conv->convd));
+
  out:
-	if (err)
-		engine->need_sync = true;
-	state->state = ENGINE_STATE_ACTIVE;
-	engine_active_handler(engine);
+	startup_done(engine, state, err);
 }
 
 
@@ -682,6 +682,19 @@ struct trace *engine_get_trace(struct engine *engine)
 }
 
 
+int engine_set_startup_workers(struct engine *engine, unsigned workers)
+{
+	if (!engine)
+		return EINVAL;
+
+	if (engine->state != ENGINE_STATE_LOGIN)
+		return EALREADY;
+
+	engine->startup_workers = workers;
+	return 0;
+}
+
+
 int engine_restart(struct engine *eng)
 {
 	int err;
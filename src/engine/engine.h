@@ -88,6 +88,8 @@ struct engine {
 	struct engine_conv_data *conv;
 	struct engine_call_data *call;
 
+	unsigned startup_workers;  /* threads for loading the store  */
+
 	struct list syncl;  /* struct engine_sync_step */
 	uint64_t ts_start;
 
@@ -51,6 +51,9 @@ static void call_destructor(void *arg)
 	dict_flush(call->users);
 	mem_deref(call->users);
 
+	dict_flush(call->pending);
+	mem_deref(call->pending);
+
 	if (call->fm)
 		dict_remove(call->fm->calls, call->convid);
 
@@ -108,6 +111,11 @@ int call_alloc(struct call **callp, struct flowmgr *fm, const char *convid)
 		goto out;
 	}
 
+	err = dict_alloc(&call->pending);
+	if (err) {
+		goto out;
+	}
+
 	list_init(&call->conf_parts);
 
 	list_init(&call->rrl);
@@ -724,6 +732,39 @@ int call_interruption(struct call *call, bool interrupted)
 }
 
 
+static bool userflow_mem_handler(char *key, void *val, void *arg)
+{
+	struct userflow *uf = val;
+	struct mediaflow_mem *sum = arg;
+	struct mediaflow_mem mem;
+	(void)key;
+
+	if (0 == mediaflow_mem_get(userflow_mediaflow(uf), &mem))
+		mediaflow_mem_add(sum, &mem);
+
+	return false;
+}
+
+
+/* Memory used by the call and the mediaflows of its users */
+static int call_mem_debug(struct re_printf *pf, const struct call *call)
+{
+	struct mediaflow_mem mem;
+	size_t own;
+
+	memset(&mem, 0, sizeof(mem));
+	dict_apply(call->users, userflow_mem_handler, &mem);
+
+	own = sizeof(*call)
+		+ dict_count(call->flows) * sizeof(struct flow)
+		+ dict_count(call->users) * sizeof(struct userflow);
+
+	return re_hprintf(pf, "%zu bytes (call=%zu, flows %H)",
+			  own + mediaflow_mem_total(&mem), own,
+			  mediaflow_mem_debug, &mem);
+}
+
+
 int call_debug(struct re_printf *pf, const struct call *call)
 {
 	int err = 0;
@@ -736,6 +777,7 @@ int call_debug(struct re_printf *pf, const struct call *call)
 	err |= re_hprintf(pf, "  flows:     %u   (active flows is %u)\n",
 			  dict_count(call->flows),
 			  flowmgr_call_count_active_flows(call));
+	err |= re_hprintf(pf, "  memory:    %H\n", call_mem_debug, call);
 
 	dict_apply(call->flows, flow_debug_handler, pf);
 	err |= re_hprintf(pf, "\n");
@@ -59,9 +59,10 @@ static const char *events[FLOWMGR_EVENT_MAX] = {
 };
 
 
-static int process_event(bool *hp, struct flowmgr *fm,
-			 const char *ctype, const char *content, size_t clen,
-			 bool replayed);
+static int handle_event(struct flowmgr *fm, struct call *call,
+			enum flowmgr_event event,
+			const char *convid, const char *flowid,
+			struct json_object *jobj, bool replayed);
 
 
 const char *flowmgr_mediacat_name(enum flowmgr_mcat mcat)
@@ -550,46 +551,125 @@ static int flow_add(struct call *call, const char *flowid,
 }
 
 
-struct event {
+/* Events that arrived before their flow, indexed per call by flow ID */
+struct pending_flow {
+	char *flowid;
+	struct list evl;  /* struct pending_event */
+};
+
+struct pending_event {
 	struct le le;
-	char *ctype;
-	struct mbuf *content;
+	enum flowmgr_event event;
+	struct json_object *jobj;
 };
 
 
-static void event_replay(struct flowmgr *fm)
+static void pending_flow_destructor(void *arg)
 {
-	struct le *le;
-	struct event *ev;
-	int max_num;
+	struct pending_flow *pf = arg;
 
-	if (!fm)
+	list_flush(&pf->evl);
+	mem_deref(pf->flowid);
+}
+
+
+static void pending_event_destructor(void *arg)
+{
+	struct pending_event *pev = arg;
+
+	list_unlink(&pev->le);
+	mem_deref(pev->jobj);
+}
+
+
+static int event_enqueue(struct call *call, const char *flowid,
+			 enum flowmgr_event event, struct json_object *jobj)
+{
+	struct pending_flow *pf;
+	struct pending_event *pev;
+	int err;
+
+	pf = dict_lookup(call->pending, flowid);
+	if (!pf) {
+		pf = mem_zalloc(sizeof(*pf), pending_flow_destructor);
+		if (!pf)
+			return ENOMEM;
+
+		err = str_dup(&pf->flowid, flowid);
+		if (!err)
+			err = dict_add(call->pending, flowid, pf);
+
+		/* Owned by the dictionary */
+		mem_deref(pf);
+		if (err)
+			return err;
+	}
+
+	pev = mem_zalloc(sizeof(*pev), pending_event_destructor);
+	if (!pev)
+		return ENOMEM;
+
+	pev->event = event;
+	pev->jobj = mem_ref(jobj);
+
+	list_append(&pf->evl, &pev->le, pev);
+
+	return 0;
+}
+
+
+static bool flow_ready_handler(char *key, void *val, void *arg)
+{
+	struct call *call = arg;
+
+	(void)val;
+
+	return call_find_flow(call, key) != NULL;
+}
+
+
+/* Dispatches the pending events of the call's flows that now exist */
+static void event_replay(struct call *call)
+{
+	struct flowmgr *fm;
+	struct pending_flow *pf;
+
+	if (!call || !call->pending)
 		return;
 
-	max_num = list_count(&fm->eventq);
+	fm = call_flowmgr(call);
+	mem_ref(call);
 
-	info("flowmgr(%p): event replay (count=%u)\n",
-	     fm, list_count(&fm->eventq));
+	while ((pf = dict_apply(call->pending,
+				flow_ready_handler, call)) != NULL) {
+		struct le *le;
 
-	le = fm->eventq.head;
-	while (le && max_num) {
+		mem_ref(pf);
+		dict_remove(call->pending, pf->flowid);
 
-		ev = le->data;
-		le = le->next;
+		info("flowmgr(%p): event replay: flow %s (count=%u)\n",
+		     fm, pf->flowid, list_count(&pf->evl));
 
-		--max_num;
+		while ((le = list_head(&pf->evl)) != NULL) {
+			struct pending_event *pev = le->data;
 
-		info("flowmgr(%p): eventq pop: ctype=%s\n", fm, ev->ctype);
-		process_event(NULL, fm, ev->ctype,
-			      (char*)ev->content->buf,
-			      ev->content->end, true);
+			handle_event(fm, call, pev->event, call->convid,
+				     pf->flowid, pev->jobj, true);
+			mem_deref(pev);
+		}
+
+		mem_deref(pf);
 
-		mem_deref(ev);
+		/* The call was ended by one of the events */
+		if (dict_lookup(fm->calls, call->convid) != call)
+			break;
 	}
+
+	mem_deref(call);
 }
 
 
-static int flows_add_list(struct flowmgr *fm, struct list *addl)
+static int flows_add_list(struct call *call, struct list *addl)
 {
 	struct le *le;
 	int n = 0;
@@ -607,7 +687,7 @@ static int flows_add_list(struct flowmgr *fm, struct list *addl)
 	}
 
 	if (n > 0)
-		event_replay(fm);
+		event_replay(call);
 
 	return err;
 }
@@ -754,7 +834,7 @@ static int add_flows(struct json_object *jobj, struct call *call,
 	if (call->ghostl.head)
 		flows_del_list(&call->ghostl);
 	
-	err = flows_add_list(call_flowmgr(call), &addl);
+	err = flows_add_list(call, &addl);
 	list_flush(&addl);
 
 	return err;
@@ -808,7 +888,7 @@ static int flows_add_handler(struct call *call, struct json_object *jobj)
 	info("flowmgr(%p): add flows -- %u flows\n",
 	     fm, dict_count(call->flows));
 
-	event_replay(fm);
+	event_replay(call);
 
 	return err;
 }
@@ -1072,7 +1152,6 @@ static void fm_destructor(void *arg)
 
 	mem_deref(fm->calls);
 
-	list_flush(&fm->eventq);
 	list_flush(&fm->postl);
 
 	list_unlink(&fm->le);
@@ -1283,51 +1362,33 @@ struct flowmgr *flowmgr_free(struct flowmgr *fm)
 }
 
 
-static void event_destructor(void *data)
-{
-	struct event *ev = data;
-
-	list_unlink(&ev->le);
-	mem_deref(ev->ctype);
-	mem_deref(ev->content);
-}
-
-
-static void event_enqueue(struct flowmgr *fm,
-			  const char *ctype, const char *content, size_t clen)
+static int event_lookup(enum flowmgr_event *eventp, const char *ev)
 {
-	struct event *ev;
+	int i;
 
-	ev = mem_zalloc(sizeof(*ev), event_destructor);
-
-	str_dup(&ev->ctype, ctype);
-	ev->content = mbuf_alloc(clen);
-	mbuf_write_mem(ev->content, (void *)content, clen);
+	if (!ev)
+		return ENOENT;
 
-	list_append(&fm->eventq, &ev->le, ev);
+	for (i = 0; i < FLOWMGR_EVENT_MAX; i++) {
+		if (streq(ev, events[i])) {
+			*eventp = (enum flowmgr_event)i;
+			return 0;
+		}
+	}
 
-	return;
+	return ENOENT;
 }
 
+
 int flowmgr_process_event(bool *hp, struct flowmgr *fm,
 			  const char *ctype, const char *content, size_t clen)
-{
-	return process_event(hp, fm, ctype, content, clen, false);
-}
-
-
-static int process_event(bool *hp, struct flowmgr *fm,
-			 const char *ctype, const char *content, size_t clen,
-			 bool replayed)
 {
 	struct json_object *jobj = NULL;
 	const char *ev;
 	const char *convid;
 	const char *flowid;
-	struct call *call = NULL;
-	struct flow *flow = NULL;
+	struct call *call;
 	bool handled = true;
-	bool created = false;
 	enum flowmgr_event event;
 	int err = 0;
 
@@ -1361,23 +1422,32 @@ static int process_event(bool *hp, struct flowmgr *fm,
 
 	info("flowmgr(%p): event(%zu bytes) %b\n", fm, clen, content, clen);
 
-	if (streq(ev, events[FLOWMGR_EVENT_FLOW_ADD]))
-		event = FLOWMGR_EVENT_FLOW_ADD;
-	else if (streq(ev, events[FLOWMGR_EVENT_FLOW_DEL]))
-		event = FLOWMGR_EVENT_FLOW_DEL;
-	else if (streq(ev, events[FLOWMGR_EVENT_FLOW_ACT]))
-		event = FLOWMGR_EVENT_FLOW_ACT;
-	else if (streq(ev, events[FLOWMGR_EVENT_CAND_ADD]))
-		event = FLOWMGR_EVENT_CAND_ADD;
-	else if (streq(ev, events[FLOWMGR_EVENT_CAND_UPD]))
-		event = FLOWMGR_EVENT_CAND_UPD;
-	else if (streq(ev, events[FLOWMGR_EVENT_SDP]))
-		event = FLOWMGR_EVENT_SDP;
-	else {
+	if (event_lookup(&event, ev)) {
 		handled = false;
 		goto out;
 	}
 
+	err = handle_event(fm, call, event, convid, flowid, jobj, false);
+
+ out:
+	mem_deref(jobj);
+
+	if (!err && hp)
+		*hp = handled;
+
+	return err;
+}
+
+
+static int handle_event(struct flowmgr *fm, struct call *call,
+			enum flowmgr_event event,
+			const char *convid, const char *flowid,
+			struct json_object *jobj, bool replayed)
+{
+	struct flow *flow = NULL;
+	bool created = false;
+	int err = 0;
+
 	if (call && flowid) {
 		flow = call_find_flow(call, flowid);
 
@@ -1391,33 +1461,27 @@ static int process_event(bool *hp, struct flowmgr *fm,
 				info("flowmgr(%p): process_event(%s): "
 				     "cannot find flow '%s'"
 				     " in [%u entries] -- queuing..\n",
-				     fm, ev, flowid,
+				     fm, events[event], flowid,
 				     call_count_flows(call));
 
-				event_enqueue(fm, ctype, content, clen);
-
-				err = 0;
-				goto out;
+				return event_enqueue(call, flowid,
+						     event, jobj);
 			}
-			err = EPROTO;
-			goto out;
+			return EPROTO;
 		}
 	}
 
-	if (handled) {
-
-		if (fm->evh) {
-			fm->evh(event, convid, flowid, jobj, fm->evarg);
-		}
+	if (fm->evh) {
+		fm->evh(event, convid, flowid, jobj, fm->evarg);
+	}
 
-		if (fm->trace) {
-			color_trace(TRACE_WS, 33, "%s", ev);
-		}
-		if (fm->trace >= 2) {
-			re_fprintf(stderr, "\x1b[33m");
-			jzon_dump(jobj);
-			re_fprintf(stderr, "\x1b[;m");
-		}
+	if (fm->trace) {
+		color_trace(TRACE_WS, 33, "%s", events[event]);
+	}
+	if (fm->trace >= 2) {
+		re_fprintf(stderr, "\x1b[33m");
+		jzon_dump(jobj);
+		re_fprintf(stderr, "\x1b[;m");
 	}
 
 	switch (event) {
@@ -1426,7 +1490,7 @@ static int process_event(bool *hp, struct flowmgr *fm,
 		if (!call) {
 			err = call_alloc(&call, fm, convid);
 			if (err)
-				goto out;
+				return err;
 			
 			created = true;
 		}
@@ -1463,21 +1527,14 @@ static int process_event(bool *hp, struct flowmgr *fm,
 		break;
 
 	default:
-		info("flowmgr(%p): event (%s) ignored\n", fm, ev);
+		info("flowmgr(%p): event (%s) ignored\n", fm, events[event]);
 		break;
 	}
 
- out:
-	mem_deref(jobj);
-
 	if (err) {
 		if (created)
 			mem_deref(call);
 	}
-	else {
-		if (hp)
-			*hp = handled;
-	}
 
 	return err;
 }
@@ -99,6 +99,7 @@ struct call {
 	struct dict *flows;  /* struct flow */
 	struct list conf_parts;
 	struct dict *users;  /* struct userflow */
+	struct dict *pending; /* events for unknown flows, by flow ID */
 	char *convid;
 	char *sessid;
 	enum flowmgr_mcat mcat; /* current media category of call */
@@ -227,8 +228,6 @@ struct flowmgr {
 
 	bool use_metrics;
 
-	struct list eventq;
-
 	struct {
 		struct call_config cfg;
 		struct tmr tmr;
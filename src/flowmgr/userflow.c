@@ -353,6 +353,9 @@ int userflow_alloc_mediaflow(struct userflow *uf)
 		mediaflow_enable_privacy(uf->mediaflow, true);
 	}
 
+	if (msystem_have_hd_video(flowmgr_msystem()))
+		mediaflow_enable_hd_video(uf->mediaflow, true);
+
 	mediaflow_set_gather_handler(uf->mediaflow,
 				     mediaflow_gather_handler);
 
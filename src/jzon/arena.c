@@ -0,0 +1,932 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Arena backed documents for jzon_decode()
+ *
+ * The decoder copies the input once and parses it in place: strings are
+ * unescaped inside the copy and the nodes point at them. All nodes of a
+ * document come from a few large chunks that are freed together with
+ * the root object.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_jzon.h"
+#include "priv_jzon.h"
+
+
+enum {
+	CHUNK_MIN   = 4096,
+	CHUNK_MAX   = 1048576,
+	ALIGN       = 8,
+	MAX_DEPTH   = 32,
+	HASH_SIZE   = 16,
+};
+
+
+struct chunk {
+	struct chunk *next;
+	size_t size;
+	size_t used;
+};
+
+struct jzon_doc {
+	char *buf;              /* copy of the input, strings live here */
+	struct chunk *chunks;
+	size_t chunk_size;
+
+	/* containers converted to odict, the odicts are ours */
+	struct json_object **thawv;
+	size_t thawc;
+	size_t thaw_sz;
+};
+
+struct root {
+	struct jzon_node node;  /* must be first */
+	struct jzon_doc doc;
+};
+
+struct parser {
+	struct jzon_doc *doc;
+	char *p;
+	char *end;
+	unsigned depth;
+
+	/* children of the containers being parsed */
+	struct jzon_member *stkv;
+	size_t stkc;
+	size_t stk_sz;
+};
+
+
+/* Never linked to, only tells our nodes apart from odict entries */
+static struct list arena_marker;
+
+
+static void root_destructor(void *arg)
+{
+	struct root *root = arg;
+	struct jzon_doc *doc = &root->doc;
+	struct chunk *c;
+	size_t i;
+
+	for (i = 0; i < doc->thawc; i++)
+		mem_deref(doc->thawv[i]->entry.u.odict);
+	mem_deref(doc->thawv);
+
+	c = doc->chunks;
+	while (c) {
+		struct chunk *next = c->next;
+
+		mem_deref(c);
+		c = next;
+	}
+
+	mem_deref(doc->buf);
+}
+
+
+static void *arena_alloc(struct jzon_doc *doc, size_t size)
+{
+	struct chunk *c = doc->chunks;
+	uint8_t *p;
+
+	size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+
+	if (!c || c->used + size > c->size) {
+		size_t csize = max(doc->chunk_size, size);
+
+		c = mem_alloc(sizeof(*c) + csize, NULL);
+		if (!c)
+			return NULL;
+
+		c->size = csize;
+		c->used = 0;
+		c->next = doc->chunks;
+		doc->chunks = c;
+
+		doc->chunk_size = min(doc->chunk_size * 2, (size_t)CHUNK_MAX);
+	}
+
+	p = (uint8_t *)(c + 1) + c->used;
+	c->used += size;
+
+	return p;
+}
+
+
+bool jzon_is_arena(const struct json_object *jobj)
+{
+	return jobj && jobj->entry.le.list == &arena_marker;
+}
+
+
+bool jzon_arena_native(const struct json_object *jobj)
+{
+	return jzon_is_arena(jobj)
+		&& odict_type_iscontainer(jobj->entry.type)
+		&& !jobj->entry.u.odict;
+}
+
+
+static struct json_object *node_alloc(struct parser *ps,
+				      enum odict_type type)
+{
+	struct jzon_node *node;
+
+	node = arena_alloc(ps->doc, sizeof(*node));
+	if (!node)
+		return NULL;
+
+	memset(node, 0, sizeof(*node));
+	node->obj.entry.le.list = &arena_marker;
+	node->obj.entry.type = type;
+	node->doc = ps->doc;
+
+	return &node->obj;
+}
+
+
+static inline void skip_ws(struct parser *ps)
+{
+	while (ps->p < ps->end) {
+		switch (*ps->p) {
+
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+			++ps->p;
+			break;
+
+		default:
+			return;
+		}
+	}
+}
+
+
+static int push(struct parser *ps, const char *key, struct json_object *val)
+{
+	if (ps->stkc >= ps->stk_sz) {
+		size_t sz = ps->stk_sz ? ps->stk_sz * 2 : 64;
+		struct jzon_member *v;
+
+		v = mem_reallocarray(ps->stkv, sz, sizeof(*v), NULL);
+		if (!v)
+			return ENOMEM;
+
+		ps->stkv = v;
+		ps->stk_sz = sz;
+	}
+
+	ps->stkv[ps->stkc].key = key;
+	ps->stkv[ps->stkc].val = val;
+	++ps->stkc;
+
+	return 0;
+}
+
+
+static int hex4(uint32_t *up, const char *p)
+{
+	uint32_t u = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		char ch = p[i];
+
+		u <<= 4;
+		if ('0' <= ch && ch <= '9')
+			u |= ch - '0';
+		else if ('a' <= ch && ch <= 'f')
+			u |= ch - 'a' + 10;
+		else if ('A' <= ch && ch <= 'F')
+			u |= ch - 'A' + 10;
+		else
+			return EBADMSG;
+	}
+
+	*up = u;
+
+	return 0;
+}
+
+
+static char *put_utf8(char *dst, uint32_t u)
+{
+	if (u < 0x80) {
+		*dst++ = (char)u;
+	}
+	else if (u < 0x800) {
+		*dst++ = (char)(0xc0 | (u >> 6));
+		*dst++ = (char)(0x80 | (u & 0x3f));
+	}
+	else if (u < 0x10000) {
+		*dst++ = (char)(0xe0 | (u >> 12));
+		*dst++ = (char)(0x80 | ((u >> 6) & 0x3f));
+		*dst++ = (char)(0x80 | (u & 0x3f));
+	}
+	else {
+		*dst++ = (char)(0xf0 | (u >> 18));
+		*dst++ = (char)(0x80 | ((u >> 12) & 0x3f));
+		*dst++ = (char)(0x80 | ((u >> 6) & 0x3f));
+		*dst++ = (char)(0x80 | (u & 0x3f));
+	}
+
+	return dst;
+}
+
+
+/* Unescapes in place, the result is never longer than the input */
+static int parse_string(struct parser *ps, char **strp)
+{
+	char *start, *dst;
+
+	if (ps->p >= ps->end || *ps->p != '"')
+		return EBADMSG;
+
+	start = dst = ++ps->p;
+
+	while (ps->p < ps->end) {
+		char ch = *ps->p++;
+		uint32_t u, lo;
+
+		if (ch == '"') {
+			*dst = '\0';
+			*strp = start;
+			return 0;
+		}
+
+		if (ch != '\\') {
+			*dst++ = ch;
+			continue;
+		}
+
+		if (ps->p >= ps->end)
+			return EBADMSG;
+
+		ch = *ps->p++;
+		switch (ch) {
+
+		case 'b': *dst++ = '\b'; break;
+		case 'f': *dst++ = '\f'; break;
+		case 'n': *dst++ = '\n'; break;
+		case 'r': *dst++ = '\r'; break;
+		case 't': *dst++ = '\t'; break;
+
+		case 'u':
+			if (ps->end - ps->p < 4 || hex4(&u, ps->p))
+				return EBADMSG;
+			ps->p += 4;
+
+			/* surrogate pair */
+			if (u >= 0xd800 && u < 0xdc00
+			    && ps->end - ps->p >= 6
+			    && ps->p[0] == '\\' && ps->p[1] == 'u'
+			    && 0 == hex4(&lo, ps->p + 2)
+			    && lo >= 0xdc00 && lo < 0xe000) {
+
+				u = 0x10000 + ((u - 0xd800) << 10)
+					+ (lo - 0xdc00);
+				ps->p += 6;
+			}
+
+			dst = put_utf8(dst, u);
+			break;
+
+		default:
+			*dst++ = ch;
+			break;
+		}
+	}
+
+	return EBADMSG;
+}
+
+
+static size_t skip_digits(struct parser *ps)
+{
+	const char *start = ps->p;
+
+	while (ps->p < ps->end && '0' <= *ps->p && *ps->p <= '9')
+		++ps->p;
+
+	return ps->p - start;
+}
+
+
+/* RFC 8259 6: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? */
+static int parse_number(struct parser *ps, struct json_object **nodep)
+{
+	struct json_object *node;
+	char *start = ps->p;
+	bool frac = false, exp = false, negexp = false;
+
+	if (ps->p < ps->end && *ps->p == '-')
+		++ps->p;
+
+	if (ps->p < ps->end && *ps->p == '0')
+		++ps->p;
+	else if (!skip_digits(ps))
+		return EBADMSG;
+
+	if (ps->p < ps->end && *ps->p == '.') {
+		frac = true;
+		++ps->p;
+		if (!skip_digits(ps))
+			return EBADMSG;
+	}
+
+	if (ps->p < ps->end && (*ps->p == 'e' || *ps->p == 'E')) {
+		exp = true;
+		++ps->p;
+		if (ps->p < ps->end && (*ps->p == '+' || *ps->p == '-')) {
+			negexp = *ps->p == '-';
+			++ps->p;
+		}
+		if (!skip_digits(ps))
+			return EBADMSG;
+	}
+
+	/* same as the odict decoder: 1e3 is an integer */
+	if (frac || negexp) {
+		node = node_alloc(ps, ODICT_DOUBLE);
+		if (!node)
+			return ENOMEM;
+		node->entry.u.dbl = strtod(start, NULL);
+	}
+	else {
+		node = node_alloc(ps, ODICT_INT);
+		if (!node)
+			return ENOMEM;
+		if (exp)
+			node->entry.u.integer = (int64_t)strtod(start, NULL);
+		else
+			node->entry.u.integer = strtoll(start, NULL, 10);
+	}
+
+	*nodep = node;
+
+	return 0;
+}
+
+
+/* Literals are lower case only, as in RFC 8259 3 */
+static bool literal(struct parser *ps, const char *lit)
+{
+	const size_t len = strlen(lit);
+
+	if ((size_t)(ps->end - ps->p) < len)
+		return false;
+
+	if (0 != memcmp(ps->p, lit, len))
+		return false;
+
+	ps->p += len;
+
+	return true;
+}
+
+
+static int parse_value(struct parser *ps, struct json_object **nodep);
+
+
+static int parse_container(struct parser *ps, struct json_object **nodep,
+			   enum odict_type type)
+{
+	const char close = type == ODICT_OBJECT ? '}' : ']';
+	struct json_object *node;
+	struct jzon_node *jn;
+	size_t base = ps->stkc;
+	size_t i, n;
+	int err = 0;
+
+	if (++ps->depth > MAX_DEPTH) {
+		warning("jzon: decode: nesting deeper than %d\n", MAX_DEPTH);
+		return EOVERFLOW;
+	}
+
+	++ps->p;
+	skip_ws(ps);
+
+	if (ps->p < ps->end && *ps->p == close) {
+		++ps->p;
+		goto done;
+	}
+
+	for (;;) {
+		struct json_object *val;
+		char *key = NULL;
+
+		if (type == ODICT_OBJECT) {
+			skip_ws(ps);
+			err = parse_string(ps, &key);
+			if (err)
+				return err;
+
+			skip_ws(ps);
+			if (ps->p >= ps->end || *ps->p != ':')
+				return EBADMSG;
+			++ps->p;
+		}
+
+		err = parse_value(ps, &val);
+		if (err)
+			return err;
+
+		val->entry.key = key;
+
+		err = push(ps, key, val);
+		if (err)
+			return err;
+
+		skip_ws(ps);
+		if (ps->p >= ps->end)
+			return EBADMSG;
+
+		if (*ps->p == ',') {
+			++ps->p;
+			continue;
+		}
+		else if (*ps->p == close) {
+			++ps->p;
+			break;
+		}
+
+		return EBADMSG;
+	}
+
+ done:
+	node = node_alloc(ps, type);
+	if (!node)
+		return ENOMEM;
+
+	jn = (struct jzon_node *)node;
+	n = ps->stkc - base;
+
+	if (n && type == ODICT_OBJECT) {
+		jn->c.memberv = arena_alloc(ps->doc, n * sizeof(*jn->c.memberv));
+		if (!jn->c.memberv)
+			return ENOMEM;
+		memcpy(jn->c.memberv, &ps->stkv[base],
+		       n * sizeof(*jn->c.memberv));
+	}
+	else if (n) {
+		jn->c.itemv = arena_alloc(ps->doc, n * sizeof(*jn->c.itemv));
+		if (!jn->c.itemv)
+			return ENOMEM;
+		for (i = 0; i < n; i++)
+			jn->c.itemv[i] = ps->stkv[base + i].val;
+	}
+
+	jn->n = n;
+	ps->stkc = base;
+	--ps->depth;
+
+	*nodep = node;
+
+	return 0;
+}
+
+
+static int parse_value(struct parser *ps, struct json_object **nodep)
+{
+	struct json_object *node;
+	char *str;
+	int err;
+
+	skip_ws(ps);
+	if (ps->p >= ps->end)
+		return EBADMSG;
+
+	switch (*ps->p) {
+
+	case '{':
+		return parse_container(ps, nodep, ODICT_OBJECT);
+
+	case '[':
+		return parse_container(ps, nodep, ODICT_ARRAY);
+
+	case '"':
+		err = parse_string(ps, &str);
+		if (err)
+			return err;
+
+		node = node_alloc(ps, ODICT_STRING);
+		if (!node)
+			return ENOMEM;
+		node->entry.u.str = str;
+		break;
+
+	case 't':
+	case 'f':
+		node = node_alloc(ps, ODICT_BOOL);
+		if (!node)
+			return ENOMEM;
+
+		if (literal(ps, "true"))
+			node->entry.u.boolean = true;
+		else if (literal(ps, "false"))
+			node->entry.u.boolean = false;
+		else
+			return EBADMSG;
+		break;
+
+	case 'n':
+		if (!literal(ps, "null"))
+			return EBADMSG;
+
+		node = node_alloc(ps, ODICT_NULL);
+		if (!node)
+			return ENOMEM;
+		break;
+
+	default:
+		return parse_number(ps, nodep);
+	}
+
+	*nodep = node;
+
+	return 0;
+}
+
+
+int jzon_arena_decode(struct json_object **jobjp, const char *buf, size_t len)
+{
+	struct parser ps;
+	struct root *root;
+	struct json_object *top = NULL;
+	int err;
+
+	if (!jobjp || !buf)
+		return EINVAL;
+
+	root = mem_zalloc(sizeof(*root), root_destructor);
+	if (!root)
+		return ENOMEM;
+
+	root->doc.buf = mem_alloc(len + 1, NULL);
+	if (!root->doc.buf) {
+		err = ENOMEM;
+		goto out;
+	}
+	memcpy(root->doc.buf, buf, len);
+	root->doc.buf[len] = '\0';
+
+	root->doc.chunk_size = min(max(len * 4, (size_t)CHUNK_MIN),
+				   (size_t)CHUNK_MAX);
+
+	memset(&ps, 0, sizeof(ps));
+	ps.doc = &root->doc;
+	ps.p = root->doc.buf;
+	ps.end = root->doc.buf + len;
+
+	skip_ws(&ps);
+	if (ps.p >= ps.end || (*ps.p != '{' && *ps.p != '[')) {
+		err = EBADMSG;
+		goto out;
+	}
+
+	err = parse_value(&ps, &top);
+	if (err)
+		goto out;
+
+	/* nothing but whitespace after the root, or a terminating NUL */
+	skip_ws(&ps);
+	while (ps.p < ps.end && *ps.p == '\0')
+		++ps.p;
+	if (ps.p != ps.end) {
+		err = EBADMSG;
+		goto out;
+	}
+
+	/* the root lives outside the arena, so it can be mem_deref'ed */
+	root->node = *(struct jzon_node *)top;
+	root->node.doc = &root->doc;
+
+ out:
+	mem_deref(ps.stkv);
+
+	if (err)
+		mem_deref(root);
+	else
+		*jobjp = &root->node.obj;
+
+	return err;
+}
+
+
+static struct jzon_doc *node_doc(const struct json_object *jobj)
+{
+	return ((const struct jzon_node *)jobj)->doc;
+}
+
+
+static int add_thawed(struct jzon_doc *doc, struct json_object *jobj)
+{
+	if (doc->thawc >= doc->thaw_sz) {
+		size_t sz = doc->thaw_sz ? doc->thaw_sz * 2 : 8;
+		struct json_object **v;
+
+		v = mem_reallocarray(doc->thawv, sz, sizeof(*v), NULL);
+		if (!v)
+			return ENOMEM;
+
+		doc->thawv = v;
+		doc->thaw_sz = sz;
+	}
+
+	doc->thawv[doc->thawc++] = jobj;
+
+	return 0;
+}
+
+
+static int odict_add_node(struct odict *od, const char *key,
+			  struct json_object *val)
+{
+	const struct odict_entry *e = &val->entry;
+	struct odict *child;
+
+	switch (e->type) {
+
+	case ODICT_OBJECT:
+	case ODICT_ARRAY:
+		child = jzon_arena_odict(val);
+		if (!child)
+			return ENOMEM;
+		return odict_entry_add(od, key, e->type, child);
+
+	case ODICT_STRING:
+		return odict_entry_add(od, key, e->type, e->u.str);
+
+	case ODICT_INT:
+		return odict_entry_add(od, key, e->type, e->u.integer);
+
+	case ODICT_DOUBLE:
+		return odict_entry_add(od, key, e->type, e->u.dbl);
+
+	case ODICT_BOOL:
+		return odict_entry_add(od, key, e->type, (int)e->u.boolean);
+
+	case ODICT_NULL:
+		return odict_entry_add(od, key, e->type);
+
+	default:
+		return EINVAL;
+	}
+}
+
+
+/* Converts an arena container to an odict the first time it is needed
+ * as one. From then on all access goes through the odict.
+ */
+struct odict *jzon_arena_odict(struct json_object *jobj)
+{
+	struct jzon_node *jn = (struct jzon_node *)jobj;
+	struct odict *od;
+	size_t i;
+	int err;
+
+	if (!jzon_is_arena(jobj) || !odict_type_iscontainer(jobj->entry.type))
+		return NULL;
+
+	if (jobj->entry.u.odict)
+		return jobj->entry.u.odict;
+
+	err = odict_alloc(&od, HASH_SIZE);
+	if (err)
+		return NULL;
+
+	for (i = 0; i < jn->n && !err; i++) {
+
+		if (jobj->entry.type == ODICT_OBJECT) {
+			err = odict_add_node(od, jn->c.memberv[i].key,
+					     jn->c.memberv[i].val);
+		}
+		else {
+			char key[16];
+
+			re_snprintf(key, sizeof(key), "%zu", i);
+			err = odict_add_node(od, key, jn->c.itemv[i]);
+		}
+	}
+
+	if (!err)
+		err = add_thawed(node_doc(jobj), jobj);
+
+	if (err) {
+		warning("jzon: converting to odict failed (%m)\n", err);
+		mem_deref(od);
+		return NULL;
+	}
+
+	jobj->entry.u.odict = od;
+
+	return od;
+}
+
+
+struct json_object *jzon_arena_lookup(const struct json_object *jobj,
+				      const char *key)
+{
+	const struct jzon_node *jn = (const struct jzon_node *)jobj;
+	size_t i;
+
+	for (i = 0; i < jn->n; i++) {
+		if (0 == strcmp(jn->c.memberv[i].key, key))
+			return jn->c.memberv[i].val;
+	}
+
+	return NULL;
+}
+
+
+size_t jzon_arena_count(const struct json_object *jobj)
+{
+	return ((const struct jzon_node *)jobj)->n;
+}
+
+
+struct json_object *jzon_arena_get_idx(const struct json_object *jobj,
+				       size_t idx)
+{
+	const struct jzon_node *jn = (const struct jzon_node *)jobj;
+
+	if (idx >= jn->n)
+		return NULL;
+
+	return jn->c.itemv[idx];
+}
+
+
+struct json_object *jzon_arena_apply(struct json_object *jobj,
+				     jzon_apply_h *ah, void *arg)
+{
+	const struct jzon_node *jn = (const struct jzon_node *)jobj;
+	size_t i;
+
+	for (i = 0; i < jn->n; i++) {
+		struct json_object *robj;
+		const char *key;
+		char idx[16];
+
+		if (jobj->entry.type == ODICT_OBJECT) {
+			robj = jn->c.memberv[i].val;
+			key = jn->c.memberv[i].key;
+		}
+		else {
+			/* array items have no key, same as the odict form */
+			re_snprintf(idx, sizeof(idx), "%zu", i);
+			robj = jn->c.itemv[i];
+			key = idx;
+		}
+
+		if (ah && ah(key, robj, arg))
+			return robj;
+	}
+
+	return NULL;
+}
+
+
+static int encode_odict(struct re_printf *pf, const struct odict *o,
+			bool array);
+
+
+/* Same output as json_encode_odict(), for both kinds of nodes */
+static int encode_node(struct re_printf *pf, const struct json_object *jobj)
+{
+	const struct jzon_node *jn = (const struct jzon_node *)jobj;
+	const struct odict_entry *e = &jobj->entry;
+	size_t i;
+	int err = 0;
+
+	switch (e->type) {
+
+	case ODICT_OBJECT:
+		if (!jzon_arena_native(jobj))
+			return encode_odict(pf, e->u.odict, false);
+
+		err |= re_hprintf(pf, "{");
+		for (i = 0; i < jn->n; i++) {
+			err |= re_hprintf(pf, "%s\"%H\":%H",
+					  i ? "," : "",
+					  utf8_encode, jn->c.memberv[i].key,
+					  encode_node, jn->c.memberv[i].val);
+		}
+		err |= re_hprintf(pf, "}");
+		break;
+
+	case ODICT_ARRAY:
+		if (!jzon_arena_native(jobj))
+			return encode_odict(pf, e->u.odict, true);
+
+		err |= re_hprintf(pf, "[");
+		for (i = 0; i < jn->n; i++) {
+			err |= re_hprintf(pf, "%s%H", i ? "," : "",
+					  encode_node, jn->c.itemv[i]);
+		}
+		err |= re_hprintf(pf, "]");
+		break;
+
+	case ODICT_INT:
+		err = re_hprintf(pf, "%lld", e->u.integer);
+		break;
+
+	case ODICT_DOUBLE:
+		err = re_hprintf(pf, "%f", e->u.dbl);
+		break;
+
+	case ODICT_STRING:
+		err = re_hprintf(pf, "\"%H\"", utf8_encode, e->u.str);
+		break;
+
+	case ODICT_BOOL:
+		err = re_hprintf(pf, "%s", e->u.boolean ? "true" : "false");
+		break;
+
+	case ODICT_NULL:
+		err = re_hprintf(pf, "null");
+		break;
+
+	default:
+		err = EINVAL;
+		break;
+	}
+
+	return err;
+}
+
+
+static int encode_odict(struct re_printf *pf, const struct odict *o,
+			bool array)
+{
+	struct le *le;
+	int err;
+
+	if (!o)
+		return 0;
+
+	err = re_hprintf(pf, array ? "[" : "{");
+
+	for (le = o->lst.head; le; le = le->next) {
+
+		const struct json_object *e = le->data;
+
+		if (!array)
+			err |= re_hprintf(pf, "\"%H\":", utf8_encode,
+					  e->entry.key);
+
+		err |= re_hprintf(pf, "%H%s", encode_node, e,
+				  le->next ? "," : "");
+	}
+
+	err |= re_hprintf(pf, array ? "]" : "}");
+
+	return err;
+}
+
+
+/* A root array is printed with {} and index keys, as the odict
+ * encoder has always done for jzon_print()
+ */
+int jzon_arena_print(struct re_printf *pf, const struct json_object *jobj)
+{
+	const struct jzon_node *jn = (const struct jzon_node *)jobj;
+	size_t i;
+	int err = 0;
+
+	if (jobj->entry.type != ODICT_ARRAY)
+		return encode_node(pf, jobj);
+
+	if (!jzon_arena_native(jobj))
+		return json_encode_odict(pf, jobj->entry.u.odict);
+
+	err |= re_hprintf(pf, "{");
+	for (i = 0; i < jn->n; i++) {
+		err |= re_hprintf(pf, "%s\"%zu\":%H", i ? "," : "", i,
+				  encode_node, jn->c.itemv[i]);
+	}
+	err |= re_hprintf(pf, "}");
+
+	return err;
+}
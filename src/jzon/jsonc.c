@@ -56,6 +56,9 @@ struct odict *jzon_odict(const struct json_object *jobj)
 		warning("jzon: get_odict: not a container\n");
 		return NULL;
 	}
+	if (jzon_is_arena(jobj))
+		return jzon_arena_odict((struct json_object *)jobj);
+
 	return jobj->entry.u.odict;
 }
 
@@ -181,31 +184,37 @@ static int add_entry(struct json_object *jobj, const char *key,
 {
 	struct odict *odict;
 	struct odict_entry *e;
+	bool arena;
 	int err = 0;
 
 	if (!jobj || !val)
 		return EINVAL;
 
 	odict = jzon_odict(jobj);
-	if (!jobj)
+	if (!odict)
 		return EINVAL;
 	e = &val->entry;
 
+	/* nodes of a decoded document are copied, the document owns them */
+	arena = jzon_is_arena(val);
+
 	switch (e->type) {
 
 	case ODICT_OBJECT:
 	case ODICT_ARRAY:
-		err = odict_entry_add(odict, key, e->type, e->u.odict);
+		err = odict_entry_add(odict, key, e->type, jzon_odict(val));
 		if (err)
 			return err;
-		e->u.odict = mem_deref(e->u.odict);
+		if (!arena)
+			e->u.odict = mem_deref(e->u.odict);
 		break;
 
 	case ODICT_STRING:
 		err = odict_entry_add(odict, key, e->type, e->u.str);
 		if (err)
 			return err;
-		e->u.str = mem_deref(e->u.str);
+		if (!arena)
+			e->u.str = mem_deref(e->u.str);
 		break;
 
 	case ODICT_INT:
@@ -253,7 +262,7 @@ void json_object_object_add(struct json_object *jobj, const char *key,
 		err = add_entry(jobj, key, val);
 	}
 	else {
-		err = odict_entry_add(jobj->entry.u.odict, key, ODICT_NULL);
+		err = odict_entry_add(jzon_odict(jobj), key, ODICT_NULL);
 	}
 	if (err) {
 		warning("jzon: json_object_object_add('%s',%p) failed (%m)\n",
@@ -263,7 +272,8 @@ void json_object_object_add(struct json_object *jobj, const char *key,
 
 #if 1
 	/* NOTE: ownership transferred to obj */
-	val = mem_deref(val);
+	if (!jzon_is_arena(val))
+		val = mem_deref(val);
 #endif
 }
 
@@ -307,7 +317,7 @@ int json_object_array_add(struct json_object *jobj, struct json_object *val)
 		err = add_entry(jobj, key, val);
 	}
 	else {
-		err = odict_entry_add(jobj->entry.u.odict, key, ODICT_NULL);
+		err = odict_entry_add(jzon_odict(jobj), key, ODICT_NULL);
 	}
 
 	if (err) {
@@ -317,7 +327,8 @@ int json_object_array_add(struct json_object *jobj, struct json_object *val)
 
 #if 1
 	/* NOTE: ownership transferred to the container */
-	mem_deref(val);
+	if (!jzon_is_arena(val))
+		mem_deref(val);
 #endif
 
 	return 0;
@@ -331,6 +342,9 @@ int json_object_array_length(struct json_object *jobj)
 	if (!jobj)
 		return 0;
 
+	if (jzon_arena_native(jobj) && jobj->entry.type == ODICT_ARRAY)
+		return (int)jzon_arena_count(jobj);
+
 	if (jobj->entry.type != ODICT_ARRAY || !jobj->entry.u.odict) {
 		warning("jzon: array_length: not an array\n");
 		return 0;
@@ -349,6 +363,9 @@ struct json_object *json_object_array_get_idx(struct json_object *obj, int idx)
 	if (!obj || idx<0)
 		return NULL;
 
+	if (jzon_arena_native(obj) && obj->entry.type == ODICT_ARRAY)
+		return jzon_arena_get_idx(obj, idx);
+
 	if (obj->entry.type != ODICT_ARRAY || !obj->entry.u.odict) {
 		warning("jzon: array_get_idx: not an array\n");
 		return 0;
@@ -374,6 +391,15 @@ bool json_object_object_get_ex(struct json_object *obj, const char *key,
 		return false;
 	}
 
+	if (jzon_arena_native(obj)) {
+		struct json_object *v = jzon_arena_lookup(obj, key);
+
+		if (v && value)
+			*value = v;
+
+		return v != NULL;
+	}
+
 	entry = odict_lookup(jzon_odict(obj), key);
 	if (!entry)
 		return false;
@@ -340,8 +340,7 @@ int jzon_print(struct re_printf *pf, struct json_object *jobj)
 	if (!jzon_is_container(jobj))
 		return EINVAL;
 
-	/* NOTE: array will be printed with {} tokens */
-	return re_hprintf(pf, "%H", json_encode_odict, jobj->entry.u.odict);
+	return jzon_arena_print(pf, jobj);
 }
 
 
@@ -356,51 +355,18 @@ int jzon_encode(char **strp, struct json_object *jobj)
 
 int jzon_decode(struct json_object **jobjp, const char *buf, size_t len)
 {
-	struct json_object *jobj = NULL;
-	struct pl pl;
-	enum odict_type type;
-	int err = 0;
+	int err;
 
 	if (!buf || !len)
 		return EINVAL;
 
-	if (0 != re_regex(buf, len, "[^ \t\r\n]1", &pl)) {
-		warning("jzon_decode: first token not found\n");
-		return EBADMSG;
-	}
-
-	switch (pl.p[0]) {
-
-	case '{':
-		type = ODICT_OBJECT;
-		break;
-
-	case '[':
-		type = ODICT_ARRAY;
-		break;
-
-	default:
-		warning("jzon: decode: invalid start-token (%r)\n", &pl);
-		return EBADMSG;
+	err = jzon_arena_decode(jobjp, buf, len);
+	if (err) {
+		warning("jzon: decode: invalid JSON (%m)\n", err);
+		return err;
 	}
 
-	jobj = jzon_container_alloc(type);
-	if (!jobj)
-		return ENOMEM;
-
-	jobj->entry.u.odict = mem_deref(jobj->entry.u.odict);
-	err = json_decode_odict(&jobj->entry.u.odict, 16, buf, len, 8);
-	if (err)
-		goto out;
-
-	if (jobjp)
-		*jobjp = jobj;
-
- out:
-	if (err)
-		mem_deref(jobj);
-
-	return err;
+	return 0;
 }
 
 
@@ -413,6 +379,9 @@ struct json_object *jzon_apply(struct json_object *jobj,
 	if (!jobj)
 		return NULL;
 
+	if (jzon_arena_native(jobj))
+		return jzon_arena_apply(jobj, ah, arg);
+
 	odict = jzon_odict(jobj);
 	if (!odict)
 		return NULL;
@@ -521,5 +490,8 @@ struct odict *jzon_get_odict(struct json_object *jobj)
 	if (!jobj)
 		return NULL;
 
+	if (jzon_is_arena(jobj))
+		return jzon_odict(jobj);
+
 	return jobj->entry.u.odict;
 }
@@ -3,6 +3,7 @@
 #
 
 AVS_SRCS += \
+	jzon/arena.c \
 	jzon/jsonc.c \
 	jzon/jzon.c \
 	jzon/pretty.c
@@ -45,3 +45,40 @@ int             json_object_is_type(struct json_object *obj,
 				    enum odict_type type);
 
 
+
+
+/* Nodes of a decoded document, see arena.c
+ *
+ * Scalars use the odict_entry as usual. Containers keep their children
+ * in an array; entry.u.odict is NULL until someone asks for the odict.
+ */
+struct jzon_doc;
+
+struct jzon_member {
+	const char *key;
+	struct json_object *val;
+};
+
+struct jzon_node {
+	struct json_object obj;  /* must be first */
+	struct jzon_doc *doc;
+	size_t n;
+	union {
+		struct json_object **itemv;
+		struct jzon_member *memberv;
+	} c;
+};
+
+int  jzon_arena_decode(struct json_object **jobjp,
+		       const char *buf, size_t len);
+bool jzon_is_arena(const struct json_object *jobj);
+bool jzon_arena_native(const struct json_object *jobj);
+struct odict *jzon_arena_odict(struct json_object *jobj);
+struct json_object *jzon_arena_lookup(const struct json_object *jobj,
+				      const char *key);
+struct json_object *jzon_arena_get_idx(const struct json_object *jobj,
+				       size_t idx);
+size_t jzon_arena_count(const struct json_object *jobj);
+struct json_object *jzon_arena_apply(struct json_object *jobj,
+				     jzon_apply_h *ah, void *arg);
+int  jzon_arena_print(struct re_printf *pf, const struct json_object *jobj);
@@ -53,12 +53,38 @@ enum {
 	DTLS_MTU       = 1480,
 	SSRC_MAX       = 4,
 	ICE_INTERVAL   = 50,    /* milliseconds */
+	ICE_INTERVAL_FAST = 20, /* milliseconds, with fast setup */
+	TURN_DEFER_MS  = 3000,  /* known-dead TURN paths are held back */
 	PORT_DISCARD   = 9,     /* draft-ietf-ice-trickle-05 */
 };
 
 enum {
-	AUDIO_BANDWIDTH = 50,   /* kilobits/second */
-	VIDEO_BANDWIDTH = 800,  /* kilobits/second */
+	AUDIO_BANDWIDTH    = 50,    /* kilobits/second */
+	VIDEO_BANDWIDTH    = 800,   /* kilobits/second */
+	VIDEO_BANDWIDTH_HD = 2500,  /* kilobits/second */
+};
+
+/* RFC 6464 client-to-mixer audio level */
+#define AULEVEL_URI "urn:ietf:params:rtp-hdrext:ssrc-audio-level"
+
+enum {
+	AULEVEL_EXTMAP_ID = 1,
+};
+
+
+/* Receive pipeline: which decoder gets a payload type  */
+enum rx_dec {
+	RX_DEC_NONE = 0,
+	RX_DEC_AUDIO,
+	RX_DEC_VIDEO,
+};
+
+/* Receive pipeline stages that are timed  */
+enum rx_stage {
+	RX_STAGE_PARSE = 0,
+	RX_STAGE_DECRYPT,
+	RX_STAGE_DECODE,
+	RX_STAGE_NUM
 };
 
 
@@ -87,7 +113,49 @@ struct interface {
 
 struct mediaflow {
 
+	/*
+	 * Fields that are used for every RTP packet come first, so that
+	 * they share a few cache lines. Setup time state follows.
+	 */
+
+	/* RTP/RTCP */
+	struct udp_sock *rtp;
+	struct srtp *srtp_tx;
+	struct srtp *srtp_rx;
+	uint32_t lssrcv[MEDIA_NUM];
+	bool started;
+	bool hold;
+	bool sent_rtp;
+	bool got_rtp;
+
+	/* receive pipeline */
+	struct {
+		uint8_t ptmap[128];     /* payload type to enum rx_dec */
+		bool ptmap_ready;
+		struct packet_hist histv[RX_STAGE_NUM];
+	} rx;
+
+	struct {
+		struct {
+			uint64_t ts_first;
+			uint64_t ts_last;
+			size_t bytes;
+		} tx, rx;
+
+		size_t n_sdp_recv;
+		size_t n_cand_recv;
+		size_t n_srtp_dropped;
+		size_t n_srtp_error;
+	} stat;
+
+	/* allocated when the stream is started */
+	struct rtp_stats *audio_stats_rcv;
+	struct rtp_stats *audio_stats_snd;
+	struct rtp_stats *video_stats_rcv;
+	struct rtp_stats *video_stats_snd;
+
 	struct mqueue *mq;
+	struct mediashard *shard;     /* owning loop, NULL for main */
 
 	/* common stuff */
 	struct sa laddr_default;
@@ -96,18 +164,10 @@ struct mediaflow {
 	int af;
 	int err;
 
-	/* RTP/RTCP */
-	struct udp_sock *rtp;
-	struct rtp_stats audio_stats_rcv;
-	struct rtp_stats audio_stats_snd;
-	struct rtp_stats video_stats_rcv;
-	struct rtp_stats video_stats_snd;
-	struct aucodec_stats codec_stats;
-
+	struct aucodec_stats *codec_stats;  /* allocated on first use */
 	struct tmr tmr_rtp;
 	bool external_rtp;
 	bool enable_rtcp;
-	uint32_t lssrcv[MEDIA_NUM];
 	char cname[16];             /* common for audio+video */
 	char msid[36];
 	char *label;
@@ -144,6 +204,7 @@ struct mediaflow {
 	bool ice_ready;
 	char *peer_software;
 	uint64_t ts_nat_start;
+	bool fast_setup;
 
 	/* ice - gathering */
 	struct stun_ctrans *ct_gather;
@@ -151,6 +212,15 @@ struct mediaflow {
 	bool ice_remote_eoc;
 	bool stun_server;
 	bool stun_ok;
+	struct list turn_deferl;  /* TURN allocations held back */
+
+	/* path cache */
+	struct {
+		enum pathcache_peer peer;
+		bool hit;
+		enum ice_cand_type ltype;
+		enum ice_cand_type rtype;
+	} pcache;
 
 	/* crypto: */
 	enum media_crypto cryptos_local;
@@ -158,12 +228,11 @@ struct mediaflow {
 	enum media_crypto crypto;          /* negotiated crypto */
 	enum media_crypto crypto_fallback;
 	struct udp_helper *uh_srtp;
-	struct srtp *srtp_tx;
-	struct srtp *srtp_rx;
 	struct tls *dtls;
 	struct dtls_sock *dtls_sock;
 	struct udp_helper *dtls_uh;   /* for outgoing DTLS-packet */
 	struct tls_conn *tls_conn;
+	struct tls_session *dtls_sess;   /* to resume, from previous flow */
 	struct {
 		size_t headroom;
 		struct sa addr;
@@ -173,14 +242,16 @@ struct mediaflow {
 	bool crypto_ready;
 	bool crypto_verified;
 	uint64_t ts_dtls;
+	struct {
+		struct mbuf *mb;     /* arrived before ICE was ready */
+		struct sa src;
+	} dtls_early;
 
 	/* Codec handling */
 	struct media_ctx *mctx;
 	struct auenc_state *aes;
 	struct audec_state *ads;
 	pthread_mutex_t mutex_enc;  /* protect the encoder state */
-	bool started;
-	bool hold;
 
 	/* Video */
 	struct {
@@ -193,6 +264,7 @@ struct mediaflow {
 		bool started;
 		char *label;
 		bool has_rtp;
+		bool hd;
 	} video;
 
 	/* Data */
@@ -210,6 +282,7 @@ struct mediaflow {
 	/* Audio */
 	struct {
 		bool cbr;
+		uint8_t level_id;  /* audio level extmap, 0 if none */
 	} audio;
     
 	/* User callbacks */
@@ -220,25 +293,10 @@ struct mediaflow {
 	mediaflow_gather_h *gatherh;
 	void *arg;
 
-	struct {
-		struct {
-			uint64_t ts_first;
-			uint64_t ts_last;
-			size_t bytes;
-		} tx, rx;
-
-		size_t n_sdp_recv;
-		size_t n_cand_recv;
-		size_t n_srtp_dropped;
-		size_t n_srtp_error;
-	} stat;
-
-	bool sent_rtp;
-	bool got_rtp;
-
 	struct list interfacel;
 
 	struct mediaflow_stats mf_stats;
+	uint64_t ts_alloc;
 	bool privacy_mode;
 
 	/* magic number check at the end of the struct */
@@ -280,6 +338,34 @@ static const struct sa dummy_dtls_peer = {
 };
 
 
+static void codec_stats_update(struct mediaflow *mf,
+			       const struct aucodec *ac)
+{
+	if (!mf->codec_stats) {
+		mf->codec_stats = mem_zalloc(sizeof(*mf->codec_stats), NULL);
+		if (!mf->codec_stats)
+			return;
+	}
+
+	ac->get_stats(mf->ads, mf->codec_stats);
+}
+
+
+static int rtp_stats_start(struct rtp_stats **rsp, int pt,
+			   int dropout_thres_ms)
+{
+	if (!*rsp) {
+		*rsp = mem_alloc(sizeof(**rsp), NULL);
+		if (!*rsp)
+			return ENOMEM;
+	}
+
+	mediastats_rtp_stats_init(*rsp, pt, dropout_thres_ms);
+
+	return 0;
+}
+
+
 /* prototypes */
 static int print_cand(struct re_printf *pf, const struct ice_cand_attr *cand);
 static void add_turn_permission(struct mediaflow *mf,
@@ -289,7 +375,8 @@ static void add_permission_to_remotes(struct mediaflow *mf);
 static void add_permission_to_remotes_ds(struct mediaflow *mf,
 					 struct turn_conn *conn);
 static void external_rtp_recv(struct mediaflow *mf,
-			      const struct sa *src, struct mbuf *mb);
+			      const struct sa *src, struct mbuf *mb,
+			      const struct packet_desc *pd);
 
 
 static void mf_log(const struct mediaflow *mf, enum log_level level,
@@ -550,12 +637,22 @@ bool mediaflow_is_ready(const struct mediaflow *mf)
 }
 
 
+/* Records the time of a call setup step, the first time it happens */
+static void setup_mark(const struct mediaflow *mf, int32_t *tp)
+{
+	if (*tp < 0)
+		*tp = (int32_t)(tmr_jiffies() - mf->ts_alloc);
+}
+
+
 static void update_tx_stats(struct mediaflow *mf, size_t len)
 {
 	uint64_t now = tmr_jiffies();
 
-	if (!mf->stat.tx.ts_first)
+	if (!mf->stat.tx.ts_first) {
 		mf->stat.tx.ts_first = now;
+		setup_mark(mf, &mf->mf_stats.setup.rtp_tx);
+	}
 	mf->stat.tx.ts_last = now;
 	mf->stat.tx.bytes += len;
 }
@@ -565,8 +662,10 @@ static void update_rx_stats(struct mediaflow *mf, size_t len)
 {
 	uint64_t now = tmr_jiffies();
 
-	if (!mf->stat.rx.ts_first)
+	if (!mf->stat.rx.ts_first) {
 		mf->stat.rx.ts_first = now;
+		setup_mark(mf, &mf->mf_stats.setup.rtp_rx);
+	}
 	mf->stat.rx.ts_last = now;
 	mf->stat.rx.bytes += len;
 }
@@ -613,7 +712,7 @@ static int voenc_rtp_handler(const uint8_t *pkt, size_t len, void *arg)
 
 	err = mediaflow_send_raw_rtp(mf, pkt, len);
 	if (err == 0){
-		mediastats_rtp_stats_update(&mf->audio_stats_snd, pkt, len, 0);
+		mediastats_rtp_stats_update(mf->audio_stats_snd, pkt, len, 0);
 	}
 
 	return err;
@@ -665,12 +764,19 @@ static int start_codecs(struct mediaflow *mf)
 	prm.srate = ac->srate;
 	prm.ch = ac->ch;
 	prm.cbr = false;
+	prm.aulevel_id = mf->audio.level_id;
 	if(fmt->params){
 		if (0 == re_regex(fmt->params, strlen(fmt->params), "cbr=1")){
 			prm.cbr = true;
 		}
 	}
     
+	/* before the codecs, which may call back from their own threads */
+	err  = rtp_stats_start(&mf->audio_stats_snd, fmt->pt, 2000);
+	err |= rtp_stats_start(&mf->audio_stats_rcv, fmt->pt, 2000);
+	if (err)
+		goto out;
+
 	if (ac->enc_alloc && !mf->aes) {
 		err = ac->enc_alloc(&mf->aes, &mf->mctx, ac, NULL,
 				    &prm,
@@ -690,7 +796,6 @@ static int start_codecs(struct mediaflow *mf)
 		mf->audio.cbr = prm.cbr;
         
 	}
-	mediastats_rtp_stats_init(&mf->audio_stats_snd, fmt->pt, 2000);
 
 	if (ac->dec_alloc && !mf->ads){
 		err = ac->dec_alloc(&mf->ads, &mf->mctx, ac, NULL,
@@ -706,7 +811,6 @@ static int start_codecs(struct mediaflow *mf)
 			ac->dec_start(mf->ads);
 		}
 	}
-	mediastats_rtp_stats_init(&mf->audio_stats_rcv, fmt->pt, 2000);
 
  out:
 	pthread_mutex_unlock(&mf->mutex_enc);
@@ -726,7 +830,7 @@ static int videnc_rtp_handler(const uint8_t *pkt, size_t len, void *arg)
 		if (vc && vc->enc_bwalloch) {
 			bwalloc = vc->enc_bwalloch(mf->video.ves);
 		}
-		mediastats_rtp_stats_update(&mf->video_stats_snd, pkt, len, bwalloc);
+		mediastats_rtp_stats_update(mf->video_stats_snd, pkt, len, bwalloc);
 	}
 
 	return err;
@@ -923,6 +1027,11 @@ static int start_video_codecs(struct mediaflow *mf)
 	      " [params=%s, rparams=%s]\n",
 	      fmt->name, fmt->srate, fmt->ch, fmt->params, fmt->rparams);
 
+	err  = rtp_stats_start(&mf->video_stats_snd, fmt->pt, 10000);
+	err |= rtp_stats_start(&mf->video_stats_rcv, fmt->pt, 10000);
+	if (err)
+		goto out;
+
 	if (vc->enc_alloch && !mf->video.ves) {
 
 		err = vc->enc_alloch(&mf->video.ves, &mf->video.mctx, vc,
@@ -946,7 +1055,6 @@ static int start_video_codecs(struct mediaflow *mf)
 			}
 		}
 	}
-	mediastats_rtp_stats_init(&mf->video_stats_snd, fmt->pt, 10000);
 
 	if (vc->dec_alloch && !mf->video.vds){
 		err = vc->dec_alloch(&mf->video.vds, &mf->video.mctx, vc,
@@ -969,8 +1077,6 @@ static int start_video_codecs(struct mediaflow *mf)
 		}
 	}
 
-	mediastats_rtp_stats_init(&mf->video_stats_rcv, fmt->pt, 10000);
-
  out:
 	return err;
 }
@@ -1310,14 +1416,17 @@ static void dtls_estab_handler(void *arg)
 {
 	struct mediaflow *mf = arg;
 	enum srtp_suite suite;
-	uint8_t cli_key[30], srv_key[30];
+	uint8_t cli_key[46], srv_key[46];
+	size_t key_size;
 	int err;
 
 	if (mf->mf_stats.dtls_estab < 0 && mf->ts_dtls)
 		mf->mf_stats.dtls_estab = tmr_jiffies() - mf->ts_dtls;
+	setup_mark(mf, &mf->mf_stats.setup.dtls_estab);
 
-	info("mediaflow: DTLS established (%d ms)\n",
-	     mf->mf_stats.dtls_estab);
+	info("mediaflow: DTLS established (%d ms%s)\n",
+	     mf->mf_stats.dtls_estab,
+	     tls_session_reused(mf->tls_conn) ? ", resumed" : "");
 
 	info("           cipher %s\n",
 	     tls_cipher_name(mf->tls_conn));
@@ -1342,10 +1451,12 @@ static void dtls_estab_handler(void *arg)
 
 	info("mediaflow: DTLS established (%s)\n", srtp_suite_name(suite));
 
+	key_size = srtp_suite_key_size(suite);
+
 	mf->srtp_tx = mem_deref(mf->srtp_tx);
 	err = srtp_alloc(&mf->srtp_tx, suite,
 			 mf->setup_local == SETUP_ACTIVE ? cli_key : srv_key,
-			 sizeof(cli_key), 0);
+			 key_size, 0);
 	if (err) {
 		warning("mediaflow: failed to allocate SRTP for TX (%m)\n",
 			err);
@@ -1354,7 +1465,7 @@ static void dtls_estab_handler(void *arg)
 
 	err = srtp_alloc(&mf->srtp_rx, suite,
 			 mf->setup_local == SETUP_ACTIVE ? srv_key : cli_key,
-			 sizeof(srv_key), 0);
+			 key_size, 0);
 	if (err) {
 		warning("mediaflow: failed to allocate SRTP for RX (%m)\n",
 			err);
@@ -1451,6 +1562,7 @@ static void dtls_conn_handler(const struct sa *unused_peer, void *arg)
 	}
 
 	mf->ts_dtls = tmr_jiffies();
+	setup_mark(mf, &mf->mf_stats.setup.dtls_start);
 
 	if (mf->tls_conn) {
 		warning("mediaflow: DTLS already accepted\n");
@@ -1532,14 +1644,19 @@ static int start_crypto(struct mediaflow *mf, const struct sa *peer)
 			     sock_prefix(headroom), peer);
 
 			mf->ts_dtls = tmr_jiffies();
+			setup_mark(mf, &mf->mf_stats.setup.dtls_start);
 
 			set_dtls_peer(mf, headroom, peer);
 
-			err = dtls_connect(&mf->tls_conn, mf->dtls,
-					   mf->dtls_sock, &dummy_dtls_peer,
-					   dtls_estab_handler,
-					   dtls_recv_handler,
-					   dtls_close_handler, mf);
+			/* Abbreviated handshake if the peer still has
+			 * the session of the flow we are replacing
+			 */
+			err = dtls_resume(&mf->tls_conn, mf->dtls,
+					  mf->dtls_sock, &dummy_dtls_peer,
+					  mf->dtls_sess,
+					  dtls_estab_handler,
+					  dtls_recv_handler,
+					  dtls_close_handler, mf);
 			if (err) {
 				warning("mediaflow: dtls_connect()"
 					" failed (%m)\n", err);
@@ -1565,6 +1682,32 @@ static int start_crypto(struct mediaflow *mf, const struct sa *peer)
 }
 
 
+static void handle_dtls_packet(struct mediaflow *mf, const struct sa *src,
+			       struct mbuf *mb);
+
+
+/* With fast setup, a DTLS ClientHello that arrived before our own
+ * connectivity checks completed is kept, and handled as soon as ICE
+ * is ready instead of waiting for the peer to retransmit it.
+ */
+static void replay_early_dtls(struct mediaflow *mf)
+{
+	struct mbuf *mb = mf->dtls_early.mb;
+
+	if (!mb)
+		return;
+
+	mf->dtls_early.mb = NULL;
+
+	info("mediaflow: handling early DTLS packet from %J\n",
+	     &mf->dtls_early.src);
+
+	handle_dtls_packet(mf, &mf->dtls_early.src, mb);
+
+	mem_deref(mb);
+}
+
+
 /* this function is only called once */
 static void ice_established_handler(struct mediaflow *mf,
 				    const struct sa *peer)
@@ -1582,6 +1725,7 @@ static void ice_established_handler(struct mediaflow *mf,
 	if (mf->mf_stats.nat_estab < 0 && mf->ts_nat_start) {
 		mf->mf_stats.nat_estab = tmr_jiffies() - mf->ts_nat_start;
 	}
+	setup_mark(mf, &mf->mf_stats.setup.ice_estab);
 
 	set_dtls_peer(mf, get_headroom(mf), peer);
 
@@ -1595,6 +1739,8 @@ static void ice_established_handler(struct mediaflow *mf,
 		crypto_error(mf, err);
 	}
 
+	replay_early_dtls(mf);
+
  out:
 	mediaflow_established_handler(mf);
 }
@@ -1716,6 +1862,27 @@ static void handle_dtls_packet(struct mediaflow *mf, const struct sa *src,
 		return;
 	}
 
+	if (mf->nat == MEDIAFLOW_TRICKLEICE_DUALSTACK &&
+	    !mediaflow_ice_ready(mf) && mf->fast_setup) {
+
+		struct mbuf *early;
+
+		early = mbuf_alloc(mb->end);
+		if (!early)
+			return;
+
+		(void)mbuf_write_mem(early, mb->buf, mb->end);
+		early->pos = mb->pos;
+
+		mem_deref(mf->dtls_early.mb);
+		mf->dtls_early.mb = early;
+		mf->dtls_early.src = *src;
+
+		info("mediaflow: ICE is not ready --"
+		     " keeping DTLS packet from %J\n", src);
+		return;
+	}
+
 	if (mf->nat == MEDIAFLOW_TRICKLEICE_DUALSTACK &&
 	    !mediaflow_ice_ready(mf)) {
 
@@ -1750,112 +1917,146 @@ static void handle_dtls_packet(struct mediaflow *mf, const struct sa *src,
 }
 
 
-static bool udp_helper_recv_handler_srtp(struct sa *src, struct mbuf *mb,
-					 void *arg)
+static void rx_hist_add(struct mediaflow *mf, enum rx_stage stage,
+			uint64_t t0)
+{
+	packet_hist_add(&mf->rx.histv[stage], packet_usec() - t0);
+}
+
+
+/* RTP/RTCP from the network, already classified by packet_parse()  */
+static bool recv_srtp(struct mediaflow *mf, struct sa *src, struct mbuf *mb,
+		      const struct packet_desc *pd)
 {
-	struct mediaflow *mf = arg;
 	size_t len = mbuf_get_left(mb);
-	const enum packet pkt = packet_classify_packet_type(mb);
+	uint64_t t0;
 	int err;
 
-	if (pkt == PACKET_DTLS) {
-		handle_dtls_packet(mf, src, mb);
-		return true;
+	/* the SRTP is not ready yet .. */
+	if (!mf->srtp_rx) {
+		mf->stat.n_srtp_dropped++;
+		goto next;
 	}
 
-	if (packet_is_rtp_or_rtcp(mb)) {
+	t0 = packet_usec();
 
-		/* the SRTP is not ready yet .. */
-		if (!mf->srtp_rx) {
-			mf->stat.n_srtp_dropped++;
-			goto next;
+	if (pd->type == PACKET_RTCP) {
+
+		err = srtcp_decrypt(mf->srtp_rx, mb);
+		if (err) {
+			mf->stat.n_srtp_error++;
+			warning("mediaflow: srtcp_decrypt failed"
+				" [%zu bytes] (%m)\n", len, err);
+			return true;
 		}
+	}
+	else {
+		err = srtp_decrypt(mf->srtp_rx, mb);
+		if (err) {
+			mf->stat.n_srtp_error++;
+			if (err != EALREADY) {
+				warning("mediaflow: srtp_decrypt"
+					" failed"
+					" [%zu bytes from %J] (%m)\n",
+					len, src, err);
+			}
+			return true;
+		}
+	}
 
-		if (packet_is_rtcp_packet(mb)) {
+	rx_hist_add(mf, RX_STAGE_DECRYPT, t0);
 
-			err = srtcp_decrypt(mf->srtp_rx, mb);
-			if (err) {
-				mf->stat.n_srtp_error++;
-				warning("mediaflow: srtcp_decrypt failed"
-					" [%zu bytes] (%m)\n", len, err);
-				return true;
-			}
+	/* APP packets carry the data channel, the RTCP packet type is
+	 * in the clear part and known without decoding the packet
+	 */
+	if (pd->type == PACKET_RTCP && pd->pt == RTCP_APP) {
+
+		const uint8_t *name, *data;
+		size_t data_len;
+
+		err = packet_rtcp_app(mb, &name, &data, &data_len);
+		if (err) {
+			warning("mediaflow: failed to decode"
+				" incoming RTCP APP"
+				" packet (%m)\n", err);
+			goto next;
 		}
-		else {
-			err = srtp_decrypt(mf->srtp_rx, mb);
-			if (err) {
-				mf->stat.n_srtp_error++;
-				if (err != EALREADY) {
-					warning("mediaflow: srtp_decrypt"
-						" failed"
-						" [%zu bytes from %J] (%m)\n",
-						len, src, err);
-				}
-				return true;
-			}
+
+		if (0 != memcmp(name, app_label, 4)) {
+			warning("invalid app name '%b'\n",
+				name, (size_t)4);
+			goto next;
 		}
 
-		if (packet_is_rtcp_packet(mb)) {
+		/* NOTE: dce handler might deref mediaflow */
+		if (mf->data.dce)
+			dce_recv_pkt(mf->data.dce, data, data_len);
 
-			struct rtcp_msg *msg = NULL;
-			size_t pos = mb->pos;
-			bool is_app = false;
-			int r;
-
-			r = rtcp_decode(&msg, mb);
-			if (r) {
-				warning("mediaflow: failed to decode"
-					" incoming RTCP"
-					" packet (%m)\n", r);
-				goto done;
-			}
-			mb->pos = pos;
+		return true;
+	}
 
-			if (msg->hdr.pt == RTCP_APP) {
+ next:
+	/* If external RTP is enabled, forward RTP/RTCP packets
+	 * to the relevant au/vid-codec.
+	 *
+	 * otherwise just pass it up to internal RTP-stack
+	 */
+	if (mf->external_rtp) {
+		external_rtp_recv(mf, src, mb, pd);
+		return true; /* handled */
+	}
+	else {
+		update_rx_stats(mf, mbuf_get_left(mb));
+		return false;  /* continue processing */
+	}
+}
 
-				if (0 != memcmp(msg->r.app.name, app_label, 4)) {
-					warning("invalid app name '%b'\n",
-						msg->r.app.name, (size_t)4);
-					goto done;
-				}
 
-				is_app = true;
+static bool udp_helper_recv_handler_srtp(struct sa *src, struct mbuf *mb,
+					 void *arg)
+{
+	struct mediaflow *mf = arg;
+	struct packet_desc pd;
+	uint64_t t0;
 
-				if (mf->data.dce) {
-					dce_recv_pkt(mf->data.dce,
-						     msg->r.app.data,
-						     msg->r.app.data_len);
-				}
-			}
+	t0 = packet_usec();
+	packet_parse(&pd, mb);
 
-		done:
-			mem_deref(msg);
+	switch (pd.type) {
 
-			/* NOTE: dce handler might deref mediaflow */
-			if (is_app)
-				return true;
-		}
+	case PACKET_DTLS:
+		handle_dtls_packet(mf, src, mb);
+		return true;
+
+	case PACKET_RTP:
+	case PACKET_RTCP:
+		rx_hist_add(mf, RX_STAGE_PARSE, t0);
+		return recv_srtp(mf, src, mb, &pd);
+
+	default:
+		return false;
 	}
+}
 
- next:
-	if (packet_is_rtp_or_rtcp(mb)) {
 
-		/* If external RTP is enabled, forward RTP/RTCP packets
-		 * to the relevant au/vid-codec.
-		 *
-		 * otherwise just pass it up to internal RTP-stack
-		 */
-		if (mf->external_rtp) {
-			external_rtp_recv(mf, src, mb);
-			return true; /* handled */
-		}
-		else {
-			update_rx_stats(mf, mbuf_get_left(mb));
-			return false;  /* continue processing */
-		}
+/* The payload type to decoder table is built from the local formats on
+ * the first RTP packet, and again after the formats have changed.
+ */
+static void rx_ptmap_update(struct mediaflow *mf)
+{
+	int pt;
+
+	for (pt = 0; pt < (int)ARRAY_SIZE(mf->rx.ptmap); pt++) {
+
+		if (sdp_media_lformat(mf->sdpm, pt))
+			mf->rx.ptmap[pt] = RX_DEC_AUDIO;
+		else if (sdp_media_lformat(mf->video.sdpm, pt))
+			mf->rx.ptmap[pt] = RX_DEC_VIDEO;
+		else
+			mf->rx.ptmap[pt] = RX_DEC_NONE;
 	}
 
-	return false;
+	mf->rx.ptmap_ready = true;
 }
 
 
@@ -1865,14 +2066,14 @@ static bool udp_helper_recv_handler_srtp(struct sa *src, struct mbuf *mb,
  * -- send to decoder if supported by it
  */
 static void external_rtp_recv(struct mediaflow *mf,
-			      const struct sa *src, struct mbuf *mb)
+			      const struct sa *src, struct mbuf *mb,
+			      const struct packet_desc *pd)
 {
 	const struct aucodec *ac;
 	const struct vidcodec *vc;
-	struct rtp_header hdr;
-	const struct sdp_format *fmt;
-	size_t start = mb->pos;
-	int err;
+	const uint8_t *pkt = mbuf_buf(mb);
+	const size_t len = mbuf_get_left(mb);
+	uint64_t t0;
 
 	if (!mf->started) {
 		return;
@@ -1881,81 +2082,76 @@ static void external_rtp_recv(struct mediaflow *mf,
 	ac = audec_get(mf->ads);
 	vc = viddec_get(mf->video.vds);
 
-	if (!packet_is_rtcp_packet(mb)) {
-		update_rx_stats(mf, mbuf_get_left(mb));
-	}
-	else {
+	t0 = packet_usec();
+
+	if (pd->type == PACKET_RTCP) {
+
 		/* RTCP is sent to both audio+video */
 
-		if (ac && ac->dec_rtcph) {
-			mb->pos = start;
-			ac->dec_rtcph(mf->ads,
-				      mbuf_buf(mb), mbuf_get_left(mb));
-		}
-		if (vc && vc->dec_rtcph) {
-			mb->pos = start;
-			vc->dec_rtcph(mf->video.vds,
-				      mbuf_buf(mb), mbuf_get_left(mb));
-		}
-		goto out;
+		if (ac && ac->dec_rtcph)
+			ac->dec_rtcph(mf->ads, pkt, len);
+		if (vc && vc->dec_rtcph)
+			vc->dec_rtcph(mf->video.vds, pkt, len);
+
+		rx_hist_add(mf, RX_STAGE_DECODE, t0);
+		return;
 	}
 
+	update_rx_stats(mf, len);
+
 	if (!mf->got_rtp) {
 		info("mediaflow: first RTP packet received (%zu bytes)\n",
-		     mbuf_get_left(mb));
+		     len);
 		mf->got_rtp = true;
 		check_rtpstart(mf);
 	}
 
-	err = rtp_hdr_decode(&hdr, mb);
-	mb->pos = start;
-	if (err) {
-		warning("mediaflow: rtp header decode (%m)\n", err);
-		goto out;
+	if (!pd->hdrlen || len < pd->hdrlen) {
+		warning("mediaflow: rtp header decode (%m)\n", EBADMSG);
+		return;
 	}
 
-	fmt = sdp_media_lformat(mf->sdpm, hdr.pt);
-	if (fmt) {
+	if (!mf->rx.ptmap_ready)
+		rx_ptmap_update(mf);
 
-		/* now, pass on the raw RTP/RTCP packet to the decoder */
+	switch (mf->rx.ptmap[pd->pt]) {
+
+	case RX_DEC_AUDIO:
+		/* now, pass on the raw RTP packet to the decoder */
 
 		if (ac && ac->dec_rtph) {
-			ac->dec_rtph(mf->ads,
-				     mbuf_buf(mb), mbuf_get_left(mb));
+			ac->dec_rtph(mf->ads, pkt, len);
 
-			mediastats_rtp_stats_update(&mf->audio_stats_rcv,
-					 mbuf_buf(mb), mbuf_get_left(mb), 0);
+			mediastats_rtp_stats_update(mf->audio_stats_rcv,
+						    pkt, len, 0);
 		}
+		break;
 
-		goto out;
-	}
-
-	fmt = sdp_media_lformat(mf->video.sdpm, hdr.pt);
-	if (fmt) {
+	case RX_DEC_VIDEO:
 		if (!mf->video.has_rtp) {
 			mf->video.has_rtp = true;
 			check_rtpstart(mf);
 		}
 		if (vc && vc->dec_rtph) {
-			vc->dec_rtph(mf->video.vds,
-				     mbuf_buf(mb), mbuf_get_left(mb));
-
 			uint32_t bwalloc = 0;
+
+			vc->dec_rtph(mf->video.vds, pkt, len);
+
 			if (vc->dec_bwalloch) {
 				bwalloc = vc->dec_bwalloch(mf->video.vds);
 			}
-			mediastats_rtp_stats_update(&mf->video_stats_rcv,
-					 mbuf_buf(mb),mbuf_get_left(mb), bwalloc);
+			mediastats_rtp_stats_update(mf->video_stats_rcv,
+						    pkt, len, bwalloc);
 		}
+		break;
 
-		goto out;
+	default:
+		info("mediaflow: recv: no SDP format found"
+		     " for payload type %d\n", pd->pt);
+		return;
 	}
 
-	info("mediaflow: recv: no SDP format found"
-	     " for payload type %d\n", hdr.pt);
-
- out:
-	return;  /* stop packet here */
+	rx_hist_add(mf, RX_STAGE_DECODE, t0);
 }
 
 
@@ -2033,6 +2229,21 @@ int mediaflow_summary(struct re_printf *pf, const struct mediaflow *mf)
 			  mf->ice_local_eoc, mf->ice_remote_eoc);
 	err |= re_hprintf(pf, "\n");
 
+	err |= re_hprintf(pf, "setup [ms]: gathered=%d ice=%d..%d dtls=%d..%d"
+			  " rtp tx=%d rx=%d%s\n",
+			  mf->mf_stats.setup.gathered,
+			  mf->mf_stats.setup.ice_start,
+			  mf->mf_stats.setup.ice_estab,
+			  mf->mf_stats.setup.dtls_start,
+			  mf->mf_stats.setup.dtls_estab,
+			  mf->mf_stats.setup.rtp_tx,
+			  mf->mf_stats.setup.rtp_rx,
+			  mf->fast_setup ? " (fast)" : "");
+	err |= re_hprintf(pf, "path cache: peer=%s %s\n",
+			  pathcache_peer_name(mf->pcache.peer),
+			  mf->pcache.hit ? "hit" : "miss");
+	err |= re_hprintf(pf, "\n");
+
 	/* Crypto summary */
 	err |= re_hprintf(pf,
 			  "crypto: local  = %H\n"
@@ -2057,8 +2268,11 @@ int mediaflow_summary(struct re_printf *pf, const struct mediaflow *mf)
 				  mediaflow_setup_name(mf->setup_local),
 				  mediaflow_setup_name(mf->setup_remote)
 				  );
-		err |= re_hprintf(pf, "        setup_time=%d ms\n",
-				  mf->mf_stats.dtls_estab);
+		err |= re_hprintf(pf, "        setup_time=%d ms%s\n",
+				  mf->mf_stats.dtls_estab,
+				  mediaflow_dtls_resumed(mf)
+				  ? " (resumed)" : "");
+
 		err |= re_hprintf(pf, "        packets sent=%u, recv=%u\n",
 				  mf->mf_stats.dtls_pkt_sent,
 				  mf->mf_stats.dtls_pkt_recv);
@@ -2119,12 +2333,19 @@ int mediaflow_summary(struct re_printf *pf, const struct mediaflow *mf)
 
 int mediaflow_rtp_summary(struct re_printf *pf, const struct mediaflow *mf)
 {
+	const struct rtp_stats *atx, *arx, *vtx, *vrx;
 	struct aucodec_stats *voe_stats;
 	int err = 0;
 
 	if (!mf)
 		return 0;
 
+	/* the statistics only exist for streams that were started */
+	atx = mf->audio_stats_snd;
+	arx = mf->audio_stats_rcv;
+	vtx = mf->video_stats_snd;
+	vrx = mf->video_stats_rcv;
+
 	err |= re_hprintf(pf,
 			  "----------- mediaflow RTP summary ------------\n");
 
@@ -2136,18 +2357,20 @@ int mediaflow_rtp_summary(struct re_printf *pf, const struct mediaflow *mf)
 				  voe_stats->in_vol.avg,
 				  voe_stats->in_vol.max);
 	}
-	err |= re_hprintf(pf,"Bit rate (kbps) %.1f %.1f %.1f \n",
-			  mf->audio_stats_snd.bit_rate_stats.min,
-			  mf->audio_stats_snd.bit_rate_stats.avg,
-			  mf->audio_stats_snd.bit_rate_stats.max);
-	err |= re_hprintf(pf,"Packet rate (1/s) %.1f %.1f %.1f \n",
-			  mf->audio_stats_snd.pkt_rate_stats.min,
-			  mf->audio_stats_snd.pkt_rate_stats.avg,
-			  mf->audio_stats_snd.pkt_rate_stats.max);
-	err |= re_hprintf(pf,"Loss rate (pct) %.1f %.1f %.1f \n",
-			  mf->audio_stats_snd.pkt_loss_stats.min,
-			  mf->audio_stats_snd.pkt_loss_stats.avg,
-			  mf->audio_stats_snd.pkt_loss_stats.max);
+	if (atx) {
+		err |= re_hprintf(pf,"Bit rate (kbps) %.1f %.1f %.1f \n",
+				  atx->bit_rate_stats.min,
+				  atx->bit_rate_stats.avg,
+				  atx->bit_rate_stats.max);
+		err |= re_hprintf(pf,"Packet rate (1/s) %.1f %.1f %.1f \n",
+				  atx->pkt_rate_stats.min,
+				  atx->pkt_rate_stats.avg,
+				  atx->pkt_rate_stats.max);
+		err |= re_hprintf(pf,"Loss rate (pct) %.1f %.1f %.1f \n",
+				  atx->pkt_loss_stats.min,
+				  atx->pkt_loss_stats.avg,
+				  atx->pkt_loss_stats.max);
+	}
 
 	err |= re_hprintf(pf,"Audio RX: \n");
 	if (voe_stats) {
@@ -2156,22 +2379,24 @@ int mediaflow_rtp_summary(struct re_printf *pf, const struct mediaflow *mf)
 				  voe_stats->out_vol.avg,
 				  voe_stats->out_vol.max);
 	}
-	err |= re_hprintf(pf,"Bit rate (kbps) %.1f %.1f %.1f \n",
-			  mf->audio_stats_rcv.bit_rate_stats.min,
-			  mf->audio_stats_rcv.bit_rate_stats.avg,
-			  mf->audio_stats_rcv.bit_rate_stats.max);
-	err |= re_hprintf(pf,"Packet rate (1/s) %.1f %.1f %.1f \n",
-			  mf->audio_stats_rcv.pkt_rate_stats.min,
-			  mf->audio_stats_rcv.pkt_rate_stats.avg,
-			  mf->audio_stats_rcv.pkt_rate_stats.max);
-	err |= re_hprintf(pf,"Loss rate (pct) %.1f %.1f %.1f \n",
-			  mf->audio_stats_rcv.pkt_loss_stats.min,
-			  mf->audio_stats_rcv.pkt_loss_stats.avg,
-			  mf->audio_stats_rcv.pkt_loss_stats.max);
-	err |= re_hprintf(pf,"Mean burst length %.1f %.1f %.1f \n",
-			  mf->audio_stats_rcv.pkt_mbl_stats.min,
-			  mf->audio_stats_rcv.pkt_mbl_stats.avg,
-			  mf->audio_stats_rcv.pkt_mbl_stats.max);
+	if (arx) {
+		err |= re_hprintf(pf,"Bit rate (kbps) %.1f %.1f %.1f \n",
+				  arx->bit_rate_stats.min,
+				  arx->bit_rate_stats.avg,
+				  arx->bit_rate_stats.max);
+		err |= re_hprintf(pf,"Packet rate (1/s) %.1f %.1f %.1f \n",
+				  arx->pkt_rate_stats.min,
+				  arx->pkt_rate_stats.avg,
+				  arx->pkt_rate_stats.max);
+		err |= re_hprintf(pf,"Loss rate (pct) %.1f %.1f %.1f \n",
+				  arx->pkt_loss_stats.min,
+				  arx->pkt_loss_stats.avg,
+				  arx->pkt_loss_stats.max);
+		err |= re_hprintf(pf,"Mean burst length %.1f %.1f %.1f \n",
+				  arx->pkt_mbl_stats.min,
+				  arx->pkt_mbl_stats.avg,
+				  arx->pkt_mbl_stats.max);
+	}
 	if (voe_stats){
 		err |= re_hprintf(pf,"JB size (ms) %.1f %.1f %.1f \n",
 				  voe_stats->jb_size.min,
@@ -2182,46 +2407,49 @@ int mediaflow_rtp_summary(struct re_printf *pf, const struct mediaflow *mf)
 				  voe_stats->rtt.avg,
 				  voe_stats->rtt.max);
 	}
-	err |= re_hprintf(pf,"Packet dropouts (#) %d \n",
-			  mf->audio_stats_rcv.dropouts);
-	if (mf->video.has_media){
+	if (arx) {
+		err |= re_hprintf(pf,"Packet dropouts (#) %d \n",
+				  arx->dropouts);
+	}
+	if (mf->video.has_media && vtx){
 		err |= re_hprintf(pf,"Video TX: \n");
 		err |= re_hprintf(pf,"Bit rate (kbps) %.1f %.1f %.1f \n",
-				  mf->video_stats_snd.bit_rate_stats.min,
-				  mf->video_stats_snd.bit_rate_stats.avg,
-				  mf->video_stats_snd.bit_rate_stats.max);
+				  vtx->bit_rate_stats.min,
+				  vtx->bit_rate_stats.avg,
+				  vtx->bit_rate_stats.max);
 		err |= re_hprintf(pf,"Alloc rate (kbps) %.1f %.1f %.1f \n",
-				  mf->video_stats_snd.bw_alloc_stats.min,
-				  mf->video_stats_snd.bw_alloc_stats.avg,
-				  mf->video_stats_snd.bw_alloc_stats.max);
+				  vtx->bw_alloc_stats.min,
+				  vtx->bw_alloc_stats.avg,
+				  vtx->bw_alloc_stats.max);
 		err |= re_hprintf(pf,"Frame rate (1/s) %.1f %.1f %.1f \n",
-				  mf->video_stats_snd.frame_rate_stats.min,
-				  mf->video_stats_snd.frame_rate_stats.avg,
-				  mf->video_stats_snd.frame_rate_stats.max);
+				  vtx->frame_rate_stats.min,
+				  vtx->frame_rate_stats.avg,
+				  vtx->frame_rate_stats.max);
 		err |= re_hprintf(pf,"Loss rate (pct) %.1f %.1f %.1f \n",
-				  mf->video_stats_snd.pkt_loss_stats.min,
-				  mf->video_stats_snd.pkt_loss_stats.avg,
-				  mf->video_stats_snd.pkt_loss_stats.max);
-
+				  vtx->pkt_loss_stats.min,
+				  vtx->pkt_loss_stats.avg,
+				  vtx->pkt_loss_stats.max);
+	}
+	if (mf->video.has_media && vrx){
 		err |= re_hprintf(pf,"Video RX: \n");
 		err |= re_hprintf(pf,"Bit rate (kbps) %.1f %.1f %.1f \n",
-				  mf->video_stats_rcv.bit_rate_stats.min,
-				  mf->video_stats_rcv.bit_rate_stats.avg,
-				  mf->video_stats_rcv.bit_rate_stats.max);
+				  vrx->bit_rate_stats.min,
+				  vrx->bit_rate_stats.avg,
+				  vrx->bit_rate_stats.max);
 		err |= re_hprintf(pf,"Alloc rate (kbps) %.1f %.1f %.1f \n",
-				  mf->video_stats_rcv.bw_alloc_stats.min,
-				  mf->video_stats_rcv.bw_alloc_stats.avg,
-				  mf->video_stats_rcv.bw_alloc_stats.max);
+				  vrx->bw_alloc_stats.min,
+				  vrx->bw_alloc_stats.avg,
+				  vrx->bw_alloc_stats.max);
 		err |= re_hprintf(pf,"Frame rate (1/s) %.1f %.1f %.1f \n",
-				  mf->video_stats_rcv.frame_rate_stats.min,
-				  mf->video_stats_rcv.frame_rate_stats.avg,
-				  mf->video_stats_rcv.frame_rate_stats.max);
+				  vrx->frame_rate_stats.min,
+				  vrx->frame_rate_stats.avg,
+				  vrx->frame_rate_stats.max);
 		err |= re_hprintf(pf,"Loss rate (pct) %.1f %.1f %.1f \n",
-				  mf->video_stats_rcv.pkt_loss_stats.min,
-				  mf->video_stats_rcv.pkt_loss_stats.avg,
-				  mf->video_stats_rcv.pkt_loss_stats.max);
+				  vrx->pkt_loss_stats.min,
+				  vrx->pkt_loss_stats.avg,
+				  vrx->pkt_loss_stats.max);
 		err |= re_hprintf(pf,"Packet dropouts (#) %d \n",
-				  mf->video_stats_rcv.dropouts);
+				  vrx->dropouts);
 	}
 
 	err |= re_hprintf(pf,
@@ -2275,7 +2503,15 @@ static void destructor(void *arg)
 
 	mf->data.dce = mem_deref(mf->data.dce);
 
+	mem_deref(mf->audio_stats_rcv);
+	mem_deref(mf->audio_stats_snd);
+	mem_deref(mf->video_stats_rcv);
+	mem_deref(mf->video_stats_snd);
+	mem_deref(mf->codec_stats);
+
 	mf->tls_conn = mem_deref(mf->tls_conn);
+	mf->dtls_sess = mem_deref(mf->dtls_sess);
+	mf->dtls_early.mb = mem_deref(mf->dtls_early.mb);
 
 	list_flush(&mf->interfacel);
 
@@ -2285,6 +2521,7 @@ static void destructor(void *arg)
 	mf->trice_stun = mem_deref(mf->trice_stun);
 	mem_deref(mf->us_stun);
 	list_flush(&mf->turnconnl);
+	list_flush(&mf->turn_deferl);
 
 	mem_deref(mf->dtls_sock);
 
@@ -2304,6 +2541,8 @@ static void destructor(void *arg)
 	mem_deref(mf->peer_software);
 
 	mem_deref(mf->mq);
+
+	mediashard_flow_remove(mf->shard);
 }
 
 
@@ -2428,10 +2667,23 @@ int mediaflow_alloc(struct mediaflow **mfp,
 	mf->mf_stats.dtls_estab = -1;
 	mf->mf_stats.dce_estab  = -1;
 
+	mf->mf_stats.setup.gathered   = -1;
+	mf->mf_stats.setup.ice_start  = -1;
+	mf->mf_stats.setup.ice_estab  = -1;
+	mf->mf_stats.setup.dtls_start = -1;
+	mf->mf_stats.setup.dtls_estab = -1;
+	mf->mf_stats.setup.rtp_tx     = -1;
+	mf->mf_stats.setup.rtp_rx     = -1;
+	mf->ts_alloc = tmr_jiffies();
+
 	err = mqueue_alloc(&mf->mq, mq_callback, mf);
 	if (err)
 		goto out;
 
+	/* the flow belongs to the main loop of this thread */
+	mf->shard = mediashard_current();
+	mediashard_flow_add(mf->shard);
+
 	mf->dtls   = mem_ref(dtls);
 	mf->nat    = nat;
 	mf->setup_local    = SETUP_ACTPASS;
@@ -2507,6 +2759,11 @@ int mediaflow_alloc(struct mediaflow **mfp,
 	if (err)
 		goto out;
 
+	err = sdp_media_set_lattr(mf->sdpm, false, "extmap", "%u %s",
+				  AULEVEL_EXTMAP_ID, AULEVEL_URI);
+	if (err)
+		goto out;
+
 	/* ICE */
 	if (nat == MEDIAFLOW_TRICKLEICE_DUALSTACK) {
 
@@ -2813,8 +3070,9 @@ int mediaflow_add_video(struct mediaflow *mf, struct list *vidcodecl)
 	if (err)
 		goto out;
 
-	sdp_media_set_lbandwidth(mf->video.sdpm,
-				 SDP_BANDWIDTH_AS, VIDEO_BANDWIDTH);
+	sdp_media_set_lbandwidth(mf->video.sdpm, SDP_BANDWIDTH_AS,
+				 mf->video.hd ? VIDEO_BANDWIDTH_HD
+				 : VIDEO_BANDWIDTH);
 
 	/* needed for new versions of WebRTC */
 	err = sdp_media_set_alt_protos(mf->video.sdpm, 2,
@@ -2897,6 +3155,8 @@ int mediaflow_add_video(struct mediaflow *mf, struct list *vidcodecl)
 				goto out;
 			}
 
+			mf->rx.ptmap_ready = false;
+
 			ssrcv[i] = rand_u32();
 			re_snprintf(ssrc_group, sizeof(ssrc_group),
 				    "%u ", ssrcv[i]);
@@ -3152,10 +3412,14 @@ static int handle_dtls_srtp(struct mediaflow *mf)
 static void demux_packet(struct mediaflow *mf, const struct sa *src,
 			 struct mbuf *mb)
 {
+	struct packet_desc pd;
 	enum packet pkt;
+	uint64_t t0;
 	bool hdld;
 
-	pkt = packet_classify_packet_type(mb);
+	t0 = packet_usec();
+	packet_parse(&pd, mb);
+	pkt = pd.type;
 
 	if (mf->trice) {
 
@@ -3179,7 +3443,8 @@ static void demux_packet(struct mediaflow *mf, const struct sa *src,
 
 	case PACKET_RTP:
 	case PACKET_RTCP:
-		hdld = udp_helper_recv_handler_srtp((struct sa *)src, mb, mf);
+		rx_hist_add(mf, RX_STAGE_PARSE, t0);
+		hdld = recv_srtp(mf, (struct sa *)src, mb, &pd);
 		if (!hdld) {
 			warning("mediaflow: rtp packet not handled\n");
 		}
@@ -3423,9 +3688,57 @@ int mediaflow_generate_answer(struct mediaflow *mf, char *sdp, size_t sz)
 }
 
 
-/* after the SDP has been parsed,
-   we can start to analyze it
-   (this must be done _after_ sdp_decode() )
+static bool aulevel_extmap_handler(const char *name, const char *value,
+				   void *arg)
+{
+	struct sdp_extmap extmap;
+	(void)name;
+	(void)arg;
+
+	if (sdp_extmap_decode(&extmap, value))
+		return false;
+
+	return 0 == pl_strcasecmp(&extmap.name, AULEVEL_URI);
+}
+
+
+/* Use the remote's id for the audio level extension, or stop offering
+ * it if the remote does not support it. Only the one-byte header form
+ * is supported, so ids 1-14.
+ */
+static void update_aulevel_extmap(struct mediaflow *mf)
+{
+	struct sdp_extmap extmap;
+	const char *attr;
+
+	attr = sdp_media_rattr_apply(mf->sdpm, "extmap",
+				     aulevel_extmap_handler, NULL);
+
+	sdp_media_del_lattr(mf->sdpm, "extmap");
+	mf->audio.level_id = 0;
+
+	if (!attr || sdp_extmap_decode(&extmap, attr)) {
+		info("mediaflow: remote does not support audio levels\n");
+		return;
+	}
+
+	if (extmap.id < 1 || extmap.id > 14) {
+		info("mediaflow: audio level extmap id %u not supported\n",
+		     extmap.id);
+		return;
+	}
+
+	mf->audio.level_id = extmap.id;
+	sdp_media_set_lattr(mf->sdpm, false, "extmap", "%u %s",
+			    extmap.id, AULEVEL_URI);
+
+	debug("mediaflow: audio levels with extmap id %u\n", extmap.id);
+}
+
+
+/* after the SDP has been parsed,
+   we can start to analyze it
+   (this must be done _after_ sdp_decode() )
 */
 static int post_sdp_decode(struct mediaflow *mf)
 {
@@ -3471,6 +3784,8 @@ static int post_sdp_decode(struct mediaflow *mf)
 		sdp_media_set_lattr(mf->sdpm, true, "mid", mid);
 	}
 
+	update_aulevel_extmap(mf);
+
 	if (!sdp_media_rattr(mf->sdpm, "rtcp-mux")) {
 		warning("mediaflow: no 'rtcp-mux' attribute in SDP"
 			" -- rejecting\n");
@@ -3981,6 +4296,73 @@ static void turnc_chan_handler(void *arg)
 }
 
 
+static bool same_network(const struct sa *a, const struct sa *b)
+{
+	if (sa_af(a) != sa_af(b))
+		return false;
+
+	switch (sa_af(a)) {
+
+	case AF_INET:
+		return (sa_in(a) & 0xffffff00) == (sa_in(b) & 0xffffff00);
+
+#ifdef HAVE_INET6
+	case AF_INET6:
+		return 0 == memcmp(&a->u.in6.sin6_addr,
+				   &b->u.in6.sin6_addr, 8);
+#endif
+
+	default:
+		return false;
+	}
+}
+
+
+/* The class of the remote peer, for the path cache */
+static enum pathcache_peer peer_class(const struct mediaflow *mf)
+{
+	enum pathcache_peer peer = PATHCACHE_PEER_NONE;
+	struct le *le;
+
+	for (le = list_head(trice_rcandl(mf->trice)); le; le = le->next) {
+		const struct ice_rcand *rcand = le->data;
+
+		switch (rcand->attr.type) {
+
+		case ICE_CAND_TYPE_HOST:
+			if (same_network(&rcand->attr.addr,
+					 &mf->laddr_default))
+				return PATHCACHE_PEER_LAN;
+			break;
+
+		case ICE_CAND_TYPE_SRFLX:
+		case ICE_CAND_TYPE_PRFLX:
+			peer = PATHCACHE_PEER_NAT;
+			break;
+
+		case ICE_CAND_TYPE_RELAY:
+			if (peer == PATHCACHE_PEER_NONE)
+				peer = PATHCACHE_PEER_RELAY;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return peer;
+}
+
+
+/* Paths are remembered per TURN server, we use the first one */
+static const struct sa *pathcache_srv(const struct mediaflow *mf)
+{
+	const struct turn_conn *conn = list_ledata(mf->turnconnl.head);
+
+	return conn ? &conn->turn_srv : NULL;
+}
+
+
 static void trice_estab_handler(struct ice_candpair *pair,
 				const struct stun_msg *msg, void *arg)
 {
@@ -4008,6 +4390,7 @@ static void trice_estab_handler(struct ice_candpair *pair,
 		mf->sel_pair = mem_ref(pair);
 
 		mf->ice_ready = true;
+		list_flush(&mf->turn_deferl);
 
 		attr = stun_msg_attr(msg, STUN_ATTR_SOFTWARE);
 		if (attr && !mf->peer_software) {
@@ -4018,6 +4401,17 @@ static void trice_estab_handler(struct ice_candpair *pair,
 		     print_cand, pair->rcand,
 		     mf->peer_software);
 
+		if (mf->ts_nat_start) {
+			int32_t setup = tmr_jiffies() - mf->ts_nat_start;
+
+			pathcache_pair_result(&mf->laddr_default,
+					      pathcache_srv(mf),
+					      peer_class(mf),
+					      pair->lcand->attr.type,
+					      pair->rcand->attr.type, setup);
+			pathcache_setup_result(mf->pcache.hit, setup);
+		}
+
 #if 1
 		// TODO: extra for PRFLX
 		udp_handler_set(pair->lcand->us, trice_udp_recv_handler, mf);
@@ -4093,12 +4487,117 @@ static void trice_failed_handler(int err, uint16_t scode,
 			mf->ice_ready = false;
 			mf->err = EPROTO;
 
+			pathcache_setup_result(mf->pcache.hit, -1);
+
 			tmr_start(&mf->tmr_error, 0, tmr_error_handler, mf);
 		}
 	}
 }
 
 
+static unsigned ice_interval(const struct mediaflow *mf)
+{
+	return mf->fast_setup ? ICE_INTERVAL_FAST : ICE_INTERVAL;
+}
+
+
+/* The pair that worked last time with this kind of peer is checked
+ * first, then host to host, then server reflexive. Relayed pairs are
+ * the most likely to work but the slowest path, so they come last, or
+ * a relay would be nominated ahead of a direct path. Lower ranks are
+ * checked first.
+ */
+static int pair_rank(const struct mediaflow *mf,
+		     const struct ice_candpair *pair)
+{
+	enum ice_cand_type ltype = pair->lcand->attr.type;
+	enum ice_cand_type rtype = pair->rcand->attr.type;
+
+	if (mf->pcache.hit &&
+	    ltype == mf->pcache.ltype && rtype == mf->pcache.rtype)
+		return -1;
+	if (ltype == ICE_CAND_TYPE_HOST && rtype == ICE_CAND_TYPE_HOST)
+		return 0;
+	if (ltype != ICE_CAND_TYPE_RELAY && rtype != ICE_CAND_TYPE_RELAY)
+		return 1;
+
+	return 2;
+}
+
+
+static void lookup_path(struct mediaflow *mf)
+{
+	enum pathcache_peer peer;
+	int err;
+
+	if (mf->pcache.hit)
+		return;
+
+	peer = peer_class(mf);
+	if (peer == PATHCACHE_PEER_NONE)
+		return;
+
+	mf->pcache.peer = peer;
+
+	err = pathcache_pair_lookup(&mf->laddr_default, pathcache_srv(mf),
+				    peer, &mf->pcache.ltype,
+				    &mf->pcache.rtype, NULL);
+	if (err)
+		return;
+
+	mf->pcache.hit = true;
+
+	info("mediaflow: path cache: peer=%s, checking %s-%s first\n",
+	     pathcache_peer_name(peer),
+	     ice_cand_type2name(mf->pcache.ltype),
+	     ice_cand_type2name(mf->pcache.rtype));
+}
+
+
+/* Move the best pairs to the front of the checklist: with fast setup
+ * the direct ones by their rank, otherwise only the pair from the path
+ * cache. Relayed pairs keep their place. The order within a rank is
+ * kept.
+ */
+static void promote_pairs(struct mediaflow *mf)
+{
+	struct list *checkl;
+	int rank, first;
+
+	lookup_path(mf);
+
+	if (mf->fast_setup)
+		first = 1;
+	else if (mf->pcache.hit)
+		first = -1;
+	else
+		return;
+
+	checkl = trice_checkl(mf->trice);
+
+	for (rank = first; rank >= -1; rank--) {
+
+		struct le *le = checkl->tail;
+		uint32_t n = list_count(checkl);
+
+		while (le && n--) {
+			struct ice_candpair *pair = le->data;
+			struct le *prev = le->prev;
+
+			bool pending = pair->state == ICE_CANDPAIR_FROZEN ||
+				pair->state == ICE_CANDPAIR_WAITING;
+
+			if (pending && pair_rank(mf, pair) == rank) {
+				list_unlink(le);
+				list_prepend(checkl, le, pair);
+			}
+
+			le = prev;
+		}
+	}
+}
+
+
 /*
  * Start the mediaflow state-machine.
  *
@@ -4115,6 +4614,7 @@ int mediaflow_start_ice(struct mediaflow *mf)
 	MAGIC_CHECK(mf);
 
 	mf->ts_nat_start = tmr_jiffies();
+	setup_mark(mf, &mf->mf_stats.setup.ice_start);
 
 	if (mf->nat == MEDIAFLOW_TRICKLEICE_DUALSTACK) {
 
@@ -4136,8 +4636,10 @@ int mediaflow_start_ice(struct mediaflow *mf)
 		     " %u remote candidates\n",
 		     list_count(trice_rcandl(mf->trice)));
 
+		promote_pairs(mf);
+
 		err = trice_checklist_start(mf->trice, mf->trice_stun,
-					    ICE_INTERVAL, true,
+					    ice_interval(mf), true,
 					    trice_estab_handler,
 					    trice_failed_handler,
 					    mf);
@@ -4214,8 +4716,10 @@ int mediaflow_add_rcand(struct mediaflow *mf, const char *sdp,
 		     " %u remote candidates\n",
 		     list_count(trice_rcandl(mf->trice)));
 
+		promote_pairs(mf);
+
 		err = trice_checklist_start(mf->trice, mf->trice_stun,
-					    ICE_INTERVAL, true,
+					    ice_interval(mf), true,
 					    trice_estab_handler,
 					    trice_failed_handler,
 					    mf);
@@ -4267,7 +4771,7 @@ static int stop_audio(struct mediaflow *mf)
 
 	ac = audec_get(mf->ads);
 	if (ac && ac->get_stats)
-		ac->get_stats(mf->ads, &mf->codec_stats);
+		codec_stats_update(mf, ac);
 	if (ac && ac->dec_stop)
 		ac->dec_stop(mf->ads);
 
@@ -4428,7 +4932,7 @@ void mediaflow_stop_media(struct mediaflow *mf)
 
 	ac = audec_get(mf->ads);
 	if (ac && ac->get_stats)
-		ac->get_stats(mf->ads, &mf->codec_stats);
+		codec_stats_update(mf, ac);
 	if (ac && ac->dec_stop)
 		ac->dec_stop(mf->ads);
 
@@ -4641,6 +5145,8 @@ static void gather_stun_resp_handler(int err, uint16_t scode,
 	mf->ice_local_eoc = true;
 	sdp_media_set_lattr(mf->sdpm, true, "end-of-candidates", NULL);
 
+	setup_mark(mf, &mf->mf_stats.setup.gathered);
+
 	if (mf->gatherh)
 		mf->gatherh(mf->arg);
 
@@ -4866,6 +5372,10 @@ static void turnconn_estab_handler(struct turn_conn *conn,
 			- conn->ts_turn_req;
 	}
 
+	pathcache_turn_result(&mf->laddr_default, &conn->turn_srv,
+			      conn->proto, true,
+			      (uint32_t)(conn->ts_turn_resp - conn->ts_turn_req));
+
 	if (mf->nat == MEDIAFLOW_TRICKLEICE_DUALSTACK) {
 
 		sdp_media_set_laddr(mf->sdpm, relay_addr);
@@ -4908,6 +5418,8 @@ static void turnconn_estab_handler(struct turn_conn *conn,
 	add_permission_to_remotes(mf);
 
 	/* NOTE: must be called last, since app might deref mediaflow */
+	setup_mark(mf, &mf->mf_stats.setup.gathered);
+
 	if (mf->gatherh)
 		mf->gatherh(mf->arg);
 
@@ -4955,13 +5467,35 @@ static void turnconn_data_handler(struct turn_conn *conn, const struct sa *src,
 }
 
 
+static void start_deferred_turn(struct mediaflow *mf);
+
+
 static void turnconn_error_handler(int err, void *arg)
 {
 	struct mediaflow *mf = arg;
+	struct le *le;
 
 	warning("mediaflow: turnconn_error:  turnconnl=%u  (%m)\n",
 		list_count(&mf->turnconnl), err);
 
+	for (le = mf->turnconnl.head; le; le = le->next) {
+		struct turn_conn *conn = le->data;
+
+		if (!conn->err || conn->turn_allocated)
+			continue;
+
+		if (PATHCACHE_DEAD == pathcache_turn_state(&mf->laddr_default,
+							   &conn->turn_srv,
+							   conn->proto, NULL))
+			continue;
+
+		pathcache_turn_result(&mf->laddr_default, &conn->turn_srv,
+				      conn->proto, false, 0);
+	}
+
+	/* the paths we held back are all we have left */
+	start_deferred_turn(mf);
+
 	if (list_count(&mf->turnconnl) > 1 ||
 	    turnconn_is_one_allocated(&mf->turnconnl)) {
 
@@ -4975,6 +5509,196 @@ static void turnconn_error_handler(int err, void *arg)
 }
 
 
+static int turn_alloc(struct mediaflow *mf, const struct sa *turn_srv,
+		      int proto, bool secure,
+		      const char *username, const char *password)
+{
+	int err;
+
+	err = turnconn_alloc(NULL, &mf->turnconnl,
+			     turn_srv, proto, secure,
+			     username, password,
+			     mf->af, NULL,
+			     LAYER_STUN, LAYER_TURN,
+			     turnconn_estab_handler,
+			     turnconn_data_handler,
+			     turnconn_error_handler, mf
+			     );
+
+	return err;
+}
+
+
+struct turn_defer {
+	struct le le;
+	struct tmr tmr;
+	struct mediaflow *mf;
+	struct sa srv;
+	int proto;
+	bool secure;
+	char *username;
+	char *password;
+};
+
+
+static void turn_defer_destructor(void *arg)
+{
+	struct turn_defer *td = arg;
+
+	tmr_cancel(&td->tmr);
+	list_unlink(&td->le);
+	mem_deref(td->username);
+	mem_deref(td->password);
+}
+
+
+static void turn_defer_start(struct turn_defer *td)
+{
+	struct mediaflow *mf = td->mf;
+	int err;
+
+	info("mediaflow: starting deferred TURN-%s allocation to %J\n",
+	     net_proto2name(td->proto), &td->srv);
+
+	err = turn_alloc(mf, &td->srv, td->proto, td->secure,
+			 td->username, td->password);
+	if (err) {
+		warning("mediaflow: deferred turnc_alloc failed (%m)\n",
+			err);
+	}
+
+	mem_deref(td);
+}
+
+
+static void turn_defer_timeout(void *arg)
+{
+	struct turn_defer *td = arg;
+
+	if (td->mf->ice_ready) {
+		mem_deref(td);
+		return;
+	}
+
+	turn_defer_start(td);
+}
+
+
+/* Once a pair is selected the held back paths are not needed */
+static void start_deferred_turn(struct mediaflow *mf)
+{
+	struct le *le = mf->turn_deferl.head;
+
+	if (mf->ice_ready) {
+		list_flush(&mf->turn_deferl);
+		return;
+	}
+
+	while (le) {
+		struct turn_defer *td = le->data;
+
+		le = le->next;
+		turn_defer_start(td);
+	}
+}
+
+
+/* Another TURN server or transport of this flow, which is allocated or
+ * worked last time from this interface.
+ */
+static bool has_turn_alternative(const struct mediaflow *mf,
+				 const struct sa *turn_srv, int proto)
+{
+	struct le *le;
+
+	for (le = mf->turnconnl.head; le; le = le->next) {
+		const struct turn_conn *conn = le->data;
+
+		if (conn->proto == proto &&
+		    sa_cmp(&conn->turn_srv, turn_srv, SA_ALL))
+			continue;
+		if (conn->err)
+			continue;
+
+		if (conn->turn_allocated)
+			return true;
+
+		if (PATHCACHE_OK == pathcache_turn_state(&mf->laddr_default,
+							 &conn->turn_srv,
+							 conn->proto, NULL))
+			return true;
+	}
+
+	return false;
+}
+
+
+/* Decided from the main loop, after all TURN servers of the flow
+ * were added, whatever the order of the gather calls was.
+ */
+static void turn_defer_check(void *arg)
+{
+	struct turn_defer *td = arg;
+	struct mediaflow *mf = td->mf;
+
+	if (mf->ice_ready) {
+		mem_deref(td);
+		return;
+	}
+
+	if (!has_turn_alternative(mf, &td->srv, td->proto)) {
+		turn_defer_start(td);
+		return;
+	}
+
+	tmr_start(&td->tmr, TURN_DEFER_MS, turn_defer_timeout, td);
+
+	pathcache_deferred();
+
+	info("mediaflow: path cache: TURN-%s to %J failed last time,"
+	     " deferring it\n", net_proto2name(td->proto), &td->srv);
+}
+
+
+/* An allocation that failed last time is held back for TURN_DEFER_MS,
+ * if the flow has another TURN server or transport that works. It is
+ * started early if another allocation fails, and dropped if ICE
+ * completes.
+ */
+static bool defer_turn(struct mediaflow *mf, const struct sa *turn_srv,
+		       int proto, bool secure,
+		       const char *username, const char *password)
+{
+	struct turn_defer *td;
+	int err;
+
+	if (PATHCACHE_DEAD != pathcache_turn_state(&mf->laddr_default,
+						   turn_srv, proto, NULL))
+		return false;
+
+	td = mem_zalloc(sizeof(*td), turn_defer_destructor);
+	if (!td)
+		return false;
+
+	td->mf = mf;
+	td->srv = *turn_srv;
+	td->proto = proto;
+	td->secure = secure;
+
+	err  = str_dup(&td->username, username);
+	err |= str_dup(&td->password, password);
+	if (err) {
+		mem_deref(td);
+		return false;
+	}
+
+	list_append(&mf->turn_deferl, &td->le, td);
+	tmr_start(&td->tmr, 0, turn_defer_check, td);
+
+	return true;
+}
+
+
 /*
  * Gather RELAY and SRFLX candidates (UDP only)
  */
@@ -4982,7 +5706,6 @@ int mediaflow_gather_turn(struct mediaflow *mf, const struct sa *turn_srv,
 			  const char *username, const char *password)
 {
 	struct sa turn_srv6;
-	void *sock = NULL;
 	int err;
 
 	if (!mf || !turn_srv)
@@ -5027,15 +5750,11 @@ int mediaflow_gather_turn(struct mediaflow *mf, const struct sa *turn_srv,
 	info("mediaflow: gather_turn: username='%s' srv=%J\n",
 	     username, turn_srv);
 
-	err = turnconn_alloc(NULL, &mf->turnconnl,
-			     turn_srv, IPPROTO_UDP, false,
-			     username, password,
-			     mf->af, sock,
-			     LAYER_STUN, LAYER_TURN,
-			     turnconn_estab_handler,
-			     turnconn_data_handler,
-			     turnconn_error_handler, mf
-			     );
+	if (defer_turn(mf, turn_srv, IPPROTO_UDP, false, username, password))
+		return 0;
+
+	err = turn_alloc(mf, turn_srv, IPPROTO_UDP, false,
+			 username, password);
 	if (err) {
 		warning("mediaflow: turnc_alloc failed (%m)\n", err);
 		return err;
@@ -5052,9 +5771,6 @@ int mediaflow_gather_turn_tcp(struct mediaflow *mf, const struct sa *turn_srv,
 			      const char *username, const char *password,
 			      bool secure)
 {
-	struct turn_conn *tc;
-	int err = 0;
-
 	if (!mf || !turn_srv)
 		return EINVAL;
 
@@ -5063,19 +5779,49 @@ int mediaflow_gather_turn_tcp(struct mediaflow *mf, const struct sa *turn_srv,
 		return EINVAL;
 	}
 
-	err = turnconn_alloc(&tc, &mf->turnconnl,
-			     turn_srv, IPPROTO_TCP, secure,
-			     username, password,
-			     mf->af, NULL,
-			     LAYER_STUN, LAYER_TURN,
-			     turnconn_estab_handler,
-			     turnconn_data_handler,
-			     turnconn_error_handler, mf
-			     );
+	if (defer_turn(mf, turn_srv, IPPROTO_TCP, secure, username, password))
+		return 0;
+
+	return turn_alloc(mf, turn_srv, IPPROTO_TCP, secure,
+			  username, password);
+}
+
+
+/* A pool of TURN allocations that can be used by mediaflows */
+int mediaflow_turnpool_alloc(struct turnpool **poolp, unsigned size, int af)
+{
+	return turnpool_alloc(poolp, size, af, LAYER_STUN, LAYER_TURN);
+}
+
+
+/*
+ * Gather RELAY and SRFLX candidates from an allocation that was made
+ * ahead of time on any of the TURN servers the flow is configured for.
+ * Returns ENOENT if the pool has none for this flow.
+ */
+int mediaflow_gather_turnpool(struct mediaflow *mf, struct turnpool *pool,
+			      const struct turnpool_server *srvv, size_t srvc)
+{
+	int err;
+
+	if (!mf || !pool || !srvv || !srvc)
+		return EINVAL;
+
+	if (mf->nat != MEDIAFLOW_TRICKLEICE_DUALSTACK || !mf->trice)
+		return EINVAL;
+
+	err = turnpool_take(pool, mf->af, srvv, srvc,
+			    &mf->turnconnl,
+			    turnconn_estab_handler,
+			    turnconn_data_handler,
+			    turnconn_error_handler, mf);
+
 	if (err)
 		return err;
 
-	return err;
+	info("mediaflow: gather_turnpool: using a ready allocation\n");
+
+	return 0;
 }
 
 
@@ -5161,6 +5907,26 @@ int mediaflow_debug(struct re_printf *pf, const struct mediaflow *mf)
 			 mf->stat.tx.bytes,
 			 mf->stat.rx.bytes);
 
+	if (mf->rx.histv[RX_STAGE_PARSE].n) {
+		static const char *stagev[RX_STAGE_NUM] = {
+			"parse", "decrypt", "decode"
+		};
+		int i;
+
+		for (i = 0; i < RX_STAGE_NUM; i++) {
+			err |= re_hprintf(pf, "\n    rx %-8s %H", stagev[i],
+					  packet_hist_debug, &mf->rx.histv[i]);
+		}
+	}
+
+	{
+		struct mediaflow_mem mem;
+
+		mediaflow_mem_get(mf, &mem);
+		err |= re_hprintf(pf, "\n    %H",
+				  mediaflow_mem_debug, &mem);
+	}
+
 	return err;
 }
 
@@ -5214,6 +5980,44 @@ const struct tls_conn *mediaflow_dtls_connection(const struct mediaflow *mf)
 }
 
 
+/*
+ * The DTLS session of an established flow, for the flow that replaces
+ * it after a restart. Only the DTLS client has one.
+ */
+int mediaflow_get_dtls_session(const struct mediaflow *mf,
+			       struct tls_session **sessp)
+{
+	if (!mf || !sessp)
+		return EINVAL;
+
+	if (!mf->crypto_ready || mf->setup_local != SETUP_ACTIVE)
+		return ENOENT;
+
+	return tls_get_session(sessp, mf->tls_conn);
+}
+
+
+/*
+ * Offer to resume a DTLS session when this flow connects as
+ * DTLS client. The fingerprints from SDP are verified as usual.
+ */
+void mediaflow_set_dtls_session(struct mediaflow *mf,
+				struct tls_session *sess)
+{
+	if (!mf)
+		return;
+
+	mem_deref(mf->dtls_sess);
+	mf->dtls_sess = mem_ref(sess);
+}
+
+
+bool mediaflow_dtls_resumed(const struct mediaflow *mf)
+{
+	return mf ? tls_session_reused(mf->tls_conn) : false;
+}
+
+
 bool mediaflow_is_started(const struct mediaflow *mf)
 {
 	return mf ? mf->started : false;
@@ -5326,12 +6130,16 @@ bool mediaflow_ice_ready(const struct mediaflow *mf)
 }
 
 
+/* Streams that have not started read as all zero */
+static const struct rtp_stats rtp_stats_none;
+
+
 const struct rtp_stats* mediaflow_rcv_audio_rtp_stats(const struct mediaflow *mf)
 {
 	if (!mf)
 		return NULL;
 
-	return &mf->audio_stats_rcv;
+	return mf->audio_stats_rcv ? mf->audio_stats_rcv : &rtp_stats_none;
 }
 
 
@@ -5340,7 +6148,7 @@ const struct rtp_stats* mediaflow_snd_audio_rtp_stats(const struct mediaflow *mf
 	if (!mf)
 		return NULL;
 
-	return &mf->audio_stats_snd;
+	return mf->audio_stats_snd ? mf->audio_stats_snd : &rtp_stats_none;
 }
 
 
@@ -5349,7 +6157,7 @@ const struct rtp_stats* mediaflow_rcv_video_rtp_stats(const struct mediaflow *mf
 	if (!mf)
 		return NULL;
 
-	return &mf->video_stats_rcv;
+	return mf->video_stats_rcv ? mf->video_stats_rcv : &rtp_stats_none;
 }
 
 
@@ -5358,7 +6166,7 @@ const struct rtp_stats* mediaflow_snd_video_rtp_stats(const struct mediaflow *mf
 	if (!mf)
 		return NULL;
 
-	return &mf->video_stats_snd;
+	return mf->video_stats_snd ? mf->video_stats_snd : &rtp_stats_none;
 }
 
 
@@ -5369,11 +6177,17 @@ struct aucodec_stats *mediaflow_codec_stats(struct mediaflow *mf)
 	if (!mf)
 		return NULL;
 
+	if (!mf->codec_stats) {
+		mf->codec_stats = mem_zalloc(sizeof(*mf->codec_stats), NULL);
+		if (!mf->codec_stats)
+			return NULL;
+	}
+
 	ac = audec_get(mf->ads);
 	if (ac && ac->get_stats)
-		ac->get_stats(mf->ads, &mf->codec_stats);
+		codec_stats_update(mf, ac);
 
-	return &mf->codec_stats;
+	return mf->codec_stats;
 }
 
 
@@ -5382,6 +6196,110 @@ const struct mediaflow_stats *mediaflow_stats_get(const struct mediaflow *mf)
 	return mf ? &mf->mf_stats : NULL;
 }
 
+
+static size_t list_mem_size(const struct list *list)
+{
+	struct le *le;
+	size_t sz = 0;
+
+	for (le = list_head(list); le; le = le->next)
+		sz += mem_size(le->data);
+
+	return sz;
+}
+
+
+/* Computed from the objects the flow holds now. libre objects count
+ * with their own size, not what they allocate internally, so this is
+ * a lower bound, and those figures are zero without memory debugging.
+ */
+int mediaflow_mem_get(const struct mediaflow *mf, struct mediaflow_mem *mem)
+{
+	if (!mf || !mem)
+		return EINVAL;
+
+	memset(mem, 0, sizeof(*mem));
+
+	mem->flow = sizeof(*mf);
+
+	if (mf->audio_stats_rcv)
+		mem->stats += sizeof(*mf->audio_stats_rcv);
+	if (mf->audio_stats_snd)
+		mem->stats += sizeof(*mf->audio_stats_snd);
+	if (mf->video_stats_rcv)
+		mem->stats += sizeof(*mf->video_stats_rcv);
+	if (mf->video_stats_snd)
+		mem->stats += sizeof(*mf->video_stats_snd);
+	if (mf->codec_stats)
+		mem->stats += sizeof(*mf->codec_stats);
+
+	mem->sdp = mem_size(mf->sdp) + mem_size(mf->sdpm)
+		+ mem_size(mf->video.sdpm) + mem_size(mf->data.sdpm);
+
+	mem->ice = mem_size(mf->trice) + mem_size(mf->trice_stun)
+		+ mem_size(mf->trice_uh) + mem_size(mf->us_stun)
+		+ list_mem_size(&mf->turnconnl)
+		+ list_mem_size(&mf->turn_deferl)
+		+ list_mem_size(&mf->interfacel);
+	if (mf->trice) {
+		mem->ice += list_mem_size(trice_lcandl(mf->trice))
+			+ list_mem_size(trice_rcandl(mf->trice))
+			+ list_mem_size(trice_checkl(mf->trice))
+			+ list_mem_size(trice_validl(mf->trice));
+	}
+
+	mem->dtls = mem_size(mf->uh_srtp) + mem_size(mf->dtls_sock)
+		+ mem_size(mf->dtls_uh) + mem_size(mf->tls_conn)
+		+ mem_size(mf->dtls_sess) + mem_size(mf->dtls_early.mb)
+		+ mem_size(mf->srtp_tx) + mem_size(mf->srtp_rx);
+
+	mem->codec = mem_size(mf->aes) + mem_size(mf->ads)
+		+ mem_size(mf->video.ves) + mem_size(mf->video.vds);
+
+	mem->data = mem_size(mf->data.dce) + mem_size(mf->data.dce_ch);
+
+	return 0;
+}
+
+
+void mediaflow_mem_add(struct mediaflow_mem *sum,
+		       const struct mediaflow_mem *mem)
+{
+	if (!sum || !mem)
+		return;
+
+	sum->flow  += mem->flow;
+	sum->stats += mem->stats;
+	sum->sdp   += mem->sdp;
+	sum->ice   += mem->ice;
+	sum->dtls  += mem->dtls;
+	sum->codec += mem->codec;
+	sum->data  += mem->data;
+}
+
+
+size_t mediaflow_mem_total(const struct mediaflow_mem *mem)
+{
+	if (!mem)
+		return 0;
+
+	return mem->flow + mem->stats + mem->sdp + mem->ice + mem->dtls
+		+ mem->codec + mem->data;
+}
+
+
+int mediaflow_mem_debug(struct re_printf *pf, const struct mediaflow_mem *mem)
+{
+	if (!mem)
+		return 0;
+
+	return re_hprintf(pf, "mem %zu bytes (flow=%zu stats=%zu sdp=%zu"
+			  " ice=%zu dtls=%zu codec=%zu data=%zu)",
+			  mediaflow_mem_total(mem),
+			  mem->flow, mem->stats, mem->sdp, mem->ice,
+			  mem->dtls, mem->codec, mem->data);
+}
+
 int32_t mediaflow_get_media_time(const struct mediaflow *mf)
 {
 	if (!mf)
@@ -5411,6 +6329,19 @@ bool mediaflow_have_eoc(const struct mediaflow *mf)
 }
 
 
+/* Fast call setup: shorter pacing of the connectivity checks, pairs
+ * that are likely to work are checked first, and a DTLS handshake that
+ * arrives before ICE is ready is not dropped.
+ */
+void mediaflow_enable_fast_setup(struct mediaflow *mf, bool enabled)
+{
+	if (!mf)
+		return;
+
+	mf->fast_setup = enabled;
+}
+
+
 void mediaflow_enable_privacy(struct mediaflow *mf, bool enabled)
 {
 	if (!mf)
@@ -5424,6 +6355,24 @@ void mediaflow_enable_privacy(struct mediaflow *mf, bool enabled)
 }
 
 
+/* Offer/accept HD video bandwidth, only for devices that can send and
+ * receive up to 1280x720.
+ */
+void mediaflow_enable_hd_video(struct mediaflow *mf, bool enabled)
+{
+	if (!mf)
+		return;
+
+	mf->video.hd = enabled;
+
+	if (mf->video.sdpm) {
+		sdp_media_set_lbandwidth(mf->video.sdpm, SDP_BANDWIDTH_AS,
+					 enabled ? VIDEO_BANDWIDTH_HD
+					 : VIDEO_BANDWIDTH);
+	}
+}
+
+
 const char *mediaflow_lcand_name(const struct mediaflow *mf)
 {
 	struct ice_lcand *lcand;
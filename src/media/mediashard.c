@@ -0,0 +1,530 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Media shards
+ *
+ * Worker threads that each run their own re main loop. A mediaflow
+ * belongs to the loop of the thread that allocated it: its sockets,
+ * timers, ICE, DTLS and SRTP are only touched from there. To spread
+ * independent calls over several cores, allocate the objects of a call
+ * on a shard with mediashard_call() and send every later control call
+ * to the same shard, e.g. through ecall_marshal_alloc_shard().
+ *
+ * Objects are not reference counted across threads. Everything that
+ * is mem_ref'ed by a flow, such as the DTLS context, must belong to
+ * the shard as well.
+ */
+
+#ifdef LINUX
+#define _GNU_SOURCE 1  /* RUSAGE_THREAD */
+#endif
+
+#include <string.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_semaphore.h"
+#include "avs_media.h"
+#include "priv_mediaflow.h"
+
+
+enum {
+	MQ_JOB  = 1,
+	MQ_STOP = 2,
+};
+
+
+struct mediashard {
+	unsigned ix;
+	pthread_t tid;
+	struct mqueue *mq;
+	struct avs_sem *sem_start;
+	int err;
+
+	unsigned nflows;     /* under shards.mutex */
+	uint64_t njobs;
+};
+
+struct job {
+	mediashard_h *h;
+	void *arg;
+	struct avs_sem *sem;  /* only for mediashard_call() */
+};
+
+
+/* The table is published and withdrawn as a whole under the mutex */
+static struct {
+	struct mediashard **shardv;
+	unsigned shardc;
+	pthread_mutex_t mutex;
+} shards = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct mediashard *sh = arg;
+	struct job *job = data;
+
+	switch (id) {
+
+	case MQ_JOB:
+		++sh->njobs;
+		job->h(job->arg);
+
+		if (job->sem)
+			avs_sem_post(job->sem);
+		else
+			mem_deref(job);
+		break;
+
+	case MQ_STOP:
+		re_cancel();
+		break;
+
+	default:
+		warning("mediashard: unknown event: %d\n", id);
+		break;
+	}
+}
+
+
+static void *shard_thread(void *arg)
+{
+	struct mediashard *sh = arg;
+	int err;
+
+	err = re_thread_init();
+	if (err) {
+		warning("mediashard: re_thread_init failed (%m)\n", err);
+		goto out;
+	}
+
+	err = mqueue_alloc(&sh->mq, mqueue_handler, sh);
+	if (err) {
+		warning("mediashard: mqueue_alloc failed (%m)\n", err);
+		re_thread_close();
+		goto out;
+	}
+
+	avs_sem_post(sh->sem_start);
+
+	err = re_main(NULL);
+	if (err)
+		warning("mediashard: shard %u: main loop (%m)\n", sh->ix, err);
+
+	sh->mq = mem_deref(sh->mq);
+	re_thread_close();
+
+	return NULL;
+
+ out:
+	sh->err = err;
+	avs_sem_post(sh->sem_start);
+
+	return NULL;
+}
+
+
+static void shard_destructor(void *arg)
+{
+	struct mediashard *sh = arg;
+
+	mem_deref(sh->sem_start);
+}
+
+
+static int shard_start(struct mediashard **shp, unsigned ix)
+{
+	struct mediashard *sh;
+	int err;
+
+	sh = mem_zalloc(sizeof(*sh), shard_destructor);
+	if (!sh)
+		return ENOMEM;
+
+	sh->ix = ix;
+
+	err = avs_sem_alloc(&sh->sem_start, 0);
+	if (err)
+		goto out;
+
+	err = pthread_create(&sh->tid, NULL, shard_thread, sh);
+	if (err)
+		goto out;
+
+	avs_sem_wait(sh->sem_start);
+
+	err = sh->err;
+	if (err) {
+		pthread_join(sh->tid, NULL);
+		goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(sh);
+	else
+		*shp = sh;
+
+	return err;
+}
+
+
+/* The shard must not have any flows */
+static void shard_stop(struct mediashard *sh)
+{
+	if (!sh)
+		return;
+
+	mqueue_push(sh->mq, MQ_STOP, NULL);
+	pthread_join(sh->tid, NULL);
+
+	mem_deref(sh);
+}
+
+
+static void shardv_stop(struct mediashard **shardv, unsigned shardc)
+{
+	unsigned i;
+
+	for (i = 0; i < shardc; i++)
+		shard_stop(shardv[i]);
+
+	mem_deref(shardv);
+}
+
+
+/* Starts n worker loops. With n = 0 everything stays on the main loop. */
+int mediashard_init(unsigned n)
+{
+	struct mediashard **shardv;
+	unsigned i;
+	int err = 0;
+
+	if (!n)
+		return 0;
+
+	shardv = mem_zalloc(n * sizeof(*shardv), NULL);
+	if (!shardv)
+		return ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		err = shard_start(&shardv[i], i);
+		if (err) {
+			warning("mediashard: could not start shard %u (%m)\n",
+				i, err);
+			shardv_stop(shardv, i);
+			return err;
+		}
+	}
+
+	pthread_mutex_lock(&shards.mutex);
+
+	if (shards.shardc) {
+		err = EALREADY;
+	}
+	else {
+		shards.shardv = shardv;
+		shards.shardc = n;
+	}
+
+	pthread_mutex_unlock(&shards.mutex);
+
+	if (err) {
+		shardv_stop(shardv, n);
+		return err;
+	}
+
+	info("mediashard: %u shards started\n", n);
+
+	return 0;
+}
+
+
+/* Refuses with EBUSY while flows are left on any shard, they would be
+ * cut off from their loop.
+ */
+int mediashard_close(void)
+{
+	struct mediashard **shardv;
+	unsigned i, shardc;
+	int err = 0;
+
+	pthread_mutex_lock(&shards.mutex);
+
+	for (i = 0; i < shards.shardc; i++) {
+		const struct mediashard *sh = shards.shardv[i];
+
+		if (sh->nflows) {
+			warning("mediashard: shard %u still has %u flows\n",
+				sh->ix, sh->nflows);
+			err = EBUSY;
+		}
+	}
+
+	shardv = shards.shardv;
+	shardc = shards.shardc;
+
+	if (!err) {
+		shards.shardv = NULL;
+		shards.shardc = 0;
+	}
+
+	pthread_mutex_unlock(&shards.mutex);
+
+	if (err)
+		return err;
+
+	shardv_stop(shardv, shardc);
+
+	return 0;
+}
+
+
+unsigned mediashard_count(void)
+{
+	unsigned n;
+
+	pthread_mutex_lock(&shards.mutex);
+	n = shards.shardc;
+	pthread_mutex_unlock(&shards.mutex);
+
+	return n;
+}
+
+
+struct mediashard *mediashard_get(unsigned ix)
+{
+	struct mediashard *sh;
+
+	pthread_mutex_lock(&shards.mutex);
+	sh = ix < shards.shardc ? shards.shardv[ix] : NULL;
+	pthread_mutex_unlock(&shards.mutex);
+
+	return sh;
+}
+
+
+/* The shard with the fewest flows */
+struct mediashard *mediashard_pick(void)
+{
+	struct mediashard *best = NULL;
+	unsigned i;
+
+	pthread_mutex_lock(&shards.mutex);
+
+	for (i = 0; i < shards.shardc; i++) {
+		struct mediashard *sh = shards.shardv[i];
+
+		if (!best || sh->nflows < best->nflows)
+			best = sh;
+	}
+
+	pthread_mutex_unlock(&shards.mutex);
+
+	return best;
+}
+
+
+/* The shard of the calling thread, NULL if it is not a shard */
+struct mediashard *mediashard_current(void)
+{
+	struct mediashard *sh = NULL;
+	pthread_t self = pthread_self();
+	unsigned i;
+
+	pthread_mutex_lock(&shards.mutex);
+
+	for (i = 0; i < shards.shardc; i++) {
+		if (pthread_equal(shards.shardv[i]->tid, self)) {
+			sh = shards.shardv[i];
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&shards.mutex);
+
+	return sh;
+}
+
+
+unsigned mediashard_index(const struct mediashard *sh)
+{
+	return sh ? sh->ix : 0;
+}
+
+
+/* Runs h on the shard, without waiting for it */
+int mediashard_exec(struct mediashard *sh, mediashard_h *h, void *arg)
+{
+	struct job *job;
+	int err;
+
+	if (!sh || !h)
+		return EINVAL;
+
+	job = mem_zalloc(sizeof(*job), NULL);
+	if (!job)
+		return ENOMEM;
+
+	job->h = h;
+	job->arg = arg;
+
+	err = mqueue_push(sh->mq, MQ_JOB, job);
+	if (err)
+		mem_deref(job);
+
+	return err;
+}
+
+
+/* Runs h on the shard and waits until it has returned. When called on
+ * the shard itself, h is called directly.
+ */
+int mediashard_call(struct mediashard *sh, mediashard_h *h, void *arg)
+{
+	struct job job;
+	int err;
+
+	if (!sh || !h)
+		return EINVAL;
+
+	if (pthread_equal(sh->tid, pthread_self())) {
+		h(arg);
+		return 0;
+	}
+
+	memset(&job, 0, sizeof(job));
+	job.h = h;
+	job.arg = arg;
+
+	err = avs_sem_alloc(&job.sem, 0);
+	if (err)
+		return err;
+
+	err = mqueue_push(sh->mq, MQ_JOB, &job);
+	if (err)
+		goto out;
+
+	avs_sem_wait(job.sem);
+
+ out:
+	mem_deref(job.sem);
+
+	return err;
+}
+
+
+void mediashard_flow_add(struct mediashard *sh)
+{
+	if (!sh)
+		return;
+
+	pthread_mutex_lock(&shards.mutex);
+	++sh->nflows;
+	pthread_mutex_unlock(&shards.mutex);
+}
+
+
+void mediashard_flow_remove(struct mediashard *sh)
+{
+	if (!sh)
+		return;
+
+	pthread_mutex_lock(&shards.mutex);
+	if (sh->nflows)
+		--sh->nflows;
+	pthread_mutex_unlock(&shards.mutex);
+}
+
+
+unsigned mediashard_flows(const struct mediashard *sh)
+{
+	unsigned n;
+
+	if (!sh)
+		return 0;
+
+	pthread_mutex_lock(&shards.mutex);
+	n = sh->nflows;
+	pthread_mutex_unlock(&shards.mutex);
+
+	return n;
+}
+
+
+struct cpu_time {
+	uint64_t usec;
+	int err;
+};
+
+
+static void cpu_time_handler(void *arg)
+{
+	struct cpu_time *ct = arg;
+
+#ifdef RUSAGE_THREAD
+	struct rusage ru;
+
+	if (0 != getrusage(RUSAGE_THREAD, &ru)) {
+		ct->err = errno;
+		return;
+	}
+
+	ct->usec = (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+		* 1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#else
+	ct->err = ENOSYS;
+#endif
+}
+
+
+/* CPU time used by the shard's thread so far, where supported */
+int mediashard_cpu_time(struct mediashard *sh, uint64_t *usecp)
+{
+	struct cpu_time ct;
+	int err;
+
+	if (!sh || !usecp)
+		return EINVAL;
+
+	memset(&ct, 0, sizeof(ct));
+
+	err = mediashard_call(sh, cpu_time_handler, &ct);
+	if (err)
+		return err;
+	if (ct.err)
+		return ct.err;
+
+	*usecp = ct.usec;
+
+	return 0;
+}
+
+
+int mediashard_debug(struct re_printf *pf, const struct mediashard *sh)
+{
+	if (!sh)
+		return 0;
+
+	return re_hprintf(pf, "shard %u: %u flows, %llu jobs",
+			  sh->ix, mediashard_flows(sh), sh->njobs);
+}
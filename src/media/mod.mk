@@ -5,5 +5,7 @@
 AVS_SRCS += \
 	media/dtls.c \
 	media/mediaflow.c \
+	media/mediashard.c \
+	media/pathcache.c \
 	media/packet.c \
 	media/sdp.c
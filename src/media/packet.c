@@ -16,6 +16,8 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string.h>
+#include <time.h>
 #include <re.h>
 #include "avs_media.h"
 #include "priv_mediaflow.h"
@@ -118,3 +120,215 @@ const char *packet_classify_name(enum packet pkt)
 	default: return "???";
 	}
 }
+
+
+enum {
+	RTCP_HDR = 4,
+};
+
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+
+/* Classifies the packet and parses what the receive path needs, without
+ * moving the buffer position. The type is always set, the rest only if
+ * 0 is returned.
+ */
+int packet_parse(struct packet_desc *pd, const struct mbuf *mb)
+{
+	const uint8_t *p;
+	size_t len;
+	uint8_t b;
+
+	if (!pd || !mb)
+		return EINVAL;
+
+	memset(pd, 0, sizeof(*pd));
+
+	len = mbuf_get_left(mb);
+	if (len < 1)
+		return EBADMSG;
+
+	p = mbuf_buf(mb);
+	b = p[0];
+
+	if (127 < b && b < 192) {
+
+		if (len < 2) {
+			pd->type = PACKET_RTP;
+			return EBADMSG;
+		}
+
+		pd->pt = p[1] & 0x7f;
+		pd->marker = (p[1] >> 7) & 1;
+
+		if (64 <= pd->pt && pd->pt <= 95) {
+			pd->type = PACKET_RTCP;
+			pd->pt = p[1];
+
+			if (len < 8)
+				return EBADMSG;
+
+			pd->ssrc = get_u32(&p[4]);
+			return 0;
+		}
+
+		pd->type = PACKET_RTP;
+
+		if (len < RTP_HEADER_SIZE)
+			return EBADMSG;
+
+		pd->seq = get_u16(&p[2]);
+		pd->ssrc = get_u32(&p[8]);
+
+		len -= RTP_HEADER_SIZE;
+		p += RTP_HEADER_SIZE;
+		pd->hdrlen = RTP_HEADER_SIZE + (b & 0x0f) * 4;
+
+		if (len < (size_t)(b & 0x0f) * 4)
+			goto badmsg;
+		len -= (b & 0x0f) * 4;
+		p += (b & 0x0f) * 4;
+
+		if (b & 0x10) {
+			size_t xlen;
+
+			if (len < 4)
+				goto badmsg;
+
+			xlen = 4 + get_u16(&p[2]) * 4;
+			if (len < xlen)
+				goto badmsg;
+
+			pd->hdrlen += xlen;
+		}
+
+		return 0;
+
+	badmsg:
+		pd->hdrlen = 0;
+		return EBADMSG;
+	}
+	else if (b >= 20 && b <= 63) {
+		pd->type = PACKET_DTLS;
+	}
+	else if (len >= 2 && !(b & 0xc0)) {
+		pd->type = PACKET_STUN;
+	}
+	else {
+		pd->type = PACKET_UNKNOWN;
+	}
+
+	return 0;
+}
+
+
+/* Name and data of an RTCP APP packet, pointing into the buffer  */
+int packet_rtcp_app(const struct mbuf *mb, const uint8_t **namep,
+		    const uint8_t **datap, size_t *lenp)
+{
+	const uint8_t *p;
+	size_t len, plen;
+
+	if (!mb || !namep || !datap || !lenp)
+		return EINVAL;
+
+	p = mbuf_buf(mb);
+	len = mbuf_get_left(mb);
+
+	if (len < RTCP_HDR + 8 || p[1] != RTCP_APP)
+		return EBADMSG;
+
+	plen = get_u16(&p[2]) * 4;
+	if (plen < 8 || len < RTCP_HDR + plen)
+		return EBADMSG;
+
+	*namep = &p[8];
+	*datap = &p[12];
+	*lenp = plen - 8;
+
+	return 0;
+}
+
+
+/* Monotonic, so that latencies do not jump with the wall clock */
+uint64_t packet_usec(void)
+{
+	struct timespec now;
+
+	if (0 != clock_gettime(CLOCK_MONOTONIC, &now))
+		return 0;
+
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+void packet_hist_add(struct packet_hist *hist, uint64_t usec)
+{
+	unsigned i = 0;
+
+	if (!hist)
+		return;
+
+	while (i < PACKET_HIST_BUCKETS - 1 && usec >= (1ULL << i))
+		++i;
+
+	++hist->bucketv[i];
+	++hist->n;
+	hist->sum += usec;
+	if (usec > hist->max)
+		hist->max = (uint32_t)min(usec, (uint64_t)UINT32_MAX);
+}
+
+
+/* Upper bound of the bucket that holds the given fraction  */
+static uint32_t hist_quantile(const struct packet_hist *hist, unsigned pct)
+{
+	uint64_t target = ((uint64_t)hist->n * pct + 99) / 100;
+	uint64_t cnt = 0;
+	unsigned i;
+
+	for (i = 0; i < PACKET_HIST_BUCKETS - 1; i++) {
+		cnt += hist->bucketv[i];
+		if (cnt >= target)
+			return 1U << i;
+	}
+
+	return hist->max;
+}
+
+
+int packet_hist_debug(struct re_printf *pf, const struct packet_hist *hist)
+{
+	unsigned i;
+	int err = 0;
+
+	if (!hist)
+		return 0;
+
+	if (!hist->n)
+		return re_hprintf(pf, "n=0");
+
+	err |= re_hprintf(pf, "n=%u avg=%lluus p50<%uus p99<%uus max=%uus [",
+			  hist->n, hist->sum / hist->n,
+			  hist_quantile(hist, 50), hist_quantile(hist, 99),
+			  hist->max);
+
+	for (i = 0; i < PACKET_HIST_BUCKETS; i++) {
+		err |= re_hprintf(pf, "%s%u", i ? " " : "",
+				  hist->bucketv[i]);
+	}
+
+	err |= re_hprintf(pf, "]");
+
+	return err;
+}
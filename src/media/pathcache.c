@@ -0,0 +1,440 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Path cache
+ *
+ * Remembers, per process, which network paths worked in earlier calls.
+ * There are two kinds of entries, both keyed by the address of the local
+ * interface and the TURN server:
+ *
+ *   TURN entries  - per transport protocol, whether the allocation
+ *                   succeeded and how long it took.
+ *
+ *   Pair entries  - per class of remote peer, the candidate types of
+ *                   the pair that was selected and the ICE setup time.
+ *
+ * Mediaflows look up the cache to check the pair that worked last time
+ * first and to hold back allocations that failed last time. Entries
+ * expire after PATHCACHE_TTL, so a changed network is noticed again.
+ *
+ * Flows on different shards share the cache, it is protected by a mutex.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <re.h>
+#include "avs_media.h"
+
+
+enum {
+	PATHCACHE_TTL = 600000,  /* milliseconds */
+	PATHCACHE_MAX = 64,
+};
+
+
+struct path {
+	struct le le;
+
+	struct sa laddr;            /* address only */
+	struct sa srv;              /* unset if there was no TURN server */
+	int proto;                  /* TURN entries */
+	enum pathcache_peer peer;   /* PATHCACHE_PEER_NONE for TURN */
+
+	bool ok;
+	enum ice_cand_type ltype;
+	enum ice_cand_type rtype;
+	uint32_t rtt;               /* smoothed, milliseconds */
+	uint32_t n_ok;
+	uint32_t n_fail;
+	uint64_t ts;
+};
+
+
+static struct {
+	struct list pathl;          /* least recently updated first */
+	struct pathcache_stats stats;
+	bool disabled;
+	pthread_mutex_t mutex;
+} cache = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+
+static void path_destructor(void *arg)
+{
+	struct path *p = arg;
+
+	list_unlink(&p->le);
+}
+
+
+static bool addr_eq(const struct sa *a, const struct sa *b, int flag)
+{
+	if (!sa_isset(a, SA_ADDR) && !sa_isset(b, SA_ADDR))
+		return true;
+
+	return sa_cmp(a, b, flag);
+}
+
+
+static struct path *find_path(const struct sa *laddr, const struct sa *srv,
+			      int proto, enum pathcache_peer peer)
+{
+	uint64_t now = tmr_jiffies();
+	struct le *le;
+
+	le = cache.pathl.head;
+	while (le) {
+		struct path *p = le->data;
+
+		le = le->next;
+
+		if (now - p->ts > PATHCACHE_TTL) {
+			mem_deref(p);
+			continue;
+		}
+
+		if (p->peer != peer || p->proto != proto)
+			continue;
+
+		if (addr_eq(&p->laddr, laddr, SA_ADDR) &&
+		    addr_eq(&p->srv, srv, SA_ALL))
+			return p;
+	}
+
+	return NULL;
+}
+
+
+static struct path *get_path(const struct sa *laddr, const struct sa *srv,
+			     int proto, enum pathcache_peer peer)
+{
+	struct path *p;
+
+	p = find_path(laddr, srv, proto, peer);
+	if (p) {
+		list_unlink(&p->le);
+		list_append(&cache.pathl, &p->le, p);
+		return p;
+	}
+
+	if (list_count(&cache.pathl) >= PATHCACHE_MAX)
+		mem_deref(list_ledata(cache.pathl.head));
+
+	p = mem_zalloc(sizeof(*p), path_destructor);
+	if (!p)
+		return NULL;
+
+	if (laddr)
+		p->laddr = *laddr;
+	if (srv)
+		p->srv = *srv;
+	p->proto = proto;
+	p->peer = peer;
+
+	list_append(&cache.pathl, &p->le, p);
+
+	return p;
+}
+
+
+static void update_rtt(struct path *p, uint32_t rtt)
+{
+	if (p->n_ok <= 1)
+		p->rtt = rtt;
+	else
+		p->rtt = (p->rtt * 3 + rtt) / 4;
+}
+
+
+void pathcache_enable(bool enabled)
+{
+	pthread_mutex_lock(&cache.mutex);
+	cache.disabled = !enabled;
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+
+bool pathcache_enabled(void)
+{
+	bool enabled;
+
+	pthread_mutex_lock(&cache.mutex);
+	enabled = !cache.disabled;
+	pthread_mutex_unlock(&cache.mutex);
+
+	return enabled;
+}
+
+
+/* Forgets all paths and resets the statistics */
+void pathcache_flush(void)
+{
+	pthread_mutex_lock(&cache.mutex);
+	list_flush(&cache.pathl);
+	memset(&cache.stats, 0, sizeof(cache.stats));
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+
+void pathcache_turn_result(const struct sa *laddr, const struct sa *srv,
+			   int proto, bool ok, uint32_t rtt)
+{
+	struct path *p;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	if (cache.disabled)
+		goto out;
+
+	p = get_path(laddr, srv, proto, PATHCACHE_PEER_NONE);
+	if (!p)
+		goto out;
+
+	p->ok = ok;
+	p->ts = tmr_jiffies();
+
+	if (ok) {
+		++p->n_ok;
+		update_rtt(p, rtt);
+	}
+	else {
+		++p->n_fail;
+	}
+
+ out:
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+
+enum pathcache_state pathcache_turn_state(const struct sa *laddr,
+					  const struct sa *srv, int proto,
+					  uint32_t *rttp)
+{
+	enum pathcache_state state = PATHCACHE_UNKNOWN;
+	struct path *p;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	if (cache.disabled)
+		goto out;
+
+	p = find_path(laddr, srv, proto, PATHCACHE_PEER_NONE);
+	if (!p)
+		goto out;
+
+	state = p->ok ? PATHCACHE_OK : PATHCACHE_DEAD;
+	if (rttp)
+		*rttp = p->rtt;
+
+ out:
+	pthread_mutex_unlock(&cache.mutex);
+
+	return state;
+}
+
+
+void pathcache_pair_result(const struct sa *laddr, const struct sa *srv,
+			   enum pathcache_peer peer,
+			   enum ice_cand_type ltype, enum ice_cand_type rtype,
+			   uint32_t rtt)
+{
+	struct path *p;
+
+	if (peer == PATHCACHE_PEER_NONE)
+		return;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	if (cache.disabled)
+		goto out;
+
+	p = get_path(laddr, srv, 0, peer);
+	if (!p)
+		goto out;
+
+	if (p->n_ok && (p->ltype != ltype || p->rtype != rtype))
+		p->n_ok = 0;
+
+	p->ok = true;
+	p->ltype = ltype;
+	p->rtype = rtype;
+	p->ts = tmr_jiffies();
+	++p->n_ok;
+	update_rtt(p, rtt);
+
+ out:
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+
+int pathcache_pair_lookup(const struct sa *laddr, const struct sa *srv,
+			  enum pathcache_peer peer,
+			  enum ice_cand_type *ltypep, enum ice_cand_type *rtypep,
+			  uint32_t *rttp)
+{
+	struct path *p;
+	int err = 0;
+
+	if (peer == PATHCACHE_PEER_NONE)
+		return EINVAL;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	if (cache.disabled) {
+		err = ENOENT;
+		goto out;
+	}
+
+	p = find_path(laddr, srv, 0, peer);
+	if (!p) {
+		err = ENOENT;
+		goto out;
+	}
+
+	if (ltypep)
+		*ltypep = p->ltype;
+	if (rtypep)
+		*rtypep = p->rtype;
+	if (rttp)
+		*rttp = p->rtt;
+
+ out:
+	pthread_mutex_unlock(&cache.mutex);
+
+	return err;
+}
+
+
+/* Called once per flow when ICE has completed or failed. A negative
+ * setup time means that ICE failed.
+ */
+void pathcache_setup_result(bool hit, int32_t setup_ms)
+{
+	struct pathcache_stats *st = &cache.stats;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	++st->lookups;
+	if (hit)
+		++st->hits;
+
+	if (setup_ms >= 0) {
+		if (hit) {
+			st->setup_hit_ms += setup_ms;
+			++st->n_setup_hit;
+		}
+		else {
+			st->setup_miss_ms += setup_ms;
+			++st->n_setup_miss;
+		}
+	}
+
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+
+void pathcache_deferred(void)
+{
+	pthread_mutex_lock(&cache.mutex);
+	++cache.stats.deferred;
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+
+void pathcache_stats_get(struct pathcache_stats *stats)
+{
+	if (!stats)
+		return;
+
+	pthread_mutex_lock(&cache.mutex);
+	*stats = cache.stats;
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+
+/* Average setup time saved by a hit, negative if hits were slower */
+int32_t pathcache_setup_savings(const struct pathcache_stats *stats)
+{
+	if (!stats || !stats->n_setup_hit || !stats->n_setup_miss)
+		return 0;
+
+	return (int32_t)(stats->setup_miss_ms / stats->n_setup_miss)
+		- (int32_t)(stats->setup_hit_ms / stats->n_setup_hit);
+}
+
+
+const char *pathcache_peer_name(enum pathcache_peer peer)
+{
+	switch (peer) {
+
+	case PATHCACHE_PEER_NONE:  return "none";
+	case PATHCACHE_PEER_LAN:   return "lan";
+	case PATHCACHE_PEER_NAT:   return "nat";
+	case PATHCACHE_PEER_RELAY: return "relay";
+	default:                   return "???";
+	}
+}
+
+
+int pathcache_debug(struct re_printf *pf, void *unused)
+{
+	struct pathcache_stats st;
+	struct le *le;
+	int err = 0;
+	(void)unused;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	st = cache.stats;
+
+	err |= re_hprintf(pf, "path cache: %u paths%s\n",
+			  list_count(&cache.pathl),
+			  cache.disabled ? " (disabled)" : "");
+
+	for (le = cache.pathl.head; le; le = le->next) {
+		const struct path *p = le->data;
+
+		if (p->peer == PATHCACHE_PEER_NONE) {
+			err |= re_hprintf(pf, "  %j -> %J %s: %s"
+					  " (ok=%u fail=%u rtt=%ums)\n",
+					  &p->laddr, &p->srv,
+					  net_proto2name(p->proto),
+					  p->ok ? "ok" : "dead",
+					  p->n_ok, p->n_fail, p->rtt);
+		}
+		else {
+			err |= re_hprintf(pf, "  %j -> %J peer=%s: %s-%s"
+					  " (ok=%u setup=%ums)\n",
+					  &p->laddr, &p->srv,
+					  pathcache_peer_name(p->peer),
+					  ice_cand_type2name(p->ltype),
+					  ice_cand_type2name(p->rtype),
+					  p->n_ok, p->rtt);
+		}
+	}
+
+	pthread_mutex_unlock(&cache.mutex);
+
+	err |= re_hprintf(pf, "  hits: %llu/%llu, deferred: %llu,"
+			  " saved: %dms per hit\n",
+			  st.hits, st.lookups, st.deferred,
+			  pathcache_setup_savings(&st));
+
+	return err;
+}
@@ -59,9 +59,53 @@ enum packet packet_classify_packet_type(const struct mbuf *mb);
 const char *packet_classify_name(enum packet pkt);
 
 
+/* Everything the receive path needs to know about a packet, parsed once.
+ * The RTP header and the first 8 bytes of RTCP are not encrypted, so
+ * this is done before SRTP.
+ */
+struct packet_desc {
+	enum packet type;
+	uint8_t pt;         /* RTP payload type or RTCP packet type */
+	bool marker;
+	uint16_t seq;
+	uint32_t ssrc;
+	size_t hdrlen;      /* RTP header incl. CSRCs and extension */
+};
+
+int packet_parse(struct packet_desc *pd, const struct mbuf *mb);
+int packet_rtcp_app(const struct mbuf *mb, const uint8_t **namep,
+		    const uint8_t **datap, size_t *lenp);
+
+
+/* Latency histogram, bucket i counts samples below 2^i microseconds */
+
+enum {
+	PACKET_HIST_BUCKETS = 16,
+};
+
+struct packet_hist {
+	uint32_t bucketv[PACKET_HIST_BUCKETS];
+	uint32_t n;
+	uint64_t sum;
+	uint32_t max;
+};
+
+uint64_t packet_usec(void);
+void packet_hist_add(struct packet_hist *hist, uint64_t usec);
+int  packet_hist_debug(struct re_printf *pf, const struct packet_hist *hist);
+
+
 /*
  * SDP
  */
 
 int sdp_fingerprint_decode(const char *attr, struct pl *hash,
 			   uint8_t *md, size_t *sz);
+
+
+/*
+ * Media shards
+ */
+
+void mediashard_flow_add(struct mediashard *sh);
+void mediashard_flow_remove(struct mediashard *sh);
@@ -0,0 +1,155 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "avs_mediastats.h"
+#include <math.h>
+#include <string.h>
+
+/* In-band FEC is switched on above FEC_ON_PCT and off below FEC_OFF_PCT.
+ * It only carries the previous packet, so it does little for long bursts.
+ */
+#define FEC_ON_PCT        1.0f
+#define FEC_OFF_PCT       0.5f
+#define FEC_MAX_MBL       4.0f
+
+/* DTX only on clean channels, where it saves bits for free */
+#define DTX_ON_PCT        0.5f
+#define DTX_OFF_PCT       1.0f
+#define DTX_MIN_REPORTS   2
+
+/* Reports between two changes of FEC or DTX */
+#define HOLD_REPORTS      3
+
+/* Concealment above the loss rate comes from packets that were late */
+#define LATE_MARGIN_PCT   2.0f
+
+#define MAX_LOSS_PCT      30
+
+/* Longer packets save header bits under congestion and heavy loss,
+ * as long as FEC recovers most of what is lost.
+ */
+#define LONG_PACKETS_RTT_MS   800
+#define LONG_PACKETS_PCT      10.0f
+#define SHORT_PACKETS_RTT_MS  500
+#define SHORT_PACKETS_PCT     3.0f
+
+#define RISE  0.7f
+#define DECAY 0.2f
+
+
+/* React quickly to loss and forget it slowly, so that FEC is already
+ * on when the next burst comes.
+ */
+static float smooth(float prev, float x)
+{
+	return prev + (x > prev ? RISE : DECAY) * (x - prev);
+}
+
+
+void mediastats_auctl_init(struct auctl *ac)
+{
+	if (!ac)
+		return;
+
+	memset(ac, 0, sizeof(*ac));
+	ac->cur.fec = false;
+	ac->cur.loss_pct = 0;
+	ac->cur.dtx = false;
+	ac->cur.packet_ms = 20;
+	ac->mbl = 1.0f;
+	ac->n_hold = HOLD_REPORTS;
+}
+
+
+bool mediastats_auctl_update(struct auctl *ac, const struct auctl_report *rep)
+{
+	struct auctl_settings s;
+	float loss;
+
+	if (!ac || !rep)
+		return false;
+
+	if (ac->n == 0) {
+		ac->loss = rep->loss_pct;
+		ac->expand = rep->expand_pct;
+	}
+	else {
+		ac->loss = smooth(ac->loss, rep->loss_pct);
+		ac->expand = smooth(ac->expand, rep->expand_pct);
+	}
+
+	/* Burst length is only defined when something was lost */
+	if (rep->loss_pct > 0.0f && rep->mbl >= 1.0f)
+		ac->mbl = 0.7f * ac->mbl + 0.3f * rep->mbl;
+
+	ac->n++;
+	ac->n_hold++;
+
+	s = ac->cur;
+
+	loss = ac->loss;
+	if (ac->expand > loss + LATE_MARGIN_PCT)
+		loss += (ac->expand - loss) / 2;
+
+	s.loss_pct = (int)lroundf(loss);
+	if (s.loss_pct > MAX_LOSS_PCT)
+		s.loss_pct = MAX_LOSS_PCT;
+
+	if (ac->mbl > FEC_MAX_MBL)
+		s.fec = false;
+	else if (s.fec)
+		s.fec = loss >= FEC_OFF_PCT;
+	else
+		s.fec = loss >= FEC_ON_PCT;
+
+	if (!ac->dtx_allowed) {
+		s.dtx = false;
+	}
+	else if (s.dtx) {
+		s.dtx = loss < DTX_OFF_PCT && ac->expand < DTX_OFF_PCT;
+	}
+	else {
+		s.dtx = ac->n >= DTX_MIN_REPORTS
+			&& loss < DTX_ON_PCT && ac->expand < DTX_ON_PCT;
+	}
+
+	if (s.fec != ac->cur.fec || s.dtx != ac->cur.dtx) {
+		if (ac->n_hold < HOLD_REPORTS) {
+			s.fec = ac->cur.fec;
+			s.dtx = ac->cur.dtx;
+		}
+		else {
+			ac->n_hold = 0;
+		}
+	}
+
+	if (rep->rtt_ms > LONG_PACKETS_RTT_MS
+	    || (loss > LONG_PACKETS_PCT && s.fec))
+		s.packet_ms = 40;
+	else if (rep->rtt_ms < SHORT_PACKETS_RTT_MS
+		 && loss < SHORT_PACKETS_PCT)
+		s.packet_ms = 20;
+
+	if (s.fec == ac->cur.fec && s.loss_pct == ac->cur.loss_pct
+	    && s.dtx == ac->cur.dtx && s.packet_ms == ac->cur.packet_ms)
+		return false;
+
+	ac->cur = s;
+
+	return true;
+}
@@ -25,7 +25,7 @@
 
 static int cmpfunc (const void * a, const void * b)
 {
-	return ( *(int*)a - *(int*)b );
+	return ( (int)*(const uint16_t*)a - (int)*(const uint16_t*)b );
 }
 
 static uint8_t get_pt(const uint8_t *pkt, size_t len)
@@ -97,7 +97,7 @@ static void calculate_loss_and_mbl(struct rtp_stats* rs, float *loss, float *mbl
 	if(packet_cnt > MAX_PACKETS){
 		packet_cnt = MAX_PACKETS;
 	}
-	qsort(rs->seq_nr_buf, packet_cnt, sizeof(int), cmpfunc);
+	qsort(rs->seq_nr_buf, packet_cnt, sizeof(rs->seq_nr_buf[0]), cmpfunc);
 	int loss_cnt = 0;
 	int loss_period_cnt = 0;
 	int16_t diff, tmp;
@@ -123,6 +123,9 @@ void mediastats_rtp_stats_update(struct rtp_stats* rs, const uint8_t *pkt, size_
 	uint32_t bw_alloc_bps)
 {
 	// lock ??
+	if (!rs)
+		return;
+
 	if ((get_pt(pkt, len) & 0x7f) != rs->pt) {
 		return;
 	}
@@ -3,4 +3,5 @@
 #
 
 AVS_SRCS += \
+	mediastats/auctl.c \
 	mediastats/mediastats.c
@@ -34,13 +34,23 @@ struct msystem {
 	bool loopback;
 	bool privacy;
 	bool cbr;
+	bool hd_video;
 	char ifname[256];
+	struct turnpool *turnpool;
 
 	struct list aucodecl;
 	struct list vidcodecl;
 };
 
 
+/* SRTP profiles in order of preference. AES-GCM does encryption and
+ * authentication in one pass (RFC 7714).
+ */
+#define SRTP_PROFILES "SRTP_AES128_CM_SHA1_80"
+#define SRTP_PROFILES_GCM \
+	"SRTP_AEAD_AES_128_GCM:SRTP_AEAD_AES_256_GCM:" SRTP_PROFILES
+
+
 static const char *cipherv[] = {
 
 	"ECDHE-RSA-AES128-GCM-SHA256",
@@ -67,6 +77,10 @@ static const char *cipherv[] = {
 
 };
 
+/* TURN allocations kept ready for the next call */
+#define TURNPOOL_SIZE 1
+
+
 static struct msystem *g_msys = NULL;
 
 
@@ -85,6 +99,7 @@ static void msystem_destructor(void *data)
 
 	tmr_cancel(&msys->vol_tmr);
 
+	msys->turnpool = mem_deref(msys->turnpool);
 	msys->mq = mem_deref(msys->mq);
 	msys->dtls = mem_deref(msys->dtls);
 	msys->name = mem_deref(msys->name);
@@ -100,6 +115,21 @@ static void msystem_destructor(void *data)
 
 
 /* This is just a dummy handler fo waking up re_main() */
+/* Not every AES backend has GCM, e.g. Apple CommonCrypto */
+static bool aes_has_gcm(void)
+{
+	static const uint8_t key[16];
+	struct aes *aes;
+
+	if (aes_alloc(&aes, AES_MODE_GCM, key, 8 * sizeof(key), NULL))
+		return false;
+
+	mem_deref(aes);
+
+	return true;
+}
+
+
 static void wakeup_handler(int id, void *data, void *arg)
 {
 	(void)id;
@@ -177,7 +207,28 @@ static int msystem_init(struct msystem **msysp, const char *msysname,
 
 	tls_set_verify_client(msys->dtls);
 
-	err = tls_set_srtp(msys->dtls, "SRTP_AES128_CM_SHA1_80");
+	/* so that a restarted call can resume the DTLS session */
+	err = tls_set_session_reuse(msys->dtls, true);
+	if (err) {
+		warning("flowmgr: failed to enable DTLS session reuse (%m)\n",
+			err);
+		goto out;
+	}
+
+	/* AES-GCM first, if both SRTP and the TLS library can do it */
+	if (aes_has_gcm()) {
+		err = tls_set_srtp(msys->dtls, SRTP_PROFILES_GCM);
+		if (err) {
+			info("flowmgr: no AES-GCM SRTP profiles (%m)\n",
+			     err);
+		}
+	}
+	else {
+		info("flowmgr: AES-GCM not supported by the AES backend\n");
+		err = ENOTSUP;
+	}
+	if (err)
+		err = tls_set_srtp(msys->dtls, SRTP_PROFILES);
 	if (err) {
 		warning("flowmgr: failed to enable SRTP profile (%m)\n",
 			err);
@@ -364,6 +415,21 @@ bool msystem_have_cbr(const struct msystem *msys)
 	return msys ? voe_have_cbr() : false;
 }
 
+void msystem_enable_hd_video(struct msystem *msys, bool enable)
+{
+	if (!msys)
+		return;
+
+	vie_enable_hd(enable);
+
+	msys->hd_video = enable;
+}
+
+bool msystem_have_hd_video(const struct msystem *msys)
+{
+	return msys ? msys->hd_video : false;
+}
+
 void msystem_set_ifname(struct msystem *msys, const char *ifname)
 {
 	if (!msys)
@@ -408,6 +474,31 @@ bool msystem_have_datachannel(const struct msystem *msys)
 }
 
 
+/* Must be called from the thread that runs the calls */
+int msystem_enable_turnpool(struct msystem *msys, bool enable)
+{
+	if (!msys)
+		return EINVAL;
+
+	if (!enable) {
+		msys->turnpool = mem_deref(msys->turnpool);
+		return 0;
+	}
+
+	if (msys->turnpool)
+		return 0;
+
+	return mediaflow_turnpool_alloc(&msys->turnpool, TURNPOOL_SIZE,
+					AF_INET);
+}
+
+
+struct turnpool *msystem_turnpool(const struct msystem *msys)
+{
+	return msys ? msys->turnpool : NULL;
+}
+
+
 int msystem_set_call_config(struct msystem *msys, struct call_config *cfg)
 {
 	if (!msys || !cfg)
@@ -2,6 +2,13 @@
 #include "avs_protobuf.h"
 
 
+enum {
+	ARENA_ALIGN        = 8,
+	ARENA_DEFAULT_SIZE = 1024,
+	ARENA_MAX_SIZE     = 65536,  /* the buffer does not grow beyond */
+};
+
+
 static void *allocator_alloc(void *allocator_data, size_t size)
 {
 	return mem_alloc(size, NULL);
@@ -30,3 +37,145 @@ void generic_message_free(GenericMessage *msg)
 {
 	generic_message__free_unpacked(msg, &allocator);
 }
+
+
+/*
+ * Arena for decoding -- every field of a message is taken from one
+ * buffer by bumping a pointer, and all of it is freed at once.
+ * What does not fit goes into separate allocations, and the buffer
+ * is made large enough for them on the next reset.
+ */
+
+struct protobuf_arena {
+	uint8_t *buf;
+	size_t size;
+	size_t pos;
+	size_t spill;        /* bytes that did not fit into buf */
+	struct list spilll;  /* struct spill */
+	struct ProtobufCAllocator allocator;
+};
+
+struct spill {
+	struct le le;
+};
+
+
+static void *arena_alloc(void *allocator_data, size_t size)
+{
+	struct protobuf_arena *arena = allocator_data;
+	struct spill *sp;
+	void *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (size <= arena->size - arena->pos) {
+		p = arena->buf + arena->pos;
+		arena->pos += size;
+		return p;
+	}
+
+	sp = mem_alloc(sizeof(*sp) + size, NULL);
+	if (!sp)
+		return NULL;
+
+	sp->le = (struct le)LE_INIT;
+	list_append(&arena->spilll, &sp->le, sp);
+	arena->spill += size;
+
+	return sp + 1;
+}
+
+
+/* nothing is freed until the arena is reset */
+static void arena_free(void *allocator_data, void *pointer)
+{
+	(void)allocator_data;
+	(void)pointer;
+}
+
+
+static void arena_destructor(void *data)
+{
+	struct protobuf_arena *arena = data;
+
+	list_flush(&arena->spilll);
+	mem_deref(arena->buf);
+}
+
+
+int protobuf_arena_alloc(struct protobuf_arena **arenap, size_t size)
+{
+	struct protobuf_arena *arena;
+
+	if (!arenap)
+		return EINVAL;
+
+	if (!size)
+		size = ARENA_DEFAULT_SIZE;
+
+	arena = mem_zalloc(sizeof(*arena), arena_destructor);
+	if (!arena)
+		return ENOMEM;
+
+	arena->buf = mem_alloc(size, NULL);
+	if (!arena->buf) {
+		mem_deref(arena);
+		return ENOMEM;
+	}
+
+	arena->size = size;
+	arena->allocator.alloc = arena_alloc;
+	arena->allocator.free = arena_free;
+	arena->allocator.allocator_data = arena;
+
+	*arenap = arena;
+
+	return 0;
+}
+
+
+/* Frees all messages that were decoded into the arena */
+void protobuf_arena_reset(struct protobuf_arena *arena)
+{
+	size_t need;
+	uint8_t *buf;
+
+	if (!arena)
+		return;
+
+	need = arena->pos + arena->spill;
+
+	list_flush(&arena->spilll);
+
+	if (arena->spill && need <= ARENA_MAX_SIZE) {
+
+		buf = mem_alloc(need, NULL);
+		if (buf) {
+			mem_deref(arena->buf);
+			arena->buf = buf;
+			arena->size = need;
+		}
+	}
+
+	arena->pos = 0;
+	arena->spill = 0;
+}
+
+
+size_t protobuf_arena_used(const struct protobuf_arena *arena)
+{
+	return arena ? arena->pos + arena->spill : 0;
+}
+
+
+/* The message lives until the arena is reset or freed, and must not
+ * be passed to generic_message_free().
+ */
+GenericMessage *generic_message_decode_arena(struct protobuf_arena *arena,
+					     size_t len, const uint8_t *data)
+{
+	if (!arena)
+		return NULL;
+
+	return generic_message__unpack(&arena->allocator, len, data);
+}
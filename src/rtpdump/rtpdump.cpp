@@ -34,16 +34,9 @@
 
 #include <assert.h>
 #include <stdio.h>
-#include <limits>
-
-#if defined(_WIN32)
-#include <Windows.h>
-#include <mmsystem.h>
-#else
 #include <string.h>
+#include <unistd.h>
 #include <sys/time.h>
-#include <time.h>
-#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -54,88 +47,151 @@ extern "C" {
 #endif
 
 namespace wire_avs {
-const char RTPFILE_VERSION[] = "1.0";
-const uint32_t MAX_UWORD32 = 0xffffffff;
 
-// This stucture is specified in the rtpdump documentation.
-// This struct corresponds to RD_packet_t in
-// http://www.cs.columbia.edu/irt/software/rtptools/
-typedef struct
+enum {
+	RING_SIZE = 256,	// power of 2
+	MAX_SNAPLEN = 1536,
+	POLL_INTERVAL_US = 10000,
+	FILE_BUFFER_SIZE = 65536,
+	IP_UDP_HDR_SIZE = 28,
+};
+
+// pcapng block types and options
+enum {
+	PCAPNG_SHB = 0x0A0D0D0A,
+	PCAPNG_IDB = 0x00000001,
+	PCAPNG_EPB = 0x00000006,
+	PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D,
+	PCAPNG_OPT_END = 0,
+	PCAPNG_OPT_SHB_USERAPPL = 4,
+	PCAPNG_OPT_IF_NAME = 2,
+	LINKTYPE_RAW = 101,
+	UDP_PORT_BASE = 10000,
+};
+
+// One captured packet. seq tells who owns the slot, see DumpPacket().
+struct RtpDump::Slot
 {
-	// Length of packet, including this header (may be smaller than plen if not
-	// whole packet recorded).
-	uint16_t length;
-	// Actual header+payload length for RTP, 0 for RTCP.
-	uint16_t plen;
-	// Milliseconds since the start of recording.
-	uint32_t offset;
-} RtpDumpPacketHeader;
+	uint64_t seq;
+	uint64_t time;
+	uint32_t length;
+	uint32_t capLength;
+	uint8_t data[MAX_SNAPLEN];
+};
+
+static size_t put_opt(uint8_t* p, uint16_t code, const char* str)
+{
+	uint16_t len = (uint16_t)strlen(str);
+	size_t padded = (len + 3) & ~3;
+
+	memcpy(p, &code, 2);
+	memcpy(p + 2, &len, 2);
+	memset(p + 4, 0, padded);
+	memcpy(p + 4, str, len);
+
+	return 4 + padded;
+}
+
+static size_t put_end(uint8_t* p)
+{
+	memset(p, 0, 4);
+
+	return 4;
+}
 
 RtpDump::RtpDump()
 {
 	pthread_mutex_init(&_mutex,NULL);
+	_running = false;
+	_active = 0;
+	_enqPos = 0;
+	_dropped = 0;
+	_ring = NULL;
+	_snapLen = MAX_SNAPLEN;
 	_file = NULL;
-	_startTime = 0;
+	_deqPos = 0;
+	_writeError = false;
+	_numFlows = 0;
 }
 
 RtpDump::~RtpDump()
 {
+	Stop();
 	pthread_mutex_destroy(&_mutex);
-	if(_file){
-		fclose(_file);
-	}
+	delete[] _ring;
 }
 
-int32_t RtpDump::Start(const char* fileNameUTF8)
+int32_t RtpDump::Start(const char* fileNameUTF8, size_t snapLen)
 {
+	int err;
+
 	if (fileNameUTF8 == NULL){
 		return -1;
 	}
 
+	Stop();
+
 	pthread_mutex_lock(&_mutex);
-	if(_file){
-		fclose(_file);
+	if (!_ring){
+		_ring = new Slot[RING_SIZE];
+		for (uint64_t i = 0; i < RING_SIZE; i++){
+			_ring[i].seq = i;
+		}
 	}
+
 	_file = fopen(fileNameUTF8, "wb");
 	if (!_file) {
 		error("rtpdump: Failed to open file.\n");
 		pthread_mutex_unlock(&_mutex);
 		return -1;
 	}
+	setvbuf(_file, NULL, _IOFBF, FILE_BUFFER_SIZE);
 
-	// Store start of RTP dump (to be used for offset calculation later).
-	_startTime = GetTimeInMS();
-
-	// All rtp dump files start with #!rtpplay.
-	char magic[14+1] = "";
-	snprintf(magic, sizeof(magic), "#!rtpplay%s \n", RTPFILE_VERSION);
-	if (fwrite(magic, sizeof(magic)-1, 1, _file) != 1){
+	_numFlows = 0;
+	_writeError = false;
+	if (WriteSectionHeader() != 0){
 		error("rtpdump: Error writing to file. \n");
-		pthread_mutex_unlock(&_mutex);
-		return -1;
+		goto out;
 	}
 
-	// The header according to the rtpdump documentation is sizeof(RD_hdr_t)
-	// which is 8 + 4 + 2 = 14 bytes for 32-bit architecture (and 22 bytes on
-	// 64-bit architecture). However, Wireshark use 16 bytes for the header
-	// regardless of if the binary is 32-bit or 64-bit. Go by the same approach
-	// as Wireshark since it makes more sense.
-	// http://wiki.wireshark.org/rtpdump explains that an additional 2 bytes
-	// of padding should be added to the header.
-	char dummyHdr[16];
-	memset(dummyHdr, 0, sizeof(dummyHdr));
-	if (fwrite(dummyHdr, sizeof(dummyHdr), 1, _file) != 1){
-		error("rtpdump: Error writing to file. \n");
-		pthread_mutex_unlock(&_mutex);
-		return -1;
+	_snapLen = (snapLen && snapLen < MAX_SNAPLEN) ? snapLen : (size_t)MAX_SNAPLEN;
+	__atomic_store_n(&_dropped, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&_active, 1, __ATOMIC_RELEASE);
+
+	err = pthread_create(&_thread, NULL, WriterThread, this);
+	if (err){
+		error("rtpdump: Failed to start writer thread.\n");
+		__atomic_store_n(&_active, 0, __ATOMIC_RELEASE);
+		goto out;
 	}
+	_running = true;
+
 	pthread_mutex_unlock(&_mutex);
 	return 0;
+
+ out:
+	fclose(_file);
+	_file = NULL;
+	pthread_mutex_unlock(&_mutex);
+	return -1;
 }
 
 int32_t RtpDump::Stop()
 {
+	uint32_t dropped;
+
 	pthread_mutex_lock(&_mutex);
+	if (_running){
+		// The writer drains the ring before it exits
+		__atomic_store_n(&_active, 0, __ATOMIC_RELEASE);
+		pthread_join(_thread, NULL);
+		_running = false;
+
+		dropped = Dropped();
+		if (dropped){
+			info("rtpdump: %u packets dropped\n", dropped);
+		}
+	}
 	if(_file){
 		fclose(_file);
 		_file = NULL;
@@ -146,69 +202,261 @@ int32_t RtpDump::Stop()
 
 bool RtpDump::IsActive() const
 {
-	bool file_opened = false;
-	if(_file){
-		file_opened = true;
-	}
-	return file_opened;
+	return __atomic_load_n(&_active, __ATOMIC_ACQUIRE) != 0;
 }
 
+uint32_t RtpDump::Dropped() const
+{
+	return __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+}
+
+// Bounded multi-producer queue: a slot is free for the producer at
+// position pos when its seq equals pos, and holds a packet for the
+// writer when its seq equals pos + 1.
 int32_t RtpDump::DumpPacket(const uint8_t* packet, size_t packetLength)
 {
-	pthread_mutex_lock(&_mutex);
+	uint64_t pos;
+	Slot* slot;
+
 	if (!IsActive()){
-		pthread_mutex_unlock(&_mutex);
 		return 0;
 	}
 
-	if (packet == NULL){
-		pthread_mutex_unlock(&_mutex);
+	if (packet == NULL || packetLength < 1){
 		return -1;
 	}
 
-	RtpDumpPacketHeader hdr;
-	size_t total_size = packetLength + sizeof hdr;
-	if (packetLength < 1 || total_size > std::numeric_limits<uint16_t>::max()){
-		pthread_mutex_unlock(&_mutex);
-		return -1;
+	pos = __atomic_load_n(&_enqPos, __ATOMIC_RELAXED);
+	for (;;){
+		slot = &_ring[pos & (RING_SIZE - 1)];
+		uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		int64_t dif = (int64_t)(seq - pos);
+
+		if (dif == 0){
+			if (__atomic_compare_exchange_n(&_enqPos, &pos, pos + 1,
+							true,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED)){
+				break;
+			}
+		}
+		else if (dif < 0){
+			// Full, the writer is behind
+			__atomic_add_fetch(&_dropped, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+		else{
+			pos = __atomic_load_n(&_enqPos, __ATOMIC_RELAXED);
+		}
 	}
 
-	// If the packet doesn't contain a valid RTCP header the packet will be
-	// considered RTP (without further verification).
-	bool isRTCP = RTCP(packet);
-
-	// Offset is relative to when recording was started.
-	uint32_t offset = GetTimeInMS();
-	if (offset < _startTime){
-		// Compensate for wraparound.
-		offset += MAX_UWORD32 - _startTime + 1;
-	} else {
-		offset -= _startTime;
+	slot->time = GetTimeInUS();
+	slot->length = (uint32_t)packetLength;
+	slot->capLength = (uint32_t)(packetLength < _snapLen ?
+				     packetLength : _snapLen);
+	memcpy(slot->data, packet, slot->capLength);
+
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void* RtpDump::WriterThread(void* arg)
+{
+	RtpDump* dump = static_cast<RtpDump*>(arg);
+
+	dump->WriterLoop();
+
+	return NULL;
+}
+
+void RtpDump::WriterLoop()
+{
+	for (;;){
+		bool active = IsActive();
+		int n = 0;
+
+		while (WriteNext()){
+			++n;
+		}
+
+		if (!active){
+			break;
+		}
+
+		if (n){
+			fflush(_file);
+		}
+		else{
+			usleep(POLL_INTERVAL_US);
+		}
 	}
-	hdr.offset = RtpDumpHtonl(offset);
+}
 
-	hdr.length = RtpDumpHtons((uint16_t)(total_size));
-	if (isRTCP){
-		hdr.plen = 0;
-	} else{
-		hdr.plen = RtpDumpHtons((uint16_t)packetLength);
+bool RtpDump::WriteNext()
+{
+	Slot* slot = &_ring[_deqPos & (RING_SIZE - 1)];
+	uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+	if (seq != _deqPos + 1){
+		return false;
 	}
 
-	if (fwrite(&hdr, 1, sizeof(hdr), _file) == -1){
+	if (!_writeError && WritePacket(slot) != 0){
 		error("rtpdump: Error writing to file.\n");
-		pthread_mutex_unlock(&_mutex);
-		return -1;
+		_writeError = true;
 	}
-	if (fwrite(packet, sizeof(uint8_t), packetLength, _file) == -1){
-		error("rtpdump: Error writing to file. \n");
-		pthread_mutex_unlock(&_mutex);
+
+	__atomic_store_n(&slot->seq, _deqPos + RING_SIZE, __ATOMIC_RELEASE);
+	++_deqPos;
+
+	return true;
+}
+
+int RtpDump::WriteBlock(uint32_t type, const uint8_t* body, size_t len)
+{
+	static const uint8_t pad[4] = {0, 0, 0, 0};
+	size_t padLen = (4 - (len & 3)) & 3;
+	uint32_t total = (uint32_t)(12 + len + padLen);
+
+	if (fwrite(&type, sizeof(type), 1, _file) != 1
+	    || fwrite(&total, sizeof(total), 1, _file) != 1
+	    || fwrite(body, 1, len, _file) != len
+	    || fwrite(pad, 1, padLen, _file) != padLen
+	    || fwrite(&total, sizeof(total), 1, _file) != 1){
 		return -1;
 	}
 
-	pthread_mutex_unlock(&_mutex);
 	return 0;
 }
 
+int RtpDump::WriteSectionHeader()
+{
+	uint8_t body[64];
+	uint32_t magic = PCAPNG_BYTE_ORDER_MAGIC;
+	uint16_t major = 1, minor = 0;
+	int64_t sectionLength = -1;
+	size_t len = 0;
+
+	memcpy(&body[len], &magic, 4); len += 4;
+	memcpy(&body[len], &major, 2); len += 2;
+	memcpy(&body[len], &minor, 2); len += 2;
+	memcpy(&body[len], &sectionLength, 8); len += 8;
+	len += put_opt(&body[len], PCAPNG_OPT_SHB_USERAPPL, "avs");
+	len += put_end(&body[len]);
+
+	return WriteBlock(PCAPNG_SHB, body, len);
+}
+
+int RtpDump::WriteInterface(uint32_t ssrc, bool isRTCP)
+{
+	uint8_t body[64];
+	char name[32];
+	uint16_t linkType = LINKTYPE_RAW, reserved = 0;
+	uint32_t snapLen = 0;
+	size_t len = 0;
+
+	snprintf(name, sizeof(name), "%s ssrc 0x%08x",
+		 isRTCP ? "rtcp" : "rtp", ssrc);
+
+	memcpy(&body[len], &linkType, 2); len += 2;
+	memcpy(&body[len], &reserved, 2); len += 2;
+	memcpy(&body[len], &snapLen, 4); len += 4;
+	len += put_opt(&body[len], PCAPNG_OPT_IF_NAME, name);
+	len += put_end(&body[len]);
+
+	return WriteBlock(PCAPNG_IDB, body, len);
+}
+
+// Returns the interface of the packet's flow, adding it on first use.
+// When there are too many flows, the rest share the last interface.
+int RtpDump::FlowInterface(const Slot* slot, bool isRTCP)
+{
+	const uint8_t* p = slot->data;
+	size_t off = isRTCP ? 4 : 8;
+	uint32_t ssrc = 0;
+
+	if (slot->capLength >= off + 4){
+		ssrc = (uint32_t)p[off] << 24 | (uint32_t)p[off+1] << 16
+			| (uint32_t)p[off+2] << 8 | (uint32_t)p[off+3];
+	}
+
+	for (int i = 0; i < _numFlows; i++){
+		if (_flows[i].ssrc == ssrc && _flows[i].isRTCP == isRTCP){
+			return i;
+		}
+	}
+
+	if (_numFlows == MAX_FLOWS){
+		return MAX_FLOWS - 1;
+	}
+
+	if (WriteInterface(ssrc, isRTCP) != 0){
+		return -1;
+	}
+
+	_flows[_numFlows].ssrc = ssrc;
+	_flows[_numFlows].isRTCP = isRTCP;
+
+	return _numFlows++;
+}
+
+int RtpDump::WritePacket(const Slot* slot)
+{
+	uint8_t body[20 + IP_UDP_HDR_SIZE + MAX_SNAPLEN];
+	uint8_t* ip = &body[20];
+	uint8_t* udp = &ip[20];
+	bool isRTCP = slot->capLength >= 2 && RTCP(slot->data);
+	uint32_t origLength = slot->length + IP_UDP_HDR_SIZE;
+	uint32_t capLength = slot->capLength + IP_UDP_HDR_SIZE;
+	uint32_t tsHigh = (uint32_t)(slot->time >> 32);
+	uint32_t tsLow = (uint32_t)slot->time;
+	uint32_t sum = 0;
+	uint16_t v;
+	int ifIndex;
+
+	ifIndex = FlowInterface(slot, isRTCP);
+	if (ifIndex < 0){
+		return -1;
+	}
+
+	memcpy(&body[0], &ifIndex, 4);
+	memcpy(&body[4], &tsHigh, 4);
+	memcpy(&body[8], &tsLow, 4);
+	memcpy(&body[12], &capLength, 4);
+	memcpy(&body[16], &origLength, 4);
+
+	// IPv4 10.0.0.1 -> 10.0.0.2
+	memset(ip, 0, 20);
+	ip[0] = 0x45;
+	v = RtpDumpHtons((uint16_t)(origLength > 0xffff ? 0xffff : origLength));
+	memcpy(&ip[2], &v, 2);
+	ip[8] = 64;
+	ip[9] = 17;
+	ip[12] = 10; ip[15] = 1;
+	ip[16] = 10; ip[19] = 2;
+	for (int i = 0; i < 20; i += 2){
+		sum += (uint32_t)ip[i] << 8 | ip[i+1];
+	}
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	v = RtpDumpHtons((uint16_t)~sum);
+	memcpy(&ip[10], &v, 2);
+
+	// UDP, one port per flow, without checksum
+	v = RtpDumpHtons((uint16_t)(UDP_PORT_BASE + 2 * ifIndex + isRTCP));
+	memcpy(&udp[0], &v, 2);
+	memcpy(&udp[2], &v, 2);
+	v = RtpDumpHtons((uint16_t)(8 + (slot->length > 0xfff7 ?
+					 0xfff7 : slot->length)));
+	memcpy(&udp[4], &v, 2);
+	memset(&udp[6], 0, 2);
+
+	memcpy(&udp[8], slot->data, slot->capLength);
+
+	return WriteBlock(PCAPNG_EPB, body, 20 + capLength);
+}
+
 bool RtpDump::RTCP(const uint8_t* packet) const
 {
 	const uint8_t payloadType = packet[1];
@@ -229,25 +477,12 @@ bool RtpDump::RTCP(const uint8_t* packet) const
 	return is_rtcp;
 }
 
-inline uint32_t RtpDump::GetTimeInMS() const
+inline uint64_t RtpDump::GetTimeInUS() const
 {
-#if defined(_WIN32)
-    return timeGetTime();
-#else
     struct timeval tv;
-    struct timezone tz;
-    unsigned long val;
 
-    gettimeofday(&tv, &tz);
-    val = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-    return val;
-#endif
-}
-
-inline uint32_t RtpDump::RtpDumpHtonl(uint32_t x) const
-{
-    return (x >> 24) + ((((x >> 16) & 0xFF) << 8) + ((((x >> 8) & 0xFF) << 16) +
-                                                     ((x & 0xFF) << 24)));
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
 inline uint16_t RtpDump::RtpDumpHtons(uint16_t x) const
@@ -0,0 +1,262 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* TURN over TCP framing
+ *
+ * STUN messages and ChannelData frames arrive on the TCP stream without
+ * regard to segment boundaries. Frames that are complete within a
+ * segment are handed over in place, as a window of the received mbuf.
+ * Only a frame that spans segments is copied, into a buffer that is
+ * allocated once with room for the largest possible frame. The buffer
+ * holds at most one frame, so it is never grown or shifted.
+ */
+
+#include <string.h>
+#include <re.h>
+#include "avs_turn.h"
+
+
+enum {
+	FRAME_HDR_SIZE = 4,
+
+	/* largest STUN message or ChannelData frame, padded */
+	FRAMER_SIZE = STUN_HEADER_SIZE + 0xffff + 3,
+};
+
+
+struct turn_framer {
+	struct mbuf *buf;          /* start of a frame that spans segments */
+	turn_framer_frame_h *frameh;
+	void *arg;
+
+	struct turn_framer_stats stats;
+};
+
+
+static void destructor(void *arg)
+{
+	struct turn_framer *tf = arg;
+
+	mem_deref(tf->buf);
+}
+
+
+int turn_framer_alloc(struct turn_framer **tfp,
+		      turn_framer_frame_h *frameh, void *arg)
+{
+	struct turn_framer *tf;
+
+	if (!tfp || !frameh)
+		return EINVAL;
+
+	tf = mem_zalloc(sizeof(*tf), destructor);
+	if (!tf)
+		return ENOMEM;
+
+	tf->frameh = frameh;
+	tf->arg = arg;
+
+	*tfp = tf;
+
+	return 0;
+}
+
+
+/* The frame handler may destroy the owner of the framer, so the owner
+ * must close it instead of just dereferencing it.
+ */
+void turn_framer_close(struct turn_framer *tf)
+{
+	if (!tf)
+		return;
+
+	tf->frameh = NULL;
+	mem_deref(tf);
+}
+
+
+/* Length of the frame without padding */
+static int frame_len(size_t *lenp, const uint8_t *p)
+{
+	uint16_t typ = (p[0] << 8) | p[1];
+	size_t len = (p[2] << 8) | p[3];
+
+	if (typ < 0x4000)
+		len += STUN_HEADER_SIZE;
+	else if (typ < 0x8000)
+		len += FRAME_HDR_SIZE;
+	else
+		return EBADMSG;
+
+	*lenp = len;
+
+	return 0;
+}
+
+
+static inline size_t padded(size_t len)
+{
+	return (len + 3) & ~(size_t)3;
+}
+
+
+static int deliver(struct turn_framer *tf, struct mbuf *mb,
+		   size_t pos, size_t len)
+{
+	size_t end = mb->end;
+	int err;
+
+	mb->pos = pos;
+	mb->end = pos + len;
+
+	++tf->stats.frames;
+	err = tf->frameh(mb, tf->arg);
+
+	mb->end = end;
+
+	return err;
+}
+
+
+static void buffer_write(struct turn_framer *tf, struct mbuf *mb, size_t n)
+{
+	memcpy(tf->buf->buf + tf->buf->end, mbuf_buf(mb), n);
+	tf->buf->end += n;
+	mb->pos += n;
+
+	tf->stats.copied += n;
+}
+
+
+/* Completes the buffered frame from the segment, if it is long enough */
+static int complete_frame(struct turn_framer *tf, struct mbuf *mb)
+{
+	struct mbuf *buf = tf->buf;
+	size_t len, n;
+	int err;
+
+	if (buf->end < FRAME_HDR_SIZE) {
+		n = min(FRAME_HDR_SIZE - buf->end, mbuf_get_left(mb));
+		buffer_write(tf, mb, n);
+
+		if (buf->end < FRAME_HDR_SIZE)
+			return 0;
+	}
+
+	err = frame_len(&len, buf->buf);
+	if (err)
+		return err;
+
+	n = min(padded(len) - buf->end, mbuf_get_left(mb));
+	buffer_write(tf, mb, n);
+
+	if (buf->end < padded(len))
+		return 0;
+
+	err = deliver(tf, buf, 0, len);
+
+	buf->pos = 0;
+	buf->end = 0;
+
+	return err;
+}
+
+
+int turn_framer_recv(struct turn_framer *tf, struct mbuf *mb)
+{
+	size_t pos, end;
+	int err = 0;
+
+	if (!tf || !mb)
+		return EINVAL;
+
+	mem_ref(tf);
+
+	tf->stats.bytes += mbuf_get_left(mb);
+
+	if (tf->buf && tf->buf->end) {
+
+		err = complete_frame(tf, mb);
+		if (err || tf->buf->end)
+			goto out;
+	}
+
+	pos = mb->pos;
+	end = mb->end;
+
+	while (tf->frameh && end - pos >= FRAME_HDR_SIZE) {
+
+		size_t len;
+
+		err = frame_len(&len, mb->buf + pos);
+		if (err)
+			goto out;
+
+		if (end - pos < padded(len))
+			break;
+
+		err = deliver(tf, mb, pos, len);
+		if (err)
+			goto out;
+
+		pos += padded(len);
+	}
+
+	mb->pos = pos;
+
+	/* keep the start of the next frame */
+	if (tf->frameh && pos < end) {
+
+		if (!tf->buf) {
+			tf->buf = mbuf_alloc(FRAMER_SIZE);
+			if (!tf->buf) {
+				err = ENOMEM;
+				goto out;
+			}
+		}
+
+		buffer_write(tf, mb, end - pos);
+	}
+
+ out:
+	mem_deref(tf);
+
+	return err;
+}
+
+
+void turn_framer_reset(struct turn_framer *tf)
+{
+	if (!tf || !tf->buf)
+		return;
+
+	tf->buf->pos = 0;
+	tf->buf->end = 0;
+}
+
+
+size_t turn_framer_pending(const struct turn_framer *tf)
+{
+	return (tf && tf->buf) ? tf->buf->end : 0;
+}
+
+
+const struct turn_framer_stats *turn_framer_stats(const struct turn_framer *tf)
+{
+	return tf ? &tf->stats : NULL;
+}
@@ -1,5 +1,7 @@
 
 
 AVS_SRCS += \
+	turn/framer.c \
 	turn/turnconn.c \
+	turn/turnpool.c \
 	turn/uri.c
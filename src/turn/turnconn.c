@@ -25,6 +25,8 @@
 
 enum {
 	TURNPING_INTERVAL = 15,  /* seconds, must be less than 29 */
+	TCP_BATCH_SIZE = 16384,
+	LAYER_BATCH = 1,         /* above TLS */
 };
 
 
@@ -90,7 +92,10 @@ static void turnc_handler(int err, uint16_t scode, const char *reason,
 	}
 
 	tc->turn_allocated = true;
+	tc->err = 0;
 	tc->ts_turn_resp = tmr_jiffies();
+	tc->relay_addr = *relay_addr;
+	tc->mapped_addr = *mapped_addr;
 
 	attr = stun_msg_attr(msg, STUN_ATTR_SOFTWARE);
 
@@ -132,7 +137,8 @@ static void turnc_handler(int err, uint16_t scode, const char *reason,
 	return;
 
  error:
-	tc->errorh(err ? err : EPROTO, tc->arg);
+	tc->err = err ? err : EPROTO;
+	tc->errorh(tc->err, tc->arg);
 }
 
 
@@ -146,7 +152,7 @@ static void tcp_estab(void *arg)
 		     tls_cipher_name(tl->tlsc));
 	}
 
-	tl->mb = (struct mbuf *)mem_deref(tl->mb);
+	turn_framer_reset(tl->framer);
 
 	err = turnc_alloc(&tl->turnc, NULL, IPPROTO_TCP,
 			  tl->tc, tl->layer_turn,
@@ -158,85 +164,92 @@ static void tcp_estab(void *arg)
 }
 
 
-static void tcp_recv(struct mbuf *mb, void *arg)
+/* NOTE: the data handler may destroy the connection */
+static int tcp_frame_handler(struct mbuf *mb, void *arg)
 {
 	struct turn_conn *tl = arg;
-	int err = 0;
+	struct sa src;
+	int err;
 
-	if (tl->mb) {
-		size_t pos;
+	err = turnc_recv(tl->turnc, &src, mb);
+	if (err)
+		return err;
 
-		pos = tl->mb->pos;
+	if (mbuf_get_left(mb))
+		turntcp_recv_data(tl, &src, mb);
 
-		tl->mb->pos = tl->mb->end;
+	return 0;
+}
 
-		err = mbuf_write_mem(tl->mb, mbuf_buf(mb),
-				     mbuf_get_left(mb));
-		if (err)
-			goto out;
 
-		tl->mb->pos = pos;
-	}
-	else {
-		tl->mb = mem_ref(mb);
-	}
+static void tcp_recv(struct mbuf *mb, void *arg)
+{
+	struct turn_conn *tl = arg;
+	int err;
 
-	for (;;) {
+	err = turn_framer_recv(tl->framer, mb);
+	if (err) {
+		warning("turnconn: turn tcp_recv error (%m)\n", err);
+		mem_deref(tl);
+	}
+}
 
-		size_t len, pos, end;
-		struct sa src;
-		uint16_t typ;
 
-		if (mbuf_get_left(tl->mb) < 4)
-			break;
+static int tx_flush(struct turn_conn *tl)
+{
+	int err;
 
-		typ = ntohs(mbuf_read_u16(tl->mb));
-		len = ntohs(mbuf_read_u16(tl->mb));
+	tmr_cancel(&tl->tmr_tx);
 
-		if (typ < 0x4000)
-			len += STUN_HEADER_SIZE;
-		else if (typ < 0x8000)
-			len += 4;
-		else {
-			err = EBADMSG;
-			goto out;
-		}
+	if (!tl->txb || !tl->txb->end)
+		return 0;
 
-		tl->mb->pos -= 4;
+	tl->txb->pos = 0;
+	err = tcp_send_helper(tl->tc, tl->txb, tl->th_batch);
 
-		if (mbuf_get_left(tl->mb) < len)
-			break;
+	tl->txb->pos = 0;
+	tl->txb->end = 0;
 
-		pos = tl->mb->pos;
-		end = tl->mb->end;
+	return err;
+}
 
-		tl->mb->end = pos + len;
 
-		err = turnc_recv(tl->turnc, &src, tl->mb);
-		if (err)
-			goto out;
+static void tx_timeout(void *arg)
+{
+	struct turn_conn *tl = arg;
+	int err;
 
-		if (mbuf_get_left(tl->mb))
-			turntcp_recv_data(tl, &src, tl->mb);
+	err = tx_flush(tl);
+	if (err)
+		warning("turnconn: tcp send failed (%m)\n", err);
+}
 
-		/* 4 byte alignment */
-		while (len & 0x03)
-			++len;
 
-		tl->mb->pos = pos + len;
-		tl->mb->end = end;
+/* Packets that are sent in the same main loop iteration are written
+ * to the socket (and TLS) in one go, when the loop comes around.
+ */
+static bool tcp_send_handler(int *err, struct mbuf *mb, void *arg)
+{
+	struct turn_conn *tl = arg;
+	size_t n = mbuf_get_left(mb);
 
-		if (tl->mb->pos >= tl->mb->end) {
-			tl->mb = mem_deref(tl->mb);
-			break;
-		}
+	if (tl->txb->end + n > TCP_BATCH_SIZE) {
+		*err = tx_flush(tl);
+		if (*err)
+			return true;
 	}
 
- out:
-	if (err) {
-		warning("turnconn: turn tcp_recv error (%m)\n");
-		mem_deref(tl);
-	}
+	if (n > TCP_BATCH_SIZE)
+		return false;
+
+	*err = mbuf_write_mem(tl->txb, mbuf_buf(mb), n);
+	if (*err)
+		return true;
+
+	if (!tmr_isrunning(&tl->tmr_tx))
+		tmr_start(&tl->tmr_tx, 0, tx_timeout, tl);
+
+	return true;
 }
 
 
@@ -248,9 +261,10 @@ static void tcp_close(int err, void *arg)
 
 	tl->turn_allocated = false;
 	tl->turnc = mem_deref(tl->turnc);
+	tl->err = err ? err : EPROTO;
 
 	if (tl->errorh)
-		tl->errorh(err ? err : EPROTO, tl->arg);
+		tl->errorh(tl->err, tl->arg);
 }
 
 
@@ -265,10 +279,14 @@ static void turnconn_destructor(void *data)
 	mem_deref(tc->ska);      /* note: deref before socket */
 	mem_deref(tc->turnc);    /* note: deref before socket */
 	mem_deref(tc->us_turn);
+	tmr_cancel(&tc->tmr_tx);
+	tmr_cancel(&tc->tmr_estab);
+	mem_deref(tc->th_batch);
 	mem_deref(tc->tlsc);
 	mem_deref(tc->tc);
 	mem_deref(tc->tls);
-	mem_deref(tc->mb);
+	mem_deref(tc->txb);
+	turn_framer_close(tc->framer);
 	mem_deref(tc->username);
 	mem_deref(tc->password);
 }
@@ -402,6 +420,21 @@ int turnconn_alloc(struct turn_conn **connp, struct list *connl,
 				goto out;
 			}
 		}
+
+		err = turn_framer_alloc(&tc->framer, tcp_frame_handler, tc);
+		if (err)
+			goto out;
+
+		tc->txb = mbuf_alloc(TCP_BATCH_SIZE);
+		if (!tc->txb) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		err = tcp_register_helper(&tc->th_batch, tc->tc, LAYER_BATCH,
+					  NULL, tcp_send_handler, NULL, tc);
+		if (err)
+			goto out;
 		break;
 
 	default:
@@ -426,6 +459,46 @@ int turnconn_alloc(struct turn_conn **connp, struct list *connl,
 }
 
 
+static void estab_timeout(void *arg)
+{
+	struct turn_conn *conn = arg;
+
+	/* the error handler was called instead */
+	if (!conn->turn_allocated)
+		return;
+
+	conn->estabh(conn, &conn->relay_addr, &conn->mapped_addr,
+		     NULL, conn->arg);
+}
+
+
+/* Moves an established allocation to a new owner. The new estab
+ * handler is called from the main loop, without a STUN message.
+ */
+int turnconn_handover(struct turn_conn *conn, struct list *connl,
+		      turnconn_estab_h *estabh, turnconn_data_h *datah,
+		      turnconn_error_h *errorh, void *arg)
+{
+	if (!conn || !estabh || !errorh)
+		return EINVAL;
+
+	if (!conn->turn_allocated)
+		return ENOTCONN;
+
+	list_unlink(&conn->le);
+	list_append(connl, &conn->le, conn);
+
+	conn->estabh = estabh;
+	conn->datah = datah;
+	conn->errorh = errorh;
+	conn->arg = arg;
+
+	tmr_start(&conn->tmr_estab, 0, estab_timeout, conn);
+
+	return 0;
+}
+
+
 static void turnc_perm_handler(void *arg)
 {
 	struct turn_conn *conn = arg;
@@ -463,6 +536,8 @@ static void turnc_chan_handler(void *arg)
 	struct turn_conn *conn = arg;
 
 	info("turnconn<%J>: TURN channel added OK\n", &conn->turn_srv);
+
+	++conn->n_chanh;
 }
 
 
@@ -0,0 +1,678 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* TURN allocation pool
+ *
+ * Keeps a few TURN allocations ready, so that the next call can start
+ * with a relay candidate instead of waiting for a round trip to every
+ * server. Each slot is filled by a race: one allocation is started per
+ * configured server and transport, the first one to succeed is kept
+ * and the others are cancelled.
+ *
+ * Ready allocations are kept alive by the TURN refresh and the STUN
+ * keepalive of turnconn. If one fails, it is dropped and replaced.
+ * A pool belongs to the thread that allocated it and can only hand
+ * its allocations to that thread's main loop.
+ *
+ * The servers are the ones of the last call. An allocation stays
+ * usable while its server is configured, whatever credentials the
+ * calls get later: the server only checks them when it is made and
+ * refreshed, with the ones it was made with. Servers no call was
+ * configured for in TURNPOOL_IDLE_MS are dropped with their
+ * allocations.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <re.h>
+#include <rew.h>
+#include "avs_log.h"
+#include "avs_turn.h"
+
+
+enum {
+	TURNPOOL_MAX_SIZE = 8,
+	TURNPOOL_RETRY_MS = 5000,  /* after an allocation failed */
+	TURNPOOL_IDLE_MS = 600000, /* servers unused for this long */
+};
+
+
+struct turnpool {
+	struct list srvl;    /* struct pool_srv */
+	struct list racel;   /* struct race, slots being filled */
+	struct list readyl;  /* struct turn_conn, allocated and idle */
+	struct tmr tmr;
+	pthread_t tid;
+	unsigned size;
+	int af;
+	int layer_stun;
+	int layer_turn;
+
+	struct turnpool_stats stats;
+};
+
+struct pool_srv {
+	struct le le;
+	struct sa addr;
+	int proto;
+	bool secure;
+	char *username;
+	char *password;
+	uint64_t ts_used;    /* last configured for a call */
+};
+
+struct race {
+	struct le le;
+	struct turnpool *pool;
+	struct list connl;
+	uint64_t ts_start;
+	bool failed;
+};
+
+
+static void refill_timeout(void *arg);
+static struct pool_srv *srv_find(const struct turnpool *pool,
+				 const struct sa *addr, int proto, bool secure);
+
+
+static void refill(struct turnpool *pool, uint32_t delay)
+{
+	tmr_start(&pool->tmr, delay, refill_timeout, pool);
+}
+
+
+static void idle_estab_handler(struct turn_conn *conn,
+			       const struct sa *relay_addr,
+			       const struct sa *mapped_addr,
+			       const struct stun_msg *msg, void *arg)
+{
+	(void)conn;
+	(void)relay_addr;
+	(void)mapped_addr;
+	(void)msg;
+	(void)arg;
+}
+
+
+static void idle_error_handler(int err, void *arg)
+{
+	struct turnpool *pool = arg;
+
+	info("turnpool: ready allocation failed (%m)\n", err);
+
+	/* dropped from the timer, we are inside its handler */
+	refill(pool, TURNPOOL_RETRY_MS);
+}
+
+
+static void race_destructor(void *data)
+{
+	struct race *race = data;
+
+	list_unlink(&race->le);
+	list_flush(&race->connl);
+}
+
+
+static void race_estab_handler(struct turn_conn *conn,
+			       const struct sa *relay_addr,
+			       const struct sa *mapped_addr,
+			       const struct stun_msg *msg, void *arg)
+{
+	struct race *race = arg;
+	struct turnpool *pool = race->pool;
+	(void)mapped_addr;
+	(void)msg;
+
+	list_unlink(&conn->le);
+	list_append(&pool->readyl, &conn->le, conn);
+
+	conn->estabh = idle_estab_handler;
+	conn->datah = NULL;
+	conn->errorh = idle_error_handler;
+	conn->arg = pool;
+
+	pool->stats.cancelled += list_count(&race->connl);
+
+	info("turnpool: TURN-%s to %J won in %llu ms (relay=%J,"
+	     " cancelled %u)\n",
+	     turnconn_proto_name(conn), &conn->turn_srv,
+	     tmr_jiffies() - race->ts_start, relay_addr,
+	     list_count(&race->connl));
+
+	mem_deref(race);
+}
+
+
+static bool race_failed(const struct race *race)
+{
+	struct le *le;
+
+	for (le = race->connl.head; le; le = le->next) {
+		struct turn_conn *conn = le->data;
+
+		if (!conn->err)
+			return false;
+	}
+
+	return true;
+}
+
+
+static void race_error_handler(int err, void *arg)
+{
+	struct race *race = arg;
+
+	if (race->failed || !race_failed(race))
+		return;
+
+	race->failed = true;
+	++race->pool->stats.failed;
+
+	warning("turnpool: all allocations failed (%m)\n", err);
+
+	/* dropped from the timer, we are inside its handler */
+	refill(race->pool, TURNPOOL_RETRY_MS);
+}
+
+
+static int race_start(struct turnpool *pool)
+{
+	struct race *race;
+	struct le *le;
+	int err = 0;
+
+	race = mem_zalloc(sizeof(*race), race_destructor);
+	if (!race)
+		return ENOMEM;
+
+	race->pool = pool;
+	race->ts_start = tmr_jiffies();
+
+	for (le = pool->srvl.head; le; le = le->next) {
+		struct pool_srv *srv = le->data;
+
+		err = turnconn_alloc(NULL, &race->connl, &srv->addr,
+				     srv->proto, srv->secure,
+				     srv->username, srv->password,
+				     pool->af, NULL,
+				     pool->layer_stun, pool->layer_turn,
+				     race_estab_handler, NULL,
+				     race_error_handler, race);
+		if (err) {
+			warning("turnpool: TURN-%s to %J failed (%m)\n",
+				net_proto2name(srv->proto), &srv->addr, err);
+			continue;
+		}
+
+		++pool->stats.allocs;
+	}
+
+	if (list_isempty(&race->connl)) {
+		mem_deref(race);
+		return err ? err : ENOENT;
+	}
+
+	list_append(&pool->racel, &race->le, race);
+
+	return 0;
+}
+
+
+/* Made for a server that is not configured anymore */
+static bool conn_stale(const struct turnpool *pool,
+		       const struct turn_conn *conn)
+{
+	return !srv_find(pool, &conn->turn_srv, conn->proto, conn->secure);
+}
+
+
+/* Drops the servers no call used for a while, returns the time until
+ * the next one expires
+ */
+static uint32_t srv_expire(struct turnpool *pool)
+{
+	uint64_t now = tmr_jiffies();
+	uint64_t next = TURNPOOL_IDLE_MS;
+	struct le *le;
+
+	le = pool->srvl.head;
+	while (le) {
+		struct pool_srv *srv = le->data;
+		uint64_t idle = now - srv->ts_used;
+
+		le = le->next;
+
+		if (idle >= TURNPOOL_IDLE_MS) {
+			info("turnpool: TURN-%s server %J unused,"
+			     " dropped\n",
+			     srv->secure ? "TLS" : net_proto2name(srv->proto),
+			     &srv->addr);
+			mem_deref(srv);
+		}
+		else if (TURNPOOL_IDLE_MS - idle < next) {
+			next = TURNPOOL_IDLE_MS - idle;
+		}
+	}
+
+	return (uint32_t)next;
+}
+
+
+static void refill_timeout(void *arg)
+{
+	struct turnpool *pool = arg;
+	bool failed = false;
+	uint32_t next;
+	struct le *le;
+	int err;
+
+	next = srv_expire(pool);
+
+	le = pool->readyl.head;
+	while (le) {
+		struct turn_conn *conn = le->data;
+
+		le = le->next;
+
+		if (!conn->turn_allocated || conn_stale(pool, conn))
+			mem_deref(conn);
+	}
+
+	le = pool->racel.head;
+	while (le) {
+		struct race *race = le->data;
+
+		le = le->next;
+
+		if (race->failed) {
+			failed = true;
+			mem_deref(race);
+		}
+	}
+
+	if (list_isempty(&pool->srvl))
+		return;
+
+	/* only one race at a time after a failure */
+	while (list_count(&pool->readyl) + list_count(&pool->racel)
+	       < pool->size) {
+
+		err = race_start(pool);
+		if (err) {
+			refill(pool, TURNPOOL_RETRY_MS);
+			break;
+		}
+
+		if (failed)
+			break;
+	}
+
+	if (!tmr_isrunning(&pool->tmr))
+		refill(pool, next);
+}
+
+
+static void srv_destructor(void *data)
+{
+	struct pool_srv *srv = data;
+
+	list_unlink(&srv->le);
+	mem_deref(srv->username);
+	mem_deref(srv->password);
+}
+
+
+static void pool_destructor(void *data)
+{
+	struct turnpool *pool = data;
+
+	tmr_cancel(&pool->tmr);
+	list_flush(&pool->racel);
+	list_flush(&pool->readyl);
+	list_flush(&pool->srvl);
+}
+
+
+int turnpool_alloc(struct turnpool **poolp, unsigned size, int af,
+		   int layer_stun, int layer_turn)
+{
+	struct turnpool *pool;
+
+	if (!poolp || !size || size > TURNPOOL_MAX_SIZE)
+		return EINVAL;
+
+	if (af != AF_INET && af != AF_INET6)
+		return EAFNOSUPPORT;
+
+	pool = mem_zalloc(sizeof(*pool), pool_destructor);
+	if (!pool)
+		return ENOMEM;
+
+	tmr_init(&pool->tmr);
+	pool->tid = pthread_self();
+	pool->size = size;
+	pool->af = af;
+	pool->layer_stun = layer_stun;
+	pool->layer_turn = layer_turn;
+
+	*poolp = pool;
+
+	return 0;
+}
+
+
+static struct pool_srv *srv_lookup(const struct list *srvl,
+				   const struct sa *addr, int proto,
+				   bool secure)
+{
+	struct le *le;
+
+	for (le = srvl->head; le; le = le->next) {
+		struct pool_srv *srv = le->data;
+
+		if (srv->proto == proto && srv->secure == secure &&
+		    sa_cmp(&srv->addr, addr, SA_ALL))
+			return srv;
+	}
+
+	return NULL;
+}
+
+
+static struct pool_srv *srv_find(const struct turnpool *pool,
+				 const struct sa *addr, int proto, bool secure)
+{
+	return srv_lookup(&pool->srvl, addr, proto, secure);
+}
+
+
+static int srv_alloc(struct pool_srv **psp, const struct turnpool *pool,
+		     const struct turnpool_server *ts)
+{
+	struct pool_srv *ps;
+	int err;
+
+	if (!sa_isset(&ts->addr, SA_ALL))
+		return EINVAL;
+
+	if (ts->proto != IPPROTO_UDP && ts->proto != IPPROTO_TCP)
+		return EPROTONOSUPPORT;
+
+	if (sa_af(&ts->addr) != pool->af)
+		return EAFNOSUPPORT;
+
+	ps = mem_zalloc(sizeof(*ps), srv_destructor);
+	if (!ps)
+		return ENOMEM;
+
+	ps->addr = ts->addr;
+	ps->proto = ts->proto;
+	ps->secure = ts->secure;
+	ps->ts_used = tmr_jiffies();
+
+	err  = str_dup(&ps->username, ts->username);
+	err |= str_dup(&ps->password, ts->password);
+	if (err) {
+		mem_deref(ps);
+		return err;
+	}
+
+	*psp = ps;
+
+	return 0;
+}
+
+
+static void srv_update(struct pool_srv *ps, const struct turnpool_server *ts)
+{
+	char *user = NULL, *pass = NULL;
+	int err;
+
+	ps->ts_used = tmr_jiffies();
+
+	err  = str_dup(&user, ts->username);
+	err |= str_dup(&pass, ts->password);
+	if (err) {
+		mem_deref(user);
+		mem_deref(pass);
+		return;
+	}
+
+	mem_deref(ps->username);
+	mem_deref(ps->password);
+	ps->username = user;
+	ps->password = pass;
+}
+
+
+/* Replaces the servers with the ones a call is configured for.
+ * Allocations on servers that are not in the list any more are
+ * dropped, those on the others are kept even if the credentials
+ * changed. New allocations are made with the new credentials.
+ * Servers that cannot be used are left out and the error returned.
+ */
+int turnpool_set_servers(struct turnpool *pool,
+			 const struct turnpool_server *srvv, size_t srvc)
+{
+	struct list srvl = LIST_INIT;
+	size_t i;
+	int err = 0;
+
+	if (!pool || (srvc && !srvv))
+		return EINVAL;
+
+	for (i = 0; i < srvc; i++) {
+		const struct turnpool_server *ts = &srvv[i];
+		struct pool_srv *ps;
+		int e;
+
+		/* listed twice */
+		if (srv_lookup(&srvl, &ts->addr, ts->proto, ts->secure))
+			continue;
+
+		ps = srv_find(pool, &ts->addr, ts->proto, ts->secure);
+		if (ps) {
+			srv_update(ps, ts);
+			list_unlink(&ps->le);
+			list_append(&srvl, &ps->le, ps);
+			continue;
+		}
+
+		e = srv_alloc(&ps, pool, ts);
+		if (e) {
+			warning("turnpool: TURN-%s server %J not used (%m)\n",
+				ts->secure ? "TLS"
+				: net_proto2name(ts->proto),
+				&ts->addr, e);
+			err = e;
+			continue;
+		}
+
+		list_append(&srvl, &ps->le, ps);
+
+		info("turnpool: added TURN-%s server %J\n",
+		     ts->secure ? "TLS" : net_proto2name(ts->proto),
+		     &ts->addr);
+	}
+
+	/* what is left is not configured any more */
+	list_flush(&pool->srvl);
+
+	while (srvl.head) {
+		struct pool_srv *ps = list_ledata(srvl.head);
+
+		list_unlink(&ps->le);
+		list_append(&pool->srvl, &ps->le, ps);
+	}
+
+	/* races that already run do not know the new ones, later
+	 * ones will
+	 */
+	refill(pool, 0);
+
+	return err;
+}
+
+
+static bool srv_match(const struct turn_conn *conn,
+		      const struct turnpool_server *srvv, size_t srvc)
+{
+	size_t i;
+
+	for (i = 0; i < srvc; i++) {
+		const struct turnpool_server *ts = &srvv[i];
+
+		if (conn->proto == ts->proto && conn->secure == ts->secure &&
+		    sa_cmp(&conn->turn_srv, &ts->addr, SA_ALL))
+			return true;
+	}
+
+	return false;
+}
+
+
+/* Hands a ready allocation on any of the given servers to a new owner,
+ * who gets its estab handler called from the main loop. The allocation
+ * keeps the credentials it was made with. ENOENT if there is none for
+ * this thread, address family and servers.
+ */
+int turnpool_take(struct turnpool *pool, int af,
+		  const struct turnpool_server *srvv, size_t srvc,
+		  struct list *connl,
+		  turnconn_estab_h *estabh, turnconn_data_h *datah,
+		  turnconn_error_h *errorh, void *arg)
+{
+	struct le *le;
+	int err;
+
+	if (!pool || !srvv || !srvc || !connl || !estabh || !errorh)
+		return EINVAL;
+
+	if (af != pool->af || !pthread_equal(pool->tid, pthread_self())) {
+		++pool->stats.misses;
+		return ENOENT;
+	}
+
+	le = pool->readyl.head;
+	while (le) {
+		struct turn_conn *conn = le->data;
+
+		le = le->next;
+
+		if (!conn->turn_allocated)
+			continue;
+
+		if (!srv_match(conn, srvv, srvc))
+			continue;
+
+		if (conn_stale(pool, conn)) {
+			mem_deref(conn);
+			refill(pool, 0);
+			continue;
+		}
+
+		err = turnconn_handover(conn, connl,
+					estabh, datah, errorh, arg);
+		if (err)
+			return err;
+
+		++pool->stats.taken;
+
+		info("turnpool: handing over TURN-%s allocation %J\n",
+		     turnconn_proto_name(conn), &conn->relay_addr);
+
+		refill(pool, 0);
+
+		return 0;
+	}
+
+	++pool->stats.misses;
+
+	return ENOENT;
+}
+
+
+/* Drops all allocations, e.g. when the network changed, and starts
+ * over with the known servers.
+ */
+void turnpool_flush(struct turnpool *pool)
+{
+	if (!pool)
+		return;
+
+	info("turnpool: flush (%u ready, %u pending)\n",
+	     list_count(&pool->readyl), list_count(&pool->racel));
+
+	list_flush(&pool->racel);
+	list_flush(&pool->readyl);
+
+	refill(pool, 0);
+}
+
+
+unsigned turnpool_ready(const struct turnpool *pool)
+{
+	struct le *le;
+	unsigned n = 0;
+
+	if (!pool)
+		return 0;
+
+	for (le = pool->readyl.head; le; le = le->next) {
+		const struct turn_conn *conn = le->data;
+
+		if (conn->turn_allocated)
+			++n;
+	}
+
+	return n;
+}
+
+
+const struct turnpool_stats *turnpool_stats(const struct turnpool *pool)
+{
+	return pool ? &pool->stats : NULL;
+}
+
+
+int turnpool_debug(struct re_printf *pf, const struct turnpool *pool)
+{
+	const struct turnpool_stats *st;
+	struct le *le;
+	int err = 0;
+
+	if (!pool)
+		return 0;
+
+	st = &pool->stats;
+
+	err |= re_hprintf(pf, "turnpool: size=%u servers=%u ready=%u"
+			  " pending=%u\n",
+			  pool->size, list_count(&pool->srvl),
+			  turnpool_ready(pool), list_count(&pool->racel));
+	err |= re_hprintf(pf, "...taken=%u misses=%u allocs=%u"
+			  " cancelled=%u failed=%u\n",
+			  st->taken, st->misses, st->allocs,
+			  st->cancelled, st->failed);
+
+	for (le = pool->readyl.head; le; le = le->next)
+		err |= turnconn_debug(pf, le->data);
+
+	return err;
+}
@@ -0,0 +1,966 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Fused pixel format conversion and downscaling to I420.
+ *
+ * Up to 2:1 each output row is made from at most two source rows. The
+ * source rows are unpacked to planar 8-bit rows (luma, or U and V), kept
+ * in a two row cache, blended vertically and then resampled
+ * horizontally. Only the rows that contribute to the output are ever
+ * converted.
+ *
+ * Above 2:1 bilinear sampling would skip source samples and alias, so
+ * that direction uses a box filter instead: every output sample is the
+ * average of all the source samples it covers.
+ *
+ * The SIMD and the scalar code give bit exact results.
+ */
+
+#include <string.h>
+
+#include <re.h>
+#include <avs.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define VIDCONV_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VIDCONV_NEON 1
+#endif
+
+
+enum {
+	ALIGN = 16,
+};
+
+
+struct vidconv {
+	uint8_t *buf;
+	size_t sz;
+};
+
+
+typedef void (unpack_h)(const struct avs_vidframe *f, int row, int w,
+			const uint8_t **c0, const uint8_t **c1,
+			uint8_t *b0, uint8_t *b1);
+
+struct plane {
+	unpack_h *unpack;
+	int nch;
+	int sw;
+	int sh;
+	int dw;
+	int dh;
+	uint8_t *dst[2];
+	size_t ds[2];
+};
+
+
+static bool use_simd = true;
+
+
+/*
+ * Row kernels
+ */
+
+/* dst = (a * (256 - f) + b * f + 128) >> 8, for 0 < f < 256 */
+static void lerp_row(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+		     int n, unsigned f)
+{
+	int i = 0;
+
+#if VIDCONV_SSE2
+	if (use_simd) {
+		const __m128i z = _mm_setzero_si128();
+		const __m128i wa = _mm_set1_epi16((short)(256 - f));
+		const __m128i wb = _mm_set1_epi16((short)f);
+		const __m128i r = _mm_set1_epi16(128);
+
+		for (; i + 16 <= n; i += 16) {
+			__m128i va = _mm_loadu_si128((const __m128i *)&a[i]);
+			__m128i vb = _mm_loadu_si128((const __m128i *)&b[i]);
+			__m128i lo, hi;
+
+			lo = _mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpacklo_epi8(va, z), wa),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(vb, z), wb));
+			hi = _mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpackhi_epi8(va, z), wa),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(vb, z), wb));
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, r), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, r), 8);
+
+			_mm_storeu_si128((__m128i *)&dst[i],
+					 _mm_packus_epi16(lo, hi));
+		}
+	}
+#elif VIDCONV_NEON
+	if (use_simd) {
+		const uint8x8_t wa = vdup_n_u8((uint8_t)(256 - f));
+		const uint8x8_t wb = vdup_n_u8((uint8_t)f);
+
+		for (; i + 8 <= n; i += 8) {
+			uint16x8_t acc = vmull_u8(vld1_u8(&a[i]), wa);
+
+			acc = vmlal_u8(acc, vld1_u8(&b[i]), wb);
+			vst1_u8(&dst[i], vrshrn_n_u16(acc, 8));
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] = (a[i] * (256 - f) + b[i] * f + 128) >> 8;
+}
+
+
+/* dst[i] = (src[2i] + src[2i+1] + 1) >> 1 */
+static void half_row(uint8_t *dst, const uint8_t *src, int n)
+{
+	int i = 0;
+
+#if VIDCONV_SSE2
+	if (use_simd) {
+		const __m128i m = _mm_set1_epi16(0x00ff);
+
+		for (; i + 16 <= n; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i *)&src[2*i]);
+			__m128i b = _mm_loadu_si128(
+					(const __m128i *)&src[2*i + 16]);
+			__m128i ev, od;
+
+			ev = _mm_packus_epi16(_mm_and_si128(a, m),
+					      _mm_and_si128(b, m));
+			od = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+					      _mm_srli_epi16(b, 8));
+
+			_mm_storeu_si128((__m128i *)&dst[i],
+					 _mm_avg_epu8(ev, od));
+		}
+	}
+#elif VIDCONV_NEON
+	if (use_simd) {
+		for (; i + 16 <= n; i += 16) {
+			uint8x16x2_t v = vld2q_u8(&src[2*i]);
+
+			vst1q_u8(&dst[i], vrhaddq_u8(v.val[0], v.val[1]));
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] = (src[2*i] + src[2*i + 1] + 1) >> 1;
+}
+
+
+/* d0[i] = src[2i], d1[i] = src[2i+1] */
+static void split_row(uint8_t *d0, uint8_t *d1, const uint8_t *src, int n)
+{
+	int i = 0;
+
+#if VIDCONV_SSE2
+	if (use_simd) {
+		const __m128i m = _mm_set1_epi16(0x00ff);
+
+		for (; i + 16 <= n; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i *)&src[2*i]);
+			__m128i b = _mm_loadu_si128(
+					(const __m128i *)&src[2*i + 16]);
+
+			_mm_storeu_si128((__m128i *)&d0[i],
+					 _mm_packus_epi16(_mm_and_si128(a, m),
+							  _mm_and_si128(b, m)));
+			_mm_storeu_si128((__m128i *)&d1[i],
+					 _mm_packus_epi16(_mm_srli_epi16(a, 8),
+							  _mm_srli_epi16(b, 8)));
+		}
+	}
+#elif VIDCONV_NEON
+	if (use_simd) {
+		for (; i + 16 <= n; i += 16) {
+			uint8x16x2_t v = vld2q_u8(&src[2*i]);
+
+			vst1q_u8(&d0[i], v.val[0]);
+			vst1q_u8(&d1[i], v.val[1]);
+		}
+	}
+#endif
+
+	for (; i < n; i++) {
+		d0[i] = src[2*i];
+		d1[i] = src[2*i + 1];
+	}
+}
+
+
+/* Y0 U Y1 V -> Y */
+static void yuy2_y_row(uint8_t *y, const uint8_t *src, int n)
+{
+	int i = 0;
+
+#if VIDCONV_SSE2
+	if (use_simd) {
+		const __m128i m = _mm_set1_epi16(0x00ff);
+
+		for (; i + 16 <= n; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i *)&src[2*i]);
+			__m128i b = _mm_loadu_si128(
+					(const __m128i *)&src[2*i + 16]);
+
+			_mm_storeu_si128((__m128i *)&y[i],
+					 _mm_packus_epi16(_mm_and_si128(a, m),
+							  _mm_and_si128(b, m)));
+		}
+	}
+#elif VIDCONV_NEON
+	if (use_simd) {
+		for (; i + 16 <= n; i += 16) {
+			uint8x16x2_t v = vld2q_u8(&src[2*i]);
+
+			vst1q_u8(&y[i], v.val[0]);
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+		y[i] = src[2*i];
+}
+
+
+/* Y0 U Y1 V -> U, V; n is the number of chroma samples */
+static void yuy2_uv_row(uint8_t *u, uint8_t *v, const uint8_t *src, int n)
+{
+	int i = 0;
+
+#if VIDCONV_SSE2
+	if (use_simd) {
+		const __m128i m = _mm_set1_epi16(0x00ff);
+
+		for (; i + 8 <= n; i += 8) {
+			__m128i a = _mm_loadu_si128((const __m128i *)&src[4*i]);
+			__m128i b = _mm_loadu_si128(
+					(const __m128i *)&src[4*i + 16]);
+			__m128i uv;
+
+			/* U V U V ... */
+			uv = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+					      _mm_srli_epi16(b, 8));
+
+			_mm_storel_epi64((__m128i *)&u[i],
+					 _mm_packus_epi16(_mm_and_si128(uv, m),
+							  _mm_setzero_si128()));
+			_mm_storel_epi64((__m128i *)&v[i],
+					 _mm_packus_epi16(_mm_srli_epi16(uv, 8),
+							  _mm_setzero_si128()));
+		}
+	}
+#elif VIDCONV_NEON
+	if (use_simd) {
+		for (; i + 8 <= n; i += 8) {
+			uint8x8x4_t q = vld4_u8(&src[4*i]);
+
+			vst1_u8(&u[i], q.val[1]);
+			vst1_u8(&v[i], q.val[3]);
+		}
+	}
+#endif
+
+	for (; i < n; i++) {
+		u[i] = src[4*i + 1];
+		v[i] = src[4*i + 3];
+	}
+}
+
+
+/*
+ * ARGB (B G R A in memory) to BT.601 limited range:
+ *
+ *   Y = ((25 B + 129 G + 66 R + 128) >> 8) + 16
+ *   U = (112 B - 74 G - 38 R + 0x8080) >> 8
+ *   V = (112 R - 94 G - 18 B + 0x8080) >> 8
+ *
+ * U and V are taken from the average of each pair of pixels.
+ */
+static inline uint8_t rgb_to_y(const uint8_t *p)
+{
+	return ((25 * p[0] + 129 * p[1] + 66 * p[2] + 128) >> 8) + 16;
+}
+
+
+static inline uint8_t rgb_to_u(int b, int g, int r)
+{
+	return (112 * b - 74 * g - 38 * r + 0x8080) >> 8;
+}
+
+
+static inline uint8_t rgb_to_v(int b, int g, int r)
+{
+	return (112 * r - 94 * g - 18 * b + 0x8080) >> 8;
+}
+
+
+#if VIDCONV_SSE2
+/* 4 pixels to 4 luma values as int32 */
+static inline __m128i argb_luma4(__m128i px)
+{
+	const __m128i z = _mm_setzero_si128();
+	const __m128i cy = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+	const __m128i r = _mm_set1_epi32(128 + (16 << 8));
+	__m128 lo, hi;
+
+	/* B+G and R+A partial sums, which do not fit in 16 bits */
+	lo = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(px, z), cy));
+	hi = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(px, z), cy));
+
+	px = _mm_add_epi32(
+		_mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2,0,2,0))),
+		_mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3,1,3,1))));
+
+	return _mm_srli_epi32(_mm_add_epi32(px, r), 8);
+}
+#endif
+
+
+static void argb_y_row(uint8_t *y, const uint8_t *src, int n)
+{
+	int i = 0;
+
+#if VIDCONV_SSE2
+	if (use_simd) {
+		const __m128i z = _mm_setzero_si128();
+
+		for (; i + 8 <= n; i += 8) {
+			__m128i p0 = _mm_loadu_si128((const __m128i *)&src[4*i]);
+			__m128i p1 = _mm_loadu_si128(
+					(const __m128i *)&src[4*i + 16]);
+
+			p0 = _mm_packs_epi32(argb_luma4(p0), argb_luma4(p1));
+
+			_mm_storel_epi64((__m128i *)&y[i],
+					 _mm_packus_epi16(p0, z));
+		}
+	}
+#elif VIDCONV_NEON
+	if (use_simd) {
+		const uint8x8_t cb = vdup_n_u8(25);
+		const uint8x8_t cg = vdup_n_u8(129);
+		const uint8x8_t cr = vdup_n_u8(66);
+		const uint8x8_t c16 = vdup_n_u8(16);
+
+		for (; i + 8 <= n; i += 8) {
+			uint8x8x4_t p = vld4_u8(&src[4*i]);
+			uint16x8_t acc = vmull_u8(p.val[0], cb);
+
+			acc = vmlal_u8(acc, p.val[1], cg);
+			acc = vmlal_u8(acc, p.val[2], cr);
+			vst1_u8(&y[i], vadd_u8(vrshrn_n_u16(acc, 8), c16));
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+		y[i] = rgb_to_y(&src[4*i]);
+}
+
+
+#if VIDCONV_SSE2
+/* Averages pixel pairs: 8 pixels in p0, p1 to 4 pixels */
+static inline __m128i argb_pair_avg(__m128i p0, __m128i p1)
+{
+	__m128i a0 = _mm_avg_epu8(p0, _mm_srli_si128(p0, 4));
+	__m128i a1 = _mm_avg_epu8(p1, _mm_srli_si128(p1, 4));
+
+	a0 = _mm_shuffle_epi32(a0, _MM_SHUFFLE(3, 1, 2, 0));
+	a1 = _mm_shuffle_epi32(a1, _MM_SHUFFLE(3, 1, 2, 0));
+
+	return _mm_unpacklo_epi64(a0, a1);
+}
+
+
+/* 4 pixels to 4 chroma values as int32 */
+static inline __m128i argb_chroma4(__m128i px, __m128i c)
+{
+	const __m128i z = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i r = _mm_set1_epi32(0x8080);
+	__m128i s;
+
+	s = _mm_packs_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(px, z), c),
+			    _mm_madd_epi16(_mm_unpackhi_epi8(px, z), c));
+
+	return _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(s, one), r), 8);
+}
+#endif
+
+
+/* n is the number of chroma samples, w the number of pixels */
+static void argb_uv_row(uint8_t *u, uint8_t *v, const uint8_t *src,
+			int n, int w)
+{
+	int i = 0;
+
+#if VIDCONV_SSE2
+	if (use_simd) {
+		const __m128i z = _mm_setzero_si128();
+		const __m128i cu = _mm_setr_epi16(112, -74, -38, 0,
+						  112, -74, -38, 0);
+		const __m128i cv = _mm_setr_epi16(-18, -94, 112, 0,
+						  -18, -94, 112, 0);
+
+		for (; i + 8 <= n && 2*i + 16 <= w; i += 8) {
+			const __m128i *p = (const __m128i *)&src[8*i];
+			__m128i q0, q1, x;
+
+			q0 = argb_pair_avg(_mm_loadu_si128(&p[0]),
+					   _mm_loadu_si128(&p[1]));
+			q1 = argb_pair_avg(_mm_loadu_si128(&p[2]),
+					   _mm_loadu_si128(&p[3]));
+
+			x = _mm_packs_epi32(argb_chroma4(q0, cu),
+					    argb_chroma4(q1, cu));
+			_mm_storel_epi64((__m128i *)&u[i],
+					 _mm_packus_epi16(x, z));
+
+			x = _mm_packs_epi32(argb_chroma4(q0, cv),
+					    argb_chroma4(q1, cv));
+			_mm_storel_epi64((__m128i *)&v[i],
+					 _mm_packus_epi16(x, z));
+		}
+	}
+#elif VIDCONV_NEON
+	if (use_simd) {
+		const int16x8_t c128 = vdupq_n_s16(128);
+
+		for (; i + 8 <= n && 2*i + 16 <= w; i += 8) {
+			uint8x16x4_t p = vld4q_u8(&src[8*i]);
+			int16x8_t b, g, r, x;
+
+			b = vreinterpretq_s16_u16(
+				vrshrq_n_u16(vpaddlq_u8(p.val[0]), 1));
+			g = vreinterpretq_s16_u16(
+				vrshrq_n_u16(vpaddlq_u8(p.val[1]), 1));
+			r = vreinterpretq_s16_u16(
+				vrshrq_n_u16(vpaddlq_u8(p.val[2]), 1));
+
+			/* (s + 0x8080) >> 8 == ((s + 128) >> 8) + 128 */
+			x = vmulq_n_s16(b, 112);
+			x = vmlaq_n_s16(x, g, -74);
+			x = vmlaq_n_s16(x, r, -38);
+			x = vaddq_s16(vshrq_n_s16(vaddq_s16(x, c128), 8), c128);
+			vst1_u8(&u[i], vqmovun_s16(x));
+
+			x = vmulq_n_s16(r, 112);
+			x = vmlaq_n_s16(x, g, -94);
+			x = vmlaq_n_s16(x, b, -18);
+			x = vaddq_s16(vshrq_n_s16(vaddq_s16(x, c128), 8), c128);
+			vst1_u8(&v[i], vqmovun_s16(x));
+		}
+	}
+#endif
+
+	for (; i < n; i++) {
+		const uint8_t *p0 = &src[8*i];
+		const uint8_t *p1 = 2*i + 1 < w ? p0 + 4 : p0;
+		int b = (p0[0] + p1[0] + 1) >> 1;
+		int g = (p0[1] + p1[1] + 1) >> 1;
+		int r = (p0[2] + p1[2] + 1) >> 1;
+
+		u[i] = rgb_to_u(b, g, r);
+		v[i] = rgb_to_v(b, g, r);
+	}
+}
+
+
+/*
+ * Row unpackers, per source format
+ */
+
+static void planar_y(const struct avs_vidframe *f, int row, int w,
+		     const uint8_t **c0, const uint8_t **c1,
+		     uint8_t *b0, uint8_t *b1)
+{
+	(void)w;
+	(void)c1;
+	(void)b0;
+	(void)b1;
+
+	*c0 = f->y + row * f->ys;
+}
+
+
+static void i420_uv(const struct avs_vidframe *f, int row, int w,
+		    const uint8_t **c0, const uint8_t **c1,
+		    uint8_t *b0, uint8_t *b1)
+{
+	(void)w;
+	(void)b0;
+	(void)b1;
+
+	*c0 = f->u + row * f->us;
+	*c1 = f->v + row * f->vs;
+}
+
+
+static void nv12_uv(const struct avs_vidframe *f, int row, int w,
+		    const uint8_t **c0, const uint8_t **c1,
+		    uint8_t *b0, uint8_t *b1)
+{
+	split_row(b0, b1, f->u + row * f->us, w);
+	*c0 = b0;
+	*c1 = b1;
+}
+
+
+static void nv21_uv(const struct avs_vidframe *f, int row, int w,
+		    const uint8_t **c0, const uint8_t **c1,
+		    uint8_t *b0, uint8_t *b1)
+{
+	split_row(b1, b0, f->u + row * f->us, w);
+	*c0 = b0;
+	*c1 = b1;
+}
+
+
+static void yuy2_y(const struct avs_vidframe *f, int row, int w,
+		   const uint8_t **c0, const uint8_t **c1,
+		   uint8_t *b0, uint8_t *b1)
+{
+	(void)c1;
+	(void)b1;
+
+	yuy2_y_row(b0, f->y + row * f->ys, w);
+	*c0 = b0;
+}
+
+
+static void yuy2_uv(const struct avs_vidframe *f, int row, int w,
+		    const uint8_t **c0, const uint8_t **c1,
+		    uint8_t *b0, uint8_t *b1)
+{
+	yuy2_uv_row(b0, b1, f->y + row * f->ys, w);
+	*c0 = b0;
+	*c1 = b1;
+}
+
+
+static void argb_y(const struct avs_vidframe *f, int row, int w,
+		   const uint8_t **c0, const uint8_t **c1,
+		   uint8_t *b0, uint8_t *b1)
+{
+	(void)c1;
+	(void)b1;
+
+	argb_y_row(b0, f->y + row * f->ys, w);
+	*c0 = b0;
+}
+
+
+static void argb_uv(const struct avs_vidframe *f, int row, int w,
+		    const uint8_t **c0, const uint8_t **c1,
+		    uint8_t *b0, uint8_t *b1)
+{
+	argb_uv_row(b0, b1, f->y + row * f->ys, w, f->w);
+	*c0 = b0;
+	*c1 = b1;
+}
+
+
+/*
+ * Scaling
+ */
+
+/* Maps output sample x to source sample i and weight f of sample i+1,
+ * with the sample centres aligned.
+ */
+static int map_pos(int x, int d, int s, unsigned *f)
+{
+	int64_t step = ((int64_t)s << 16) / d;
+	int64_t pos = x * step + step / 2 - (1 << 15);
+	int i;
+
+	if (pos < 0)
+		pos = 0;
+
+	i = (int)(pos >> 16);
+	*f = (unsigned)(pos >> 8) & 0xff;
+
+	if (i >= s - 1) {
+		i = s - 1;
+		*f = 0;
+	}
+
+	return i;
+}
+
+
+/* Source sample i of output sample x is in [idx[x], idx[x + 1]) */
+static void box_row(uint8_t *dst, const uint8_t *src, const int *idx, int n)
+{
+	int x, i;
+
+	for (x = 0; x < n; x++) {
+		unsigned sum = 0, k = idx[x + 1] - idx[x];
+
+		for (i = idx[x]; i < idx[x + 1]; i++)
+			sum += src[i];
+
+		dst[x] = (sum + k / 2) / k;
+	}
+}
+
+
+static void hscale_row(uint8_t *dst, const uint8_t *src,
+		       const struct plane *p, const int *idx, const uint8_t *wt)
+{
+	int x;
+
+	if (p->sw == p->dw) {
+		memcpy(dst, src, p->dw);
+		return;
+	}
+
+	if (p->sw == 2 * p->dw) {
+		half_row(dst, src, p->dw);
+		return;
+	}
+
+	if (p->sw > 2 * p->dw) {
+		box_row(dst, src, idx, p->dw);
+		return;
+	}
+
+	for (x = 0; x < p->dw; x++) {
+		const uint8_t *s = &src[idx[x]];
+		unsigned f = wt[x];
+
+		dst[x] = f ? (s[0] * (256 - f) + s[1] * f + 128) >> 8 : s[0];
+	}
+}
+
+
+static size_t align(size_t n)
+{
+	return (n + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+
+static int scratch_get(struct vidconv *vc, size_t sz)
+{
+	if (vc->sz >= sz)
+		return 0;
+
+	mem_deref(vc->buf);
+	vc->sz = 0;
+
+	vc->buf = mem_alloc(sz, NULL);
+	if (!vc->buf)
+		return ENOMEM;
+
+	vc->sz = sz;
+
+	return 0;
+}
+
+
+static size_t scratch_size(int sw, int dw)
+{
+	return 6 * align(sw) + 2 * align(sw * sizeof(uint32_t))
+		+ align((dw + 1) * sizeof(int)) + align(dw) + ALIGN;
+}
+
+
+/* Averages the source rows [r0, r1) of every channel into line */
+static void vbox_rows(const struct avs_vidframe *f, const struct plane *p,
+		      int r0, int r1, uint8_t *line[2], uint32_t *acc[2],
+		      uint8_t *b0, uint8_t *b1)
+{
+	const unsigned k = r1 - r0;
+	int x, r, ch;
+
+	for (ch = 0; ch < p->nch; ch++)
+		memset(acc[ch], 0, p->sw * sizeof(uint32_t));
+
+	for (r = r0; r < r1; r++) {
+		const uint8_t *c[2] = {NULL, NULL};
+
+		p->unpack(f, r, p->sw, &c[0], &c[1], b0, b1);
+
+		for (ch = 0; ch < p->nch; ch++) {
+			for (x = 0; x < p->sw; x++)
+				acc[ch][x] += c[ch][x];
+		}
+	}
+
+	for (ch = 0; ch < p->nch; ch++) {
+		for (x = 0; x < p->sw; x++)
+			line[ch][x] = (acc[ch][x] + k / 2) / k;
+	}
+}
+
+
+static void scale_plane(struct vidconv *vc, const struct avs_vidframe *f,
+			const struct plane *p)
+{
+	uint8_t *base = (uint8_t *)align((size_t)vc->buf);
+	uint8_t *rowbuf[2][2], *tmp[2];
+	const uint8_t *rows[2][2] = {{NULL, NULL}, {NULL, NULL}};
+	int cached[2] = {-1, -1};
+	uint32_t *acc[2];
+	uint8_t *wt;
+	int *idx;
+	int x, y, ch;
+
+	rowbuf[0][0] = base;
+	rowbuf[0][1] = base + align(p->sw);
+	rowbuf[1][0] = base + 2 * align(p->sw);
+	rowbuf[1][1] = base + 3 * align(p->sw);
+	tmp[0] = base + 4 * align(p->sw);
+	tmp[1] = base + 5 * align(p->sw);
+	acc[0] = (uint32_t *)(base + 6 * align(p->sw));
+	acc[1] = (uint32_t *)((uint8_t *)acc[0]
+			      + align(p->sw * sizeof(uint32_t)));
+	idx = (int *)((uint8_t *)acc[1] + align(p->sw * sizeof(uint32_t)));
+	wt = (uint8_t *)idx + align((p->dw + 1) * sizeof(int));
+
+	if (p->sw > 2 * p->dw) {
+		for (x = 0; x <= p->dw; x++)
+			idx[x] = (int)((int64_t)x * p->sw / p->dw);
+	}
+	else {
+		for (x = 0; x < p->dw; x++) {
+			unsigned fx;
+
+			idx[x] = map_pos(x, p->dw, p->sw, &fx);
+			wt[x] = (uint8_t)fx;
+		}
+	}
+
+	for (y = 0; y < p->dh; y++) {
+		unsigned fy;
+		int r[2];
+
+		if (p->sh > 2 * p->dh) {
+			r[0] = (int)((int64_t)y * p->sh / p->dh);
+			r[1] = (int)((int64_t)(y + 1) * p->sh / p->dh);
+
+			vbox_rows(f, p, r[0], r[1], tmp, acc,
+				  rowbuf[0][0], rowbuf[0][1]);
+
+			for (ch = 0; ch < p->nch; ch++) {
+				hscale_row(p->dst[ch] + y * p->ds[ch],
+					   tmp[ch], p, idx, wt);
+			}
+			continue;
+		}
+
+		r[0] = map_pos(y, p->dh, p->sh, &fy);
+		r[1] = fy ? r[0] + 1 : r[0];
+
+		for (x = 0; x < 2; x++) {
+			int slot = r[x] & 1;
+
+			if (cached[slot] == r[x])
+				continue;
+
+			p->unpack(f, r[x], p->sw,
+				  &rows[slot][0], &rows[slot][1],
+				  rowbuf[slot][0], rowbuf[slot][1]);
+			cached[slot] = r[x];
+		}
+
+		for (ch = 0; ch < p->nch; ch++) {
+			const uint8_t *line = rows[r[0] & 1][ch];
+
+			if (fy) {
+				lerp_row(tmp[ch], line, rows[r[1] & 1][ch],
+					 p->sw, fy);
+				line = tmp[ch];
+			}
+
+			hscale_row(p->dst[ch] + y * p->ds[ch], line,
+				   p, idx, wt);
+		}
+	}
+}
+
+
+static void destructor(void *arg)
+{
+	struct vidconv *vc = arg;
+
+	mem_deref(vc->buf);
+}
+
+
+int vidconv_alloc(struct vidconv **vcp)
+{
+	struct vidconv *vc;
+
+	if (!vcp)
+		return EINVAL;
+
+	vc = mem_zalloc(sizeof(*vc), destructor);
+	if (!vc)
+		return ENOMEM;
+
+	*vcp = vc;
+
+	return 0;
+}
+
+
+int vidconv_to_i420(struct vidconv *vc, struct avs_vidframe *dst,
+		    const struct avs_vidframe *src)
+{
+	struct plane py, puv;
+	bool chroma_422 = false;
+	int err;
+
+	if (!vc || !dst || !src || !src->y)
+		return EINVAL;
+
+	if (dst->type != AVS_VIDFRAME_I420 || !dst->y || !dst->u || !dst->v)
+		return EINVAL;
+
+	if (src->w <= 0 || src->h <= 0 || dst->w <= 0 || dst->h <= 0
+	    || dst->w > src->w || dst->h > src->h)
+		return EINVAL;
+
+	memset(&py, 0, sizeof(py));
+	memset(&puv, 0, sizeof(puv));
+
+	switch (src->type) {
+
+	case AVS_VIDFRAME_I420:
+		if (!src->u || !src->v)
+			return EINVAL;
+		py.unpack = planar_y;
+		puv.unpack = i420_uv;
+		break;
+
+	case AVS_VIDFRAME_NV12:
+	case AVS_VIDFRAME_NV21:
+		if (!src->u)
+			return EINVAL;
+		py.unpack = planar_y;
+		puv.unpack = src->type == AVS_VIDFRAME_NV12 ? nv12_uv : nv21_uv;
+		break;
+
+	case AVS_VIDFRAME_YUY2:
+		if (src->w & 1)
+			return EINVAL;
+		py.unpack = yuy2_y;
+		puv.unpack = yuy2_uv;
+		chroma_422 = true;
+		break;
+
+	case AVS_VIDFRAME_ARGB:
+		py.unpack = argb_y;
+		puv.unpack = argb_uv;
+		chroma_422 = true;
+		break;
+
+	default:
+		return ENOTSUP;
+	}
+
+	err = scratch_get(vc, scratch_size(src->w, dst->w));
+	if (err)
+		return err;
+
+	py.nch = 1;
+	py.sw = src->w;
+	py.sh = src->h;
+	py.dw = dst->w;
+	py.dh = dst->h;
+	py.dst[0] = dst->y;
+	py.ds[0] = dst->ys;
+
+	puv.nch = 2;
+	puv.sw = (src->w + 1) / 2;
+	puv.sh = chroma_422 ? src->h : (src->h + 1) / 2;
+	puv.dw = (dst->w + 1) / 2;
+	puv.dh = (dst->h + 1) / 2;
+	puv.dst[0] = dst->u;
+	puv.ds[0] = dst->us;
+	puv.dst[1] = dst->v;
+	puv.ds[1] = dst->vs;
+
+	scale_plane(vc, src, &py);
+	scale_plane(vc, src, &puv);
+
+	dst->rotation = src->rotation;
+	dst->ts = src->ts;
+
+	return 0;
+}
+
+
+void vidconv_fit(int *dw, int *dh, int w, int h, int max_w, int max_h)
+{
+	int64_t ls = w > h ? w : h, ss = w > h ? h : w;
+	int64_t lt = max_w > max_h ? max_w : max_h;
+	int64_t st = max_w > max_h ? max_h : max_w;
+	int64_t num, den;
+
+	if (!dw || !dh)
+		return;
+
+	*dw = w;
+	*dh = h;
+
+	if (w <= 0 || h <= 0 || max_w <= 0 || max_h <= 0)
+		return;
+
+	/* scale = min(lt / ls, st / ss) */
+	if (lt * ss <= st * ls) {
+		num = lt;
+		den = ls;
+	}
+	else {
+		num = st;
+		den = ss;
+	}
+
+	if (num >= den)
+		return;
+
+	*dw = (int)(w * num / den) & ~1;
+	*dh = (int)(h * num / den) & ~1;
+
+	if (*dw < 2)
+		*dw = 2;
+	if (*dh < 2)
+		*dh = 2;
+}
+
+
+void vidconv_enable_simd(bool enable)
+{
+	use_simd = enable;
+}
+
+
+bool vidconv_has_simd(void)
+{
+#if VIDCONV_SSE2 || VIDCONV_NEON
+	return true;
+#else
+	return false;
+#endif
+}
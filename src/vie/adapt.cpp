@@ -0,0 +1,331 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Send resolution and framerate adaptation
+ *
+ * Picks an operating point from the resolution ladder for the bitrate
+ * allocated by the bandwidth estimator and the CPU load reported by the
+ * encoder. Within a step the framerate is scaled with the bitrate, so
+ * that on a bad link we first lose frames and only drop resolution once
+ * the framerate would go below the step's min_fps. Going up a step
+ * requires the bitrate for full framerate on the new step to be
+ * available for UP_HOLD_MS.
+ *
+ * The steps above 640x480 are only used if HD video is enabled, see
+ * vie_enable_hd().
+ */
+
+#include <algorithm>
+#include <re.h>
+
+#include <avs.h>
+#include <avs_vie.h>
+
+
+enum {
+	UP_HOLD_MS  = 4000,
+	CPU_HOLD_MS = 5000,
+	SD_MAX_HEIGHT = 480,
+};
+
+
+static const struct vie_ladder_step default_ladder[] = {
+	{1280, 720, 30, 15, 1500, 2500},
+	{ 960, 540, 30, 15,  900, 1800},
+	{ 640, 480, 30, 15,  600, 1200},
+	{ 480, 360, 30, 15,  350,  700},
+	{ 320, 240, 15, 10,  150,  400},
+	{ 240, 180, 15,  7,    0,  200},
+};
+
+static struct {
+	struct vie_ladder_step *stepv;
+	size_t stepc;
+	bool hd;
+} ladder;
+
+
+struct vie_adapt {
+	struct vie_ladder_step *stepv;
+	size_t stepc;
+
+	struct vie_oppoint op;
+	uint32_t bitrate;     /* kilobits/second  */
+
+	uint64_t ts_up;       /* since when can we go up, 0 if not  */
+
+	/* CPU limits, only ever lower than what the bitrate allows  */
+	size_t cpu_step;
+	bool cpu_fps_limit;
+	uint64_t ts_cpu;
+};
+
+
+static void adapt_destructor(void *arg)
+{
+	struct vie_adapt *va = (struct vie_adapt *)arg;
+
+	mem_deref(va->stepv);
+}
+
+
+static uint32_t step_fps(const struct vie_ladder_step *step, uint32_t br)
+{
+	uint64_t fps;
+
+	if (br >= step->min_br || step->min_br == 0)
+		return step->max_fps;
+
+	fps = (uint64_t)step->max_fps * br / step->min_br;
+
+	return (uint32_t)fps;
+}
+
+
+static void set_oppoint(struct vie_adapt *va, size_t idx, uint32_t fps)
+{
+	const struct vie_ladder_step *step = &va->stepv[idx];
+
+	va->op.step = idx;
+	va->op.width = step->width;
+	va->op.height = step->height;
+	va->op.fps = fps;
+	va->op.max_br = step->max_br;
+}
+
+
+static bool update(struct vie_adapt *va, uint64_t now, bool immediate)
+{
+	const struct vie_oppoint old = va->op;
+	size_t cur = va->op.step;
+	size_t best, i;
+	uint32_t fps;
+
+	/* Best step we could run at full framerate.  */
+	best = va->stepc - 1;
+	for (i = 0; i < va->stepc; ++i) {
+		if (va->bitrate >= va->stepv[i].min_br) {
+			best = i;
+			break;
+		}
+	}
+	best = std::max(best, va->cpu_step);
+
+	if (best < cur) {
+		if (!va->ts_up)
+			va->ts_up = now;
+		if (immediate || now - va->ts_up >= UP_HOLD_MS) {
+			cur = best;
+			va->ts_up = 0;
+		}
+	}
+	else {
+		va->ts_up = 0;
+	}
+
+	/* Going down: keep the resolution as long as the framerate
+	 * stays above min_fps.
+	 */
+	for (;;) {
+		const struct vie_ladder_step *step = &va->stepv[cur];
+
+		fps = step_fps(step, va->bitrate);
+		if (va->cpu_fps_limit)
+			fps = std::min(fps, step->min_fps);
+
+		if (fps >= step->min_fps || cur == va->stepc - 1)
+			break;
+
+		++cur;
+		va->ts_up = 0;
+	}
+
+	if (cur < va->cpu_step) {
+		cur = va->cpu_step;
+		fps = step_fps(&va->stepv[cur], va->bitrate);
+	}
+	fps = std::max(fps, va->stepv[cur].min_fps);
+	fps = std::min(fps, va->stepv[cur].max_fps);
+
+	set_oppoint(va, cur, fps);
+
+	return old.step != va->op.step || old.fps != va->op.fps;
+}
+
+
+int vie_adapt_alloc(struct vie_adapt **vap,
+		    const struct vie_ladder_step *stepv, size_t stepc)
+{
+	struct vie_adapt *va;
+
+	if (!vap)
+		return EINVAL;
+
+	if (!stepv) {
+		if (ladder.stepv) {
+			stepv = ladder.stepv;
+			stepc = ladder.stepc;
+		}
+		else {
+			stepv = default_ladder;
+			stepc = ARRAY_SIZE(default_ladder);
+
+			while (!ladder.hd && stepc > 1
+			       && stepv->height > SD_MAX_HEIGHT) {
+				++stepv;
+				--stepc;
+			}
+		}
+	}
+	if (!stepc)
+		return EINVAL;
+
+	va = (struct vie_adapt *)mem_zalloc(sizeof(*va), adapt_destructor);
+	if (!va)
+		return ENOMEM;
+
+	va->stepv = (struct vie_ladder_step *)
+		mem_alloc(stepc * sizeof(*stepv), NULL);
+	if (!va->stepv) {
+		mem_deref(va);
+		return ENOMEM;
+	}
+	memcpy(va->stepv, stepv, stepc * sizeof(*stepv));
+	va->stepc = stepc;
+
+	/* Start at the bottom until we know better.  */
+	set_oppoint(va, stepc - 1, va->stepv[stepc - 1].max_fps);
+
+	*vap = va;
+
+	return 0;
+}
+
+
+/* Returns true if the operating point has changed.
+ *
+ * The first call decides the starting point without waiting for the
+ * up-switch hold time.
+ */
+bool vie_adapt_set_bitrate(struct vie_adapt *va, uint32_t bitrate_bps,
+			   uint64_t now)
+{
+	bool first;
+
+	if (!va)
+		return false;
+
+	first = va->bitrate == 0;
+	va->bitrate = bitrate_bps / 1000;
+
+	return update(va, now, first);
+}
+
+
+/* On overuse first drop to the step's minimum framerate, then go down
+ * one step per report. Underuse lifts the limits again in reverse
+ * order, but not more often than every CPU_HOLD_MS.
+ */
+bool vie_adapt_set_cpu_overuse(struct vie_adapt *va, bool overuse,
+			       uint64_t now)
+{
+	if (!va)
+		return false;
+
+	if (overuse) {
+		if (!va->cpu_fps_limit
+		    && va->op.fps > va->stepv[va->op.step].min_fps) {
+			va->cpu_fps_limit = true;
+		}
+		else if (va->op.step < va->stepc - 1) {
+			va->cpu_step = va->op.step + 1;
+			va->cpu_fps_limit = false;
+		}
+		va->ts_cpu = now;
+	}
+	else {
+		if (now - va->ts_cpu < CPU_HOLD_MS)
+			return false;
+
+		if (va->cpu_fps_limit)
+			va->cpu_fps_limit = false;
+		else if (va->cpu_step > 0)
+			--va->cpu_step;
+		else
+			return false;
+		va->ts_cpu = now;
+	}
+
+	return update(va, now, false);
+}
+
+
+const struct vie_oppoint *vie_adapt_oppoint(const struct vie_adapt *va)
+{
+	return va ? &va->op : NULL;
+}
+
+
+int vie_adapt_debug(struct re_printf *pf, const struct vie_adapt *va)
+{
+	if (!va)
+		return 0;
+
+	return re_hprintf(pf, "%ux%u@%u (step %zu/%zu) br=%ukbps"
+			  " cpu_step=%zu%s",
+			  va->op.width, va->op.height, va->op.fps,
+			  va->op.step, va->stepc, va->bitrate,
+			  va->cpu_step,
+			  va->cpu_fps_limit ? " cpu_fps_limit" : "");
+}
+
+
+int vie_set_resolution_ladder(const struct vie_ladder_step *stepv,
+			      size_t stepc)
+{
+	struct vie_ladder_step *v = NULL;
+
+	if (stepv) {
+		if (!stepc)
+			return EINVAL;
+
+		v = (struct vie_ladder_step *)
+			mem_alloc(stepc * sizeof(*stepv), NULL);
+		if (!v)
+			return ENOMEM;
+		memcpy(v, stepv, stepc * sizeof(*stepv));
+	}
+
+	mem_deref(ladder.stepv);
+	ladder.stepv = v;
+	ladder.stepc = v ? stepc : 0;
+
+	return 0;
+}
+
+
+void vie_enable_hd(bool enable)
+{
+	ladder.hd = enable;
+}
+
+
+bool vie_have_hd(void)
+{
+	return ladder.hd;
+}
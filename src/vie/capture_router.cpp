@@ -35,6 +35,11 @@ static struct vie_capture_router {
 	webrtc::VideoCaptureInput *stream_input;
 	struct lock *lock;
 	bool buffer_rotate;
+	struct vidconv *vc;
+	int max_w;
+	int max_h;
+	uint8_t *scratch;
+	size_t scratch_sz;
 #if PRINT_PERIODIC_FRAME_STATS
 	struct timeb fps_time;
 	uint32_t fps_count;
@@ -43,6 +48,11 @@ static struct vie_capture_router {
 	.stream_input = NULL,
 	.lock = NULL,
 	.buffer_rotate = false,
+	.vc = NULL,
+	.max_w = 0,
+	.max_h = 0,
+	.scratch = NULL,
+	.scratch_sz = 0,
 };
 
 
@@ -52,11 +62,19 @@ int vie_capture_router_init(void)
 
 	router.stream_input = NULL;
 	router.buffer_rotate = false;
+	router.max_w = 0;
+	router.max_h = 0;
 
 	err = lock_alloc(&router.lock);
 	if (err)
 		return err;
 
+	err = vidconv_alloc(&router.vc);
+	if (err) {
+		router.lock = (struct lock *)mem_deref(router.lock);
+		return err;
+	}
+
 #if PRINT_PERIODIC_FRAME_STATS
 	ftime(&router.fps_time);
 	router.fps_count = 0;
@@ -72,6 +90,10 @@ void vie_capture_router_deinit(void)
 
 	mem_deref(router.lock);
 	router.lock = NULL;
+
+	router.vc = (struct vidconv *)mem_deref(router.vc);
+	router.scratch = (uint8_t *)mem_deref(router.scratch);
+	router.scratch_sz = 0;
 }
 
 
@@ -106,16 +128,115 @@ void vie_capture_router_detach_stream(webrtc::VideoCaptureInput *stream_input)
 	lock_rel(router.lock);
 }
 
+
+/* The resolution the encoder is configured for. Captured frames are
+ * scaled down to fit within it, in either orientation.
+ */
+void vie_capture_router_set_size(int w, int h)
+{
+	lock_write_get(router.lock);
+
+	debug("%s: %dx%d\n", __FUNCTION__, w, h);
+
+	router.max_w = w;
+	router.max_h = h;
+
+	lock_rel(router.lock);
+}
+
+
+/* Converts and scales the captured frame into an I420 frame of
+ * dw x dh, with the planes of dst.
+ */
+static int convert_frame(struct avs_vidframe *dst,
+			 const struct avs_vidframe *frame, int dw, int dh)
+{
+	struct avs_vidframe src = *frame;
+	size_t w = frame->w;
+	size_t h = frame->h;
+
+	switch (frame->type) {
+
+	case AVS_VIDFRAME_NV12:
+	case AVS_VIDFRAME_NV21:
+		/* Capturers deliver a contiguous buffer, the chroma
+		 * plane directly follows the luma plane.
+		 */
+		src.ys = w;
+		src.u = frame->y + w * h;
+		src.us = w;
+		break;
+
+	case AVS_VIDFRAME_I420:
+		if (!frame->u || !frame->v) {
+			src.ys = w;
+			src.us = src.vs = (w + 1) / 2;
+			src.u = frame->y + w * h;
+			src.v = src.u + src.us * ((h + 1) / 2);
+		}
+		break;
+
+	case AVS_VIDFRAME_YUY2:
+		if (!src.ys)
+			src.ys = 2 * w;
+		break;
+
+	case AVS_VIDFRAME_ARGB:
+		if (!src.ys)
+			src.ys = 4 * w;
+		break;
+	}
+
+	dst->type = AVS_VIDFRAME_I420;
+	dst->w = dw;
+	dst->h = dh;
+
+	return vidconv_to_i420(router.vc, dst, &src);
+}
+
+
+static int scratch_frame(struct avs_vidframe *vf, int w, int h)
+{
+	size_t ys = w;
+	size_t uvs = (ys + 1) / 2;
+	size_t sz = ys * h + 2 * uvs * ((h + 1) / 2);
+
+	if (router.scratch_sz < sz) {
+		mem_deref(router.scratch);
+		router.scratch_sz = 0;
+
+		router.scratch = (uint8_t *)mem_alloc(sz, NULL);
+		if (!router.scratch)
+			return ENOMEM;
+
+		router.scratch_sz = sz;
+	}
+
+	memset(vf, 0, sizeof(*vf));
+	vf->y = router.scratch;
+	vf->ys = ys;
+	vf->u = vf->y + ys * h;
+	vf->us = uvs;
+	vf->v = vf->u + uvs * ((h + 1) / 2);
+	vf->vs = uvs;
+
+	return 0;
+}
+
 extern "C" {
 
 void vie_capture_router_handle_frame(struct avs_vidframe *frame)
 {
 	webrtc::VideoFrame rtc_frame;
-	webrtc::VideoType rtc_type;
 	webrtc::VideoRotation rtc_rotation;
-	bool needs_convert = false;
-	int dw = frame->w;
-	int dh = frame->h;
+	webrtc::VideoRotation frot; /* Frame rotation */
+	webrtc::VideoRotation crot; /* Convert rotation */
+	struct avs_vidframe dst;
+	int max_w, max_h;
+	int sw, sh; /* scaled size, capture orientation */
+	int dw, dh; /* output size */
+	size_t dys, duvs;
+	int err = 0;
 
 #if PRINT_PERIODIC_FRAME_STATS
 	struct timeb now;
@@ -127,8 +248,9 @@ void vie_capture_router_handle_frame(struct avs_vidframe *frame)
 
 	if (msec > 5000) {
 		if (msec < 6000) {
-			info("Capturer: res %dx%d fps: %0.2f\n", dw, dh,
-				(float)router.fps_count * 1000.0f / msec); 
+			info("Capturer: res %dx%d fps: %0.2f\n",
+			     frame->w, frame->h,
+			     (float)router.fps_count * 1000.0f / msec); 
 		}
 		router.fps_count = 0;
 		router.fps_time = now;
@@ -139,43 +261,46 @@ void vie_capture_router_handle_frame(struct avs_vidframe *frame)
 
 	switch (frame->type) {
 		case AVS_VIDFRAME_I420:
-			rtc_type = webrtc::kI420;
-			break;
-			
 		case AVS_VIDFRAME_NV12:
-			rtc_type = webrtc::kNV12;
-			needs_convert = true;
-			break;
-			
 		case AVS_VIDFRAME_NV21:
-			rtc_type = webrtc::kNV21;
-			needs_convert = true;
+		case AVS_VIDFRAME_YUY2:
+		case AVS_VIDFRAME_ARGB:
 			break;
+
+		default:
+			warning("%s: unsupported frame type %d\n",
+				__FUNCTION__, frame->type);
+			return;
 	}
 
+	lock_read_get(router.lock);
+	max_w = router.max_w;
+	max_h = router.max_h;
+	lock_rel(router.lock);
+
+	/* Only convert the pixels the encoder is going to use */
+	vidconv_fit(&sw, &sh, frame->w, frame->h, max_w, max_h);
+	dw = sw;
+	dh = sh;
+
 	switch (frame->rotation) {
 		case 90:
 			rtc_rotation = webrtc::kVideoRotation_90;
 			if (router.buffer_rotate) {
-				dw = frame->h;
-				dh = frame->w;
-				needs_convert = true;
+				dw = sh;
+				dh = sw;
 			}
 			break;
 
 		case 180:
 			rtc_rotation = webrtc::kVideoRotation_180;
-			if (router.buffer_rotate) {
-				needs_convert = true;
-			}
 			break;
 
 		case 270:
 			rtc_rotation = webrtc::kVideoRotation_270;
 			if (router.buffer_rotate) {
-				dw = frame->h;
-				dh = frame->w;
-				needs_convert = true;
+				dw = sh;
+				dh = sw;
 			}
 			break;
 
@@ -185,39 +310,51 @@ void vie_capture_router_handle_frame(struct avs_vidframe *frame)
 			break;
 	}
 
-	//if (needs_convert) {
-	if (true) { // For now we will always convert
-		int err = 0;
-		size_t dys = dw;
-		size_t duvs = (dys + 1) / 2;
-		webrtc::VideoRotation frot; /* Frame rotation */
-		webrtc::VideoRotation crot; /* Convert rotation */
-		
-		frot = router.buffer_rotate ? webrtc::kVideoRotation_0
-			: rtc_rotation;
-		crot = router.buffer_rotate ? rtc_rotation
-			: webrtc::kVideoRotation_0;
-		
-		rtc_frame.CreateEmptyFrame(dw, dh, dys, duvs, duvs);
-		rtc_frame.set_rotation(frot);
-		
-		debug("%s: convert src %dx%d str %zu/%zu dst %dx%d "
-		      "str %zu/%zu rot %d\n",
-		      __FUNCTION__, frame->w, frame->h,
-		      frame->ys, frame->us, dw, dh, dys,
-		      duvs, crot);
-		
-		err = webrtc::ConvertToI420(rtc_type, frame->y, 0, 0,
-					    frame->w, frame->h, 0, crot,
-					    &rtc_frame);
-		if (err < 0) {
-			error("%s: failed to convert video frame (err=%d)\n",
-			      __FUNCTION__, err);
-			goto out;
-		}
+	frot = router.buffer_rotate ? webrtc::kVideoRotation_0
+		: rtc_rotation;
+	crot = router.buffer_rotate ? rtc_rotation
+		: webrtc::kVideoRotation_0;
+
+	dys = dw;
+	duvs = (dys + 1) / 2;
+
+	rtc_frame.CreateEmptyFrame(dw, dh, dys, duvs, duvs);
+	rtc_frame.set_rotation(frot);
+
+	debug("%s: convert src %dx%d str %zu/%zu dst %dx%d "
+	      "str %zu/%zu rot %d\n",
+	      __FUNCTION__, frame->w, frame->h,
+	      frame->ys, frame->us, dw, dh, dys,
+	      duvs, crot);
+
+	if (crot == webrtc::kVideoRotation_0) {
+		memset(&dst, 0, sizeof(dst));
+		dst.y = rtc_frame.video_frame_buffer()->MutableDataY();
+		dst.u = rtc_frame.video_frame_buffer()->MutableDataU();
+		dst.v = rtc_frame.video_frame_buffer()->MutableDataV();
+		dst.ys = rtc_frame.video_frame_buffer()->StrideY();
+		dst.us = rtc_frame.video_frame_buffer()->StrideU();
+		dst.vs = rtc_frame.video_frame_buffer()->StrideV();
+
+		err = convert_frame(&dst, frame, dw, dh);
 	}
 	else {
-		// Do fancy frame wrapping here
+		/* Scale first, so that the rotation only touches
+		 * the smaller frame.
+		 */
+		err = scratch_frame(&dst, sw, sh);
+		if (!err)
+			err = convert_frame(&dst, frame, sw, sh);
+		if (!err && webrtc::ConvertToI420(webrtc::kI420, dst.y, 0, 0,
+						  sw, sh, 0, crot,
+						  &rtc_frame) < 0)
+			err = EPROTO;
+	}
+
+	if (err) {
+		error("%s: failed to convert video frame (err=%d)\n",
+		      __FUNCTION__, err);
+		goto out;
 	}
 
 	lock_read_get(router.lock);
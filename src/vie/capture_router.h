@@ -31,5 +31,7 @@ void vie_capture_router_attach_stream(webrtc::VideoCaptureInput *stream_input,
 
 void vie_capture_router_detach_stream(webrtc::VideoCaptureInput *stream_input);
 
+void vie_capture_router_set_size(int w, int h);
+
 #endif  // CAPTURE_ROUTER_H
 
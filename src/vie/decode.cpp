@@ -27,9 +27,94 @@
 #include "webrtc/common_types.h"
 #include "webrtc/common.h"
 #include "webrtc/video_decoder.h"
+#include "webrtc/system_wrappers/include/clock.h"
 #include "vie.h"
 
 
+/* Decoder wrapper that skips VP8 temporal enhancement layers when the
+ * decoder can't keep up. Frames are still received and go through the
+ * jitter buffer as usual, so nothing is NACKed or re-keyed.
+ *
+ * NOTE: called from the decoder thread
+ */
+class ViETLDecoder : public webrtc::VideoDecoder
+{
+public:
+	ViETLDecoder(webrtc::VideoDecoder *decoder)
+		: _decoder(decoder)
+		, _sel(NULL)
+	{
+		vie_tl_sel_alloc(&_sel);
+	}
+
+	virtual ~ViETLDecoder()
+	{
+		mem_deref(_sel);
+	}
+
+	int32_t InitDecode(const webrtc::VideoCodec* codec_settings,
+			   int32_t number_of_cores) override
+	{
+		return _decoder->InitDecode(codec_settings, number_of_cores);
+	}
+
+	int32_t Decode(const webrtc::EncodedImage& input_image,
+		       bool missing_frames,
+		       const webrtc::RTPFragmentationHeader* fragmentation,
+		       const webrtc::CodecSpecificInfo* codec_specific_info,
+		       int64_t render_time_ms) override
+	{
+		if (codec_specific_info && _sel &&
+		    codec_specific_info->codecType == webrtc::kVideoCodecVP8) {
+			const webrtc::CodecSpecificInfoVP8 *vp8 =
+				&codec_specific_info->codecSpecific.VP8;
+			int64_t now = webrtc::Clock::GetRealTimeClock()
+				->TimeInMilliseconds();
+			uint8_t tid = vp8->temporalIdx == webrtc::kNoTemporalIdx
+				? 0 : vp8->temporalIdx;
+			bool key = input_image._frameType
+				== webrtc::kVideoFrameKey;
+
+			if (!vie_tl_sel_decode(_sel, tid, vp8->layerSync, key,
+					       render_time_ms < 0 ? 0
+					       : now - render_time_ms,
+					       (uint64_t)now)) {
+				return WEBRTC_VIDEO_CODEC_OK;
+			}
+		}
+
+		return _decoder->Decode(input_image, missing_frames,
+					fragmentation, codec_specific_info,
+					render_time_ms);
+	}
+
+	int32_t RegisterDecodeCompleteCallback(
+		webrtc::DecodedImageCallback* callback) override
+	{
+		return _decoder->RegisterDecodeCompleteCallback(callback);
+	}
+
+	int32_t Release() override
+	{
+		return _decoder->Release();
+	}
+
+	int32_t Reset() override
+	{
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	const struct vie_tl_sel *Selector() const
+	{
+		return _sel;
+	}
+
+private:
+	webrtc::VideoDecoder *_decoder;
+	struct vie_tl_sel *_sel;
+};
+
+
 static void vds_destructor(void *arg)
 {
 	struct viddec_state *vds = (struct viddec_state *)arg;
@@ -189,7 +274,8 @@ int vie_render_start(struct viddec_state *vds)
 	decoder.payload_type = vds->pt;
 	decoder.payload_name = "VP8";
 	vie->decoder = webrtc::VideoDecoder::Create(webrtc::VideoDecoder::kVp8);
-	decoder.decoder = vie->decoder;
+	vie->tl_decoder = new ViETLDecoder(vie->decoder);
+	decoder.decoder = vie->tl_decoder;
 	receive_config.decoders.push_back(decoder);
 
 	// TODO: find the new version of this flag
@@ -225,10 +311,13 @@ void vie_render_stop(struct viddec_state *vds)
 		vie->call->DestroyVideoReceiveStream(vie->receive_stream);
 	}
 
-    if(vie->decoder){
-        delete vie->decoder;
-    }
-    
+	if (vie->tl_decoder) {
+		delete vie->tl_decoder;
+		vie->tl_decoder = NULL;
+	}
+	if (vie->decoder) {
+		delete vie->decoder;
+	}
 
 	if (vie->receive_renderer) {
 		delete vie->receive_renderer;
@@ -310,16 +399,11 @@ void vie_dec_rtp_handler(struct viddec_state *vds,
 
 
 	stats_rtp_add_packet(&vie->stats_rx, pkt, len);
+	if (len > 1 && (pkt[1] & 0x7f) == vds->pt)
+		stats_rtp_add_vp8_packet(&vie->stats_rx, pkt, len);
 
 #if FORCE_VIDEO_RTP_RECORDING
-	// Only Save RTP header and length;
-	uint32_t len32 = (int32_t)len;
-	uint8_t buf[VIDEO_RTP_RECORDING_LENGTH + sizeof(uint32_t)]; // RTP header is 12 bytes but we also need header extension
-    
-	memcpy(buf, &len32, sizeof(uint32_t));
-	memcpy(&buf[sizeof(uint32_t)], pkt, VIDEO_RTP_RECORDING_LENGTH*sizeof(uint8_t));
-
-	vie->rtp_dump_in->DumpPacket(buf, sizeof(buf));
+	vie->rtp_dump_in->DumpPacket(pkt, len);
 #endif
 
 	delstat = vie->call->Receiver()->DeliverPacket(webrtc::MediaType::VIDEO, pkt, len, pt);
@@ -369,3 +453,25 @@ uint32_t vie_dec_getbw(struct viddec_state *vds)
 	return vds->vie->stats_tx.rtcp.bitrate_limit;
 }
 
+int vie_dec_debug(struct re_printf *pf, const struct viddec_state *vds)
+{
+	struct vie *vie = vds ? vds->vie : NULL;
+	int err = 0;
+
+	if (!vie)
+		return 0;
+
+	err |= re_hprintf(pf, "vie: tx: %H\n", stats_print, &vie->stats_tx);
+	err |= re_hprintf(pf, "vie: rx: %H\n", stats_print, &vie->stats_rx);
+	if (vie->ves) {
+		err |= re_hprintf(pf, "vie: send: %u temporal layers, %H\n",
+				  vie->ves->tlayers,
+				  vie_adapt_debug, vie->ves->adapt);
+	}
+	if (vie->tl_decoder) {
+		err |= re_hprintf(pf, "vie: recv: %H\n", vie_tl_sel_debug,
+				  vie->tl_decoder->Selector());
+	}
+
+	return err;
+}
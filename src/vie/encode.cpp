@@ -16,6 +16,7 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <pthread.h>
 #include <stdio.h>
 #include <re.h>
@@ -30,68 +31,61 @@
 #include "vie.h"
 
 enum {
-	MIN_SEND_BANDWIDTH = 100,  /* kilobits/second */
-	MAX_SEND_BANDWIDTH = 800,  /* kilobits/second */
-};
-
-const size_t num_resolutions = 4;
-const struct resolution_info {
-	uint32_t width;
-	uint32_t height;
-	uint32_t max_fps;
-	uint32_t min_br;
-	uint32_t max_br;
-}
-resolutions[num_resolutions] = {
-	{640, 480, 15, 500, 800},
-	{480, 360, 15, 200, 600},
-	{320, 240, 15, 100, 300},
-	{240, 180, 15,   0, 150}
+	MIN_SEND_BANDWIDTH    = 100,   /* kilobits/second */
+	MAX_SEND_BANDWIDTH    = 800,   /* kilobits/second */
+	MAX_SEND_BANDWIDTH_HD = 2500,  /* kilobits/second */
 };
 
 
 static enum flowmgr_video_send_state _send_state = FLOWMGR_VIDEO_SEND_NONE;
 
-static int get_resolution_for_bitrate(uint32_t bitrate)
-{
-	size_t r = 0;
-
-	while (r < num_resolutions - 1) {
-		if (bitrate > (resolutions[r].min_br * 1000)) {
-			break;
-		}
-		r++;
-	}
-
-	return r;
-}
-
-std::vector<webrtc::VideoStream> CreateVideoStream(size_t res_idx,
+std::vector<webrtc::VideoStream> CreateVideoStream(
+	const struct vie_oppoint *op, uint8_t tlayers,
 	bool rtp_rotation, int32_t max_bandwidth) {
 
 	std::vector<webrtc::VideoStream> stream_settings(1);
 	
-	uint32_t width = resolutions[res_idx].width;
-	uint32_t height = resolutions[res_idx].height;
-	uint32_t fps = resolutions[res_idx].max_fps;
+	uint32_t width = op->width;
+	uint32_t height = op->height;
+	uint32_t fps = op->fps;
 
 	stream_settings[0].width = rtp_rotation ? width : height;
 	stream_settings[0].height = rtp_rotation ? height : width;
 	stream_settings[0].max_framerate = fps;
 	stream_settings[0].min_bitrate_bps = MIN_SEND_BANDWIDTH * 1000;
 
+	/* Don't let the encoder spend more than the step is worth  */
+	if (op->max_br)
+		max_bandwidth = std::min(max_bandwidth, (int32_t)op->max_br);
+
 	stream_settings[0].target_bitrate_bps =
 		stream_settings[0].max_bitrate_bps = max_bandwidth * 1000;
 	stream_settings[0].max_qp = 56;
 
+	/* The number of thresholds sets the number of VP8 temporal layers,
+	 * each is the bitrate at which the next layer is added.
+	 */
+	int target = stream_settings[0].target_bitrate_bps;
+	if (tlayers == 2) {
+		stream_settings[0].temporal_layer_thresholds_bps.push_back(
+			target * 6 / 10);
+	}
+	else if (tlayers >= 3) {
+		stream_settings[0].temporal_layer_thresholds_bps.push_back(
+			target * 4 / 10);
+		stream_settings[0].temporal_layer_thresholds_bps.push_back(
+			target * 6 / 10);
+	}
+
 	return stream_settings;
 }
 
-webrtc::VideoEncoderConfig CreateEncoderConfig(size_t res_idx,
+webrtc::VideoEncoderConfig CreateEncoderConfig(
+	const struct vie_oppoint *op, uint8_t tlayers,
 	bool rtp_rotation, int32_t max_bandwidth) {
 
 	webrtc::VideoEncoderConfig encoder_config;
-	encoder_config.streams = CreateVideoStream(res_idx, rtp_rotation, 
+	encoder_config.streams = CreateVideoStream(op, tlayers, rtp_rotation,
 		max_bandwidth);
 	return encoder_config;
 }
@@ -115,11 +109,32 @@ static void ves_destructor(void *arg)
 		ves->vie->ves = NULL;
 	
 	mem_deref(ves->sdpm);
+	mem_deref(ves->adapt);
 	mem_deref(ves->vie);
 
 	_send_state = FLOWMGR_VIDEO_SEND_NONE;
 }
 
+/* Only send temporal layers if the remote side can make use of them  */
+static uint8_t fmtp_temporal_layers(const char *fmtp)
+{
+	struct pl pl, val;
+	uint32_t n;
+
+	if (!str_isset(fmtp))
+		return 1;
+
+	pl_set_str(&pl, fmtp);
+	if (!fmt_param_get(&pl, "x-temporal-layers", &val))
+		return 1;
+
+	n = pl_u32(&val);
+	if (n < 1)
+		return 1;
+
+	return (uint8_t)std::min(n, (uint32_t)vie_get_temporal_layers());
+}
+
 static bool check_rotation_attr(const char *name, const char *value, void *arg){
 	if (0 == re_regex(value, strlen(value), "urn:3gpp:video-orientation")){
 		return true;
@@ -137,21 +152,23 @@ static bool sdp_has_rtp_rotation(struct videnc_state *ves){
 
 static int32_t sdp_get_max_bandwidth(struct videnc_state *ves){
 	int32_t bw = sdp_media_rbandwidth(ves->sdpm, SDP_BANDWIDTH_AS);
+	int32_t max_bw = vie_have_hd() ? MAX_SEND_BANDWIDTH_HD
+		: MAX_SEND_BANDWIDTH;
 
 	debug("%s: sdpbw: %d min: %d max: %d\n", __FUNCTION__, bw,
-		MIN_SEND_BANDWIDTH, MAX_SEND_BANDWIDTH);
+		MIN_SEND_BANDWIDTH, max_bw);
 
 	if (bw < 0) {
 		/* Remote hasnt specified, send my max */
-		bw = MAX_SEND_BANDWIDTH;
+		bw = max_bw;
 	}
 	else if (bw < MIN_SEND_BANDWIDTH) {
 		/* Remotes max is less than my min, send my min */
 		bw = MIN_SEND_BANDWIDTH;
 	}
-	else if (bw > MAX_SEND_BANDWIDTH) {
+	else if (bw > max_bw) {
 		/* Remote accepts more than my max, send my max */
-		bw = MAX_SEND_BANDWIDTH;
+		bw = max_bw;
 	}
 	/* else send bw */
 	
@@ -205,6 +222,10 @@ int vie_enc_alloc(struct videnc_state **vesp,
 	ves->arg = arg;
 	if (prm)
 		ves->prm = *prm;
+	ves->tlayers = fmtp_temporal_layers(fmtp);
+
+	info("%s: sending %u temporal layer(s)\n", __FUNCTION__,
+	     ves->tlayers);
 
  out:
 	if (err) {
@@ -231,6 +252,7 @@ static bool rtx_format_handler(struct sdp_format *fmt, void *arg)
 static int vie_capture_start_int(struct videnc_state *ves)
 {
 	struct vie *vie = ves ? ves->vie: NULL;
+	const struct vie_oppoint *op;
 	int err = 0;
 
 	if (!ves || !vie)
@@ -243,13 +265,22 @@ static int vie_capture_start_int(struct videnc_state *ves)
 #endif
 
 	ves->max_bandwidth = sdp_get_max_bandwidth(ves);
-	ves->res_idx = get_resolution_for_bitrate(ves->max_bandwidth * 1000);
+
+	ves->adapt = (struct vie_adapt *)mem_deref(ves->adapt);
+	err = vie_adapt_alloc(&ves->adapt, NULL, 0);
+	if (err) {
+		/* return here to avoid protected scope error */
+		return err;
+	}
+	vie_adapt_set_bitrate(ves->adapt, ves->max_bandwidth * 1000,
+			      tmr_jiffies());
 
 	info("%s: remote side %s support rotation\n", __FUNCTION__,
 		ves->rtp_rotation ? "does" : "does not");
 	webrtc::VideoSendStream::Config send_config(vie->transport);
 	webrtc::VideoEncoderConfig encoder_config(CreateEncoderConfig(
-		ves->res_idx, ves->rtp_rotation, ves->max_bandwidth));
+		vie_adapt_oppoint(ves->adapt), ves->tlayers,
+		ves->rtp_rotation, ves->max_bandwidth));
 
 	send_config.rtp.ssrcs.push_back(ves->prm.local_ssrcv[0]);
 	send_config.rtp.nack.rtp_history_ms = 0;
@@ -302,6 +333,7 @@ static int vie_capture_start_int(struct videnc_state *ves)
 	send_config.encoder_settings.payload_name = ves->vc->name;
 	send_config.encoder_settings.payload_type = ves->pt;
 	send_config.suspend_below_min_bitrate = false;
+	send_config.overuse_callback = vie->load_observer;
 
 	vie->send_stream = vie->call->CreateVideoSendStream(send_config,
 							    encoder_config);
@@ -310,6 +342,8 @@ static int vie_capture_start_int(struct videnc_state *ves)
 		goto out;
 	}
 
+	op = vie_adapt_oppoint(ves->adapt);
+	vie_capture_router_set_size(op->width, op->height);
 	vie_capture_router_attach_stream(vie->send_stream->Input(), 
 		!ves->rtp_rotation);
 	debug("capture_start_device\n");
@@ -423,10 +457,29 @@ uint32_t vie_capture_getbw(struct videnc_state *ves)
 	return ves->vie->stats_rx.rtcp.bitrate_limit;
 }
 
+static void reconfigure_encoder(struct videnc_state *ves,
+				const struct vie_oppoint *prev,
+				const char *reason)
+{
+	struct vie *vie = ves->vie;
+	const struct vie_oppoint *op = vie_adapt_oppoint(ves->adapt);
+
+	info("%s: send resolution changed from %ux%u@%u to %ux%u@%u (%s)\n",
+	     __FUNCTION__,
+	     prev->width, prev->height, prev->fps,
+	     op->width, op->height, op->fps, reason);
+
+	webrtc::VideoEncoderConfig config = CreateEncoderConfig(op,
+		ves->tlayers, ves->rtp_rotation, ves->max_bandwidth);
+	vie->send_stream->ReconfigureVideoEncoder(config);
+
+	vie_capture_router_set_size(op->width, op->height);
+}
+
 void vie_bandwidth_allocation_changed(struct vie *vie, uint32_t ssrc, uint32_t allocation)
 {
 	struct videnc_state *ves = vie ? vie->ves : NULL;
-	int r = 0;
+	struct vie_oppoint prev;
 
 	if (!vie || !ves || !vie->send_stream) {
 		return;
@@ -436,25 +489,22 @@ void vie_bandwidth_allocation_changed(struct vie *vie, uint32_t ssrc, uint32_t a
 		return;
 	}
 
-	if (allocation < resolutions[ves->res_idx].min_br * 1000 ||
-		allocation > resolutions[ves->res_idx].max_br * 1000) {
-		size_t target_res = get_resolution_for_bitrate(allocation);
-
-		if (target_res != ves->res_idx) {
-			info("%s send resolution changed from %ux%u to %ux%u br: %u\n",
-				__FUNCTION__,
-				resolutions[ves->res_idx].width,
-				resolutions[ves->res_idx].height,
-				resolutions[target_res].width,
-				resolutions[target_res].height,
-				allocation);
-
-			webrtc::VideoEncoderConfig config = CreateEncoderConfig(target_res,
-				ves->rtp_rotation, ves->max_bandwidth);
-			vie->send_stream->ReconfigureVideoEncoder(config);
-			ves->res_idx = target_res;
-		}
-	}
+	prev = *vie_adapt_oppoint(ves->adapt);
+	if (vie_adapt_set_bitrate(ves->adapt, allocation, tmr_jiffies()))
+		reconfigure_encoder(ves, &prev, "bandwidth");
 }
 
+void vie_load_changed(struct vie *vie, bool overuse)
+{
+	struct videnc_state *ves = vie ? vie->ves : NULL;
+	struct vie_oppoint prev;
+
+	if (!vie || !ves || !vie->send_stream) {
+		return;
+	}
 
+	prev = *vie_adapt_oppoint(ves->adapt);
+	if (vie_adapt_set_cpu_overuse(ves->adapt, overuse, tmr_jiffies()))
+		reconfigure_encoder(ves, &prev, overuse ? "cpu overuse"
+				    : "cpu underuse");
+}
@@ -3,12 +3,14 @@
 #
 
 AVS_SRCS += \
+	vie/adapt.cpp \
 	vie/decode.cpp \
 	vie/encode.cpp \
 	vie/shared.cpp \
 	vie/vie.cpp \
 	vie/sdp.cpp \
 	vie/stats.cpp \
+	vie/tlayer.cpp \
 	vie/vie_renderer.cpp \
 	vie/capture_router.cpp
 
@@ -77,6 +77,8 @@ bool ViETransport::SendRtp(const uint8_t* packet, size_t length,
 	}
     
 	stats_rtp_add_packet(&vie->stats_tx, packet, length);
+	if (length > 1 && (packet[1] & 0x7f) == ves->pt)
+		stats_rtp_add_vp8_packet(&vie->stats_tx, packet, length);
 
 	if (ves->rtph) {
 		err = ves->rtph(packet, length, ves->arg);
@@ -86,14 +88,7 @@ bool ViETransport::SendRtp(const uint8_t* packet, size_t length,
 		}
     
 #if FORCE_VIDEO_RTP_RECORDING
-		// Only Save RTP header and length;
-		uint32_t len32 = (uint32_t)length;
-		uint8_t buf[VIDEO_RTP_RECORDING_LENGTH + sizeof(uint32_t)]; // RTP header is 12 bytes
-        
-		memcpy(buf, &len32, sizeof(uint32_t));
-		memcpy(&buf[sizeof(int32_t)], packet, VIDEO_RTP_RECORDING_LENGTH*sizeof(uint8_t));
-        
-		vie->rtp_dump_out->DumpPacket(buf, sizeof(buf));
+		vie->rtp_dump_out->DumpPacket(packet, length);
 #endif
 		return true;
 	}
@@ -129,27 +124,38 @@ bool ViETransport::SendRtcp(const uint8_t* packet, size_t length)
 	return -1;
 }
 
+enum {
+	VIE_MQ_OVERUSE,
+	VIE_MQ_UNDERUSE,
+};
+
 class ViELoadObserver : public webrtc::LoadObserver
 {
 	public:
     
-	ViELoadObserver(){};
+	ViELoadObserver(struct vie *vie_) : vie(vie_) {};
     
 	~ViELoadObserver(){}
     
+	/* NOTE: called from the encoder thread, the change is
+	 * passed to the main thread through the vie's mqueue.
+	 */
 	void OnLoadUpdate(Load load){
 		switch(load){
 			case webrtc::LoadObserver::kOveruse:
-				error("CPU is overused !!\n");
+				warning("CPU is overused !!\n");
+				mqueue_push(vie->mq, VIE_MQ_OVERUSE, NULL);
 				break;
             
 			case webrtc::LoadObserver::kUnderuse:
 				debug("CPU is underused !!\n");
+				mqueue_push(vie->mq, VIE_MQ_UNDERUSE, NULL);
 				break;
 		}
 	}
     
 	private:
+	struct vie *vie;
 };
 
 static void print_summary(struct vie *vie, int ch)
@@ -228,6 +234,9 @@ static void vie_destructor(void *arg)
     
 	if(vie->call)
 		delete vie->call;
+
+	/* after the call, so that no encoder thread can push anymore */
+	mem_deref(vie->mq);
     
 #if FORCE_VIDEO_RTP_RECORDING
 	if(vie->rtp_dump_in){
@@ -267,21 +276,26 @@ static void vie_start_rtp_dump(struct vie *vie)
 	tstruct = *localtime(&now);
 	strftime(buf, sizeof(buf), "%Y-%m-%d.%X", &tstruct);
 
-	std::string name_in = prefix + "VidIn";
-	std::string name_out = prefix + "VidOut";
-	name_in.insert(name_in.size(),buf);
-	name_in.insert(name_in.size(),".rtp");
-	name_out.insert(name_out.size(),buf);
-	name_out.insert(name_out.size(),".rtp");
-    
-	vie->rtp_dump_in->Start(name_in.c_str());
-	vie->rtp_dump_out->Start(name_out.c_str());
-    
-	name_in.insert(name_in.size()-1,"c");
-	vie->rtcp_dump_in->Start(name_in.c_str());
+	std::string name_in = prefix + "VidIn" + buf;
+	std::string name_out = prefix + "VidOut" + buf;
+
+	// Only save the RTP header and extensions
+	vie->rtp_dump_in->Start((name_in + "_rtp.pcapng").c_str(),
+				VIDEO_RTP_RECORDING_LENGTH);
+	vie->rtp_dump_out->Start((name_out + "_rtp.pcapng").c_str(),
+				 VIDEO_RTP_RECORDING_LENGTH);
 
-	name_out.insert(name_out.size()-1,"c");
-	vie->rtcp_dump_out->Start(name_out.c_str());
+	vie->rtcp_dump_in->Start((name_in + "_rtcp.pcapng").c_str());
+	vie->rtcp_dump_out->Start((name_out + "_rtcp.pcapng").c_str());
+}
+
+static void mq_callback(int id, void *data, void *arg)
+{
+	struct vie *vie = (struct vie *)arg;
+
+	(void)data;
+
+	vie_load_changed(vie, id == VIE_MQ_OVERUSE);
 }
 
 int vie_alloc(struct vie **viep, const struct vidcodec *vc, int pt)
@@ -300,12 +314,18 @@ int vie_alloc(struct vie **viep, const struct vidcodec *vc, int pt)
 
 	vie->ch = -1;
 
+	err = mqueue_alloc(&vie->mq, mq_callback, vie);
+	if (err) {
+		/* return here to avoid protected scope error */
+		mem_deref((void *)vie);
+		return err;
+	}
+
 	vie->transport = new ViETransport(vie);
-	vie->load_observer = new ViELoadObserver();
+	vie->load_observer = new ViELoadObserver(vie);
 	webrtc::Call::Config config;
 
-	// TODO: find how to set overuse callback
-	// config.overuse_callback = vie->load_observer;
+	/* The load observer is set per send stream, see encode.cpp */
 /* TODO: set bitrate limits */
 /*
 all_config.bitrate_config.min_bitrate_bps =
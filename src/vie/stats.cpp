@@ -38,6 +38,36 @@ void stats_rtp_add_packet(struct transp_stats *stats,
 }
 
 
+void stats_rtp_add_vp8_packet(struct transp_stats *stats,
+			      const uint8_t *data, size_t len)
+{
+	uint64_t now = tmr_jiffies();
+	uint8_t tid;
+	int i;
+
+	if (!stats)
+		return;
+
+	if (vie_vp8_tid(&tid, NULL, data, len) || tid >= VIE_MAX_TLAYERS)
+		return;
+
+	if (!stats->tl.ts)
+		stats->tl.ts = now;
+
+	if (now - stats->tl.ts >= 1000) {
+		uint64_t dur = now - stats->tl.ts;
+
+		for (i = 0; i < VIE_MAX_TLAYERS; ++i) {
+			stats->tl.bitrate[i] = stats->tl.bytes[i] * 8000 / dur;
+			stats->tl.bytes[i] = 0;
+		}
+		stats->tl.ts = now;
+	}
+
+	stats->tl.bytes[tid] += len;
+}
+
+
 int stats_rtcp_add_packet(struct transp_stats *stats,
 			  const uint8_t *data, size_t len)
 {
@@ -175,5 +205,10 @@ int stats_print(struct re_printf *pf, const struct transp_stats *stats)
 			  stats->rtcp.unknown
 			  );
 
+	err |= re_hprintf(pf, " TL={%u,%u,%u}kbps",
+			  stats->tl.bitrate[0] / 1000,
+			  stats->tl.bitrate[1] / 1000,
+			  stats->tl.bitrate[2] / 1000);
+
 	return err;
 }
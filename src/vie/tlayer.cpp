@@ -0,0 +1,281 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* VP8 temporal layers
+ *
+ * Parsing of the temporal layer index from the VP8 payload descriptor
+ * (RFC 7741) and the receive side layer selector. The selector decides
+ * per frame whether to decode it. When too many frames are decoded
+ * after their render time, it stops decoding the highest enhancement
+ * layer. Once decoding keeps up for a while, it goes back up, but only
+ * at a layer sync frame of the layer being added, so the decoder never
+ * sees a frame whose references it skipped.
+ */
+
+#include <re.h>
+
+#include <avs.h>
+#include <avs_vie.h>
+
+
+enum {
+	TL_WINDOW_MS    = 1000,
+	TL_UP_HOLD_MS   = 10000,
+	TL_LATE_PERCENT = 10,
+};
+
+
+static uint8_t tlayers = 1;
+static char tlayers_fmtp[32] = "";
+
+
+int vie_set_temporal_layers(uint8_t n)
+{
+	if (n < 1 || n > VIE_MAX_TLAYERS)
+		return EINVAL;
+
+	tlayers = n;
+
+	if (n > 1) {
+		re_snprintf(tlayers_fmtp, sizeof(tlayers_fmtp),
+			    "x-temporal-layers=%u", n);
+	}
+	else {
+		tlayers_fmtp[0] = '\0';
+	}
+
+	return 0;
+}
+
+
+uint8_t vie_get_temporal_layers(void)
+{
+	return tlayers;
+}
+
+
+/* The VP8 fmtp parameters, always valid and empty without layering */
+const char *vie_tlayer_fmtp(void)
+{
+	return tlayers_fmtp;
+}
+
+
+int vie_vp8_tid(uint8_t *tidp, bool *syncp, const uint8_t *pkt, size_t len)
+{
+	size_t pos;
+	uint8_t cc, b;
+	bool tbit, kbit;
+
+	if (!tidp || !pkt || len < RTP_HEADER_SIZE)
+		return EINVAL;
+
+	if ((pkt[0] >> 6) != RTP_VERSION)
+		return EBADMSG;
+
+	cc = pkt[0] & 0x0f;
+	pos = RTP_HEADER_SIZE + cc * 4;
+
+	if (pkt[0] & 0x10) {
+		uint16_t xlen;
+
+		if (len < pos + 4)
+			return EBADMSG;
+
+		xlen = (pkt[pos + 2] << 8) | pkt[pos + 3];
+		pos += 4 + xlen * 4;
+	}
+
+	if (len < pos + 1)
+		return EBADMSG;
+
+	*tidp = 0;
+	if (syncp)
+		*syncp = false;
+
+	/* X: no extension, so no layers  */
+	b = pkt[pos++];
+	if (!(b & 0x80))
+		return 0;
+
+	if (len < pos + 1)
+		return EBADMSG;
+	b = pkt[pos++];
+
+	tbit = b & 0x20;
+	kbit = b & 0x10;
+
+	/* I: picture id, 7 or 15 bits  */
+	if (b & 0x80) {
+		if (len < pos + 1)
+			return EBADMSG;
+		pos += (pkt[pos] & 0x80) ? 2 : 1;
+	}
+
+	/* L: TL0PICIDX  */
+	if (b & 0x40)
+		++pos;
+
+	if (!tbit && !kbit)
+		return 0;
+
+	if (len < pos + 1)
+		return EBADMSG;
+
+	if (tbit) {
+		*tidp = pkt[pos] >> 6;
+		if (syncp)
+			*syncp = pkt[pos] & 0x20;
+	}
+
+	return 0;
+}
+
+
+struct vie_tl_sel {
+	uint8_t max_tid;     /* highest layer currently decoded  */
+	uint8_t target_tid;  /* where we want to be  */
+
+	uint64_t ts_window;
+	uint32_t frames;
+	uint32_t late;
+
+	uint64_t ts_good;    /* since when are we keeping up, 0 if not  */
+
+	uint32_t skipped;
+};
+
+
+int vie_tl_sel_alloc(struct vie_tl_sel **selp)
+{
+	struct vie_tl_sel *sel;
+
+	if (!selp)
+		return EINVAL;
+
+	sel = (struct vie_tl_sel *)mem_zalloc(sizeof(*sel), NULL);
+	if (!sel)
+		return ENOMEM;
+
+	sel->max_tid = VIE_MAX_TLAYERS - 1;
+	sel->target_tid = sel->max_tid;
+
+	*selp = sel;
+
+	return 0;
+}
+
+
+static void update_target(struct vie_tl_sel *sel, uint64_t now)
+{
+	bool behind;
+
+	if (!sel->ts_window) {
+		sel->ts_window = now;
+		return;
+	}
+
+	if (now - sel->ts_window < TL_WINDOW_MS)
+		return;
+
+	behind = sel->late * 100 > sel->frames * TL_LATE_PERCENT;
+
+	if (behind) {
+		sel->ts_good = 0;
+		if (sel->target_tid > 0) {
+			--sel->target_tid;
+			info("vie: tlayer: decoder behind (%u/%u late), "
+			     "decoding up to layer %u\n",
+			     sel->late, sel->frames, sel->target_tid);
+		}
+	}
+	else if (sel->late == 0) {
+		if (!sel->ts_good)
+			sel->ts_good = now;
+
+		if (now - sel->ts_good >= TL_UP_HOLD_MS
+		    && sel->target_tid < VIE_MAX_TLAYERS - 1) {
+			++sel->target_tid;
+			sel->ts_good = now;
+			info("vie: tlayer: decoder keeping up, "
+			     "decoding up to layer %u\n", sel->target_tid);
+		}
+	}
+	else {
+		sel->ts_good = 0;
+	}
+
+	sel->ts_window = now;
+	sel->frames = 0;
+	sel->late = 0;
+}
+
+
+/* Returns true if the frame should be decoded.
+ *
+ * Pass the frame's temporal layer in *tid*, whether it is a layer sync
+ * frame in *sync*, whether it is a key frame in *key* and how many
+ * milliseconds after its render time it arrives at the decoder in
+ * *late_ms*.
+ */
+bool vie_tl_sel_decode(struct vie_tl_sel *sel, uint8_t tid, bool sync,
+		       bool key, int64_t late_ms, uint64_t now)
+{
+	if (!sel)
+		return true;
+
+	++sel->frames;
+	if (late_ms > 0)
+		++sel->late;
+
+	update_target(sel, now);
+
+	if (sel->target_tid < sel->max_tid) {
+		sel->max_tid = sel->target_tid;
+	}
+	else if (sel->target_tid > sel->max_tid) {
+		if (key)
+			sel->max_tid = sel->target_tid;
+		else if (sync && tid == sel->max_tid + 1)
+			sel->max_tid = tid;
+	}
+
+	if (tid > sel->max_tid) {
+		++sel->skipped;
+		return false;
+	}
+
+	return true;
+}
+
+
+uint8_t vie_tl_sel_max_tid(const struct vie_tl_sel *sel)
+{
+	return sel ? sel->max_tid : VIE_MAX_TLAYERS - 1;
+}
+
+
+int vie_tl_sel_debug(struct re_printf *pf, const struct vie_tl_sel *sel)
+{
+	if (!sel)
+		return 0;
+
+	return re_hprintf(pf, "decoding layers 0..%u (target %u),"
+			  " %u frames skipped",
+			  sel->max_tid, sel->target_tid, sel->skipped);
+}
@@ -70,7 +70,7 @@ static struct vidcodec vie_vidcodecv[NUM_CODECS] = {
 		.dec_holdh    = vie_render_hold,
 		.dec_rtph     = vie_dec_rtp_handler,
 		.dec_rtcph    = vie_dec_rtcp_handler,
-		.dec_debugh   = NULL,
+		.dec_debugh   = vie_dec_debug,
 		.dec_bwalloch = vie_dec_getbw,
 
 		.fmtp_ench    = vie_fmtp_enc,
@@ -183,6 +183,9 @@ int vie_init(struct list *vidcodecl)
 
 		vid_eng.codecs[i] = c;
 	}
+	/* Read when the SDP is made, so later changes are picked up */
+	vie_vidcodecv[0].fmtp = vie_tlayer_fmtp();
+
 	for (int i = 0; i < NUM_CODECS; ++i) {
 		const webrtc::VideoCodec *c;
 		struct vidcodec *vc = &vie_vidcodecv[i];
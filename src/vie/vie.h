@@ -41,6 +41,7 @@ static const int kAbsSendTimeExtensionId = 3;
 class ViERenderer;
 class ViECaptureRouter;
 class ViELoadObserver;
+class ViETLDecoder;
 
 class ViETransport : public webrtc::Transport
 {
@@ -79,11 +80,20 @@ struct transp_stats {
 		uint32_t ssrc;
 		uint32_t bitrate_limit;
 	} rtcp;
+
+	/* per temporal layer, VP8 packets only */
+	struct {
+		uint64_t ts;
+		size_t bytes[VIE_MAX_TLAYERS];
+		uint32_t bitrate[VIE_MAX_TLAYERS];  /* bits/s, last second */
+	} tl;
 };
 
 
 void stats_rtp_add_packet(struct transp_stats *stats,
 			  const uint8_t *data, size_t len);
+void stats_rtp_add_vp8_packet(struct transp_stats *stats,
+			      const uint8_t *data, size_t len);
 int  stats_rtcp_add_packet(struct transp_stats *stats,
 			   const uint8_t *data, size_t len);
 int  stats_print(struct re_printf *pf, const struct transp_stats *stats);
@@ -99,9 +109,10 @@ struct videnc_state {
 
 	int pt;
 	
-	size_t res_idx;
+	struct vie_adapt *adapt;
 	bool rtp_rotation;
 	size_t max_bandwidth;
+	uint8_t tlayers;
 
 	videnc_rtp_h *rtph;
 	videnc_rtcp_h *rtcph;
@@ -163,6 +174,7 @@ void vie_dec_rtp_handler(struct viddec_state *vds,
 void vie_dec_rtcp_handler(struct viddec_state *vds,
 			  const uint8_t *pkt, size_t len);
 uint32_t vie_dec_getbw(struct viddec_state *vds);
+int vie_dec_debug(struct re_printf *pf, const struct viddec_state *vds);
 
 void vie_update_ssrc_array( uint32_t array[], size_t *count, uint32_t val);
 
@@ -175,6 +187,7 @@ struct vie {
 	webrtc::Call *call;
 	ViETransport *transport;
 	ViELoadObserver *load_observer;
+	struct mqueue *mq;   /* load updates from the encoder thread */
     
 	/* Sender side */
 	webrtc::VideoEncoder* encoder;
@@ -182,6 +195,7 @@ struct vie {
 
 	/* Receiver side */
 	webrtc::VideoDecoder* decoder;
+	ViETLDecoder *tl_decoder;
 	webrtc::VideoReceiveStream* receive_stream;
 	ViERenderer *receive_renderer;
 
@@ -201,6 +215,7 @@ struct vie {
 
 int vie_alloc(struct vie **viep, const struct vidcodec *vc, int pt);
 void vie_bandwidth_allocation_changed(struct vie *vie, uint32_t ssrc, uint32_t allocation);
+void vie_load_changed(struct vie *vie, bool overuse);
 
 /* global */
 
@@ -247,6 +262,7 @@ const webrtc::VideoCodec *vie_find_codec(const struct vidcodec *vc);
 
 /* sdp */
 
+const char *vie_tlayer_fmtp(void);
 int vie_fmtp_enc(struct mbuf *mb, const struct sdp_format *fmt,
 		 bool offer, void *data);
 int vie_rtx_fmtp_enc(struct mbuf *mb, const struct sdp_format *fmt,
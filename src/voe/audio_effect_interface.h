@@ -29,10 +29,15 @@ extern "C" {
 
 class VoEAudioEffect : public webrtc::VoEMediaProcess {
 public:
-    VoEAudioEffect(bool test_mode) {
+    /* notifyh is called from the audio thread when Collect() should be
+     * called. Until the first frame the capture rate is not known, an
+     * effect set before then is re-created at the right rate.
+     */
+    VoEAudioEffect(bool test_mode, aueswitch_notify_h *notifyh, void *arg) {
         fs_hz_ = 32000;
         aueffect_alloc(&normalizer_, AUDIO_EFFECT_NORMALIZER, fs_hz_);
-        effect_ = NULL;
+        aueswitch_alloc(&effect_, fs_hz_);
+        aueswitch_set_notify_handler(effect_, notifyh, arg);
         force_reset_ = false;
         test_mode_ = test_mode;
         omega_ = 0.0f;
@@ -51,9 +56,6 @@ public:
     {
         if(samplingFreq != fs_hz_ || force_reset_){
             aueffect_reset(normalizer_, samplingFreq);
-            if(effect_){
-                aueffect_reset(effect_, samplingFreq);
-            }
             fs_hz_ = samplingFreq;
             if(samplingFreq > 0){
                 delta_omega_ = (2*3.14f*400.0f)/(samplingFreq);
@@ -64,19 +66,25 @@ public:
             GenerateSine(audio10ms, length);
         } else {
             size_t out_len;
-            if(effect_){
-                aueffect_process(effect_, audio10ms, audio10ms, length, &out_len);
-            }
+            aueswitch_process(effect_, audio10ms, length, samplingFreq);
             aueffect_process(normalizer_, audio10ms, audio10ms, length, &out_len);
         }
     }
-    void AddEffect(enum audio_effect effect_type)
+    /* Called from the control thread. The new effect is allocated here
+     * and cross-faded in by the audio thread on its next frame.
+     */
+    int AddEffect(enum audio_effect effect_type)
     {
-        mem_deref(effect_);
-        effect_ = NULL;
-        if(effect_type != AUDIO_EFFECT_NONE){
-            aueffect_alloc(&effect_, effect_type, fs_hz_);
-        }
+        return aueswitch_set(effect_, effect_type);
+    }
+    /* Called from the control thread when notified */
+    void Collect()
+    {
+        aueswitch_collect(effect_);
+    }
+    enum audio_effect GetEffect()
+    {
+        return aueswitch_effect(effect_);
     }
     void ResetNormalizer()
     {
@@ -96,7 +104,7 @@ private:
     }
     
     struct aueffect *normalizer_;
-    struct aueffect *effect_;
+    struct aueswitch *effect_;
     int fs_hz_;
     bool force_reset_;
     bool test_mode_;
@@ -0,0 +1,487 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Audio levels and active speaker selection
+ *
+ * Parsing of the RFC 6464 client-to-mixer audio level from the RFC 5285
+ * one-byte header extension, and the receive side selector that decides
+ * which streams are decoded. Streams are ranked by their smoothed level
+ * and only the loudest ones are decoded. A stream that stopped sending
+ * (DTX) counts as silent. A stream without audio levels is always
+ * decoded and does not take a slot. So is a stream that negotiated
+ * them but whose packets don't carry any, its level is unknown rather
+ * than silent.
+ *
+ * To avoid flapping between two speakers, a stream only replaces a
+ * decoded one if it is louder by SPK_HYST_DB and the decoded one has
+ * been selected for at least SPK_HOLD_MS.
+ */
+
+#include <re.h>
+
+#include <avs.h>
+#include <avs_voe.h>
+
+
+enum {
+	AULEVEL_PROFILE = 0xbede,
+
+	SPK_INTERVAL_MS = 100,
+	SPK_HOLD_MS     = 1000,
+	SPK_STALE_MS    = 500,
+	SPK_HYST_DB     = 6,
+	SPK_Q           = 16,   /* fixed point scale of the score  */
+};
+
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+
+/* Position of the extension element with the given id  */
+static int find_element(size_t *posp, size_t *elenp,
+			const uint8_t *pkt, size_t len, uint8_t id)
+{
+	size_t pos, end;
+
+	if (!pkt || len < RTP_HEADER_SIZE)
+		return EINVAL;
+
+	if ((pkt[0] >> 6) != RTP_VERSION)
+		return EBADMSG;
+
+	if (!(pkt[0] & 0x10) || id < 1 || id > 14)
+		return ENOENT;
+
+	pos = RTP_HEADER_SIZE + (pkt[0] & 0x0f) * 4;
+	if (len < pos + 4)
+		return EBADMSG;
+
+	/* Two-byte headers are never negotiated  */
+	if (get_u16(&pkt[pos]) != AULEVEL_PROFILE)
+		return ENOENT;
+
+	end = pos + 4 + get_u16(&pkt[pos + 2]) * 4;
+	pos += 4;
+	if (len < end)
+		return EBADMSG;
+
+	while (pos < end) {
+		uint8_t eid = pkt[pos] >> 4;
+		size_t elen = (pkt[pos] & 0x0f) + 1;
+
+		/* padding  */
+		if (eid == 0) {
+			++pos;
+			continue;
+		}
+		if (eid == 15)
+			break;
+
+		if (pos + 1 + elen > end)
+			return EBADMSG;
+
+		if (eid == id) {
+			*posp = pos;
+			*elenp = elen;
+			return 0;
+		}
+
+		pos += 1 + elen;
+	}
+
+	return ENOENT;
+}
+
+
+/* The level is in -dBov, 0 is the loudest and 127 is silence  */
+int voe_aulevel_parse(uint8_t *levelp, bool *vadp,
+		      const uint8_t *pkt, size_t len, uint8_t id)
+{
+	size_t pos, elen;
+	int err;
+
+	if (!levelp)
+		return EINVAL;
+
+	err = find_element(&pos, &elen, pkt, len, id);
+	if (err)
+		return err;
+
+	*levelp = pkt[pos + 1] & 0x7f;
+	if (vadp)
+		*vadp = pkt[pos + 1] & 0x80;
+
+	return 0;
+}
+
+
+/* Changes the id of the audio level element. A new id of 0 turns the
+ * element into padding, for receivers that did not negotiate it.
+ */
+int voe_aulevel_rewrite(uint8_t *pkt, size_t len, uint8_t id,
+			uint8_t new_id)
+{
+	size_t pos, elen;
+	int err;
+
+	if (id == new_id)
+		return 0;
+
+	if (new_id > 14)
+		return EINVAL;
+
+	err = find_element(&pos, &elen, pkt, len, id);
+	if (err)
+		return err;
+
+	if (new_id)
+		pkt[pos] = (new_id << 4) | (pkt[pos] & 0x0f);
+	else
+		memset(&pkt[pos], 0, 1 + elen);
+
+	return 0;
+}
+
+
+struct spk_stream {
+	struct le le;
+	int id;
+
+	int score;            /* smoothed dB above -127 dBov, in SPK_Q  */
+	bool has_level;
+	bool decoding;
+
+	uint64_t ts_level;
+	uint64_t ts_nolevel;  /* last packet without a level  */
+	uint64_t ts_selected;
+};
+
+struct voe_spksel {
+	struct list streaml;
+	size_t max_decode;
+
+	uint64_t ts_update;
+	uint32_t switches;
+};
+
+
+static void spksel_destructor(void *arg)
+{
+	struct voe_spksel *sel = (struct voe_spksel *)arg;
+
+	list_flush(&sel->streaml);
+}
+
+
+int voe_spksel_alloc(struct voe_spksel **selp, size_t max_decode)
+{
+	struct voe_spksel *sel;
+
+	if (!selp)
+		return EINVAL;
+
+	sel = (struct voe_spksel *)mem_zalloc(sizeof(*sel),
+					      spksel_destructor);
+	if (!sel)
+		return ENOMEM;
+
+	sel->max_decode = max_decode;
+
+	*selp = sel;
+
+	return 0;
+}
+
+
+void voe_spksel_set_max(struct voe_spksel *sel, size_t max_decode)
+{
+	if (!sel)
+		return;
+
+	sel->max_decode = max_decode;
+
+	/* Apply with the next level  */
+	sel->ts_update = 0;
+}
+
+
+size_t voe_spksel_max(const struct voe_spksel *sel)
+{
+	return sel ? sel->max_decode : 0;
+}
+
+
+static struct spk_stream *find_stream(const struct voe_spksel *sel, int id)
+{
+	struct le *le;
+
+	for (le = sel->streaml.head; le; le = le->next) {
+		struct spk_stream *st = (struct spk_stream *)le->data;
+
+		if (st->id == id)
+			return st;
+	}
+
+	return NULL;
+}
+
+
+static void stream_destructor(void *arg)
+{
+	struct spk_stream *st = (struct spk_stream *)arg;
+
+	list_unlink(&st->le);
+}
+
+
+/* Pass has_level if the stream was negotiated with audio levels. Until
+ * its first level arrives it counts as silent, unless its packets come
+ * without one, see voe_spksel_nolevel().
+ */
+int voe_spksel_add(struct voe_spksel *sel, int id, bool has_level)
+{
+	struct spk_stream *st;
+
+	if (!sel)
+		return EINVAL;
+
+	if (find_stream(sel, id))
+		return 0;
+
+	st = (struct spk_stream *)mem_zalloc(sizeof(*st), stream_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->id = id;
+	st->has_level = has_level;
+	st->decoding = true;
+
+	list_append(&sel->streaml, &st->le, st);
+
+	return 0;
+}
+
+
+void voe_spksel_remove(struct voe_spksel *sel, int id)
+{
+	if (!sel)
+		return;
+
+	mem_deref(find_stream(sel, id));
+}
+
+
+/* A packet of the stream arrived without an audio level  */
+void voe_spksel_nolevel(struct voe_spksel *sel, int id, uint64_t now)
+{
+	struct spk_stream *st;
+
+	if (!sel)
+		return;
+
+	st = find_stream(sel, id);
+	if (!st)
+		return;
+
+	st->ts_nolevel = now;
+}
+
+
+void voe_spksel_level(struct voe_spksel *sel, int id, uint8_t level,
+		      uint64_t now)
+{
+	struct spk_stream *st;
+	int x;
+
+	if (!sel)
+		return;
+
+	st = find_stream(sel, id);
+	if (!st)
+		return;
+
+	x = (127 - (level & 0x7f)) * SPK_Q;
+
+	if (!st->ts_level)
+		st->score = x;
+	st->has_level = true;
+
+	/* Fast attack, slow release  */
+	if (x > st->score)
+		st->score += (x - st->score) / 2;
+	else
+		st->score += (x - st->score) / 8;
+
+	st->ts_level = now;
+}
+
+
+/* Streams that are sending, but not their levels, can't be ranked  */
+static bool level_unknown(const struct spk_stream *st, uint64_t now)
+{
+	if (!st->has_level)
+		return true;
+
+	if (st->ts_level && now - st->ts_level <= SPK_STALE_MS)
+		return false;
+
+	return st->ts_nolevel && now - st->ts_nolevel <= SPK_STALE_MS;
+}
+
+
+static void select_stream(struct voe_spksel *sel, struct spk_stream *st,
+			  bool decoding, uint64_t now)
+{
+	st->decoding = decoding;
+	if (decoding)
+		st->ts_selected = now;
+
+	++sel->switches;
+
+	debug("voe: spksel: %s stream %d (level %d dB)\n",
+	      decoding ? "decoding" : "not decoding",
+	      st->id, st->score / SPK_Q);
+}
+
+
+/* Returns true if the set of decoded streams has changed.  */
+bool voe_spksel_update(struct voe_spksel *sel, uint64_t now)
+{
+	bool changed = false;
+	struct le *le;
+
+	if (!sel)
+		return false;
+
+	if (sel->ts_update && now - sel->ts_update < SPK_INTERVAL_MS)
+		return false;
+	sel->ts_update = now;
+
+	for (le = sel->streaml.head; le; le = le->next) {
+		struct spk_stream *st = (struct spk_stream *)le->data;
+
+		if (st->has_level && now - st->ts_level > SPK_STALE_MS)
+			st->score = 0;
+
+		if (st->decoding)
+			continue;
+
+		if (level_unknown(st, now) || !sel->max_decode) {
+			select_stream(sel, st, true, now);
+			changed = true;
+		}
+	}
+
+	if (!sel->max_decode)
+		return changed;
+
+	for (;;) {
+		struct spk_stream *best = NULL, *worst = NULL;
+		struct spk_stream *weakest = NULL;
+		size_t n = 0;
+
+		for (le = sel->streaml.head; le; le = le->next) {
+			struct spk_stream *st = (struct spk_stream *)le->data;
+
+			if (level_unknown(st, now))
+				continue;
+
+			if (!st->decoding) {
+				if (!best || st->score > best->score)
+					best = st;
+				continue;
+			}
+
+			++n;
+			if (!weakest || st->score < weakest->score)
+				weakest = st;
+
+			if (now - st->ts_selected < SPK_HOLD_MS)
+				continue;
+			if (!worst || st->score < worst->score)
+				worst = st;
+		}
+
+		if (n < sel->max_decode && best) {
+			select_stream(sel, best, true, now);
+		}
+		else if (n > sel->max_decode) {
+			select_stream(sel, weakest, false, now);
+		}
+		else if (best && worst
+			 && best->score > worst->score + SPK_HYST_DB * SPK_Q) {
+			select_stream(sel, worst, false, now);
+			select_stream(sel, best, true, now);
+		}
+		else {
+			break;
+		}
+
+		changed = true;
+	}
+
+	return changed;
+}
+
+
+/* Unknown streams are decoded  */
+bool voe_spksel_decoding(const struct voe_spksel *sel, int id)
+{
+	const struct spk_stream *st;
+
+	if (!sel)
+		return true;
+
+	st = find_stream(sel, id);
+
+	return st ? st->decoding : true;
+}
+
+
+int voe_spksel_debug(struct re_printf *pf, const struct voe_spksel *sel)
+{
+	struct le *le;
+	int err = 0;
+
+	if (!sel)
+		return 0;
+
+	err |= re_hprintf(pf, " decoded streams: max %zu, %u switches\n",
+			  sel->max_decode, sel->switches);
+
+	for (le = sel->streaml.head; le; le = le->next) {
+		const struct spk_stream *st =
+			(const struct spk_stream *)le->data;
+
+		if (st->has_level) {
+			err |= re_hprintf(pf, " ...channel=%d level=%d dB%s\n",
+					  st->id, st->score / SPK_Q,
+					  st->decoding ? " (decoding)" : "");
+		}
+		else {
+			err |= re_hprintf(pf, " ...channel=%d no level%s\n",
+					  st->id,
+					  st->decoding ? " (decoding)" : "");
+		}
+	}
+
+	return err;
+}
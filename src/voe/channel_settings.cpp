@@ -15,6 +15,7 @@
 * You should have received a copy of the GNU General Public License
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>
 #include <re.h>
 
 extern "C" {
@@ -47,6 +48,8 @@ int channel_data_add(struct list *ch_list, int ch, webrtc::CodecInst &c)
     cd->last_rtcp_ploss = 0;
     cd->interrupted = false;
     cd->out_vol_smth = -1.0f;
+
+    voe_channel_ctl_init(&cd->ctl, cd->packet_size_ms);
     
     list_append(ch_list, &cd->le, cd);
     
@@ -54,6 +57,16 @@ int channel_data_add(struct list *ch_list, int ch, webrtc::CodecInst &c)
 }
 
 
+void voe_channel_ctl_init(struct auctl *ctl, int packet_ms)
+{
+    mediastats_auctl_init(ctl);
+    ctl->cur.fec = ZETA_USE_INBAND_FEC;
+    ctl->cur.dtx = ZETA_USE_DTX;
+    ctl->cur.packet_ms = packet_ms;
+    ctl->dtx_allowed = ZETA_USE_DTX;
+}
+
+
 struct channel_data *find_channel_data(struct list *active_chs, int ch)
 {
     struct le *le;
@@ -71,22 +84,63 @@ struct channel_data *find_channel_data(struct list *active_chs, int ch)
     return NULL;
 }
 
+static int channel_packet_size(const struct voe *voe,
+                               const struct channel_data *cd)
+{
+    int packet_size_ms;
+
+    if (voe->manual_packet_size_ms)
+        return voe->manual_packet_size_ms;
+
+    packet_size_ms = std::max( voe->packet_size_ms, voe->min_packet_size_ms );
+#if ZETA_USE_LOSS_ADAPTATION
+    packet_size_ms = std::max( packet_size_ms, cd->ctl.cur.packet_ms );
+#endif
+
+    return packet_size_ms;
+}
+
+/* The controller's 40 ms packets go with the low bitrate, as the
+ * RTT/loss rule does for voe->packet_size_ms.
+ */
+static int channel_bitrate(const struct voe *voe,
+                           const struct channel_data *cd)
+{
+    if (voe->manual_bitrate_bps)
+        return voe->manual_bitrate_bps;
+
+#if ZETA_USE_LOSS_ADAPTATION
+    if (cd->ctl.cur.packet_ms > 20)
+        return ZETA_OPUS_BITRATE_LO_BPS;
+#endif
+
+    return voe->bitrate_bps;
+}
+
+static void set_channel_codec(struct voe *voe, struct channel_data *cd)
+{
+    webrtc::CodecInst c;
+    int packet_size_ms = channel_packet_size(voe, cd);
+
+    gvoe.codec->GetSendCodec(cd->channel_number, c);
+    c.pacsize = (c.plfreq * packet_size_ms) / 1000;
+    c.rate = channel_bitrate(voe, cd);
+    gvoe.codec->SetSendCodec(cd->channel_number, c);
+
+    cd->packet_size_ms = packet_size_ms;
+    cd->bitrate_bps = c.rate;
+}
+
 void voe_set_channel_load(struct voe *voe)
 {
     webrtc::CodecInst c;
     
-    int bitrate_bps = voe->manual_bitrate_bps ? voe->manual_bitrate_bps : voe->bitrate_bps;
-    int packet_size_ms = voe->manual_packet_size_ms ? voe->manual_packet_size_ms :
-    std::max( voe->packet_size_ms, voe->min_packet_size_ms );
-    
     struct le *le;
     for (le = gvoe.channel_data_list.head; le; le = le->next) {
         struct channel_data *cd = (struct channel_data *)le->data;
         
+        set_channel_codec(voe, cd);
         gvoe.codec->GetSendCodec(cd->channel_number, c);
-        c.pacsize = (c.plfreq * packet_size_ms) / 1000;
-        c.rate = bitrate_bps;
-        gvoe.codec->SetSendCodec(cd->channel_number, c);
         
         info("voe: Changing codec settings parameters for channel %d\n", cd->channel_number);
         info("voe: pltype = %d \n", c.pltype);
@@ -109,7 +163,11 @@ void voe_multi_party_packet_rate_control(struct voe *voe)
     int active_flows = list_count(&voe->channel_data_list);
     int min_packet_size_ms = 20;
     
-    if ( active_flows >= ACTIVE_FLOWS_FOR_60MS_PACKETS ) {
+    /* With a shared encoder the CPU cost does not grow with the group */
+    if ( voe_fanout_active(voe) ) {
+        min_packet_size_ms = 20;
+    }
+    else if ( active_flows >= ACTIVE_FLOWS_FOR_60MS_PACKETS ) {
         min_packet_size_ms = 60;
     }
     else if( active_flows >=  ACTIVE_FLOWS_FOR_40MS_PACKETS) {
@@ -128,8 +186,135 @@ void voe_multi_party_packet_rate_control(struct voe *voe)
 #define SWITCH_TO_SHORTER_PACKETS_RTT_MS  500
 #define SWITCH_TO_LONGER_PACKETS_RTT_MS   800
 
+#if ZETA_USE_LOSS_ADAPTATION
+/*
+ * Closed loop control of FEC, DTX and packet size per channel.
+ *
+ * The send side is only driven by what the remote side tells us about
+ * it, the loss from its receiver reports and the RTT. RTCP carries
+ * neither the burst length nor the concealment, so the controller sees
+ * the loss as random and no late packets. What we measure on our
+ * receive direction says nothing about the path the other way.
+ */
+static void channel_report(struct auctl_report *rep,
+                           const struct channel_data *cd)
+{
+    rep->loss_pct = cd->last_rtcp_ploss * 100.0f / 256.0f;
+    rep->mbl = 1.0f;
+    rep->expand_pct = 0.0f;
+    rep->rtt_ms = cd->last_rtcp_rtt;
+}
+
+static void apply_settings(struct voe *voe, struct channel_data *cd,
+                           const struct auctl_settings *prev)
+{
+    const struct auctl_settings *cur = &cd->ctl.cur;
+
+    /* The expected loss is not exposed by VoECodec, the channel feeds
+     * the RTCP loss to the encoder itself. Changing FEC or DTX recreates
+     * the encoder, so only do it when they change.
+     */
+    if (cur->fec != prev->fec)
+        gvoe.codec->SetFECStatus(cd->channel_number, cur->fec);
+
+    if (cur->dtx != prev->dtx) {
+        gvoe.codec->SetOpusDtx(cd->channel_number, cur->dtx);
+        cd->using_dtx = cur->dtx;
+    }
+
+    if (channel_packet_size(voe, cd) != cd->packet_size_ms
+        || channel_bitrate(voe, cd) != cd->bitrate_bps)
+        set_channel_codec(voe, cd);
+}
+
+static void adapt_channel(struct voe *voe, struct channel_data *cd)
+{
+    struct auctl_report rep;
+    const struct auctl_settings *cur = &cd->ctl.cur;
+    struct auctl_settings prev = cd->ctl.cur;
+
+    channel_report(&rep, cd);
+
+    if (!mediastats_auctl_update(&cd->ctl, &rep))
+        return;
+
+    info("voe: channel %d loss=%.1f%% rtt=%d ms:"
+         " fec=%d expected_loss=%d%% dtx=%d packet=%d ms\n",
+         cd->channel_number, rep.loss_pct, rep.rtt_ms,
+         cur->fec, cur->loss_pct, cur->dtx, cur->packet_ms);
+
+    apply_settings(voe, cd, &prev);
+}
+
+/* With the shared encoder one encoder serves all member flows, so its
+ * settings have to suit the worst of them. The primary's reports set
+ * the pace, the latest reports of the others are folded in.
+ */
+static void adapt_group(struct voe *voe)
+{
+    const struct auctl_settings *cur = &voe->fan_ctl.cur;
+    struct auctl_report rep;
+    struct le *le;
+    int n = 0;
+
+    for (le = voe->channel_data_list.head; le; le = le->next) {
+        struct channel_data *cd = (struct channel_data *)le->data;
+        struct auctl_report r;
+
+        if (!voe_fanout_member(voe, cd->channel_number, NULL))
+            continue;
+
+        channel_report(&r, cd);
+        if (n++ == 0) {
+            rep = r;
+            continue;
+        }
+
+        rep.loss_pct = std::max(rep.loss_pct, r.loss_pct);
+        rep.rtt_ms = std::max(rep.rtt_ms, r.rtt_ms);
+    }
+
+    if (!n || !mediastats_auctl_update(&voe->fan_ctl, &rep))
+        return;
+
+    info("voe: shared encoder, %d flows worst loss=%.1f%% rtt=%d ms:"
+         " fec=%d expected_loss=%d%% dtx=%d packet=%d ms\n",
+         n, rep.loss_pct, rep.rtt_ms,
+         cur->fec, cur->loss_pct, cur->dtx, cur->packet_ms);
+
+    for (le = voe->channel_data_list.head; le; le = le->next) {
+        struct channel_data *cd = (struct channel_data *)le->data;
+        struct auctl_settings prev = cd->ctl.cur;
+
+        if (!voe_fanout_member(voe, cd->channel_number, NULL))
+            continue;
+
+        cd->ctl.cur = *cur;
+        apply_settings(voe, cd, &prev);
+    }
+}
+#endif
+
 void voe_update_channel_stats(struct voe *voe, int ch_id, int rtcp_rttMs, int rtcp_loss_Q8)
 {
+#if ZETA_USE_LOSS_ADAPTATION
+    struct channel_data *cd = find_channel_data(&voe->channel_data_list, ch_id);
+    bool primary = false;
+
+    if (!cd)
+        return;
+
+    cd->last_rtcp_rtt = rtcp_rttMs;
+    cd->last_rtcp_ploss = rtcp_loss_Q8;
+
+    if (voe_fanout_member(voe, ch_id, &primary)) {
+        if (primary)
+            adapt_group(voe);
+    }
+    else {
+        adapt_channel(voe, cd);
+    }
+#else
     int rtt_ms = 0, frac_lost_Q8 = 0;
     struct le *le;
     for (le = voe->channel_data_list.head; le; le = le->next) {
@@ -155,4 +340,5 @@ void voe_update_channel_stats(struct voe *voe, int ch_id, int rtcp_rttMs, int rt
         voe->bitrate_bps = packet_size_ms == 20 ? ZETA_OPUS_BITRATE_HI_BPS : ZETA_OPUS_BITRATE_LO_BPS;
         voe_set_channel_load(voe);
     }
+#endif
 }
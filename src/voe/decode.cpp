@@ -96,6 +96,7 @@ int voe_dec_alloc(struct audec_state **adsp,
 
 	list_append(&gvoe.decl, &ads->le, ads);
 
+	ads->ve->aulevel_id = prm->aulevel_id;
 	ads->ac = ac;
 	ads->errh = errh;
 	ads->arg = arg;
@@ -125,6 +126,10 @@ int voe_dec_start(struct audec_state *ads)
 	ret = gvoe.base->StartReceive(ads->ve->ch);
 	ret += gvoe.base->StartPlayout(ads->ve->ch);
 
+	ads->started = true;
+	ads->playing = true;
+	voe_spksel_add(gvoe.spksel, ads->ve->ch, ads->ve->aulevel_id != 0);
+
 	gvoe.codec->GetSendCodec(ads->ve->ch, c);
 
 	channel_data_add(&gvoe.channel_data_list, ads->ve->ch, c);
@@ -155,6 +160,10 @@ void voe_dec_stop(struct audec_state *ads)
 
 	info("voe: stopping decoder\n");
 
+	voe_spksel_remove(gvoe.spksel, ads->ve->ch);
+	ads->started = false;
+	ads->playing = false;
+
 	if (!gvoe.base)
 		return;
 
@@ -184,3 +193,80 @@ void voe_dec_stop(struct audec_state *ads)
 #endif
 
 }
+
+
+/* A channel that is not playing still receives its packets, so RTCP
+ * and the jitter statistics stay up to date, but they are not inserted
+ * into NetEQ and nothing is decoded until the channel is selected again.
+ */
+void voe_dec_rtp_level(struct audec_state *ads,
+		       const uint8_t *pkt, size_t len)
+{
+	uint64_t now = tmr_jiffies();
+	uint8_t level;
+
+	if (!ads || !gvoe.spksel)
+		return;
+
+	if (ads->ve->aulevel_id) {
+		if (0 == voe_aulevel_parse(&level, NULL, pkt, len,
+					   ads->ve->aulevel_id))
+			voe_spksel_level(gvoe.spksel, ads->ve->ch, level, now);
+		else
+			voe_spksel_nolevel(gvoe.spksel, ads->ve->ch, now);
+	}
+
+	if (voe_spksel_update(gvoe.spksel, now))
+		voe_dec_select(&gvoe);
+}
+
+
+void voe_dec_select(struct voe *voe)
+{
+	struct le *le;
+
+	if (!voe || !voe->base)
+		return;
+
+	for (le = voe->decl.head; le; le = le->next) {
+		struct audec_state *ads = (struct audec_state *)le->data;
+		bool play;
+
+		if (!ads->started)
+			continue;
+
+		play = voe_spksel_decoding(voe->spksel, ads->ve->ch);
+		if (play == ads->playing)
+			continue;
+
+		debug("voe: %s decoding channel %d\n",
+		      play ? "start" : "stop", ads->ve->ch);
+
+		if (play)
+			voe->base->StartPlayout(ads->ve->ch);
+		else
+			voe->base->StopPlayout(ads->ve->ch);
+
+		ads->playing = play;
+	}
+}
+
+
+void voe_set_max_decoded_streams(size_t n)
+{
+	if (n)
+		info("voe: decoding the %zu loudest streams\n", n);
+	else
+		info("voe: decoding all streams\n");
+
+	voe_spksel_set_max(gvoe.spksel, n);
+
+	if (voe_spksel_update(gvoe.spksel, tmr_jiffies()))
+		voe_dec_select(&gvoe);
+}
+
+
+size_t voe_get_max_decoded_streams(void)
+{
+	return voe_spksel_max(gvoe.spksel);
+}
@@ -53,8 +53,16 @@ static void aes_destructor(void *arg)
 
 	voe_enc_stop(aes);
 
+	/* The primary may be sending to us without the mutex */
+	pthread_mutex_lock(&gvoe.enc_mutex);
 	list_unlink(&aes->le);
+	while (gvoe.fan_busy > 0)
+		pthread_cond_wait(&gvoe.fan_cond, &gvoe.enc_mutex);
+	if (aes->ve && aes->ve->aes == aes)
+		aes->ve->aes = NULL;
+	pthread_mutex_unlock(&gvoe.enc_mutex);
 
+	mem_deref(aes->fmtp);
 	mem_deref(aes->ve);
 }
 
@@ -93,17 +101,32 @@ int voe_enc_alloc(struct auenc_state **aesp,
 		*mctxp = (struct media_ctx *)aes->ve;
 	}
 
-	list_append(&gvoe.encl, &aes->le, aes);
-
 	aes->ve->aes = aes;
 	aes->ac = ac;
 	aes->rtph = rtph;
 	aes->rtcph = rtcph;
 	aes->errh = errh;
 	aes->arg = arg;
+	aes->fan.ssrc = prm->local_ssrc;
+
+	if (str_isset(fmtp)) {
+		err = str_dup(&aes->fmtp, fmtp);
+		if (err)
+			goto out;
+	}
+
+	pthread_mutex_lock(&gvoe.enc_mutex);
+	list_append(&gvoe.encl, &aes->le, aes);
+	pthread_mutex_unlock(&gvoe.enc_mutex);
+
+	aes->ve->aulevel_id = prm->aulevel_id;
 
 	if(gvoe.rtp_rtcp){
 		gvoe.rtp_rtcp->SetLocalSSRC(aes->ve->ch, prm->local_ssrc);
+		if (prm->aulevel_id) {
+			gvoe.rtp_rtcp->SetSendAudioLevelIndicationStatus(
+				aes->ve->ch, true, prm->aulevel_id);
+		}
 	}
 	if(gvoe.codec){
 		int ret = gvoe.codec->SetOpusCbr(aes->ve->ch, gvoe.cbr_enabled || prm->cbr);
@@ -115,6 +138,7 @@ int voe_enc_alloc(struct auenc_state **aesp,
 	} else {
 		prm->cbr = false;
 	}
+	aes->cbr = prm->cbr;
  out:
 	if (err) {
 		mem_deref(aes);
@@ -129,22 +153,18 @@ int voe_enc_alloc(struct auenc_state **aesp,
 
 int voe_enc_start(struct auenc_state *aes)
 {
-	int ret = 0;
 	if (!aes)
 		return EINVAL;
 
 	info("voe: starting encoder -- StartSend ch %d \n", aes->ve->ch);
 
+	pthread_mutex_lock(&gvoe.enc_mutex);
 	aes->started = true;
+	aes->fan.synced = false;
+	pthread_mutex_unlock(&gvoe.enc_mutex);
 
-	if (gvoe.base){
-		ret = gvoe.base->StartSend(aes->ve->ch);
-	}
-	if(ret){
-		ret = EIO;
-	}
-    
-	return ret;
+	/* Sends on this channel, or on the shared encoder's */
+	return voe_fanout_update(&gvoe);
 }
 
 
@@ -153,7 +173,9 @@ void voe_enc_stop(struct auenc_state *aes)
 	if (!aes)
 		return;
 
+	pthread_mutex_lock(&gvoe.enc_mutex);
 	aes->started = false;
+	pthread_mutex_unlock(&gvoe.enc_mutex);
 
 	if (gvoe.base){
 		info("voe: stopping encoder -- StopSend ch %d \n",
@@ -161,4 +183,7 @@ void voe_enc_stop(struct auenc_state *aes)
 
 		gvoe.base->StopSend(aes->ve->ch);
 	}
+
+	/* if it was the primary, another flow takes over */
+	voe_fanout_update(&gvoe);
 }
@@ -0,0 +1,528 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Shared encoder for group calls
+ *
+ * Every flow has its own VoiceEngine channel, but only one of them, the
+ * primary, is sending. Its packets are copied to all started flows with
+ * the same codec, fmtp and CBR setting, the members, with the flow's own
+ * SSRC, payload type, sequence number, timestamp offset and audio level
+ * extension id; SRTP is done per flow by the mediaflow as usual. Flows
+ * that negotiated something else send on their own channel.
+ *
+ * The other channels keep running RTCP for their flow, but as they are
+ * not sending VoiceEngine sends no SR for them, and without an SR the
+ * remote side's reports carry no RTT. So we send the SRs for those
+ * flows ourselves and take the RTT from the answers.
+ *
+ * When the primary goes away another flow takes over. Sequence numbers
+ * simply continue, timestamps are re-anchored on the wall clock so that
+ * every flow keeps seeing a continuous stream.
+ */
+
+#include <sys/time.h>
+#include <algorithm>
+#include <vector>
+#include <re.h>
+
+#include "webrtc/voice_engine/include/voe_base.h"
+#include "voe_settings.h"
+
+extern "C" {
+#include "avs_log.h"
+#include "avs_aucodec.h"
+}
+
+#include "voe.h"
+#include "avs_voe.h"
+
+
+enum {
+	FANOUT_MAX_PKT = 1500,
+	OPUS_RTP_CLOCK = 48000,
+	FANOUT_SR_INTERVAL = 2500,  /* ms */
+	RTCP_SR_SIZE = 28,
+	RTCP_RB_SIZE = 24,
+};
+
+
+/* A copy of the primary's packet, sent without the mutex */
+struct fanout_tx {
+	auenc_rtp_h *rtph;
+	auenc_rtcp_h *rtcph;
+	void *arg;
+	int ch;
+	size_t sr_len;
+	uint8_t sr[RTCP_SR_SIZE];
+};
+
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+
+static inline void put_u16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v & 0xff;
+}
+
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+
+static void ntp_now(uint32_t *sec, uint32_t *frac)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	*sec = (uint32_t)tv.tv_sec + 2208988800UL;
+	*frac = (uint32_t)(((uint64_t)tv.tv_usec << 32) / 1000000);
+}
+
+
+static bool fanout_compatible(const struct auenc_state *a,
+			      const struct auenc_state *b)
+{
+	if (a->ac != b->ac || a->cbr != b->cbr)
+		return false;
+
+	if (a->ve->srate != b->ve->srate)
+		return false;
+
+	if (!str_isset(a->fmtp) || !str_isset(b->fmtp))
+		return str_isset(a->fmtp) == str_isset(b->fmtp);
+
+	return 0 == str_casecmp(a->fmtp, b->fmtp);
+}
+
+
+static size_t sr_encode(uint8_t *p, const struct auenc_state *aes,
+			uint32_t ntp_sec, uint32_t ntp_frac)
+{
+	p[0] = RTP_VERSION << 6;  /* no report blocks */
+	p[1] = RTCP_SR;
+	put_u16(&p[2], RTCP_SR_SIZE / 4 - 1);
+	put_u32(&p[4], aes->fan.ssrc);
+	put_u32(&p[8], ntp_sec);
+	put_u32(&p[12], ntp_frac);
+	put_u32(&p[16], aes->fan.ts_last);
+	put_u32(&p[20], (uint32_t)aes->fan.n_pkt);
+	put_u32(&p[24], aes->fan.n_octets);
+
+	return RTCP_SR_SIZE;
+}
+
+
+bool voe_fanout_active(const struct voe *voe)
+{
+	return voe ? voe->shared_enc : false;
+}
+
+
+/* Picks the primary and makes sure only it and the flows it can't
+ * send for are sending. Call this whenever an encoder is started or
+ * stopped.
+ */
+int voe_fanout_update(struct voe *voe)
+{
+	std::vector<std::pair<int, bool> > sendv;
+	struct auenc_state *primary = NULL;
+	struct auenc_state *old;
+	struct le *le;
+	int primary_ch = -1;
+	int err = 0;
+
+	if (!voe)
+		return EINVAL;
+
+	pthread_mutex_lock(&voe->enc_mutex);
+
+	old = voe->enc_primary;
+
+	for (le = voe->encl.head; le; le = le->next) {
+		struct auenc_state *aes = (struct auenc_state *)le->data;
+
+		if (!aes->started)
+			continue;
+
+		if (aes == old) {
+			primary = aes;
+			break;
+		}
+		if (!primary)
+			primary = aes;
+	}
+
+	primary = voe->shared_enc ? primary : NULL;
+	voe->enc_primary = primary;
+
+	for (le = voe->encl.head; le; le = le->next) {
+		struct auenc_state *aes = (struct auenc_state *)le->data;
+		bool member;
+
+		member = primary && aes->started
+			&& fanout_compatible(aes, primary);
+
+		if (primary != old || member != aes->fan.member)
+			aes->fan.synced = false;
+		aes->fan.member = member;
+
+		if (aes->started) {
+			sendv.push_back(std::make_pair(aes->ve->ch,
+				!member || aes == primary));
+		}
+	}
+
+	if (primary)
+		primary_ch = primary->ve->ch;
+
+	pthread_mutex_unlock(&voe->enc_mutex);
+
+	if (primary && primary != old) {
+		info("voe: fanout: channel %d is encoding for all flows\n",
+		     primary_ch);
+	}
+
+	if (!voe->base)
+		return 0;
+
+	/* Not under the mutex, the channels may be waiting for it */
+	for (size_t i = 0; i < sendv.size(); i++) {
+		if (sendv[i].second) {
+			if (voe->base->StartSend(sendv[i].first))
+				err = EIO;
+		}
+		else {
+			voe->base->StopSend(sendv[i].first);
+		}
+	}
+
+	return err;
+}
+
+
+/* The copies are made under the mutex and sent after releasing it.
+ * fan_busy keeps the destination flows alive until then.
+ *
+ * NOTE: called from a WebRTC thread
+ */
+int voe_fanout_send(struct auenc_state *src, const uint8_t *pkt, size_t len)
+{
+	std::vector<struct fanout_tx> txv;
+	std::vector<uint8_t> bufv;
+	uint32_t ntp_sec, ntp_frac;
+	uint16_t seq;
+	uint32_t ts;
+	uint64_t now;
+	struct le *le;
+	int err = 0;
+
+	if (!src || !pkt)
+		return EINVAL;
+
+	if (len < RTP_HEADER_SIZE || len > FANOUT_MAX_PKT)
+		return EINVAL;
+
+	if ((pkt[0] >> 6) != RTP_VERSION)
+		return EBADMSG;
+
+	seq = get_u16(&pkt[2]);
+	ts = get_u32(&pkt[4]);
+	now = tmr_jiffies();
+	ntp_now(&ntp_sec, &ntp_frac);
+
+	pthread_mutex_lock(&gvoe.enc_mutex);
+
+	if (src != gvoe.enc_primary) {
+		auenc_rtp_h *rtph = src->rtph;
+		void *arg = src->arg;
+		bool own = src->started && !src->fan.member;
+
+		pthread_mutex_unlock(&gvoe.enc_mutex);
+
+		/* A flow the primary can't send for sends its own
+		 * packets. A channel that lost the primary role may
+		 * still have a packet in flight, drop it.
+		 */
+		if (!own || !rtph)
+			return 0;
+
+		err = rtph(pkt, len, arg);
+		if (err) {
+			warning("voe: fanout: rtp send to channel %d"
+				" failed (%m)\n", src->ve->ch, err);
+		}
+
+		return err;
+	}
+
+	bufv.resize(list_count(&gvoe.encl) * len);
+
+	for (le = gvoe.encl.head; le; le = le->next) {
+		struct auenc_state *aes = (struct auenc_state *)le->data;
+		uint32_t srate = aes->ve->srate;
+		struct fanout_tx tx;
+		uint8_t *buf;
+
+		if (!aes->fan.member || !aes->rtph)
+			continue;
+
+		if (!aes->fan.jfs_last) {
+			aes->fan.seq = seq;
+			aes->fan.ts_ofs = 0;
+		}
+		else if (!aes->fan.synced) {
+			uint32_t elapsed;
+
+			if (!srate)
+				srate = OPUS_RTP_CLOCK;
+
+			elapsed = (uint32_t)
+				((now - aes->fan.jfs_last) * srate / 1000);
+
+			aes->fan.ts_ofs = aes->fan.ts_last + elapsed - ts;
+		}
+		aes->fan.synced = true;
+
+		buf = &bufv[txv.size() * len];
+		memcpy(buf, pkt, len);
+		buf[1] = (buf[1] & 0x80) | (aes->ve->pt & 0x7f);
+		put_u16(&buf[2], aes->fan.seq);
+		put_u32(&buf[4], ts + aes->fan.ts_ofs);
+		put_u32(&buf[8], aes->fan.ssrc);
+		voe_aulevel_rewrite(buf, len, src->ve->aulevel_id,
+				    aes->ve->aulevel_id);
+
+		++aes->fan.seq;
+		aes->fan.ts_last = ts + aes->fan.ts_ofs;
+		aes->fan.jfs_last = now;
+		++aes->fan.n_pkt;
+		aes->fan.n_octets += len - RTP_HEADER_SIZE;
+
+		tx.rtph = aes->rtph;
+		tx.rtcph = aes->rtcph;
+		tx.arg = aes->arg;
+		tx.ch = aes->ve->ch;
+		tx.sr_len = 0;
+
+		/* The primary's channel sends its own SRs */
+		if (aes != src && aes->rtcph
+		    && now - aes->fan.jfs_sr >= FANOUT_SR_INTERVAL) {
+			tx.sr_len = sr_encode(tx.sr, aes, ntp_sec, ntp_frac);
+			aes->fan.jfs_sr = now;
+		}
+
+		txv.push_back(tx);
+	}
+
+	++gvoe.fan_busy;
+
+	pthread_mutex_unlock(&gvoe.enc_mutex);
+
+	for (size_t i = 0; i < txv.size(); i++) {
+		const struct fanout_tx *tx = &txv[i];
+		int e;
+
+		e = tx->rtph(&bufv[i * len], len, tx->arg);
+		if (e) {
+			warning("voe: fanout: rtp send to channel %d"
+				" failed (%m)\n", tx->ch, e);
+			err = e;
+		}
+
+		if (tx->sr_len)
+			tx->rtcph(tx->sr, tx->sr_len, tx->arg);
+	}
+
+	pthread_mutex_lock(&gvoe.enc_mutex);
+	if (--gvoe.fan_busy == 0)
+		pthread_cond_broadcast(&gvoe.fan_cond);
+	pthread_mutex_unlock(&gvoe.enc_mutex);
+
+	return err;
+}
+
+
+/* Looks for the answers to our SRs in the report blocks of an incoming
+ * RTCP packet, RTT = arrival - LSR - DLSR in 1/65536 s. Returns the
+ * last RTT of the channel's flow in ms, 0 if unknown.
+ */
+int voe_fanout_rtcp(struct voe_channel *ve, const uint8_t *pkt, size_t len)
+{
+	struct auenc_state *aes;
+	uint32_t ntp_sec, ntp_frac, mid;
+	size_t pos = 0;
+	int rtt_ms = 0;
+
+	if (!ve || !pkt)
+		return 0;
+
+	ntp_now(&ntp_sec, &ntp_frac);
+	mid = (ntp_sec << 16) | (ntp_frac >> 16);
+
+	pthread_mutex_lock(&gvoe.enc_mutex);
+
+	aes = ve->aes;
+	if (!aes)
+		goto out;
+
+	while (pos + 4 <= len) {
+		const uint8_t *p = &pkt[pos];
+		size_t plen = (get_u16(&p[2]) + 1) * 4;
+		unsigned rc = p[0] & 0x1f;
+		size_t off = 0;
+
+		if ((p[0] >> 6) != RTP_VERSION || pos + plen > len)
+			break;
+
+		if (p[1] == RTCP_SR)
+			off = RTCP_SR_SIZE;
+		else if (p[1] == RTCP_RR)
+			off = 8;
+		else
+			rc = 0;
+
+		for (; rc > 0 && off + RTCP_RB_SIZE <= plen; --rc) {
+			const uint8_t *rb = &p[off];
+			uint32_t lsr = get_u32(&rb[16]);
+			uint32_t dlsr = get_u32(&rb[20]);
+			uint32_t rtt = mid - lsr - dlsr;
+
+			off += RTCP_RB_SIZE;
+
+			if (get_u32(rb) != aes->fan.ssrc || !lsr)
+				continue;
+
+			/* clock jumps */
+			if (rtt > (60u << 16))
+				continue;
+
+			rtt_ms = (int)(((uint64_t)rtt * 1000) >> 16);
+			aes->fan.rtt_ms = std::max(rtt_ms, 1);
+		}
+
+		pos += plen;
+	}
+
+	rtt_ms = aes->fan.rtt_ms;
+
+ out:
+	pthread_mutex_unlock(&gvoe.enc_mutex);
+
+	return rtt_ms;
+}
+
+
+/* Whether the flow on channel ch is sent by the shared encoder  */
+bool voe_fanout_member(struct voe *voe, int ch, bool *primaryp)
+{
+	bool member = false;
+	struct le *le;
+
+	if (!voe)
+		return false;
+
+	pthread_mutex_lock(&voe->enc_mutex);
+
+	for (le = voe->encl.head; le; le = le->next) {
+		struct auenc_state *aes = (struct auenc_state *)le->data;
+
+		if (aes->ve->ch != ch)
+			continue;
+
+		member = aes->fan.member;
+		if (primaryp)
+			*primaryp = aes == voe->enc_primary;
+		break;
+	}
+
+	pthread_mutex_unlock(&voe->enc_mutex);
+
+	return member;
+}
+
+
+int voe_fanout_debug(struct re_printf *pf, const struct voe *voe)
+{
+	struct le *le;
+	int err = 0;
+
+	if (!voe)
+		return 0;
+
+	err |= re_hprintf(pf, " shared encoder:  %s",
+			  voe->shared_enc ? "yes" : "no");
+	if (voe->enc_primary) {
+		err |= re_hprintf(pf, " (channel %d)",
+				  voe->enc_primary->ve->ch);
+	}
+	err |= re_hprintf(pf, "\n");
+
+	if (!voe->shared_enc)
+		return err;
+
+	for (le = voe->encl.head; le; le = le->next) {
+		const struct auenc_state *aes =
+			(const struct auenc_state *)le->data;
+
+		err |= re_hprintf(pf, " ...channel=%d ssrc=0x%08x"
+				  " packets=%llu rtt=%d%s\n",
+				  aes->ve->ch, aes->fan.ssrc, aes->fan.n_pkt,
+				  aes->fan.rtt_ms,
+				  !aes->started ? " (stopped)" :
+				  !aes->fan.member ? " (own encoder)" : "");
+	}
+
+	return err;
+}
+
+
+void voe_enable_shared_encoder(bool enabled)
+{
+	if (gvoe.shared_enc == enabled)
+		return;
+
+	info("voe: shared encoder %s\n", enabled ? "enabled" : "disabled");
+
+	gvoe.shared_enc = enabled;
+
+	voe_fanout_update(&gvoe);
+	voe_multi_party_packet_rate_control(&gvoe);
+}
+
+
+bool voe_have_shared_encoder(void)
+{
+	return gvoe.shared_enc;
+}
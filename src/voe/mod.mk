@@ -3,9 +3,11 @@
 #
 
 AVS_SRCS += \
+	voe/aulevel.cpp \
 	voe/decode.cpp \
 	voe/device.cpp \
 	voe/encode.cpp \
+	voe/fanout.cpp \
 	voe/shared.cpp \
 	voe/voe.cpp \
 	voe/audio_test.cpp \
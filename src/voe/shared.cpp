@@ -80,7 +80,16 @@ public:
 		}
         
 		aes = ve->aes;
-		if (aes->rtph) {
+		if (!aes) {
+			err = ENOENT;
+			goto out;
+		}
+		if (voe_fanout_active(&gvoe)) {
+			err = voe_fanout_send(aes, packet, length);
+			if (err)
+				return false;
+		}
+		else if (aes->rtph) {
 			err = aes->rtph(packet, length, aes->arg);
 			if (err) {
 				warning("voe: rtp send failed (%m)\n", err);
@@ -136,7 +145,7 @@ public:
 
 		aes = ve->aes;
 
-		if (!aes->started)
+		if (!aes || !aes->started)
 			return true;
 
 		if (aes->rtcph) {
@@ -279,6 +288,16 @@ static void voe_setup_opus(bool use_stereo, int32_t rate_bps,
 	}
 }
 
+/* Called from the audio thread, the effects are collected on the main
+ * thread.
+ */
+static void aueffect_notify_handler(void *arg)
+{
+	(void)arg;
+
+	mqueue_push(gvoe.mq, VOE_MQ_AUEFFECT, NULL);
+}
+
 static void ve_destructor(void *arg)
 {
 	struct voe_channel *ve = (struct voe_channel *)arg;
@@ -309,6 +328,7 @@ static void ve_destructor(void *arg)
 		gvoe.external_media->DeRegisterExternalMediaProcessing(-1, webrtc::kRecordingAllChannelsMixed);
 		if(gvoe.voe_audio_effect){
 			delete gvoe.voe_audio_effect;
+			gvoe.voe_audio_effect = NULL;
 		}
         
 		tmr_cancel(&gvoe.tmr_neteq_stats);
@@ -386,7 +406,9 @@ int voe_ve_alloc(struct voe_channel **vep, const struct aucodec *ac,
 			test_mode = true;
 		}
         
-		gvoe.voe_audio_effect = new VoEAudioEffect(test_mode);
+		gvoe.voe_audio_effect = new VoEAudioEffect(test_mode,
+							   aueffect_notify_handler,
+							   NULL);
 		if(gvoe.voe_audio_effect){
 			gvoe.external_media->RegisterExternalMediaProcessing(-1,
 									webrtc::kRecordingAllChannelsMixed, *gvoe.voe_audio_effect);
@@ -503,7 +525,8 @@ int voe_set_audio_effect(enum audio_effect effect_type)
 		case AUDIO_EFFECT_HARMONIZER_MED:
 		case AUDIO_EFFECT_HARMONIZER_MAX:
 		case AUDIO_EFFECT_NONE:
-			gvoe.voe_audio_effect->AddEffect(effect_type);
+			if (gvoe.voe_audio_effect->AddEffect(effect_type))
+				ret = -1;
 			break;
 		case AUDIO_EFFECT_REVERB_MAX:
 		case AUDIO_EFFECT_REVERB_MID:
@@ -528,6 +551,10 @@ int voe_set_audio_effect(enum audio_effect effect_type)
     
 audio_effect voe_get_audio_effect()
 {
-	return AUDIO_EFFECT_NONE;
+	if(!gvoe.voe_audio_effect){
+		return AUDIO_EFFECT_NONE;
+	}
+
+	return gvoe.voe_audio_effect->GetEffect();
 }
 
@@ -114,6 +114,11 @@ static void mq_callback(int id, void *data, void *arg)
 		mem_deref(med);
 		break;
     }
+
+	case VOE_MQ_AUEFFECT:
+		if (gvoe.voe_audio_effect)
+			gvoe.voe_audio_effect->Collect();
+		break;
         
     }
 }
@@ -280,6 +285,7 @@ static int rtp_handler(struct audec_state *ads,
 	    
 	if (gvoe.nw){
 		set_interrupted(ads->ve->ch, false);
+		voe_dec_rtp_level(ads, pkt, len);
 
 		gvoe.nw->ReceivedRTPPacket(ads->ve->ch, pkt, len);
 
@@ -319,7 +325,12 @@ static int rtcp_handler(struct audec_state *ads,
 		gvoe.rtp_rtcp->GetRemoteRTCPData( ads->ve->ch, NTPHigh, NTPLow, timestamp, playoutTimestamp, &jitter, &fractionLostUp_Q8);
 		debug("voe: Channel %d RTCP:  RTT = %d ms; uplink packet loss perc = %d downlink packet loss perc = %d\n", ads->ve->ch, stats.rttMs, (int)(fractionLostUp_Q8/2.55f+0.5f), (int)(stats.fractionLost/2.55f+0.5f));
         
-        voe_update_channel_stats(&gvoe, ads->ve->ch, stats.rttMs, fractionLostUp_Q8);
+        rtt_ms = stats.rttMs;
+        /* VoE has no RTT for flows sent by the shared encoder */
+        if (rtt_ms <= 0 && voe_fanout_active(&gvoe))
+            rtt_ms = voe_fanout_rtcp(ads->ve, pkt, len);
+
+        voe_update_channel_stats(&gvoe, ads->ve->ch, rtt_ms, fractionLostUp_Q8);
     }
 	return 0;
 }
@@ -436,6 +447,8 @@ void voe_close(void)
     
 	list_flush(&gvoe.channel_data_list);
 
+	gvoe.spksel = (struct voe_spksel *)mem_deref(gvoe.spksel);
+
 	gvoe.playout_device = (char *)mem_deref(gvoe.playout_device);
 	gvoe.path_to_files = (char *)mem_deref(gvoe.path_to_files);
 
@@ -463,6 +476,8 @@ int voe_init(struct list *aucodecl)
 #endif
     
 	memset(&gvoe, 0, sizeof(gvoe));
+	pthread_mutex_init(&gvoe.enc_mutex, NULL);
+	pthread_cond_init(&gvoe.fan_cond, NULL);
 
 	gvoe.ve = webrtc::VoiceEngine::Create();
 	if (!gvoe.ve) {
@@ -576,6 +591,7 @@ int voe_init(struct list *aucodecl)
 	list_init(&gvoe.channel_data_list);
 	gvoe.packet_size_ms = 20;
 	gvoe.min_packet_size_ms = 20;
+	voe_channel_ctl_init(&gvoe.fan_ctl, gvoe.packet_size_ms);
 	gvoe.manual_packet_size_ms = 0;
 	gvoe.bitrate_bps = ZETA_OPUS_BITRATE_HI_BPS;
 	gvoe.manual_bitrate_bps = 0;
@@ -588,6 +604,11 @@ int voe_init(struct list *aucodecl)
 	gvoe.isSilenced = false;
     
 	gvoe.cbr_enabled = false;
+	gvoe.shared_enc = ZETA_USE_SHARED_ENCODER;
+
+	err = voe_spksel_alloc(&gvoe.spksel, ZETA_MAX_DECODED_STREAMS);
+	if (err)
+		goto out;
     
 	gvoe.adm = NULL;
     
@@ -767,15 +788,23 @@ int voe_debug(struct re_printf *pf, void *unused)
 	}
 	err |= re_hprintf(pf, "\n");
 
+	err |= voe_fanout_debug(pf, &gvoe);
+	err |= re_hprintf(pf, "\n");
+
 	err |= re_hprintf(pf, " decoders (%u):\n", list_count(&gvoe.decl));
 	for (le = gvoe.decl.head; le; le = le->next) {
 		struct audec_state *ads = (struct audec_state *)le->data;
 
-		err |= re_hprintf(pf, " ...%s channel=%d\n",
-				  ads->ac->name, ads->ve->ch);
+		err |= re_hprintf(pf, " ...%s channel=%d%s\n",
+				  ads->ac->name, ads->ve->ch,
+				  ads->started && !ads->playing
+				  ? " (not decoding)" : "");
 	}
 	err |= re_hprintf(pf, "\n");
 
+	err |= voe_spksel_debug(pf, gvoe.spksel);
+	err |= re_hprintf(pf, "\n");
+
 	return err;
 }
 
@@ -43,6 +43,7 @@
 #include "avs_audio_io.h"
 #include "avs_flowmgr.h"
 #include "avs_rtpdump.h"
+#include "avs_mediastats.h"
 
 #include "audio_effect_interface.h"
 
@@ -63,6 +64,7 @@ void voe_update_channel_stats(struct voe *voe,
                               int channel_id,
                               int rtcp_rttMs,
                               int rtcp_loss_Q8);
+void voe_channel_ctl_init(struct auctl *ctl, int packet_ms);
 
 /* encoder */
 
@@ -76,6 +78,25 @@ struct auenc_state {
 	auenc_rtcp_h *rtcph;
 	auenc_err_h *errh;
 	void *arg;
+
+	/* Only flows with the same codec setup share an encoder */
+	char *fmtp;
+	bool cbr;
+
+	/* RTP header of this flow when sending shared encoder output */
+	struct {
+		bool member;       /* sent by the primary */
+		uint32_t ssrc;
+		uint16_t seq;
+		uint32_t ts_ofs;
+		uint32_t ts_last;
+		uint64_t jfs_last;
+		bool synced;
+		uint64_t n_pkt;
+		uint32_t n_octets;
+		uint64_t jfs_sr;   /* our own sender reports */
+		int rtt_ms;        /* from their answers, 0 if unknown */
+	} fan;
 };
 
 int voe_enc_alloc(struct auenc_state **aesp,
@@ -90,6 +111,16 @@ int voe_enc_alloc(struct auenc_state **aesp,
 int  voe_enc_start(struct auenc_state *aes);
 void voe_enc_stop(struct auenc_state *aes);
 
+/* shared encoder */
+int  voe_fanout_update(struct voe *voe);
+bool voe_fanout_active(const struct voe *voe);
+int  voe_fanout_send(struct auenc_state *aes,
+		     const uint8_t *pkt, size_t len);
+int  voe_fanout_rtcp(struct voe_channel *ve,
+		     const uint8_t *pkt, size_t len);
+bool voe_fanout_member(struct voe *voe, int ch, bool *primaryp);
+int  voe_fanout_debug(struct re_printf *pf, const struct voe *voe);
+
 /* decoder */
 
 struct audec_state {
@@ -97,6 +128,8 @@ struct audec_state {
 
 	struct voe_channel *ve;
 	struct le le;
+	bool started;
+	bool playing;  /* not playing means not decoded, see aulevel.cpp */
 
 	audec_err_h *errh;
     
@@ -114,6 +147,9 @@ int  voe_dec_alloc(struct audec_state **adsp,
 int  voe_dec_start(struct audec_state *ads);
 int  voe_get_stats(struct audec_state *ads, struct aucodec_stats *new_stats);
 void voe_dec_stop(struct audec_state *ads);
+void voe_dec_rtp_level(struct audec_state *ads,
+		       const uint8_t *pkt, size_t len);
+void voe_dec_select(struct voe *voe);
 void voe_calculate_stats(int ch);
 void voe_set_channel_load(struct voe *voe);
 
@@ -137,6 +173,7 @@ void voe_stop_audio_test(struct voe *voe);
 
 enum {
 	VOE_MQ_ERR = 0,
+	VOE_MQ_AUEFFECT,
 };
 
 class VoETransport;
@@ -153,6 +190,7 @@ struct voe_channel {
 
 	uint32_t srate;
 	int pt;
+	uint8_t aulevel_id;  /* RFC 6464 extmap id, 0 if none */
 
 	VoETransport *transport;
     
@@ -195,6 +233,9 @@ struct channel_data {
 	int stats_idx;
 	int stats_cnt;
 	float out_vol_smth;
+
+	/* Loss adaptation, see channel_settings.cpp */
+	struct auctl ctl;
 };
 
 int channel_data_add(struct list *ch_list, int ch, webrtc::CodecInst &c);
@@ -236,6 +277,17 @@ struct voe {
 	bool isSilenced;
     
 	bool cbr_enabled;
+
+	/* One encoder for all flows, see fanout.cpp */
+	bool shared_enc;
+	struct auenc_state *enc_primary;
+	pthread_mutex_t enc_mutex;  /* encl, started and enc_primary */
+	pthread_cond_t fan_cond;    /* signals fan_busy dropping to 0 */
+	int fan_busy;               /* fanout sends without the mutex */
+	struct auctl fan_ctl;       /* loss adaptation of the group */
+
+	/* Only the loudest streams are decoded, see aulevel.cpp */
+	struct voe_spksel *spksel;
     
 	char *path_to_files;
     
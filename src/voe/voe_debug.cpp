@@ -169,9 +169,9 @@ void voe_start_rtp_dump(struct voe_channel *ve)
     strftime(buf, sizeof(buf), "%Y-%m-%d.%X", &tstruct);
     
     file_in.insert(file_in.size(),buf);
-    file_in.insert(file_in.size(),".rtpdump");
+    file_in.insert(file_in.size(),".pcapng");
     file_out.insert(file_out.size(),buf);
-    file_out.insert(file_out.size(),".rtpdump");
+    file_out.insert(file_out.size(),".pcapng");
     
     if(ve->rtp_dump_in){
         ve->rtp_dump_in->Start(file_in.c_str());
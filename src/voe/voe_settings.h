@@ -37,6 +37,18 @@
 
 #define ZETA_USE_DTX                     false
 
+#define ZETA_USE_LOSS_ADAPTATION         true
+/* FEC and packet size follow the loss reported for each channel, or
+ * the worst one of the group with the shared encoder, see
+ * channel_settings.cpp. DTX only follows it if ZETA_USE_DTX is set.
+ */
+
+#define ZETA_USE_SHARED_ENCODER          true
+/* Group calls encode once and send the packets to all flows */
+
+#define ZETA_MAX_DECODED_STREAMS         3
+/* Group calls only decode the loudest streams, 0 decodes all */
+
 /* --- HP Filter Settings              --- */
 #define ZETA_USE_HP                          true
 
@@ -87,6 +87,16 @@ int ztime_get(struct ztime *ztime)
 	if (!ztime)
 		return EINVAL;
 
+	/* Simulations run on the timer clock */
+	if (tmr_clock_isvirtual()) {
+		const uint64_t jfs = tmr_jiffies();
+
+		ztime->sec  = jfs / 1000;
+		ztime->msec = jfs % 1000;
+
+		return 0;
+	}
+
 	if (0 != gettimeofday(&now, NULL))
 		return errno;
 
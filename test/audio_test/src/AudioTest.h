@@ -39,6 +39,8 @@ int voe_conf_test(int argc, char *argv[], const char *path);
 
 int voe_conf_test_dec(const char *path, bool use_build_in_aec, int num_channels);
 
+int voe_conf_test_topn(const char *path, int num_senders, int max_decoded);
+
 int start_stop_stress_test(int argc, char *argv[], const char *path);
 
 int voe_loopback_test(int argc, char *argv[], const char *path);
@@ -0,0 +1,551 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Conference with many senders where only the loudest are decoded
+ *
+ * Like voe_conf_test_dec, but every sender puts the RFC 6464 audio
+ * level in its packets and the receiver runs them through the speaker
+ * selector. The senders take turns talking, with the next one in line
+ * talking quietly in the background, everybody else is silent.
+ *
+ * usage: voe_conf_test_topn [num_senders] [max_decoded]
+ *
+ * Run once with max_decoded 0 (decode all) and once with the default
+ * to compare the CPU time.
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "webrtc/modules/audio_coding/include/audio_coding_module.h"
+#include "webrtc/system_wrappers/include/trace.h"
+
+#include "webrtc/voice_engine/include/voe_base.h"
+#include "webrtc/voice_engine/include/voe_network.h"
+#include "webrtc/voice_engine/include/voe_codec.h"
+#include "webrtc/voice_engine/include/voe_conf_control.h"
+#include "webrtc/voice_engine/include/voe_errors.h"
+
+#include "NwSimulator.h"
+
+#include <re.h>
+#include <avs.h>
+#include <avs_voe.h>
+
+#if defined(WEBRTC_ANDROID)
+#include <android/log.h>
+#endif
+
+#define RTP_HEADER_IN_BYTES 12
+#define RTP_EXT_IN_BYTES 8
+#define MAX_PACKET_SIZE_BYTES 1000
+
+#define DELTA_TIME_MS 10
+#define PACKET_SIZE_MS 20
+#define NUM_FRAMES 3000
+
+#define DEFAULT_NUM_SENDERS 16
+#define DEFAULT_MAX_DECODED 3
+#define TALK_TURN_MS 3000
+#define BACKGROUND_GAIN 0.1f
+
+#define AULEVEL_EXT_ID 1
+
+#if defined(WEBRTC_ANDROID)
+#define LOG(...) ((void)__android_log_print(ANDROID_LOG_INFO, "audiotest : voe_conf_test_topn", __VA_ARGS__))
+#else
+#define LOG(...) printf(__VA_ARGS__)
+#endif
+
+static int MakeRTPheader( uint8_t* rtpHeader,
+                  const uint8_t payloadType,
+                  const uint16_t seqNum,
+                  const uint32_t timeStamp,
+                  const uint32_t ssrc,
+                  const uint8_t level){
+
+    rtpHeader[0] = (uint8_t) 0x90;
+    rtpHeader[1] = (uint8_t) (payloadType & 0xFF);
+    rtpHeader[2] = (uint8_t) ((seqNum >> 8) & 0xFF);
+    rtpHeader[3] = (uint8_t) (seqNum & 0xFF);
+    rtpHeader[4] = (uint8_t) ((timeStamp >> 24) & 0xFF);
+    rtpHeader[5] = (uint8_t) ((timeStamp >> 16) & 0xFF);
+    rtpHeader[6] = (uint8_t) ((timeStamp >> 8) & 0xFF);
+    rtpHeader[7] = (uint8_t) (timeStamp & 0xFF);
+    rtpHeader[8] = (uint8_t) ((ssrc >> 24) & 0xFF);
+    rtpHeader[9] = (uint8_t) ((ssrc >> 16) & 0xFF);
+    rtpHeader[10] = (uint8_t) ((ssrc >> 8) & 0xFF);
+    rtpHeader[11] = (uint8_t) (ssrc & 0xFF);
+
+    /* One-byte header extension with the audio level only */
+    rtpHeader[12] = 0xBE;
+    rtpHeader[13] = 0xDE;
+    rtpHeader[14] = 0;
+    rtpHeader[15] = 1;
+    rtpHeader[16] = (uint8_t) (AULEVEL_EXT_ID << 4);
+    rtpHeader[17] = level & 0x7F;
+    rtpHeader[18] = 0;
+    rtpHeader[19] = 0;
+
+    return(RTP_HEADER_IN_BYTES + RTP_EXT_IN_BYTES);
+}
+
+/* Level in -dBov as in RFC 6464, 127 is silence */
+static uint8_t frame_level(const int16_t *buf, size_t n)
+{
+    double energy = 0;
+
+    for(size_t i = 0; i < n; i++){
+        energy += (double)buf[i] * buf[i];
+    }
+    double rms = sqrt(energy / n);
+    if(rms < 1.0){
+        return 127;
+    }
+    int level = (int)(-20.0 * log10(rms / 32768.0) + 0.5);
+
+    return (uint8_t)std::max(0, std::min(127, level));
+}
+
+/**************************************************/
+/* Transport callback writes to file              */
+/**************************************************/
+class TransportCallBack : public webrtc::AudioPacketizationCallback {
+
+public:
+    TransportCallBack( std::string name, uint32_t ssrc ){
+        seqNo_ = 0;
+        ssrc_ = ssrc;
+        level_ = 127;
+        timestamp_offset_ = rand();
+        fp_ = fopen(name.c_str(),"wb");
+    }
+
+    ~TransportCallBack(){
+        if(fp_){
+            fclose(fp_);
+        }
+    }
+
+    /* The loudest frame in the packet counts */
+    void AddLevel(uint8_t level){
+        level_ = std::min(level_, level);
+    }
+
+    int32_t SendData(
+                    webrtc::FrameType     frame_type,
+                    uint8_t       payload_type,
+                    uint32_t      timestamp,
+                    const uint8_t* payload_data,
+                    size_t      payload_len_bytes,
+                    const webrtc::RTPFragmentationHeader* fragmentation){
+
+        int headerLenBytes;
+        uint32_t packetLenBytes = 0;
+
+        timestamp = timestamp + timestamp_offset_;
+
+        headerLenBytes = MakeRTPheader(packet_,
+                                       payload_type,
+                                       seqNo_++,
+                                       timestamp,
+                                       ssrc_,
+                                       level_);
+        level_ = 127;
+
+        if( payload_len_bytes < MAX_PACKET_SIZE_BYTES ){
+            memcpy(&packet_[headerLenBytes], payload_data, payload_len_bytes * sizeof(uint8_t));
+            packetLenBytes = (uint32_t)payload_len_bytes + (uint32_t)headerLenBytes;
+        }
+
+        /* Packets are written in send order, one every PACKET_SIZE_MS */
+        int32_t ms = (int32_t)(seqNo_ - 1) * PACKET_SIZE_MS;
+
+        fwrite( &ms, sizeof(int32_t), 1, fp_);
+        fwrite( &packetLenBytes, sizeof(uint32_t), 1, fp_);
+        fwrite( packet_, sizeof(uint8_t), packetLenBytes, fp_);
+
+        return (int)packetLenBytes;
+    }
+
+private:
+    uint32_t ssrc_;
+    uint16_t seqNo_;
+    uint8_t level_;
+    uint32_t timestamp_offset_;
+    uint8_t  packet_[RTP_HEADER_IN_BYTES + RTP_EXT_IN_BYTES + MAX_PACKET_SIZE_BYTES];
+    FILE* fp_;
+};
+
+class DummyTransport : public webrtc::Transport {
+public:
+	virtual bool SendRtp(const uint8_t* packet, size_t length, const webrtc::PacketOptions& options) {
+        return true;
+    };
+
+    virtual bool SendRtcp(const uint8_t* packet, size_t length) {
+        return true;
+    };
+};
+
+class VoELogCallback : public webrtc::TraceCallback {
+public:
+    VoELogCallback() {};
+    virtual ~VoELogCallback() {};
+
+    virtual void Print(webrtc::TraceLevel lvl, const char* message,
+                       int len) override
+    {
+        LOG("%s \n", message);
+    };
+};
+
+static VoELogCallback logCb;
+
+struct test_setup{
+    const char *path;
+    int num_senders;
+    int max_decoded;
+};
+
+/* Who is talking at time t, and who is in the background */
+static float sender_gain(int sender, int num_senders, int t_ms)
+{
+    int turn = t_ms / TALK_TURN_MS;
+
+    if(sender == turn % num_senders){
+        return 1.0f;
+    }
+    if(sender == (turn + 1) % num_senders){
+        return BACKGROUND_GAIN;
+    }
+    return 0.0f;
+}
+
+static double cpu_time_ms(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+
+    return ru.ru_utime.tv_sec*1000.0 + ru.ru_utime.tv_usec/1000.0 +
+        ru.ru_stime.tv_sec*1000.0 + ru.ru_stime.tv_usec/1000.0;
+}
+
+struct channel_info {
+    int sender;
+    int channel_id;
+    DummyTransport* transport;
+    NwSimulator* nw_sim;
+    FILE* fp;
+    bool file_ended;
+    bool playing;
+};
+
+static void run_test(struct test_setup *setup)
+{
+    webrtc::VoiceEngine* ve = webrtc::VoiceEngine::Create();
+    webrtc::VoEBase* base = webrtc::VoEBase::GetInterface(ve);
+    webrtc::VoENetwork *nw = webrtc::VoENetwork::GetInterface(ve);
+    webrtc::VoECodec *codec = webrtc::VoECodec::GetInterface(ve);
+    webrtc::VoEConfControl *conferencing = webrtc::VoEConfControl::GetInterface(ve);
+
+    std::vector<std::string> rtp_files, in_files;
+    std::string file_path = setup->path;
+
+    if(file_path.length() && file_path[file_path.length()-1] != '/'){
+        file_path = file_path + "/";
+    }
+
+    in_files.push_back(file_path + "far32.pcm");
+    in_files.push_back(file_path + "testfile2_32kHz.pcm");
+    in_files.push_back(file_path + "testfile3_32kHz.pcm");
+    in_files.push_back(file_path + "testfile32kHz.pcm");
+    in_files.push_back(file_path + "iLike32.pcm");
+    in_files.push_back(file_path + "However32.pcm");
+    in_files.push_back(file_path + "ScottishFootball32.pcm");
+
+    webrtc::CodecInst c;
+
+    for( int i = 0; i < codec->NumOfCodecs(); i++ ){
+        codec->GetCodec( i, c);
+        if(strcmp(c.plname,"opus") == 0){
+            break;
+        }
+    }
+    c.rate = 32000;
+    c.channels = 1;
+    c.pacsize = (c.plfreq * PACKET_SIZE_MS) / 1000;
+
+    /* Encode the senders to RTP stream files, the input files are
+       reused when there are more senders than files */
+    for( int i = 0; i < setup->num_senders; i++){
+        std::unique_ptr<webrtc::AudioCodingModule> acm(webrtc::AudioCodingModule::Create(0));
+        acm->RegisterSendCodec(c);
+
+        char buf[32];
+        sprintf(buf, "rtp_topn_ch#%d.dat", i);
+        std::string rtp_file_name = buf;
+#if TARGET_OS_IPHONE || defined(WEBRTC_ANDROID)
+        rtp_file_name = file_path + rtp_file_name;
+#endif
+        rtp_files.push_back(rtp_file_name);
+
+        TransportCallBack tCB( rtp_file_name, 0x1000 + i );
+        acm->RegisterTransportCallback(&tCB);
+
+        const std::string &in_name = in_files[i % in_files.size()];
+        FILE *in_file = fopen(in_name.c_str(),"rb");
+        if(in_file == NULL){
+            LOG("Cannot open %s for reading \n", in_name.c_str());
+            continue;
+        }
+
+        webrtc::AudioFrame audioframe;
+        audioframe.sample_rate_hz_ = 32000;
+        audioframe.num_channels_ = 1;
+        audioframe.samples_per_channel_ = audioframe.sample_rate_hz_/100;
+        size_t size = audioframe.samples_per_channel_ * audioframe.num_channels_;
+
+        for(int n = 0; n < NUM_FRAMES; n++ ) {
+            size_t read_count = fread(audioframe.data_, sizeof(int16_t), size, in_file);
+            if(read_count < size){
+                rewind(in_file);
+                read_count = fread(audioframe.data_, sizeof(int16_t), size, in_file);
+                if(read_count < size){
+                    break;
+                }
+            }
+            float gain = sender_gain(i, setup->num_senders, n * DELTA_TIME_MS);
+            for(size_t k = 0; k < size; k++){
+                audioframe.data_[k] = (int16_t)(audioframe.data_[k] * gain);
+            }
+            tCB.AddLevel(frame_level(audioframe.data_, size));
+
+            audioframe.timestamp_ = n * audioframe.samples_per_channel_;
+            acm->Add10MsData(audioframe);
+        }
+        fclose(in_file);
+    }
+
+    webrtc::Trace::CreateTrace();
+    webrtc::Trace::SetTraceCallback(&logCb);
+    webrtc::Trace::set_level_filter(webrtc::kTraceWarning | webrtc::kTraceError | webrtc::kTraceCritical);
+
+    base->Init();
+
+    struct voe_spksel *sel = NULL;
+    voe_spksel_alloc(&sel, setup->max_decoded);
+
+    std::vector<struct channel_info> chv;
+    std::list<int> conf_list;
+
+    for( int i = 0; i < setup->num_senders; i++){
+        struct channel_info ci;
+
+        ci.sender = i;
+        ci.channel_id = base->CreateChannel();
+        ci.transport = new DummyTransport();
+        nw->RegisterExternalTransport(ci.channel_id, *ci.transport);
+
+        ci.nw_sim = new NwSimulator();
+        ci.nw_sim->Init(PACKET_SIZE_MS, 0, 1.0f, NW_type_clean, file_path);
+
+        ci.fp = fopen(rtp_files[i].c_str(),"rb");
+        ci.file_ended = ci.fp == NULL;
+        ci.playing = true;
+
+        codec->SetSendCodec(ci.channel_id, c);
+        base->StartReceive(ci.channel_id);
+        base->StartPlayout(ci.channel_id);
+
+        voe_spksel_add(sel, ci.channel_id, true);
+
+        chv.push_back(ci);
+        conf_list.push_back(ci.channel_id);
+    }
+    conferencing->UpdateConference(conf_list);
+
+    uint8_t RTPpacketBuf[MAX_PACKET_SIZE_BYTES + RTP_HEADER_IN_BYTES + RTP_EXT_IN_BYTES];
+    int32_t rcv_time_ms;
+    uint32_t bytesIn;
+    int32_t next_ms = 0;
+
+    uint64_t n_checks = 0, n_talker_decoded = 0, n_decoded = 0;
+    int max_decoded = 0;
+
+    struct timeval start_time, now, res;
+    gettimeofday(&start_time, NULL);
+    double cpu_start = cpu_time_ms();
+
+    for(;;){
+        bool all_files_ended = true;
+
+        if( next_ms % PACKET_SIZE_MS == 0){
+            for( auto it = chv.begin(); it != chv.end(); it++){
+                if(it->file_ended){
+                    continue;
+                }
+                if(fread(&rcv_time_ms, sizeof(int32_t), 1, it->fp) < 1 ||
+                   fread(&bytesIn, sizeof(uint32_t), 1, it->fp) < 1 ||
+                   bytesIn > sizeof(RTPpacketBuf) ||
+                   fread(RTPpacketBuf, sizeof(uint8_t), bytesIn, it->fp) < bytesIn){
+                    it->file_ended = true;
+                    continue;
+                }
+                it->nw_sim->Add_Packet(RTPpacketBuf, bytesIn, next_ms);
+            }
+        }
+        for( auto it = chv.begin(); it != chv.end(); it++){
+            all_files_ended &= it->file_ended;
+        }
+        if(all_files_ended){
+            break;
+        }
+
+        for( auto it = chv.begin(); it != chv.end(); it++){
+            int len = it->nw_sim->Get_Packet(RTPpacketBuf, next_ms);
+            while(len > 0){
+                uint8_t level;
+
+                if(voe_aulevel_parse(&level, NULL, RTPpacketBuf, len,
+                                     AULEVEL_EXT_ID) == 0){
+                    voe_spksel_level(sel, it->channel_id, level, next_ms);
+                }
+                nw->ReceivedRTPPacket(it->channel_id, (const void*)RTPpacketBuf, len);
+
+                len = it->nw_sim->Get_Packet(RTPpacketBuf, next_ms);
+            }
+        }
+
+        if(voe_spksel_update(sel, next_ms)){
+            for( auto it = chv.begin(); it != chv.end(); it++){
+                bool play = voe_spksel_decoding(sel, it->channel_id);
+                if(play == it->playing){
+                    continue;
+                }
+                if(play){
+                    base->StartPlayout(it->channel_id);
+                } else {
+                    base->StopPlayout(it->channel_id);
+                }
+                it->playing = play;
+            }
+        }
+
+        /* Half a second into a turn the talker should be decoded */
+        if(next_ms % TALK_TURN_MS == TALK_TURN_MS/2){
+            int talker = (next_ms / TALK_TURN_MS) % setup->num_senders;
+            int decoded = 0;
+
+            for( auto it = chv.begin(); it != chv.end(); it++){
+                decoded += it->playing ? 1 : 0;
+            }
+            n_talker_decoded += chv[talker].playing ? 1 : 0;
+            n_decoded += decoded;
+            max_decoded = std::max(max_decoded, decoded);
+            ++n_checks;
+
+            LOG("%6d ms: talker %d %s, %d streams decoded\n", next_ms, talker,
+                chv[talker].playing ? "decoded" : "NOT DECODED", decoded);
+        }
+
+        next_ms += DELTA_TIME_MS;
+
+        gettimeofday(&now, NULL);
+        timersub(&now, &start_time, &res);
+        int32_t now_ms = (int32_t)res.tv_sec*1000 + (int32_t)res.tv_usec/1000;
+        int32_t sleep_ms = next_ms - now_ms;
+        if(sleep_ms > 0){
+            timespec t;
+            t.tv_sec = 0;
+            t.tv_nsec = sleep_ms*1000*1000;
+            nanosleep(&t, NULL);
+        }
+    }
+
+    double cpu_ms = cpu_time_ms() - cpu_start;
+
+    LOG("--------------------------------------\n");
+    LOG("senders: %d max decoded: %d (0 = all)\n", setup->num_senders, setup->max_decoded);
+    if(n_checks){
+        LOG("talker decoded: %.1f %% avg decoded: %.1f max decoded: %d\n",
+            100.0 * n_talker_decoded / n_checks, (double)n_decoded / n_checks, max_decoded);
+    }
+    LOG("cpu: %.0f ms for %d ms of audio\n", cpu_ms, next_ms);
+    LOG("--------------------------------------\n");
+
+    for( auto it = chv.begin(); it != chv.end(); it++){
+        nw->DeRegisterExternalTransport(it->channel_id);
+        base->StopReceive(it->channel_id);
+        base->StopPlayout(it->channel_id);
+        base->DeleteChannel(it->channel_id);
+
+        if(it->fp){
+            fclose(it->fp);
+        }
+        delete it->transport;
+        delete it->nw_sim;
+    }
+
+    mem_deref(sel);
+
+    codec->Release();
+    nw->Release();
+    conferencing->Release();
+    base->Terminate();
+    base->Release();
+
+    webrtc::VoiceEngine::Delete(ve);
+}
+
+#if TARGET_OS_IPHONE || defined(WEBRTC_ANDROID)
+int voe_conf_test_topn(const char *path, int num_senders, int max_decoded)
+#else
+int main(int argc, char *argv[])
+#endif
+{
+    struct test_setup setup;
+#if TARGET_OS_IPHONE || defined(WEBRTC_ANDROID)
+    setup.path = path;
+    setup.num_senders = num_senders;
+    setup.max_decoded = max_decoded;
+#else
+    setup.path = "../../files/";
+    setup.num_senders = argc > 1 ? atoi(argv[1]) : DEFAULT_NUM_SENDERS;
+    setup.max_decoded = argc > 2 ? atoi(argv[2]) : DEFAULT_MAX_DECODED;
+#endif
+    if(setup.num_senders < 1){
+        setup.num_senders = DEFAULT_NUM_SENDERS;
+    }
+
+    run_test(&setup);
+
+    return 0;
+}
@@ -159,6 +159,7 @@ public:
 	~TurnServer();
 	void init();
 	void set_sim_error(uint16_t sim_error);
+	void set_delay(uint32_t ms);
 
 public:
 	struct turnd *turnd = nullptr;
@@ -169,6 +170,8 @@ public:
 	unsigned nrecv = 0;
 	unsigned nrecv_tcp = 0;
 	unsigned nrecv_tls = 0;
+	uint32_t delay = 0;       /* ms before a UDP request is handled */
+	struct list delayl = LIST_INIT;
 };
 
 
@@ -28,6 +28,8 @@ NwSimulator::NwSimulator()
     packets_in_queue_ = 0;
     xtra_loss_rate_ = 0;
     avg_burst_length_ = 1.0f;
+    use_seed_ = false;
+    seed_ = 0;
     packet_size_ms_ = 0;
     lost_packets_ = 0;
     num_packets_ = 0;
@@ -145,8 +147,8 @@ int NwSimulator::Add_Packet( /* returns -1 if Queue is full otherwise 0 */
   num_packets_++;
 	
   float ploss = xtra_loss_rate_ / 100.0f;
-  if( ( !xtra_prev_lost_  && ((float)rand()/RAND_MAX) < ploss / (1.0f - ploss) / avg_burst_length_ ) ||
-      (  xtra_prev_lost_  && ((float)rand()/RAND_MAX) < 1.0f - 1.0f / avg_burst_length_ ) ) {
+  if( ( !xtra_prev_lost_  && Random() < ploss / (1.0f - ploss) / avg_burst_length_ ) ||
+      (  xtra_prev_lost_  && Random() < 1.0f - 1.0f / avg_burst_length_ ) ) {
       xtra_prev_lost_ = true;
       lost_packets_++;
       return(0);
@@ -258,6 +260,28 @@ int NwSimulator::Get_Packet( /* (O) returns -1 if no more packets otherwise leng
   }
 }
 
+int NwSimulator::Next_Packet_Time()
+{
+    if( packets_in_queue_ == 0){
+        return(-1);
+    }
+    return(packets_[read_idx_].rcv_time_ms);
+}
+
+void NwSimulator::SetSeed(unsigned int seed)
+{
+    use_seed_ = true;
+    seed_ = seed;
+}
+
+float NwSimulator::Random()
+{
+    if(use_seed_){
+        return (float)rand_r(&seed_)/RAND_MAX;
+    }
+    return (float)rand()/RAND_MAX;
+}
+
 int NwSimulator::GetLostPacketCount()
 {
     return(lost_packets_);
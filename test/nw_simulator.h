@@ -63,6 +63,13 @@ public:
         int            time_ms   /* (I) Get Packets recieved up untill this time */
     );
     
+    int Next_Packet_Time( /* (O) returns -1 if the queue is empty otherwise the arrival time in ms */
+    );
+    
+    void SetSeed( /* Use a private random generator, for reproducible runs */
+        unsigned int seed
+    );
+    
     int GetLostPacketCount();
     
     int GetPacketCount();
@@ -71,6 +78,7 @@ public:
     
 private:
     int Setup_Jitter_File(bool add_offset);
+    float Random();
     
     struct NW_Queue_element packets_[ NUM_PACKETS ];
     int read_idx_;
@@ -79,6 +87,8 @@ private:
     int xtra_loss_rate_;
     float avg_burst_length_;
     bool xtra_prev_lost_;
+    bool use_seed_;
+    unsigned int seed_;
     int packet_size_ms_;
     int lost_packets_;
     int num_packets_;
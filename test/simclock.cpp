@@ -0,0 +1,74 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "simclock.h"
+
+#define SIMCLOCK_IDLE_STEP_MS 10 /* step when no timer is running */
+
+SimClock::SimClock(uint64_t start_ms)
+{
+    now_ms_ = start_ms;
+    idle_cnt_ = 0;
+    tmr_init(&tmr_stop_);
+
+    tmr_set_clock(clock_handler, idle_handler, this);
+}
+
+SimClock::~SimClock()
+{
+    tmr_cancel(&tmr_stop_);
+    tmr_set_clock(NULL, NULL, NULL);
+}
+
+uint64_t SimClock::Now() const
+{
+    return now_ms_;
+}
+
+uint64_t SimClock::IdleCount() const
+{
+    return idle_cnt_;
+}
+
+int SimClock::Run(uint64_t duration_ms)
+{
+    tmr_start(&tmr_stop_, duration_ms, stop_handler, this);
+
+    return re_main(NULL);
+}
+
+uint64_t SimClock::clock_handler(void *arg)
+{
+    SimClock *sc = static_cast<SimClock *>(arg);
+
+    return sc->now_ms_;
+}
+
+void SimClock::idle_handler(uint64_t next, void *arg)
+{
+    SimClock *sc = static_cast<SimClock *>(arg);
+
+    sc->now_ms_ += next ? next : SIMCLOCK_IDLE_STEP_MS;
+    sc->idle_cnt_++;
+}
+
+void SimClock::stop_handler(void *arg)
+{
+    (void)arg;
+
+    re_cancel();
+}
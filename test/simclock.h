@@ -0,0 +1,64 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Virtual clock for simulations
+ *
+ * While a SimClock exists, tmr_jiffies() and ztime_get() return its
+ * time instead of the system time. The re main loop does not wait for
+ * timers; whenever it has nothing to do, the clock jumps to the next
+ * timer. Everything that is paced by re timers, such as the mediaflow
+ * timers, the fake audio device with EnableVirtualClock() and a
+ * NwSimulator that is polled from a timer, then runs as fast as the
+ * CPU allows, and in the same order on every run.
+ *
+ * Only one SimClock may exist at a time, and everything must run on
+ * the thread of the re main loop. Threads with their own main loop
+ * keep the system clock.
+ */
+
+#ifndef SIMCLOCK_H__
+#define SIMCLOCK_H__
+
+#include <stdint.h>
+#include <re.h>
+
+class SimClock {
+public:
+    SimClock(uint64_t start_ms = 1000000);
+
+    ~SimClock();
+
+    uint64_t Now() const;
+
+    /* Runs the re main loop for duration_ms of virtual time */
+    int Run(uint64_t duration_ms);
+
+    uint64_t IdleCount() const;
+
+private:
+    static uint64_t clock_handler(void *arg);
+    static void idle_handler(uint64_t next, void *arg);
+    static void stop_handler(void *arg);
+
+    uint64_t now_ms_;
+    uint64_t idle_cnt_;
+    struct tmr tmr_stop_;
+};
+
+#endif
@@ -9,7 +9,9 @@ TEST_SRCS	+= util.cpp
 # Testcases in alphabetical order
 TEST_SRCS	+= test_acm.cpp
 TEST_SRCS	+= test_apm.cpp
+TEST_SRCS	+= test_auctl.cpp
 TEST_SRCS	+= test_audummy.cpp
+TEST_SRCS	+= test_aueffect.cpp
 TEST_SRCS	+= test_bwe.cpp
 TEST_SRCS	+= test_cert.cpp
 TEST_SRCS	+= test_chunk.cpp
@@ -38,14 +40,18 @@ TEST_SRCS	+= test_netprobe.cpp
 TEST_SRCS	+= test_network.cpp
 TEST_SRCS	+= test_nevent.cpp
 TEST_SRCS	+= test_packetqueue.cpp
+TEST_SRCS	+= test_packet.cpp
 TEST_SRCS	+= test_resampler.cpp
 TEST_SRCS	+= test_rest.cpp
+TEST_SRCS	+= test_rtpdump.cpp
 TEST_SRCS	+= test_self.cpp
+TEST_SRCS	+= test_simclock.cpp
 TEST_SRCS	+= test_srtp.cpp
 TEST_SRCS	+= test_string.cpp
 TEST_SRCS	+= test_turn.cpp
 TEST_SRCS	+= test_uuid.cpp
 TEST_SRCS	+= test_vidcodec.cpp
+TEST_SRCS	+= test_vidconv.cpp
 TEST_SRCS	+= test_vie.cpp
 TEST_SRCS	+= test_voe.cpp
 TEST_SRCS	+= test_vp8_impl.cpp
@@ -74,6 +80,7 @@ TEST_SRCS	+= fake_cert.c
 TEST_SRCS	+= fake_httpsrv.cpp
 TEST_SRCS	+= fake_stunsrv.cpp
 TEST_SRCS	+= nw_simulator.cpp
+TEST_SRCS	+= simclock.cpp
 TEST_SRCS	+= turn/fake_turnsrv.cpp \
 	turn/alloc.c \
 	turn/chan.c \
@@ -0,0 +1,467 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <re.h>
+#include <avs.h>
+#include <avs_mediastats.h>
+#include <gtest/gtest.h>
+#include "nw_simulator.h"
+
+
+static void report(struct auctl_report *rep, float loss, float mbl,
+		   float expand, int rtt)
+{
+	rep->loss_pct = loss;
+	rep->mbl = mbl;
+	rep->expand_pct = expand;
+	rep->rtt_ms = rtt;
+}
+
+
+TEST(auctl, fec_follows_loss)
+{
+	struct auctl ac;
+	struct auctl_report rep;
+
+	mediastats_auctl_init(&ac);
+	ac.dtx_allowed = true;
+	ASSERT_FALSE(ac.cur.fec);
+	ASSERT_EQ(20, ac.cur.packet_ms);
+
+	report(&rep, 5.0f, 1.2f, 5.0f, 100);
+	EXPECT_TRUE(mediastats_auctl_update(&ac, &rep));
+	EXPECT_TRUE(ac.cur.fec);
+	EXPECT_EQ(5, ac.cur.loss_pct);
+	EXPECT_FALSE(ac.cur.dtx);
+
+	/* The loss is forgotten slowly */
+	report(&rep, 0.0f, 1.0f, 0.0f, 100);
+	mediastats_auctl_update(&ac, &rep);
+	EXPECT_TRUE(ac.cur.fec);
+	EXPECT_GE(ac.cur.loss_pct, 3);
+
+	for (int i = 0; i < 20; i++)
+		mediastats_auctl_update(&ac, &rep);
+
+	EXPECT_FALSE(ac.cur.fec);
+	EXPECT_EQ(0, ac.cur.loss_pct);
+
+	/* and a clean channel gets DTX */
+	EXPECT_TRUE(ac.cur.dtx);
+
+	/* Nothing changes any more */
+	EXPECT_FALSE(mediastats_auctl_update(&ac, &rep));
+}
+
+
+TEST(auctl, no_dtx_unless_allowed)
+{
+	struct auctl ac;
+	struct auctl_report rep;
+
+	mediastats_auctl_init(&ac);
+	ASSERT_FALSE(ac.dtx_allowed);
+
+	report(&rep, 0.0f, 1.0f, 0.0f, 100);
+	for (int i = 0; i < 20; i++)
+		mediastats_auctl_update(&ac, &rep);
+
+	EXPECT_FALSE(ac.cur.dtx);
+}
+
+
+TEST(auctl, fec_changes_held)
+{
+	struct auctl ac;
+	struct auctl_report rep;
+
+	mediastats_auctl_init(&ac);
+
+	report(&rep, 8.0f, 1.0f, 8.0f, 100);
+	mediastats_auctl_update(&ac, &rep);
+	ASSERT_TRUE(ac.cur.fec);
+
+	/* The loss is gone at once, FEC stays on for a few reports */
+	report(&rep, 0.0f, 1.0f, 0.0f, 100);
+	ac.loss = 0.0f;
+	ac.expand = 0.0f;
+	mediastats_auctl_update(&ac, &rep);
+	EXPECT_TRUE(ac.cur.fec);
+	mediastats_auctl_update(&ac, &rep);
+	EXPECT_TRUE(ac.cur.fec);
+
+	mediastats_auctl_update(&ac, &rep);
+	EXPECT_FALSE(ac.cur.fec);
+
+	/* and back on only after a few more */
+	report(&rep, 8.0f, 1.0f, 8.0f, 100);
+	mediastats_auctl_update(&ac, &rep);
+	EXPECT_FALSE(ac.cur.fec);
+	mediastats_auctl_update(&ac, &rep);
+	mediastats_auctl_update(&ac, &rep);
+	EXPECT_TRUE(ac.cur.fec);
+}
+
+
+TEST(auctl, long_bursts_no_fec)
+{
+	struct auctl ac;
+	struct auctl_report rep;
+
+	mediastats_auctl_init(&ac);
+
+	report(&rep, 10.0f, 8.0f, 10.0f, 100);
+	for (int i = 0; i < 10; i++)
+		mediastats_auctl_update(&ac, &rep);
+
+	EXPECT_FALSE(ac.cur.fec);
+	EXPECT_EQ(10, ac.cur.loss_pct);
+}
+
+
+TEST(auctl, late_packets)
+{
+	struct auctl ac;
+	struct auctl_report rep;
+
+	mediastats_auctl_init(&ac);
+
+	/* NetEQ conceals much more than the network loses */
+	report(&rep, 0.0f, 1.0f, 8.0f, 100);
+	mediastats_auctl_update(&ac, &rep);
+
+	EXPECT_TRUE(ac.cur.fec);
+	EXPECT_EQ(4, ac.cur.loss_pct);
+	EXPECT_FALSE(ac.cur.dtx);
+}
+
+
+TEST(auctl, packet_size_follows_rtt)
+{
+	struct auctl ac;
+	struct auctl_report rep;
+
+	mediastats_auctl_init(&ac);
+
+	report(&rep, 0.0f, 1.0f, 0.0f, 900);
+	mediastats_auctl_update(&ac, &rep);
+	EXPECT_EQ(40, ac.cur.packet_ms);
+
+	/* Hysteresis */
+	report(&rep, 0.0f, 1.0f, 0.0f, 600);
+	mediastats_auctl_update(&ac, &rep);
+	EXPECT_EQ(40, ac.cur.packet_ms);
+
+	report(&rep, 0.0f, 1.0f, 0.0f, 200);
+	mediastats_auctl_update(&ac, &rep);
+	EXPECT_EQ(20, ac.cur.packet_ms);
+}
+
+
+/*
+ * Offline comparison against the static settings.
+ *
+ * One direction of a call through a NwSimulator. The receiver plays
+ * packet k JB_MS after it was sent. A packet that is not there by then
+ * is recovered from the in-band FEC of packet k+1 if that one is there
+ * and carries FEC, otherwise it is concealed. Every RTCP_MS the receiver
+ * reports loss, burst length and the concealed share of the playout.
+ *
+ * Opus only adds FEC data when it expects loss. The redundant copy of
+ * the previous frame is coded at a lower rate and costs FEC_COST_PCT of
+ * the payload. 40 ms packets are sent at the low bitrate, as voe does.
+ * With DTX, silence is sent as one small packet every DTX_MS. Headers
+ * are IPv4, UDP, RTP and the SRTP tag.
+ *
+ * Like voe, the adaptive policy only gets what RTCP receiver reports
+ * carry, the loss and the RTT, and DTX stays off.
+ *
+ * The scores come from this cost model, not from Opus and NetEQ: a
+ * packet counts as recovered whenever FEC for it arrived, as concealed
+ * otherwise, whatever the actual quality of either would be. It shows
+ * whether the controller switches where the model says it should, not
+ * how a call would sound.
+ */
+
+#define CALL_MS      (10 * 60 * 1000)
+#define JB_MS        80
+#define RTCP_MS      5000
+#define RTT_MS       100
+#define DTX_MS       400
+#define DTX_BYTES    3
+#define HDR_BYTES    (20 + 8 + 12 + 10)
+#define CODEC_HI_BPS 32000
+#define CODEC_LO_BPS 24000
+#define FEC_COST_PCT 30
+#define MAX_SEQ      (CALL_MS / 20 + 1)
+
+
+enum policy {
+	POLICY_STATIC,
+	POLICY_ADAPTIVE,
+};
+
+
+struct sim_packet {
+	int sent;
+	int arrival;   /* -1 if lost */
+	int ms;
+	bool speech;
+	bool fec;      /* carries FEC for the previous packet */
+};
+
+
+struct sim_result {
+	uint64_t speech_ms;
+	uint64_t concealed_ms;
+	uint64_t bytes;
+	unsigned changes;
+};
+
+
+/* Talk spurts and pauses of 0.5 to 4 s */
+static bool is_speech(int t, unsigned *seed, int *next, bool *speech)
+{
+	while (t >= *next) {
+		*speech = !*speech;
+		*next += 500 + rand_r(seed) % (*speech ? 3500 : 2500);
+	}
+
+	return *speech;
+}
+
+
+static void simulate(struct sim_result *res, enum policy pol,
+		     NW_type nw_type, int loss_pct, float mbl)
+{
+	static struct sim_packet pktv[MAX_SEQ];
+	NwSimulator nws;
+	struct auctl ac;
+	struct auctl_settings cur;
+	unsigned talk_seed = 42;
+	int talk_next = 0;
+	bool talk = false;
+	int t = 0, next_send = 0, next_rtcp = RTCP_MS;
+	int last_dtx = -DTX_MS;
+	int nsent = 0, nplayed = 0;
+	int win_first = 0;
+	uint64_t win_concealed = 0, win_played = 0;
+
+	memset(res, 0, sizeof(*res));
+	memset(pktv, 0, sizeof(pktv));
+
+	nws.Init(20, loss_pct, mbl, nw_type, "./test/data/");
+	nws.SetSeed(4711);
+
+	mediastats_auctl_init(&ac);
+	ac.cur.fec = true;
+	cur = ac.cur;
+
+	for (t = 0; t < CALL_MS; t++) {
+		unsigned char buf[MAX_BYTES_PER_PACKET];
+		struct sim_packet *p = NULL;
+		bool speech = false;
+		int bytes, n;
+
+		/* Sender */
+		if (t == next_send && nsent < MAX_SEQ) {
+			speech = is_speech(t, &talk_seed, &talk_next, &talk);
+			next_send = t + cur.packet_ms;
+
+			if (speech || !cur.dtx || t - last_dtx >= DTX_MS)
+				p = &pktv[nsent];
+		}
+
+		if (p) {
+			p->sent = t;
+			p->ms = cur.packet_ms;
+			p->speech = speech;
+			p->fec = cur.fec && cur.loss_pct > 0;
+			p->arrival = -1;
+
+			if (!speech && cur.dtx) {
+				bytes = DTX_BYTES;
+				last_dtx = t;
+			}
+			else {
+				int bps = p->ms > 20 ? CODEC_LO_BPS
+					: CODEC_HI_BPS;
+
+				bytes = bps / 8 * p->ms / 1000;
+				if (p->fec)
+					bytes += bytes * FEC_COST_PCT / 100;
+			}
+			res->bytes += HDR_BYTES + bytes;
+
+			memset(buf, 0, 4);
+			buf[2] = nsent >> 8;
+			buf[3] = nsent & 0xff;
+			memcpy(&buf[4], &nsent, sizeof(nsent));
+			nws.Add_Packet(buf, 4 + sizeof(nsent), t);
+			++nsent;
+		}
+
+		while ((n = nws.Get_Packet(buf, t)) > 0) {
+			int seq;
+
+			memcpy(&seq, &buf[4], sizeof(seq));
+			if (seq >= 0 && seq < nsent && pktv[seq].arrival < 0)
+				pktv[seq].arrival = t;
+		}
+
+		/* Playout */
+		while (nplayed < nsent
+		       && pktv[nplayed].sent + JB_MS <= t) {
+			struct sim_packet *pp = &pktv[nplayed];
+			struct sim_packet *q = nplayed + 1 < nsent
+				? &pktv[nplayed + 1] : NULL;
+			bool ok = pp->arrival >= 0;
+
+			if (!ok && q && q->fec && q->arrival >= 0
+			    && q->arrival <= t)
+				ok = true;
+
+			if (!ok) {
+				win_concealed += pp->ms;
+				if (pp->speech)
+					res->concealed_ms += pp->ms;
+			}
+			if (pp->speech)
+				res->speech_ms += pp->ms;
+
+			win_played += pp->ms;
+			++nplayed;
+		}
+
+		/* Receiver report */
+		if (t == next_rtcp) {
+			struct auctl_report rep;
+			int lost = 0, bursts = 0, expected = 0;
+			bool prev_lost = false;
+
+			for (int i = win_first; i < nplayed; i++) {
+				bool l = pktv[i].arrival < 0;
+
+				++expected;
+				if (l) {
+					++lost;
+					if (!prev_lost)
+						++bursts;
+				}
+				prev_lost = l;
+			}
+
+			rep.loss_pct = expected ? 100.0f * lost / expected : 0;
+			rep.mbl = bursts ? (float)lost / bursts : 1.0f;
+			rep.expand_pct = win_played
+				? 100.0f * win_concealed / win_played : 0;
+			rep.rtt_ms = RTT_MS;
+
+			if (pol == POLICY_ADAPTIVE) {
+				/* What an RR tells the sender */
+				rep.mbl = 1.0f;
+				rep.expand_pct = 0.0f;
+
+				if (mediastats_auctl_update(&ac, &rep)) {
+					cur = ac.cur;
+					++res->changes;
+				}
+			}
+			else {
+				/* The channel feeds the RTCP loss to Opus */
+				cur.loss_pct = (int)rep.loss_pct;
+
+				/* and voe_update_channel_stats used to pick
+				 * the packet size
+				 */
+				if (rep.rtt_ms < 500 && rep.loss_pct < 3.0f)
+					cur.packet_ms = 20;
+				else if (rep.rtt_ms > 800 || rep.loss_pct > 10.0f)
+					cur.packet_ms = 40;
+			}
+
+			win_first = nplayed;
+			win_concealed = 0;
+			win_played = 0;
+			next_rtcp = t + RTCP_MS;
+		}
+	}
+}
+
+
+static float kbps(const struct sim_result *res)
+{
+	return res->bytes * 8.0f / CALL_MS;
+}
+
+
+static float concealed_pct(const struct sim_result *res)
+{
+	return res->speech_ms ? 100.0f * res->concealed_ms / res->speech_ms
+		: 0.0f;
+}
+
+
+TEST(auctl, nwsim_report)
+{
+	static const struct {
+		const char *name;
+		NW_type type;
+		int loss;
+		float mbl;
+	} profv[] = {
+		{"clean",         NW_type_clean, 0,  1.0f},
+		{"random 3%",     NW_type_clean, 3,  1.0f},
+		{"random 10%",    NW_type_clean, 10, 1.0f},
+		{"bursty 10%",    NW_type_clean, 10, 2.5f},
+		{"wifi",          NW_type_wifi,  0,  1.0f},
+		{"wifi 5% burst", NW_type_wifi,  5,  2.0f},
+	};
+
+	re_printf("auctl: scored with the test's FEC/concealment model,"
+		  " not real Opus/NetEQ concealment\n");
+	re_printf("auctl: %-14s %22s %22s\n", "",
+		  "static", "adaptive");
+	re_printf("auctl: %-14s %10s %11s %10s %11s\n", "profile",
+		  "kbps", "concealed%", "kbps", "concealed%");
+
+	for (size_t i = 0; i < ARRAY_SIZE(profv); i++) {
+		struct sim_result rs, ra;
+		char ks[16], cs[16], ka[16], ca[16];
+
+		simulate(&rs, POLICY_STATIC, profv[i].type,
+			 profv[i].loss, profv[i].mbl);
+		simulate(&ra, POLICY_ADAPTIVE, profv[i].type,
+			 profv[i].loss, profv[i].mbl);
+
+		/* re_printf has no float precision */
+		snprintf(ks, sizeof(ks), "%.1f", kbps(&rs));
+		snprintf(cs, sizeof(cs), "%.2f", concealed_pct(&rs));
+		snprintf(ka, sizeof(ka), "%.1f", kbps(&ra));
+		snprintf(ca, sizeof(ca), "%.2f", concealed_pct(&ra));
+
+		re_printf("auctl: %-14s %10s %11s %10s %11s  (%u changes)\n",
+			  profv[i].name, ks, cs, ka, ca, ra.changes);
+
+		EXPECT_GT(rs.speech_ms, CALL_MS / 3);
+
+		/* Never worse than the static settings */
+		EXPECT_LE(kbps(&ra), kbps(&rs) * 1.01f) << profv[i].name;
+		EXPECT_LE(concealed_pct(&ra), concealed_pct(&rs) + 0.1f)
+			<< profv[i].name;
+	}
+}
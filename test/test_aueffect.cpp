@@ -0,0 +1,352 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <math.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <re.h>
+#include "avs_audio_effect.h"
+
+#include "gtest/gtest.h"
+#include "complexity_check.h"
+
+#define FS_HZ 16000
+#define L10 (FS_HZ/100)
+#define NUM_EFFECTS 3
+
+static const enum audio_effect stacked_effects[NUM_EFFECTS] = {
+    AUDIO_EFFECT_PITCH_UP_SHIFT_MED,
+    AUDIO_EFFECT_AUTO_TUNE_MED,
+    AUDIO_EFFECT_HARMONIZER_MED,
+};
+
+/* Runs the effects side by side on the same input and returns the time
+ * spent per 10 ms frame in microseconds.
+ */
+static int run_effects(const char *in_file_name, bool share,
+                       int16_t *out, size_t max_frames,
+                       size_t *num_frames, float *usec_per_frame)
+{
+    struct aueffect *aue[NUM_EFFECTS] = {NULL, NULL, NULL};
+    int16_t in_buf[L10];
+    struct timeval now, startTime, res, tmp, totTime;
+    size_t n = 0;
+    int err = 0;
+
+    timerclear(&totTime);
+
+    FILE *in_file = fopen(in_file_name, "rb");
+    if (!in_file) {
+        printf("Could not open file for reading \n");
+        return ENOENT;
+    }
+
+    for (int i = 0; i < NUM_EFFECTS; i++) {
+        err = aueffect_alloc(&aue[i], stacked_effects[i], FS_HZ);
+        if (err)
+            goto out;
+
+        if (share && i > 0) {
+            err = aueffect_share_pitch(aue[i], aue[0]);
+            if (err)
+                goto out;
+        }
+    }
+
+    while (n < max_frames &&
+           fread(in_buf, sizeof(int16_t), L10, in_file) == L10) {
+
+        gettimeofday(&startTime, NULL);
+
+        for (int i = 0; i < NUM_EFFECTS; i++) {
+            size_t L_out;
+
+            aueffect_process(aue[i], in_buf,
+                             &out[(n*NUM_EFFECTS + i)*L10], L10, &L_out);
+        }
+
+        gettimeofday(&now, NULL);
+        timersub(&now, &startTime, &res);
+        memcpy(&tmp, &totTime, sizeof(struct timeval));
+        timeradd(&res, &tmp, &totTime);
+
+        n++;
+    }
+
+    *num_frames = n;
+    *usec_per_frame = n ? ((float)totTime.tv_sec*1e6f
+                           + (float)totTime.tv_usec)/(float)n : 0;
+
+out:
+    for (int i = 0; i < NUM_EFFECTS; i++)
+        mem_deref(aue[i]);
+    fclose(in_file);
+
+    return err;
+}
+
+TEST(aueffect, share_pitch_not_supported)
+{
+    struct aueffect *chorus = NULL, *pitch = NULL;
+
+    ASSERT_EQ(0, aueffect_alloc(&chorus, AUDIO_EFFECT_CHORUS, FS_HZ));
+    ASSERT_EQ(0, aueffect_alloc(&pitch, AUDIO_EFFECT_PITCH_UP_SHIFT, FS_HZ));
+
+    EXPECT_EQ(ENOTSUP, aueffect_share_pitch(chorus, pitch));
+    EXPECT_EQ(ENOTSUP, aueffect_share_pitch(pitch, chorus));
+    EXPECT_EQ(0, aueffect_share_pitch(pitch, pitch));
+
+    mem_deref(pitch);
+    mem_deref(chorus);
+}
+
+TEST(aueffect, share_pitch_rate_mismatch)
+{
+    struct aueffect *a = NULL, *b = NULL;
+
+    ASSERT_EQ(0, aueffect_alloc(&a, AUDIO_EFFECT_AUTO_TUNE_MIN, 16000));
+    ASSERT_EQ(0, aueffect_alloc(&b, AUDIO_EFFECT_AUTO_TUNE_MIN, 32000));
+
+    EXPECT_EQ(EINVAL, aueffect_share_pitch(a, b));
+
+    mem_deref(b);
+    mem_deref(a);
+}
+
+TEST(aueffect, shared_pitch_analysis)
+{
+    const size_t max_frames = 500;
+    size_t n_sep, n_shared;
+    float usec_sep, usec_shared;
+    int16_t *out_sep, *out_shared;
+
+    out_sep = (int16_t *)calloc(max_frames*NUM_EFFECTS*L10, sizeof(int16_t));
+    out_shared = (int16_t *)calloc(max_frames*NUM_EFFECTS*L10, sizeof(int16_t));
+    ASSERT_TRUE(out_sep != NULL);
+    ASSERT_TRUE(out_shared != NULL);
+
+    ASSERT_EQ(0, run_effects("./test/data/near16.pcm", false,
+                             out_sep, max_frames, &n_sep, &usec_sep));
+    ASSERT_EQ(0, run_effects("./test/data/near16.pcm", true,
+                             out_shared, max_frames, &n_shared, &usec_shared));
+
+    ASSERT_EQ(n_sep, n_shared);
+    ASSERT_GT(n_sep, 0);
+
+    /* Sharing the analysis must not change what the effects produce */
+    EXPECT_EQ(0, memcmp(out_sep, out_shared,
+                        n_sep*NUM_EFFECTS*L10*sizeof(int16_t)));
+
+    printf("pitch analysis: separate %.1f us, shared %.1f us per frame"
+           " (%.1f us saved)\n",
+           usec_sep, usec_shared, usec_sep - usec_shared);
+
+    COMPLEXITY_CHECK( usec_shared, usec_sep );
+
+    free(out_shared);
+    free(out_sep);
+}
+
+
+TEST(aueffect, switch_basic)
+{
+    struct aueswitch *sw = NULL;
+    struct aueswitch_stats stats;
+    int16_t buf[L10];
+
+    ASSERT_EQ(0, aueswitch_alloc(&sw, FS_HZ));
+    ASSERT_EQ(AUDIO_EFFECT_NONE, aueswitch_effect(sw));
+
+    /* Effects that change the length cannot run live */
+    EXPECT_EQ(ENOTSUP, aueswitch_set(sw, AUDIO_EFFECT_PACE_UP_SHIFT_MIN));
+
+    ASSERT_EQ(0, aueswitch_set(sw, AUDIO_EFFECT_AUTO_TUNE_MIN));
+    ASSERT_EQ(AUDIO_EFFECT_AUTO_TUNE_MIN, aueswitch_effect(sw));
+
+    memset(buf, 0, sizeof(buf));
+    aueswitch_process(sw, buf, L10, FS_HZ);
+    aueswitch_process(sw, buf, L10, FS_HZ);
+
+    aueswitch_get_stats(sw, &stats);
+    EXPECT_EQ(1, stats.switches);
+    EXPECT_EQ(0, stats.bypassed);
+
+    /* A different rate passes the audio through */
+    aueswitch_process(sw, buf, L10*2, FS_HZ*2);
+    aueswitch_process(sw, buf, L10*2, FS_HZ*2);
+    aueswitch_get_stats(sw, &stats);
+    EXPECT_GT(stats.bypassed, 0);
+
+    mem_deref(sw);
+}
+
+static void count_notify(void *arg)
+{
+    ++*(int *)arg;
+}
+
+/* An effect set before the first frame is made for the wrong rate */
+TEST(aueffect, switch_rate_and_collect)
+{
+    struct aueswitch *sw = NULL;
+    struct aueswitch_stats stats;
+    int16_t buf[L10*2];
+    int n_notify = 0;
+
+    ASSERT_EQ(0, aueswitch_alloc(&sw, FS_HZ));
+    aueswitch_set_notify_handler(sw, count_notify, &n_notify);
+
+    ASSERT_EQ(0, aueswitch_set(sw, AUDIO_EFFECT_AUTO_TUNE_MIN));
+
+    memset(buf, 0, sizeof(buf));
+    aueswitch_process(sw, buf, L10*2, FS_HZ*2);
+    EXPECT_EQ(1, n_notify);
+
+    /* Notified only once until collected */
+    aueswitch_process(sw, buf, L10*2, FS_HZ*2);
+    EXPECT_EQ(1, n_notify);
+
+    ASSERT_EQ(0, aueswitch_collect(sw));
+    ASSERT_EQ(AUDIO_EFFECT_AUTO_TUNE_MIN, aueswitch_effect(sw));
+
+    /* The re-created effect runs, the old one is handed back */
+    aueswitch_process(sw, buf, L10*2, FS_HZ*2);
+    aueswitch_process(sw, buf, L10*2, FS_HZ*2);
+    EXPECT_EQ(2, n_notify);
+
+    aueswitch_get_stats(sw, &stats);
+    EXPECT_EQ(2, stats.switches);
+    const uint32_t bypassed = stats.bypassed;
+
+    ASSERT_EQ(0, aueswitch_collect(sw));
+    for (int i = 0; i < 10; i++)
+        aueswitch_process(sw, buf, L10*2, FS_HZ*2);
+
+    aueswitch_get_stats(sw, &stats);
+    EXPECT_EQ(bypassed, stats.bypassed);
+    EXPECT_EQ(2, n_notify);
+
+    mem_deref(sw);
+}
+
+static const enum audio_effect live_effects[] = {
+    AUDIO_EFFECT_CHORUS_MIN,
+    AUDIO_EFFECT_PITCH_UP_SHIFT_MED,
+    AUDIO_EFFECT_NONE,
+    AUDIO_EFFECT_AUTO_TUNE_MAX,
+    AUDIO_EFFECT_HARMONIZER_MIN,
+    AUDIO_EFFECT_PITCH_DOWN_SHIFT_MAX,
+    AUDIO_EFFECT_VOCODER_MIN,
+    AUDIO_EFFECT_PITCH_UP_DOWN_MED,
+};
+
+struct switch_state {
+    pthread_mutex_t mutex;
+    struct aueswitch *sw;
+    bool run;
+    unsigned n_set;
+    int err;
+};
+
+static bool switch_running(struct switch_state *st)
+{
+    bool run;
+
+    pthread_mutex_lock(&st->mutex);
+    run = st->run;
+    pthread_mutex_unlock(&st->mutex);
+
+    return run;
+}
+
+static void *switch_thread(void *arg)
+{
+    struct switch_state *st = (struct switch_state *)arg;
+    const size_t n = sizeof(live_effects)/sizeof(live_effects[0]);
+
+    while (switch_running(st)) {
+        int err = aueswitch_set(st->sw, live_effects[st->n_set % n]);
+        if (err) {
+            st->err = err;
+            break;
+        }
+        ++st->n_set;
+        usleep(1000);
+    }
+
+    return NULL;
+}
+
+/* Switches effects every millisecond while the audio keeps running */
+TEST(aueffect, switch_stress)
+{
+    struct switch_state st;
+    struct aueswitch_stats stats;
+    struct timeval now, startTime, res;
+    int16_t buf[L10];
+    long max_usec = 0;
+    double phase = 0;
+    pthread_t tid;
+
+    memset(&st, 0, sizeof(st));
+    pthread_mutex_init(&st.mutex, NULL);
+    ASSERT_EQ(0, aueswitch_alloc(&st.sw, FS_HZ));
+
+    st.run = true;
+    ASSERT_EQ(0, pthread_create(&tid, NULL, switch_thread, &st));
+
+    for (int f = 0; f < 1000; f++) {
+
+        for (int i = 0; i < L10; i++) {
+            buf[i] = (int16_t)(8000 * sin(phase));
+            phase += 2 * M_PI * 180.0 / FS_HZ;
+        }
+
+        gettimeofday(&startTime, NULL);
+        aueswitch_process(st.sw, buf, L10, FS_HZ);
+        gettimeofday(&now, NULL);
+
+        timersub(&now, &startTime, &res);
+        if (res.tv_sec*1000000 + res.tv_usec > max_usec)
+            max_usec = res.tv_sec*1000000 + res.tv_usec;
+
+        usleep(500);
+    }
+
+    pthread_mutex_lock(&st.mutex);
+    st.run = false;
+    pthread_mutex_unlock(&st.mutex);
+    pthread_join(tid, NULL);
+    pthread_mutex_destroy(&st.mutex);
+
+    ASSERT_EQ(0, st.err);
+
+    aueswitch_get_stats(st.sw, &stats);
+    EXPECT_GT(st.n_set, 0);
+    EXPECT_GT(stats.switches, 0);
+    EXPECT_LE(stats.switches, st.n_set);
+
+    printf("aueswitch: %u switches requested, %u done, %u deferred,"
+           " max %ld us per frame\n",
+           st.n_set, stats.switches, stats.deferred, max_usec);
+
+    /* A frame must never wait for the control thread */
+    COMPLEXITY_CHECK( max_usec, 10000 );
+
+    mem_deref(st.sw);
+}
@@ -20,11 +20,13 @@
 #include <avs.h>
 #include <gtest/gtest.h>
 #include <sys/time.h>
+#include <algorithm>
 #include "ztest.h"
 
 
 #define MQUEUE_DCE_MESSAGE 0
 #define MQUEUE_START_TEST 1
+#define MQUEUE_BENCH_MESSAGE 2
 
 #define TEST_STEP_CONNECT               0
 #define TEST_STEP_OPEN_CHANNELS         (TEST_STEP_CONNECT + 1)
@@ -75,6 +77,7 @@ struct client {
 
 /* prototypes */
 static void test_command_handler(void *arg);
+static void bench_recv_handler(void *arg);
 
 
 class Dce : public ::testing::Test {
@@ -116,6 +119,9 @@ public:
 		else if ( id == MQUEUE_START_TEST ) {
 			test_command_handler(data);
 		}
+		else if (id == MQUEUE_BENCH_MESSAGE) {
+			bench_recv_handler(data);
+		}
 		else {
 			printf("unknown mqueeu id \n");
 		}
@@ -780,3 +786,595 @@ TEST_F(Dce, alloc_after_close)
 	ASSERT_EQ(0, B.co[0].n_received);
 
 }
+
+
+/*
+ * Throughput of several associations over the loopback transport. The
+ * baseline sends for all associations from a single thread, which is
+ * what the global lock used to serialize them to. The parallel run
+ * sends from one thread per association. In both runs the main loop
+ * receives while the senders are still running.
+ */
+
+#define BENCH_PAIRS     8
+#define BENCH_MESSAGES  200
+#define BENCH_MSG_SIZE  512
+
+struct bench_peer {
+	Dce *fix;
+	struct dce *dce;
+	struct dce_channel *ch;
+	struct bench_peer *other;
+	bool active;
+	bool estab;
+	bool open;
+	unsigned n_received;
+	size_t bytes;
+	int send_err;
+	pthread_t tid;
+};
+
+struct bench_pkt {
+	struct bench_peer *peer;
+	uint8_t *pkt;
+	size_t len;
+};
+
+struct bench {
+	struct bench_peer a[BENCH_PAIRS];
+	struct bench_peer b[BENCH_PAIRS];
+	struct tmr tmr;
+	bool parallel;
+	pthread_t tid;       /* baseline sender */
+	bool started;
+	int step;
+	int wait_count;
+	uint64_t t_start;
+	uint64_t t_done;
+};
+
+
+static void bench_pkt_destructor(void *arg)
+{
+	struct bench_pkt *bp = (struct bench_pkt *)arg;
+
+	mem_deref(bp->pkt);
+}
+
+
+static void bench_recv_handler(void *arg)
+{
+	struct bench_pkt *bp = (struct bench_pkt *)arg;
+
+	if (bp->peer->dce)
+		dce_recv_pkt(bp->peer->dce, bp->pkt, bp->len);
+	mem_deref(bp);
+}
+
+
+static int bench_send_handler(uint8_t *pkt, size_t len, void *arg)
+{
+	struct bench_peer *bp = (struct bench_peer *)arg;
+	struct bench_pkt *pp;
+
+	pp = (struct bench_pkt *)mem_zalloc(sizeof(*pp),
+					    bench_pkt_destructor);
+	if (!pp)
+		return ENOMEM;
+
+	pp->pkt = (uint8_t *)mem_alloc(len, NULL);
+	if (!pp->pkt) {
+		mem_deref(pp);
+		return ENOMEM;
+	}
+	memcpy(pp->pkt, pkt, len);
+	pp->len = len;
+	pp->peer = bp->other;
+
+	return mqueue_push(bp->fix->mq, MQUEUE_BENCH_MESSAGE, pp);
+}
+
+
+static void bench_estab_handler(void *arg)
+{
+	struct bench_peer *bp = (struct bench_peer *)arg;
+
+	bp->estab = true;
+}
+
+
+static void bench_open_handler(int sid, const char *label,
+			       const char *protocol, void *arg)
+{
+	struct bench_peer *bp = (struct bench_peer *)arg;
+
+	bp->open = true;
+}
+
+
+static void bench_data_handler(int sid, uint8_t *data, size_t len,
+			       void *arg)
+{
+	struct bench_peer *bp = (struct bench_peer *)arg;
+
+	++bp->n_received;
+	bp->bytes += len;
+}
+
+
+static void *bench_send_thread(void *arg)
+{
+	struct bench_peer *bp = (struct bench_peer *)arg;
+	char msg[BENCH_MSG_SIZE];
+	int i;
+
+	memset(msg, 'x', sizeof(msg));
+
+	for (i = 0; i < BENCH_MESSAGES; ++i) {
+		int err = dce_send(bp->dce, bp->ch, msg, sizeof(msg));
+		if (err)
+			bp->send_err = err;
+	}
+
+	return NULL;
+}
+
+
+static void *bench_send_all_thread(void *arg)
+{
+	struct bench *bench = (struct bench *)arg;
+	char msg[BENCH_MSG_SIZE];
+	int i, j;
+
+	memset(msg, 'x', sizeof(msg));
+
+	for (i = 0; i < BENCH_MESSAGES; ++i) {
+		for (j = 0; j < BENCH_PAIRS; ++j) {
+			struct bench_peer *bp = &bench->a[j];
+			int err = dce_send(bp->dce, bp->ch, msg, sizeof(msg));
+			if (err)
+				bp->send_err = err;
+		}
+	}
+
+	return NULL;
+}
+
+
+static void bench_join(struct bench *bench)
+{
+	int i;
+
+	if (!bench->started)
+		return;
+
+	if (bench->parallel) {
+		for (i = 0; i < BENCH_PAIRS; ++i)
+			pthread_join(bench->a[i].tid, NULL);
+	}
+	else {
+		pthread_join(bench->tid, NULL);
+	}
+
+	bench->started = false;
+}
+
+
+static bool bench_all(const struct bench_peer *v, bool open)
+{
+	for (int i = 0; i < BENCH_PAIRS; ++i) {
+		if (open ? !dce_is_chan_open(v[i].ch) : !v[i].estab)
+			return false;
+	}
+
+	return true;
+}
+
+
+static void bench_tmr_handler(void *arg)
+{
+	struct bench *bench = (struct bench *)arg;
+	int i;
+
+	if (++bench->wait_count > MAX_WAIT) {
+		re_cancel();
+		return;
+	}
+
+	switch (bench->step) {
+
+	case 0:
+		for (i = 0; i < BENCH_PAIRS; ++i) {
+			dce_connect(bench->a[i].dce, true);
+			dce_connect(bench->b[i].dce, false);
+		}
+		++bench->step;
+		break;
+
+	case 1:
+		if (!bench_all(bench->a, false) || !bench_all(bench->b, false))
+			break;
+
+		for (i = 0; i < BENCH_PAIRS; ++i)
+			dce_open_chan(bench->a[i].dce, bench->a[i].ch);
+		++bench->step;
+		break;
+
+	case 2:
+		if (!bench_all(bench->a, true))
+			break;
+
+		/* Don't wait for the senders here, the main loop
+		 * has to keep receiving while they run.
+		 */
+		bench->t_start = tmr_jiffies();
+		if (bench->parallel) {
+			for (i = 0; i < BENCH_PAIRS; ++i) {
+				pthread_create(&bench->a[i].tid, NULL,
+					       bench_send_thread,
+					       &bench->a[i]);
+			}
+		}
+		else {
+			pthread_create(&bench->tid, NULL,
+				       bench_send_all_thread, bench);
+		}
+		bench->started = true;
+		++bench->step;
+		break;
+
+	case 3:
+		for (i = 0; i < BENCH_PAIRS; ++i) {
+			if (bench->b[i].n_received < BENCH_MESSAGES)
+				break;
+		}
+		if (i < BENCH_PAIRS)
+			break;
+
+		bench->t_done = tmr_jiffies();
+		re_cancel();
+		return;
+	}
+
+	tmr_start(&bench->tmr, bench->step == 3 ? 1 : 10,
+		  bench_tmr_handler, bench);
+}
+
+
+static void bench_peer_alloc(struct bench_peer *bp, Dce *fix,
+			     struct bench_peer *other)
+{
+	int err;
+
+	bp->fix = fix;
+	bp->other = other;
+
+	err = dce_alloc(&bp->dce, bench_send_handler, bench_estab_handler,
+			bp);
+	ASSERT_EQ(0, err);
+
+	err = dce_channel_alloc(&bp->ch, bp->dce, "bench", "",
+				NULL, bench_open_handler, NULL,
+				bench_data_handler, bp);
+	ASSERT_EQ(0, err);
+}
+
+
+static void bench_run(Dce *fix, bool parallel,
+		      uint64_t *durp, size_t *bytesp)
+{
+	struct bench *bench;
+	size_t bytes = 0;
+	int i, err;
+
+	bench = (struct bench *)mem_zalloc(sizeof(*bench), NULL);
+	ASSERT_TRUE(bench != NULL);
+
+	bench->parallel = parallel;
+
+	for (i = 0; i < BENCH_PAIRS; ++i) {
+		bench_peer_alloc(&bench->a[i], fix, &bench->b[i]);
+		bench_peer_alloc(&bench->b[i], fix, &bench->a[i]);
+	}
+
+	tmr_init(&bench->tmr);
+	tmr_start(&bench->tmr, 1, bench_tmr_handler, bench);
+
+	err = re_main_wait(30000);
+	tmr_cancel(&bench->tmr);
+	bench_join(bench);
+	ASSERT_EQ(0, err);
+
+	for (i = 0; i < BENCH_PAIRS; ++i) {
+		ASSERT_EQ(0, bench->a[i].send_err);
+		ASSERT_EQ(BENCH_MESSAGES, bench->b[i].n_received);
+		bytes += bench->b[i].bytes;
+	}
+	ASSERT_EQ((size_t)BENCH_PAIRS * BENCH_MESSAGES * BENCH_MSG_SIZE,
+		  bytes);
+
+	*durp = bench->t_done - bench->t_start;
+	*bytesp = bytes;
+
+	for (i = 0; i < BENCH_PAIRS; ++i) {
+		bench->a[i].dce = (struct dce *)mem_deref(bench->a[i].dce);
+		bench->b[i].dce = (struct dce *)mem_deref(bench->b[i].dce);
+	}
+
+	/* flush packets still in the queue  */
+	re_main_wait(100);
+
+	mem_deref(bench);
+}
+
+
+static void bench_report(const char *name, uint64_t dur, size_t bytes)
+{
+	if (!dur) {
+		re_printf("%-10s %6llu ms\n", name, (unsigned long long)dur);
+		return;
+	}
+
+	re_printf("%-10s %6llu ms %8llu messages/s %8llu KB/s\n", name,
+		  (unsigned long long)dur,
+		  (unsigned long long)
+		  (BENCH_PAIRS * BENCH_MESSAGES * 1000ULL / dur),
+		  (unsigned long long)(bytes / dur));
+}
+
+
+TEST_F(Dce, multi_association_throughput)
+{
+	uint64_t dur_base = 0, dur_par = 0;
+	size_t bytes_base = 0, bytes_par = 0;
+
+	bench_run(this, false, &dur_base, &bytes_base);
+	if (HasFatalFailure())
+		return;
+	bench_run(this, true, &dur_par, &bytes_par);
+	if (HasFatalFailure())
+		return;
+
+	re_printf("~~~ dce throughput report ~~~\n");
+	re_printf("associations:   %d\n", BENCH_PAIRS);
+	re_printf("messages:       %d x %d bytes each\n",
+		  BENCH_MESSAGES, BENCH_MSG_SIZE);
+	bench_report("baseline", dur_base, bytes_base);
+	bench_report("parallel", dur_par, bytes_par);
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+}
+
+
+/*
+ * Bulk transfer: one association sending a large payload, refilled
+ * from the low watermark handler.
+ */
+
+#define BULK_BLOCK  (256*1024)
+#define BULK_LOW    (128*1024)
+
+struct bulk {
+	struct bench_peer a;
+	struct bench_peer b;
+	struct tmr tmr;
+	int step;
+	int wait_count;
+
+	uint8_t *data;
+	size_t total;
+	size_t sent;
+	size_t rcvd;
+	unsigned n_low;
+	unsigned n_msgs;
+	size_t max_msg;
+	bool corrupt;
+
+	uint64_t t_start;
+	uint64_t t_done;
+};
+
+
+static void bulk_fill(struct bulk *bulk)
+{
+	while (bulk->sent < bulk->total &&
+	       dce_buffered_amount(bulk->a.dce, bulk->a.ch) <= BULK_LOW) {
+
+		size_t n = std::min(bulk->total - bulk->sent,
+				    (size_t)BULK_BLOCK);
+		int err;
+
+		err = dce_send_bulk(bulk->a.dce, bulk->a.ch,
+				    bulk->data + bulk->sent, n);
+		if (err) {
+			bulk->a.send_err = err;
+			return;
+		}
+		bulk->sent += n;
+	}
+}
+
+
+static void bulk_low_handler(size_t buffered, void *arg)
+{
+	struct bulk *bulk = (struct bulk *)arg;
+
+	++bulk->n_low;
+	bulk_fill(bulk);
+}
+
+
+static void bulk_data_handler(int sid, uint8_t *data, size_t len, void *arg)
+{
+	struct bulk *bulk = (struct bulk *)arg;
+
+	if (bulk->rcvd + len > bulk->total ||
+	    memcmp(data, bulk->data + bulk->rcvd, len))
+		bulk->corrupt = true;
+
+	bulk->rcvd += len;
+	bulk->max_msg = std::max(bulk->max_msg, len);
+	++bulk->n_msgs;
+}
+
+
+static void bulk_estab_handler(void *arg)
+{
+	struct bench_peer *bp = (struct bench_peer *)arg;
+
+	bp->estab = true;
+}
+
+
+static void bulk_tmr_handler(void *arg)
+{
+	struct bulk *bulk = (struct bulk *)arg;
+
+	if (++bulk->wait_count > 10 * MAX_WAIT) {
+		re_cancel();
+		return;
+	}
+
+	switch (bulk->step) {
+
+	case 0:
+		dce_connect(bulk->a.dce, true);
+		dce_connect(bulk->b.dce, false);
+		++bulk->step;
+		break;
+
+	case 1:
+		if (!bulk->a.estab || !bulk->b.estab)
+			break;
+
+		dce_open_chan(bulk->a.dce, bulk->a.ch);
+		++bulk->step;
+		break;
+
+	case 2:
+		if (!dce_is_chan_open(bulk->a.ch))
+			break;
+
+		bulk->t_start = tmr_jiffies();
+		bulk_fill(bulk);
+		++bulk->step;
+		break;
+
+	case 3:
+		if (bulk->rcvd < bulk->total && !bulk->corrupt)
+			break;
+
+		bulk->t_done = tmr_jiffies();
+		re_cancel();
+		return;
+	}
+
+	tmr_start(&bulk->tmr, 1, bulk_tmr_handler, bulk);
+}
+
+
+static void bulk_dtor(void *arg)
+{
+	struct bulk *bulk = (struct bulk *)arg;
+
+	mem_deref(bulk->data);
+}
+
+
+static void run_bulk(Dce *fix, struct bulk *bulk, size_t total)
+{
+	int err;
+
+	bulk->total = total;
+	bulk->data = (uint8_t *)mem_alloc(total, NULL);
+	ASSERT_TRUE(bulk->data != NULL);
+	for (size_t i = 0; i < total; ++i)
+		bulk->data[i] = (uint8_t)(i % 251);
+
+	bulk->a.fix = fix;
+	bulk->a.other = &bulk->b;
+	bulk->b.fix = fix;
+	bulk->b.other = &bulk->a;
+
+	err = dce_alloc(&bulk->a.dce, bench_send_handler, bulk_estab_handler,
+			&bulk->a);
+	ASSERT_EQ(0, err);
+	err = dce_channel_alloc(&bulk->a.ch, bulk->a.dce, "bulk", "",
+				NULL, NULL, NULL, NULL, bulk);
+	ASSERT_EQ(0, err);
+	err = dce_channel_set_buffered_low(bulk->a.ch, BULK_LOW,
+					   bulk_low_handler);
+	ASSERT_EQ(0, err);
+
+	err = dce_alloc(&bulk->b.dce, bench_send_handler, bulk_estab_handler,
+			&bulk->b);
+	ASSERT_EQ(0, err);
+	err = dce_channel_alloc(&bulk->b.ch, bulk->b.dce, "bulk", "",
+				NULL, NULL, NULL, bulk_data_handler, bulk);
+	ASSERT_EQ(0, err);
+
+	tmr_init(&bulk->tmr);
+	tmr_start(&bulk->tmr, 1, bulk_tmr_handler, bulk);
+
+	err = re_main_wait(60000);
+	ASSERT_EQ(0, err);
+	tmr_cancel(&bulk->tmr);
+
+	bulk->a.dce = (struct dce *)mem_deref(bulk->a.dce);
+	bulk->b.dce = (struct dce *)mem_deref(bulk->b.dce);
+
+	/* flush packets still in the queue  */
+	re_main_wait(100);
+}
+
+
+TEST_F(Dce, bulk_fragmentation)
+{
+	struct bulk *bulk;
+
+	bulk = (struct bulk *)mem_zalloc(sizeof(*bulk), bulk_dtor);
+	ASSERT_TRUE(bulk != NULL);
+
+	run_bulk(this, bulk, 100 * 1024 + 17);
+
+	ASSERT_EQ(0, bulk->a.send_err);
+	ASSERT_FALSE(bulk->corrupt);
+	ASSERT_EQ(bulk->total, bulk->rcvd);
+	ASSERT_EQ(7, bulk->n_msgs);
+	ASSERT_EQ(16 * 1024, bulk->max_msg);
+
+	mem_deref(bulk);
+}
+
+
+TEST_F(Dce, bulk_throughput)
+{
+	struct bulk *bulk;
+	uint64_t dur;
+
+	bulk = (struct bulk *)mem_zalloc(sizeof(*bulk), bulk_dtor);
+	ASSERT_TRUE(bulk != NULL);
+
+	run_bulk(this, bulk, 8 * 1024 * 1024);
+
+	ASSERT_EQ(0, bulk->a.send_err);
+	ASSERT_FALSE(bulk->corrupt);
+	ASSERT_EQ(bulk->total, bulk->rcvd);
+	ASSERT_TRUE(bulk->n_low > 0);
+
+	dur = bulk->t_done - bulk->t_start;
+
+	re_printf("~~~ dce bulk transfer report ~~~\n");
+	re_printf("payload:        %zu bytes\n", bulk->total);
+	re_printf("messages:       %u\n", bulk->n_msgs);
+	re_printf("low watermark:  %u times\n", bulk->n_low);
+	re_printf("duration:       %llu ms\n", (unsigned long long)dur);
+	if (dur) {
+		re_printf("throughput:     %llu KB/s\n",
+			  (unsigned long long)(bulk->total / dur));
+	}
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+
+	mem_deref(bulk);
+}
@@ -378,3 +378,116 @@ TEST(dtls, loss_4)
 {
 	test_init(TLS_KEYTYPE_EC, FILTER_PACKET_LOSS, 4);
 }
+
+
+/*
+ * Connect from A to B, optionally resuming a session from an earlier
+ * connection on the same TLS context. Returns the session of the new
+ * connection and the number of packets seen by A.
+ */
+static void resume_handshake(struct tls *tls, struct tls_session *sess,
+			     struct tls_session **sessp, bool *reusedp,
+			     unsigned *npktp, uint8_t *cli_key, size_t keysz)
+{
+	struct agent *ag_a=0, *ag_b=0;
+	enum srtp_suite suite;
+	uint8_t srv_key[30], key_b[30], srv_key_b[30];
+	int err;
+
+	agent_alloc(&ag_a, tls, "A", true);
+	agent_alloc(&ag_b, tls, "B", false);
+	ASSERT_TRUE(ag_a != NULL);
+	ASSERT_TRUE(ag_b != NULL);
+	ag_a->peer = ag_b;
+	ag_b->peer = ag_a;
+
+	agent_filter(ag_a, FILTER_NONE, 0);
+
+	err = dtls_resume(&ag_a->dtls_conn, tls, ag_a->dtls_sock,
+			  &ag_b->addr, sess,
+			  dtls_estab_handler, dtls_recv_handler,
+			  dtls_close_handler, ag_a);
+	ASSERT_EQ(0, err);
+
+	err = re_main_wait(10000);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(1, ag_a->estab);
+	ASSERT_EQ(1, ag_b->estab);
+
+	/* both sides agree on whether the session was resumed */
+	*reusedp = tls_session_reused(ag_a->dtls_conn);
+	ASSERT_EQ(*reusedp, tls_session_reused(ag_b->dtls_conn));
+
+	/* and on the SRTP keys */
+	err = tls_srtp_keyinfo(ag_a->dtls_conn, &suite, cli_key, keysz,
+			       srv_key, sizeof(srv_key));
+	ASSERT_EQ(0, err);
+	err = tls_srtp_keyinfo(ag_b->dtls_conn, &suite, key_b, sizeof(key_b),
+			       srv_key_b, sizeof(srv_key_b));
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, memcmp(cli_key, key_b, keysz));
+	ASSERT_EQ(0, memcmp(srv_key, srv_key_b, sizeof(srv_key)));
+
+	if (sessp) {
+		err = tls_get_session(sessp, ag_a->dtls_conn);
+		ASSERT_EQ(0, err);
+	}
+
+	/* handshake and one application packet each way */
+	*npktp = ag_a->seq;
+
+	mem_deref(ag_b);
+	mem_deref(ag_a);
+}
+
+
+TEST(dtls, resume)
+{
+	struct tls *tls = NULL;
+	struct tls_session *sess1 = NULL, *sess2 = NULL;
+	uint8_t key1[30], key2[30], key3[30];
+	unsigned npkt_full, npkt_resumed, npkt;
+	bool reused;
+	int err;
+
+	err = tls_alloc(&tls, TLS_METHOD_DTLS, 0, 0);
+	ASSERT_EQ(0, err);
+	err = cert_enable_ecdh(tls);
+	ASSERT_EQ(0, err);
+	err = cert_tls_set_selfsigned_ecdsa(tls, "prime256v1");
+	ASSERT_EQ(0, err);
+	err = tls_set_srtp(tls, "SRTP_AES128_CM_SHA1_80");
+	ASSERT_EQ(0, err);
+	tls_set_verify_client(tls);
+
+	err = tls_set_session_reuse(tls, true);
+	ASSERT_EQ(0, err);
+
+	resume_handshake(tls, NULL, &sess1, &reused, &npkt_full,
+			 key1, sizeof(key1));
+	ASSERT_TRUE(sess1 != NULL);
+	ASSERT_FALSE(reused);
+
+	resume_handshake(tls, sess1, &sess2, &reused, &npkt_resumed,
+			 key2, sizeof(key2));
+	ASSERT_TRUE(sess2 != NULL);
+	ASSERT_TRUE(reused);
+
+	/* abbreviated handshake, fresh keys */
+	ASSERT_LT(npkt_resumed, npkt_full);
+	ASSERT_NE(0, memcmp(key1, key2, sizeof(key1)));
+
+	/* a server without session cache does a full handshake */
+	err = tls_set_session_reuse(tls, false);
+	ASSERT_EQ(0, err);
+
+	resume_handshake(tls, sess2, NULL, &reused, &npkt,
+			 key3, sizeof(key3));
+	ASSERT_FALSE(reused);
+	ASSERT_EQ(npkt_full, npkt);
+
+	mem_deref(sess2);
+	mem_deref(sess1);
+	mem_deref(tls);
+}
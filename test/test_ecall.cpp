@@ -97,6 +97,7 @@ struct client {
 	unsigned n_media_estab = 0;
 	unsigned n_audio_estab = 0;
 	unsigned n_datachan_estab = 0;
+	unsigned n_dtls_resumed = 0;
 	unsigned n_propsync = 0;
 	unsigned n_close = 0;
 	int err_close;
@@ -616,6 +617,9 @@ public:
 
 		++cli->n_datachan_estab;
 
+		if (mediaflow_dtls_resumed(ecall_mediaflow(cli->ecall)))
+			++cli->n_dtls_resumed;
+
 		if (fix->exp_total_datachan_estab &&
 	    total_datachan_estab(loop) >= fix->exp_total_datachan_estab) {
 
@@ -2100,4 +2104,91 @@ TEST_F(Ecall, restart)
 	ASSERT_EQ(1, b2->n_conn);
 	ASSERT_EQ(2, b2->n_datachan_estab);
 }
+
+
+/* The side that restarts offers, the other side takes the update
+ * request path. The DTLS client keeps its session either way, and
+ * both sides resume it on the new flow.
+ */
+TEST_F(Ecall, restart_resumes_dtls)
+{
+	struct client *a1, *b2;
+
+	prepare_loops(1, 4);
+
+	struct conv_loop *conv = loopv[0];
+
+	prepare_clients(conv);
+
+	conv->clients[1].userid = "";
+	conv->clients[2].userid = "";
+
+	a1 = convloop_client(conv, "A", "1");
+	b2 = convloop_client(conv, "B", "2");
+	ASSERT_TRUE(a1 != NULL);
+	ASSERT_TRUE(b2 != NULL);
+
+	b2->action_conn = ACTION_ANSWER;
+
+	exp_total_audio_estab = 2;
+	a1->action_aestab = ACTION_RESTART;
+
+	exp_total_datachan_estab = 4;
+	a1->action_destab = ACTION_END;
+
+	b2->action_close = ACTION_TEST_COMPLETE;
+
+	test_base(conv, MEDIAFLOW_TRICKLEICE_DUALSTACK);
+
+	err = re_main_wait(10000);
+	ASSERT_EQ(0, err);
+
+	/* the first flow does a full handshake */
+	ASSERT_EQ(2, a1->n_datachan_estab);
+	ASSERT_EQ(1, a1->n_dtls_resumed);
+
+	ASSERT_EQ(2, b2->n_datachan_estab);
+	ASSERT_EQ(1, b2->n_dtls_resumed);
+}
+
+
+TEST_F(Ecall, restart_by_callee_resumes_dtls)
+{
+	struct client *a1, *b2;
+
+	prepare_loops(1, 4);
+
+	struct conv_loop *conv = loopv[0];
+
+	prepare_clients(conv);
+
+	conv->clients[1].userid = "";
+	conv->clients[2].userid = "";
+
+	a1 = convloop_client(conv, "A", "1");
+	b2 = convloop_client(conv, "B", "2");
+	ASSERT_TRUE(a1 != NULL);
+	ASSERT_TRUE(b2 != NULL);
+
+	b2->action_conn = ACTION_ANSWER;
+
+	exp_total_audio_estab = 2;
+	b2->action_aestab = ACTION_RESTART;
+
+	exp_total_datachan_estab = 4;
+	b2->action_destab = ACTION_END;
+
+	a1->action_close = ACTION_TEST_COMPLETE;
+
+	test_base(conv, MEDIAFLOW_TRICKLEICE_DUALSTACK);
+
+	err = re_main_wait(10000);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(2, a1->n_datachan_estab);
+	ASSERT_EQ(1, a1->n_dtls_resumed);
+
+	ASSERT_EQ(2, b2->n_datachan_estab);
+	ASSERT_EQ(1, b2->n_dtls_resumed);
+}
 #endif
@@ -273,3 +273,239 @@ TEST_F(EngineTest, register_client)
 
 	shutdown();
 }
+
+
+/*
+ * Startup from a synthetic store
+ */
+
+#define STARTUP_NUM_CONVS 2000
+#define STARTUP_NUM_USERS 16
+#define STARTUP_MEMBERS   8
+
+
+class EngineStartupTest : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		char tmp[256];
+
+#if 1
+		log_set_min_level(LOG_LEVEL_WARN);
+		log_enable_stderr(false);
+#endif
+
+		err = engine_init(ENG_MSYS);
+		ASSERT_EQ(0, err);
+
+		backend = new FakeBackend;
+		backend->addUser("user@domain.com", "secret");
+
+		re_snprintf(tmp, sizeof(tmp), "/tmp/ztest_store_XXXXXX");
+		ASSERT_TRUE(mkdtemp(tmp) != NULL);
+		str_ncpy(path, tmp, sizeof(path));
+
+		err = store_alloc(&store, path);
+		ASSERT_EQ(0, err);
+	}
+
+	virtual void TearDown() override
+	{
+		mem_deref(eng);
+		mem_deref(store);
+		engine_close();
+
+		store_remove_pathf("%s", path);
+
+		delete backend;
+	}
+
+	/* Must be called after engine_alloc() has set the store user */
+	void write_convs(unsigned num)
+	{
+		for (unsigned i = 0; i < num; ++i) {
+			struct sobject *so;
+			char id[64];
+
+			re_snprintf(id, sizeof(id),
+				    "00000000-0000-0000-0000-%012u", i);
+
+			err = store_user_open(&so, store, "conv", id, "wb");
+			ASSERT_EQ(0, err);
+
+			err |= sobject_write_u8(so, 0);
+			err |= sobject_write_lenstr(so, id);
+			err |= sobject_write_u32(so, STARTUP_MEMBERS);
+			for (unsigned j = 0; j < STARTUP_MEMBERS; ++j) {
+				char uid[64];
+
+				re_snprintf(uid, sizeof(uid),
+					    "11111111-0000-0000-0000-%012u",
+					    (i + j) % STARTUP_NUM_USERS);
+
+				err |= sobject_write_lenstr(so, uid);
+				err |= sobject_write_u8(so, 0x01);
+				err |= sobject_write_dbl(so, 0.);
+			}
+			err |= sobject_write_u8(so, 0x01);
+			err |= sobject_write_lenstr(so, "1.800122000a");
+			err |= sobject_write_lenstr(so, "1.800122000a");
+			ASSERT_EQ(0, err);
+
+			mem_deref(so);
+		}
+	}
+
+	uint64_t run_startup(unsigned workers, bool bulk)
+	{
+		struct engine_lsnr lsnr;
+		uint64_t t1, t_write;
+
+		memset(&lsnr, 0, sizeof(lsnr));
+		lsnr.addconvh = add_conv_handler;
+		if (bulk)
+			lsnr.convsloadedh = convs_loaded_handler;
+		lsnr.arg = this;
+
+		t1 = tmr_jiffies();
+
+		err = engine_alloc(&eng, backend->uri, backend->uri,
+				   "user@domain.com", "secret",
+				   store, false, false, "ztest 1.0",
+				   engine_ready_handler,
+				   NULL, NULL, this);
+		if (err)
+			return 0;
+
+		err = engine_set_startup_workers(eng, workers);
+		if (err)
+			return 0;
+
+		err = engine_lsnr_register(eng, &lsnr);
+		if (err)
+			return 0;
+
+		/* The store user is only known now. Writing the test data
+		 * is not part of the startup, so it is not timed.
+		 */
+		t_write = tmr_jiffies();
+		write_convs(STARTUP_NUM_CONVS);
+		t_write = tmr_jiffies() - t_write;
+
+		err = re_main_wait(30000);
+		engine_lsnr_unregister(&lsnr);
+
+		return tmr_jiffies() - t1 - t_write;
+	}
+
+	static void engine_ready_handler(void *arg)
+	{
+		EngineStartupTest *et = static_cast<EngineStartupTest *>(arg);
+
+		++et->n_ready;
+		re_cancel();
+	}
+
+	static void add_conv_handler(struct engine_conv *conv, void *arg)
+	{
+		EngineStartupTest *et = static_cast<EngineStartupTest *>(arg);
+
+		++et->n_addconv;
+	}
+
+	static void convs_loaded_handler(uint32_t count, void *arg)
+	{
+		EngineStartupTest *et = static_cast<EngineStartupTest *>(arg);
+
+		++et->n_loaded;
+		et->loaded_count = count;
+	}
+
+	static bool count_handler(struct engine_conv *conv, void *arg)
+	{
+		++*static_cast<unsigned *>(arg);
+		return false;
+	}
+
+	unsigned count_convs()
+	{
+		unsigned n = 0;
+
+		engine_apply_convs(eng, count_handler, &n);
+		return n;
+	}
+
+protected:
+	FakeBackend *backend = nullptr;
+	struct engine *eng = nullptr;
+	struct store *store = nullptr;
+	char path[256];
+	int err = 0;
+	unsigned n_ready = 0;
+	unsigned n_addconv = 0;
+	unsigned n_loaded = 0;
+	uint32_t loaded_count = 0;
+};
+
+
+TEST_F(EngineStartupTest, sequential)
+{
+	run_startup(0, true);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(1, n_ready);
+
+	ASSERT_EQ(STARTUP_NUM_CONVS, count_convs());
+	ASSERT_EQ(0, n_addconv);
+	ASSERT_EQ(1, n_loaded);
+	ASSERT_EQ(STARTUP_NUM_CONVS, loaded_count);
+}
+
+
+TEST_F(EngineStartupTest, parallel_bulk_notification)
+{
+	run_startup(4, true);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(1, n_ready);
+
+	ASSERT_EQ(STARTUP_NUM_CONVS, count_convs());
+	ASSERT_EQ(0, n_addconv);
+	ASSERT_EQ(1, n_loaded);
+	ASSERT_EQ(STARTUP_NUM_CONVS, loaded_count);
+}
+
+
+TEST_F(EngineStartupTest, parallel_deferred_addconv)
+{
+	run_startup(4, false);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(1, n_ready);
+
+	ASSERT_EQ(STARTUP_NUM_CONVS, count_convs());
+	ASSERT_EQ(STARTUP_NUM_CONVS, n_addconv);
+	ASSERT_EQ(0, n_loaded);
+}
+
+
+TEST_F(EngineStartupTest, performance)
+{
+	uint64_t t_seq, t_par;
+
+	t_seq = run_startup(0, true);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(STARTUP_NUM_CONVS, count_convs());
+
+	eng = (struct engine *)mem_deref(eng);
+	n_ready = 0;
+
+	t_par = run_startup(4, true);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(STARTUP_NUM_CONVS, count_convs());
+
+	re_printf("~~~ startup performance report ~~~\n");
+	re_printf("conversations:  %d\n", STARTUP_NUM_CONVS);
+	re_printf("sequential:     %llu ms\n", (unsigned long long)t_seq);
+	re_printf("4 workers:      %llu ms\n", (unsigned long long)t_par);
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+}
@@ -369,6 +369,102 @@ TEST_F(FlowmgrTest, flow_add_event)
 }
 
 
+#define FLOW_ADD_JSON(conv, flow)					\
+	"{"								\
+	"\"conversation\":\"" conv "\","				\
+	"\"type\":\"call.flow-add\","					\
+	"\"flows\":["							\
+	  "{"								\
+	    "\"creator\":\"b1b4efa0-4204-4fd0-be42-b8b64f0fbdcb\","	\
+	    "\"active\":false,"						\
+	    "\"remote_user\":\"b1b4efa0-4204-4fd0-be42-b8b64f0fbdcb\","	\
+	    "\"sdp_step\":\"pending\","					\
+	    "\"id\":\"" flow "\""					\
+	  "}"								\
+	"]"								\
+	"}"
+
+#define CAND_ADD_JSON(conv, flow)					\
+	"{"								\
+	"\"conversation\":\"" conv "\","				\
+	"\"type\":\"call.remote-candidates-add\","			\
+	"\"flow\":\"" flow "\","					\
+	"\"candidates\":[]"						\
+	"}"
+
+
+#define CONV1 "c1ac3155-c865-4da5-b571-5a6004fc3e96"
+#define CONV2 "0f6b1e1c-4b1c-4e4b-9a52-5fd7d1c1a1a2"
+#define FLOWA "49bdf339-9d96-4db2-89bb-f7982e10f96c"
+#define FLOWB "5b1e7c1a-7c66-4e43-9a5d-0d0d7a4a8e11"
+#define FLOWC "7aa3d1d5-54d1-4b0f-bd2f-35f0a5c0c2f4"
+
+struct event_count {
+	unsigned n[FLOWMGR_EVENT_MAX];
+	std::string last_flowid;
+};
+
+
+static void count_event_handler(enum flowmgr_event ev,
+				const char *convid, const char *flowid,
+				void *jobj, void *arg)
+{
+	struct event_count *ec = (struct event_count *)arg;
+
+	++ec->n[ev];
+	if (flowid)
+		ec->last_flowid = flowid;
+}
+
+
+/* Events for a flow we do not know yet are held back until the flow is
+ * added, and only that flow's events are dispatched then.
+ */
+TEST_F(FlowmgrTest, pending_events_per_flow)
+{
+	static const char add_a[] = FLOW_ADD_JSON(CONV1, FLOWA);
+	static const char add_b[] = FLOW_ADD_JSON(CONV1, FLOWB);
+	static const char add_c[] = FLOW_ADD_JSON(CONV2, FLOWC);
+	static const char cand_b[] = CAND_ADD_JSON(CONV1, FLOWB);
+	static const char cand_x[] = CAND_ADD_JSON(CONV2, FLOWB);
+	struct event_count ec;
+	bool handled;
+
+	memset(ec.n, 0, sizeof(ec.n));
+	flowmgr_set_event_handler(fm, count_event_handler, &ec);
+
+	err = flowmgr_process_event(&handled, fm, "application/json",
+				    add_a, strlen(add_a));
+	ASSERT_EQ(0, err);
+	err = flowmgr_process_event(&handled, fm, "application/json",
+				    add_c, strlen(add_c));
+	ASSERT_EQ(0, err);
+
+	/* Candidates for flow B, before flow B exists */
+	for (int i = 0; i < 3; i++) {
+		err = flowmgr_process_event(&handled, fm, "application/json",
+					    cand_b, strlen(cand_b));
+		ASSERT_EQ(0, err);
+		ASSERT_TRUE(handled);
+	}
+	err = flowmgr_process_event(&handled, fm, "application/json",
+				    cand_x, strlen(cand_x));
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, ec.n[FLOWMGR_EVENT_CAND_ADD]);
+
+	err = flowmgr_process_event(&handled, fm, "application/json",
+				    add_b, strlen(add_b));
+	ASSERT_EQ(0, err);
+
+	/* Only the events of CONV1/FLOWB are replayed */
+	ASSERT_EQ(3, ec.n[FLOWMGR_EVENT_CAND_ADD]);
+	ASSERT_EQ(FLOWB, ec.last_flowid);
+
+	flowmgr_release_flows(fm, CONV1);
+	flowmgr_release_flows(fm, CONV2);
+}
+
+
 TEST_F(FlowmgrTest, handle_bogus_response)
 {
 	struct rr_resp *rr = (struct rr_resp *)0x0000beef;
@@ -354,3 +354,396 @@ TEST(jzon, add_base64)
 
 	mem_deref(jobj);
 }
+
+
+TEST(jzon, decode_escapes)
+{
+	static const char str[] =
+		"{\"quote\":\"a\\\"b\\\\c\\/d\","
+		" \"ctrl\":\"\\t\\r\\n\","
+		" \"latin\":\"gr\\u00fc\\u00DF\","
+		" \"euro\":\"\\u20ac\","
+		" \"clef\":\"\\ud834\\udd1e\","
+		" \"true\":true, \"null\":null}";
+	struct json_object *jobj;
+	bool b;
+	int err;
+
+	err = jzon_decode(&jobj, str, strlen(str));
+	ASSERT_EQ(0, err);
+
+	ASSERT_STREQ("a\"b\\c/d", jzon_str(jobj, "quote"));
+	ASSERT_STREQ("\t\r\n", jzon_str(jobj, "ctrl"));
+	ASSERT_STREQ("gr\xc3\xbc\xc3\x9f", jzon_str(jobj, "latin"));
+	ASSERT_STREQ("\xe2\x82\xac", jzon_str(jobj, "euro"));
+	ASSERT_STREQ("\xf0\x9d\x84\x9e", jzon_str(jobj, "clef"));
+
+	ASSERT_EQ(0, jzon_bool(&b, jobj, "true"));
+	ASSERT_TRUE(b);
+	ASSERT_EQ(0, jzon_is_null(jobj, "null"));
+
+	mem_deref(jobj);
+}
+
+
+TEST(jzon, decode_arrays)
+{
+	static const char str[] =
+		"{\"matrix\":[[1,2,3],[4,5,6]],"
+		" \"mixed\":[\"x\", 1.5, -7, 2e2, true, null, {}, []]}";
+	struct json_object *jobj, *jarr, *jrow, *jv;
+	int i, j;
+	int err;
+
+	err = jzon_decode(&jobj, str, strlen(str));
+	ASSERT_EQ(0, err);
+
+	err = jzon_array(&jarr, jobj, "matrix");
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(2, json_object_array_length(jarr));
+
+	for (i = 0; i < 2; i++) {
+		jrow = json_object_array_get_idx(jarr, i);
+		ASSERT_TRUE(jzon_is_array(jrow));
+		ASSERT_EQ(3, json_object_array_length(jrow));
+
+		for (j = 0; j < 3; j++) {
+			jv = json_object_array_get_idx(jrow, j);
+			ASSERT_EQ(i * 3 + j + 1, json_object_get_int(jv));
+		}
+	}
+	ASSERT_TRUE(json_object_array_get_idx(jarr, 2) == NULL);
+
+	err = jzon_array(&jarr, jobj, "mixed");
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(8, json_object_array_length(jarr));
+
+	jv = json_object_array_get_idx(jarr, 0);
+	ASSERT_STREQ("x", json_object_get_string(jv));
+	jv = json_object_array_get_idx(jarr, 1);
+	ASSERT_EQ(1.5, json_object_get_double(jv));
+	jv = json_object_array_get_idx(jarr, 2);
+	ASSERT_EQ(-7, json_object_get_int(jv));
+	jv = json_object_array_get_idx(jarr, 3);
+	ASSERT_EQ(200, json_object_get_int(jv));
+	ASSERT_TRUE(jzon_is_object(json_object_array_get_idx(jarr, 6)));
+	ASSERT_TRUE(jzon_is_array(json_object_array_get_idx(jarr, 7)));
+
+	mem_deref(jobj);
+}
+
+
+TEST(jzon, decode_invalid)
+{
+	static const char *strv[] = {
+		"",
+		"   ",
+		"\"just a string\"",
+		"42",
+		"{",
+		"{\"a\":}",
+		"{\"a\" 1}",
+		"{\"a\":1,}",
+		"[1 2]",
+		"[tru]",
+		"{\"a\":\"unterminated}",
+		"{\"a\":\"\\u12\"}",
+		"[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]",
+
+		/* numbers */
+		"[1-2+3]",
+		"[+1]",
+		"[-]",
+		"[01]",
+		"[1.]",
+		"[.5]",
+		"[1e]",
+		"[1e+]",
+		"[0x10]",
+		"[1.5.5]",
+
+		/* literals are lower case */
+		"[TRUE]",
+		"[False]",
+		"{\"a\":NULL}",
+
+		/* trailing garbage */
+		"{} x",
+		"{}{}",
+		"[1]]",
+		"{\"a\":1},",
+	};
+	struct json_object *jobj = NULL;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(strv); i++) {
+		int err = jzon_decode(&jobj, strv[i], strlen(strv[i]));
+		ASSERT_TRUE(err != 0) << strv[i];
+	}
+}
+
+
+TEST(jzon, decode_modify_encode)
+{
+	static const char str[] =
+		"{\"a\":1,\"list\":[\"x\",\"y\"],\"sub\":{\"b\":\"c\"}}";
+	struct json_object *jobj, *jlist, *jsub, *jout;
+	struct odict *od;
+	char *enc = NULL;
+	int err;
+
+	err = jzon_decode(&jobj, str, strlen(str));
+	ASSERT_EQ(0, err);
+
+	err = jzon_encode(&enc, jobj);
+	ASSERT_EQ(0, err);
+	ASSERT_STREQ(str, enc);
+	enc = (char *)mem_deref(enc);
+
+	/* the odict view contains everything */
+	od = jzon_get_odict(jobj);
+	ASSERT_TRUE(od != NULL);
+	ASSERT_EQ(3, odict_count(od, false));
+	ASSERT_EQ(2, odict_count(odict_lookup(od, "list")->u.odict, false));
+
+	/* modify decoded containers */
+	err = jzon_add_str(jobj, "new", "value");
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, jzon_array(&jlist, jobj, "list"));
+	ASSERT_EQ(0, json_object_array_add(jlist,
+					   json_object_new_int(3)));
+	ASSERT_EQ(3, json_object_array_length(jlist));
+	ASSERT_EQ(3, json_object_get_int(
+			  json_object_array_get_idx(jlist, 2)));
+
+	err = jzon_encode(&enc, jobj);
+	ASSERT_EQ(0, err);
+	ASSERT_STREQ("{\"a\":1,\"list\":[\"x\",\"y\",3],"
+		     "\"sub\":{\"b\":\"c\"},\"new\":\"value\"}", enc);
+	enc = (char *)mem_deref(enc);
+
+	mem_deref(jobj);
+
+	/* add a node of a decoded document to a new object */
+	err = jzon_decode(&jobj, str, strlen(str));
+	ASSERT_EQ(0, err);
+
+	jout = jzon_alloc_object();
+	ASSERT_EQ(0, jzon_object(&jsub, jobj, "sub"));
+	json_object_object_add(jout, "sub", jsub);
+
+	mem_deref(jobj);
+
+	/* survives the document */
+	err = jzon_encode(&enc, jout);
+	ASSERT_EQ(0, err);
+	ASSERT_STREQ("{\"sub\":{\"b\":\"c\"}}", enc);
+
+	mem_deref(enc);
+	mem_deref(jout);
+}
+
+
+TEST(jzon, decode_numbers)
+{
+	static const char str[] =
+		"[0, -0, 7, -12, 0.5, -0.25e+2, 1E3, 2e-1] \r\n";
+	struct json_object *jarr;
+	int err;
+
+	/* trailing whitespace and a terminating NUL are fine */
+	err = jzon_decode(&jarr, str, sizeof(str));
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(8, json_object_array_length(jarr));
+
+	ASSERT_EQ(0, json_object_get_int(json_object_array_get_idx(jarr, 0)));
+	ASSERT_EQ(0, json_object_get_int(json_object_array_get_idx(jarr, 1)));
+	ASSERT_EQ(7, json_object_get_int(json_object_array_get_idx(jarr, 2)));
+	ASSERT_EQ(-12, json_object_get_int(json_object_array_get_idx(jarr, 3)));
+	ASSERT_EQ(0.5, json_object_get_double(
+			  json_object_array_get_idx(jarr, 4)));
+	ASSERT_EQ(-25.0, json_object_get_double(
+			  json_object_array_get_idx(jarr, 5)));
+	ASSERT_EQ(1000, json_object_get_int(
+			  json_object_array_get_idx(jarr, 6)));
+	ASSERT_EQ(0.2, json_object_get_double(
+			  json_object_array_get_idx(jarr, 7)));
+
+	mem_deref(jarr);
+}
+
+
+/* Root arrays are printed with {} and index keys, nested ones with [] */
+TEST(jzon, roundtrip_array)
+{
+	static const char str[] = "[1,[2,3],{\"a\":true}]";
+	struct json_object *jarr, *jin;
+	char *enc = NULL;
+	int err;
+
+	jarr = jzon_alloc_array();
+	ASSERT_EQ(0, json_object_array_add(jarr,
+					   json_object_new_string("\xe2\x82\xac")));
+	ASSERT_EQ(0, json_object_array_add(jarr, json_object_new_int(1)));
+
+	err = jzon_encode(&enc, jarr);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ('{', enc[0]);
+
+	err = jzon_decode(&jin, enc, strlen(enc));
+	ASSERT_EQ(0, err);
+
+	ASSERT_TRUE(jzon_is_object(jin));
+	ASSERT_STREQ("\xe2\x82\xac", jzon_str(jin, "0"));
+
+	enc = (char *)mem_deref(enc);
+	jin = (struct json_object *)mem_deref(jin);
+
+	/* the same for a decoded array */
+	err = jzon_decode(&jin, str, strlen(str));
+	ASSERT_EQ(0, err);
+	ASSERT_TRUE(jzon_is_array(jin));
+	ASSERT_EQ(3, json_object_array_length(jin));
+
+	err = jzon_encode(&enc, jin);
+	ASSERT_EQ(0, err);
+	ASSERT_STREQ("{\"0\":1,\"1\":[2,3],\"2\":{\"a\":true}}", enc);
+
+	mem_deref(enc);
+	mem_deref(jin);
+	mem_deref(jarr);
+}
+
+
+#define BENCH_CONVS 500
+#define BENCH_ROUNDS 20
+
+static int bench_conv_list(struct re_printf *pf, void *arg)
+{
+	int i, j;
+	int err = 0;
+	(void)arg;
+
+	err |= re_hprintf(pf, "{\"has_more\":false,\"conversations\":[");
+	for (i = 0; i < BENCH_CONVS; i++) {
+		err |= re_hprintf(pf,
+			"%s{\"id\":\"%08x-29c5-4fa9-bfc4-28a803a9d450\","
+			"\"name\":\"conversation %d\",\"type\":%d,"
+			"\"creator\":\"9aad484e-5827-4b78-a8eb-08b7b1c3167f\","
+			"\"members\":{\"self\":{\"status\":0,"
+			"\"muted\":false},\"others\":[",
+			i ? "," : "", i, i, i % 3);
+		for (j = 0; j < 8; j++) {
+			err |= re_hprintf(pf,
+				"%s{\"status\":0,\"id\":"
+				"\"1ddba185-2a80-4c48-8007-a74ac041%04x\"}",
+				j ? "," : "", j);
+		}
+		err |= re_hprintf(pf, "]}}");
+	}
+	err |= re_hprintf(pf, "]}");
+
+	return err;
+}
+
+
+static int bench_odict(const char *str, size_t len, size_t *n)
+{
+	struct odict *od;
+	const struct odict_entry *convs, *conv, *e;
+	char key[16], *enc = NULL;
+	int i, err;
+
+	err = json_decode_odict(&od, 16, str, len, 8);
+	if (err)
+		return err;
+
+	convs = odict_lookup(od, "conversations");
+	for (i = 0; ; i++) {
+		re_snprintf(key, sizeof(key), "%d", i);
+		conv = odict_lookup(convs->u.odict, key);
+		if (!conv)
+			break;
+		e = odict_lookup(conv->u.odict, "id");
+		if (e && e->type == ODICT_STRING)
+			++*n;
+	}
+
+	err = re_sdprintf(&enc, "%H", json_encode_odict, od);
+
+	mem_deref(enc);
+	mem_deref(od);
+
+	return err;
+}
+
+
+static int bench_jzon(const char *str, size_t len, size_t *n)
+{
+	struct json_object *jobj, *jconvs;
+	char *enc = NULL;
+	int i, count, err;
+
+	err = jzon_decode(&jobj, str, len);
+	if (err)
+		return err;
+
+	err = jzon_array(&jconvs, jobj, "conversations");
+	if (err)
+		goto out;
+
+	count = json_object_array_length(jconvs);
+	for (i = 0; i < count; i++) {
+		struct json_object *jconv;
+
+		jconv = json_object_array_get_idx(jconvs, i);
+		if (jzon_str(jconv, "id"))
+			++*n;
+	}
+
+	err = jzon_encode(&enc, jobj);
+
+ out:
+	mem_deref(enc);
+	mem_deref(jobj);
+
+	return err;
+}
+
+
+TEST(jzon, benchmark_decode_encode)
+{
+	char *str = NULL;
+	uint64_t t0, t_odict, t_jzon;
+	size_t n_odict = 0, n_jzon = 0;
+	size_t len;
+	int i, err;
+
+	err = re_sdprintf(&str, "%H", bench_conv_list, NULL);
+	ASSERT_EQ(0, err);
+	len = strlen(str);
+
+	t0 = tmr_jiffies();
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		err = bench_odict(str, len, &n_odict);
+		ASSERT_EQ(0, err);
+	}
+	t_odict = tmr_jiffies() - t0;
+
+	t0 = tmr_jiffies();
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		err = bench_jzon(str, len, &n_jzon);
+		ASSERT_EQ(0, err);
+	}
+	t_jzon = tmr_jiffies() - t0;
+
+	ASSERT_EQ(BENCH_CONVS * BENCH_ROUNDS, n_odict);
+	ASSERT_EQ(n_odict, n_jzon);
+
+	re_printf("jzon benchmark: %zu bytes x %d rounds,"
+		  " decode+lookup+encode:\n", len, BENCH_ROUNDS);
+	re_printf("    odict:  %llu ms\n", t_odict);
+	re_printf("    arena:  %llu ms\n", t_jzon);
+
+	mem_deref(str);
+}
@@ -17,6 +17,7 @@
 */
 #include <re.h>
 #include <avs.h>
+#include <avs_mediastats.h>
 #include <gtest/gtest.h>
 #include "fakes.hpp"
 #include "ztest.h"
@@ -778,3 +779,265 @@ TEST_F(TestMedia, sdp_offer_with_bandwidth_attr)
 	/* verify video */
 	ASSERT_TRUE(find_in_sdp(sdp, "b=AS:800"));
 }
+
+
+static const char *sdp_audio_level_fmt =
+"v=0\r\n"
+"o=- 7592746549217333175 2 IN IP4 127.0.0.1\r\n"
+"s=-\r\n"
+"t=0 0\r\n"
+"m=audio 1 UDP/TLS/RTP/SAVPF 111\r\n"
+"c=IN IP4 0.0.0.0\r\n"
+"a=ice-ufrag:l7J3IU942KErkh/V\r\n"
+"a=ice-pwd:oORc7rLRvan7Nf2A6c+QjRkn\r\n"
+"a=fingerprint:sha-256 1D:A8:0B:46:EF:25:C9:3D:D1:D5:06:B9:9B:41:BE:DB:42:D6:15:D3:BA:C5:D5:99:FA:CC:92:74:AE:36:22:AB\r\n"
+"a=setup:actpass\r\n"
+"a=mid:audio\r\n"
+"%s"
+"a=sendrecv\r\n"
+"a=rtcp-mux\r\n"
+"a=rtpmap:111 opus/48000/2\r\n"
+"a=ssrc:267209345 cname:pKJMJctHTdncMCWy\r\n"
+	;
+
+
+TEST_F(TestMedia, sdp_offer_with_audio_level)
+{
+	char sdp[4096];
+	int err;
+
+	err = mediaflow_generate_offer(mf, sdp, sizeof(sdp));
+	ASSERT_EQ(0, err);
+
+	ASSERT_TRUE(find_in_sdp(sdp, "a=extmap:1 "
+				"urn:ietf:params:rtp-hdrext:ssrc-audio-level"));
+}
+
+
+TEST_F(TestMedia, sdp_answer_uses_remote_audio_level_id)
+{
+	char offer[4096], answer[4096];
+	int err;
+
+	re_snprintf(offer, sizeof(offer), sdp_audio_level_fmt,
+		    "a=extmap:3 http://www.webrtc.org/experiments/"
+		    "rtp-hdrext/abs-send-time\r\n"
+		    "a=extmap:4 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n");
+
+	err = mediaflow_offeranswer(mf, answer, sizeof(answer), offer);
+	ASSERT_EQ(0, err);
+
+	ASSERT_TRUE(find_in_sdp(answer, "a=extmap:4 "
+				"urn:ietf:params:rtp-hdrext:ssrc-audio-level"));
+	ASSERT_FALSE(find_in_sdp(answer, "a=extmap:1 "));
+	ASSERT_FALSE(find_in_sdp(answer, "abs-send-time"));
+}
+
+
+TEST_F(TestMedia, sdp_answer_without_audio_level)
+{
+	char offer[4096], answer[4096];
+	int err;
+
+	re_snprintf(offer, sizeof(offer), sdp_audio_level_fmt, "");
+
+	err = mediaflow_offeranswer(mf, answer, sizeof(answer), offer);
+	ASSERT_EQ(0, err);
+
+	ASSERT_FALSE(find_in_sdp(answer, "extmap"));
+}
+
+
+TEST_F(TestMedia, mem_accounting)
+{
+	struct mediaflow_mem mem;
+	struct memstat mstat;
+	bool measured = (0 == mem_get_stat(&mstat));
+	int err;
+
+	ASSERT_EQ(EINVAL, mediaflow_mem_get(NULL, &mem));
+
+	err = mediaflow_mem_get(mf, &mem);
+	ASSERT_EQ(0, err);
+
+	/* the statistics are allocated when their stream starts */
+	ASSERT_GT(mem.flow, 0);
+	ASSERT_EQ(0, mem.stats);
+
+	/* streams that have not started read as zero */
+	ASSERT_TRUE(mediaflow_rcv_audio_rtp_stats(mf) != NULL);
+	ASSERT_EQ(0, mediaflow_rcv_audio_rtp_stats(mf)->packet_cnt);
+	ASSERT_TRUE(mediaflow_snd_video_rtp_stats(mf) != NULL);
+	ASSERT_EQ(0, mediaflow_snd_video_rtp_stats(mf)->packet_cnt);
+
+	ASSERT_TRUE(mediaflow_codec_stats(mf) != NULL);
+	err = mediaflow_mem_get(mf, &mem);
+	ASSERT_EQ(0, err);
+	ASSERT_GT(mem.stats, 0);
+
+	if (measured) {
+		ASSERT_GT(mem.sdp, 0);
+		ASSERT_GT(mem.ice, 0);
+		ASSERT_GT(mem.dtls, 0);
+		ASSERT_GT(mem.data, 0);
+	}
+
+	ASSERT_EQ(mem.flow + mem.stats + mem.sdp + mem.ice + mem.dtls +
+		  mem.codec + mem.data, mediaflow_mem_total(&mem));
+}
+
+
+static void loop_stop(void *arg)
+{
+	(void)arg;
+	re_cancel();
+}
+
+
+/* Runs the main loop for a while */
+static int loop_run(uint32_t ms)
+{
+	struct tmr tmr;
+	int err;
+
+	tmr_init(&tmr);
+	tmr_start(&tmr, ms, loop_stop, NULL);
+	err = re_main_wait(ms + 1000);
+	tmr_cancel(&tmr);
+
+	return err;
+}
+
+
+TEST_F(TestMedia, turn_defer_needs_alternative)
+{
+	struct pathcache_stats st;
+	struct sa laddr, srv_dead, srv_ok, srv_dead2;
+	int err;
+
+	pathcache_flush();
+
+	sa_set_str(&laddr, "127.0.0.1", 0);
+	sa_set_str(&srv_dead, "127.0.0.1", 3478);
+	sa_set_str(&srv_ok, "127.0.0.1", 3479);
+	sa_set_str(&srv_dead2, "127.0.0.1", 3480);
+
+	pathcache_turn_result(&laddr, &srv_dead, IPPROTO_UDP, false, 0);
+	pathcache_turn_result(&laddr, &srv_ok, IPPROTO_UDP, true, 20);
+	pathcache_turn_result(&laddr, &srv_dead2, IPPROTO_UDP, false, 0);
+
+	/* a path from this interface works, but not with this flow's
+	 * only TURN server, so it is not held back
+	 */
+	err = mediaflow_gather_turn(mf, &srv_dead, "user", "pass");
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, loop_run(20));
+	pathcache_stats_get(&st);
+	ASSERT_EQ(0, st.deferred);
+
+	/* with a working server on the flow, a dead one waits, also
+	 * when it was added first
+	 */
+	err = mediaflow_gather_turn(mf, &srv_dead2, "user", "pass");
+	ASSERT_EQ(0, err);
+	err = mediaflow_gather_turn(mf, &srv_ok, "user", "pass");
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, loop_run(20));
+	pathcache_stats_get(&st);
+	ASSERT_EQ(1, st.deferred);
+
+	pathcache_flush();
+}
+
+
+TEST(media, pathcache_turn)
+{
+	struct sa laddr, srv_udp, srv_tcp;
+	uint32_t rtt = 0;
+
+	pathcache_flush();
+
+	sa_set_str(&laddr, "10.0.0.2", 0);
+	sa_set_str(&srv_udp, "1.2.3.4", 3478);
+	sa_set_str(&srv_tcp, "1.2.3.4", 443);
+
+	ASSERT_EQ(PATHCACHE_UNKNOWN, pathcache_turn_state(&laddr, &srv_udp,
+							  IPPROTO_UDP, NULL));
+
+	pathcache_turn_result(&laddr, &srv_udp, IPPROTO_UDP, false, 0);
+	ASSERT_EQ(PATHCACHE_DEAD, pathcache_turn_state(&laddr, &srv_udp,
+						       IPPROTO_UDP, NULL));
+
+	pathcache_turn_result(&laddr, &srv_tcp, IPPROTO_TCP, true, 40);
+	ASSERT_EQ(PATHCACHE_OK, pathcache_turn_state(&laddr, &srv_tcp,
+						     IPPROTO_TCP, &rtt));
+	ASSERT_EQ(40, rtt);
+
+	/* the port of the local interface does not matter */
+	sa_set_port(&laddr, 5000);
+	ASSERT_EQ(PATHCACHE_DEAD, pathcache_turn_state(&laddr, &srv_udp,
+						       IPPROTO_UDP, NULL));
+
+	/* another interface knows nothing */
+	sa_set_str(&laddr, "192.168.1.2", 0);
+	ASSERT_EQ(PATHCACHE_UNKNOWN, pathcache_turn_state(&laddr, &srv_udp,
+							  IPPROTO_UDP, NULL));
+
+	pathcache_flush();
+}
+
+
+TEST(media, pathcache_pair)
+{
+	struct pathcache_stats st;
+	enum ice_cand_type ltype, rtype;
+	struct sa laddr, srv;
+	uint32_t rtt;
+	int err;
+
+	pathcache_flush();
+
+	sa_set_str(&laddr, "10.0.0.2", 0);
+	sa_set_str(&srv, "1.2.3.4", 3478);
+
+	err = pathcache_pair_lookup(&laddr, &srv, PATHCACHE_PEER_NAT,
+				    &ltype, &rtype, &rtt);
+	ASSERT_EQ(ENOENT, err);
+	pathcache_setup_result(false, 300);
+
+	pathcache_pair_result(&laddr, &srv, PATHCACHE_PEER_NAT,
+			      ICE_CAND_TYPE_RELAY, ICE_CAND_TYPE_SRFLX, 300);
+
+	err = pathcache_pair_lookup(&laddr, &srv, PATHCACHE_PEER_NAT,
+				    &ltype, &rtype, &rtt);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(ICE_CAND_TYPE_RELAY, ltype);
+	ASSERT_EQ(ICE_CAND_TYPE_SRFLX, rtype);
+	ASSERT_EQ(300, rtt);
+	pathcache_setup_result(true, 100);
+
+	/* other peers and calls without TURN are kept apart */
+	err = pathcache_pair_lookup(&laddr, &srv, PATHCACHE_PEER_LAN,
+				    NULL, NULL, NULL);
+	ASSERT_EQ(ENOENT, err);
+	err = pathcache_pair_lookup(&laddr, NULL, PATHCACHE_PEER_NAT,
+				    NULL, NULL, NULL);
+	ASSERT_EQ(ENOENT, err);
+
+	pathcache_setup_result(false, -1);
+
+	pathcache_stats_get(&st);
+	ASSERT_EQ(3, st.lookups);
+	ASSERT_EQ(1, st.hits);
+	ASSERT_EQ(200, pathcache_setup_savings(&st));
+
+	pathcache_enable(false);
+	err = pathcache_pair_lookup(&laddr, &srv, PATHCACHE_PEER_NAT,
+				    NULL, NULL, NULL);
+	ASSERT_EQ(ENOENT, err);
+	pathcache_enable(true);
+
+	pathcache_flush();
+	pathcache_stats_get(&st);
+	ASSERT_EQ(0, st.lookups);
+}
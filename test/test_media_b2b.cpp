@@ -46,8 +46,10 @@ enum mode {
 #define HAS_TURN(mode) ((mode)==TRICKLE_TURN || (mode)==TRICKLE_TURN_ONLY)
 
 struct test {
-	struct list aucodecl;
+	struct list *aucodecl;
 	unsigned n_sdp_exch;
+	bool load;          /* keep running and send extra packets */
+	bool fast;          /* fast call setup */
 };
 
 
@@ -63,6 +65,11 @@ struct agent {
 	enum mode mode;
 	int err;
 	struct tmr tmr;
+	struct tmr tmr_load;
+	uint32_t load_ssrc;
+	uint16_t load_seq;
+	uint32_t load_ts;
+	bool complete;
 
 	unsigned n_lcand_expect;  /* all local candidates, incl. HOST */
 
@@ -72,12 +79,34 @@ struct agent {
 
 static const uint8_t payload[160] = {0};
 static void sdp_exchange(struct agent *a, struct agent *b);
+static void load_tmr_handler(void *arg);
+
+
+/* The load test runs the agents on media shards, whose loops are only
+ * stopped by mediashard_close(). There the error is only recorded.
+ */
+static void stop_test(struct agent *ag)
+{
+	if (!ag->test->load)
+		re_cancel();
+}
 
 
 static void abort_test(struct agent *ag, int err)
 {
 	ag->err = err;
-	re_cancel();
+	stop_test(ag);
+}
+
+
+/* The path cache is global and outlives a test. Every test starts with
+ * an empty and enabled one, so that what an earlier test learned does
+ * not change how its calls are set up.
+ */
+static void pathcache_reset(void)
+{
+	pathcache_flush();
+	pathcache_enable(true);
 }
 
 
@@ -182,13 +211,11 @@ static void mediaflow_estab_handler(const char *crypto, const char *codec,
 static void mediaflow_close_handler(int err, void *arg)
 {
 	struct agent *ag = static_cast<struct agent *>(arg);
-	(void)ag;
 
 	/* if this one is called, there was an error */
-	ASSERT_TRUE(false);
+	ADD_FAILURE() << ag->name << ": mediaflow closed (" << err << ")";
 
-	ag->err = EPROTO;
-	re_cancel();
+	abort_test(ag, err ? err : EPROTO);
 }
 
 
@@ -198,7 +225,14 @@ static void tmr_complete_handler(void *arg)
 
 	if (are_we_complete(ag)) {
 
-		re_cancel();
+		if (ag->test->load) {
+			ag->complete = true;
+			ag->load_ssrc = rand_u32();
+			tmr_start(&ag->tmr_load, 10, load_tmr_handler, ag);
+			return;
+		}
+
+		stop_test(ag);
 		return;
 	}
 
@@ -211,6 +245,7 @@ static void destructor(void *arg)
 	struct agent *ag = static_cast<struct agent *>(arg);
 
 	tmr_cancel(&ag->tmr);
+	tmr_cancel(&ag->tmr_load);
 
 	mem_deref(ag->mf);
 	mem_deref(ag->dtls);
@@ -279,32 +314,20 @@ static void gather_server(struct agent *ag)
 }
 
 
-static void agent_alloc(struct agent **agp, struct test *test, bool offerer,
-			enum mode mode, const char *name)
+/* allocate the mediaflow of an agent and start gathering */
+static void agent_flow_alloc(struct agent *ag)
 {
+	struct test *test = ag->test;
 	struct sa laddr;
-	struct agent *ag;
 	enum mediaflow_nat nat;
-	bool host_cand = (mode != TRICKLE_TURN_ONLY);
+	bool host_cand = (ag->mode != TRICKLE_TURN_ONLY);
 	int err;
 
 	nat = MEDIAFLOW_TRICKLEICE_DUALSTACK;
 
-	ag = (struct agent *)mem_zalloc(sizeof(*ag), destructor);
-	ASSERT_TRUE(ag != NULL);
-
-	ag->test = test;
-
-	ag->offerer = offerer;
-	ag->mode = mode;
-	str_ncpy(ag->name, name, sizeof(ag->name));
-
 	sa_set_str(&laddr, "127.0.0.1", 0);
 
-	err = create_dtls_srtp_context(&ag->dtls, TLS_KEYTYPE_EC);
-	ASSERT_EQ(0, err);
-
-	err = mediaflow_alloc(&ag->mf, ag->dtls, &test->aucodecl, &laddr,
+	err = mediaflow_alloc(&ag->mf, ag->dtls, test->aucodecl, &laddr,
 			      nat, CRYPTO_DTLS_SRTP,
 			      NULL, /*mediaflow_localcand_handler,*/
 			      mediaflow_estab_handler,
@@ -313,6 +336,7 @@ static void agent_alloc(struct agent **agp, struct test *test, bool offerer,
 	ASSERT_EQ(0, err);
 
 	mediaflow_set_gather_handler(ag->mf, gather_handler);
+	mediaflow_enable_fast_setup(ag->mf, test->fast);
 
 	if (host_cand) {
 		/* NOTE: at least one HOST candidate is needed */
@@ -325,6 +349,30 @@ static void agent_alloc(struct agent **agp, struct test *test, bool offerer,
 
 	mediaflow_set_tag(ag->mf, ag->name);
 
+	gather_server(ag);
+
+	tmr_start(&ag->tmr, 5, tmr_complete_handler, ag);
+}
+
+
+static void agent_alloc(struct agent **agp, struct test *test, bool offerer,
+			enum mode mode, const char *name)
+{
+	struct agent *ag;
+	int err;
+
+	ag = (struct agent *)mem_zalloc(sizeof(*ag), destructor);
+	ASSERT_TRUE(ag != NULL);
+
+	ag->test = test;
+
+	ag->offerer = offerer;
+	ag->mode = mode;
+	str_ncpy(ag->name, name, sizeof(ag->name));
+
+	err = create_dtls_srtp_context(&ag->dtls, TLS_KEYTYPE_EC);
+	ASSERT_EQ(0, err);
+
 	if (IS_TRICKLE(mode)) {
 
 		switch (mode) {
@@ -349,9 +397,7 @@ static void agent_alloc(struct agent **agp, struct test *test, bool offerer,
 		}
 	}
 
-	gather_server(ag);
-
-	tmr_start(&ag->tmr, 5, tmr_complete_handler, ag);
+	agent_flow_alloc(ag);
 
 #if 0
 	re_printf("[ %s ] agent allocated (%s, %s, %s)\n",
@@ -415,9 +461,21 @@ static void sdp_exchange(struct agent *a, struct agent *b)
 }
 
 
+static void verify_setup_timeline(const struct agent *ag)
+{
+	const struct mediaflow_stats *st = mediaflow_stats_get(ag->mf);
+
+	ASSERT_GE(st->setup.ice_start, 0);
+	ASSERT_GE(st->setup.ice_estab, st->setup.ice_start);
+	ASSERT_GE(st->setup.dtls_estab, st->setup.ice_estab);
+	ASSERT_GE(st->setup.rtp_rx, st->setup.dtls_estab);
+}
+
+
 static void test_b2b(enum mode a_mode, enum mode b_mode, bool early_dtls)
 {
 	struct test test;
+	struct list aucodecl = LIST_INIT;
 	struct agent *a = NULL, *b = NULL;
 	int err;
 	(void)early_dtls;
@@ -428,8 +486,11 @@ static void test_b2b(enum mode a_mode, enum mode b_mode, bool early_dtls)
 #endif
 
 	memset(&test, 0, sizeof(test));
+	test.aucodecl = &aucodecl;
 
-	err = audummy_init(&test.aucodecl);
+	pathcache_reset();
+
+	err = audummy_init(&aucodecl);
 	ASSERT_EQ(0, err);
 
 	/* initialization */
@@ -521,6 +582,9 @@ static void test_b2b(enum mode a_mode, enum mode b_mode, bool early_dtls)
 	ASSERT_TRUE(mediaflow_stats_get(b->mf)->dtls_estab >= 0);
 	ASSERT_TRUE(mediaflow_stats_get(b->mf)->dtls_estab < 5000);
 
+	verify_setup_timeline(a);
+	verify_setup_timeline(b);
+
 	mem_deref(a);
 	mem_deref(b);
 
@@ -550,3 +614,534 @@ TEST(media, b2b_turnonly_and_turnonly)
 {
 	test_b2b(TRICKLE_TURN_ONLY, TRICKLE_TURN_ONLY, false);
 }
+
+
+/*
+ * Load test: loopback calls spread over N media shards. Every call
+ * runs on one shard, and each agent sends LOAD_BURST extra packets
+ * every 10 ms on top of the audio. Reports the received packets per
+ * second, and per second of CPU time used by the shards.
+ */
+
+#define LOAD_CALLS   8
+#define LOAD_BURST   10
+#define LOAD_TIME    1000  /* ms */
+
+struct load_call {
+	struct test test;
+	struct agent *a;
+	struct agent *b;
+	struct mediashard *shard;
+
+	bool complete;
+	uint64_t packets;
+	int err;
+};
+
+
+static void load_tmr_handler(void *arg)
+{
+	struct agent *ag = static_cast<struct agent *>(arg);
+	const struct aucodec *ac;
+	struct rtp_header hdr;
+	int i, err;
+
+	tmr_start(&ag->tmr_load, 10, load_tmr_handler, ag);
+
+	ac = (const struct aucodec *)list_ledata(ag->test->aucodecl->head);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver  = RTP_VERSION;
+	hdr.pt   = atoi(ac->pt);
+	hdr.ssrc = ag->load_ssrc;
+
+	for (i = 0; i < LOAD_BURST; i++) {
+
+		hdr.seq = ag->load_seq++;
+		hdr.ts  = ag->load_ts;
+		ag->load_ts += 960;
+
+		err = mediaflow_send_rtp(ag->mf, &hdr,
+					 payload, sizeof(payload));
+		if (err) {
+			ag->err = err;
+			break;
+		}
+	}
+}
+
+
+static void load_call_start(void *arg)
+{
+	struct load_call *lc = static_cast<struct load_call *>(arg);
+
+	agent_alloc(&lc->a, &lc->test, true, TRICKLE_STUN, "A");
+	agent_alloc(&lc->b, &lc->test, false, TRICKLE_STUN, "B");
+	if (!lc->a || !lc->b)
+		return;
+
+	lc->a->other = lc->b;
+	lc->b->other = lc->a;
+
+	if (are_both_gathered(lc->a)) {
+		sdp_exchange(lc->a, lc->b);
+		start_both_ice(lc->a);
+	}
+}
+
+
+static void load_call_poll(void *arg)
+{
+	struct load_call *lc = static_cast<struct load_call *>(arg);
+
+	if (!lc->a || !lc->b)
+		return;
+
+	lc->complete = lc->a->complete && lc->b->complete;
+	lc->err = lc->a->err ? lc->a->err : lc->b->err;
+	lc->packets =
+		mediaflow_rcv_audio_rtp_stats(lc->a->mf)->packet_cnt +
+		mediaflow_rcv_audio_rtp_stats(lc->b->mf)->packet_cnt;
+}
+
+
+static void load_call_stop(void *arg)
+{
+	struct load_call *lc = static_cast<struct load_call *>(arg);
+
+	lc->a = (struct agent *)mem_deref(lc->a);
+	lc->b = (struct agent *)mem_deref(lc->b);
+}
+
+
+/* Stops the calls on their shards and closes the shards, also when an
+ * assertion returns early.
+ */
+struct load_guard {
+	struct load_call *callv;
+
+	load_guard() : callv(NULL) {}
+
+	~load_guard()
+	{
+		for (int i = 0; callv && i < LOAD_CALLS; i++) {
+			if (callv[i].shard) {
+				mediashard_call(callv[i].shard,
+						load_call_stop, &callv[i]);
+			}
+		}
+
+		EXPECT_EQ(0, mediashard_close());
+		mem_deref(callv);
+	}
+};
+
+
+static uint64_t load_packets(struct load_call *callv)
+{
+	uint64_t n = 0;
+
+	for (int i = 0; i < LOAD_CALLS; i++) {
+		mediashard_call(callv[i].shard, load_call_poll, &callv[i]);
+		n += callv[i].packets;
+	}
+
+	return n;
+}
+
+
+static int load_cpu_time(uint64_t *usecp)
+{
+	uint64_t usec = 0;
+
+	for (unsigned i = 0; i < mediashard_count(); i++) {
+		uint64_t t;
+		int err;
+
+		err = mediashard_cpu_time(mediashard_get(i), &t);
+		if (err)
+			return err;
+
+		usec += t;
+	}
+
+	*usecp = usec;
+
+	return 0;
+}
+
+
+static void test_load(struct list *aucodecl, unsigned nshards)
+{
+	struct load_call *callv;
+	uint64_t pkt0, pkt1, cpu0 = 0, cpu1 = 0, t0, t1;
+	int i, wait, err, cpu_err;
+
+	err = mediashard_init(nshards);
+	ASSERT_EQ(0, err);
+
+	load_guard guard;
+
+	callv = (struct load_call *)mem_zalloc(LOAD_CALLS * sizeof(*callv),
+					       NULL);
+	ASSERT_TRUE(callv != NULL);
+	guard.callv = callv;
+
+	for (i = 0; i < LOAD_CALLS; i++) {
+		struct load_call *lc = &callv[i];
+
+		lc->test.aucodecl = aucodecl;
+		lc->test.load = true;
+		lc->shard = mediashard_pick();
+
+		err = mediashard_call(lc->shard, load_call_start, lc);
+		ASSERT_EQ(0, err);
+		ASSERT_TRUE(lc->a != NULL);
+		ASSERT_TRUE(lc->b != NULL);
+	}
+
+	for (wait = 0; wait < 1000; wait++) {
+
+		load_packets(callv);
+
+		for (i = 0; i < LOAD_CALLS; i++) {
+			if (!callv[i].complete)
+				break;
+		}
+		if (i == LOAD_CALLS)
+			break;
+
+		sys_msleep(10);
+	}
+	ASSERT_EQ(LOAD_CALLS, i);
+
+	cpu_err = load_cpu_time(&cpu0);
+	pkt0 = load_packets(callv);
+	t0 = tmr_jiffies();
+
+	sys_msleep(LOAD_TIME);
+
+	pkt1 = load_packets(callv);
+	t1 = tmr_jiffies();
+	if (!cpu_err)
+		cpu_err = load_cpu_time(&cpu1);
+
+	for (i = 0; i < LOAD_CALLS; i++)
+		ASSERT_EQ(0, callv[i].err) << "call " << i;
+
+	ASSERT_GT(pkt1, pkt0);
+	ASSERT_GT(t1, t0);
+
+	re_printf("shards: %u  packets/s: %llu", nshards,
+		  (unsigned long long)((pkt1 - pkt0) * 1000 / (t1 - t0)));
+	if (!cpu_err && cpu1 > cpu0) {
+		re_printf("  cpu: %llu%%  packets/s per core: %llu",
+			  (unsigned long long)
+			  ((cpu1 - cpu0) / 10 / (t1 - t0)),
+			  (unsigned long long)
+			  ((pkt1 - pkt0) * 1000000 / (cpu1 - cpu0)));
+	}
+	re_printf("\n");
+}
+
+
+TEST(media, b2b_sharded_load)
+{
+	struct list aucodecl = LIST_INIT;
+	int err;
+
+	log_set_min_level(LOG_LEVEL_WARN);
+	log_enable_stderr(true);
+
+	pathcache_reset();
+
+	err = audummy_init(&aucodecl);
+	ASSERT_EQ(0, err);
+
+	re_printf("~~~ sharded media load report ~~~\n");
+	re_printf("calls:          %d, %d extra packets per 10 ms"
+		  " each way\n", LOAD_CALLS, LOAD_BURST);
+
+	for (unsigned n = 1; n <= 4; n *= 2)
+		test_load(&aucodecl, n);
+
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+
+	audummy_close();
+}
+
+
+/*
+ * Call setup benchmark: time from mediaflow_alloc() to the first
+ * received RTP packet, for loopback calls through the fake TURN
+ * servers. Reports p50 and p95 with and without fast setup.
+ */
+
+#define SETUP_CALLS  20
+
+
+static void setup_call(struct list *aucodecl, bool fast, int32_t *msp,
+		       struct mediaflow_stats *statsp)
+{
+	struct test test;
+	struct agent *a = NULL, *b = NULL;
+	const struct mediaflow_stats *sa, *sb;
+	int err;
+
+	memset(&test, 0, sizeof(test));
+	test.aucodecl = aucodecl;
+	test.fast = fast;
+
+	agent_alloc(&a, &test, true, TRICKLE_TURN, "A");
+	agent_alloc(&b, &test, false, TRICKLE_TURN, "B");
+	ASSERT_TRUE(a != NULL);
+	ASSERT_TRUE(b != NULL);
+	a->other = b;
+	b->other = a;
+
+	if (are_both_gathered(a)) {
+		sdp_exchange(a, b);
+		start_both_ice(a);
+	}
+
+	err = re_main_wait(10000);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, a->err);
+	ASSERT_EQ(0, b->err);
+
+	sa = mediaflow_stats_get(a->mf);
+	sb = mediaflow_stats_get(b->mf);
+	ASSERT_GE(sa->setup.rtp_rx, 0);
+	ASSERT_GE(sb->setup.rtp_rx, 0);
+
+	/* media flows once both sides have heard each other */
+	*statsp = sa->setup.rtp_rx > sb->setup.rtp_rx ? *sa : *sb;
+	*msp = statsp->setup.rtp_rx;
+
+	mem_deref(a);
+	mem_deref(b);
+}
+
+
+static int int32_cmp(const void *a, const void *b)
+{
+	return *(const int32_t *)a - *(const int32_t *)b;
+}
+
+
+static void test_setup_time(struct list *aucodecl, bool fast,
+			    const char *name)
+{
+	int32_t msv[SETUP_CALLS];
+	struct mediaflow_stats stats;
+	int i;
+
+	for (i = 0; i < SETUP_CALLS; i++) {
+		setup_call(aucodecl, fast, &msv[i], &stats);
+		if (::testing::Test::HasFatalFailure())
+			return;
+	}
+
+	qsort(msv, SETUP_CALLS, sizeof(msv[0]), int32_cmp);
+
+	re_printf("%-8s  p50: %4d ms  p95: %4d ms"
+		  "  (last: ice %d..%d, dtls %d..%d, rtp %d)\n",
+		  name,
+		  msv[SETUP_CALLS / 2], msv[(SETUP_CALLS - 1) * 95 / 100],
+		  stats.setup.ice_start, stats.setup.ice_estab,
+		  stats.setup.dtls_start, stats.setup.dtls_estab,
+		  stats.setup.rtp_rx);
+}
+
+
+TEST(media, b2b_setup_time)
+{
+	struct list aucodecl = LIST_INIT;
+	struct pathcache_stats st;
+	int err;
+
+	log_set_min_level(LOG_LEVEL_WARN);
+	log_enable_stderr(true);
+
+	pathcache_reset();
+
+	err = audummy_init(&aucodecl);
+	ASSERT_EQ(0, err);
+
+	re_printf("~~~ time to first RTP report ~~~\n");
+	re_printf("calls:          %d, TURN on both sides\n", SETUP_CALLS);
+
+	pathcache_enable(false);
+	test_setup_time(&aucodecl, false, "default");
+	test_setup_time(&aucodecl, true, "fast");
+
+	pathcache_flush();
+	pathcache_enable(true);
+	test_setup_time(&aucodecl, false, "cached");
+
+	/* every call after the first one finds its path */
+	pathcache_stats_get(&st);
+	re_printf("path cache: %llu/%llu hits, %d ms saved per hit\n",
+		  st.hits, st.lookups, pathcache_setup_savings(&st));
+	ASSERT_LE(st.lookups, 2 * SETUP_CALLS);
+	ASSERT_GE(st.hits, SETUP_CALLS - 1);
+
+	pathcache_flush();
+
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+
+	audummy_close();
+}
+
+
+/*
+ * Restart benchmark: after a call is up, both sides replace their
+ * mediaflow like ecall does on a network change. Reports the time
+ * from the restart to the first received RTP packet, with and
+ * without resuming the DTLS session of the first flow.
+ */
+
+#define RESTART_CALLS  10
+
+
+static void agent_restart(struct agent *ag, bool resume)
+{
+	struct tls_session *sess = NULL;
+	enum media_setup setup;
+	int err;
+
+	setup = mediaflow_local_setup(ag->mf);
+	if (resume)
+		(void)mediaflow_get_dtls_session(ag->mf, &sess);
+
+	tmr_cancel(&ag->tmr);
+	ag->mf = (struct mediaflow *)mem_deref(ag->mf);
+	ag->n_lcand_expect = 0;
+	ag->n_lcand = 0;
+	ag->n_estab = 0;
+
+	agent_flow_alloc(ag);
+
+	mediaflow_set_dtls_session(ag->mf, sess);
+	mem_deref(sess);
+
+	/* the offerer keeps its role, so the client keeps its session */
+	if (ag->offerer) {
+		err = mediaflow_set_setup(ag->mf, setup);
+		ASSERT_EQ(0, err);
+	}
+}
+
+
+static void restart_call(struct list *aucodecl, bool resume,
+			 int32_t *msp, int32_t *dtls_msp)
+{
+	struct test test;
+	struct agent *a = NULL, *b = NULL;
+	const struct mediaflow_stats *sa, *sb, *st;
+	int err;
+
+	memset(&test, 0, sizeof(test));
+	test.aucodecl = aucodecl;
+
+	agent_alloc(&a, &test, true, TRICKLE_STUN, "A");
+	agent_alloc(&b, &test, false, TRICKLE_STUN, "B");
+	ASSERT_TRUE(a != NULL);
+	ASSERT_TRUE(b != NULL);
+	a->other = b;
+	b->other = a;
+
+	if (are_both_gathered(a)) {
+		sdp_exchange(a, b);
+		start_both_ice(a);
+	}
+
+	err = re_main_wait(10000);
+	ASSERT_EQ(0, err);
+	ASSERT_FALSE(mediaflow_dtls_resumed(a->mf));
+
+	/* restart */
+	test.n_sdp_exch = 0;
+	agent_restart(a, resume);
+	agent_restart(b, resume);
+
+	if (are_both_gathered(a)) {
+		sdp_exchange(a, b);
+		start_both_ice(a);
+	}
+
+	err = re_main_wait(10000);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, a->err);
+	ASSERT_EQ(0, b->err);
+
+	ASSERT_EQ(resume, mediaflow_dtls_resumed(a->mf));
+	ASSERT_EQ(resume, mediaflow_dtls_resumed(b->mf));
+
+	sa = mediaflow_stats_get(a->mf);
+	sb = mediaflow_stats_get(b->mf);
+	ASSERT_GE(sa->setup.rtp_rx, 0);
+	ASSERT_GE(sb->setup.rtp_rx, 0);
+
+	st = sa->setup.rtp_rx > sb->setup.rtp_rx ? sa : sb;
+	*msp = st->setup.rtp_rx;
+	*dtls_msp = st->setup.dtls_estab - st->setup.dtls_start;
+
+	mem_deref(a);
+	mem_deref(b);
+}
+
+
+static void test_restart_time(struct list *aucodecl, bool resume,
+			      const char *name)
+{
+	int32_t msv[RESTART_CALLS], dtlsv[RESTART_CALLS];
+	int i;
+
+	for (i = 0; i < RESTART_CALLS; i++) {
+		restart_call(aucodecl, resume, &msv[i], &dtlsv[i]);
+		if (::testing::Test::HasFatalFailure())
+			return;
+	}
+
+	qsort(msv, RESTART_CALLS, sizeof(msv[0]), int32_cmp);
+	qsort(dtlsv, RESTART_CALLS, sizeof(dtlsv[0]), int32_cmp);
+
+	re_printf("%-8s  p50: %4d ms  p95: %4d ms  (dtls p50: %d ms)\n",
+		  name,
+		  msv[RESTART_CALLS / 2], msv[(RESTART_CALLS - 1) * 95 / 100],
+		  dtlsv[RESTART_CALLS / 2]);
+}
+
+
+TEST(media, b2b_restart_time)
+{
+	struct list aucodecl = LIST_INIT;
+	int err;
+
+	log_set_min_level(LOG_LEVEL_WARN);
+	log_enable_stderr(true);
+
+	pathcache_reset();
+
+	err = audummy_init(&aucodecl);
+	ASSERT_EQ(0, err);
+
+	pathcache_enable(false);
+
+	re_printf("~~~ restart to first RTP packet ~~~\n");
+	re_printf("calls:          %d, STUN on both sides\n", RESTART_CALLS);
+
+	test_restart_time(&aucodecl, false, "full");
+	test_restart_time(&aucodecl, true, "resumed");
+
+	pathcache_flush();
+	pathcache_enable(true);
+
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+
+	audummy_close();
+}
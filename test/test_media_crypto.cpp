@@ -38,6 +38,7 @@
 struct test {
 	struct list aucodecl;
 	struct tmr tmr;
+	const char *srtp_profiles;  /* NULL for the default */
 };
 
 
@@ -51,6 +52,7 @@ struct agent {
 	int err;
 
 	unsigned n_estab;
+	enum srtp_suite suite;
 };
 
 
@@ -112,6 +114,13 @@ static void mediaflow_estab_handler(const char *crypto, const char *codec,
 		name = tls_cipher_name(sc);
 		ASSERT_EQ(0, re_regex(name, strlen(name), "ECDHE"));
 
+		uint8_t cli_key[64], srv_key[64];
+
+		err = tls_srtp_keyinfo(sc, &ag->suite,
+				       cli_key, sizeof(cli_key),
+				       srv_key, sizeof(srv_key));
+		ASSERT_EQ(0, err);
+
 		/* TODO: also compare cipher-name with ECDSA etc. */
 	}
 
@@ -214,6 +223,11 @@ static void agent_alloc(struct agent **agp, struct test *test, bool offerer,
 	if (cryptos & CRYPTO_DTLS_SRTP) {
 		err = create_dtls_srtp_context(&ag->dtls, cert_type);
 		ASSERT_EQ(0, err);
+
+		if (test->srtp_profiles) {
+			err = tls_set_srtp(ag->dtls, test->srtp_profiles);
+			ASSERT_EQ(0, err);
+		}
 	}
 
 	err = mediaflow_alloc(&ag->mf, ag->dtls, &test->aucodecl, &laddr,
@@ -247,7 +261,9 @@ static void test_b2b_base(enum tls_keytype a_cert,
 			  enum media_setup a_setup,
 			  enum media_setup b_setup,
 			  enum media_setup a_setup_expect,
-			  enum media_setup b_setup_expect)
+			  enum media_setup b_setup_expect,
+			  const char *srtp_profiles,
+			  enum srtp_suite suite_expect)
 {
 	struct test test;
 	struct agent *a = NULL, *b = NULL;
@@ -259,6 +275,7 @@ static void test_b2b_base(enum tls_keytype a_cert,
 #endif
 
 	memset(&test, 0, sizeof(test));
+	test.srtp_profiles = srtp_profiles;
 
 	err = audummy_init(&test.aucodecl);
 	ASSERT_EQ(0, err);
@@ -313,6 +330,11 @@ static void test_b2b_base(enum tls_keytype a_cert,
 	ASSERT_TRUE(mediaflow_is_rtpstarted(a->mf));
 	ASSERT_TRUE(mediaflow_is_rtpstarted(b->mf));
 
+	if (mode_expect == CRYPTO_DTLS_SRTP) {
+		ASSERT_EQ(suite_expect, a->suite);
+		ASSERT_EQ(suite_expect, b->suite);
+	}
+
 	mem_deref(a);
 	mem_deref(b);
 
@@ -329,7 +351,8 @@ static void test_b2b(enum tls_keytype a_cert,
 {
 	test_b2b_base(a_cert, b_cert, a_cryptos, b_cryptos, mode_expect,
 		      SETUP_ACTPASS, SETUP_ACTPASS,
-		      SETUP_PASSIVE, SETUP_ACTIVE);
+		      SETUP_PASSIVE, SETUP_ACTIVE,
+		      NULL, SRTP_AES_CM_128_HMAC_SHA1_80);
 }
 
 
@@ -340,7 +363,8 @@ static void test_setup(enum media_setup a_setup,
 {
 	test_b2b_base(TLS_KEYTYPE_EC, TLS_KEYTYPE_EC,
 		      CRYPTO_DTLS_SRTP, CRYPTO_DTLS_SRTP, CRYPTO_DTLS_SRTP,
-		      a_setup, b_setup, a_setup_expect, b_setup_expect);
+		      a_setup, b_setup, a_setup_expect, b_setup_expect,
+		      NULL, SRTP_AES_CM_128_HMAC_SHA1_80);
 }
 
 
@@ -374,6 +398,17 @@ TEST(media_crypto, both_and_both)
 }
 
 
+TEST(media_crypto, dtlssrtp_gcm)
+{
+	test_b2b_base(TLS_KEYTYPE_EC, TLS_KEYTYPE_EC,
+		      CRYPTO_DTLS_SRTP, CRYPTO_DTLS_SRTP, CRYPTO_DTLS_SRTP,
+		      SETUP_ACTPASS, SETUP_ACTPASS,
+		      SETUP_PASSIVE, SETUP_ACTIVE,
+		      "SRTP_AEAD_AES_128_GCM:SRTP_AES128_CM_SHA1_80",
+		      SRTP_AES_128_GCM);
+}
+
+
 TEST(media_crypto, mix_rsa_ecdsa_dtlssrtp_and_dtlssrtp)
 {
 	test_b2b(TLS_KEYTYPE_RSA, TLS_KEYTYPE_EC,
@@ -0,0 +1,297 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "../src/media/priv_mediaflow.h"
+}
+
+
+static void mbuf_wrap(struct mbuf *mb, const uint8_t *buf, size_t len)
+{
+	memset(mb, 0, sizeof(*mb));
+	mb->buf  = (uint8_t *)buf;
+	mb->size = len;
+	mb->end  = len;
+}
+
+
+static const uint8_t rtp_pkt[] = {
+	0x80, 0xe0, 0x12, 0x34,  /* V=2, M=1, PT=96, seq */
+	0x00, 0x00, 0x03, 0xc0,  /* timestamp */
+	0xde, 0xad, 0xbe, 0xef,  /* SSRC */
+	0x01, 0x02, 0x03, 0x04,  /* payload */
+};
+
+
+TEST(packet, parse_rtp)
+{
+	struct packet_desc pd;
+	struct mbuf mb;
+
+	mbuf_wrap(&mb, rtp_pkt, sizeof(rtp_pkt));
+
+	ASSERT_EQ(0, packet_parse(&pd, &mb));
+	ASSERT_EQ(PACKET_RTP, pd.type);
+	ASSERT_EQ(96, pd.pt);
+	ASSERT_TRUE(pd.marker);
+	ASSERT_EQ(0x1234, pd.seq);
+	ASSERT_EQ(0xdeadbeef, pd.ssrc);
+	ASSERT_EQ(RTP_HEADER_SIZE, pd.hdrlen);
+
+	/* the position is not moved */
+	ASSERT_EQ(0, mb.pos);
+}
+
+
+TEST(packet, parse_rtp_csrc_and_extension)
+{
+	static const uint8_t pkt[] = {
+		0x92, 0x60, 0x00, 0x01,  /* X=1, CC=2, PT=96 */
+		0x00, 0x00, 0x00, 0x00,
+		0x11, 0x22, 0x33, 0x44,
+		0x00, 0x00, 0x00, 0x01,  /* CSRC 1 */
+		0x00, 0x00, 0x00, 0x02,  /* CSRC 2 */
+		0xbe, 0xde, 0x00, 0x01,  /* extension, one word */
+		0x10, 0xaa, 0x00, 0x00,
+		0x01, 0x02,              /* payload */
+	};
+	struct packet_desc pd;
+	struct mbuf mb;
+
+	mbuf_wrap(&mb, pkt, sizeof(pkt));
+
+	ASSERT_EQ(0, packet_parse(&pd, &mb));
+	ASSERT_EQ(PACKET_RTP, pd.type);
+	ASSERT_FALSE(pd.marker);
+	ASSERT_EQ(0x11223344, pd.ssrc);
+	ASSERT_EQ(RTP_HEADER_SIZE + 8 + 8, pd.hdrlen);
+}
+
+
+TEST(packet, parse_rtp_truncated)
+{
+	static const uint8_t csrc[] = {
+		0x83, 0x60, 0x00, 0x01,  /* CC=3, but only one CSRC */
+		0x00, 0x00, 0x00, 0x00,
+		0x11, 0x22, 0x33, 0x44,
+		0x00, 0x00, 0x00, 0x01,
+	};
+	static const uint8_t ext[] = {
+		0x90, 0x60, 0x00, 0x01,  /* X=1, extension is cut */
+		0x00, 0x00, 0x00, 0x00,
+		0x11, 0x22, 0x33, 0x44,
+		0xbe, 0xde, 0x00, 0x04,
+		0x10, 0xaa, 0x00, 0x00,
+	};
+	struct packet_desc pd;
+	struct mbuf mb;
+
+	/* a single byte is still classified */
+	mbuf_wrap(&mb, rtp_pkt, 1);
+	ASSERT_EQ(EBADMSG, packet_parse(&pd, &mb));
+	ASSERT_EQ(PACKET_RTP, pd.type);
+
+	mbuf_wrap(&mb, rtp_pkt, RTP_HEADER_SIZE - 1);
+	ASSERT_EQ(EBADMSG, packet_parse(&pd, &mb));
+	ASSERT_EQ(PACKET_RTP, pd.type);
+
+	mbuf_wrap(&mb, csrc, sizeof(csrc));
+	ASSERT_EQ(EBADMSG, packet_parse(&pd, &mb));
+	ASSERT_EQ(0, pd.hdrlen);
+
+	mbuf_wrap(&mb, ext, sizeof(ext));
+	ASSERT_EQ(EBADMSG, packet_parse(&pd, &mb));
+	ASSERT_EQ(0, pd.hdrlen);
+
+	/* extension header without its length */
+	mbuf_wrap(&mb, ext, RTP_HEADER_SIZE + 2);
+	ASSERT_EQ(EBADMSG, packet_parse(&pd, &mb));
+	ASSERT_EQ(0, pd.hdrlen);
+}
+
+
+TEST(packet, parse_rtcp)
+{
+	static const uint8_t sr[] = {
+		0x80, 0xc8, 0x00, 0x06,  /* SR */
+		0x01, 0x02, 0x03, 0x04,
+		0x00, 0x00, 0x00, 0x00,
+	};
+	struct packet_desc pd;
+	struct mbuf mb;
+
+	mbuf_wrap(&mb, sr, sizeof(sr));
+	ASSERT_EQ(0, packet_parse(&pd, &mb));
+	ASSERT_EQ(PACKET_RTCP, pd.type);
+	ASSERT_EQ(RTCP_SR, pd.pt);
+	ASSERT_EQ(0x01020304, pd.ssrc);
+
+	mbuf_wrap(&mb, sr, 7);
+	ASSERT_EQ(EBADMSG, packet_parse(&pd, &mb));
+	ASSERT_EQ(PACKET_RTCP, pd.type);
+}
+
+
+TEST(packet, parse_other)
+{
+	static const uint8_t dtls[] = {0x16, 0xfe, 0xfd, 0x00};
+	static const uint8_t stun[] = {0x00, 0x01, 0x00, 0x00};
+	static const uint8_t junk[] = {0xff, 0xff, 0xff, 0xff};
+	struct packet_desc pd;
+	struct mbuf mb;
+
+	mbuf_wrap(&mb, dtls, sizeof(dtls));
+	ASSERT_EQ(0, packet_parse(&pd, &mb));
+	ASSERT_EQ(PACKET_DTLS, pd.type);
+
+	mbuf_wrap(&mb, stun, sizeof(stun));
+	ASSERT_EQ(0, packet_parse(&pd, &mb));
+	ASSERT_EQ(PACKET_STUN, pd.type);
+
+	/* too short for a STUN message type */
+	mbuf_wrap(&mb, stun, 1);
+	ASSERT_EQ(0, packet_parse(&pd, &mb));
+	ASSERT_EQ(PACKET_UNKNOWN, pd.type);
+
+	mbuf_wrap(&mb, junk, sizeof(junk));
+	ASSERT_EQ(0, packet_parse(&pd, &mb));
+	ASSERT_EQ(PACKET_UNKNOWN, pd.type);
+
+	mbuf_wrap(&mb, junk, 0);
+	ASSERT_EQ(EBADMSG, packet_parse(&pd, &mb));
+
+	ASSERT_EQ(EINVAL, packet_parse(NULL, &mb));
+	ASSERT_EQ(EINVAL, packet_parse(&pd, NULL));
+}
+
+
+TEST(packet, rtcp_app)
+{
+	static const uint8_t app[] = {
+		0x80, 0xcc, 0x00, 0x03,  /* APP, 3 words follow */
+		0x01, 0x02, 0x03, 0x04,
+		'A',  'V',  'S',  ' ',
+		0xca, 0xfe, 0xba, 0xbe,
+		0x00, 0x00, 0x00, 0x00,  /* next packet */
+	};
+	const uint8_t *name, *data;
+	size_t len;
+	struct mbuf mb;
+
+	mbuf_wrap(&mb, app, sizeof(app));
+	ASSERT_EQ(0, packet_rtcp_app(&mb, &name, &data, &len));
+	ASSERT_TRUE(0 == memcmp(name, "AVS ", 4));
+	ASSERT_TRUE(data == &app[12]);
+	ASSERT_EQ(4, len);
+
+	ASSERT_EQ(EINVAL, packet_rtcp_app(NULL, &name, &data, &len));
+	ASSERT_EQ(EINVAL, packet_rtcp_app(&mb, &name, &data, NULL));
+}
+
+
+TEST(packet, rtcp_app_malformed)
+{
+	static const uint8_t sr[] = {
+		0x80, 0xc8, 0x00, 0x03,
+		0x01, 0x02, 0x03, 0x04,
+		'A',  'V',  'S',  ' ',
+		0xca, 0xfe, 0xba, 0xbe,
+	};
+	static const uint8_t longer[] = {
+		0x80, 0xcc, 0x00, 0x08,  /* claims more than there is */
+		0x01, 0x02, 0x03, 0x04,
+		'A',  'V',  'S',  ' ',
+		0xca, 0xfe, 0xba, 0xbe,
+	};
+	static const uint8_t noname[] = {
+		0x80, 0xcc, 0x00, 0x01,  /* SSRC only */
+		0x01, 0x02, 0x03, 0x04,
+		'A',  'V',  'S',  ' ',
+	};
+	const uint8_t *name, *data;
+	size_t len;
+	struct mbuf mb;
+
+	mbuf_wrap(&mb, sr, sizeof(sr));
+	ASSERT_EQ(EBADMSG, packet_rtcp_app(&mb, &name, &data, &len));
+
+	mbuf_wrap(&mb, longer, sizeof(longer));
+	ASSERT_EQ(EBADMSG, packet_rtcp_app(&mb, &name, &data, &len));
+
+	mbuf_wrap(&mb, noname, sizeof(noname));
+	ASSERT_EQ(EBADMSG, packet_rtcp_app(&mb, &name, &data, &len));
+
+	/* truncated before the name */
+	mbuf_wrap(&mb, longer, 11);
+	ASSERT_EQ(EBADMSG, packet_rtcp_app(&mb, &name, &data, &len));
+}
+
+
+TEST(packet, hist)
+{
+	struct packet_hist hist;
+	char *str = NULL;
+	int err;
+
+	memset(&hist, 0, sizeof(hist));
+
+	err = re_sdprintf(&str, "%H", packet_hist_debug, &hist);
+	ASSERT_EQ(0, err);
+	ASSERT_STREQ("n=0", str);
+	str = (char *)mem_deref(str);
+
+	packet_hist_add(&hist, 0);
+	packet_hist_add(&hist, 1);
+	packet_hist_add(&hist, 1000);
+	packet_hist_add(&hist, 1000);
+	packet_hist_add(&hist, 1ULL << 40);
+
+	ASSERT_EQ(5, hist.n);
+	ASSERT_EQ(1, hist.bucketv[0]);
+	ASSERT_EQ(1, hist.bucketv[1]);
+	ASSERT_EQ(2, hist.bucketv[10]);   /* 512 <= 1000 < 1024 */
+	ASSERT_EQ(1, hist.bucketv[PACKET_HIST_BUCKETS - 1]);
+	ASSERT_EQ(2001 + (1ULL << 40), hist.sum);
+	ASSERT_EQ(UINT32_MAX, hist.max);
+
+	err = re_sdprintf(&str, "%H", packet_hist_debug, &hist);
+	ASSERT_EQ(0, err);
+	ASSERT_TRUE(NULL != strstr(str, "n=5 "));
+	ASSERT_TRUE(NULL != strstr(str, "p50<1024us"));
+	ASSERT_TRUE(NULL != strstr(str, "[1 1 0 0 0 0 0 0 0 0 2 0"));
+	mem_deref(str);
+
+	packet_hist_add(NULL, 1);
+}
+
+
+TEST(packet, usec_is_monotonic)
+{
+	uint64_t t0, t1;
+
+	t0 = packet_usec();
+	ASSERT_GT(t0, 0);
+
+	sys_msleep(2);
+
+	t1 = packet_usec();
+	ASSERT_GE(t1, t0 + 1000);
+}
@@ -1,3 +1,4 @@
+#include <sys/time.h>
 #include <re.h>
 #include <avs.h>
 #include <avs_protobuf.h> // XXX: ?
@@ -57,3 +58,181 @@ TEST(protobuf, decode_and_encode)
 
 	generic_message_free(msg);
 }
+
+
+static void check_sample(const GenericMessage *msg)
+{
+	ASSERT_TRUE(msg != NULL);
+	ASSERT_STREQ("08a1d656-9c42-4602-a9b3-0721e13e2eba", msg->message_id);
+	ASSERT_EQ(GENERIC_MESSAGE__CONTENT_TEXT, msg->content_case);
+	ASSERT_TRUE(msg->text != NULL);
+	ASSERT_STREQ("White fox hurra", msg->text->content);
+	ASSERT_EQ(0, msg->text->n_mention);
+}
+
+
+TEST(protobuf, arena_decode)
+{
+	struct protobuf_arena *arena;
+	GenericMessage *msgv[4];
+	size_t used;
+	int i, err;
+
+	/* too small, the first decode spills */
+	err = protobuf_arena_alloc(&arena, 16);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, protobuf_arena_used(arena));
+
+	msgv[0] = generic_message_decode_arena(arena, sizeof(sample_protobuf),
+					       sample_protobuf);
+	check_sample(msgv[0]);
+
+	used = protobuf_arena_used(arena);
+	ASSERT_GT(used, (size_t)16);
+
+	protobuf_arena_reset(arena);
+	ASSERT_EQ(0, protobuf_arena_used(arena));
+
+	/* several messages live side by side until the reset */
+	for (i = 0; i < 4; i++) {
+		msgv[i] = generic_message_decode_arena(arena,
+						       sizeof(sample_protobuf),
+						       sample_protobuf);
+	}
+	for (i = 0; i < 4; i++)
+		check_sample(msgv[i]);
+
+	ASSERT_EQ(4 * used, protobuf_arena_used(arena));
+
+	/* truncated input */
+	ASSERT_TRUE(NULL == generic_message_decode_arena(arena, 10,
+							 sample_protobuf));
+	ASSERT_TRUE(NULL == generic_message_decode_arena(NULL,
+						 sizeof(sample_protobuf),
+						 sample_protobuf));
+
+	mem_deref(arena);
+}
+
+
+/*
+ * Decode and free throughput, with one allocation per field and
+ * with an arena that is reset after each message.
+ */
+
+enum {
+	BENCH_MSGS = 100000,
+};
+
+
+static uint64_t now_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+static unsigned bench_mps(uint64_t usec)
+{
+	return usec ? (unsigned)(BENCH_MSGS * 1000000ULL / usec) : 0;
+}
+
+
+/* A calling message with an econn SETUP, like the ones sent for
+ * every call.
+ */
+static size_t make_calling(uint8_t *buf, size_t sz)
+{
+	GenericMessage msg = GENERIC_MESSAGE__INIT;
+	Calling calling = CALLING__INIT;
+	char sdp[2048], json[3072];
+	size_t n = 0;
+	int i;
+
+	n += re_snprintf(sdp + n, sizeof(sdp) - n,
+			 "v=0\\r\\no=- 2291589356 1242618047 IN IP4"
+			 " 192.168.10.231\\r\\ns=-\\r\\nt=0 0\\r\\n"
+			 "m=audio 57485 UDP/TLS/RTP/SAVPF 111\\r\\n"
+			 "a=rtpmap:111 opus/48000/2\\r\\n"
+			 "a=fingerprint:sha-256 07:52:B0:D8:DF:33:E0:54:"
+			 "8B:A6:DD:C0:3A:C9:FB:4F:80:E1:F6:CE:57:D0:C3:24:"
+			 "50:3D:6B:8D:98:EF:24:DE\\r\\n");
+
+	for (i = 0; i < 8; i++) {
+		n += re_snprintf(sdp + n, sizeof(sdp) - n,
+				 "a=candidate:%d 1 UDP %u 10.0.0.%d %u"
+				 " typ host\\r\\n",
+				 i, 2113937151 - i, i + 1, 50000 + i);
+	}
+
+	re_snprintf(json, sizeof(json),
+		    "{\"version\":\"3.0\",\"type\":\"SETUP\","
+		    "\"sessid\":\"9ec4\",\"resp\":false,"
+		    "\"sdp\":\"%s\",\"props\":{\"videosend\":\"false\"}}",
+		    sdp);
+
+	calling.content = json;
+
+	msg.message_id = (char *)"5f9e8c1a-2b2e-4e5c-9a0f-2b7a1c3d4e5f";
+	msg.content_case = GENERIC_MESSAGE__CONTENT_CALLING;
+	msg.calling = &calling;
+
+	n = generic_message__get_packed_size(&msg);
+	if (n > sz)
+		return 0;
+
+	return generic_message__pack(&msg, buf);
+}
+
+
+static void bench_decode(const char *name, const uint8_t *pb, size_t len)
+{
+	struct protobuf_arena *arena;
+	GenericMessage *msg;
+	uint64_t t0, t_heap, t_arena;
+	int i, err;
+
+	err = protobuf_arena_alloc(&arena, 0);
+	ASSERT_EQ(0, err);
+
+	t0 = now_usec();
+	for (i = 0; i < BENCH_MSGS; i++) {
+		msg = generic_message_decode(len, pb);
+		ASSERT_TRUE(msg != NULL);
+		generic_message_free(msg);
+	}
+	t_heap = now_usec() - t0;
+
+	t0 = now_usec();
+	for (i = 0; i < BENCH_MSGS; i++) {
+		msg = generic_message_decode_arena(arena, len, pb);
+		ASSERT_TRUE(msg != NULL);
+		protobuf_arena_reset(arena);
+	}
+	t_arena = now_usec() - t0;
+
+	re_printf("%-8s %5zu bytes   heap: %8u msg/s   arena: %8u msg/s\n",
+		  name, len, bench_mps(t_heap), bench_mps(t_arena));
+
+	mem_deref(arena);
+}
+
+
+TEST(protobuf, arena_bench)
+{
+	uint8_t calling[4096];
+	size_t n;
+
+	n = make_calling(calling, sizeof(calling));
+	ASSERT_GT(n, (size_t)0);
+
+	re_printf("\n");
+	re_printf("~~~ GenericMessage decode and free ~~~\n");
+	bench_decode("text", sample_protobuf, sizeof(sample_protobuf));
+	bench_decode("calling", calling, n);
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+}
@@ -0,0 +1,248 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <pthread.h>
+#include <unistd.h>
+#include <re.h>
+#include "avs_rtpdump.h"
+#include <gtest/gtest.h>
+
+
+#define CAPTURE_FILE "rtpdump_test.pcapng"
+
+
+struct capture {
+	unsigned shb;
+	unsigned idb;
+	unsigned epb;
+	uint32_t last_caplen;
+	uint32_t last_origlen;
+	uint8_t last_data[2048];
+};
+
+
+/* Reads a little endian pcapng file and counts the blocks */
+static int read_capture(struct capture *cap, const char *path)
+{
+	uint8_t block[4096];
+	uint32_t hdr[2];
+	FILE *f;
+	int err = 0;
+
+	memset(cap, 0, sizeof(*cap));
+
+	f = fopen(path, "rb");
+	if (!f)
+		return errno;
+
+	while (fread(hdr, sizeof(hdr), 1, f) == 1) {
+		uint32_t len = hdr[1];
+		uint32_t trailer;
+
+		if (len < 12 || len % 4 || len - 8 > sizeof(block)) {
+			err = EBADMSG;
+			break;
+		}
+
+		if (fread(block, len - 8, 1, f) != 1) {
+			err = EBADMSG;
+			break;
+		}
+
+		memcpy(&trailer, &block[len - 12], 4);
+		if (trailer != len) {
+			err = EBADMSG;
+			break;
+		}
+
+		switch (hdr[0]) {
+
+		case 0x0A0D0D0A:
+			++cap->shb;
+			break;
+
+		case 0x00000001:
+			++cap->idb;
+			break;
+
+		case 0x00000006:
+			++cap->epb;
+			memcpy(&cap->last_caplen, &block[12], 4);
+			memcpy(&cap->last_origlen, &block[16], 4);
+			memcpy(cap->last_data, &block[20],
+			       cap->last_caplen);
+			break;
+		}
+	}
+
+	fclose(f);
+
+	return err;
+}
+
+
+static void make_rtp(uint8_t *pkt, size_t len, uint16_t seq, uint32_t ssrc)
+{
+	memset(pkt, seq & 0xff, len);
+	pkt[0] = 0x80;
+	pkt[1] = 111;
+	pkt[2] = seq >> 8;
+	pkt[3] = seq & 0xff;
+	pkt[8] = ssrc >> 24;
+	pkt[9] = ssrc >> 16;
+	pkt[10] = ssrc >> 8;
+	pkt[11] = ssrc & 0xff;
+}
+
+
+TEST(rtpdump, flows)
+{
+	wire_avs::RtpDump dump;
+	struct capture cap;
+	uint8_t pkt[200];
+
+	ASSERT_FALSE(dump.IsActive());
+	ASSERT_EQ(0, dump.Start(CAPTURE_FILE));
+	ASSERT_TRUE(dump.IsActive());
+
+	for (int i = 0; i < 50; i++) {
+		make_rtp(pkt, sizeof(pkt), i, 0x11111111);
+		ASSERT_EQ(0, dump.DumpPacket(pkt, sizeof(pkt)));
+
+		make_rtp(pkt, sizeof(pkt), i, 0x22222222);
+		ASSERT_EQ(0, dump.DumpPacket(pkt, sizeof(pkt)));
+	}
+
+	/* RTCP receiver report */
+	memset(pkt, 0, 32);
+	pkt[0] = 0x81;
+	pkt[1] = 201;
+	pkt[3] = 7;
+	pkt[4] = 0x33;
+	ASSERT_EQ(0, dump.DumpPacket(pkt, 32));
+
+	ASSERT_EQ(-1, dump.DumpPacket(NULL, 10));
+
+	ASSERT_EQ(0, dump.Stop());
+	ASSERT_FALSE(dump.IsActive());
+	ASSERT_EQ(0, dump.Dropped());
+
+	ASSERT_EQ(0, read_capture(&cap, CAPTURE_FILE));
+	EXPECT_EQ(1, cap.shb);
+	EXPECT_EQ(3, cap.idb);
+	EXPECT_EQ(101, cap.epb);
+
+	/* IPv4 + UDP + RTCP */
+	EXPECT_EQ(28 + 32, cap.last_caplen);
+	EXPECT_EQ(28 + 32, cap.last_origlen);
+	EXPECT_EQ(0x45, cap.last_data[0]);
+	EXPECT_EQ(17, cap.last_data[9]);
+	EXPECT_EQ(0, memcmp(&cap.last_data[28], pkt, 32));
+
+	/* Not captured after Stop */
+	EXPECT_EQ(0, dump.DumpPacket(pkt, 32));
+
+	unlink(CAPTURE_FILE);
+}
+
+
+TEST(rtpdump, snaplen)
+{
+	wire_avs::RtpDump dump;
+	struct capture cap;
+	uint8_t pkt[1000];
+
+	ASSERT_EQ(0, dump.Start(CAPTURE_FILE, 30));
+
+	make_rtp(pkt, sizeof(pkt), 1, 0x11111111);
+	ASSERT_EQ(0, dump.DumpPacket(pkt, sizeof(pkt)));
+
+	ASSERT_EQ(0, dump.Stop());
+
+	ASSERT_EQ(0, read_capture(&cap, CAPTURE_FILE));
+	EXPECT_EQ(1, cap.epb);
+	EXPECT_EQ(28 + 30, cap.last_caplen);
+	EXPECT_EQ(28 + sizeof(pkt), cap.last_origlen);
+	EXPECT_EQ(0, memcmp(&cap.last_data[28], pkt, 30));
+
+	unlink(CAPTURE_FILE);
+}
+
+
+#define NUM_THREADS 4
+#define PACKETS_PER_THREAD 20000
+
+
+struct producer {
+	wire_avs::RtpDump *dump;
+	uint32_t ssrc;
+	int err;
+};
+
+
+static void *producer_thread(void *arg)
+{
+	struct producer *prod = (struct producer *)arg;
+	uint8_t pkt[160];
+
+	for (int i = 0; i < PACKETS_PER_THREAD; i++) {
+		make_rtp(pkt, sizeof(pkt), i, prod->ssrc);
+
+		if (prod->dump->DumpPacket(pkt, sizeof(pkt)))
+			++prod->err;
+	}
+
+	return NULL;
+}
+
+
+/* Every packet is either written or counted as dropped */
+TEST(rtpdump, concurrent)
+{
+	wire_avs::RtpDump dump;
+	struct producer prodv[NUM_THREADS];
+	pthread_t tidv[NUM_THREADS];
+	struct capture cap;
+
+	ASSERT_EQ(0, dump.Start(CAPTURE_FILE));
+
+	for (int i = 0; i < NUM_THREADS; i++) {
+		prodv[i].dump = &dump;
+		prodv[i].ssrc = 0x1000 + i;
+		prodv[i].err = 0;
+		ASSERT_EQ(0, pthread_create(&tidv[i], NULL,
+					    producer_thread, &prodv[i]));
+	}
+
+	for (int i = 0; i < NUM_THREADS; i++) {
+		pthread_join(tidv[i], NULL);
+		EXPECT_EQ(0, prodv[i].err);
+	}
+
+	ASSERT_EQ(0, dump.Stop());
+
+	ASSERT_EQ(0, read_capture(&cap, CAPTURE_FILE));
+	EXPECT_GE(cap.idb, 1);
+	EXPECT_LE(cap.idb, NUM_THREADS);
+	EXPECT_GT(cap.epb, 0);
+	EXPECT_EQ(NUM_THREADS * PACKETS_PER_THREAD, cap.epb + dump.Dropped());
+
+	re_printf("rtpdump: %u packets written, %u dropped\n",
+		  cap.epb, dump.Dropped());
+
+	unlink(CAPTURE_FILE);
+}
@@ -0,0 +1,624 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <sys/time.h>
+#include <pthread.h>
+#include <re.h>
+#include <avs.h>
+#include <avs_mediastats.h>
+#include <gtest/gtest.h>
+#include "avs_audio_io.h"
+#include "nw_simulator.h"
+#include "simclock.h"
+
+
+#define CALL_DURATION_MS (10 * 60 * 1000)
+#define PACKET_MS 20
+#define PAYLOAD_BYTES 80
+#define PT 111
+#define RTP_HDR_BYTES 12
+
+
+static uint64_t wall_ms(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+
+struct tick_state {
+	struct tmr tmr;
+	uint64_t last;
+	unsigned n;
+	unsigned late;
+};
+
+
+static void tick_handler(void *arg)
+{
+	struct tick_state *ts = (struct tick_state *)arg;
+	uint64_t now = tmr_jiffies();
+
+	if (ts->last && now - ts->last != PACKET_MS)
+		++ts->late;
+
+	ts->last = now;
+	++ts->n;
+
+	tmr_start(&ts->tmr, PACKET_MS, tick_handler, ts);
+}
+
+
+TEST(simclock, timers)
+{
+	struct tick_state ts;
+	struct ztime zt;
+	uint64_t t0 = wall_ms();
+
+	memset(&ts, 0, sizeof(ts));
+
+	{
+		SimClock sc(5000);
+
+		ASSERT_TRUE(tmr_clock_isvirtual());
+		ASSERT_EQ(5000, tmr_jiffies());
+
+		ASSERT_EQ(0, ztime_get(&zt));
+		ASSERT_EQ(5, zt.sec);
+
+		tmr_start(&ts.tmr, PACKET_MS, tick_handler, &ts);
+
+		ASSERT_EQ(0, sc.Run(CALL_DURATION_MS));
+		tmr_cancel(&ts.tmr);
+
+		ASSERT_EQ(5000 + CALL_DURATION_MS, sc.Now());
+	}
+
+	ASSERT_FALSE(tmr_clock_isvirtual());
+
+	/* The last tick is at the same time as the stop timer */
+	EXPECT_GE(ts.n, CALL_DURATION_MS/PACKET_MS - 1);
+	EXPECT_LE(ts.n, CALL_DURATION_MS/PACKET_MS);
+	EXPECT_EQ(0, ts.late);
+
+	/* Ten minutes of timers in much less than a minute */
+	EXPECT_LT(wall_ms() - t0, 30000);
+}
+
+
+struct thread_clock {
+	bool isvirtual;
+	uint64_t jfs;
+	int err;
+};
+
+
+static void *thread_clock_handler(void *arg)
+{
+	struct thread_clock *tc = (struct thread_clock *)arg;
+
+	tc->err = re_thread_init();
+	if (tc->err)
+		return NULL;
+
+	tc->isvirtual = tmr_clock_isvirtual();
+	tc->jfs = tmr_jiffies();
+
+	re_thread_close();
+
+	return NULL;
+}
+
+
+/* A thread with its own main loop keeps the system clock */
+TEST(simclock, per_thread)
+{
+	struct thread_clock tc;
+	pthread_t tid;
+
+	memset(&tc, 0, sizeof(tc));
+
+	SimClock sc(5000);
+
+	ASSERT_EQ(0, pthread_create(&tid, NULL, thread_clock_handler, &tc));
+	pthread_join(tid, NULL);
+
+	ASSERT_EQ(0, tc.err);
+	EXPECT_FALSE(tc.isvirtual);
+	EXPECT_GT(tc.jfs, 5000 + CALL_DURATION_MS);
+
+	EXPECT_TRUE(tmr_clock_isvirtual());
+	EXPECT_EQ(5000, tmr_jiffies());
+}
+
+
+/* One direction of a call: RTP packets through a simulated network */
+struct leg {
+	NwSimulator nws;
+	struct rtp_stats stats;
+	struct tmr tmr_send;
+	struct tmr tmr_recv;
+	uint16_t seq;
+	uint32_t ts;
+	uint32_t ssrc;
+	unsigned sent;
+	unsigned received;
+	unsigned buffered_ms;  /* received and not played yet */
+};
+
+
+static void recv_handler(void *arg);
+
+
+static void schedule_recv(struct leg *lg)
+{
+	int next = lg->nws.Next_Packet_Time();
+	int now = (int)tmr_jiffies();
+	uint64_t delay;
+
+	if (next < 0)
+		return;
+
+	delay = next > now ? next - now : 0;
+
+	if (tmr_isrunning(&lg->tmr_recv) &&
+	    tmr_get_expire(&lg->tmr_recv) <= delay)
+		return;
+
+	tmr_start(&lg->tmr_recv, delay, recv_handler, lg);
+}
+
+
+static void recv_handler(void *arg)
+{
+	struct leg *lg = (struct leg *)arg;
+	unsigned char pkt[MAX_BYTES_PER_PACKET];
+	int n;
+
+	while ((n = lg->nws.Get_Packet(pkt, (int)tmr_jiffies())) > 0) {
+		mediastats_rtp_stats_update(&lg->stats, pkt, n, 0);
+		++lg->received;
+		lg->buffered_ms += PACKET_MS;
+	}
+
+	schedule_recv(lg);
+}
+
+
+static void leg_init(struct leg *lg, int ix, NW_type nw_type,
+		     int loss_pct, float mbl)
+{
+	lg->nws.Init(PACKET_MS, loss_pct, mbl, nw_type, "./test/data/");
+	lg->nws.SetSeed(1234 + ix);
+	mediastats_rtp_stats_init(&lg->stats, PT, 200);
+	tmr_init(&lg->tmr_send);
+	tmr_init(&lg->tmr_recv);
+	lg->seq = 100 * ix;
+	lg->ts = 0;
+	lg->ssrc = 0x1000 + ix;
+	lg->sent = 0;
+	lg->received = 0;
+	lg->buffered_ms = 0;
+}
+
+
+static void leg_send(struct leg *lg)
+{
+	unsigned char pkt[RTP_HDR_BYTES + PAYLOAD_BYTES];
+	struct rtp_header hdr;
+	struct mbuf mb;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver = RTP_VERSION;
+	hdr.pt = PT;
+	hdr.seq = lg->seq++;
+	hdr.ts = lg->ts;
+	hdr.ssrc = lg->ssrc;
+	lg->ts += PACKET_MS * 48;
+
+	mbuf_init(&mb);
+	mb.buf = pkt;
+	mb.size = sizeof(pkt);
+	rtp_hdr_encode(&mb, &hdr);
+	memset(pkt + RTP_HDR_BYTES, lg->seq & 0xff, PAYLOAD_BYTES);
+
+	lg->nws.Add_Packet(pkt, sizeof(pkt), (int)tmr_jiffies());
+	++lg->sent;
+
+	schedule_recv(lg);
+}
+
+
+static void send_handler(void *arg)
+{
+	struct leg *lg = (struct leg *)arg;
+
+	tmr_start(&lg->tmr_send, PACKET_MS, send_handler, lg);
+
+	leg_send(lg);
+}
+
+
+struct call_result {
+	unsigned sent[2];
+	unsigned received[2];
+	int lost[2];
+	int dropouts[2];
+	int n[2];
+	float loss_avg[2];
+	float loss_max[2];
+	float mbl_avg[2];
+	uint64_t wall_ms;
+};
+
+
+static void simulated_call(struct call_result *res, NW_type nw_type,
+			   int loss_pct, float mbl)
+{
+	struct leg legv[2];
+	uint64_t t0 = wall_ms();
+	int err;
+
+	SimClock sc;
+
+	for (int i = 0; i < 2; i++) {
+		struct leg *lg = &legv[i];
+
+		leg_init(lg, i, nw_type, loss_pct, mbl);
+
+		/* The two sides start off-beat */
+		tmr_start(&lg->tmr_send, 5 + 7 * i, send_handler, lg);
+	}
+
+	err = sc.Run(CALL_DURATION_MS);
+
+	/* the timers point into legv */
+	for (int i = 0; i < 2; i++) {
+		tmr_cancel(&legv[i].tmr_send);
+		tmr_cancel(&legv[i].tmr_recv);
+	}
+
+	ASSERT_EQ(0, err);
+
+	for (int i = 0; i < 2; i++) {
+		struct leg *lg = &legv[i];
+
+		res->sent[i] = lg->sent;
+		res->received[i] = lg->received;
+		res->lost[i] = lg->nws.GetLostPacketCount();
+		res->dropouts[i] = lg->stats.dropouts;
+		res->n[i] = lg->stats.n;
+		res->loss_avg[i] = lg->stats.pkt_loss_stats.avg;
+		res->loss_max[i] = lg->stats.pkt_loss_stats.max;
+		res->mbl_avg[i] = lg->stats.pkt_mbl_stats.avg;
+	}
+
+	res->wall_ms = wall_ms() - t0;
+}
+
+
+TEST(simclock, call_wifi_loss)
+{
+	struct call_result r1, r2;
+
+	memset(&r1, 0, sizeof(r1));
+	memset(&r2, 0, sizeof(r2));
+
+	simulated_call(&r1, NW_type_wifi, 10, 2.0f);
+	simulated_call(&r2, NW_type_wifi, 10, 2.0f);
+
+	for (int i = 0; i < 2; i++) {
+
+		EXPECT_GE(r1.sent[i], CALL_DURATION_MS/PACKET_MS - 1);
+		EXPECT_GT(r1.received[i], r1.sent[i] / 2);
+		EXPECT_LT(r1.received[i], r1.sent[i]);
+		EXPECT_GT(r1.lost[i], 0);
+
+		/* one set of statistics per 10 s */
+		EXPECT_GE(r1.n[i], CALL_DURATION_MS/INTERVAL_MS - 2);
+		EXPECT_GT(r1.loss_avg[i], 2.0f);
+		EXPECT_LT(r1.loss_avg[i], 25.0f);
+
+		/* The same run gives the same numbers */
+		EXPECT_EQ(r1.sent[i], r2.sent[i]);
+		EXPECT_EQ(r1.received[i], r2.received[i]);
+		EXPECT_EQ(r1.lost[i], r2.lost[i]);
+		EXPECT_EQ(r1.dropouts[i], r2.dropouts[i]);
+		EXPECT_EQ(r1.n[i], r2.n[i]);
+		EXPECT_EQ(r1.loss_avg[i], r2.loss_avg[i]);
+		EXPECT_EQ(r1.loss_max[i], r2.loss_max[i]);
+		EXPECT_EQ(r1.mbl_avg[i], r2.mbl_avg[i]);
+	}
+
+	re_printf("simulated 10 min call in %llu ms:"
+		  " %u/%u and %u/%u packets received\n",
+		  r1.wall_ms,
+		  r1.received[0], r1.sent[0], r1.received[1], r1.sent[1]);
+
+	EXPECT_LT(r1.wall_ms, 30000);
+}
+
+
+/* Counts the frames of a fake audio device and checks their spacing */
+class FrameCounter : public webrtc::AudioTransport {
+public:
+	FrameCounter() : recorded(0), played(0), late(0), silent(0),
+			 last_rec(0) {}
+
+	int32_t RecordedDataIsAvailable(const void* audioSamples,
+					const size_t nSamples,
+					const size_t nBytesPerSample,
+					const size_t nChannels,
+					const uint32_t samplesPerSec,
+					const uint32_t totalDelayMS,
+					const int32_t clockDrift,
+					const uint32_t currentMicLevel,
+					const bool keyPressed,
+					uint32_t& newMicLevel)
+	{
+		const int16_t *samples = (const int16_t *)audioSamples;
+		uint64_t now = tmr_jiffies();
+		bool sound = false;
+
+		if (last_rec && now - last_rec != FRAME_LEN_MS)
+			++late;
+		last_rec = now;
+
+		for (size_t i = 0; i < nSamples; i++)
+			sound |= samples[i] != 0;
+		if (!sound)
+			++silent;
+
+		++recorded;
+
+		return 0;
+	}
+
+	int32_t NeedMorePlayData(const size_t nSamples,
+				 const size_t nBytesPerSample,
+				 const size_t nChannels,
+				 const uint32_t samplesPerSec,
+				 void* audioSamples,
+				 size_t& nSamplesOut,
+				 int64_t* elapsed_time_ms,
+				 int64_t* ntp_time_ms)
+	{
+		nSamplesOut = nSamples;
+		++played;
+
+		return 0;
+	}
+
+	unsigned recorded;
+	unsigned played;
+	unsigned late;
+	unsigned silent;
+
+private:
+	uint64_t last_rec;
+};
+
+
+TEST(simclock, fake_audiodevice)
+{
+	FrameCounter fc;
+	uint64_t t0 = wall_ms();
+	int err;
+
+	SimClock sc;
+
+	/* declared after the clock, so that it stops its timers first */
+	webrtc::fake_audiodevice ad;
+
+	ASSERT_EQ(0, ad.EnableVirtualClock());
+	ad.EnableSine();
+	ad.RegisterAudioCallback(&fc);
+
+	ad.InitRecording();
+	ad.InitPlayout();
+	ad.StartRecording();
+	ad.StartPlayout();
+
+	/* too late once the device runs */
+	ASSERT_EQ(-1, ad.EnableVirtualClock());
+
+	err = sc.Run(CALL_DURATION_MS);
+
+	ad.StopRecording();
+	ad.StopPlayout();
+
+	ASSERT_EQ(0, err);
+
+	EXPECT_GE(fc.recorded, CALL_DURATION_MS/FRAME_LEN_MS - 1);
+	EXPECT_LE(fc.recorded, CALL_DURATION_MS/FRAME_LEN_MS);
+	EXPECT_GE(fc.played, CALL_DURATION_MS/FRAME_LEN_MS - 1);
+	EXPECT_LE(fc.played, CALL_DURATION_MS/FRAME_LEN_MS);
+	EXPECT_EQ(0, fc.late);
+	EXPECT_EQ(0, fc.silent);
+
+	/* nothing runs after the device was stopped */
+	fc.recorded = 0;
+	fc.played = 0;
+	ASSERT_EQ(0, sc.Run(100));
+	EXPECT_EQ(0, fc.recorded);
+	EXPECT_EQ(0, fc.played);
+
+	EXPECT_LT(wall_ms() - t0, 30000);
+}
+
+
+/* One side of a call on a fake audio device. Every PACKET_MS of
+ * recording goes out as an RTP packet on tx. The playout takes its
+ * frames from what arrived on rx and counts a concealed frame when
+ * nothing is there.
+ */
+class CallSide : public webrtc::AudioTransport {
+public:
+	CallSide(struct leg *tx, struct leg *rx)
+		: played(0), concealed(0), tx_(tx), rx_(rx), rec_ms_(0) {}
+
+	int32_t RecordedDataIsAvailable(const void* audioSamples,
+					const size_t nSamples,
+					const size_t nBytesPerSample,
+					const size_t nChannels,
+					const uint32_t samplesPerSec,
+					const uint32_t totalDelayMS,
+					const int32_t clockDrift,
+					const uint32_t currentMicLevel,
+					const bool keyPressed,
+					uint32_t& newMicLevel)
+	{
+		rec_ms_ += FRAME_LEN_MS;
+		if (rec_ms_ >= PACKET_MS) {
+			rec_ms_ = 0;
+			leg_send(tx_);
+		}
+
+		return 0;
+	}
+
+	int32_t NeedMorePlayData(const size_t nSamples,
+				 const size_t nBytesPerSample,
+				 const size_t nChannels,
+				 const uint32_t samplesPerSec,
+				 void* audioSamples,
+				 size_t& nSamplesOut,
+				 int64_t* elapsed_time_ms,
+				 int64_t* ntp_time_ms)
+	{
+		nSamplesOut = nSamples;
+		memset(audioSamples, 0, nSamples * nBytesPerSample * nChannels);
+
+		if (rx_->buffered_ms >= FRAME_LEN_MS)
+			rx_->buffered_ms -= FRAME_LEN_MS;
+		else
+			++concealed;
+		++played;
+
+		return 0;
+	}
+
+	unsigned played;
+	unsigned concealed;
+
+private:
+	struct leg *tx_;
+	struct leg *rx_;
+	unsigned rec_ms_;
+};
+
+
+struct device_call_result {
+	unsigned sent[2];
+	unsigned received[2];
+	unsigned played[2];
+	unsigned concealed[2];
+	int n[2];
+};
+
+
+static void device_call(struct device_call_result *res, NW_type nw_type,
+			int loss_pct, float mbl)
+{
+	struct leg legv[2];
+	int err;
+
+	SimClock sc;
+
+	for (int i = 0; i < 2; i++)
+		leg_init(&legv[i], i, nw_type, loss_pct, mbl);
+
+	CallSide sidev[2] = {
+		CallSide(&legv[0], &legv[1]),
+		CallSide(&legv[1], &legv[0]),
+	};
+
+	/* declared after the clock, so that they stop their timers first */
+	webrtc::fake_audiodevice adv[2];
+
+	for (int i = 0; i < 2; i++) {
+		ASSERT_EQ(0, adv[i].EnableVirtualClock());
+		adv[i].EnableSine();
+		adv[i].RegisterAudioCallback(&sidev[i]);
+		adv[i].InitRecording();
+		adv[i].InitPlayout();
+		adv[i].StartRecording();
+		adv[i].StartPlayout();
+	}
+
+	err = sc.Run(CALL_DURATION_MS);
+
+	for (int i = 0; i < 2; i++) {
+		adv[i].StopRecording();
+		adv[i].StopPlayout();
+		tmr_cancel(&legv[i].tmr_recv);
+	}
+
+	ASSERT_EQ(0, err);
+
+	for (int i = 0; i < 2; i++) {
+		res->sent[i] = legv[i].sent;
+		res->received[i] = legv[i].received;
+		res->played[i] = sidev[i].played;
+		res->concealed[i] = sidev[i].concealed;
+		res->n[i] = legv[i].stats.n;
+	}
+}
+
+
+/*
+ * The fake audio devices of both sides pace the call. This covers the
+ * devices, the network simulator and re timers on the SimClock. The
+ * mediaflows, with their sockets, and the voice engine, whose NetEQ
+ * runs on WebRTC threads with their own clock, are not part of it.
+ */
+TEST(simclock, call_fake_audiodevice)
+{
+	struct device_call_result r1, r2;
+	uint64_t t0 = wall_ms();
+
+	memset(&r1, 0, sizeof(r1));
+	memset(&r2, 0, sizeof(r2));
+
+	device_call(&r1, NW_type_wifi, 10, 2.0f);
+	device_call(&r2, NW_type_wifi, 10, 2.0f);
+
+	for (int i = 0; i < 2; i++) {
+
+		EXPECT_GE(r1.sent[i], CALL_DURATION_MS/PACKET_MS - 1);
+		EXPECT_GT(r1.received[i], r1.sent[i] / 2);
+		EXPECT_LT(r1.received[i], r1.sent[i]);
+		EXPECT_GE(r1.played[i], CALL_DURATION_MS/FRAME_LEN_MS - 1);
+
+		/* side i plays leg 1-i, at least what the network lost on
+		 * it is concealed
+		 */
+		EXPECT_GE(r1.concealed[i] * FRAME_LEN_MS,
+			  (r1.sent[1-i] - r1.received[1-i] - 1) * PACKET_MS);
+		EXPECT_GE(r1.n[i], CALL_DURATION_MS/INTERVAL_MS - 2);
+
+		EXPECT_EQ(r1.sent[i], r2.sent[i]);
+		EXPECT_EQ(r1.received[i], r2.received[i]);
+		EXPECT_EQ(r1.played[i], r2.played[i]);
+		EXPECT_EQ(r1.concealed[i], r2.concealed[i]);
+	}
+
+	EXPECT_LT(wall_ms() - t0, 60000);
+}
@@ -15,10 +15,15 @@
 * You should have received a copy of the GNU General Public License
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
+#include <sys/time.h>
 #include <re.h>
 #include <gtest/gtest.h>
 #include <avs.h>
 
+extern "C" {
+#include "../contrib/re/src/srtp/srtp.h"
+}
+
 
 TEST(srtp, srtcp_packet)
 {
@@ -54,3 +59,620 @@ TEST(srtp, srtcp_packet)
 	mem_deref(srtp);
 	mem_deref(mb);
 }
+
+
+/* RFC 7714 16.1.1, with the IV as calculated in 16.1 */
+TEST(srtp, aes_gcm_rfc7714)
+{
+	static const char *key_str = "000102030405060708090a0b0c0d0e0f";
+	static const char *iv_str  = "51753c6580c2726f20718414";
+	static const char *hdr_str = "8040f17b8041f8d35501a0b2";
+	static const char *pt_str  =
+		"47616c6c696120657374206f6d6e6973"
+		"20646976697361"
+		"20696e207061727465732074726573";
+	static const char *ct_str  =
+		"f24de3a3fb34de6cacba861c9d7e4bca"
+		"be633bd50d294e6f42a5f47a51c7d19b"
+		"36de3adf8833899d7f27beb16a9152cf"
+		"765ee4390cce";
+	uint8_t key[16], iv[AES_BLOCK_SIZE] = {0}, hdr[12];
+	uint8_t pt[38], ct[54], buf[38], tag[16];
+	struct aes *aes;
+	int err = 0;
+
+	err |= str_hex(key, sizeof(key), key_str);
+	err |= str_hex(iv, 12, iv_str);
+	err |= str_hex(hdr, sizeof(hdr), hdr_str);
+	err |= str_hex(pt, sizeof(pt), pt_str);
+	err |= str_hex(ct, sizeof(ct), ct_str);
+	ASSERT_EQ(0, err);
+
+	err = aes_alloc(&aes, AES_MODE_GCM, key, 128, NULL);
+	ASSERT_EQ(0, err);
+
+	aes_set_iv(aes, iv);
+	ASSERT_EQ(0, aes_encr(aes, NULL, hdr, sizeof(hdr)));
+	ASSERT_EQ(0, aes_encr(aes, buf, pt, sizeof(pt)));
+	ASSERT_EQ(0, aes_get_authtag(aes, tag, sizeof(tag)));
+	ASSERT_EQ(0, memcmp(buf, ct, sizeof(pt)));
+	ASSERT_EQ(0, memcmp(tag, &ct[sizeof(pt)], sizeof(tag)));
+
+	aes_set_iv(aes, iv);
+	ASSERT_EQ(0, aes_decr(aes, NULL, hdr, sizeof(hdr)));
+	ASSERT_EQ(0, aes_decr(aes, buf, ct, sizeof(pt)));
+	ASSERT_EQ(0, aes_authenticate(aes, &ct[sizeof(pt)], sizeof(tag)));
+	ASSERT_EQ(0, memcmp(buf, pt, sizeof(pt)));
+
+	/* a modified header fails */
+	hdr[0] ^= 1;
+	aes_set_iv(aes, iv);
+	ASSERT_EQ(0, aes_decr(aes, NULL, hdr, sizeof(hdr)));
+	ASSERT_EQ(0, aes_decr(aes, buf, ct, sizeof(pt)));
+	ASSERT_EQ(EAUTH, aes_authenticate(aes, &ct[sizeof(pt)], sizeof(tag)));
+
+	mem_deref(aes);
+}
+
+
+/* RFC 3711 B.3, the 96-bit GCM salt is padded with zeros */
+TEST(srtp, key_derivation)
+{
+	static const char *key_str  = "e1f97a0d3e018be0d64fa32c06de4139";
+	static const char *salt_str = "0ec675ad498afeebb6960b3aabe6";
+	static const char *k_e_str  = "c61e7a93744f39ee10734afe3ff7a087";
+	static const char *k_s_str  = "30cbbc08863d8c85d49db34a9ae1";
+	static const char *k_a_str  = "cebe321f6ff7716b6fd4ab49af256a15"
+		"6d38baa4";
+	uint8_t key[16], salt[14], k_e[16], k_s[14], k_a[20];
+	uint8_t out[20], out_gcm[20];
+	int err = 0;
+
+	err |= str_hex(key, sizeof(key), key_str);
+	err |= str_hex(salt, sizeof(salt), salt_str);
+	err |= str_hex(k_e, sizeof(k_e), k_e_str);
+	err |= str_hex(k_s, sizeof(k_s), k_s_str);
+	err |= str_hex(k_a, sizeof(k_a), k_a_str);
+	ASSERT_EQ(0, err);
+
+	err = srtp_derive(out, sizeof(k_e), 0x00, key, sizeof(key),
+			  salt, sizeof(salt));
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, memcmp(out, k_e, sizeof(k_e)));
+
+	err = srtp_derive(out, sizeof(k_s), 0x02, key, sizeof(key),
+			  salt, sizeof(salt));
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, memcmp(out, k_s, sizeof(k_s)));
+
+	err = srtp_derive(out, sizeof(k_a), 0x01, key, sizeof(key),
+			  salt, sizeof(salt));
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, memcmp(out, k_a, sizeof(k_a)));
+
+	/* RFC 7714 11: the KDF of RFC 3711 with a 96-bit master salt */
+	salt[12] = salt[13] = 0;
+	for (uint8_t label = 0; label < 6; label++) {
+
+		err  = srtp_derive(out, sizeof(out), label, key, sizeof(key),
+				   salt, 14);
+		err |= srtp_derive(out_gcm, sizeof(out_gcm), label,
+				   key, sizeof(key), salt, GCM_SALT_SIZE);
+		ASSERT_EQ(0, err);
+		ASSERT_EQ(0, memcmp(out, out_gcm, sizeof(out)));
+	}
+}
+
+
+/* RFC 7714 8.1 and 9.1 */
+TEST(srtp, gcm_iv)
+{
+	static const char *salt_str = "517569642070726f2071756f";
+	union vect128 k_s, iv, iv_exp;
+	int err = 0;
+
+	memset(&k_s, 0, sizeof(k_s));
+	memset(&iv_exp, 0, sizeof(iv_exp));
+
+	err = str_hex(k_s.u8, GCM_SALT_SIZE, salt_str);
+	ASSERT_EQ(0, err);
+
+	/* RFC 7714 16.1 */
+	err = str_hex(iv_exp.u8, 12, "51753c6580c2726f20718414");
+	ASSERT_EQ(0, err);
+	srtp_iv_calc_gcm(&iv, &k_s, 0x5501a0b2, 0xf17b);
+	ASSERT_EQ(0, memcmp(&iv, &iv_exp, sizeof(iv)));
+
+	/* all 48 bits of the index */
+	err = str_hex(iv_exp.u8, 12, "51753c6580c2605b7609efd3");
+	ASSERT_EQ(0, err);
+	srtp_iv_calc_gcm(&iv, &k_s, 0x5501a0b2, 0x123456789abcULL);
+	ASSERT_EQ(0, memcmp(&iv, &iv_exp, sizeof(iv)));
+}
+
+
+/* Use the session keys of RFC 7714 16 instead of derived ones */
+static void set_session_key(struct srtp::comp *comp, const uint8_t *key,
+			    const uint8_t *salt)
+{
+	int err;
+
+	mem_deref(comp->aes);
+	err = aes_alloc(&comp->aes, AES_MODE_GCM, key, 128, NULL);
+	ASSERT_EQ(0, err);
+
+	memset(&comp->k_s, 0, sizeof(comp->k_s));
+	memcpy(comp->k_s.u8, salt, GCM_SALT_SIZE);
+}
+
+
+/* RFC 7714 16.1.1, as a packet */
+TEST(srtp, gcm_rfc7714_srtp)
+{
+	static const char *rtp_str =
+		"8040f17b8041f8d35501a0b2"
+		"47616c6c696120657374206f6d6e6973"
+		"20646976697361"
+		"20696e207061727465732074726573";
+	static const char *srtp_str =
+		"8040f17b8041f8d35501a0b2"
+		"f24de3a3fb34de6cacba861c9d7e4bca"
+		"be633bd50d294e6f42a5f47a51c7d19b"
+		"36de3adf8833899d7f27beb16a9152cf"
+		"765ee4390cce";
+	uint8_t master[28] = {0}, key[16], salt[12];
+	uint8_t rtp[50], pkt[66];
+	struct srtp *tx, *rx;
+	struct mbuf *mb = mbuf_alloc(128);
+	int err = 0;
+
+	ASSERT_TRUE(mb != NULL);
+
+	err |= str_hex(key, sizeof(key), "000102030405060708090a0b0c0d0e0f");
+	err |= str_hex(salt, sizeof(salt), "517569642070726f2071756f");
+	err |= str_hex(rtp, sizeof(rtp), rtp_str);
+	err |= str_hex(pkt, sizeof(pkt), srtp_str);
+	ASSERT_EQ(0, err);
+
+	err  = srtp_alloc(&tx, SRTP_AES_128_GCM, master, sizeof(master), 0);
+	err |= srtp_alloc(&rx, SRTP_AES_128_GCM, master, sizeof(master), 0);
+	ASSERT_EQ(0, err);
+
+	set_session_key(&tx->rtp, key, salt);
+	set_session_key(&rx->rtp, key, salt);
+
+	/* the header is authenticated, the payload encrypted */
+	mbuf_write_mem(mb, rtp, sizeof(rtp));
+	mb->pos = 0;
+	err = srtp_encrypt(tx, mb);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, mb->pos);
+	ASSERT_EQ(sizeof(pkt), mb->end);
+	ASSERT_EQ(0, memcmp(mb->buf, pkt, sizeof(pkt)));
+
+	err = srtp_decrypt(rx, mb);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, mb->pos);
+	ASSERT_EQ(sizeof(rtp), mb->end);
+	ASSERT_EQ(0, memcmp(mb->buf, rtp, sizeof(rtp)));
+
+	/* a modified header fails */
+	pkt[2] ^= 0x01;
+	mbuf_rewind(mb);
+	mbuf_write_mem(mb, pkt, sizeof(pkt));
+	mb->pos = 0;
+	ASSERT_EQ(EAUTH, srtp_decrypt(rx, mb));
+
+	mem_deref(tx);
+	mem_deref(rx);
+	mem_deref(mb);
+}
+
+
+/*
+ * RFC 7714 9: the SRTCP packet is header, ciphertext, tag and the
+ * E-flag with the SRTCP index. The first 8 bytes and the E-flag with
+ * the index are the Associated Data, and the index is in the IV.
+ */
+TEST(srtp, gcm_rfc7714_srtcp)
+{
+	static const char *rtcp_str =
+		"81c8000d4d617273"
+		"4e5450314e5450325254502000000429"
+		"0000e9304c756d61deadbeef";
+	const uint32_t ix = 0x05d4;
+	uint8_t master[28] = {0}, key[16], salt[12];
+	uint8_t rtcp[36], aad[12], ct[28], tag[GCM_TAG_SIZE];
+	union vect128 iv;
+	struct srtp *tx, *rx;
+	struct srtp_stream *strm;
+	struct aes *aes;
+	struct mbuf *mb = mbuf_alloc(128);
+	int err = 0;
+
+	ASSERT_TRUE(mb != NULL);
+
+	err |= str_hex(key, sizeof(key), "000102030405060708090a0b0c0d0e0f");
+	err |= str_hex(salt, sizeof(salt), "517569642070726f2071756f");
+	err |= str_hex(rtcp, sizeof(rtcp), rtcp_str);
+	ASSERT_EQ(0, err);
+
+	/* the IV from the salt, the SSRC and the index, by hand */
+	memset(&iv, 0, sizeof(iv));
+	memcpy(&iv.u8[2], &rtcp[4], 4);
+	iv.u32[2] = htonl(ix);
+	for (size_t i = 0; i < sizeof(salt); i++)
+		iv.u8[i] ^= salt[i];
+
+	memcpy(aad, rtcp, 8);
+	aad[8]  = 0x80;
+	aad[9]  = 0x00;
+	aad[10] = ix >> 8;
+	aad[11] = ix & 0xff;
+
+	err = aes_alloc(&aes, AES_MODE_GCM, key, 128, NULL);
+	ASSERT_EQ(0, err);
+	aes_set_iv(aes, iv.u8);
+	ASSERT_EQ(0, aes_encr(aes, NULL, aad, sizeof(aad)));
+	ASSERT_EQ(0, aes_encr(aes, ct, &rtcp[8], sizeof(ct)));
+	ASSERT_EQ(0, aes_get_authtag(aes, tag, sizeof(tag)));
+	mem_deref(aes);
+
+	err  = srtp_alloc(&tx, SRTP_AES_128_GCM, master, sizeof(master), 0);
+	err |= srtp_alloc(&rx, SRTP_AES_128_GCM, master, sizeof(master), 0);
+	ASSERT_EQ(0, err);
+
+	set_session_key(&tx->rtcp, key, salt);
+	set_session_key(&rx->rtcp, key, salt);
+
+	/* the next packet is sent with this index */
+	err = stream_get(&strm, tx, 0x4d617273);
+	ASSERT_EQ(0, err);
+	strm->rtcp_index = ix - 1;
+
+	mbuf_write_mem(mb, rtcp, sizeof(rtcp));
+	mb->pos = 0;
+	err = srtcp_encrypt(tx, mb);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, mb->pos);
+	ASSERT_EQ(sizeof(rtcp) + sizeof(tag) + 4, mb->end);
+
+	ASSERT_EQ(0, memcmp(mb->buf, rtcp, 8));
+	ASSERT_EQ(0, memcmp(&mb->buf[8], ct, sizeof(ct)));
+	ASSERT_EQ(0, memcmp(&mb->buf[36], tag, sizeof(tag)));
+	ASSERT_EQ(0, memcmp(&mb->buf[52], &aad[8], 4));
+
+	err = srtcp_decrypt(rx, mb);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, mb->pos);
+	ASSERT_EQ(sizeof(rtcp), mb->end);
+	ASSERT_EQ(0, memcmp(mb->buf, rtcp, sizeof(rtcp)));
+
+	/* the index is authenticated */
+	mb->end = sizeof(rtcp);
+	mb->pos = 0;
+	strm->rtcp_index = ix - 1;
+	ASSERT_EQ(0, srtcp_encrypt(tx, mb));
+	mb->buf[mb->end - 1] ^= 0x01;
+	ASSERT_EQ(EAUTH, srtcp_decrypt(rx, mb));
+
+	/* unencrypted SRTCP is not possible with GCM */
+	mb->buf[mb->end - 1] ^= 0x01;
+	mb->buf[mb->end - 4] &= 0x7f;
+	ASSERT_EQ(EPROTO, srtcp_decrypt(rx, mb));
+
+	mem_deref(tx);
+	mem_deref(rx);
+	mem_deref(mb);
+}
+
+
+static const enum srtp_suite suitev[] = {
+	SRTP_AES_CM_128_HMAC_SHA1_80,
+	SRTP_AES_CM_128_HMAC_SHA1_32,
+	SRTP_AES_256_CM_HMAC_SHA1_80,
+	SRTP_AES_128_GCM,
+	SRTP_AES_256_GCM,
+};
+
+
+static struct mbuf *rtp_packet(uint16_t seq, uint32_t ssrc, size_t len)
+{
+	struct mbuf *mb = mbuf_alloc(len + 64);
+	size_t i;
+
+	mbuf_write_u8(mb, 0x80);
+	mbuf_write_u8(mb, 96);
+	mbuf_write_u16(mb, htons(seq));
+	mbuf_write_u32(mb, htonl(seq * 960));
+	mbuf_write_u32(mb, htonl(ssrc));
+
+	for (i = RTP_HEADER_SIZE; i < len; i++)
+		mbuf_write_u8(mb, (uint8_t)i);
+
+	mb->pos = 0;
+
+	return mb;
+}
+
+
+static struct mbuf *rtcp_packet(uint32_t ssrc, size_t len)
+{
+	struct mbuf *mb = mbuf_alloc(len + 64);
+	size_t i;
+
+	mbuf_write_u8(mb, 0x80);
+	mbuf_write_u8(mb, 200);
+	mbuf_write_u16(mb, htons(len / 4 - 1));
+	mbuf_write_u32(mb, htonl(ssrc));
+
+	for (i = 8; i < len; i++)
+		mbuf_write_u8(mb, (uint8_t)i);
+
+	mb->pos = 0;
+
+	return mb;
+}
+
+
+static void test_suite(enum srtp_suite suite)
+{
+	struct srtp *tx, *rx;
+	struct mbuf *mb, *ref;
+	uint8_t key[46];
+	size_t key_size = srtp_suite_key_size(suite);
+	size_t i;
+	int err;
+
+	ASSERT_NE(0, key_size);
+	ASSERT_LE(key_size, sizeof(key));
+
+	for (i = 0; i < key_size; i++)
+		key[i] = (uint8_t)(i * 7);
+
+	err  = srtp_alloc(&tx, suite, key, key_size, 0);
+	err |= srtp_alloc(&rx, suite, key, key_size, 0);
+	ASSERT_EQ(0, err);
+
+	/* wrong key size */
+	ASSERT_EQ(EINVAL, srtp_alloc(&rx, suite, key, key_size - 2, 0));
+
+	/* RTP */
+	mb = rtp_packet(1000, 0x11223344, 172);
+	ref = rtp_packet(1000, 0x11223344, 172);
+
+	ASSERT_EQ(0, srtp_encrypt(tx, mb));
+	ASSERT_EQ(0, mb->pos);
+	ASSERT_GT(mb->end, ref->end);
+	ASSERT_NE(0, memcmp(mb->buf + RTP_HEADER_SIZE,
+			    ref->buf + RTP_HEADER_SIZE,
+			    ref->end - RTP_HEADER_SIZE));
+
+	ASSERT_EQ(0, srtp_decrypt(rx, mb));
+	ASSERT_EQ(ref->end, mb->end);
+	ASSERT_EQ(0, memcmp(mb->buf, ref->buf, ref->end));
+	mem_deref(mb);
+
+	/* replayed and modified packets */
+	mb = rtp_packet(1001, 0x11223344, 172);
+	ASSERT_EQ(0, srtp_encrypt(tx, mb));
+	mb->buf[20] ^= 0x01;
+	ASSERT_EQ(EAUTH, srtp_decrypt(rx, mb));
+	mem_deref(mb);
+
+	mb = rtp_packet(1000, 0x11223344, 172);
+	ASSERT_EQ(0, srtp_encrypt(tx, mb));
+	ASSERT_EQ(EALREADY, srtp_decrypt(rx, mb));
+	mem_deref(mb);
+	mem_deref(ref);
+
+	/* RTCP */
+	mb = rtcp_packet(0x11223344, 28);
+	ref = rtcp_packet(0x11223344, 28);
+
+	ASSERT_EQ(0, srtcp_encrypt(tx, mb));
+	ASSERT_EQ(0, mb->pos);
+	ASSERT_NE(0, memcmp(mb->buf + 8, ref->buf + 8, ref->end - 8));
+
+	ASSERT_EQ(0, srtcp_decrypt(rx, mb));
+	ASSERT_EQ(ref->end, mb->end);
+	ASSERT_EQ(0, memcmp(mb->buf, ref->buf, ref->end));
+	mem_deref(mb);
+
+	mb = rtcp_packet(0x11223344, 28);
+	ASSERT_EQ(0, srtcp_encrypt(tx, mb));
+	mb->buf[4] ^= 0x01;
+	ASSERT_NE(0, srtcp_decrypt(rx, mb));
+	mem_deref(mb);
+	mem_deref(ref);
+
+	mem_deref(tx);
+	mem_deref(rx);
+}
+
+
+TEST(srtp, suites)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(suitev); i++) {
+
+		test_suite(suitev[i]);
+		if (::testing::Test::HasFatalFailure()) {
+			warning("suite %s failed\n", srtp_suite_name(suitev[i]));
+			return;
+		}
+	}
+}
+
+
+TEST(srtp, batch)
+{
+	enum { N = 8 };
+	struct mbuf *mbv[N], *refv[N];
+	struct srtp *tx_single, *tx_batch, *rx;
+	uint8_t key[28] = {1, 2, 3};
+	int errv[N];
+	size_t i;
+	int err;
+
+	err  = srtp_alloc(&tx_single, SRTP_AES_128_GCM, key, sizeof(key), 0);
+	err |= srtp_alloc(&tx_batch, SRTP_AES_128_GCM, key, sizeof(key), 0);
+	err |= srtp_alloc(&rx, SRTP_AES_128_GCM, key, sizeof(key), 0);
+	ASSERT_EQ(0, err);
+
+	/* two interleaved streams */
+	for (i = 0; i < N; i++) {
+		uint32_t ssrc = i < N/2 ? 1 : 2;
+
+		mbv[i]  = rtp_packet(100 + i, ssrc, 200);
+		refv[i] = rtp_packet(100 + i, ssrc, 200);
+
+		ASSERT_EQ(0, srtp_encrypt(tx_single, refv[i]));
+	}
+
+	err = srtp_encrypt_batch(tx_batch, mbv, N, errv);
+	ASSERT_EQ(0, err);
+
+	for (i = 0; i < N; i++) {
+		ASSERT_EQ(0, errv[i]);
+		ASSERT_EQ(refv[i]->end, mbv[i]->end);
+		ASSERT_EQ(0, memcmp(mbv[i]->buf, refv[i]->buf, mbv[i]->end));
+	}
+
+	/* a bad packet does not stop the batch */
+	mbv[3]->buf[30] ^= 0x80;
+
+	err = srtp_decrypt_batch(rx, mbv, N, errv);
+	ASSERT_EQ(EAUTH, err);
+
+	for (i = 0; i < N; i++) {
+		ASSERT_EQ(i == 3 ? EAUTH : 0, errv[i]);
+	}
+
+	for (i = 0; i < N; i++) {
+		mem_deref(mbv[i]);
+		mem_deref(refv[i]);
+	}
+
+	mem_deref(tx_single);
+	mem_deref(tx_batch);
+	mem_deref(rx);
+}
+
+
+/*
+ * Packets per second for each suite, with audio and video sized packets.
+ * Protect is measured one by one and in batches, unprotect one by one.
+ */
+
+enum {
+	PERF_PACKETS = 20000,
+	PERF_BATCH   = 16,
+};
+
+
+static uint64_t now_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+static unsigned perf_pps(uint64_t usec)
+{
+	return usec ? (unsigned)(PERF_PACKETS * 1000000ULL / usec) : 0;
+}
+
+
+static void perf_suite(enum srtp_suite suite, size_t size)
+{
+	struct mbuf *mbv[PERF_BATCH];
+	struct srtp *tx, *rx;
+	uint8_t key[46] = {0};
+	uint64_t t0, t_single = 0, t_batch = 0, t_decr = 0;
+	size_t key_size = srtp_suite_key_size(suite);
+	uint16_t seq = 0;
+	size_t i, j;
+	int err;
+
+	err  = srtp_alloc(&tx, suite, key, key_size, 0);
+	err |= srtp_alloc(&rx, suite, key, key_size, 0);
+	ASSERT_EQ(0, err);
+
+	for (j = 0; j < PERF_BATCH; j++)
+		mbv[j] = mbuf_alloc(size + 64);
+
+	for (i = 0; i < PERF_PACKETS; i += PERF_BATCH) {
+
+		/* protect and unprotect one by one */
+		for (j = 0; j < PERF_BATCH; j++) {
+			struct mbuf *pkt = rtp_packet(++seq, 1, size);
+
+			mbuf_reset(mbv[j]);
+			mbuf_write_mem(mbv[j], pkt->buf, pkt->end);
+			mbv[j]->pos = 0;
+			mem_deref(pkt);
+		}
+
+		t0 = now_usec();
+		for (j = 0; j < PERF_BATCH; j++)
+			err |= srtp_encrypt(tx, mbv[j]);
+		t_single += now_usec() - t0;
+
+		t0 = now_usec();
+		for (j = 0; j < PERF_BATCH; j++)
+			err |= srtp_decrypt(rx, mbv[j]);
+		t_decr += now_usec() - t0;
+
+		/* protect the (now plain) packets again, as one batch */
+		for (j = 0; j < PERF_BATCH; j++) {
+			uint16_t s = ++seq;
+
+			mbv[j]->buf[2] = s >> 8;
+			mbv[j]->buf[3] = s & 0xff;
+		}
+
+		t0 = now_usec();
+		err |= srtp_encrypt_batch(tx, mbv, PERF_BATCH, NULL);
+		t_batch += now_usec() - t0;
+	}
+	ASSERT_EQ(0, err);
+
+	re_printf("%-24s %5zu bytes  protect %8u  batch %8u"
+		  "  unprotect %8u pkt/s\n",
+		  srtp_suite_name(suite), size,
+		  perf_pps(t_single), perf_pps(t_batch), perf_pps(t_decr));
+
+	for (j = 0; j < PERF_BATCH; j++)
+		mem_deref(mbv[j]);
+
+	mem_deref(tx);
+	mem_deref(rx);
+}
+
+
+TEST(srtp, perf_protect)
+{
+	static const size_t sizev[] = {
+		112,   /* Opus, 20 ms */
+		1200,  /* video */
+	};
+	size_t i, j;
+
+	re_printf("\n");
+
+	for (j = 0; j < ARRAY_SIZE(sizev); j++) {
+		for (i = 0; i < ARRAY_SIZE(suitev); i++) {
+
+			perf_suite(suitev[i], sizev[j]);
+			if (::testing::Test::HasFatalFailure())
+				return;
+		}
+	}
+
+	re_printf("\n");
+}
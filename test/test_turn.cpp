@@ -36,6 +36,14 @@
 static const char *payload = "Ich bin ein payload?";
 
 
+enum {
+	BENCH_PACKETS = 5000,
+	BENCH_BURST   = 25,     /* packets per tick */
+	BENCH_PKTSIZE = 172,    /* RTP header and 20 ms of 64 kbit/s audio */
+	BENCH_LINGER  = 1000,   /* ms to wait for the last packets */
+};
+
+
 class TestTurn : public ::testing::Test {
 
 public:
@@ -131,6 +139,11 @@ public:
 	{
 		TestTurn *tt = static_cast<TestTurn *>(arg);
 
+		if (tt->bench) {
+			tt->bench_send();
+			return;
+		}
+
 		if (tt->turnc->n_permh > 0) {
 
 			tt->send_data(payload);
@@ -164,6 +177,11 @@ public:
 		err = turnconn_add_permission(tt->turnc, &tt->addr_peer);
 		ASSERT_EQ(0, err);
 
+		if (tt->bench) {
+			err = turnconn_add_channel(tt->turnc, &tt->addr_peer);
+			ASSERT_EQ(0, err);
+		}
+
 		tmr_start(&tt->tmr_send, 10, tmr_send_handler, tt);
 	}
 
@@ -195,6 +213,12 @@ public:
 		++tt->n_udp_peer;
 
 		ASSERT_TRUE(sa_cmp(src, &tt->addr_relay, SA_ALL));
+
+		if (tt->bench) {
+			udp_send(tt->us_peer, src, mb);
+			return;
+		}
+
 		ASSERT_EQ(strlen(payload), mbuf_get_left(mb));
 		ASSERT_TRUE(0 == memcmp(payload, mbuf_buf(mb),
 					mbuf_get_left(mb)));
@@ -258,6 +282,16 @@ public:
 		++tt->n_tcp_cli;
 
 		ASSERT_TRUE(sa_cmp(src, &tt->addr_peer, SA_ALL));
+
+		if (tt->bench) {
+			ASSERT_EQ(BENCH_PKTSIZE, mbuf_get_left(mb));
+
+			tt->t_done = tmr_jiffies();
+			if (tt->n_tcp_cli == BENCH_PACKETS)
+				re_cancel();
+			return;
+		}
+
 		ASSERT_EQ(strlen(payload), mbuf_get_left(mb));
 		ASSERT_TRUE(0 == memcmp(payload, mbuf_buf(mb),
 					mbuf_get_left(mb)));
@@ -267,6 +301,51 @@ public:
 #endif
 	}
 
+	/* Relays RTP sized packets over the TCP connection to the
+	 * peer and back, BENCH_BURST every millisecond.
+	 */
+	void bench_send()
+	{
+		struct mbuf *mb;
+		unsigned i;
+		int err;
+
+		if (turnc->n_chanh == 0) {
+			tmr_start(&tmr_send, 10, tmr_send_handler, this);
+			return;
+		}
+
+		if (!t_start)
+			t_start = tmr_jiffies();
+
+		mb = mbuf_alloc(36 + BENCH_PKTSIZE);
+		ASSERT_TRUE(mb != NULL);
+
+		for (i = 0; i < BENCH_BURST && n_sent < BENCH_PACKETS; i++) {
+
+			mb->pos = 36;
+			mb->end = 36 + BENCH_PKTSIZE;
+			memset(mbuf_buf(mb), n_sent & 0xff, BENCH_PKTSIZE);
+
+			err = turnc_send(turnc->turnc, &addr_peer, mb);
+			ASSERT_EQ(0, err);
+
+			++n_sent;
+		}
+
+		mem_deref(mb);
+
+		if (n_sent < BENCH_PACKETS)
+			tmr_start(&tmr_send, 1, tmr_send_handler, this);
+		else
+			tmr_start(&tmr_send, BENCH_LINGER, bench_linger, this);
+	}
+
+	static void bench_linger(void *arg)
+	{
+		re_cancel();
+	}
+
 protected:
 	struct tmr tmr_send;
 	TurnServer srv;
@@ -287,6 +366,11 @@ protected:
 	unsigned n_udp_peer = 0;
 
 	int alloc_error = 0;
+
+	bool bench = false;
+	unsigned n_sent = 0;
+	uint64_t t_start = 0;
+	uint64_t t_done = 0;
 };
 
 
@@ -359,6 +443,48 @@ TEST_F(TestTurn, allocation_permission_send_tls)
 }
 
 
+TEST_F(TestTurn, tcp_relay_throughput)
+{
+	const struct turn_framer_stats *stats;
+	uint64_t dur;
+	int err;
+
+	bench = true;
+
+	start(IPPROTO_TCP, false);
+
+	err = re_main_wait(10000);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(0, alloc_error);
+	ASSERT_EQ(1, n_alloch);
+	ASSERT_EQ(1, turnc->n_chanh);
+	ASSERT_EQ(BENCH_PACKETS, n_sent);
+
+	/* the peer leg is UDP, allow for a few drops */
+	ASSERT_GE(n_tcp_cli, BENCH_PACKETS * 9 / 10);
+
+	stats = turn_framer_stats(turnc->framer);
+	ASSERT_TRUE(stats != NULL);
+	ASSERT_GE(stats->frames, (uint64_t)n_tcp_cli);
+
+	dur = t_done - t_start;
+
+	re_printf("\n");
+	re_printf("~~~ TURN/TCP relay report ~~~\n");
+	re_printf("packets:        %u of %u bytes, %u relayed back\n",
+		  BENCH_PACKETS, BENCH_PKTSIZE, n_tcp_cli);
+	re_printf("duration:       %llu ms\n", dur);
+	re_printf("packets/s:      %llu\n",
+		  dur ? n_tcp_cli * 1000ULL / dur : 0);
+	re_printf("frames:         %llu\n", stats->frames);
+	re_printf("bytes received: %llu\n", stats->bytes);
+	re_printf("bytes copied:   %llu\n", stats->copied);
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+}
+
+
 TEST_F(TestTurn, allocation_failure_441)
 {
 	int err;
@@ -474,3 +600,660 @@ TEST(turn, uri)
 		ASSERT_STREQ(test->str, buf);
 	}
 }
+
+
+struct framer_test {
+	struct turn_framer *tf;
+	struct mbuf *rx;     /* concatenated frames as delivered */
+	unsigned n;
+	unsigned n_stop;     /* stop after this many frames */
+};
+
+
+static int framer_frame_handler(struct mbuf *mb, void *arg)
+{
+	struct framer_test *ft = (struct framer_test *)arg;
+	int err;
+
+	++ft->n;
+
+	err = mbuf_write_mem(ft->rx, mbuf_buf(mb), mbuf_get_left(mb));
+	if (err)
+		return err;
+
+	if (ft->n == ft->n_stop)
+		turn_framer_close(ft->tf);
+
+	return 0;
+}
+
+
+/* A ChannelData frame with len bytes of data, padded to 4 bytes */
+static void write_chandata(struct mbuf *mb, size_t len, uint8_t c)
+{
+	mbuf_write_u16(mb, htons(0x4000));
+	mbuf_write_u16(mb, htons(len));
+	mbuf_fill(mb, c, len);
+	mbuf_fill(mb, 0, (4 - (len & 3)) & 3);
+}
+
+
+/* A STUN Binding Indication without attributes */
+static void write_stun(struct mbuf *mb)
+{
+	mbuf_write_u16(mb, htons(0x0011));
+	mbuf_write_u16(mb, 0);
+	mbuf_write_u32(mb, htonl(0x2112a442));
+	mbuf_fill(mb, 0xab, 12);
+}
+
+
+/* Feeds the stream to the framer in segments of the given size */
+static int framer_feed(struct turn_framer *tf, const struct mbuf *stream,
+		       size_t segsz)
+{
+	size_t pos = 0;
+	int err = 0;
+
+	while (pos < stream->end && !err) {
+
+		size_t n = stream->end - pos;
+		struct mbuf *seg;
+
+		if (n > segsz)
+			n = segsz;
+
+		seg = mbuf_alloc(n);
+		if (!seg)
+			return ENOMEM;
+
+		mbuf_write_mem(seg, stream->buf + pos, n);
+		seg->pos = 0;
+
+		err = turn_framer_recv(tf, seg);
+
+		mem_deref(seg);
+		pos += n;
+	}
+
+	return err;
+}
+
+
+TEST(turn, framer_segments)
+{
+	static const size_t lenv[] = {0, 1, 2, 3, 4, 5, 160, 1200, 1203};
+	static const size_t segv[] = {1, 2, 3, 5, 7, 64, 1000, 65536};
+	struct mbuf *stream, *expect;
+	unsigned i, j;
+	int err;
+
+	stream = mbuf_alloc(4096);
+	expect = mbuf_alloc(4096);
+	ASSERT_TRUE(stream != NULL);
+	ASSERT_TRUE(expect != NULL);
+
+	for (i = 0; i < ARRAY_SIZE(lenv); i++) {
+
+		size_t pos = stream->end;
+
+		write_chandata(stream, lenv[i], 'a' + i);
+		mbuf_write_mem(expect, stream->buf + pos, 4 + lenv[i]);
+
+		if (i == 4) {
+			pos = stream->end;
+			write_stun(stream);
+			mbuf_write_mem(expect, stream->buf + pos,
+				       STUN_HEADER_SIZE);
+		}
+	}
+
+	for (j = 0; j < ARRAY_SIZE(segv); j++) {
+
+		struct framer_test ft;
+		const struct turn_framer_stats *stats;
+
+		memset(&ft, 0, sizeof(ft));
+		ft.rx = mbuf_alloc(4096);
+		ASSERT_TRUE(ft.rx != NULL);
+
+		err = turn_framer_alloc(&ft.tf, framer_frame_handler, &ft);
+		ASSERT_EQ(0, err);
+
+		err = framer_feed(ft.tf, stream, segv[j]);
+		ASSERT_EQ(0, err);
+
+		ASSERT_EQ(ARRAY_SIZE(lenv) + 1, ft.n);
+		ASSERT_EQ(expect->end, ft.rx->end);
+		ASSERT_TRUE(0 == memcmp(expect->buf, ft.rx->buf,
+					expect->end));
+		ASSERT_EQ(0, turn_framer_pending(ft.tf));
+
+		stats = turn_framer_stats(ft.tf);
+		ASSERT_EQ(ft.n, stats->frames);
+		ASSERT_EQ(stream->end, stats->bytes);
+
+		/* whole frames in one segment are not copied */
+		if (segv[j] >= stream->end)
+			ASSERT_EQ(0, stats->copied);
+		else
+			ASSERT_GT(stats->copied, 0);
+
+		mem_deref(ft.tf);
+		mem_deref(ft.rx);
+	}
+
+	mem_deref(expect);
+	mem_deref(stream);
+}
+
+
+TEST(turn, framer_padding_split)
+{
+	struct framer_test ft;
+	struct mbuf *stream;
+	int err;
+
+	memset(&ft, 0, sizeof(ft));
+	ft.rx = mbuf_alloc(64);
+	stream = mbuf_alloc(64);
+	ASSERT_TRUE(ft.rx != NULL);
+	ASSERT_TRUE(stream != NULL);
+
+	err = turn_framer_alloc(&ft.tf, framer_frame_handler, &ft);
+	ASSERT_EQ(0, err);
+
+	/* the padding of the first frame ends up in the next segment */
+	write_chandata(stream, 5, 'x');
+	write_chandata(stream, 2, 'y');
+
+	err = framer_feed(ft.tf, stream, 9);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(2, ft.n);
+	ASSERT_EQ(9 + 6, ft.rx->end);
+	ASSERT_EQ(0, turn_framer_pending(ft.tf));
+
+	mem_deref(ft.tf);
+	mem_deref(ft.rx);
+	mem_deref(stream);
+}
+
+
+TEST(turn, framer_close_in_handler)
+{
+	struct framer_test ft;
+	struct mbuf *stream;
+	int err;
+
+	memset(&ft, 0, sizeof(ft));
+	ft.rx = mbuf_alloc(64);
+	stream = mbuf_alloc(64);
+	ASSERT_TRUE(ft.rx != NULL);
+	ASSERT_TRUE(stream != NULL);
+
+	err = turn_framer_alloc(&ft.tf, framer_frame_handler, &ft);
+	ASSERT_EQ(0, err);
+
+	ft.n_stop = 1;
+
+	write_chandata(stream, 8, 'a');
+	write_chandata(stream, 8, 'b');
+	write_chandata(stream, 8, 'c');
+
+	err = framer_feed(ft.tf, stream, stream->end);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(1, ft.n);
+
+	mem_deref(ft.rx);
+	mem_deref(stream);
+}
+
+
+TEST(turn, framer_bad_message)
+{
+	struct framer_test ft;
+	struct mbuf *stream;
+	int err;
+
+	memset(&ft, 0, sizeof(ft));
+	ft.rx = mbuf_alloc(64);
+	stream = mbuf_alloc(64);
+	ASSERT_TRUE(ft.rx != NULL);
+	ASSERT_TRUE(stream != NULL);
+
+	err = turn_framer_alloc(&ft.tf, framer_frame_handler, &ft);
+	ASSERT_EQ(0, err);
+
+	write_chandata(stream, 8, 'a');
+	mbuf_write_u16(stream, htons(0x8000));
+	mbuf_write_u16(stream, htons(8));
+
+	err = framer_feed(ft.tf, stream, 6);
+	ASSERT_EQ(EBADMSG, err);
+	ASSERT_EQ(1, ft.n);
+
+	mem_deref(ft.tf);
+	mem_deref(ft.rx);
+	mem_deref(stream);
+}
+
+
+/*
+ * TURN allocation pool
+ */
+
+enum {
+	POOL_SRV_DELAY = 100,   /* ms, round trip of a remote server */
+};
+
+struct pool_test {
+	struct turnpool *pool;
+	struct tmr tmr;
+	struct list connl;
+	unsigned n_ready;       /* wait until this many are ready */
+	unsigned n_failed;      /* .. or this many races failed */
+	unsigned n_estab;
+	int err;
+	struct turn_conn *conn;
+	uint64_t ts_estab;
+};
+
+
+static void pool_poll(void *arg)
+{
+	struct pool_test *pt = (struct pool_test *)arg;
+	const struct turnpool_stats *stats = turnpool_stats(pt->pool);
+
+	if ((pt->n_ready && turnpool_ready(pt->pool) >= pt->n_ready) ||
+	    (pt->n_failed && stats && stats->failed >= pt->n_failed)) {
+		re_cancel();
+		return;
+	}
+
+	tmr_start(&pt->tmr, 5, pool_poll, pt);
+}
+
+
+static int pool_wait(struct pool_test *pt, unsigned n_ready,
+		     unsigned n_failed)
+{
+	pt->n_ready = n_ready;
+	pt->n_failed = n_failed;
+
+	tmr_start(&pt->tmr, 0, pool_poll, pt);
+
+	return re_main_wait(5000);
+}
+
+
+static void pool_estab_handler(struct turn_conn *conn,
+			       const struct sa *relay_addr,
+			       const struct sa *mapped_addr,
+			       const struct stun_msg *msg, void *arg)
+{
+	struct pool_test *pt = (struct pool_test *)arg;
+	(void)mapped_addr;
+	(void)msg;
+
+	pt->ts_estab = tmr_jiffies();
+	pt->conn = conn;
+	++pt->n_estab;
+
+	EXPECT_TRUE(sa_isset(relay_addr, SA_ALL));
+
+	re_cancel();
+}
+
+
+static void pool_error_handler(int err, void *arg)
+{
+	struct pool_test *pt = (struct pool_test *)arg;
+
+	pt->err = err ? err : EPROTO;
+
+	re_cancel();
+}
+
+
+static void pool_test_init(struct pool_test *pt, unsigned size)
+{
+	int err;
+
+	memset(pt, 0, sizeof(*pt));
+	tmr_init(&pt->tmr);
+
+	err = turnpool_alloc(&pt->pool, size, AF_INET, 0, 0);
+	ASSERT_EQ(0, err);
+}
+
+
+static struct turnpool_server pool_server(const struct sa *addr, int proto,
+					  const char *user, const char *pass)
+{
+	struct turnpool_server ts;
+
+	ts.addr = *addr;
+	ts.proto = proto;
+	ts.secure = false;
+	ts.username = user;
+	ts.password = pass;
+
+	return ts;
+}
+
+
+static int pool_take(struct pool_test *pt,
+		     const struct turnpool_server *srvv, size_t srvc)
+{
+	return turnpool_take(pt->pool, AF_INET, srvv, srvc, &pt->connl,
+			     pool_estab_handler, NULL,
+			     pool_error_handler, pt);
+}
+
+
+static void pool_test_close(struct pool_test *pt)
+{
+	tmr_cancel(&pt->tmr);
+	list_flush(&pt->connl);
+	mem_deref(pt->pool);
+}
+
+
+/* A slow UDP server and a fast TCP server, TCP wins */
+TEST(turn, pool_race)
+{
+	const struct turnpool_stats *stats;
+	struct pool_test pt;
+	TurnServer srv_slow, srv_fast;
+	int err;
+
+	log_set_min_level(LOG_LEVEL_WARN);
+
+	srv_slow.set_delay(POOL_SRV_DELAY);
+
+	pool_test_init(&pt, 1);
+
+	struct turnpool_server slow = pool_server(&srv_slow.addr, IPPROTO_UDP,
+						  "user", "pass");
+	struct turnpool_server fast = pool_server(&srv_fast.addr_tcp,
+						  IPPROTO_TCP, "user", "pass");
+	struct turnpool_server srvv[] = {slow, fast, fast};
+
+	/* one listed twice is only raced once */
+	err = turnpool_set_servers(pt.pool, srvv, ARRAY_SIZE(srvv));
+	ASSERT_EQ(0, err);
+
+	err = pool_wait(&pt, 1, 0);
+	ASSERT_EQ(0, err);
+
+	stats = turnpool_stats(pt.pool);
+	ASSERT_EQ(1, turnpool_ready(pt.pool));
+	ASSERT_EQ(2, stats->allocs);
+	ASSERT_EQ(1, stats->cancelled);
+	ASSERT_EQ(0, stats->failed);
+
+	/* only the winner is ready */
+	err = pool_take(&pt, &slow, 1);
+	ASSERT_EQ(ENOENT, err);
+
+	err = pool_take(&pt, &fast, 1);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(1, list_count(&pt.connl));
+
+	/* the new owner hears about it from the main loop */
+	ASSERT_EQ(0, pt.n_estab);
+
+	err = re_main_wait(5000);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, pt.err);
+	ASSERT_EQ(1, pt.n_estab);
+	ASSERT_EQ(IPPROTO_TCP, pt.conn->proto);
+	ASSERT_TRUE(sa_cmp(&srv_fast.addr_tcp, &pt.conn->turn_srv, SA_ALL));
+	ASSERT_EQ(1, stats->taken);
+
+	/* the taken slot is filled again */
+	err = pool_wait(&pt, 1, 0);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(4, stats->allocs);
+
+	pool_test_close(&pt);
+}
+
+
+TEST(turn, pool_failure)
+{
+	const struct turnpool_stats *stats;
+	struct pool_test pt;
+	TurnServer srv;
+	int err;
+
+	log_set_min_level(LOG_LEVEL_ERROR);
+
+	srv.set_sim_error(441);
+
+	pool_test_init(&pt, 2);
+
+	/* nothing to race with */
+	ASSERT_EQ(0, turnpool_stats(pt.pool)->allocs);
+
+	struct turnpool_server ts = pool_server(&srv.addr, IPPROTO_UDP,
+						"user", "pass");
+
+	err = turnpool_set_servers(pt.pool, &ts, 1);
+	ASSERT_EQ(0, err);
+
+	err = pool_wait(&pt, 0, 1);
+	ASSERT_EQ(0, err);
+
+	stats = turnpool_stats(pt.pool);
+	ASSERT_EQ(0, turnpool_ready(pt.pool));
+	ASSERT_GE(stats->failed, 1);
+	ASSERT_EQ(0, stats->cancelled);
+
+	err = pool_take(&pt, &ts, 1);
+	ASSERT_EQ(ENOENT, err);
+	ASSERT_EQ(1, stats->misses);
+	ASSERT_EQ(0, stats->taken);
+
+	pool_test_close(&pt);
+}
+
+
+/* A call gets an allocation on any of the servers it is configured
+ * for. Servers that are not configured any more are dropped.
+ */
+TEST(turn, pool_servers)
+{
+	const struct turnpool_stats *stats;
+	struct pool_test pt;
+	TurnServer srv, srv_other;
+	int err;
+
+	log_set_min_level(LOG_LEVEL_WARN);
+
+	pool_test_init(&pt, 1);
+
+	struct turnpool_server udp = pool_server(&srv.addr, IPPROTO_UDP,
+						 "user", "pass");
+	struct turnpool_server tcp = pool_server(&srv.addr_tcp, IPPROTO_TCP,
+						 "user", "pass");
+	struct turnpool_server other = pool_server(&srv_other.addr,
+						   IPPROTO_UDP,
+						   "user", "pass");
+
+	err = turnpool_set_servers(pt.pool, &udp, 1);
+	ASSERT_EQ(0, err);
+
+	err = pool_wait(&pt, 1, 0);
+	ASSERT_EQ(0, err);
+
+	stats = turnpool_stats(pt.pool);
+
+	err = pool_take(&pt, &other, 1);
+	ASSERT_EQ(ENOENT, err);
+	err = pool_take(&pt, &tcp, 1);
+	ASSERT_EQ(ENOENT, err);
+	ASSERT_EQ(1, turnpool_ready(pt.pool));
+
+	/* a call that can use either */
+	struct turnpool_server callv[] = {other, tcp, udp};
+
+	err = pool_take(&pt, callv, ARRAY_SIZE(callv));
+	ASSERT_EQ(0, err);
+
+	err = re_main_wait(5000);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, pt.err);
+	ASSERT_EQ(1, pt.n_estab);
+	ASSERT_EQ(1, stats->taken);
+	ASSERT_EQ(2, stats->misses);
+
+	/* the next call only has the other server */
+	err = pool_wait(&pt, 1, 0);
+	ASSERT_EQ(0, err);
+
+	err = turnpool_set_servers(pt.pool, &other, 1);
+	ASSERT_EQ(0, err);
+
+	err = pool_take(&pt, &udp, 1);
+	ASSERT_EQ(ENOENT, err);
+	ASSERT_EQ(0, turnpool_ready(pt.pool));
+
+	err = pool_wait(&pt, 1, 0);
+	ASSERT_EQ(0, err);
+
+	err = pool_take(&pt, &other, 1);
+	ASSERT_EQ(0, err);
+
+	err = re_main_wait(5000);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, pt.err);
+	ASSERT_EQ(2, pt.n_estab);
+	ASSERT_TRUE(sa_cmp(&srv_other.addr, &pt.conn->turn_srv, SA_ALL));
+
+	pool_test_close(&pt);
+}
+
+
+/* Every call gets new credentials. The allocation made with the ones
+ * of the previous call is still good for the next one.
+ */
+TEST(turn, pool_rotating_credentials)
+{
+	const struct turnpool_stats *stats;
+	struct pool_test pt;
+	TurnServer srv;
+	char user[32], pass[32];
+	int err;
+
+	log_set_min_level(LOG_LEVEL_WARN);
+
+	pool_test_init(&pt, 1);
+
+	stats = turnpool_stats(pt.pool);
+
+	for (unsigned i = 0; i < 3; i++) {
+		struct turnpool_server ts;
+
+		re_snprintf(user, sizeof(user), "user%u", i);
+		re_snprintf(pass, sizeof(pass), "pass%u", i);
+		ts = pool_server(&srv.addr, IPPROTO_UDP, user, pass);
+
+		err = turnpool_set_servers(pt.pool, &ts, 1);
+		ASSERT_EQ(0, err);
+
+		/* the first call has nothing to take */
+		err = pool_take(&pt, &ts, 1);
+		if (i == 0) {
+			ASSERT_EQ(ENOENT, err);
+		}
+		else {
+			ASSERT_EQ(0, err);
+
+			err = re_main_wait(5000);
+			ASSERT_EQ(0, err);
+			ASSERT_EQ(0, pt.err);
+			ASSERT_EQ(i, pt.n_estab);
+
+			/* made for the previous call */
+			re_snprintf(user, sizeof(user), "user%u", i - 1);
+			ASSERT_STREQ(user, pt.conn->username);
+		}
+
+		err = pool_wait(&pt, 1, 0);
+		ASSERT_EQ(0, err);
+	}
+
+	ASSERT_EQ(2, stats->taken);
+	ASSERT_EQ(1, stats->misses);
+	ASSERT_EQ(3, stats->allocs);
+
+	pool_test_close(&pt);
+}
+
+
+/* Time from the start of a call to its first relay candidate, with
+ * and without an allocation from the pool.
+ */
+TEST(turn, pool_setup_time)
+{
+	struct pool_test pt;
+	struct turn_conn *conn = NULL;
+	TurnServer srv;
+	uint64_t t0, t_direct, t_pool;
+	int err;
+
+	log_set_min_level(LOG_LEVEL_WARN);
+
+	srv.set_delay(POOL_SRV_DELAY);
+
+	pool_test_init(&pt, 1);
+
+	t0 = tmr_jiffies();
+	err = turnconn_alloc(&conn, &pt.connl, &srv.addr, IPPROTO_UDP, false,
+			     "user", "pass", AF_INET, NULL, 0, 0,
+			     pool_estab_handler, NULL,
+			     pool_error_handler, &pt);
+	ASSERT_EQ(0, err);
+
+	err = re_main_wait(5000);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, pt.err);
+	ASSERT_EQ(1, pt.n_estab);
+	t_direct = pt.ts_estab - t0;
+
+	struct turnpool_server ts = pool_server(&srv.addr, IPPROTO_UDP,
+						"user", "pass");
+
+	err = turnpool_set_servers(pt.pool, &ts, 1);
+	ASSERT_EQ(0, err);
+
+	err = pool_wait(&pt, 1, 0);
+	ASSERT_EQ(0, err);
+
+	t0 = tmr_jiffies();
+	err = pool_take(&pt, &ts, 1);
+	ASSERT_EQ(0, err);
+
+	err = re_main_wait(5000);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(0, pt.err);
+	ASSERT_EQ(2, pt.n_estab);
+	ASSERT_EQ(2, list_count(&pt.connl));
+	t_pool = pt.ts_estab - t0;
+
+	ASSERT_GE(t_direct, POOL_SRV_DELAY);
+	ASSERT_LT(t_pool, POOL_SRV_DELAY);
+
+	re_printf("\n");
+	re_printf("~~~ TURN allocation setup time ~~~\n");
+	re_printf("server delay:   %u ms\n", POOL_SRV_DELAY);
+	re_printf("direct:         %llu ms\n", t_direct);
+	re_printf("from pool:      %llu ms\n", t_pool);
+	re_printf("~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~ ~~~\n");
+	re_printf("\n");
+
+	pool_test_close(&pt);
+}
@@ -0,0 +1,565 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <time.h>
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+/* A frame with its own pixel buffer */
+struct test_frame {
+	struct avs_vidframe vf;
+	uint8_t *buf;
+	size_t sz;
+};
+
+
+static void frame_init(struct test_frame *tf, enum avs_vidframe_type type,
+		       int w, int h)
+{
+	size_t cw = (w + 1) / 2, ch = (h + 1) / 2;
+
+	memset(tf, 0, sizeof(*tf));
+
+	tf->vf.type = type;
+	tf->vf.w = w;
+	tf->vf.h = h;
+
+	switch (type) {
+
+	case AVS_VIDFRAME_I420:
+		tf->vf.ys = w;
+		tf->vf.us = tf->vf.vs = cw;
+		tf->sz = w * h + 2 * cw * ch;
+		break;
+
+	case AVS_VIDFRAME_NV12:
+	case AVS_VIDFRAME_NV21:
+		tf->vf.ys = w;
+		tf->vf.us = 2 * cw;
+		tf->sz = w * h + 2 * cw * ch;
+		break;
+
+	case AVS_VIDFRAME_YUY2:
+		tf->vf.ys = 2 * w;
+		tf->sz = 2 * w * h;
+		break;
+
+	case AVS_VIDFRAME_ARGB:
+		tf->vf.ys = 4 * w;
+		tf->sz = 4 * w * h;
+		break;
+	}
+
+	tf->buf = (uint8_t *)mem_zalloc(tf->sz, NULL);
+
+	tf->vf.y = tf->buf;
+	if (type == AVS_VIDFRAME_I420) {
+		tf->vf.u = tf->buf + w * h;
+		tf->vf.v = tf->vf.u + cw * ch;
+	}
+	else if (type != AVS_VIDFRAME_YUY2 && type != AVS_VIDFRAME_ARGB) {
+		tf->vf.u = tf->buf + w * h;
+	}
+}
+
+
+static void frame_random(struct test_frame *tf)
+{
+	rand_bytes(tf->buf, tf->sz);
+}
+
+
+static void frame_close(struct test_frame *tf)
+{
+	mem_deref(tf->buf);
+}
+
+
+static uint8_t avg(uint8_t a, uint8_t b)
+{
+	return (a + b + 1) >> 1;
+}
+
+
+static const enum avs_vidframe_type typev[] = {
+	AVS_VIDFRAME_I420,
+	AVS_VIDFRAME_NV12,
+	AVS_VIDFRAME_NV21,
+	AVS_VIDFRAME_YUY2,
+	AVS_VIDFRAME_ARGB,
+};
+
+
+static const char *type_name(enum avs_vidframe_type type)
+{
+	switch (type) {
+
+	case AVS_VIDFRAME_I420: return "I420";
+	case AVS_VIDFRAME_NV12: return "NV12";
+	case AVS_VIDFRAME_NV21: return "NV21";
+	case AVS_VIDFRAME_YUY2: return "YUY2";
+	case AVS_VIDFRAME_ARGB: return "ARGB";
+	default:                return "?";
+	}
+}
+
+
+/* Reference conversion without scaling, for even sizes */
+static void reference(struct test_frame *dst, const struct test_frame *src)
+{
+	const struct avs_vidframe *s = &src->vf;
+	struct avs_vidframe *d = &dst->vf;
+	int x, y;
+
+	for (y = 0; y < s->h; y++) {
+		const uint8_t *row = s->y + y * s->ys;
+
+		for (x = 0; x < s->w; x++) {
+			uint8_t *py = &d->y[y * d->ys + x];
+
+			switch (s->type) {
+
+			case AVS_VIDFRAME_YUY2:
+				*py = row[2*x];
+				break;
+
+			case AVS_VIDFRAME_ARGB: {
+				const uint8_t *p = &row[4*x];
+
+				*py = ((25*p[0] + 129*p[1] + 66*p[2] + 128)
+				       >> 8) + 16;
+			}
+				break;
+
+			default:
+				*py = row[x];
+				break;
+			}
+		}
+	}
+
+	for (y = 0; y < s->h / 2; y++) {
+		for (x = 0; x < s->w / 2; x++) {
+			uint8_t *pu = &d->u[y * d->us + x];
+			uint8_t *pv = &d->v[y * d->vs + x];
+
+			switch (s->type) {
+
+			case AVS_VIDFRAME_I420:
+				*pu = s->u[y * s->us + x];
+				*pv = s->v[y * s->vs + x];
+				break;
+
+			case AVS_VIDFRAME_NV12:
+				*pu = s->u[y * s->us + 2*x];
+				*pv = s->u[y * s->us + 2*x + 1];
+				break;
+
+			case AVS_VIDFRAME_NV21:
+				*pv = s->u[y * s->us + 2*x];
+				*pu = s->u[y * s->us + 2*x + 1];
+				break;
+
+			case AVS_VIDFRAME_YUY2: {
+				const uint8_t *r0 = s->y + 2*y * s->ys + 4*x;
+				const uint8_t *r1 = r0 + s->ys;
+
+				*pu = avg(r0[1], r1[1]);
+				*pv = avg(r0[3], r1[3]);
+			}
+				break;
+
+			case AVS_VIDFRAME_ARGB: {
+				uint8_t uv[2][2];
+
+				for (int i = 0; i < 2; i++) {
+					const uint8_t *p = s->y
+						+ (2*y + i) * s->ys + 8*x;
+					int b = avg(p[0], p[4]);
+					int g = avg(p[1], p[5]);
+					int r = avg(p[2], p[6]);
+
+					uv[i][0] = (112*b - 74*g - 38*r
+						    + 0x8080) >> 8;
+					uv[i][1] = (112*r - 94*g - 18*b
+						    + 0x8080) >> 8;
+				}
+
+				*pu = avg(uv[0][0], uv[1][0]);
+				*pv = avg(uv[0][1], uv[1][1]);
+			}
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+}
+
+
+static void convert(struct test_frame *dst, enum avs_vidframe_type type,
+		    int sw, int sh, int dw, int dh, bool simd, uint32_t seed)
+{
+	struct vidconv *vc = NULL;
+	struct test_frame src;
+
+	srand(seed);
+
+	frame_init(&src, type, sw, sh);
+	for (size_t i = 0; i < src.sz; i++)
+		src.buf[i] = rand() & 0xff;
+
+	frame_init(dst, AVS_VIDFRAME_I420, dw, dh);
+
+	ASSERT_EQ(0, vidconv_alloc(&vc));
+
+	vidconv_enable_simd(simd);
+	ASSERT_EQ(0, vidconv_to_i420(vc, &dst->vf, &src.vf));
+	vidconv_enable_simd(true);
+
+	mem_deref(vc);
+	frame_close(&src);
+}
+
+
+TEST(vidconv, same_size)
+{
+	struct vidconv *vc = NULL;
+
+	ASSERT_EQ(0, vidconv_alloc(&vc));
+
+	for (size_t i = 0; i < ARRAY_SIZE(typev); i++) {
+		struct test_frame src, dst, ref;
+		const int w = 70, h = 38;
+
+		frame_init(&src, typev[i], w, h);
+		frame_init(&dst, AVS_VIDFRAME_I420, w, h);
+		frame_init(&ref, AVS_VIDFRAME_I420, w, h);
+		frame_random(&src);
+		src.vf.rotation = 90;
+		src.vf.ts = 1234;
+
+		ASSERT_EQ(0, vidconv_to_i420(vc, &dst.vf, &src.vf));
+		reference(&ref, &src);
+
+		EXPECT_EQ(0, memcmp(dst.buf, ref.buf, dst.sz))
+			<< type_name(typev[i]);
+		EXPECT_EQ(90, dst.vf.rotation);
+		EXPECT_EQ(1234, dst.vf.ts);
+
+		frame_close(&src);
+		frame_close(&dst);
+		frame_close(&ref);
+	}
+
+	mem_deref(vc);
+}
+
+
+TEST(vidconv, argb_levels)
+{
+	struct vidconv *vc = NULL;
+	struct test_frame src, dst;
+
+	ASSERT_EQ(0, vidconv_alloc(&vc));
+
+	frame_init(&src, AVS_VIDFRAME_ARGB, 32, 4);
+	frame_init(&dst, AVS_VIDFRAME_I420, 32, 4);
+
+	/* white */
+	memset(src.buf, 0xff, src.sz);
+	ASSERT_EQ(0, vidconv_to_i420(vc, &dst.vf, &src.vf));
+	EXPECT_EQ(235, dst.vf.y[0]);
+	EXPECT_EQ(128, dst.vf.u[0]);
+	EXPECT_EQ(128, dst.vf.v[0]);
+
+	/* black */
+	memset(src.buf, 0, src.sz);
+	ASSERT_EQ(0, vidconv_to_i420(vc, &dst.vf, &src.vf));
+	EXPECT_EQ(16, dst.vf.y[31]);
+	EXPECT_EQ(128, dst.vf.u[15]);
+	EXPECT_EQ(128, dst.vf.v[15]);
+
+	/* blue */
+	for (size_t i = 0; i < src.sz; i += 4)
+		src.buf[i] = 0xff;
+	ASSERT_EQ(0, vidconv_to_i420(vc, &dst.vf, &src.vf));
+	EXPECT_EQ(41, dst.vf.y[0]);
+	EXPECT_EQ(240, dst.vf.u[0]);
+	EXPECT_EQ(110, dst.vf.v[0]);
+
+	frame_close(&src);
+	frame_close(&dst);
+	mem_deref(vc);
+}
+
+
+TEST(vidconv, simd_matches_scalar)
+{
+	static const struct {
+		int sw, sh, dw, dh;
+	} sizev[] = {
+		{ 64,   48,   64,  48},
+		{ 1280, 720,  640, 360},
+		{ 1280, 720,  852, 480},
+		{ 333,  199,  333, 199},
+		{ 334,  199,  101,  67},
+		{ 640,  480,  638, 478},
+		{ 96,   64,   2,   2},
+	};
+
+	if (!vidconv_has_simd())
+		re_printf("vidconv: no SIMD on this platform\n");
+
+	for (size_t i = 0; i < ARRAY_SIZE(sizev); i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(typev); j++) {
+			struct test_frame a, b;
+
+			/* YUY2 needs an even width */
+			if (typev[j] == AVS_VIDFRAME_YUY2 && sizev[i].sw & 1)
+				continue;
+
+			convert(&a, typev[j], sizev[i].sw, sizev[i].sh,
+				sizev[i].dw, sizev[i].dh, false, i);
+			convert(&b, typev[j], sizev[i].sw, sizev[i].sh,
+				sizev[i].dw, sizev[i].dh, true, i);
+
+			EXPECT_EQ(0, memcmp(a.buf, b.buf, a.sz))
+				<< type_name(typev[j]) << " "
+				<< sizev[i].sw << "x" << sizev[i].sh << " -> "
+				<< sizev[i].dw << "x" << sizev[i].dh;
+
+			frame_close(&a);
+			frame_close(&b);
+		}
+	}
+}
+
+
+TEST(vidconv, downscale_flat)
+{
+	struct vidconv *vc = NULL;
+	struct test_frame src, dst;
+
+	ASSERT_EQ(0, vidconv_alloc(&vc));
+
+	frame_init(&src, AVS_VIDFRAME_NV12, 1280, 720);
+	frame_init(&dst, AVS_VIDFRAME_I420, 480, 270);
+
+	memset(src.vf.y, 100, 1280 * 720);
+	for (int i = 0; i < 640 * 360; i++) {
+		src.vf.u[2*i] = 60;
+		src.vf.u[2*i + 1] = 200;
+	}
+
+	ASSERT_EQ(0, vidconv_to_i420(vc, &dst.vf, &src.vf));
+
+	for (int i = 0; i < 480 * 270; i++)
+		ASSERT_EQ(100, dst.vf.y[i]);
+	for (int i = 0; i < 240 * 135; i++) {
+		ASSERT_EQ(60, dst.vf.u[i]);
+		ASSERT_EQ(200, dst.vf.v[i]);
+	}
+
+	frame_close(&src);
+	frame_close(&dst);
+	mem_deref(vc);
+}
+
+
+TEST(vidconv, downscale_no_alias)
+{
+	static const struct {
+		int sw, sh, dw, dh;
+	} sizev[] = {
+		{ 640,  480,  160, 120},
+		{ 1280, 720,  320, 180},
+		{ 1280, 720,  426, 240},
+	};
+	struct vidconv *vc = NULL;
+
+	ASSERT_EQ(0, vidconv_alloc(&vc));
+
+	for (size_t i = 0; i < ARRAY_SIZE(sizev); i++) {
+		struct test_frame src, dst;
+		const int sw = sizev[i].sw, sh = sizev[i].sh;
+		const int dw = sizev[i].dw, dh = sizev[i].dh;
+
+		frame_init(&src, AVS_VIDFRAME_I420, sw, sh);
+		frame_init(&dst, AVS_VIDFRAME_I420, dw, dh);
+
+		/* one pixel checkerboard, point sampling gives 0 or 255 */
+		for (int y = 0; y < sh; y++) {
+			for (int x = 0; x < sw; x++)
+				src.vf.y[y * sw + x] = (x ^ y) & 1 ? 255 : 0;
+		}
+		memset(src.vf.u, 128, sw / 2 * sh / 2);
+		memset(src.vf.v, 128, sw / 2 * sh / 2);
+
+		ASSERT_EQ(0, vidconv_to_i420(vc, &dst.vf, &src.vf));
+
+		for (int j = 0; j < dw * dh; j++) {
+			ASSERT_NEAR(128, dst.vf.y[j], 24)
+				<< sw << "x" << sh << " -> "
+				<< dw << "x" << dh << " at " << j;
+		}
+		for (int j = 0; j < dw / 2 * dh / 2; j++)
+			ASSERT_EQ(128, dst.vf.u[j]);
+
+		frame_close(&src);
+		frame_close(&dst);
+	}
+
+	mem_deref(vc);
+}
+
+
+TEST(vidconv, bad_args)
+{
+	struct vidconv *vc = NULL;
+	struct test_frame src, dst;
+
+	ASSERT_EQ(0, vidconv_alloc(&vc));
+
+	frame_init(&src, AVS_VIDFRAME_NV21, 320, 240);
+	frame_init(&dst, AVS_VIDFRAME_I420, 640, 480);
+
+	/* no upscaling */
+	EXPECT_EQ(EINVAL, vidconv_to_i420(vc, &dst.vf, &src.vf));
+	EXPECT_EQ(EINVAL, vidconv_to_i420(NULL, &dst.vf, &src.vf));
+
+	dst.vf.w = 160;
+	dst.vf.h = 120;
+	dst.vf.ys = 160;
+	dst.vf.us = dst.vf.vs = 80;
+	EXPECT_EQ(0, vidconv_to_i420(vc, &dst.vf, &src.vf));
+
+	src.vf.type = (enum avs_vidframe_type)99;
+	EXPECT_EQ(ENOTSUP, vidconv_to_i420(vc, &dst.vf, &src.vf));
+
+	frame_close(&src);
+	frame_close(&dst);
+	mem_deref(vc);
+}
+
+
+TEST(vidconv, fit)
+{
+	int w, h;
+
+	vidconv_fit(&w, &h, 1280, 720, 640, 480);
+	EXPECT_EQ(640, w);
+	EXPECT_EQ(360, h);
+
+	/* The target works in either orientation */
+	vidconv_fit(&w, &h, 720, 1280, 640, 480);
+	EXPECT_EQ(360, w);
+	EXPECT_EQ(640, h);
+
+	vidconv_fit(&w, &h, 1920, 1080, 1280, 720);
+	EXPECT_EQ(1280, w);
+	EXPECT_EQ(720, h);
+
+	vidconv_fit(&w, &h, 640, 480, 320, 240);
+	EXPECT_EQ(320, w);
+	EXPECT_EQ(240, h);
+
+	/* Never upscale */
+	vidconv_fit(&w, &h, 640, 480, 1280, 720);
+	EXPECT_EQ(640, w);
+	EXPECT_EQ(480, h);
+
+	/* No target */
+	vidconv_fit(&w, &h, 640, 480, 0, 0);
+	EXPECT_EQ(640, w);
+	EXPECT_EQ(480, h);
+}
+
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+#define BENCH_FRAMES 10
+
+
+TEST(vidconv, benchmark)
+{
+	static const struct {
+		const char *name;
+		int w, h;
+	} sizev[] = {
+		{"480p",  640,  480},
+		{"720p",  1280, 720},
+		{"1080p", 1920, 1080},
+	};
+	struct vidconv *vc = NULL;
+
+	ASSERT_EQ(0, vidconv_alloc(&vc));
+
+	re_printf("vidconv: ns/frame     full   full(nosimd)"
+		  "   half   half(nosimd)\n");
+
+	for (size_t i = 0; i < ARRAY_SIZE(sizev); i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(typev); j++) {
+			uint64_t ns[4];
+			struct test_frame src;
+
+			frame_init(&src, typev[j], sizev[i].w, sizev[i].h);
+			frame_random(&src);
+
+			for (int k = 0; k < 4; k++) {
+				struct test_frame dst;
+				int div = k < 2 ? 1 : 2;
+				uint64_t t0;
+
+				frame_init(&dst, AVS_VIDFRAME_I420,
+					   sizev[i].w / div, sizev[i].h / div);
+				vidconv_enable_simd(!(k & 1));
+
+				t0 = now_ns();
+				for (int n = 0; n < BENCH_FRAMES; n++) {
+					ASSERT_EQ(0, vidconv_to_i420(vc,
+								     &dst.vf,
+								     &src.vf));
+				}
+				ns[k] = (now_ns() - t0) / BENCH_FRAMES;
+
+				frame_close(&dst);
+			}
+
+			vidconv_enable_simd(true);
+
+			re_printf("vidconv: %5s %s %9llu %9llu %9llu %9llu\n",
+				  sizev[i].name, type_name(typev[j]),
+				  ns[0], ns[1], ns[2], ns[3]);
+
+			frame_close(&src);
+		}
+	}
+
+	mem_deref(vc);
+}
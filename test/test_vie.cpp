@@ -384,3 +384,351 @@ TEST_F(Vie, encode_decode_loop)
 	/* DONE */
 	mem_deref(ves);
 }
+
+
+/*
+ * Send resolution/framerate adaptation
+ */
+
+struct bw_trace_point {
+	uint64_t t;         /* ms  */
+	uint32_t kbps;
+	uint32_t width;     /* expected operating point  */
+	uint32_t height;
+	uint32_t fps;
+};
+
+
+static void run_bw_trace(struct vie_adapt *va,
+			 const struct bw_trace_point *tracev, size_t tracec)
+{
+	for (size_t i = 0; i < tracec; ++i) {
+		const struct bw_trace_point *tp = &tracev[i];
+		const struct vie_oppoint *op;
+
+		vie_adapt_set_bitrate(va, tp->kbps * 1000, tp->t);
+		op = vie_adapt_oppoint(va);
+
+		ASSERT_EQ(tp->width, op->width) << "at t=" << tp->t;
+		ASSERT_EQ(tp->height, op->height) << "at t=" << tp->t;
+		ASSERT_EQ(tp->fps, op->fps) << "at t=" << tp->t;
+	}
+}
+
+
+class VieAdapt : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		vie_enable_hd(true);
+	}
+
+	virtual void TearDown() override
+	{
+		vie_enable_hd(false);
+	}
+};
+
+
+TEST_F(VieAdapt, good_link_reaches_720p30)
+{
+	struct vie_adapt *va = NULL;
+	static const struct bw_trace_point trace[] = {
+		{    0, 2000, 1280, 720, 30},
+		{ 1000, 2500, 1280, 720, 30},
+		{ 2000, 1800, 1280, 720, 30},
+	};
+
+	ASSERT_EQ(0, vie_adapt_alloc(&va, NULL, 0));
+	run_bw_trace(va, trace, ARRAY_SIZE(trace));
+	mem_deref(va);
+}
+
+
+TEST_F(VieAdapt, framerate_drops_before_resolution)
+{
+	struct vie_adapt *va = NULL;
+	static const struct bw_trace_point trace[] = {
+		{    0, 2000, 1280, 720, 30},
+		{ 1000, 1000, 1280, 720, 20},
+		{ 2000,  750, 1280, 720, 15},
+		{ 3000,  600,  960, 540, 20},
+		{ 4000,  300,  640, 480, 15},
+		{ 5000,  200,  480, 360, 17},
+		{ 6000,  100,  320, 240, 10},
+		{ 7000,   50,  240, 180, 15},
+	};
+
+	ASSERT_EQ(0, vie_adapt_alloc(&va, NULL, 0));
+	run_bw_trace(va, trace, ARRAY_SIZE(trace));
+	mem_deref(va);
+}
+
+
+TEST_F(VieAdapt, going_up_needs_sustained_bandwidth)
+{
+	struct vie_adapt *va = NULL;
+	static const struct bw_trace_point trace[] = {
+		{    0,  400,  480, 360, 30},
+		{ 1000, 2000,  480, 360, 30},
+		{ 3000, 2000,  480, 360, 30},
+		{ 5000, 2000, 1280, 720, 30},
+	};
+
+	ASSERT_EQ(0, vie_adapt_alloc(&va, NULL, 0));
+	run_bw_trace(va, trace, ARRAY_SIZE(trace));
+	mem_deref(va);
+}
+
+
+TEST_F(VieAdapt, no_flapping_around_threshold)
+{
+	struct vie_adapt *va = NULL;
+	const struct vie_oppoint *op;
+
+	ASSERT_EQ(0, vie_adapt_alloc(&va, NULL, 0));
+
+	vie_adapt_set_bitrate(va, 1000000, 0);
+	op = vie_adapt_oppoint(va);
+	ASSERT_EQ(960, op->width);
+
+	/* 1.6 and 1.4 Mbit/s alternating, never long enough to go up
+	 * and never low enough to go down.
+	 */
+	for (uint64_t t = 1000; t < 30000; t += 1000) {
+		uint32_t kbps = (t / 1000) % 2 ? 1600 : 1400;
+
+		vie_adapt_set_bitrate(va, kbps * 1000, t);
+		op = vie_adapt_oppoint(va);
+		ASSERT_EQ(960, op->width);
+		ASSERT_EQ(540, op->height);
+	}
+
+	mem_deref(va);
+}
+
+
+TEST_F(VieAdapt, cpu_overuse)
+{
+	struct vie_adapt *va = NULL;
+	const struct vie_oppoint *op;
+
+	ASSERT_EQ(0, vie_adapt_alloc(&va, NULL, 0));
+
+	vie_adapt_set_bitrate(va, 2000000, 0);
+	op = vie_adapt_oppoint(va);
+	ASSERT_EQ(1280, op->width);
+	ASSERT_EQ(30, op->fps);
+
+	/* First overuse lowers the framerate ... */
+	ASSERT_TRUE(vie_adapt_set_cpu_overuse(va, true, 1000));
+	ASSERT_EQ(1280, op->width);
+	ASSERT_EQ(15, op->fps);
+
+	/* ... the next one the resolution.  */
+	ASSERT_TRUE(vie_adapt_set_cpu_overuse(va, true, 2000));
+	ASSERT_EQ(960, op->width);
+	ASSERT_EQ(30, op->fps);
+
+	/* Plenty of bandwidth doesn't override the CPU limit.  */
+	vie_adapt_set_bitrate(va, 2500000, 3000);
+	vie_adapt_set_bitrate(va, 2500000, 8000);
+	ASSERT_EQ(960, op->width);
+
+	/* Underuse too soon is ignored.  */
+	ASSERT_FALSE(vie_adapt_set_cpu_overuse(va, false, 6000));
+	ASSERT_EQ(960, op->width);
+
+	/* Later, the step limit is lifted and bandwidth takes over.  */
+	ASSERT_FALSE(vie_adapt_set_cpu_overuse(va, false, 7000));
+	ASSERT_EQ(960, op->width);
+	vie_adapt_set_bitrate(va, 2500000, 9000);
+	ASSERT_EQ(960, op->width);
+	vie_adapt_set_bitrate(va, 2500000, 11000);
+	ASSERT_EQ(1280, op->width);
+	ASSERT_EQ(30, op->fps);
+
+	mem_deref(va);
+}
+
+
+TEST(vie_adapt, no_hd_stops_at_640x480)
+{
+	struct vie_adapt *va = NULL;
+	const struct vie_oppoint *op;
+
+	ASSERT_FALSE(vie_have_hd());
+	ASSERT_EQ(0, vie_adapt_alloc(&va, NULL, 0));
+
+	vie_adapt_set_bitrate(va, 5000000, 0);
+	op = vie_adapt_oppoint(va);
+	ASSERT_EQ(640, op->width);
+	ASSERT_EQ(480, op->height);
+	ASSERT_EQ(30, op->fps);
+	ASSERT_EQ(1200, op->max_br);
+
+	vie_adapt_set_bitrate(va, 200000, 1000);
+	ASSERT_EQ(480, op->width);
+	ASSERT_EQ(700, op->max_br);
+
+	mem_deref(va);
+}
+
+
+TEST(vie_adapt, custom_ladder)
+{
+	struct vie_adapt *va = NULL;
+	static const struct vie_ladder_step ladder[] = {
+		{640, 360, 24, 12, 400, 800},
+		{320, 180, 12,  6,   0, 300},
+	};
+	static const struct bw_trace_point trace[] = {
+		{    0,  500,  640, 360, 24},
+		{ 1000,  300,  640, 360, 18},
+		{ 2000,  150,  320, 180, 12},
+		{ 3000,  450,  320, 180, 12},
+		{ 7000,  450,  640, 360, 24},
+	};
+
+	ASSERT_EQ(0, vie_adapt_alloc(&va, ladder, ARRAY_SIZE(ladder)));
+	run_bw_trace(va, trace, ARRAY_SIZE(trace));
+	mem_deref(va);
+
+	/* The configured ladder is used for new streams */
+	ASSERT_EQ(0, vie_set_resolution_ladder(ladder, ARRAY_SIZE(ladder)));
+	ASSERT_EQ(0, vie_adapt_alloc(&va, NULL, 0));
+	vie_adapt_set_bitrate(va, 5000000, 0);
+	ASSERT_EQ(640, vie_adapt_oppoint(va)->width);
+	mem_deref(va);
+
+	ASSERT_EQ(0, vie_set_resolution_ladder(NULL, 0));
+}
+
+
+static size_t make_vp8_packet(uint8_t *buf, uint8_t tid, bool sync)
+{
+	static const uint8_t hdr[] = {
+		0x80, 100, 0x00, 0x01,   /* V=2, PT=100, seq  */
+		0x00, 0x00, 0x00, 0x00,  /* timestamp  */
+		0x11, 0x22, 0x33, 0x44,  /* SSRC  */
+		0x90,                    /* X, S  */
+		0xe0,                    /* I, L, T  */
+		0x81, 0x23,              /* 15 bit picture id  */
+		0x05,                    /* TL0PICIDX  */
+	};
+
+	memcpy(buf, hdr, sizeof(hdr));
+	buf[sizeof(hdr)] = (uint8_t)(tid << 6) | (sync ? 0x20 : 0x00);
+	buf[sizeof(hdr) + 1] = 0x9d;  /* start of VP8 payload  */
+
+	return sizeof(hdr) + 2;
+}
+
+
+TEST(vie_tlayer, parse_temporal_index)
+{
+	uint8_t pkt[64];
+	size_t len;
+	uint8_t tid = 0xff;
+	bool sync = true;
+
+	len = make_vp8_packet(pkt, 2, false);
+	ASSERT_EQ(0, vie_vp8_tid(&tid, &sync, pkt, len));
+	ASSERT_EQ(2, tid);
+	ASSERT_FALSE(sync);
+
+	len = make_vp8_packet(pkt, 1, true);
+	ASSERT_EQ(0, vie_vp8_tid(&tid, &sync, pkt, len));
+	ASSERT_EQ(1, tid);
+	ASSERT_TRUE(sync);
+
+	/* no extension means base layer  */
+	pkt[12] = 0x10;
+	ASSERT_EQ(0, vie_vp8_tid(&tid, &sync, pkt, 14));
+	ASSERT_EQ(0, tid);
+
+	/* truncated  */
+	len = make_vp8_packet(pkt, 1, true);
+	ASSERT_EQ(EBADMSG, vie_vp8_tid(&tid, &sync, pkt, 16));
+	ASSERT_EQ(EINVAL, vie_vp8_tid(&tid, &sync, pkt, 8));
+}
+
+
+/* 3 layer pattern 0 2 1 2, at 30 fps  */
+static uint32_t run_tl_frames(struct vie_tl_sel *sel, uint64_t *now,
+			      uint64_t duration, bool late, bool sync)
+{
+	static const uint8_t pattern[] = {0, 2, 1, 2};
+	uint64_t end = *now + duration;
+	uint32_t decoded = 0;
+	size_t i = 0;
+
+	while (*now < end) {
+		uint8_t tid = pattern[i++ % ARRAY_SIZE(pattern)];
+
+		if (vie_tl_sel_decode(sel, tid, sync && tid > 0, false,
+				      late ? 50 : -20, *now))
+			++decoded;
+
+		*now += 33;
+	}
+
+	return decoded;
+}
+
+
+TEST(vie_tlayer, selector_drops_and_recovers)
+{
+	struct vie_tl_sel *sel = NULL;
+	uint64_t now = 1;
+
+	ASSERT_EQ(0, vie_tl_sel_alloc(&sel));
+	ASSERT_EQ(2, vie_tl_sel_max_tid(sel));
+
+	/* keeping up: everything is decoded  */
+	ASSERT_EQ(61u, run_tl_frames(sel, &now, 2000, false, false));
+	ASSERT_EQ(2, vie_tl_sel_max_tid(sel));
+
+	/* decoder falls behind: one layer dropped per second  */
+	run_tl_frames(sel, &now, 1100, true, false);
+	ASSERT_EQ(1, vie_tl_sel_max_tid(sel));
+	run_tl_frames(sel, &now, 1000, true, false);
+	ASSERT_EQ(0, vie_tl_sel_max_tid(sel));
+
+	/* base layer only from now on  */
+	ASSERT_EQ(8u, run_tl_frames(sel, &now, 1000, false, false));
+
+	/* without sync frames we can't go back up  */
+	run_tl_frames(sel, &now, 12000, false, false);
+	ASSERT_EQ(0, vie_tl_sel_max_tid(sel));
+
+	/* with sync frames we go up a layer at a time  */
+	run_tl_frames(sel, &now, 1000, false, true);
+	ASSERT_EQ(1, vie_tl_sel_max_tid(sel));
+	run_tl_frames(sel, &now, 11000, false, true);
+	ASSERT_EQ(2, vie_tl_sel_max_tid(sel));
+
+	mem_deref(sel);
+}
+
+
+TEST(vie_tlayer, key_frame_restores_all_layers)
+{
+	struct vie_tl_sel *sel = NULL;
+	uint64_t now = 1;
+
+	ASSERT_EQ(0, vie_tl_sel_alloc(&sel));
+
+	run_tl_frames(sel, &now, 2100, true, false);
+	ASSERT_EQ(0, vie_tl_sel_max_tid(sel));
+
+	run_tl_frames(sel, &now, 25000, false, false);
+	ASSERT_EQ(0, vie_tl_sel_max_tid(sel));
+
+	ASSERT_TRUE(vie_tl_sel_decode(sel, 0, false, true, 0, now));
+	ASSERT_EQ(2, vie_tl_sel_max_tid(sel));
+	ASSERT_TRUE(vie_tl_sel_decode(sel, 2, false, false, 0, now + 33));
+
+	mem_deref(sel);
+}
@@ -530,3 +530,432 @@ TEST_F(Voe, cbr_on)
     
     mem_deref(ss.mq);
 }
+
+
+static bool sync_complete(struct sync_state *pss)
+{
+	bool complete;
+
+	pthread_mutex_lock(&pss->mutex);
+	complete = pss->n_packet >= EXPECTED_PACKETS;
+	pthread_mutex_unlock(&pss->mutex);
+
+	return complete;
+}
+
+
+TEST_F(Voe, shared_encoder_two_flows)
+{
+	struct auenc_state *aesv[2] = {NULL, NULL};
+	struct audec_state *adsv[2] = {NULL, NULL};
+	struct media_ctx *mctxv[2] = {NULL, NULL};
+	struct sync_state ssv[2];
+	struct aucodec_param prm[2];
+	const struct aucodec *ac;
+	int i, err;
+
+	voe_enable_shared_encoder(true);
+	ASSERT_TRUE(voe_have_shared_encoder());
+
+	ac = aucodec_find(&aucodecl, "opus", 48000, 2);
+	ASSERT_TRUE(ac != NULL);
+
+	for (i = 0; i < 2; i++) {
+		init_sync_state(&ssv[i]);
+
+		memset(&prm[i], 0, sizeof(prm[i]));
+		prm[i].local_ssrc = 0x12345678 + i;
+		prm[i].pt = 96 + i;
+		prm[i].srate = 48000;
+		prm[i].ch = 2;
+
+		err = ac->enc_alloc(&aesv[i], &mctxv[i], ac, NULL, &prm[i],
+				    send_rtp_handler, NULL, NULL, &ssv[i]);
+		ASSERT_EQ(0, err);
+
+		err = ac->dec_alloc(&adsv[i], &mctxv[i], ac, NULL, &prm[i],
+				    NULL, NULL);
+		ASSERT_EQ(0, err);
+	}
+
+	for (i = 0; i < 2; i++) {
+		ac->enc_start(aesv[i]);
+		ac->dec_start(adsv[i]);
+	}
+
+	while (!sync_complete(&ssv[0]) || !sync_complete(&ssv[1])) {
+		err = re_main_wait(30000);
+		ASSERT_EQ(0, err);
+	}
+
+	/* One encoder, but every flow has its own RTP stream,
+	 * and the group does not force longer packets
+	 */
+	for (i = 0; i < 2; i++) {
+		ASSERT_EQ(prm[i].pt, ssv[i].pt);
+		ASSERT_EQ(prm[i].local_ssrc, ssv[i].ssrc);
+		ASSERT_EQ(1, ssv[i].seq_diff);
+		ASSERT_EQ(960, ssv[i].timestamp_diff);
+	}
+
+	for (i = 0; i < 2; i++) {
+		ac->enc_stop(aesv[i]);
+		ac->dec_stop(adsv[i]);
+
+		mem_deref(aesv[i]);
+		mem_deref(adsv[i]);
+
+		mem_deref(ssv[i].mq);
+	}
+}
+
+
+
+/* A flow with CBR can't take the primary's VBR packets, it has to
+ * keep its own encoder. Its packets then all have the same size.
+ */
+TEST_F(Voe, shared_encoder_mismatched_fmtp)
+{
+	struct auenc_state *aesv[2] = {NULL, NULL};
+	struct audec_state *adsv[2] = {NULL, NULL};
+	struct media_ctx *mctxv[2] = {NULL, NULL};
+	struct sync_state ssv[2];
+	struct aucodec_param prm[2];
+	const char *fmtpv[2] = {
+		"stereo=0;sprop-stereo=0;useinbandfec=1",
+		"stereo=0;sprop-stereo=0;useinbandfec=1;cbr=1"
+	};
+	const struct aucodec *ac;
+	int i, err;
+
+	voe_enable_cbr(false);
+	voe_enable_shared_encoder(true);
+
+	ac = aucodec_find(&aucodecl, "opus", 48000, 2);
+	ASSERT_TRUE(ac != NULL);
+
+	for (i = 0; i < 2; i++) {
+		init_sync_state(&ssv[i]);
+
+		memset(&prm[i], 0, sizeof(prm[i]));
+		prm[i].local_ssrc = 0x12345678 + i;
+		prm[i].pt = 96 + i;
+		prm[i].srate = 48000;
+		prm[i].ch = 2;
+		prm[i].cbr = (i == 1);
+
+		err = ac->enc_alloc(&aesv[i], &mctxv[i], ac, fmtpv[i], &prm[i],
+				    send_rtp_handler, NULL, NULL, &ssv[i]);
+		ASSERT_EQ(0, err);
+
+		err = ac->dec_alloc(&adsv[i], &mctxv[i], ac, NULL, &prm[i],
+				    NULL, NULL);
+		ASSERT_EQ(0, err);
+	}
+
+	for (i = 0; i < 2; i++) {
+		ac->enc_start(aesv[i]);
+		ac->dec_start(adsv[i]);
+	}
+
+	while (!sync_complete(&ssv[0]) || !sync_complete(&ssv[1])) {
+		err = re_main_wait(30000);
+		ASSERT_EQ(0, err);
+	}
+
+	for (i = 0; i < 2; i++) {
+		ASSERT_EQ(prm[i].pt, ssv[i].pt);
+		ASSERT_EQ(prm[i].local_ssrc, ssv[i].ssrc);
+		ASSERT_EQ(1, ssv[i].seq_diff);
+		ASSERT_EQ(960, ssv[i].timestamp_diff);
+	}
+	ASSERT_EQ(0, ssv[1].max_pktsize_diff);
+
+	for (i = 0; i < 2; i++) {
+		ac->enc_stop(aesv[i]);
+		ac->dec_stop(adsv[i]);
+
+		mem_deref(aesv[i]);
+		mem_deref(adsv[i]);
+
+		mem_deref(ssv[i].mq);
+	}
+}
+
+static size_t make_level_packet(uint8_t *pkt, uint8_t id, uint8_t level,
+				bool vad)
+{
+	memset(pkt, 0, 32);
+
+	pkt[0] = 0x90;  /* V=2, X */
+	pkt[1] = 111;
+
+	/* one-byte header extension, 3 words */
+	pkt[12] = 0xbe;
+	pkt[13] = 0xde;
+	pkt[15] = 3;
+
+	/* padding, abs-send-time (id 3), audio level */
+	pkt[16] = 0x00;
+	pkt[17] = 0x32;
+	pkt[18] = 0x12;
+	pkt[19] = 0x34;
+	pkt[20] = 0x56;
+	pkt[21] = id << 4;
+	pkt[22] = (vad ? 0x80 : 0) | level;
+
+	/* payload */
+	pkt[28] = 0xfc;
+
+	return 32;
+}
+
+
+TEST(voe, aulevel_parse)
+{
+	uint8_t pkt[32];
+	uint8_t level = 0;
+	bool vad = false;
+	size_t len;
+
+	len = make_level_packet(pkt, 1, 42, true);
+
+	ASSERT_EQ(0, voe_aulevel_parse(&level, &vad, pkt, len, 1));
+	ASSERT_EQ(42, level);
+	ASSERT_TRUE(vad);
+
+	ASSERT_EQ(ENOENT, voe_aulevel_parse(&level, &vad, pkt, len, 2));
+	ASSERT_EQ(ENOENT, voe_aulevel_parse(&level, &vad, pkt, len, 0));
+	ASSERT_EQ(EBADMSG, voe_aulevel_parse(&level, &vad, pkt, 20, 1));
+	ASSERT_EQ(EINVAL, voe_aulevel_parse(&level, &vad, pkt, 8, 1));
+
+	/* no extension */
+	pkt[0] = 0x80;
+	ASSERT_EQ(ENOENT, voe_aulevel_parse(&level, &vad, pkt, len, 1));
+}
+
+
+TEST(voe, aulevel_rewrite)
+{
+	uint8_t pkt[32];
+	uint8_t level = 0;
+	size_t len;
+
+	len = make_level_packet(pkt, 1, 30, false);
+
+	ASSERT_EQ(0, voe_aulevel_rewrite(pkt, len, 1, 5));
+	ASSERT_EQ(ENOENT, voe_aulevel_parse(&level, NULL, pkt, len, 1));
+	ASSERT_EQ(0, voe_aulevel_parse(&level, NULL, pkt, len, 5));
+	ASSERT_EQ(30, level);
+
+	/* Stripping turns it into padding, the rest is untouched */
+	ASSERT_EQ(0, voe_aulevel_rewrite(pkt, len, 5, 0));
+	ASSERT_EQ(ENOENT, voe_aulevel_parse(&level, NULL, pkt, len, 5));
+	ASSERT_EQ(0, pkt[21]);
+	ASSERT_EQ(0, pkt[22]);
+	ASSERT_EQ(0x32, pkt[17]);
+	ASSERT_EQ(0xfc, pkt[28]);
+}
+
+
+static void feed_levels(struct voe_spksel *sel, const uint8_t *levelv,
+			int n, uint64_t *now, int ms)
+{
+	for (int t = 0; t < ms; t += 20) {
+		for (int i = 0; i < n; i++) {
+			if (levelv[i] < 128)
+				voe_spksel_level(sel, i, levelv[i], *now);
+		}
+		voe_spksel_update(sel, *now);
+		*now += 20;
+	}
+}
+
+
+TEST(voe, spksel_top_n)
+{
+	struct voe_spksel *sel = NULL;
+	uint8_t levelv[6] = {10, 20, 30, 40, 50, 60};
+	uint64_t now = 1000;
+	int i;
+
+	ASSERT_EQ(0, voe_spksel_alloc(&sel, 3));
+	for (i = 0; i < 6; i++)
+		ASSERT_EQ(0, voe_spksel_add(sel, i, true));
+
+	/* Everything is decoded until the levels are known */
+	for (i = 0; i < 6; i++)
+		ASSERT_TRUE(voe_spksel_decoding(sel, i));
+
+	feed_levels(sel, levelv, 6, &now, 2000);
+	for (i = 0; i < 6; i++)
+		ASSERT_EQ(i < 3, voe_spksel_decoding(sel, i));
+
+	/* A stream without levels is decoded without taking a slot */
+	ASSERT_EQ(0, voe_spksel_add(sel, 99, false));
+	feed_levels(sel, levelv, 6, &now, 200);
+	ASSERT_TRUE(voe_spksel_decoding(sel, 99));
+	ASSERT_TRUE(voe_spksel_decoding(sel, 2));
+
+	/* Stream 5 starts talking and replaces the quietest one */
+	levelv[5] = 5;
+	feed_levels(sel, levelv, 6, &now, 500);
+	ASSERT_TRUE(voe_spksel_decoding(sel, 5));
+	ASSERT_FALSE(voe_spksel_decoding(sel, 2));
+	ASSERT_TRUE(voe_spksel_decoding(sel, 0));
+	ASSERT_TRUE(voe_spksel_decoding(sel, 1));
+
+	/* Within the hysteresis nothing changes */
+	levelv[2] = 16;
+	feed_levels(sel, levelv, 6, &now, 3000);
+	ASSERT_FALSE(voe_spksel_decoding(sel, 2));
+
+	/* Stream 1 goes quiet (DTX) and makes room */
+	levelv[1] = 128;
+	feed_levels(sel, levelv, 6, &now, 1000);
+	ASSERT_FALSE(voe_spksel_decoding(sel, 1));
+	ASSERT_TRUE(voe_spksel_decoding(sel, 2));
+
+	/* 0 decodes everything */
+	voe_spksel_set_max(sel, 0);
+	feed_levels(sel, levelv, 6, &now, 20);
+	for (i = 0; i < 6; i++)
+		ASSERT_TRUE(voe_spksel_decoding(sel, i));
+
+	voe_spksel_remove(sel, 99);
+	ASSERT_TRUE(voe_spksel_decoding(sel, 99));
+
+	mem_deref(sel);
+}
+
+
+/* Stream 3 negotiated audio levels but its packets carry none. It must
+ * not be ranked as silent and dropped, it is decoded without a slot.
+ */
+TEST(voe, spksel_negotiated_without_levels)
+{
+	struct voe_spksel *sel = NULL;
+	uint8_t levelv[3] = {10, 20, 30};
+	uint64_t now = 1000;
+	int i, t;
+
+	ASSERT_EQ(0, voe_spksel_alloc(&sel, 2));
+	for (i = 0; i < 4; i++)
+		ASSERT_EQ(0, voe_spksel_add(sel, i, true));
+
+	for (t = 0; t < 2000; t += 20) {
+		for (i = 0; i < 3; i++)
+			voe_spksel_level(sel, i, levelv[i], now);
+		voe_spksel_nolevel(sel, 3, now);
+		voe_spksel_update(sel, now);
+		now += 20;
+	}
+
+	ASSERT_TRUE(voe_spksel_decoding(sel, 0));
+	ASSERT_TRUE(voe_spksel_decoding(sel, 1));
+	ASSERT_FALSE(voe_spksel_decoding(sel, 2));
+	ASSERT_TRUE(voe_spksel_decoding(sel, 3));
+
+	/* Once its levels show up, it is ranked like the others */
+	for (t = 0; t < 2000; t += 20) {
+		for (i = 0; i < 3; i++)
+			voe_spksel_level(sel, i, levelv[i], now);
+		voe_spksel_level(sel, 3, 40, now);
+		voe_spksel_update(sel, now);
+		now += 20;
+	}
+
+	ASSERT_TRUE(voe_spksel_decoding(sel, 0));
+	ASSERT_TRUE(voe_spksel_decoding(sel, 1));
+	ASSERT_FALSE(voe_spksel_decoding(sel, 2));
+	ASSERT_FALSE(voe_spksel_decoding(sel, 3));
+
+	/* A stream that stops sending altogether is silent (DTX) */
+	for (t = 0; t < 2000; t += 20) {
+		voe_spksel_level(sel, 0, levelv[0], now);
+		voe_spksel_level(sel, 2, levelv[2], now);
+		voe_spksel_update(sel, now);
+		now += 20;
+	}
+
+	ASSERT_TRUE(voe_spksel_decoding(sel, 0));
+	ASSERT_FALSE(voe_spksel_decoding(sel, 1));
+	ASSERT_TRUE(voe_spksel_decoding(sel, 2));
+	ASSERT_FALSE(voe_spksel_decoding(sel, 3));
+
+	mem_deref(sel);
+}
+
+/* A large conference: senders take turns talking with the next one in
+ * the background, the silent ones either send silence or nothing (DTX).
+ */
+TEST(voe, spksel_many_senders)
+{
+	const int num_senders = 40;
+	const int max_decode = 3;
+	const int turn_ms = 3000;
+	struct voe_spksel *sel = NULL;
+	uint64_t now = 0;
+	int checks = 0, talker_decoded = 0, max_decoded = 0;
+	int switches = 0;
+	bool prev[num_senders];
+	int i;
+
+	ASSERT_EQ(0, voe_spksel_alloc(&sel, max_decode));
+	for (i = 0; i < num_senders; i++) {
+		ASSERT_EQ(0, voe_spksel_add(sel, i, true));
+		prev[i] = true;
+	}
+
+	for (int t = 0; t < 2 * num_senders * turn_ms; t += 20) {
+		int turn = t / turn_ms;
+		int talker = turn % num_senders;
+		int decoded = 0;
+
+		now = t + 1;
+
+		for (i = 0; i < num_senders; i++) {
+			uint8_t level = 127;
+
+			if (i == talker)
+				level = 20 + rand() % 10;
+			else if (i == (turn + 1) % num_senders)
+				level = 45 + rand() % 10;
+			else if (i % 2)
+				continue;
+
+			voe_spksel_level(sel, i, level, now);
+		}
+		voe_spksel_update(sel, now);
+
+		for (i = 0; i < num_senders; i++) {
+			bool dec = voe_spksel_decoding(sel, i);
+
+			decoded += dec;
+			if (dec != prev[i])
+				++switches;
+			prev[i] = dec;
+		}
+
+		/* Let the first second settle */
+		if (t < 1000)
+			continue;
+
+		if (decoded > max_decoded)
+			max_decoded = decoded;
+
+		if (t % turn_ms == turn_ms / 2) {
+			++checks;
+			if (voe_spksel_decoding(sel, talker))
+				++talker_decoded;
+		}
+	}
+
+	ASSERT_LE(max_decoded, max_decode);
+	ASSERT_EQ(checks, talker_decoded);
+
+	/* The initial cut and a swap or two per turn, no flapping */
+	ASSERT_LE(switches, num_senders - max_decode + 4 * checks);
+
+	mem_deref(sel);
+}
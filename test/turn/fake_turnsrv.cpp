@@ -23,13 +23,68 @@
 #include "turn.h"
 
 
+/* A packet held back to simulate the round trip to a remote server */
+struct delayed {
+	struct le le;
+	struct tmr tmr;
+	TurnServer *turn;
+	struct sa src;
+	struct mbuf *mb;
+};
+
+
+static void delayed_destructor(void *arg)
+{
+	struct delayed *dl = (struct delayed *)arg;
+
+	tmr_cancel(&dl->tmr);
+	list_unlink(&dl->le);
+	mem_deref(dl->mb);
+}
+
+
+static void delayed_timeout(void *arg)
+{
+	struct delayed *dl = (struct delayed *)arg;
+	TurnServer *turn = dl->turn;
+
+	process_msg(turn->turnd, IPPROTO_UDP, turn->us, &dl->src,
+		    &turn->addr, dl->mb);
+
+	mem_deref(dl);
+}
+
+
 static void turnserver_udp_recv(const struct sa *src, struct mbuf *mb,
 				void *arg)
 {
 	TurnServer *turn = static_cast<TurnServer *>(arg);
+	struct delayed *dl;
 
 	turn->nrecv++;
 
+	if (turn->delay) {
+		dl = (struct delayed *)mem_zalloc(sizeof(*dl),
+						  delayed_destructor);
+		if (!dl)
+			return;
+
+		dl->turn = turn;
+		dl->src = *src;
+		dl->mb = mbuf_alloc(mbuf_get_left(mb));
+		if (!dl->mb) {
+			mem_deref(dl);
+			return;
+		}
+
+		mbuf_write_mem(dl->mb, mbuf_buf(mb), mbuf_get_left(mb));
+		dl->mb->pos = 0;
+
+		list_append(&turn->delayl, &dl->le, dl);
+		tmr_start(&dl->tmr, turn->delay, delayed_timeout, dl);
+		return;
+	}
+
 	process_msg(turn->turnd, IPPROTO_UDP, turn->us, src, &turn->addr, mb);
 }
 
@@ -115,6 +170,7 @@ TurnServer::TurnServer()
 
 TurnServer::~TurnServer()
 {
+	list_flush(&delayl);
 	restund_tcp_close(turnd);
 
 	mem_deref(turnd);
@@ -126,3 +182,10 @@ void TurnServer::set_sim_error(uint16_t sim_error)
 {
 	turnd->sim_error = sim_error;
 }
+
+
+/* Requests over UDP are handled after the given time */
+void TurnServer::set_delay(uint32_t ms)
+{
+	delay = ms;
+}
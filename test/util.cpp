@@ -143,6 +143,10 @@ int create_dtls_srtp_context(struct tls **dtlsp, enum tls_keytype cert_type)
 
 	tls_set_verify_client(dtls);
 
+	err = tls_set_session_reuse(dtls, true);
+	if (err)
+		goto out;
+
 	err = tls_set_srtp(dtls, "SRTP_AES128_CM_SHA1_80");
 	if (err)
 		goto out;